@@ -57,6 +57,7 @@ struct PartitionRoot;
 using ThreadSafePartitionRoot = PartitionRoot<internal::ThreadSafe>;
 using ThreadUnsafePartitionRoot = PartitionRoot<internal::NotThreadSafe>;
 
+class PartitionFragmentationStatsDumper;
 class PartitionStatsDumper;
 
 }  // namespace base
@@ -0,0 +1,162 @@
+// Copyright 2021 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// This program runs a synthetic allocation churn workload against a fresh
+// PartitionAlloc partition and prints a per-bucket fragmentation report. It is
+// meant for manual investigation of allocation patterns and bucket
+// distributions.
+//
+// Usage:
+// $ ninja -C out/foobar partition_alloc_fragmentation_dumper
+// $ out/foobar/partition_alloc_fragmentation_dumper --allocations=100000 \
+//     --min-size=16 --max-size=4096 --free-percent=75 --seed=1 --purge
+//
+// The workload makes --allocations allocations with sizes drawn uniformly from
+// [--min-size, --max-size], then frees a random --free-percent of them. With
+// --purge, empty slot spans are decommitted and unused system pages discarded
+// before the report is printed.
+//
+// For each bucket, the report lists the number of slot spans in use, their
+// occupancy histogram (in 10% increments), the resident size, the part of it
+// held by slot spans that are less than 25% occupied and the resident size the
+// bucket would need if its allocations were packed densely.
+
+#include <stdlib.h>
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "base/allocator/partition_allocator/partition_root.h"
+#include "base/allocator/partition_allocator/partition_stats.h"
+#include "base/command_line.h"
+#include "base/strings/string_number_conversions.h"
+
+namespace {
+
+class FragmentationReporter : public base::PartitionFragmentationStatsDumper {
+ public:
+  void PartitionDumpBucketFragmentationStats(
+      const char* partition_name,
+      const base::PartitionBucketFragmentationStats* stats) override {
+    std::cout << std::setw(9) << stats->bucket_slot_size << std::setw(7)
+              << stats->slots_per_span << std::setw(7) << stats->num_slot_spans
+              << std::setw(7) << stats->num_empty_slot_spans << "  ";
+    for (uint32_t count : stats->occupancy_histogram)
+      std::cout << std::setw(6) << count;
+    std::cout << std::setw(12) << stats->resident_bytes / 1024
+              << std::setw(14) << stats->mostly_empty_resident_bytes / 1024
+              << std::setw(12) << stats->ideal_packed_bytes / 1024 << std::endl;
+
+    total_resident_bytes_ += stats->resident_bytes;
+    total_mostly_empty_bytes_ += stats->mostly_empty_resident_bytes;
+    total_ideal_packed_bytes_ += stats->ideal_packed_bytes;
+  }
+
+  void PrintHeader() const {
+    std::cout << "# Sizes in KiB, histogram bins are occupancy in 10% steps."
+              << std::endl;
+    std::cout << "#  bucket  slots  spans  empty  ";
+    for (size_t i = 0;
+         i < base::PartitionBucketFragmentationStats::kOccupancyHistogramSize;
+         ++i) {
+      std::cout << std::setw(5)
+                << i * 100 / base::PartitionBucketFragmentationStats::
+                                 kOccupancyHistogramSize
+                << "%";
+    }
+    std::cout << "    resident" << std::setw(14) << "mostly_empty"
+              << std::setw(12) << "packed" << std::endl;
+  }
+
+  void PrintTotals() const {
+    std::cout << "# Total resident: " << total_resident_bytes_ / 1024
+              << " KiB, in mostly empty slot spans: "
+              << total_mostly_empty_bytes_ / 1024
+              << " KiB, densely packed: " << total_ideal_packed_bytes_ / 1024
+              << " KiB" << std::endl;
+  }
+
+ private:
+  size_t total_resident_bytes_ = 0;
+  size_t total_mostly_empty_bytes_ = 0;
+  size_t total_ideal_packed_bytes_ = 0;
+};
+
+bool GetSizeSwitch(const base::CommandLine& command_line,
+                   const char* name,
+                   size_t* value) {
+  std::string value_str = command_line.GetSwitchValueASCII(name);
+  if (value_str.empty())
+    return true;
+  if (base::StringToSizeT(value_str, value))
+    return true;
+  std::cout << "# invalid --" << name << " command line switch" << std::endl;
+  return false;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  base::CommandLine::Init(argc, argv);
+  const base::CommandLine& command_line =
+      *base::CommandLine::ForCurrentProcess();
+
+  size_t allocations = 100000;
+  size_t min_size = 16;
+  size_t max_size = 4096;
+  size_t free_percent = 75;
+  size_t seed = 1;
+  if (!GetSizeSwitch(command_line, "allocations", &allocations) ||
+      !GetSizeSwitch(command_line, "min-size", &min_size) ||
+      !GetSizeSwitch(command_line, "max-size", &max_size) ||
+      !GetSizeSwitch(command_line, "free-percent", &free_percent) ||
+      !GetSizeSwitch(command_line, "seed", &seed)) {
+    return EXIT_FAILURE;
+  }
+  if (min_size < 1 || min_size > max_size ||
+      max_size > base::MaxDirectMapped() || free_percent > 100) {
+    std::cout << "# invalid workload parameters" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  base::ThreadSafePartitionRoot root(
+      {base::PartitionOptions::AlignedAlloc::kDisallowed,
+       base::PartitionOptions::ThreadCache::kDisabled,
+       base::PartitionOptions::Quarantine::kDisallowed,
+       base::PartitionOptions::Cookie::kAllowed,
+       base::PartitionOptions::BackupRefPtr::kDisabled,
+       base::PartitionOptions::UseConfigurablePool::kNo,
+       base::PartitionOptions::LazyCommit::kEnabled});
+
+  std::mt19937_64 generator(seed);
+  std::uniform_int_distribution<size_t> size_distribution(min_size, max_size);
+  std::vector<void*> pointers(allocations);
+  for (void*& ptr : pointers) {
+    ptr = root.AllocFlagsNoHooks(0, size_distribution(generator),
+                                 base::PartitionPageSize());
+  }
+  std::shuffle(pointers.begin(), pointers.end(), generator);
+  const size_t freed = allocations * free_percent / 100;
+  for (size_t i = 0; i < freed; ++i)
+    base::ThreadSafePartitionRoot::FreeNoHooks(pointers[i]);
+  if (command_line.HasSwitch("purge")) {
+    root.PurgeMemory(base::PartitionPurgeDecommitEmptySlotSpans |
+                     base::PartitionPurgeDiscardUnusedSystemPages);
+  }
+
+  std::cout << "# " << allocations << " allocations of [" << min_size << ", "
+            << max_size << "] bytes, " << freed << " freed" << std::endl;
+  FragmentationReporter reporter;
+  reporter.PrintHeader();
+  root.DumpFragmentationStats("fragmentation_dumper", &reporter);
+  reporter.PrintTotals();
+
+  for (size_t i = freed; i < allocations; ++i)
+    base::ThreadSafePartitionRoot::FreeNoHooks(pointers[i]);
+  return EXIT_SUCCESS;
+}
@@ -2304,6 +2304,78 @@ TEST_F(PartitionAllocTest, DumpMemoryStats) {
   }
 }
 
+class MockPartitionFragmentationStatsDumper
+    : public PartitionFragmentationStatsDumper {
+ public:
+  void PartitionDumpBucketFragmentationStats(
+      const char* partition_name,
+      const PartitionBucketFragmentationStats* stats) override {
+    bucket_stats.push_back(*stats);
+  }
+
+  const PartitionBucketFragmentationStats* GetBucketStats(size_t bucket_size) {
+    for (auto& stat : bucket_stats) {
+      if (stat.bucket_slot_size == bucket_size)
+        return &stat;
+    }
+    return nullptr;
+  }
+
+ private:
+  std::vector<PartitionBucketFragmentationStats> bucket_stats;
+};
+
+// Tests that |DumpFragmentationStats| reports the occupancy of slot spans.
+TEST_F(PartitionAllocTest, DumpFragmentationStats) {
+  const size_t size = 2048 - kExtraAllocSize;
+  const size_t num_slots =
+      allocator.root()->buckets[SizeToIndex(2048)].get_slots_per_span();
+  ASSERT_GT(num_slots, 4u);
+
+  // Fill two slot spans, then free all but one slot of the second one.
+  std::vector<void*> ptrs;
+  for (size_t i = 0; i < 2 * num_slots; ++i)
+    ptrs.push_back(allocator.root()->Alloc(size, type_name));
+  for (size_t i = num_slots + 1; i < 2 * num_slots; ++i)
+    allocator.root()->Free(ptrs[i]);
+
+  {
+    MockPartitionFragmentationStatsDumper dumper;
+    allocator.root()->DumpFragmentationStats("mock_allocator", &dumper);
+    const PartitionBucketFragmentationStats* stats =
+        dumper.GetBucketStats(2048);
+    ASSERT_TRUE(stats);
+    EXPECT_EQ(num_slots, stats->slots_per_span);
+    EXPECT_EQ(2u, stats->num_slot_spans);
+    EXPECT_EQ(0u, stats->num_empty_slot_spans);
+    EXPECT_EQ(num_slots + 1, stats->allocated_slots);
+    const size_t histogram_size =
+        PartitionBucketFragmentationStats::kOccupancyHistogramSize;
+    EXPECT_EQ(1u, stats->occupancy_histogram[histogram_size / num_slots]);
+    EXPECT_EQ(1u, stats->occupancy_histogram[histogram_size - 1]);
+    const size_t span_bytes = RoundUpToSystemPage(num_slots * 2048);
+    EXPECT_EQ(2 * span_bytes, stats->resident_bytes);
+    EXPECT_EQ(span_bytes, stats->mostly_empty_resident_bytes);
+    EXPECT_EQ(span_bytes + SystemPageSize(), stats->ideal_packed_bytes);
+  }
+
+  // Empty slot spans are reported separately.
+  allocator.root()->Free(ptrs[num_slots]);
+  {
+    MockPartitionFragmentationStatsDumper dumper;
+    allocator.root()->DumpFragmentationStats("mock_allocator", &dumper);
+    const PartitionBucketFragmentationStats* stats =
+        dumper.GetBucketStats(2048);
+    ASSERT_TRUE(stats);
+    EXPECT_EQ(1u, stats->num_slot_spans);
+    EXPECT_EQ(1u, stats->num_empty_slot_spans);
+    EXPECT_EQ(0u, stats->mostly_empty_resident_bytes);
+  }
+
+  for (size_t i = 0; i < num_slots; ++i)
+    allocator.root()->Free(ptrs[i]);
+}
+
 // Tests the API to purge freeable memory.
 TEST_F(PartitionAllocTest, Purge) {
   char* ptr = reinterpret_cast<char*>(
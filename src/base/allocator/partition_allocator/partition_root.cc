@@ -16,6 +16,7 @@
 #include "base/allocator/partition_allocator/partition_cookie.h"
 #include "base/allocator/partition_allocator/partition_oom.h"
 #include "base/allocator/partition_allocator/partition_page.h"
+#include "base/allocator/partition_allocator/partition_stats.h"
 #include "base/allocator/partition_allocator/reservation_offset_table.h"
 #include "base/allocator/partition_allocator/starscan/pcscan.h"
 #include "base/bits.h"
@@ -446,6 +447,40 @@ static void PartitionDumpBucketStats(
   }
 }
 
+template <bool thread_safe>
+static void PartitionAccountSlotSpanFragmentation(
+    PartitionBucketFragmentationStats* stats_out,
+    const internal::SlotSpanMetadata<thread_safe>* slot_span) {
+  if (slot_span->is_decommitted())
+    return;
+
+  const size_t slot_size = slot_span->bucket->slot_size;
+  const size_t slots_per_span = slot_span->bucket->get_slots_per_span();
+  const size_t resident_bytes = RoundUpToSystemPage(
+      (slots_per_span - slot_span->num_unprovisioned_slots) * slot_size);
+  stats_out->resident_bytes += resident_bytes;
+  if (slot_span->is_empty()) {
+    ++stats_out->num_empty_slot_spans;
+    return;
+  }
+
+  // Full slot spans that were detached from the active list have their
+  // allocated slot count negated, see
+  // PartitionBucket::SetNewActiveSlotSpan().
+  const size_t allocated_slots = std::abs(slot_span->num_allocated_slots);
+  ++stats_out->num_slot_spans;
+  stats_out->allocated_slots += allocated_slots;
+  const size_t histogram_size =
+      PartitionBucketFragmentationStats::kOccupancyHistogramSize;
+  ++stats_out->occupancy_histogram[std::min(
+      allocated_slots * histogram_size / slots_per_span, histogram_size - 1)];
+  if (allocated_slots * 100 <
+      slots_per_span *
+          PartitionBucketFragmentationStats::kMostlyEmptyOccupancyPercent) {
+    stats_out->mostly_empty_resident_bytes += resident_bytes;
+  }
+}
+
 #if DCHECK_IS_ON()
 void DCheckIfManagedByPartitionAllocBRPPool(void* ptr) {
   PA_DCHECK(IsManagedByPartitionAllocBRPPool(ptr));
@@ -1123,6 +1158,62 @@ void PartitionRoot<thread_safe>::DumpStats(const char* partition_name,
   dumper->PartitionDumpTotals(partition_name, &stats);
 }
 
+template <bool thread_safe>
+void PartitionRoot<thread_safe>::DumpFragmentationStats(
+    const char* partition_name,
+    PartitionFragmentationStatsDumper* dumper) {
+  // Allocate before locking below, see DumpStats().
+  std::unique_ptr<PartitionBucketFragmentationStats[]> bucket_stats(
+      new PartitionBucketFragmentationStats[kNumBuckets]());
+
+  // Super pages are never released, and extents are only ever appended to the
+  // list or grown, so they can be walked one super page at a time without
+  // holding the lock throughout.
+  SuperPageExtentEntry* extent;
+  {
+    ScopedGuard guard{lock_};
+    extent = first_extent;
+  }
+  while (extent) {
+    for (size_t super_page_index = 0;; ++super_page_index) {
+      ScopedGuard guard{lock_};
+      if (super_page_index >= extent->number_of_consecutive_super_pages)
+        break;
+      char* super_page = internal::SuperPagesBeginFromExtent(extent) +
+                         super_page_index * kSuperPageSize;
+      internal::IterateSlotSpans<thread_safe>(
+          super_page, IsQuarantineAllowed(),
+          [this, &bucket_stats](SlotSpan* slot_span) {
+            const size_t bucket_index = slot_span->bucket - buckets;
+            PA_DCHECK(bucket_index < kNumBuckets);
+            internal::PartitionAccountSlotSpanFragmentation(
+                &bucket_stats[bucket_index], slot_span);
+            return false;
+          });
+    }
+    ScopedGuard guard{lock_};
+    extent = extent->next;
+  }
+
+  // Do not hold the lock when calling |dumper|, as it may allocate.
+  for (size_t i = 0; i < kNumBuckets; ++i) {
+    PartitionBucketFragmentationStats& stats = bucket_stats[i];
+    if (!stats.num_slot_spans && !stats.num_empty_slot_spans)
+      continue;
+    const Bucket& bucket = bucket_at(i);
+    stats.bucket_slot_size = bucket.slot_size;
+    stats.slots_per_span = bucket.get_slots_per_span();
+    const size_t full_span_resident_bytes =
+        RoundUpToSystemPage(stats.slots_per_span * bucket.slot_size);
+    stats.ideal_packed_bytes =
+        stats.allocated_slots / stats.slots_per_span *
+            full_span_resident_bytes +
+        RoundUpToSystemPage(stats.allocated_slots % stats.slots_per_span *
+                            bucket.slot_size);
+    dumper->PartitionDumpBucketFragmentationStats(partition_name, &stats);
+  }
+}
+
 template <bool thread_safe>
 void PartitionRoot<thread_safe>::DeleteForTesting(
     PartitionRoot* partition_root) {
@@ -73,6 +73,7 @@
 
 namespace base {
 
+class PartitionFragmentationStatsDumper;
 class PartitionStatsDumper;
 
 namespace internal {
@@ -479,6 +480,13 @@ struct alignas(64) BASE_EXPORT PartitionRoot {
                  bool is_light_dump,
                  PartitionStatsDumper* partition_stats_dumper);
 
+  // Walks the super pages and reports how fragmented the slot spans of each
+  // bucket are. The lock is only held while a single super page is walked, so
+  // allocations can proceed in between. As a consequence, the stats of
+  // different super pages may be taken at slightly different times.
+  void DumpFragmentationStats(const char* partition_name,
+                              PartitionFragmentationStatsDumper* dumper);
+
   static void DeleteForTesting(PartitionRoot* partition_root);
   void ResetBookkeepingForTesting();
 
@@ -93,6 +93,41 @@ struct PartitionBucketMemoryStats {
                                         // and decommitted.
 };
 
+// Struct used to retrieve fragmentation statistics about a partition bucket.
+// Used by PartitionFragmentationStatsDumper implementations. Only committed
+// slot spans are taken into account. Slots cached by thread caches count as
+// allocated.
+struct PartitionBucketFragmentationStats {
+  // Slot spans are binned by occupancy (allocated slots / slots per span) in
+  // 10% increments. Full slot spans are in the last bin.
+  static constexpr size_t kOccupancyHistogramSize = 10;
+  // Slot spans below this occupancy are considered mostly empty.
+  static constexpr size_t kMostlyEmptyOccupancyPercent = 25;
+
+  uint32_t bucket_slot_size;     // The size of the slot in bytes.
+  uint32_t slots_per_span;       // Number of slots in a slot span.
+  uint32_t num_slot_spans;       // Number of slot spans with at least one
+                                 // allocated slot.
+  uint32_t num_empty_slot_spans;  // Number of committed, empty slot spans.
+  uint32_t occupancy_histogram[kOccupancyHistogramSize];
+  size_t allocated_slots;  // Total number of allocated slots.
+  size_t resident_bytes;   // Total bytes provisioned in the bucket.
+  size_t mostly_empty_resident_bytes;  // Bytes provisioned by mostly empty
+                                       // slot spans.
+  size_t ideal_packed_bytes;  // Bytes that would be provisioned if the
+                              // allocated slots were packed into as few slot
+                              // spans as possible.
+};
+
+// Interface that is passed to PartitionRoot::DumpFragmentationStats.
+class BASE_EXPORT PartitionFragmentationStatsDumper {
+ public:
+  // Called for each bucket that has committed slot spans.
+  virtual void PartitionDumpBucketFragmentationStats(
+      const char* partition_name,
+      const PartitionBucketFragmentationStats*) = 0;
+};
+
 // Interface that is passed to PartitionDumpStats and
 // PartitionDumpStats for using the memory statistics.
 class BASE_EXPORT PartitionStatsDumper {
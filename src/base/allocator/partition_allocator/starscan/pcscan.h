@@ -68,6 +68,11 @@ class BASE_EXPORT PCScan final {
       kDisabled,
       kEnabled,
     } safepoint = SafepointMode::kDisabled;
+
+    // Number of threads, including the PCScan thread, that clear, scan and
+    // sweep the heap. Additional threads pick super pages from the same
+    // worklists as the PCScan thread. Zero means one thread per processor.
+    size_t scanner_threads = 1;
   };
 
   PCScan(const PCScan&) = delete;
@@ -143,6 +148,7 @@ class BASE_EXPORT PCScan final {
   class PCScanThread;
   friend class PCScanTask;
   friend class PartitionAllocPCScanTest;
+  friend class PartitionAllocPCScanPerfTest;
   friend class PCScanInternal;
 
   enum class State : uint8_t {
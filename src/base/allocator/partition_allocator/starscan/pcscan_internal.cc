@@ -241,6 +241,8 @@ SimdSupport DetectSimdSupport() {
   return SimdSupport::kNEON;
 #else
   base::CPU cpu;
+  if (cpu.has_avx512f())
+    return SimdSupport::kAVX512;
   if (cpu.has_avx2())
     return SimdSupport::kAVX2;
   if (cpu.has_sse41())
@@ -557,6 +559,12 @@ class PCScanTask final : public base::RefCountedThreadSafe<PCScanTask>,
                      uintptr_t* end,
                      size_t slot_size);
 
+  // Runs |function| on the current thread and on additional scanner threads
+  // (see PCScan::InitConfig::scanner_threads). Returns when all threads are
+  // done.
+  template <typename Function>
+  void RunOnScannerThreads(Function function);
+
   // Scans all registered partitions and marks reachable quarantined objects.
   void ScanPartitions();
 
@@ -806,6 +814,32 @@ PCScanTask::PCScanTask(PCScan& pcscan, size_t quarantine_last_size)
           PCScanInternal::Instance().IsImmediateFreeingEnabled()),
       pcscan_(pcscan) {}
 
+template <typename Function>
+void PCScanTask::RunOnScannerThreads(Function function) {
+  const size_t helper_threads =
+      PCScanInternal::Instance().scanner_threads() - 1;
+  if (!helper_threads) {
+    function();
+    return;
+  }
+
+  std::vector<std::thread, MetadataAllocator<std::thread>> helpers;
+  {
+    // std::thread allocates its state with malloc().
+    ScopedAllowAllocations allow_allocations_within_std_thread;
+    helpers.reserve(helper_threads);
+    for (size_t i = 0; i < helper_threads; ++i) {
+      helpers.emplace_back([&function] {
+        ReentrantScannerGuard reentrancy_guard;
+        function();
+      });
+    }
+  }
+  function();
+  for (auto& helper : helpers)
+    helper.join();
+}
+
 void PCScanTask::ScanStack() {
   const auto& pcscan = PCScanInternal::Instance();
   if (!pcscan.IsStackScanningEnabled())
@@ -987,31 +1021,40 @@ void PCScanTask::SweepQuarantine() {
       (pcscan_epoch_ % kDiscardMarkedQuarantineFrequency == 0) &&
       (pcscan_.clear_type_ == PCScan::ClearType::kEager);
 
-  SweepStat stat;
-  StarScanSnapshot::SweepingView sweeping_view(*snapshot_);
-  sweeping_view.VisitNonConcurrently(
-      [this, &stat, should_discard](uintptr_t super_page) {
-        void* super_page_as_void = reinterpret_cast<void*>(super_page);
-        auto* root = ThreadSafePartitionRoot::FromSuperPage(
-            static_cast<char*>(super_page_as_void));
-
-        if (UNLIKELY(should_discard && !root->allow_cookie))
-          SweepSuperPageAndDiscardMarkedQuarantine(root, super_page_as_void,
-                                                   pcscan_epoch_, stat);
-        else
-          SweepSuperPage(root, super_page_as_void, pcscan_epoch_, stat);
-      });
-
-  stats_.IncreaseSweptSize(stat.swept_bytes);
-  stats_.IncreaseDiscardedQuarantineSize(stat.discarded_bytes);
+  std::atomic<size_t> swept_bytes{0u};
+  std::atomic<size_t> discarded_bytes{0u};
+  RunOnScannerThreads([this, should_discard, &swept_bytes, &discarded_bytes] {
+    SweepStat stat;
+    // Freeing is not idempotent, so every super page must be swept by exactly
+    // one thread.
+    StarScanSnapshot::SweepingView sweeping_view(*snapshot_);
+    sweeping_view.VisitConcurrentlyExclusively(
+        [this, &stat, should_discard](uintptr_t super_page) {
+          void* super_page_as_void = reinterpret_cast<void*>(super_page);
+          auto* root = ThreadSafePartitionRoot::FromSuperPage(
+              static_cast<char*>(super_page_as_void));
+
+          if (UNLIKELY(should_discard && !root->allow_cookie))
+            SweepSuperPageAndDiscardMarkedQuarantine(root, super_page_as_void,
+                                                     pcscan_epoch_, stat);
+          else
+            SweepSuperPage(root, super_page_as_void, pcscan_epoch_, stat);
+        });
+    swept_bytes.fetch_add(stat.swept_bytes, std::memory_order_relaxed);
+    discarded_bytes.fetch_add(stat.discarded_bytes, std::memory_order_relaxed);
 
 #if defined(PA_THREAD_CACHE_SUPPORTED)
-  // Sweeping potentially frees into the current thread's thread cache. Purge
-  // releases the cache back to the global allocator.
-  auto* current_thread_tcache = ThreadCache::Get();
-  if (ThreadCache::IsValid(current_thread_tcache))
-    current_thread_tcache->Purge();
+    // Sweeping potentially frees into the current thread's thread cache. Purge
+    // releases the cache back to the global allocator.
+    auto* current_thread_tcache = ThreadCache::Get();
+    if (ThreadCache::IsValid(current_thread_tcache))
+      current_thread_tcache->Purge();
 #endif  // defined(PA_THREAD_CACHE_SUPPORTED)
+  });
+
+  stats_.IncreaseSweptSize(swept_bytes.load(std::memory_order_relaxed));
+  stats_.IncreaseDiscardedQuarantineSize(
+      discarded_bytes.load(std::memory_order_relaxed));
 }
 
 void PCScanTask::FinishScanner() {
@@ -1074,13 +1117,14 @@ void PCScanTask::RunFromScanner() {
         // Clear all quarantined objects and prepare the card table.
         StatsCollector::ScannerScope clear_scope(
             stats_, StatsCollector::ScannerId::kClear);
-        ClearQuarantinedObjectsAndPrepareCardTable();
+        RunOnScannerThreads(
+            [this] { ClearQuarantinedObjectsAndPrepareCardTable(); });
       }
       {
         // Scan heap for dangling references.
         StatsCollector::ScannerScope scan_scope(
             stats_, StatsCollector::ScannerId::kScan);
-        ScanPartitions();
+        RunOnScannerThreads([this] { ScanPartitions(); });
       }
       {
         // Unprotect all scanned pages, if needed.
@@ -1228,6 +1272,12 @@ void PCScanInternal::Initialize(PCScan::InitConfig config) {
   if (config.safepoint == PCScan::InitConfig::SafepointMode::kEnabled) {
     PCScan::Instance().EnableSafepoints();
   }
+  const size_t number_of_processors =
+      std::max(std::thread::hardware_concurrency(), 1u);
+  scanner_threads_ =
+      config.scanner_threads
+          ? std::min<size_t>(config.scanner_threads, number_of_processors)
+          : number_of_processors;
   scannable_roots_ = RootsMap();
   nonscannable_roots_ = RootsMap();
   // Don't initialize PCScanThread::Instance() as otherwise sandbox complains
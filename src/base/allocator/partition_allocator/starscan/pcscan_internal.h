@@ -87,6 +87,8 @@ class PCScanInternal final {
 
   SimdSupport simd_support() const { return simd_support_; }
 
+  size_t scanner_threads() const { return scanner_threads_; }
+
   void EnableStackScanning();
   void DisableStackScanning();
   bool IsStackScanningEnabled() const;
@@ -140,6 +142,7 @@ class PCScanInternal final {
 
   const char* process_name_ = nullptr;
   const SimdSupport simd_support_;
+  size_t scanner_threads_ = 1;
 
   std::unique_ptr<WriteProtector> write_protector_;
   StatsReporter* stats_reporter_;
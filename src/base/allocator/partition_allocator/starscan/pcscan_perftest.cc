@@ -0,0 +1,198 @@
+// Copyright 2021 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <algorithm>
+#include <string>
+#include <thread>
+
+#include "base/allocator/partition_allocator/partition_alloc.h"
+#include "base/allocator/partition_allocator/partition_alloc_config.h"
+#include "base/allocator/partition_allocator/partition_root.h"
+#include "base/allocator/partition_allocator/starscan/pcscan.h"
+#include "base/allocator/partition_allocator/starscan/stats_collector.h"
+#include "base/allocator/partition_allocator/starscan/stats_reporter.h"
+#include "base/cxx17_backports.h"
+#include "base/logging.h"
+#include "base/strings/stringprintf.h"
+#include "base/system/sys_info.h"
+#include "base/time/time.h"
+#include "build/build_config.h"
+#include "testing/gtest/include/gtest/gtest.h"
+#include "testing/perf/perf_result_reporter.h"
+
+// PCScan requires the 64-bit GigaCage, and the larger heaps don't fit on
+// memory-constrained devices.
+#if defined(PA_ALLOW_PCSCAN) && defined(PA_HAS_64_BITS_POINTERS) && \
+    !defined(OS_ANDROID) && !defined(MEMORY_TOOL_REPLACES_ALLOCATOR)
+
+namespace base {
+namespace internal {
+
+class PartitionAllocPCScanPerfTest
+    : public testing::TestWithParam<std::tuple<size_t, size_t>> {
+ public:
+  PartitionAllocPCScanPerfTest() {
+    PartitionAllocGlobalInit([](size_t) { LOG(FATAL) << "Out of memory"; });
+  }
+  ~PartitionAllocPCScanPerfTest() override {
+    PartitionAllocGlobalUninitForTesting();
+  }
+
+  void ReinitPCScan(PCScan::InitConfig config) {
+    PCScan::ReinitForTesting(config);
+  }
+};
+
+namespace {
+
+constexpr char kMetricPrefixStarScan[] = "StarScan.";
+constexpr char kMetricScanBandwidth[] = "scan_bandwidth";
+constexpr char kMetricPauseTime[] = "pause_time";
+constexpr char kMetricSweepTime[] = "sweep_time";
+
+// Objects are small enough to be scanned by the vectorized loop (see
+// kLargeScanAreaThresholdInWords in pcscan_internal.cc).
+constexpr size_t kObjectSize = 256;
+// Every Nth object is freed (quarantined) before scanning.
+constexpr size_t kQuarantineEveryNth = 8;
+
+perf_test::PerfResultReporter SetUpReporter(const std::string& story_name) {
+  perf_test::PerfResultReporter reporter(kMetricPrefixStarScan, story_name);
+  reporter.RegisterImportantMetric(kMetricScanBandwidth, "GB/s");
+  reporter.RegisterImportantMetric(kMetricPauseTime, "ms");
+  reporter.RegisterFyiMetric(kMetricSweepTime, "ms");
+  return reporter;
+}
+
+// Collects the duration of the scanner phases of the last PCScan cycle.
+class PhaseTimeReporter final : public StatsReporter {
+ public:
+  void ReportTraceEvent(StatsCollector::ScannerId id,
+                        const PlatformThreadId tid,
+                        TimeTicks start_time,
+                        TimeTicks end_time) override {
+    if (id == StatsCollector::ScannerId::kScan)
+      scan_time_ = end_time - start_time;
+    else if (id == StatsCollector::ScannerId::kSweep)
+      sweep_time_ = end_time - start_time;
+  }
+
+  TimeDelta scan_time() const { return scan_time_; }
+  TimeDelta sweep_time() const { return sweep_time_; }
+
+ private:
+  TimeDelta scan_time_;
+  TimeDelta sweep_time_;
+};
+
+// PCScan keeps the registered reporter forever.
+PhaseTimeReporter& GetPhaseTimeReporter() {
+  static PhaseTimeReporter reporter;
+  return reporter;
+}
+
+struct Node {
+  Node* next;
+  // Mix of in-cage pointers, which take the slow path in the scan loop, and
+  // plain integers, which are filtered out by the vector comparison.
+  uintptr_t payload[kObjectSize / sizeof(uintptr_t) - 1];
+};
+static_assert(sizeof(Node) == kObjectSize, "");
+
+size_t NumberOfScannerThreads() {
+  return std::max(std::thread::hardware_concurrency(), 1u);
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    ,
+    PartitionAllocPCScanPerfTest,
+    ::testing::Combine(
+        // Heap size in MiB.
+        ::testing::Values(256, 1024, 4096, 8192),
+        // Number of scanner threads. Zero means one per processor.
+        ::testing::Values(1, 0)));
+
+TEST_P(PartitionAllocPCScanPerfTest, ScanHeap) {
+  const size_t heap_size_in_mib = std::get<0>(GetParam());
+  const size_t heap_size = heap_size_in_mib * 1024 * 1024;
+  // Keep some headroom for the scanner metadata and the rest of the process.
+  if (heap_size > static_cast<uint64_t>(SysInfo::AmountOfPhysicalMemory()) / 2)
+    GTEST_SKIP() << "Not enough physical memory";
+
+  PCScan::InitConfig config;
+  config.scanner_threads = std::get<1>(GetParam());
+  ReinitPCScan(config);
+  PhaseTimeReporter& phase_time_reporter = GetPhaseTimeReporter();
+  PCScan::RegisterStatsReporter(&phase_time_reporter);
+
+  ThreadSafePartitionRoot root({PartitionOptions::AlignedAlloc::kDisallowed,
+                                PartitionOptions::ThreadCache::kDisabled,
+                                PartitionOptions::Quarantine::kAllowed,
+                                PartitionOptions::Cookie::kDisallowed,
+                                PartitionOptions::BackupRefPtr::kDisabled,
+                                PartitionOptions::UseConfigurablePool::kNo,
+                                PartitionOptions::LazyCommit::kEnabled});
+  PCScan::RegisterScannableRoot(&root);
+  // Don't let MoveToQuarantine() schedule scans while the heap is populated.
+  PCScan::Disable();
+
+  const size_t num_objects = heap_size / kObjectSize;
+  Node* head = nullptr;
+  for (size_t i = 0; i < num_objects; ++i) {
+    auto* node = static_cast<Node*>(root.AllocFlagsNoHooks(0, sizeof(Node),
+                                                           PartitionPageSize()));
+    CHECK(node);
+    node->next = head;
+    for (size_t word = 0; word < base::size(node->payload); ++word) {
+      node->payload[word] =
+          word % 2 ? reinterpret_cast<uintptr_t>(head) : i + word;
+    }
+    head = node;
+  }
+
+  // Quarantine every Nth object. References from the remaining objects keep
+  // some of them alive, which exercises marking.
+  size_t index = 0;
+  for (Node* node = head; node; ++index) {
+    Node* next = node->next;
+    if (next && index % kQuarantineEveryNth == 0) {
+      node->next = next->next;
+      ThreadSafePartitionRoot::FreeNoHooks(next);
+      next = node->next;
+    }
+    node = next;
+  }
+
+  const size_t committed_size = root.get_total_size_of_committed_pages();
+  const TimeTicks start = TimeTicks::Now();
+  PCScan::PerformScan(PCScan::InvocationMode::kForcedBlocking);
+  const TimeDelta pause_time = TimeTicks::Now() - start;
+
+  const double scan_bandwidth =
+      committed_size / phase_time_reporter.scan_time().InSecondsF() / 1e9;
+  auto reporter = SetUpReporter(StringPrintf(
+      "%zuMiB_%zuThreads", heap_size_in_mib,
+      config.scanner_threads ? config.scanner_threads
+                             : NumberOfScannerThreads()));
+  reporter.AddResult(kMetricScanBandwidth, scan_bandwidth);
+  reporter.AddResult(kMetricPauseTime, pause_time.InMillisecondsF());
+  reporter.AddResult(kMetricSweepTime,
+                     phase_time_reporter.sweep_time().InMillisecondsF());
+
+  while (head) {
+    Node* next = head->next;
+    ThreadSafePartitionRoot::FreeNoHooks(head);
+    head = next;
+  }
+  PCScan::PerformScan(PCScan::InvocationMode::kForcedBlocking);
+  root.PurgeMemory(PartitionPurgeDecommitEmptySlotSpans |
+                   PartitionPurgeDiscardUnusedSystemPages);
+  PCScan::Reenable();
+}
+
+}  // namespace
+}  // namespace internal
+}  // namespace base
+
+#endif  // defined(PA_ALLOW_PCSCAN) && defined(PA_HAS_64_BITS_POINTERS) && ...
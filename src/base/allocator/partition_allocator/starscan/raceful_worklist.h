@@ -46,9 +46,17 @@ class RacefulWorklist {
     RandomizedView(const RandomizedView&) = delete;
     const RandomizedView& operator=(const RandomizedView&) = delete;
 
+    // Visits items racefully: an item that is being visited by another thread
+    // may be visited again by this one. Only suitable for idempotent visitors.
     template <typename Function>
     void Visit(Function f);
 
+    // Visits items so that every item is visited by exactly one thread. Items
+    // claimed by other threads are skipped, which means that once this returns
+    // other threads may still be visiting the remaining items.
+    template <typename Function>
+    void VisitExclusively(Function f);
+
    private:
     RacefulWorklist& worklist_;
     size_t offset_;
@@ -138,6 +146,32 @@ void RacefulWorklist<T>::RandomizedView::Visit(Function f) {
   worklist_.fully_visited_.store(true, std::memory_order_release);
 }
 
+template <typename T>
+template <typename Function>
+void RacefulWorklist<T>::RandomizedView::VisitExclusively(Function f) {
+  auto& data = worklist_.data_;
+
+  if (worklist_.fully_visited_.load(std::memory_order_acquire))
+    return;
+
+  const auto try_visit = [&f](Node& node) {
+    if (node.is_visited.load(std::memory_order_relaxed))
+      return;
+    // Claim the item. Unlike Visit(), the claim must be an atomic rmw so that
+    // two threads never visit the same item.
+    if (node.is_being_visited.exchange(true, std::memory_order_relaxed))
+      return;
+    f(node.value);
+    node.is_visited.store(true, std::memory_order_relaxed);
+  };
+
+  const auto offset_it = std::next(data.begin(), offset_);
+  std::for_each(offset_it, data.end(), try_visit);
+  std::for_each(data.begin(), offset_it, try_visit);
+
+  worklist_.fully_visited_.store(true, std::memory_order_release);
+}
+
 }  // namespace internal
 }  // namespace base
 #endif  // BASE_ALLOCATOR_PARTITION_ALLOCATOR_STARSCAN_RACEFUL_WORKLIST_H_
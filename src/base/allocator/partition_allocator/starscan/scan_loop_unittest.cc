@@ -138,6 +138,43 @@ TEST(PartitionAllocScanLoopTest, VectorizedAVX2) {
                                  kValidPtr, kValidPtr);
   }
 }
+
+TEST(PartitionAllocScanLoopTest, VectorizedAVX512) {
+  base::CPU cpu;
+  if (!cpu.has_avx512f())
+    return;
+  {
+    TestScanLoop sl(SimdSupport::kAVX512);
+    TestOnRangeWithAlignment<32>(sl, 0u, kInvalidPtr, kInvalidPtr, kInvalidPtr,
+                                 kInvalidPtr, kInvalidPtr, kInvalidPtr,
+                                 kInvalidPtr, kInvalidPtr, kInvalidPtr);
+  }
+  {
+    TestScanLoop sl(SimdSupport::kAVX512);
+    TestOnRangeWithAlignment<32>(sl, 1u, kValidPtr, kInvalidPtr, kInvalidPtr,
+                                 kInvalidPtr, kInvalidPtr, kInvalidPtr,
+                                 kInvalidPtr, kInvalidPtr, kInvalidPtr);
+  }
+  {
+    TestScanLoop sl(SimdSupport::kAVX512);
+    TestOnRangeWithAlignment<32>(sl, 4u, kValidPtr, kValidPtr, kValidPtr,
+                                 kValidPtr, kInvalidPtr, kInvalidPtr,
+                                 kInvalidPtr, kInvalidPtr, kZeroPtr);
+  }
+  {
+    TestScanLoop sl(SimdSupport::kAVX512);
+    TestOnRangeWithAlignment<32>(sl, 8u, kValidPtr, kValidPtr, kValidPtr,
+                                 kValidPtr, kValidPtr, kValidPtr, kValidPtr,
+                                 kValidPtr, kInvalidPtr);
+  }
+  {
+    // Check that the residual pointer is also visited.
+    TestScanLoop sl(SimdSupport::kAVX512);
+    TestOnRangeWithAlignment<32>(sl, 9u, kValidPtr, kValidPtr, kValidPtr,
+                                 kValidPtr, kValidPtr, kValidPtr, kValidPtr,
+                                 kValidPtr, kValidPtr);
+  }
+}
 #endif  // defined(ARCH_CPU_X86_64)
 
 #if defined(PA_STARSCAN_NEON_SUPPORTED)
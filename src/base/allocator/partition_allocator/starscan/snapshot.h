@@ -26,6 +26,12 @@ class StarScanSnapshot final : public AllocatedOnPCScanMetadataPartition {
     template <typename Function>
     void VisitConcurrently(Function);
 
+    // Same as VisitConcurrently(), but guarantees that each super page is
+    // visited by exactly one thread. Used for non-idempotent visitors, such as
+    // sweeping.
+    template <typename Function>
+    void VisitConcurrentlyExclusively(Function);
+
     template <typename Function>
     void VisitNonConcurrently(Function);
 
@@ -75,6 +81,12 @@ void StarScanSnapshot::ViewBase::VisitConcurrently(Function f) {
   view.Visit(std::move(f));
 }
 
+template <typename Function>
+void StarScanSnapshot::ViewBase::VisitConcurrentlyExclusively(Function f) {
+  SuperPagesWorklist::RandomizedView view(worklist_);
+  view.VisitExclusively(std::move(f));
+}
+
 template <typename Function>
 void StarScanSnapshot::ViewBase::VisitNonConcurrently(Function f) {
   worklist_.VisitNonConcurrently(std::move(f));
@@ -35,7 +35,8 @@ class HistogramCache {
       case HISTOGRAM:
       case LINEAR_HISTOGRAM:
       case BOOLEAN_HISTOGRAM:
-      case CUSTOM_HISTOGRAM: {
+      case CUSTOM_HISTOGRAM:
+      case HDR_HISTOGRAM: {
         Histogram* hist = static_cast<Histogram*>(histogram);
         params_str += StringPrintf("/%d/%d/%d", hist->declared_min(),
                                    hist->declared_max(), hist->bucket_count());
@@ -168,6 +168,12 @@ const char kForceFieldTrialParams[] = "force-fieldtrial-params";
 // This flag requires the BPF sandbox to be disabled.
 const char kEnableThreadInstructionCount[] = "enable-thread-instruction-count";
 
+// Enables the per-task performance counters of TaskAnnotator, which count the
+// instructions, cycles, cache misses and context switches of every task.
+//
+// This flag requires the BPF sandbox to be disabled.
+const char kEnableTaskPerfCounters[] = "enable-task-perf-counters";
+
 // TODO(crbug.com/1176772): Remove kEnableCrashpad and IsCrashpadEnabled() when
 // Crashpad is fully enabled on Linux. Indicates that Crashpad should be
 // enabled.
@@ -61,6 +61,7 @@ extern const char kForceFieldTrialParams[];
 
 #if defined(OS_LINUX) || defined(OS_CHROMEOS)
 extern const char kEnableThreadInstructionCount[];
+extern const char kEnableTaskPerfCounters[];
 
 // TODO(crbug.com/1176772): Remove kEnableCrashpad and IsCrashpadEnabled() when
 // Crashpad is fully enabled on Linux.
@@ -294,8 +294,13 @@ void CPU::Initialize(bool require_branding) {
         (cpu_info[2] & 0x08000000) != 0 /* OSXSAVE */ &&
         (xgetbv(0) & 6) == 6 /* XSAVE enabled by kernel */;
     has_aesni_ = (cpu_info[2] & 0x02000000) != 0;
+    has_pclmul_ = (cpu_info[2] & 0x00000002) != 0;
     has_fma3_ = (cpu_info[2] & 0x00001000) != 0;
     has_avx2_ = has_avx_ && (cpu_info7[1] & 0x00000020) != 0;
+    // AVX-512 additionally requires the kernel to save the opmask registers
+    // and the upper halves of ZMM0-15 and ZMM16-31 (XCR0 bits 5, 6 and 7).
+    has_avx512f_ = has_avx_ && (cpu_info7[1] & 0x00010000) != 0 &&
+                   (xgetbv(0) & 0xe0) == 0xe0;
   }
 
   // Get the brand string of the cpu.
@@ -78,7 +78,9 @@ class BASE_EXPORT CPU final {
   bool has_avx() const { return has_avx_; }
   bool has_fma3() const { return has_fma3_; }
   bool has_avx2() const { return has_avx2_; }
+  bool has_avx512f() const { return has_avx512f_; }
   bool has_aesni() const { return has_aesni_; }
+  bool has_pclmul() const { return has_pclmul_; }
   bool has_non_stop_time_stamp_counter() const {
     return has_non_stop_time_stamp_counter_;
   }
@@ -182,7 +184,9 @@ class BASE_EXPORT CPU final {
   bool has_avx_ = false;
   bool has_fma3_ = false;
   bool has_avx2_ = false;
+  bool has_avx512f_ = false;
   bool has_aesni_ = false;
+  bool has_pclmul_ = false;
 #if defined(ARCH_CPU_ARM_FAMILY)
   bool has_mte_ = false;  // Armv8.5-A MTE (Memory Taggging Extension)
   bool has_bti_ = false;  // Armv8.5-A BTI (Branch Target Identification)
@@ -58,6 +58,11 @@ TEST(CPU, RunExtendedInstructions) {
     __asm__ __volatile__("popcnt %%eax, %%eax\n" : : : "eax");
   }
 
+  if (cpu.has_pclmul()) {
+    // Execute a PCLMULQDQ instruction.
+    __asm__ __volatile__("pclmulqdq $0, %%xmm0, %%xmm0\n" : : : "xmm0");
+  }
+
   if (cpu.has_avx()) {
     // Execute an AVX instruction.
     __asm__ __volatile__("vzeroupper\n" : : : "xmm0");
@@ -72,6 +77,11 @@ TEST(CPU, RunExtendedInstructions) {
     // Execute an AVX 2 instruction.
     __asm__ __volatile__("vpunpcklbw %%ymm0, %%ymm0, %%ymm0\n" : : : "xmm0");
   }
+
+  if (cpu.has_avx512f()) {
+    // Execute an AVX-512 Foundation instruction.
+    __asm__ __volatile__("vpxorq %%zmm0, %%zmm0, %%zmm0\n" : : : "xmm0");
+  }
 // Visual C 32 bit and ClangCL 32/64 bit test.
 #elif defined(COMPILER_MSVC) && (defined(ARCH_CPU_32_BITS) || \
       (defined(ARCH_CPU_64_BITS) && defined(__clang__)))
@@ -108,6 +118,11 @@ TEST(CPU, RunExtendedInstructions) {
     __asm popcnt eax, eax;
   }
 
+  if (cpu.has_pclmul()) {
+    // Execute a PCLMULQDQ instruction.
+    __asm pclmulqdq xmm0, xmm0, 0;
+  }
+
   if (cpu.has_avx()) {
     // Execute an AVX instruction.
     __asm vzeroupper;
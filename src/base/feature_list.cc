@@ -14,6 +14,9 @@
 
 #include <stddef.h>
 
+#include <atomic>
+#include <limits>
+
 #include "base/base_paths.h"
 #include "base/base_switches.h"
 #include "base/containers/contains.h"
@@ -40,6 +43,25 @@ namespace {
 // have more control over initialization timing. Leaky.
 FeatureList* g_feature_list_instance = nullptr;
 
+// Source of FeatureList::caching_context_. Contexts fit in the bits of
+// Feature::cached_value_ above the cached OverrideState, and zero is skipped
+// since it marks features that weren't cached yet.
+constexpr int kCachedOverrideStateBits = 2;
+constexpr uint32_t kCachedOverrideStateMask =
+    (1u << kCachedOverrideStateBits) - 1;
+constexpr uint32_t kMaxCachingContext =
+    std::numeric_limits<uint32_t>::max() >> kCachedOverrideStateBits;
+std::atomic<uint32_t> g_next_caching_context{1};
+
+uint32_t GetNextCachingContext() {
+  uint32_t context;
+  do {
+    context = g_next_caching_context.fetch_add(1, std::memory_order_relaxed) &
+              kMaxCachingContext;
+  } while (context == 0);
+  return context;
+}
+
 // Tracks whether the FeatureList instance was initialized via an accessor, and
 // which Feature that accessor was for, if so.
 const Feature* g_initialized_from_accessor = nullptr;
@@ -188,7 +210,7 @@ const Feature kDCheckIsFatalFeature{"DcheckIsFatal",
                                     FEATURE_DISABLED_BY_DEFAULT};
 #endif  // defined(DCHECK_IS_CONFIGURABLE)
 
-FeatureList::FeatureList() = default;
+FeatureList::FeatureList() : caching_context_(GetNextCachingContext()) {}
 
 FeatureList::~FeatureList() = default;
 
@@ -517,6 +539,8 @@ void FeatureList::FinalizeInitialization() {
   DCHECK(!initialized_);
   // Store the field trial list pointer for DCHECKing.
   field_trial_list_ = FieldTrialList::GetInstance();
+  // Drops any state cached before the overrides were final.
+  caching_context_ = GetNextCachingContext();
   initialized_ = true;
 }
 
@@ -544,23 +568,39 @@ absl::optional<bool> FeatureList::IsFeatureEnabledIfOverridden(
 FeatureList::OverrideState FeatureList::GetOverrideState(
     const Feature& feature) {
   DCHECK(initialized_);
+
+  // Fast path: the state was already resolved by this FeatureList. The cached
+  // value is a single word, so relaxed ordering is enough; a stale value from
+  // another FeatureList has a different context and is simply recomputed.
+  const uint32_t cached_value =
+      feature.cached_value_.load(std::memory_order_relaxed);
+  if ((cached_value >> kCachedOverrideStateBits) == caching_context_)
+    return static_cast<OverrideState>(cached_value & kCachedOverrideStateMask);
+
   DCHECK(IsValidFeatureOrFieldTrialName(feature.name)) << feature.name;
   DCHECK(CheckFeatureIdentity(feature)) << feature.name;
 
+  OverrideState state = OVERRIDE_USE_DEFAULT;
   auto it = overrides_.find(feature.name);
   if (it != overrides_.end()) {
     const OverrideEntry& entry = it->second;
 
-    // Activate the corresponding field trial, if necessary.
+    // Activate the corresponding field trial, if necessary. Doing it only on
+    // the first query is enough, since activation is permanent.
     if (entry.field_trial)
       entry.field_trial->group();
 
     // TODO(asvitkine) Expand this section as more support is added.
 
-    return entry.overridden_state;
+    state = entry.overridden_state;
   }
-  // Otherwise, report that we want to use the default state.
-  return OVERRIDE_USE_DEFAULT;
+
+  static_assert(OVERRIDE_ENABLE_FEATURE <= kCachedOverrideStateMask,
+                "OverrideState doesn't fit in Feature::cached_value_");
+  feature.cached_value_.store(
+      (caching_context_ << kCachedOverrideStateBits) | state,
+      std::memory_order_relaxed);
+  return state;
 }
 
 FieldTrial* FeatureList::GetAssociatedFieldTrial(const Feature& feature) {
@@ -5,6 +5,9 @@
 #ifndef BASE_FEATURE_LIST_H_
 #define BASE_FEATURE_LIST_H_
 
+#include <stdint.h>
+
+#include <atomic>
 #include <functional>
 #include <map>
 #include <memory>
@@ -40,6 +43,15 @@ enum FeatureState {
 // file static. It should never be used as a constexpr as it breaks
 // pointer-based identity lookup.
 struct BASE_EXPORT Feature {
+  constexpr Feature(const char* name, FeatureState default_state)
+      : name(name), default_state(default_state) {}
+
+  // Copies don't share the cached state of the original, and are generally
+  // only used as a list of names, e.g. by ScopedFeatureList.
+  Feature(const Feature& other)
+      : name(other.name), default_state(other.default_state) {}
+  Feature& operator=(const Feature&) = delete;
+
   // The name of the feature. This should be unique to each feature and is used
   // for enabling/disabling features via command line flags and experiments.
   // It is strongly recommended to use CamelCase style for feature names, e.g.
@@ -50,6 +62,16 @@ struct BASE_EXPORT Feature {
   // NOTE: The actual runtime state may be different, due to a field trial or a
   // command line switch.
   const FeatureState default_state;
+
+ private:
+  friend class FeatureList;
+
+  // The state resolved by the FeatureList the last time this feature was
+  // queried, so that repeated queries don't have to look up the overrides.
+  // Packs the FeatureList::OverrideState in the low bits and the caching
+  // context of the FeatureList that resolved it in the high bits; zero means
+  // nothing was cached yet. See FeatureList::GetOverrideState().
+  mutable std::atomic<uint32_t> cached_value_{0};
 };
 
 #if defined(DCHECK_IS_CONFIGURABLE)
@@ -352,6 +374,9 @@ class BASE_EXPORT FeatureList {
   // Returns the override state of a given |feature|. If the feature was not
   // overridden, returns OVERRIDE_USE_DEFAULT. Performs any necessary callbacks
   // for when the feature state has been observed, e.g. actvating field trials.
+  // The result is cached in |feature|, so that later queries are a single
+  // atomic load as long as this object remains the FeatureList that answers
+  // them.
   OverrideState GetOverrideState(const Feature& feature);
 
   // Returns the field trial associated with the given |feature|. This is
@@ -413,6 +438,13 @@ class BASE_EXPORT FeatureList {
   // result of FinalizeInitialization().
   bool initialized_ = false;
 
+  // Identifies the states cached in Feature structs by this object, which are
+  // only valid for it. Never zero, which marks features without a cached
+  // state, and distinct for each FeatureList so that swapping the instance
+  // (e.g. with ScopedFeatureList) invalidates the cached states without having
+  // to visit every Feature. Assigned again by FinalizeInitialization().
+  uint32_t caching_context_;
+
   // Whether this object has been initialized from command line.
   bool initialized_from_command_line_ = false;
 };
@@ -0,0 +1,105 @@
+// Copyright 2021 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "base/feature_list.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "base/strings/string_util.h"
+#include "base/strings/stringprintf.h"
+#include "base/test/scoped_feature_list.h"
+#include "base/timer/elapsed_timer.h"
+#include "testing/gtest/include/gtest/gtest.h"
+#include "testing/perf/perf_result_reporter.h"
+
+// This file measures FeatureList::IsEnabled() with many overrides registered,
+// both on the first query of each feature, which looks up the overrides, and
+// on later queries, which use the state cached in the Feature.
+
+namespace base {
+
+namespace {
+
+constexpr char kMetricPrefixFeatureList[] = "FeatureList.";
+constexpr char kMetricTimePerQuery[] = "time_per_query";
+constexpr int kNumFeatures = 500;
+constexpr int kNumRounds = 200;
+
+perf_test::PerfResultReporter SetUpReporter(const std::string& story_name) {
+  perf_test::PerfResultReporter reporter(kMetricPrefixFeatureList, story_name);
+  reporter.RegisterImportantMetric(kMetricTimePerQuery, "ns");
+  return reporter;
+}
+
+class FeatureListPerfTest : public testing::Test {
+ public:
+  FeatureListPerfTest() {
+    std::vector<std::string> enabled_names;
+    for (int i = 0; i < kNumFeatures; ++i) {
+      names_.push_back(StringPrintf("PerfFeature%d", i));
+      if (i % 2 == 0)
+        enabled_names.push_back(names_.back());
+    }
+    // Features are not movable, so they are allocated one by one.
+    for (const std::string& name : names_) {
+      features_.push_back(std::make_unique<Feature>(
+          name.c_str(), FEATURE_DISABLED_BY_DEFAULT));
+    }
+    enable_features_ = JoinString(enabled_names, ",");
+  }
+
+ protected:
+  // Installs a new FeatureList with an override for every other feature, which
+  // invalidates the cached states.
+  void ResetFeatureList(test::ScopedFeatureList* scoped_feature_list) {
+    auto feature_list = std::make_unique<FeatureList>();
+    feature_list->InitializeFromCommandLine(enable_features_, std::string());
+    scoped_feature_list->InitWithFeatureList(std::move(feature_list));
+  }
+
+  // Queries all the features once and returns the number of enabled ones.
+  int QueryAll() {
+    int enabled = 0;
+    for (const auto& feature : features_)
+      enabled += FeatureList::IsEnabled(*feature);
+    return enabled;
+  }
+
+  std::vector<std::string> names_;
+  std::vector<std::unique_ptr<Feature>> features_;
+  std::string enable_features_;
+};
+
+}  // namespace
+
+TEST_F(FeatureListPerfTest, IsEnabled) {
+  TimeDelta uncached_time;
+  for (int round = 0; round < kNumRounds; ++round) {
+    test::ScopedFeatureList scoped_feature_list;
+    ResetFeatureList(&scoped_feature_list);
+    ElapsedTimer timer;
+    EXPECT_EQ(kNumFeatures / 2, QueryAll());
+    uncached_time += timer.Elapsed();
+  }
+
+  test::ScopedFeatureList scoped_feature_list;
+  ResetFeatureList(&scoped_feature_list);
+  EXPECT_EQ(kNumFeatures / 2, QueryAll());
+  ElapsedTimer timer;
+  for (int round = 0; round < kNumRounds; ++round)
+    EXPECT_EQ(kNumFeatures / 2, QueryAll());
+  const TimeDelta cached_time = timer.Elapsed();
+
+  constexpr double kNumQueries = double{kNumFeatures} * kNumRounds;
+  auto uncached_reporter = SetUpReporter("MapLookup_500Overrides");
+  uncached_reporter.AddResult(kMetricTimePerQuery,
+                              uncached_time.InNanoseconds() / kNumQueries);
+  auto cached_reporter = SetUpReporter("Cached_500Overrides");
+  cached_reporter.AddResult(kMetricTimePerQuery,
+                            cached_time.InNanoseconds() / kNumQueries);
+}
+
+}  // namespace base
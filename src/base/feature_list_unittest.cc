@@ -609,6 +609,39 @@ TEST_F(FeatureListTest, UninitializedInstance_IsEnabledReturnsFalse) {
     FeatureList::RestoreInstanceForTesting(std::move(original_feature_list));
 }
 
+TEST_F(FeatureListTest, CachedStateFollowsInstance) {
+  // Query the state once to cache it for the default FeatureList.
+  EXPECT_FALSE(FeatureList::IsEnabled(kFeatureOffByDefault));
+  EXPECT_FALSE(FeatureList::IsEnabled(kFeatureOffByDefault));
+
+  {
+    test::ScopedFeatureList scoped_feature_list;
+    scoped_feature_list.InitAndEnableFeature(kFeatureOffByDefault);
+    EXPECT_TRUE(FeatureList::IsEnabled(kFeatureOffByDefault));
+    EXPECT_TRUE(FeatureList::IsEnabled(kFeatureOffByDefault));
+    EXPECT_EQ(true, FeatureList::GetStateIfOverridden(kFeatureOffByDefault));
+
+    {
+      test::ScopedFeatureList nested_feature_list;
+      nested_feature_list.InitAndDisableFeature(kFeatureOffByDefault);
+      EXPECT_FALSE(FeatureList::IsEnabled(kFeatureOffByDefault));
+      EXPECT_EQ(false, FeatureList::GetStateIfOverridden(kFeatureOffByDefault));
+    }
+
+    // The restored instance doesn't use the state cached by the nested one.
+    EXPECT_TRUE(FeatureList::IsEnabled(kFeatureOffByDefault));
+  }
+
+  EXPECT_FALSE(FeatureList::IsEnabled(kFeatureOffByDefault));
+  EXPECT_EQ(absl::nullopt,
+            FeatureList::GetStateIfOverridden(kFeatureOffByDefault));
+
+  // Copies have their own state.
+  const Feature feature_copy(kFeatureOffByDefault);
+  EXPECT_STREQ(kFeatureOffByDefaultName, feature_copy.name);
+  EXPECT_EQ(FEATURE_DISABLED_BY_DEFAULT, feature_copy.default_state);
+}
+
 TEST_F(FeatureListTest, StoreAndRetrieveFeaturesFromSharedMemory) {
   std::unique_ptr<base::FeatureList> feature_list(new base::FeatureList);
 
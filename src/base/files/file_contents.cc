@@ -0,0 +1,172 @@
+// Copyright 2021 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "base/files/file_contents.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <utility>
+
+#include "base/check_op.h"
+#include "base/files/file_path.h"
+#include "base/files/memory_mapped_file.h"
+#include "base/numerics/safe_conversions.h"
+#include "base/threading/scoped_blocking_call.h"
+#include "build/build_config.h"
+
+#if defined(OS_POSIX) && !defined(OS_NACL)
+#include <sys/mman.h>
+#endif
+
+namespace base {
+
+namespace {
+
+// The initial buffer size for the files whose size isn't known, which is
+// doubled whenever it's full. Small, since most of them, or empty files, are.
+constexpr size_t kUnknownSizeMinBufferSize = 4 * 1024;
+
+// Reads |size| bytes at |offset| of |file| into |buffer|, in several reads if
+// |size| doesn't fit in an int. Returns the number of bytes read, fewer than
+// |size| if the end of the file was reached, or -1 on error.
+int64_t ReadAt(File* file, int64_t offset, uint8_t* buffer, size_t size) {
+  size_t total = 0;
+  while (total < size) {
+    const int chunk = saturated_cast<int>(size - total);
+    const int result = file->Read(offset + static_cast<int64_t>(total),
+                                  reinterpret_cast<char*>(buffer + total),
+                                  chunk);
+    if (result < 0)
+      return -1;
+    total += static_cast<size_t>(result);
+    if (result < chunk)
+      break;
+  }
+  return static_cast<int64_t>(total);
+}
+
+}  // namespace
+
+FileContents::FileContents() = default;
+
+FileContents::FileContents(FileContents&& other) = default;
+
+FileContents& FileContents::operator=(FileContents&& other) = default;
+
+FileContents::~FileContents() = default;
+
+// static
+absl::optional<FileContents> FileContents::Read(const FilePath& path,
+                                                size_t max_size,
+                                                MapMode map_mode) {
+  if (path.ReferencesParent())
+    return absl::nullopt;
+  File file(path, File::FLAG_OPEN | File::FLAG_READ);
+  if (!file.IsValid())
+    return absl::nullopt;
+  return Read(std::move(file), max_size, map_mode);
+}
+
+// static
+absl::optional<FileContents> FileContents::Read(File file,
+                                                size_t max_size,
+                                                MapMode map_mode) {
+  DCHECK(file.IsValid());
+  ScopedBlockingCall scoped_blocking_call(FROM_HERE, BlockingType::MAY_BLOCK);
+
+  // Many files have no size, like the ones of procfs, or an incorrect one,
+  // like the ones of sysfs which are never larger than a page. The former are
+  // read until their end, and the latter turn out to be shorter.
+  const int64_t length = file.GetLength();
+  if (length < 0)
+    return absl::nullopt;
+  if (static_cast<uint64_t>(length) > max_size)
+    return absl::nullopt;
+  if (!IsValueInRangeForNumericType<size_t>(length))
+    return absl::nullopt;
+
+  FileContents contents;
+  if (length >= kMapThreshold && map_mode == MapMode::kMapLargeFiles) {
+#if !defined(OS_NACL)
+    auto mapped_file = std::make_unique<MemoryMappedFile>();
+    if (!mapped_file->Initialize(std::move(file)))
+      return absl::nullopt;
+#if defined(OS_POSIX)
+    // The whole file is about to be read, so it's read ahead of the accesses,
+    // and in larger batches than random accesses would read. Both are hints,
+    // which can be ignored.
+    uint8_t* const data = mapped_file->data();
+    madvise(data, mapped_file->length(), MADV_SEQUENTIAL);
+    madvise(data, mapped_file->length(), MADV_WILLNEED);
+#endif
+    contents.bytes_ = make_span(mapped_file->data(), mapped_file->length());
+    contents.mapped_file_ = std::move(mapped_file);
+    return contents;
+#endif  // !defined(OS_NACL)
+  }
+
+  if (length > 0) {
+    // Not value-initialized, since it's overwritten right away.
+    contents.buffer_.reset(new uint8_t[length]);
+    const int64_t bytes_read =
+        ReadAt(&file, 0, contents.buffer_.get(), static_cast<size_t>(length));
+    if (bytes_read < 0)
+      return absl::nullopt;
+    contents.bytes_ =
+        make_span(contents.buffer_.get(), static_cast<size_t>(bytes_read));
+    return contents;
+  }
+
+  size_t capacity = 0;
+  size_t size = 0;
+  for (;;) {
+    if (size == capacity) {
+      const size_t new_capacity =
+          std::max(2 * capacity, kUnknownSizeMinBufferSize);
+      std::unique_ptr<uint8_t[]> buffer(new uint8_t[new_capacity]);
+      if (size)
+        memcpy(buffer.get(), contents.buffer_.get(), size);
+      contents.buffer_ = std::move(buffer);
+      capacity = new_capacity;
+    }
+    const int result = file.ReadAtCurrentPosNoBestEffort(
+        reinterpret_cast<char*>(contents.buffer_.get() + size),
+        saturated_cast<int>(capacity - size));
+    if (result < 0)
+      return absl::nullopt;
+    if (result == 0)
+      break;
+    size += static_cast<size_t>(result);
+    if (size > max_size)
+      return absl::nullopt;
+  }
+  contents.bytes_ = make_span(contents.buffer_.get(), size);
+  return contents;
+}
+
+StringPiece FileContents::AsStringPiece() const {
+  return StringPiece(reinterpret_cast<const char*>(bytes_.data()),
+                     bytes_.size());
+}
+
+FileChunkReader::FileChunkReader(File file, size_t chunk_size)
+    : file_(std::move(file)),
+      chunk_size_(chunk_size),
+      buffer_(new uint8_t[chunk_size]) {
+  DCHECK(file_.IsValid());
+  DCHECK_GT(chunk_size_, 0u);
+}
+
+FileChunkReader::~FileChunkReader() = default;
+
+absl::optional<span<const uint8_t>> FileChunkReader::ReadNextChunk() {
+  const int result = file_.ReadAtCurrentPosNoBestEffort(
+      reinterpret_cast<char*>(buffer_.get()), saturated_cast<int>(chunk_size_));
+  if (result < 0)
+    return absl::nullopt;
+  return make_span(buffer_.get(), static_cast<size_t>(result));
+}
+
+}  // namespace base
@@ -0,0 +1,127 @@
+// Copyright 2021 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BASE_FILES_FILE_CONTENTS_H_
+#define BASE_FILES_FILE_CONTENTS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <limits>
+#include <memory>
+
+#include "base/base_export.h"
+#include "base/containers/span.h"
+#include "base/files/file.h"
+#include "base/strings/string_piece.h"
+#include "third_party/abseil-cpp/absl/types/optional.h"
+
+namespace base {
+
+class FilePath;
+class MemoryMappedFile;
+
+// The whole contents of a file, read without the copies and reallocations of
+// ReadFileToString():
+// - Regular files of at least kMapThreshold bytes are memory-mapped, unless
+//   MapMode::kNeverMap is passed, and the kernel is told that they will be
+//   read sequentially. Like with
+//   MemoryMappedFile, the pages are read when accessed, and truncating the
+//   file while it is mapped makes these accesses crash.
+// - Smaller regular files are read at once into a buffer of their size.
+// - The files whose size isn't known, like pipes or the files of procfs, are
+//   read in chunks until their end.
+// The contents are limited to the size the file had when it was read, and the
+// ones of a mapped file reflect the later writes to it.
+//
+// Example:
+//   absl::optional<FileContents> contents = FileContents::Read(path);
+//   if (!contents)
+//     return false;
+//   Parse(contents->AsStringPiece());
+class BASE_EXPORT FileContents {
+ public:
+  // Regular files of at least this size are memory-mapped.
+  static constexpr int64_t kMapThreshold = 1024 * 1024;
+
+  enum class MapMode {
+    kMapLargeFiles,
+    // Reads all the files, e.g. when the file may be truncated while the
+    // contents are used.
+    kNeverMap,
+  };
+
+  FileContents(FileContents&& other);
+  FileContents& operator=(FileContents&& other);
+  ~FileContents();
+
+  // Returns the contents of the file at |path|, or nullopt if it can't be
+  // read or is larger than |max_size| bytes. Fails if |path| references a
+  // parent directory, like ReadFileToString().
+  static absl::optional<FileContents> Read(
+      const FilePath& path,
+      size_t max_size = std::numeric_limits<size_t>::max(),
+      MapMode map_mode = MapMode::kMapLargeFiles);
+
+  // As above, with |file| opened for reading. The files whose size isn't known
+  // are read from their current position, the others from their start.
+  static absl::optional<FileContents> Read(
+      File file,
+      size_t max_size = std::numeric_limits<size_t>::max(),
+      MapMode map_mode = MapMode::kMapLargeFiles);
+
+  span<const uint8_t> bytes() const { return bytes_; }
+  StringPiece AsStringPiece() const;
+  size_t size() const { return bytes_.size(); }
+
+  // Whether the contents are memory-mapped rather than read.
+  bool is_mapped() const { return !!mapped_file_; }
+
+ private:
+  FileContents();
+
+  std::unique_ptr<MemoryMappedFile> mapped_file_;
+  std::unique_ptr<uint8_t[]> buffer_;
+  span<const uint8_t> bytes_;
+};
+
+// Reads a file, or a pipe, by chunks into a buffer which is reused for each
+// chunk, so that the chunks can be processed as they arrive without
+// accumulating the contents.
+//
+// Example:
+//   FileChunkReader reader(std::move(file));
+//   for (;;) {
+//     absl::optional<span<const uint8_t>> chunk = reader.ReadNextChunk();
+//     if (!chunk)
+//       return false;
+//     if (chunk->empty())
+//       return true;
+//     Consume(*chunk);
+//   }
+class BASE_EXPORT FileChunkReader {
+ public:
+  static constexpr size_t kDefaultChunkSize = 64 * 1024;
+
+  // |file| must be opened for reading. It is read from its current position.
+  explicit FileChunkReader(File file, size_t chunk_size = kDefaultChunkSize);
+  FileChunkReader(const FileChunkReader&) = delete;
+  FileChunkReader& operator=(const FileChunkReader&) = delete;
+  ~FileChunkReader();
+
+  // Returns the next chunk, of up to the chunk size bytes, which is valid until
+  // the next call. The chunk is whatever a single read returns, so a pipe's
+  // is what was written to it so far. Returns an empty chunk at the end of the
+  // file, and nullopt on error.
+  absl::optional<span<const uint8_t>> ReadNextChunk();
+
+ private:
+  File file_;
+  const size_t chunk_size_;
+  const std::unique_ptr<uint8_t[]> buffer_;
+};
+
+}  // namespace base
+
+#endif  // BASE_FILES_FILE_CONTENTS_H_
@@ -0,0 +1,130 @@
+// Copyright 2021 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "base/files/file_contents.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <string>
+
+#include "base/bind.h"
+#include "base/callback.h"
+#include "base/files/file.h"
+#include "base/files/file_path.h"
+#include "base/files/file_util.h"
+#include "base/files/scoped_temp_dir.h"
+#include "base/rand_util.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/strings/string_piece.h"
+#include "base/time/time.h"
+#include "testing/gtest/include/gtest/gtest.h"
+#include "testing/perf/perf_result_reporter.h"
+
+namespace base {
+
+namespace {
+
+constexpr char kMetricPrefixFileContents[] = "FileContents.";
+constexpr char kMetricThroughput[] = "throughput";
+
+// Each story reads about this many bytes, in at most kMaxReads reads.
+constexpr int64_t kBytesPerStory = int64_t{4} * 1024 * 1024 * 1024;
+constexpr int kMaxReads = 20000;
+
+// The contents are accessed once per page, so that the pages of the mapped
+// files are faulted in, without measuring the processing of the contents.
+constexpr size_t kPageSize = 4096;
+
+// Reads the whole file and passes its contents to the callback.
+using ReadCallback = RepeatingCallback<void(const FilePath&,
+                                            OnceCallback<void(StringPiece)>)>;
+
+// Reads files from 1 KiB to 1 GiB, which are in the page cache once written.
+class FileContentsPerfTest : public testing::TestWithParam<int64_t> {
+ public:
+  void SetUp() override {
+    ASSERT_TRUE(temp_dir_.CreateUniqueTempDir());
+    path_ = temp_dir_.GetPath().AppendASCII("file");
+    File file(path_, File::FLAG_CREATE | File::FLAG_WRITE);
+    ASSERT_TRUE(file.IsValid());
+    const std::string chunk =
+        RandBytesAsString(std::min<int64_t>(file_size(), 1024 * 1024));
+    for (int64_t offset = 0; offset < file_size(); offset += chunk.size()) {
+      ASSERT_EQ(static_cast<int>(chunk.size()),
+                file.Write(offset, chunk.data(), chunk.size()));
+    }
+  }
+
+ protected:
+  int64_t file_size() const { return GetParam(); }
+
+  void RunReads(const std::string& story_name, const ReadCallback& read) {
+    const int num_reads = static_cast<int>(std::max<int64_t>(
+        1, std::min<int64_t>(kMaxReads, kBytesPerStory / file_size())));
+    uint64_t sum = 0;
+    const TimeTicks start = TimeTicks::Now();
+    for (int i = 0; i < num_reads; ++i) {
+      read.Run(path_, BindOnce(
+                          [](int64_t file_size, uint64_t* sum,
+                             StringPiece contents) {
+                            CHECK_EQ(file_size,
+                                     static_cast<int64_t>(contents.size()));
+                            for (size_t j = 0; j < contents.size();
+                                 j += kPageSize) {
+                              *sum += static_cast<uint8_t>(contents[j]);
+                            }
+                          },
+                          file_size(), &sum));
+    }
+    const TimeDelta elapsed = TimeTicks::Now() - start;
+    EXPECT_GT(sum, 0u);
+
+    perf_test::PerfResultReporter reporter(
+        kMetricPrefixFileContents,
+        story_name + "_" + NumberToString(file_size() / 1024) + "KiB");
+    reporter.RegisterImportantMetric(kMetricThroughput, "MiB/s");
+    reporter.AddResult(kMetricThroughput, num_reads * file_size() /
+                                              (1024.0 * 1024.0) /
+                                              elapsed.InSecondsF());
+  }
+
+ private:
+  ScopedTempDir temp_dir_;
+  FilePath path_;
+};
+
+}  // namespace
+
+TEST_P(FileContentsPerfTest, ReadFileToString) {
+  RunReads("ReadFileToString",
+           BindRepeating([](const FilePath& path,
+                            OnceCallback<void(StringPiece)> consume) {
+             std::string contents;
+             CHECK(ReadFileToString(path, &contents));
+             std::move(consume).Run(contents);
+           }));
+}
+
+TEST_P(FileContentsPerfTest, FileContents) {
+  RunReads("FileContents",
+           BindRepeating([](const FilePath& path,
+                            OnceCallback<void(StringPiece)> consume) {
+             absl::optional<FileContents> contents = FileContents::Read(path);
+             CHECK(contents);
+             std::move(consume).Run(contents->AsStringPiece());
+           }));
+}
+
+INSTANTIATE_TEST_SUITE_P(,
+                         FileContentsPerfTest,
+                         testing::Values(int64_t{1} << 10,
+                                         int64_t{16} << 10,
+                                         int64_t{256} << 10,
+                                         int64_t{4} << 20,
+                                         int64_t{64} << 20,
+                                         int64_t{1} << 30));
+
+}  // namespace base
@@ -0,0 +1,200 @@
+// Copyright 2021 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "base/files/file_contents.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <utility>
+
+#include "base/bind.h"
+#include "base/containers/span.h"
+#include "base/files/file.h"
+#include "base/files/file_path.h"
+#include "base/files/file_util.h"
+#include "base/files/scoped_temp_dir.h"
+#include "base/rand_util.h"
+#include "base/strings/string_number_conversions.h"
+#include "build/build_config.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+#if defined(OS_POSIX)
+#include "base/files/scoped_file.h"
+#include "base/threading/thread.h"
+#endif
+
+namespace base {
+
+namespace {
+
+class FileContentsTest : public testing::Test {
+ protected:
+  void SetUp() override { ASSERT_TRUE(temp_dir_.CreateUniqueTempDir()); }
+
+  // Writes |data| to a new file and returns its path.
+  FilePath WriteTestFile(const std::string& data) {
+    const FilePath path =
+        temp_dir_.GetPath().AppendASCII("file" + NumberToString(num_files_++));
+    EXPECT_TRUE(WriteFile(path, data));
+    return path;
+  }
+
+ private:
+  ScopedTempDir temp_dir_;
+  int num_files_ = 0;
+};
+
+}  // namespace
+
+TEST_F(FileContentsTest, ReadSmallFile) {
+  const std::string data = RandBytesAsString(1000);
+  absl::optional<FileContents> contents =
+      FileContents::Read(WriteTestFile(data));
+  ASSERT_TRUE(contents);
+  EXPECT_FALSE(contents->is_mapped());
+  EXPECT_EQ(data, contents->AsStringPiece());
+}
+
+TEST_F(FileContentsTest, ReadEmptyFile) {
+  absl::optional<FileContents> contents = FileContents::Read(WriteTestFile(""));
+  ASSERT_TRUE(contents);
+  EXPECT_FALSE(contents->is_mapped());
+  EXPECT_TRUE(contents->bytes().empty());
+}
+
+TEST_F(FileContentsTest, MapLargeFile) {
+  const std::string data = RandBytesAsString(FileContents::kMapThreshold + 1);
+  absl::optional<FileContents> contents =
+      FileContents::Read(WriteTestFile(data));
+  ASSERT_TRUE(contents);
+#if !defined(OS_NACL)
+  EXPECT_TRUE(contents->is_mapped());
+#endif
+  EXPECT_EQ(data, contents->AsStringPiece());
+
+  // The mapping moves with the contents.
+  FileContents moved = std::move(*contents);
+  EXPECT_EQ(data, moved.AsStringPiece());
+}
+
+TEST_F(FileContentsTest, ReadLargeFileWithoutMapping) {
+  const std::string data = RandBytesAsString(FileContents::kMapThreshold + 1);
+  absl::optional<FileContents> contents =
+      FileContents::Read(WriteTestFile(data), data.size(),
+                         FileContents::MapMode::kNeverMap);
+  ASSERT_TRUE(contents);
+  EXPECT_FALSE(contents->is_mapped());
+  EXPECT_EQ(data, contents->AsStringPiece());
+}
+
+TEST_F(FileContentsTest, MaxSize) {
+  const FilePath path = WriteTestFile("0123456789");
+  EXPECT_TRUE(FileContents::Read(path, 10));
+  EXPECT_FALSE(FileContents::Read(path, 9));
+}
+
+TEST_F(FileContentsTest, ReadFailures) {
+  const FilePath path = WriteTestFile("data");
+  const FilePath dir = path.DirName();
+  EXPECT_FALSE(FileContents::Read(dir.AppendASCII("missing")));
+  // The file exists, but its path references a parent.
+  EXPECT_FALSE(FileContents::Read(
+      dir.AppendASCII("..").Append(dir.BaseName()).Append(path.BaseName())));
+}
+
+#if defined(OS_POSIX)
+// A pipe has no size, so it's read until its end.
+TEST_F(FileContentsTest, ReadPipe) {
+  ScopedFD read_fd;
+  ScopedFD write_fd;
+  ASSERT_TRUE(CreatePipe(&read_fd, &write_fd));
+  const std::string data = RandBytesAsString(1000 * 1000);
+
+  Thread writer("FileContentsTestWriter");
+  ASSERT_TRUE(writer.Start());
+  writer.task_runner()->PostTask(
+      FROM_HERE, BindOnce(
+                     [](ScopedFD fd, const std::string* data) {
+                       EXPECT_TRUE(WriteFileDescriptor(fd.get(), *data));
+                     },
+                     std::move(write_fd), &data));
+
+  absl::optional<FileContents> contents =
+      FileContents::Read(File(std::move(read_fd)));
+  ASSERT_TRUE(contents);
+  EXPECT_FALSE(contents->is_mapped());
+  EXPECT_EQ(data, contents->AsStringPiece());
+}
+
+// An empty pipe is read like a procfs file, whose size isn't known either.
+TEST_F(FileContentsTest, ReadEmptyPipe) {
+  ScopedFD read_fd;
+  ScopedFD write_fd;
+  ASSERT_TRUE(CreatePipe(&read_fd, &write_fd));
+  write_fd.reset();
+  absl::optional<FileContents> contents =
+      FileContents::Read(File(std::move(read_fd)));
+  ASSERT_TRUE(contents);
+  EXPECT_TRUE(contents->bytes().empty());
+}
+
+TEST_F(FileContentsTest, PipeMaxSize) {
+  ScopedFD read_fd;
+  ScopedFD write_fd;
+  ASSERT_TRUE(CreatePipe(&read_fd, &write_fd));
+  ASSERT_TRUE(WriteFileDescriptor(write_fd.get(), "0123456789"));
+  write_fd.reset();
+  EXPECT_FALSE(FileContents::Read(File(std::move(read_fd)), 9));
+}
+
+TEST_F(FileContentsTest, ChunkReaderReadsPipeAsItIsWritten) {
+  ScopedFD read_fd;
+  ScopedFD write_fd;
+  ASSERT_TRUE(CreatePipe(&read_fd, &write_fd));
+  FileChunkReader reader(File(std::move(read_fd)), 4);
+
+  ASSERT_TRUE(WriteFileDescriptor(write_fd.get(), "012345"));
+  absl::optional<span<const uint8_t>> chunk = reader.ReadNextChunk();
+  ASSERT_TRUE(chunk);
+  EXPECT_EQ("0123", std::string(chunk->begin(), chunk->end()));
+  chunk = reader.ReadNextChunk();
+  ASSERT_TRUE(chunk);
+  EXPECT_EQ("45", std::string(chunk->begin(), chunk->end()));
+
+  write_fd.reset();
+  chunk = reader.ReadNextChunk();
+  ASSERT_TRUE(chunk);
+  EXPECT_TRUE(chunk->empty());
+}
+#endif  // defined(OS_POSIX)
+
+TEST_F(FileContentsTest, ChunkReaderReadsFile) {
+  const std::string data = RandBytesAsString(100 * 1000);
+  FileChunkReader reader(
+      File(WriteTestFile(data), File::FLAG_OPEN | File::FLAG_READ));
+  std::string read;
+  for (;;) {
+    absl::optional<span<const uint8_t>> chunk = reader.ReadNextChunk();
+    ASSERT_TRUE(chunk);
+    if (chunk->empty())
+      break;
+    EXPECT_LE(chunk->size(), FileChunkReader::kDefaultChunkSize);
+    read.append(chunk->begin(), chunk->end());
+  }
+  EXPECT_EQ(data, read);
+}
+
+#if defined(OS_LINUX) || defined(OS_CHROMEOS) || defined(OS_ANDROID)
+// The files of procfs report no size.
+TEST_F(FileContentsTest, ReadProcFile) {
+  absl::optional<FileContents> contents =
+      FileContents::Read(FilePath("/proc/self/status"));
+  ASSERT_TRUE(contents);
+  EXPECT_NE(StringPiece::npos, contents->AsStringPiece().find("Name:"));
+}
+#endif
+
+}  // namespace base
@@ -9,11 +9,19 @@
 
 #include "base/bind.h"
 #include "base/callback_helpers.h"
+#include "base/containers/span.h"
 #include "base/files/file.h"
 #include "base/files/file_util.h"
 #include "base/location.h"
+#include "base/memory/ptr_util.h"
 #include "base/task/task_runner.h"
 #include "base/task/task_runner_util.h"
+#include "base/threading/sequenced_task_runner_handle.h"
+#include "build/build_config.h"
+
+#if defined(OS_LINUX) || defined(OS_CHROMEOS)
+#include "base/files/io_uring_file_engine.h"
+#endif
 
 namespace {
 
@@ -33,6 +41,8 @@ class FileHelper {
   FileHelper(const FileHelper&) = delete;
   FileHelper& operator=(const FileHelper&) = delete;
 
+  PlatformFile GetPlatformFile() const { return file_.GetPlatformFile(); }
+
   void PassFile() {
     if (proxy_)
       proxy_->SetFile(std::move(file_));
@@ -85,6 +95,11 @@ class GenericFileHelper : public FileHelper {
     if (!callback.is_null())
       std::move(callback).Run(error_);
   }
+
+  void ReplyWithError(FileProxy::StatusCallback callback, File::Error error) {
+    error_ = error;
+    Reply(std::move(callback));
+  }
 };
 
 class CreateOrOpenHelper : public FileHelper {
@@ -191,7 +206,51 @@ class ReadHelper : public FileHelper {
     std::move(callback).Run(error_, buffer_.get(), bytes_read_);
   }
 
+#if defined(OS_LINUX) || defined(OS_CHROMEOS)
+  // Reads the rest of the buffer at |offset| with |engine|, then replies once
+  // it is full, the end of the file is reached or the read fails, like
+  // File::Read().
+  static void ReadWithIoUring(std::unique_ptr<ReadHelper> helper,
+                              IoUringFileEngine* engine,
+                              int64_t offset,
+                              FileProxy::ReadCallback callback) {
+    ReadHelper* const self = helper.get();
+    engine->Read(
+        self->GetPlatformFile(), offset + self->bytes_read_,
+        as_writable_bytes(make_span(self->buffer_.get() + self->bytes_read_,
+                                    self->bytes_to_read_ - self->bytes_read_)),
+        SequencedTaskRunnerHandle::Get(),
+        BindOnce(&ReadHelper::DidReadWithIoUring, std::move(helper), engine,
+                 offset, std::move(callback)));
+  }
+#endif
+
  private:
+#if defined(OS_LINUX) || defined(OS_CHROMEOS)
+  static void DidReadWithIoUring(std::unique_ptr<ReadHelper> helper,
+                                 IoUringFileEngine* engine,
+                                 int64_t offset,
+                                 FileProxy::ReadCallback callback,
+                                 File::Error error,
+                                 int bytes_read) {
+    if (bytes_read > 0) {
+      helper->bytes_read_ += bytes_read;
+      if (helper->bytes_read_ < helper->bytes_to_read_) {
+        ReadWithIoUring(std::move(helper), engine, offset, std::move(callback));
+        return;
+      }
+    }
+    // A failure after a partial read returns what was read.
+    if (bytes_read < 0 && !helper->bytes_read_) {
+      helper->error_ = error;
+      helper->bytes_read_ = -1;
+    } else {
+      helper->error_ = File::FILE_OK;
+    }
+    helper->Reply(std::move(callback));
+  }
+#endif
+
   std::unique_ptr<char[]> buffer_;
   int bytes_to_read_;
   int bytes_read_ = 0;
@@ -222,7 +281,51 @@ class WriteHelper : public FileHelper {
       std::move(callback).Run(error_, bytes_written_);
   }
 
+#if defined(OS_LINUX) || defined(OS_CHROMEOS)
+  // Writes the rest of the buffer at |offset| with |engine|, then replies once
+  // it is all written or the write fails, like File::Write().
+  static void WriteWithIoUring(std::unique_ptr<WriteHelper> helper,
+                               IoUringFileEngine* engine,
+                               int64_t offset,
+                               FileProxy::WriteCallback callback) {
+    WriteHelper* const self = helper.get();
+    engine->Write(
+        self->GetPlatformFile(), offset + self->bytes_written_,
+        as_bytes(make_span(self->buffer_.get() + self->bytes_written_,
+                           self->bytes_to_write_ - self->bytes_written_)),
+        SequencedTaskRunnerHandle::Get(),
+        BindOnce(&WriteHelper::DidWriteWithIoUring, std::move(helper), engine,
+                 offset, std::move(callback)));
+  }
+#endif
+
  private:
+#if defined(OS_LINUX) || defined(OS_CHROMEOS)
+  static void DidWriteWithIoUring(std::unique_ptr<WriteHelper> helper,
+                                  IoUringFileEngine* engine,
+                                  int64_t offset,
+                                  FileProxy::WriteCallback callback,
+                                  File::Error error,
+                                  int bytes_written) {
+    if (bytes_written > 0) {
+      helper->bytes_written_ += bytes_written;
+      if (helper->bytes_written_ < helper->bytes_to_write_) {
+        WriteWithIoUring(std::move(helper), engine, offset,
+                         std::move(callback));
+        return;
+      }
+    }
+    // A failure after a partial write returns what was written.
+    if (bytes_written < 0 && !helper->bytes_written_) {
+      helper->error_ = error;
+      helper->bytes_written_ = -1;
+    } else {
+      helper->error_ = File::FILE_OK;
+    }
+    helper->Reply(std::move(callback));
+  }
+#endif
+
   std::unique_ptr<char[]> buffer_;
   int bytes_to_write_;
   int bytes_written_ = 0;
@@ -305,6 +408,13 @@ bool FileProxy::Read(int64_t offset, int bytes_to_read, ReadCallback callback) {
     return false;
 
   ReadHelper* helper = new ReadHelper(this, std::move(file_), bytes_to_read);
+#if defined(OS_LINUX) || defined(OS_CHROMEOS)
+  if (io_uring_engine_) {
+    ReadHelper::ReadWithIoUring(WrapUnique(helper), io_uring_engine_, offset,
+                                std::move(callback));
+    return true;
+  }
+#endif
   return task_runner_->PostTaskAndReply(
       FROM_HERE, BindOnce(&ReadHelper::RunWork, Unretained(helper), offset),
       BindOnce(&ReadHelper::Reply, Owned(helper), std::move(callback)));
@@ -320,6 +430,13 @@ bool FileProxy::Write(int64_t offset,
 
   WriteHelper* helper =
       new WriteHelper(this, std::move(file_), buffer, bytes_to_write);
+#if defined(OS_LINUX) || defined(OS_CHROMEOS)
+  if (io_uring_engine_) {
+    WriteHelper::WriteWithIoUring(WrapUnique(helper), io_uring_engine_, offset,
+                                  std::move(callback));
+    return true;
+  }
+#endif
   return task_runner_->PostTaskAndReply(
       FROM_HERE, BindOnce(&WriteHelper::RunWork, Unretained(helper), offset),
       BindOnce(&WriteHelper::Reply, Owned(helper), std::move(callback)));
@@ -349,6 +466,15 @@ bool FileProxy::SetLength(int64_t length, StatusCallback callback) {
 bool FileProxy::Flush(StatusCallback callback) {
   DCHECK(file_.IsValid());
   GenericFileHelper* helper = new GenericFileHelper(this, std::move(file_));
+#if defined(OS_LINUX) || defined(OS_CHROMEOS)
+  if (io_uring_engine_) {
+    const PlatformFile file = helper->GetPlatformFile();
+    io_uring_engine_->Flush(file, SequencedTaskRunnerHandle::Get(),
+                            BindOnce(&GenericFileHelper::ReplyWithError,
+                                     Owned(helper), std::move(callback)));
+    return true;
+  }
+#endif
   return task_runner_->PostTaskAndReply(
       FROM_HERE, BindOnce(&GenericFileHelper::Flush, Unretained(helper)),
       BindOnce(&GenericFileHelper::Reply, Owned(helper), std::move(callback)));
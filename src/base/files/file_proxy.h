@@ -13,9 +13,13 @@
 #include "base/files/file_path.h"
 #include "base/memory/ref_counted.h"
 #include "base/memory/weak_ptr.h"
+#include "build/build_config.h"
 
 namespace base {
 
+#if defined(OS_LINUX) || defined(OS_CHROMEOS)
+class IoUringFileEngine;
+#endif
 class TaskRunner;
 class Time;
 
@@ -128,12 +132,26 @@ class BASE_EXPORT FileProxy : public SupportsWeakPtr<FileProxy> {
   // This returns false if task posting to |task_runner| has failed.
   bool Flush(StatusCallback callback);
 
+#if defined(OS_LINUX) || defined(OS_CHROMEOS)
+  // Makes Read(), Write() and Flush() go through |engine|, which must outlive
+  // the operations, instead of the task runner. Their callbacks still run on
+  // the sequence which called them. Like File::Read() and File::Write(), short
+  // reads and writes are continued until the buffer is done, the end of the
+  // file is reached or an error occurs. Null restores the task runner.
+  void SetIoUringEngine(IoUringFileEngine* engine) {
+    io_uring_engine_ = engine;
+  }
+#endif
+
  private:
   friend class FileHelper;
   TaskRunner* task_runner() { return task_runner_.get(); }
 
   scoped_refptr<TaskRunner> task_runner_;
   File file_;
+#if defined(OS_LINUX) || defined(OS_CHROMEOS)
+  IoUringFileEngine* io_uring_engine_ = nullptr;
+#endif
 };
 
 }  // namespace base
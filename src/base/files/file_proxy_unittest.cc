@@ -23,6 +23,14 @@
 #include "build/build_config.h"
 #include "testing/gtest/include/gtest/gtest.h"
 
+#if defined(OS_LINUX) || defined(OS_CHROMEOS)
+#include "base/files/io_uring_file_engine.h"
+#include "base/files/scoped_file.h"
+#include "base/test/bind.h"
+#include "base/test/test_timeouts.h"
+#include "base/threading/thread_task_runner_handle.h"
+#endif
+
 namespace base {
 
 class FileProxyTest : public testing::Test {
@@ -357,6 +365,83 @@ TEST_F(FileProxyTest, WriteAndFlush) {
   }
 }
 
+#if defined(OS_LINUX) || defined(OS_CHROMEOS)
+TEST_F(FileProxyTest, WriteFlushAndReadWithIoUring) {
+  std::unique_ptr<IoUringFileEngine> engine = IoUringFileEngine::Create();
+  if (!engine)
+    GTEST_SKIP() << "io_uring is not supported";
+
+  FileProxy proxy(file_task_runner());
+  CreateProxy(File::FLAG_CREATE | File::FLAG_READ | File::FLAG_WRITE, &proxy);
+  proxy.SetIoUringEngine(engine.get());
+
+  const char data[] = "foo!";
+  int data_bytes = base::size(data);
+  {
+    RunLoop run_loop;
+    proxy.Write(0, data, data_bytes,
+                BindOnce(&FileProxyTest::DidWrite, weak_factory_.GetWeakPtr(),
+                         run_loop.QuitWhenIdleClosure()));
+    // Only one operation at a time.
+    EXPECT_FALSE(proxy.IsValid());
+    run_loop.Run();
+  }
+  EXPECT_EQ(File::FILE_OK, error_);
+  EXPECT_EQ(data_bytes, bytes_written_);
+  EXPECT_TRUE(proxy.IsValid());
+
+  {
+    RunLoop run_loop;
+    proxy.Flush(BindOnce(&FileProxyTest::DidFinish, weak_factory_.GetWeakPtr(),
+                         run_loop.QuitWhenIdleClosure()));
+    run_loop.Run();
+  }
+  EXPECT_EQ(File::FILE_OK, error_);
+
+  {
+    RunLoop run_loop;
+    proxy.Read(0, 128,
+               BindOnce(&FileProxyTest::DidRead, weak_factory_.GetWeakPtr(),
+                        run_loop.QuitWhenIdleClosure()));
+    run_loop.Run();
+  }
+  EXPECT_EQ(File::FILE_OK, error_);
+  ASSERT_EQ(data_bytes, static_cast<int>(buffer_.size()));
+  for (int i = 0; i < data_bytes; ++i)
+    EXPECT_EQ(data[i], buffer_[i]);
+}
+
+// A read from a pipe only returns what was written to it so far, so it is
+// continued until the buffer is full.
+TEST_F(FileProxyTest, ShortReadWithIoUring) {
+  std::unique_ptr<IoUringFileEngine> engine = IoUringFileEngine::Create();
+  if (!engine)
+    GTEST_SKIP() << "io_uring is not supported";
+
+  ScopedFD read_fd;
+  ScopedFD write_fd;
+  ASSERT_TRUE(CreatePipe(&read_fd, &write_fd));
+  ASSERT_TRUE(WriteFileDescriptor(write_fd.get(), "0123"));
+
+  FileProxy proxy(file_task_runner());
+  proxy.SetFile(File(std::move(read_fd)));
+  proxy.SetIoUringEngine(engine.get());
+  RunLoop run_loop;
+  proxy.Read(0, 8,
+             BindOnce(&FileProxyTest::DidRead, weak_factory_.GetWeakPtr(),
+                      run_loop.QuitWhenIdleClosure()));
+  // Written once the first read returned the first half.
+  ThreadTaskRunnerHandle::Get()->PostDelayedTask(
+      FROM_HERE, BindLambdaForTesting([&]() {
+        EXPECT_TRUE(WriteFileDescriptor(write_fd.get(), "4567"));
+      }),
+      TestTimeouts::tiny_timeout());
+  run_loop.Run();
+  EXPECT_EQ(File::FILE_OK, error_);
+  EXPECT_EQ("01234567", std::string(buffer_.begin(), buffer_.end()));
+}
+#endif  // defined(OS_LINUX) || defined(OS_CHROMEOS)
+
 #if defined(OS_ANDROID) || defined(OS_FUCHSIA)
 // Flaky on Android, see http://crbug.com/489602
 // TODO(crbug.com/851734): Implementation depends on stat, which is not
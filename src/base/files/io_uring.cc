@@ -0,0 +1,226 @@
+// Copyright 2021 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "base/files/io_uring.h"
+
+#include <linux/io_uring.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "base/check_op.h"
+#include "base/memory/ptr_util.h"
+#include "base/posix/eintr_wrapper.h"
+
+// The system call numbers are the same on all the architectures but alpha,
+// which the headers of older sysroots may not define.
+#if !defined(__NR_io_uring_setup)
+#define __NR_io_uring_setup 425
+#define __NR_io_uring_enter 426
+#define __NR_io_uring_register 427
+#endif
+
+// Linux 5.8.
+#if !defined(IORING_SQ_CQ_OVERFLOW)
+#define IORING_SQ_CQ_OVERFLOW (1U << 1)
+#endif
+
+namespace base {
+
+namespace {
+
+// The last operation of Linux 5.5, the last version without
+// IORING_REGISTER_PROBE.
+constexpr uint8_t kLastOpWithoutProbe = IORING_OP_CONNECT;
+
+int IoUringSetup(uint32_t entries, io_uring_params* params) {
+  return syscall(__NR_io_uring_setup, entries, params);
+}
+
+int IoUringEnter(int fd,
+                 uint32_t to_submit,
+                 uint32_t min_complete,
+                 uint32_t flags) {
+  return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags,
+                 nullptr, 0);
+}
+
+int IoUringRegister(int fd, uint32_t opcode, const void* arg, uint32_t count) {
+  return syscall(__NR_io_uring_register, fd, opcode, arg, count);
+}
+
+void* MapRing(int fd, size_t size, off_t offset) {
+  void* address = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, fd, offset);
+  return address == MAP_FAILED ? nullptr : address;
+}
+
+template <typename T>
+T* RingField(void* ring, uint32_t offset) {
+  return reinterpret_cast<T*>(static_cast<char*>(ring) + offset);
+}
+
+}  // namespace
+
+// static
+std::unique_ptr<IoUring> IoUring::Create(uint32_t entries) {
+  auto ring = WrapUnique(new IoUring());
+  if (!ring->Initialize(entries))
+    return nullptr;
+  return ring;
+}
+
+IoUring::~IoUring() {
+  if (sqes_)
+    munmap(sqes_, sqes_size_);
+  if (cq_ring_ && cq_ring_ != sq_ring_)
+    munmap(cq_ring_, cq_ring_size_);
+  if (sq_ring_)
+    munmap(sq_ring_, sq_ring_size_);
+}
+
+bool IoUring::Initialize(uint32_t entries) {
+  io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  params.flags = IORING_SETUP_CQSIZE;
+  params.cq_entries = 2 * entries;
+  ring_fd_.reset(IoUringSetup(entries, &params));
+  if (!ring_fd_.is_valid() || !(params.features & IORING_FEAT_NODROP))
+    return false;
+
+  sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+  cq_ring_size_ =
+      params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  if (params.features & IORING_FEAT_SINGLE_MMAP) {
+    sq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+    cq_ring_size_ = sq_ring_size_;
+  }
+  sq_ring_ = MapRing(ring_fd_.get(), sq_ring_size_, IORING_OFF_SQ_RING);
+  if (!sq_ring_)
+    return false;
+  if (params.features & IORING_FEAT_SINGLE_MMAP) {
+    cq_ring_ = sq_ring_;
+  } else {
+    cq_ring_ = MapRing(ring_fd_.get(), cq_ring_size_, IORING_OFF_CQ_RING);
+    if (!cq_ring_)
+      return false;
+  }
+  sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+  sqes_ = static_cast<io_uring_sqe*>(
+      MapRing(ring_fd_.get(), sqes_size_, IORING_OFF_SQES));
+  if (!sqes_)
+    return false;
+
+  sq_entries_ = params.sq_entries;
+  sq_mask_ = *RingField<uint32_t>(sq_ring_, params.sq_off.ring_mask);
+  sq_head_ = RingField<std::atomic<uint32_t>>(sq_ring_, params.sq_off.head);
+  sq_tail_ = RingField<std::atomic<uint32_t>>(sq_ring_, params.sq_off.tail);
+  sq_flags_ = RingField<std::atomic<uint32_t>>(sq_ring_, params.sq_off.flags);
+  sq_array_ = RingField<uint32_t>(sq_ring_, params.sq_off.array);
+  sqe_tail_ = sq_tail_->load(std::memory_order_relaxed);
+
+  cq_entries_ = params.cq_entries;
+  cq_mask_ = *RingField<uint32_t>(cq_ring_, params.cq_off.ring_mask);
+  cq_head_ = RingField<std::atomic<uint32_t>>(cq_ring_, params.cq_off.head);
+  cq_tail_ = RingField<std::atomic<uint32_t>>(cq_ring_, params.cq_off.tail);
+  cqes_ = RingField<io_uring_cqe>(cq_ring_, params.cq_off.cqes);
+
+  ProbeOps();
+  return true;
+}
+
+void IoUring::ProbeOps() {
+  constexpr size_t kNumOps = 256;
+  const size_t probe_size =
+      sizeof(io_uring_probe) + kNumOps * sizeof(io_uring_probe_op);
+  std::unique_ptr<char[]> buffer(new char[probe_size]());
+  io_uring_probe* probe = reinterpret_cast<io_uring_probe*>(buffer.get());
+  if (IoUringRegister(ring_fd_.get(), IORING_REGISTER_PROBE, probe, kNumOps) <
+      0) {
+    for (size_t op = 0; op <= kLastOpWithoutProbe; ++op)
+      supported_ops_.set(op);
+    return;
+  }
+  for (size_t i = 0; i < probe->ops_len && i < kNumOps; ++i) {
+    if (probe->ops[i].flags & IO_URING_OP_SUPPORTED)
+      supported_ops_.set(probe->ops[i].op);
+  }
+}
+
+io_uring_sqe* IoUring::GetSqe() {
+  const uint32_t head = sq_head_->load(std::memory_order_acquire);
+  if (sqe_tail_ - head >= sq_entries_)
+    return nullptr;
+  const uint32_t index = sqe_tail_ & sq_mask_;
+  io_uring_sqe* sqe = &sqes_[index];
+  memset(sqe, 0, sizeof(*sqe));
+  sq_array_[index] = index;
+  ++sqe_tail_;
+  return sqe;
+}
+
+uint32_t IoUring::GetSqSpaceLeft() const {
+  return sq_entries_ -
+         (sqe_tail_ - sq_head_->load(std::memory_order_acquire));
+}
+
+int IoUring::Submit() {
+  // Publishes the entries to the kernel, which may not have consumed all those
+  // of the previous submission.
+  sq_tail_->store(sqe_tail_, std::memory_order_release);
+  const uint32_t to_submit =
+      sqe_tail_ - sq_head_->load(std::memory_order_acquire);
+  if (!to_submit)
+    return 0;
+  const int result =
+      HANDLE_EINTR(IoUringEnter(ring_fd_.get(), to_submit, 0, 0));
+  return result < 0 ? -errno : result;
+}
+
+int IoUring::WaitForCompletions(uint32_t min_complete) {
+  const int result = HANDLE_EINTR(IoUringEnter(
+      ring_fd_.get(), 0, min_complete, IORING_ENTER_GETEVENTS));
+  return result < 0 ? -errno : 0;
+}
+
+int IoUring::SubmitAndWait(uint32_t min_complete) {
+  sq_tail_->store(sqe_tail_, std::memory_order_release);
+  const uint32_t to_submit =
+      sqe_tail_ - sq_head_->load(std::memory_order_acquire);
+  const int result = HANDLE_EINTR(IoUringEnter(
+      ring_fd_.get(), to_submit, min_complete, IORING_ENTER_GETEVENTS));
+  return result < 0 ? -errno : result;
+}
+
+bool IoUring::HasOverflowedCompletions() const {
+  return sq_flags_->load(std::memory_order_relaxed) & IORING_SQ_CQ_OVERFLOW;
+}
+
+io_uring_cqe* IoUring::PeekCqe() {
+  const uint32_t head = cq_head_->load(std::memory_order_relaxed);
+  if (head == cq_tail_->load(std::memory_order_acquire))
+    return nullptr;
+  return &cqes_[head & cq_mask_];
+}
+
+void IoUring::PopCqe() {
+  const uint32_t head = cq_head_->load(std::memory_order_relaxed);
+  DCHECK_NE(head, cq_tail_->load(std::memory_order_relaxed));
+  cq_head_->store(head + 1, std::memory_order_release);
+}
+
+int IoUring::RegisterBuffers(const iovec* buffers, uint32_t count) {
+  const int result = IoUringRegister(ring_fd_.get(), IORING_REGISTER_BUFFERS,
+                                     buffers, count);
+  return result < 0 ? -errno : result;
+}
+
+bool IoUring::IsOpSupported(uint8_t opcode) const {
+  return supported_ops_.test(opcode);
+}
+
+}  // namespace base
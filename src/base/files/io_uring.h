@@ -0,0 +1,125 @@
+// Copyright 2021 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BASE_FILES_IO_URING_H_
+#define BASE_FILES_IO_URING_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+#include <atomic>
+#include <bitset>
+#include <memory>
+
+#include "base/base_export.h"
+#include "base/files/scoped_file.h"
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+namespace base {
+
+// A minimal io_uring instance (see io_uring(7)), used without liburing: the
+// submission and completion queues are mapped in memory and the entries are
+// submitted with io_uring_enter(2).
+//
+// Not thread-safe: the submission queue must be used by one thread at a time,
+// and so must the completion queue, though not necessarily by the same one.
+//
+// Linux and ChromeOS only.
+class BASE_EXPORT IoUring {
+ public:
+  // Returns null if io_uring isn't supported by the kernel, or not permitted,
+  // e.g. by a seccomp-bpf policy or by the kernel.io_uring_disabled sysctl.
+  // The completion queue has twice as many |entries| as the submission queue.
+  // The kernel must keep the completions which don't fit in the completion
+  // queue (IORING_FEAT_NODROP, Linux 5.5).
+  static std::unique_ptr<IoUring> Create(uint32_t entries);
+
+  IoUring(const IoUring&) = delete;
+  IoUring& operator=(const IoUring&) = delete;
+  ~IoUring();
+
+  // Returns a zeroed submission queue entry to fill, or null if the queue is
+  // full, in which case Submit() makes room.
+  io_uring_sqe* GetSqe();
+
+  // Returns the number of entries GetSqe() can return before a submission.
+  uint32_t GetSqSpaceLeft() const;
+
+  // Submits the entries got since the last call. Returns the number of entries
+  // submitted, or -errno.
+  int Submit();
+
+  // Waits until there are |min_complete| completions in the queue. Returns 0,
+  // or -errno, e.g. -EINTR if interrupted by a signal. Unlike the others, this
+  // can be called concurrently with the methods of the submission queue.
+  int WaitForCompletions(uint32_t min_complete);
+
+  // Submit() and WaitForCompletions() in a single system call, which also
+  // moves the completions which overflowed back to the completion queue.
+  int SubmitAndWait(uint32_t min_complete);
+
+  // Returns whether completions overflowed the completion queue, in which case
+  // SubmitAndWait() must be called to get them.
+  bool HasOverflowedCompletions() const;
+
+  // Returns the oldest completion, or null if there is none. It stays in the
+  // queue until PopCqe().
+  io_uring_cqe* PeekCqe();
+  void PopCqe();
+
+  // Registers buffers for the IORING_OP_READ_FIXED and IORING_OP_WRITE_FIXED
+  // operations, in which they are referred to by their index. Returns 0 or
+  // -errno.
+  int RegisterBuffers(const iovec* buffers, uint32_t count);
+
+  // Returns whether the kernel supports the IORING_OP_* |opcode|. Only known
+  // from Linux 5.6, before which only the operations of Linux 5.5 are assumed.
+  bool IsOpSupported(uint8_t opcode) const;
+
+  uint32_t sq_entries() const { return sq_entries_; }
+  uint32_t cq_entries() const { return cq_entries_; }
+  int fd() const { return ring_fd_.get(); }
+
+ private:
+  IoUring() = default;
+
+  bool Initialize(uint32_t entries);
+  void ProbeOps();
+
+  ScopedFD ring_fd_;
+
+  // The mappings of the rings and of the submission queue entries. The
+  // completion queue shares the mapping of the submission queue if the kernel
+  // supports it (IORING_FEAT_SINGLE_MMAP).
+  void* sq_ring_ = nullptr;
+  size_t sq_ring_size_ = 0;
+  void* cq_ring_ = nullptr;
+  size_t cq_ring_size_ = 0;
+  io_uring_sqe* sqes_ = nullptr;
+  size_t sqes_size_ = 0;
+
+  uint32_t sq_entries_ = 0;
+  uint32_t sq_mask_ = 0;
+  std::atomic<uint32_t>* sq_head_ = nullptr;
+  std::atomic<uint32_t>* sq_tail_ = nullptr;
+  std::atomic<uint32_t>* sq_flags_ = nullptr;
+  uint32_t* sq_array_ = nullptr;
+  // The tail including the entries got but not submitted yet.
+  uint32_t sqe_tail_ = 0;
+
+  uint32_t cq_entries_ = 0;
+  uint32_t cq_mask_ = 0;
+  std::atomic<uint32_t>* cq_head_ = nullptr;
+  std::atomic<uint32_t>* cq_tail_ = nullptr;
+  io_uring_cqe* cqes_ = nullptr;
+
+  std::bitset<256> supported_ops_;
+};
+
+}  // namespace base
+
+#endif  // BASE_FILES_IO_URING_H_
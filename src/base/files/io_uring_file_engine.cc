@@ -0,0 +1,373 @@
+// Copyright 2021 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "base/files/io_uring_file_engine.h"
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include <limits>
+#include <utility>
+
+#include "base/bind.h"
+#include "base/check_op.h"
+#include "base/files/io_uring.h"
+#include "base/location.h"
+#include "base/memory/ptr_util.h"
+#include "base/task/sequenced_task_runner.h"
+#include "build/chromeos_buildflags.h"
+
+namespace base {
+
+namespace {
+
+// The operations of the engine, all supported from Linux 5.6.
+constexpr uint8_t kRequiredOps[] = {
+    IORING_OP_READ,        IORING_OP_WRITE, IORING_OP_READ_FIXED,
+    IORING_OP_WRITE_FIXED, IORING_OP_FSYNC, IORING_OP_OPENAT,
+};
+
+// The open(2) flags for the File |flags|, as in File::DoInitialize().
+int GetOpenFlags(uint32_t flags) {
+  int open_flags = 0;
+  if (flags & File::FLAG_CREATE)
+    open_flags = O_CREAT | O_EXCL;
+  if (flags & File::FLAG_CREATE_ALWAYS) {
+    DCHECK(!open_flags);
+    DCHECK(flags & File::FLAG_WRITE);
+    open_flags = O_CREAT | O_TRUNC;
+  }
+  if (flags & File::FLAG_OPEN_TRUNCATED) {
+    DCHECK(!open_flags);
+    DCHECK(flags & File::FLAG_WRITE);
+    open_flags = O_TRUNC;
+  }
+  if (flags & File::FLAG_OPEN_ALWAYS)
+    open_flags |= O_CREAT;
+  DCHECK(open_flags || (flags & File::FLAG_OPEN));
+
+  if (flags & File::FLAG_WRITE && flags & File::FLAG_READ)
+    open_flags |= O_RDWR;
+  else if (flags & File::FLAG_WRITE)
+    open_flags |= O_WRONLY;
+
+  if (flags & File::FLAG_TERMINAL_DEVICE)
+    open_flags |= O_NOCTTY | O_NDELAY;
+
+  if (flags & File::FLAG_APPEND && flags & File::FLAG_READ)
+    open_flags |= O_APPEND | O_RDWR;
+  else if (flags & File::FLAG_APPEND)
+    open_flags |= O_APPEND | O_WRONLY;
+  return open_flags;
+}
+
+void RunIOCallback(IoUringFileEngine::IOCallback callback, int result) {
+  if (result < 0)
+    std::move(callback).Run(File::OSErrorToFileError(-result), -1);
+  else
+    std::move(callback).Run(File::FILE_OK, result);
+}
+
+void RunStatusCallback(IoUringFileEngine::StatusCallback callback,
+                       int result) {
+  std::move(callback).Run(result < 0 ? File::OSErrorToFileError(-result)
+                                     : File::FILE_OK);
+}
+
+void RunOpenCallback(IoUringFileEngine::OpenCallback callback,
+                     bool async,
+                     int result) {
+  if (result < 0)
+    std::move(callback).Run(File(File::OSErrorToFileError(-result)));
+  else
+    std::move(callback).Run(File(ScopedPlatformFile(result), async));
+}
+
+}  // namespace
+
+// An operation from its submission to its completion, identified by its
+// address in the user data of its entries.
+struct IoUringFileEngine::Operation {
+  uint8_t opcode = IORING_OP_NOP;
+  int fd = -1;
+  uint64_t offset = 0;
+  uint64_t address = 0;
+  uint32_t length = 0;
+  uint16_t buffer_index = 0;
+  uint32_t flags = 0;
+  // The path of IORING_OP_OPENAT, which |address| points to.
+  std::string path;
+
+  scoped_refptr<SequencedTaskRunner> reply_task_runner;
+  // Run with the result of the operation: a positive value, or -errno. Null
+  // for the operation waking up the completion thread on destruction.
+  OnceCallback<void(int)> callback;
+};
+
+IoUringFileEngine::ScopedBatch::ScopedBatch(IoUringFileEngine* engine)
+    : engine_(engine) {
+  AutoLock lock(engine_->lock_);
+  ++engine_->batch_depth_;
+}
+
+IoUringFileEngine::ScopedBatch::~ScopedBatch() {
+  AutoLock lock(engine_->lock_);
+  DCHECK_GT(engine_->batch_depth_, 0);
+  if (!--engine_->batch_depth_)
+    engine_->SubmitLocked();
+}
+
+// static
+std::unique_ptr<IoUringFileEngine> IoUringFileEngine::Create(
+    uint32_t queue_depth) {
+  std::unique_ptr<IoUring> ring = IoUring::Create(queue_depth);
+  if (!ring)
+    return nullptr;
+  for (uint8_t opcode : kRequiredOps) {
+    if (!ring->IsOpSupported(opcode))
+      return nullptr;
+  }
+  return WrapUnique(new IoUringFileEngine(std::move(ring)));
+}
+
+IoUringFileEngine::IoUringFileEngine(std::unique_ptr<IoUring> ring)
+    : ring_(std::move(ring)) {
+  completion_thread_ =
+      std::make_unique<DelegateSimpleThread>(this, "IoUringFileEngine");
+  completion_thread_->StartAsync();
+}
+
+IoUringFileEngine::~IoUringFileEngine() {
+  {
+    AutoLock lock(lock_);
+    DCHECK(!batch_depth_);
+    shutting_down_ = true;
+    queue_.push_back(std::make_unique<Operation>());
+    SubmitLocked();
+  }
+  completion_thread_->Join();
+}
+
+void IoUringFileEngine::Read(
+    PlatformFile file,
+    int64_t offset,
+    span<uint8_t> buffer,
+    scoped_refptr<SequencedTaskRunner> reply_task_runner,
+    IOCallback callback) {
+  DCHECK_GE(offset, 0);
+  DCHECK_LE(buffer.size(),
+            static_cast<size_t>(std::numeric_limits<int>::max()));
+  auto operation = std::make_unique<Operation>();
+  operation->opcode = IORING_OP_READ;
+  operation->fd = file;
+  operation->offset = static_cast<uint64_t>(offset);
+  operation->address = reinterpret_cast<uintptr_t>(buffer.data());
+  operation->length = static_cast<uint32_t>(buffer.size());
+  operation->reply_task_runner = std::move(reply_task_runner);
+  operation->callback = BindOnce(&RunIOCallback, std::move(callback));
+  Enqueue(std::move(operation));
+}
+
+void IoUringFileEngine::Write(
+    PlatformFile file,
+    int64_t offset,
+    span<const uint8_t> buffer,
+    scoped_refptr<SequencedTaskRunner> reply_task_runner,
+    IOCallback callback) {
+  DCHECK_GE(offset, 0);
+  DCHECK_LE(buffer.size(),
+            static_cast<size_t>(std::numeric_limits<int>::max()));
+  auto operation = std::make_unique<Operation>();
+  operation->opcode = IORING_OP_WRITE;
+  operation->fd = file;
+  operation->offset = static_cast<uint64_t>(offset);
+  operation->address = reinterpret_cast<uintptr_t>(buffer.data());
+  operation->length = static_cast<uint32_t>(buffer.size());
+  operation->reply_task_runner = std::move(reply_task_runner);
+  operation->callback = BindOnce(&RunIOCallback, std::move(callback));
+  Enqueue(std::move(operation));
+}
+
+void IoUringFileEngine::Flush(
+    PlatformFile file,
+    scoped_refptr<SequencedTaskRunner> reply_task_runner,
+    StatusCallback callback) {
+  auto operation = std::make_unique<Operation>();
+  operation->opcode = IORING_OP_FSYNC;
+  operation->fd = file;
+  // File::Flush() uses fdatasync(2) on Linux.
+  operation->flags = IORING_FSYNC_DATASYNC;
+  operation->reply_task_runner = std::move(reply_task_runner);
+  operation->callback = BindOnce(&RunStatusCallback, std::move(callback));
+  Enqueue(std::move(operation));
+}
+
+void IoUringFileEngine::Open(
+    const FilePath& path,
+    uint32_t flags,
+    scoped_refptr<SequencedTaskRunner> reply_task_runner,
+    OpenCallback callback) {
+  DCHECK(!(flags & File::FLAG_DELETE_ON_CLOSE));
+  auto operation = std::make_unique<Operation>();
+  operation->opcode = IORING_OP_OPENAT;
+  operation->fd = AT_FDCWD;
+  operation->path = path.value();
+  operation->address = reinterpret_cast<uintptr_t>(operation->path.c_str());
+  operation->flags = GetOpenFlags(flags);
+  // The mode is passed as the length.
+  operation->length = S_IRUSR | S_IWUSR;
+#if BUILDFLAG(IS_CHROMEOS_ASH) || BUILDFLAG(IS_CHROMEOS_LACROS)
+  operation->length |= S_IRGRP | S_IROTH;
+#endif
+  operation->reply_task_runner = std::move(reply_task_runner);
+  operation->callback = BindOnce(&RunOpenCallback, std::move(callback),
+                                 (flags & File::FLAG_ASYNC) != 0);
+  Enqueue(std::move(operation));
+}
+
+bool IoUringFileEngine::RegisterBuffers(
+    const std::vector<span<uint8_t>>& buffers) {
+  std::vector<iovec> iovecs;
+  iovecs.reserve(buffers.size());
+  for (span<uint8_t> buffer : buffers)
+    iovecs.push_back({buffer.data(), buffer.size()});
+  AutoLock lock(lock_);
+  DCHECK(registered_buffers_.empty());
+  if (ring_->RegisterBuffers(iovecs.data(), iovecs.size()) < 0)
+    return false;
+  registered_buffers_ = buffers;
+  return true;
+}
+
+void IoUringFileEngine::ReadFixed(
+    PlatformFile file,
+    int64_t offset,
+    size_t buffer_index,
+    size_t length,
+    scoped_refptr<SequencedTaskRunner> reply_task_runner,
+    IOCallback callback) {
+  DCHECK_GE(offset, 0);
+  auto operation = std::make_unique<Operation>();
+  operation->opcode = IORING_OP_READ_FIXED;
+  operation->fd = file;
+  operation->offset = static_cast<uint64_t>(offset);
+  {
+    AutoLock lock(lock_);
+    CHECK_LT(buffer_index, registered_buffers_.size());
+    CHECK_LE(length, registered_buffers_[buffer_index].size());
+    operation->address =
+        reinterpret_cast<uintptr_t>(registered_buffers_[buffer_index].data());
+  }
+  operation->length = static_cast<uint32_t>(length);
+  operation->buffer_index = static_cast<uint16_t>(buffer_index);
+  operation->reply_task_runner = std::move(reply_task_runner);
+  operation->callback = BindOnce(&RunIOCallback, std::move(callback));
+  Enqueue(std::move(operation));
+}
+
+void IoUringFileEngine::WriteFixed(
+    PlatformFile file,
+    int64_t offset,
+    size_t buffer_index,
+    size_t length,
+    scoped_refptr<SequencedTaskRunner> reply_task_runner,
+    IOCallback callback) {
+  DCHECK_GE(offset, 0);
+  auto operation = std::make_unique<Operation>();
+  operation->opcode = IORING_OP_WRITE_FIXED;
+  operation->fd = file;
+  operation->offset = static_cast<uint64_t>(offset);
+  {
+    AutoLock lock(lock_);
+    CHECK_LT(buffer_index, registered_buffers_.size());
+    CHECK_LE(length, registered_buffers_[buffer_index].size());
+    operation->address =
+        reinterpret_cast<uintptr_t>(registered_buffers_[buffer_index].data());
+  }
+  operation->length = static_cast<uint32_t>(length);
+  operation->buffer_index = static_cast<uint16_t>(buffer_index);
+  operation->reply_task_runner = std::move(reply_task_runner);
+  operation->callback = BindOnce(&RunIOCallback, std::move(callback));
+  Enqueue(std::move(operation));
+}
+
+void IoUringFileEngine::Enqueue(std::unique_ptr<Operation> operation) {
+  AutoLock lock(lock_);
+  DCHECK(!shutting_down_);
+  queue_.push_back(std::move(operation));
+  if (!batch_depth_)
+    SubmitLocked();
+}
+
+void IoUringFileEngine::SubmitLocked() {
+  // The completions of the operations in flight must fit in the completion
+  // queue, for the kernel not to have to buffer them.
+  while (!queue_.empty() && in_flight_ < ring_->cq_entries()) {
+    io_uring_sqe* sqe = ring_->GetSqe();
+    if (!sqe) {
+      // Makes room in the submission queue.
+      if (ring_->Submit() <= 0)
+        break;
+      continue;
+    }
+    Operation* operation = queue_.front().release();
+    queue_.pop_front();
+    ++in_flight_;
+
+    sqe->opcode = operation->opcode;
+    sqe->fd = operation->fd;
+    sqe->off = operation->offset;
+    sqe->addr = operation->address;
+    sqe->len = operation->length;
+    sqe->buf_index = operation->buffer_index;
+    if (operation->opcode == IORING_OP_FSYNC)
+      sqe->fsync_flags = operation->flags;
+    else if (operation->opcode == IORING_OP_OPENAT)
+      sqe->open_flags = operation->flags;
+    sqe->user_data = reinterpret_cast<uintptr_t>(operation);
+  }
+  // On failure, e.g. if the kernel lacks memory, the entries stay in the
+  // submission queue until the next submission.
+  ring_->Submit();
+}
+
+void IoUringFileEngine::Run() {
+  std::vector<std::pair<std::unique_ptr<Operation>, int>> completed;
+  while (true) {
+    const int result = ring_->WaitForCompletions(1);
+    DCHECK_EQ(0, result);
+
+    while (io_uring_cqe* cqe = ring_->PeekCqe()) {
+      completed.emplace_back(
+          WrapUnique(reinterpret_cast<Operation*>(cqe->user_data)), cqe->res);
+      ring_->PopCqe();
+    }
+
+    bool done;
+    {
+      AutoLock lock(lock_);
+      DCHECK_GE(in_flight_, completed.size());
+      in_flight_ -= completed.size();
+      // Submits the operations which were waiting for room.
+      SubmitLocked();
+      done = shutting_down_ && !in_flight_ && queue_.empty();
+    }
+
+    for (auto& completion : completed) {
+      Operation* operation = completion.first.get();
+      if (!operation->callback)
+        continue;
+      operation->reply_task_runner->PostTask(
+          FROM_HERE,
+          BindOnce(std::move(operation->callback), completion.second));
+    }
+    completed.clear();
+    if (done)
+      return;
+  }
+}
+
+}  // namespace base
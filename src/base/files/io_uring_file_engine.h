@@ -0,0 +1,160 @@
+// Copyright 2021 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BASE_FILES_IO_URING_FILE_ENGINE_H_
+#define BASE_FILES_IO_URING_FILE_ENGINE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "base/base_export.h"
+#include "base/callback.h"
+#include "base/containers/circular_deque.h"
+#include "base/containers/span.h"
+#include "base/files/file.h"
+#include "base/files/file_path.h"
+#include "base/memory/scoped_refptr.h"
+#include "base/synchronization/lock.h"
+#include "base/thread_annotations.h"
+#include "base/threading/simple_thread.h"
+
+namespace base {
+
+class IoUring;
+class SequencedTaskRunner;
+
+// IoUringFileEngine performs file I/O asynchronously with io_uring, so that
+// no thread blocks in the read(2) or write(2) system calls: the operations are
+// queued to the kernel, and a single completion thread posts their results to
+// the sequences which issued them. A thread pool running File operations in
+// ScopedBlockingCalls, like FileProxy does, needs instead as many blocked
+// threads as concurrent operations.
+//
+// Create() returns null if the kernel doesn't support io_uring or the
+// operations used (Linux 5.6), in which case the File operations must be used
+// instead, e.g. through FileProxy. The engine may be used from any sequence.
+//
+// The operations are submitted to the kernel as they are issued, with one
+// system call per operation, unless a ScopedBatch defers them. Operations
+// beyond the capacity of the queues are kept until there is room.
+//
+// Linux and ChromeOS only.
+class BASE_EXPORT IoUringFileEngine : public DelegateSimpleThread::Delegate {
+ public:
+  // Run with the number of bytes read or written, or -1 with the error.
+  using IOCallback = OnceCallback<void(File::Error, int bytes)>;
+  using StatusCallback = OnceCallback<void(File::Error)>;
+  // Run with the opened file, or with an invalid file holding the error.
+  using OpenCallback = OnceCallback<void(File)>;
+
+  // Defers the submission of the operations issued while it is alive, on any
+  // sequence, so that they are submitted with a single system call.
+  class BASE_EXPORT ScopedBatch {
+   public:
+    explicit ScopedBatch(IoUringFileEngine* engine);
+    ScopedBatch(const ScopedBatch&) = delete;
+    ScopedBatch& operator=(const ScopedBatch&) = delete;
+    ~ScopedBatch();
+
+   private:
+    IoUringFileEngine* const engine_;
+  };
+
+  static constexpr uint32_t kDefaultQueueDepth = 256;
+
+  // Returns null if io_uring can't be used. |queue_depth| is the number of
+  // operations which can be submitted with a single system call.
+  static std::unique_ptr<IoUringFileEngine> Create(
+      uint32_t queue_depth = kDefaultQueueDepth);
+
+  IoUringFileEngine(const IoUringFileEngine&) = delete;
+  IoUringFileEngine& operator=(const IoUringFileEngine&) = delete;
+  // Waits for the pending operations to complete. Their callbacks are still
+  // posted to their task runners.
+  ~IoUringFileEngine() override;
+
+  // Like File::Read() and File::Write(), at |offset|, without retrying on
+  // short reads or writes. |buffer| must stay valid until |callback| runs on
+  // |reply_task_runner|.
+  void Read(PlatformFile file,
+            int64_t offset,
+            span<uint8_t> buffer,
+            scoped_refptr<SequencedTaskRunner> reply_task_runner,
+            IOCallback callback);
+  void Write(PlatformFile file,
+             int64_t offset,
+             span<const uint8_t> buffer,
+             scoped_refptr<SequencedTaskRunner> reply_task_runner,
+             IOCallback callback);
+
+  // Like File::Flush().
+  void Flush(PlatformFile file,
+             scoped_refptr<SequencedTaskRunner> reply_task_runner,
+             StatusCallback callback);
+
+  // Like File::Initialize(). FLAG_OPEN_ALWAYS creates the file if needed, but
+  // File::created() isn't set. FLAG_DELETE_ON_CLOSE isn't supported.
+  void Open(const FilePath& path,
+            uint32_t flags,
+            scoped_refptr<SequencedTaskRunner> reply_task_runner,
+            OpenCallback callback);
+
+  // Registers |buffers| with the kernel, which then doesn't have to map them
+  // for every operation. They can be registered only once, before they are
+  // used by ReadFixed() and WriteFixed(), and must stay valid as long as the
+  // engine. Returns false on failure, e.g. if they exceed RLIMIT_MEMLOCK.
+  bool RegisterBuffers(const std::vector<span<uint8_t>>& buffers);
+
+  // Like Read() and Write(), with the first |length| bytes of the registered
+  // buffer at |buffer_index|.
+  void ReadFixed(PlatformFile file,
+                 int64_t offset,
+                 size_t buffer_index,
+                 size_t length,
+                 scoped_refptr<SequencedTaskRunner> reply_task_runner,
+                 IOCallback callback);
+  void WriteFixed(PlatformFile file,
+                  int64_t offset,
+                  size_t buffer_index,
+                  size_t length,
+                  scoped_refptr<SequencedTaskRunner> reply_task_runner,
+                  IOCallback callback);
+
+ private:
+  struct Operation;
+
+  explicit IoUringFileEngine(std::unique_ptr<IoUring> ring);
+
+  // Queues |operation| to be submitted, unless a batch defers it.
+  void Enqueue(std::unique_ptr<Operation> operation);
+
+  // Submits the queued operations, as many as the completion queue can hold.
+  void SubmitLocked() EXCLUSIVE_LOCKS_REQUIRED(lock_);
+
+  // DelegateSimpleThread::Delegate:
+  // Reaps the completions and posts their callbacks, until the engine is
+  // destroyed.
+  void Run() override;
+
+  const std::unique_ptr<IoUring> ring_;
+
+  Lock lock_;
+  // The operations not submitted yet.
+  circular_deque<std::unique_ptr<Operation>> queue_ GUARDED_BY(lock_);
+  // The number of operations submitted and not reaped yet.
+  size_t in_flight_ GUARDED_BY(lock_) = 0;
+  int batch_depth_ GUARDED_BY(lock_) = 0;
+  bool shutting_down_ GUARDED_BY(lock_) = false;
+  std::vector<span<uint8_t>> registered_buffers_ GUARDED_BY(lock_);
+
+  std::unique_ptr<DelegateSimpleThread> completion_thread_;
+};
+
+}  // namespace base
+
+#endif  // BASE_FILES_IO_URING_FILE_ENGINE_H_
@@ -0,0 +1,212 @@
+// Copyright 2021 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "base/files/io_uring_file_engine.h"
+
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "base/bind.h"
+#include "base/files/file.h"
+#include "base/files/file_proxy.h"
+#include "base/files/scoped_temp_dir.h"
+#include "base/rand_util.h"
+#include "base/run_loop.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/task/single_thread_task_executor.h"
+#include "base/task/thread_pool.h"
+#include "base/task/thread_pool/thread_pool_instance.h"
+#include "base/test/bind.h"
+#include "base/threading/sequenced_task_runner_handle.h"
+#include "base/time/time.h"
+#include "testing/gtest/include/gtest/gtest.h"
+#include "testing/perf/perf_result_reporter.h"
+
+namespace base {
+
+namespace {
+
+constexpr char kMetricPrefixIoUring[] = "IoUringFileEngine.";
+constexpr char kMetricReadThroughput[] = "read_throughput";
+
+// The file is in the page cache once written, so that the reads measure the
+// cost of the I/O path rather than the one of the storage.
+constexpr int64_t kFileSize = 64 * 1024 * 1024;
+constexpr int kReadSize = 4096;
+constexpr int kNumReads = 20000;
+constexpr int kMaxQueueDepth = 128;
+
+// Issues a read of |kReadSize| bytes at |offset| with the buffers of |slot|,
+// then runs the callback with the number of bytes read.
+using IssueReadCallback =
+    RepeatingCallback<void(int slot, int64_t offset, OnceCallback<void(int)>)>;
+
+class IoUringFileEnginePerfTest : public testing::TestWithParam<int> {
+ public:
+  IoUringFileEnginePerfTest() {
+    ThreadPoolInstance::Create("IoUringFileEnginePerfTest");
+    // FileProxy needs as many threads as reads in flight.
+    ThreadPoolInstance::Get()->Start({kMaxQueueDepth});
+  }
+
+  ~IoUringFileEnginePerfTest() override {
+    ThreadPoolInstance::Get()->JoinForTesting();
+    ThreadPoolInstance::Set(nullptr);
+  }
+
+  void SetUp() override {
+    ASSERT_TRUE(temp_dir_.CreateUniqueTempDir());
+    path_ = temp_dir_.GetPath().AppendASCII("file");
+    File file(path_, File::FLAG_CREATE | File::FLAG_WRITE);
+    ASSERT_TRUE(file.IsValid());
+    const std::string chunk = RandBytesAsString(1024 * 1024);
+    for (int64_t offset = 0; offset < kFileSize; offset += chunk.size()) {
+      ASSERT_EQ(static_cast<int>(chunk.size()),
+                file.Write(offset, chunk.data(), chunk.size()));
+    }
+  }
+
+ protected:
+  int queue_depth() const { return GetParam(); }
+
+  // Runs |kNumReads| reads at random offsets aligned on |kReadSize|, keeping
+  // queue_depth() of them in flight, and reports the reads per second.
+  void RunRandomReads(const std::string& story_name,
+                      const IssueReadCallback& issue_read) {
+    int issued = 0;
+    int completed = 0;
+    RunLoop run_loop;
+    RepeatingCallback<void(int)> issue_next;
+    issue_next = BindLambdaForTesting([&](int slot) {
+      const int64_t offset =
+          static_cast<int64_t>(RandGenerator(kFileSize / kReadSize)) *
+          kReadSize;
+      ++issued;
+      issue_read.Run(slot, offset, BindLambdaForTesting([&, slot](int bytes) {
+                       CHECK_EQ(kReadSize, bytes);
+                       if (++completed == kNumReads)
+                         run_loop.Quit();
+                       else if (issued < kNumReads)
+                         issue_next.Run(slot);
+                     }));
+    });
+
+    const TimeTicks start = TimeTicks::Now();
+    for (int slot = 0; slot < queue_depth(); ++slot)
+      issue_next.Run(slot);
+    run_loop.Run();
+    const TimeDelta elapsed = TimeTicks::Now() - start;
+
+    perf_test::PerfResultReporter reporter(
+        kMetricPrefixIoUring,
+        story_name + "_qd" + NumberToString(queue_depth()));
+    reporter.RegisterImportantMetric(kMetricReadThroughput, "reads/s");
+    reporter.AddResult(kMetricReadThroughput, kNumReads / elapsed.InSecondsF());
+  }
+
+  // Reads with FileProxies on the thread pool, one per read in flight since
+  // FileProxy proxies one operation at a time, with |engine| if not null.
+  void RunFileProxyReads(const std::string& story_name,
+                         IoUringFileEngine* engine) {
+    scoped_refptr<TaskRunner> task_runner =
+        ThreadPool::CreateTaskRunner({MayBlock()});
+    std::vector<std::unique_ptr<FileProxy>> proxies;
+    for (int i = 0; i < queue_depth(); ++i) {
+      proxies.push_back(std::make_unique<FileProxy>(task_runner.get()));
+      proxies.back()->SetFile(File(path_, File::FLAG_OPEN | File::FLAG_READ));
+      ASSERT_TRUE(proxies.back()->IsValid());
+      proxies.back()->SetIoUringEngine(engine);
+    }
+
+    RunRandomReads(
+        story_name, BindLambdaForTesting([&](int slot, int64_t offset,
+                                             OnceCallback<void(int)> done) {
+          proxies[slot]->Read(
+              offset, kReadSize,
+              BindOnce(
+                  [](OnceCallback<void(int)> done, File::Error error,
+                     const char* data, int bytes_read) {
+                    std::move(done).Run(bytes_read);
+                  },
+                  std::move(done)));
+        }));
+  }
+
+  SingleThreadTaskExecutor executor_;
+  ScopedTempDir temp_dir_;
+  FilePath path_;
+};
+
+}  // namespace
+
+TEST_P(IoUringFileEnginePerfTest, RandomReads) {
+  std::unique_ptr<IoUringFileEngine> engine =
+      IoUringFileEngine::Create(kMaxQueueDepth);
+  if (!engine)
+    GTEST_SKIP() << "io_uring is not supported";
+  File file(path_, File::FLAG_OPEN | File::FLAG_READ);
+  ASSERT_TRUE(file.IsValid());
+
+  std::vector<std::vector<uint8_t>> buffers(queue_depth(),
+                                            std::vector<uint8_t>(kReadSize));
+  RunRandomReads(
+      "engine", BindLambdaForTesting([&](int slot, int64_t offset,
+                                         OnceCallback<void(int)> done) {
+        engine->Read(file.GetPlatformFile(), offset, buffers[slot],
+                     SequencedTaskRunnerHandle::Get(),
+                     BindOnce(
+                         [](OnceCallback<void(int)> done, File::Error error,
+                            int bytes_read) {
+                           std::move(done).Run(bytes_read);
+                         },
+                         std::move(done)));
+      }));
+}
+
+TEST_P(IoUringFileEnginePerfTest, RandomReadsWithFixedBuffers) {
+  std::unique_ptr<IoUringFileEngine> engine =
+      IoUringFileEngine::Create(kMaxQueueDepth);
+  if (!engine)
+    GTEST_SKIP() << "io_uring is not supported";
+  File file(path_, File::FLAG_OPEN | File::FLAG_READ);
+  ASSERT_TRUE(file.IsValid());
+
+  std::vector<std::vector<uint8_t>> buffers(queue_depth(),
+                                            std::vector<uint8_t>(kReadSize));
+  if (!engine->RegisterBuffers({buffers.begin(), buffers.end()}))
+    GTEST_SKIP() << "The buffers can't be registered";
+  RunRandomReads(
+      "engine_fixed", BindLambdaForTesting([&](int slot, int64_t offset,
+                                               OnceCallback<void(int)> done) {
+        engine->ReadFixed(file.GetPlatformFile(), offset, slot, kReadSize,
+                          SequencedTaskRunnerHandle::Get(),
+                          BindOnce(
+                              [](OnceCallback<void(int)> done,
+                                 File::Error error, int bytes_read) {
+                                std::move(done).Run(bytes_read);
+                              },
+                              std::move(done)));
+      }));
+}
+
+TEST_P(IoUringFileEnginePerfTest, RandomReadsWithFileProxy) {
+  RunFileProxyReads("file_proxy", nullptr);
+}
+
+TEST_P(IoUringFileEnginePerfTest, RandomReadsWithFileProxyOnEngine) {
+  std::unique_ptr<IoUringFileEngine> engine =
+      IoUringFileEngine::Create(kMaxQueueDepth);
+  if (!engine)
+    GTEST_SKIP() << "io_uring is not supported";
+  RunFileProxyReads("file_proxy_engine", engine.get());
+}
+
+INSTANTIATE_TEST_SUITE_P(All,
+                         IoUringFileEnginePerfTest,
+                         testing::Values(1, 4, 16, 64, 128));
+
+}  // namespace base
@@ -0,0 +1,171 @@
+// Copyright 2021 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "base/files/io_uring_file_engine.h"
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "base/files/file.h"
+#include "base/files/file_util.h"
+#include "base/files/scoped_temp_dir.h"
+#include "base/run_loop.h"
+#include "base/test/bind.h"
+#include "base/test/task_environment.h"
+#include "base/test/test_future.h"
+#include "base/threading/sequenced_task_runner_handle.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace base {
+
+namespace {
+
+class IoUringFileEngineTest : public testing::Test {
+ public:
+  void SetUp() override {
+    engine_ = IoUringFileEngine::Create();
+    if (!engine_)
+      GTEST_SKIP() << "io_uring is not supported";
+    ASSERT_TRUE(temp_dir_.CreateUniqueTempDir());
+    path_ = temp_dir_.GetPath().AppendASCII("file");
+  }
+
+ protected:
+  File OpenFile(uint32_t flags) {
+    test::TestFuture<File> future;
+    engine_->Open(path_, flags, SequencedTaskRunnerHandle::Get(),
+                  future.GetCallback());
+    return future.Take();
+  }
+
+  test::TaskEnvironment task_environment_;
+  std::unique_ptr<IoUringFileEngine> engine_;
+  ScopedTempDir temp_dir_;
+  FilePath path_;
+};
+
+}  // namespace
+
+TEST_F(IoUringFileEngineTest, OpenWriteFlushAndRead) {
+  File file = OpenFile(File::FLAG_CREATE | File::FLAG_READ | File::FLAG_WRITE);
+  ASSERT_TRUE(file.IsValid());
+  EXPECT_TRUE(PathExists(path_));
+
+  const std::string data = "io_uring";
+  test::TestFuture<File::Error, int> write_future;
+  engine_->Write(file.GetPlatformFile(), 1, as_bytes(make_span(data)),
+                 SequencedTaskRunnerHandle::Get(), write_future.GetCallback());
+  EXPECT_EQ(File::FILE_OK, std::get<0>(write_future.Get()));
+  EXPECT_EQ(static_cast<int>(data.size()), std::get<1>(write_future.Get()));
+
+  test::TestFuture<File::Error> flush_future;
+  engine_->Flush(file.GetPlatformFile(), SequencedTaskRunnerHandle::Get(),
+                 flush_future.GetCallback());
+  EXPECT_EQ(File::FILE_OK, flush_future.Get());
+
+  std::vector<uint8_t> buffer(64);
+  test::TestFuture<File::Error, int> read_future;
+  engine_->Read(file.GetPlatformFile(), 0, buffer,
+                SequencedTaskRunnerHandle::Get(), read_future.GetCallback());
+  EXPECT_EQ(File::FILE_OK, std::get<0>(read_future.Get()));
+  ASSERT_EQ(static_cast<int>(data.size() + 1), std::get<1>(read_future.Get()));
+  EXPECT_EQ(0, buffer[0]);
+  EXPECT_EQ(data, std::string(buffer.begin() + 1,
+                              buffer.begin() + 1 + data.size()));
+}
+
+TEST_F(IoUringFileEngineTest, OpenErrors) {
+  EXPECT_EQ(File::FILE_ERROR_NOT_FOUND,
+            OpenFile(File::FLAG_OPEN | File::FLAG_READ).error_details());
+
+  ASSERT_TRUE(WriteFile(path_, "x"));
+  EXPECT_EQ(File::FILE_ERROR_EXISTS,
+            OpenFile(File::FLAG_CREATE | File::FLAG_WRITE).error_details());
+
+  // Truncates the existing file.
+  File file = OpenFile(File::FLAG_CREATE_ALWAYS | File::FLAG_WRITE);
+  ASSERT_TRUE(file.IsValid());
+  EXPECT_EQ(0, file.GetLength());
+}
+
+TEST_F(IoUringFileEngineTest, ReadErrors) {
+  std::vector<uint8_t> buffer(16);
+  test::TestFuture<File::Error, int> future;
+  engine_->Read(kInvalidPlatformFile, 0, buffer,
+                SequencedTaskRunnerHandle::Get(), future.GetCallback());
+  EXPECT_NE(File::FILE_OK, std::get<0>(future.Get()));
+  EXPECT_EQ(-1, std::get<1>(future.Get()));
+
+  // The file isn't open for reading.
+  File file = OpenFile(File::FLAG_CREATE | File::FLAG_WRITE);
+  ASSERT_TRUE(file.IsValid());
+  test::TestFuture<File::Error, int> write_only_future;
+  engine_->Read(file.GetPlatformFile(), 0, buffer,
+                SequencedTaskRunnerHandle::Get(),
+                write_only_future.GetCallback());
+  EXPECT_NE(File::FILE_OK, std::get<0>(write_only_future.Get()));
+}
+
+TEST_F(IoUringFileEngineTest, FixedBuffers) {
+  std::vector<uint8_t> write_buffer(4096, 'w');
+  std::vector<uint8_t> read_buffer(4096);
+  if (!engine_->RegisterBuffers({write_buffer, read_buffer}))
+    GTEST_SKIP() << "The buffers can't be registered";
+
+  File file = OpenFile(File::FLAG_CREATE | File::FLAG_READ | File::FLAG_WRITE);
+  ASSERT_TRUE(file.IsValid());
+
+  test::TestFuture<File::Error, int> write_future;
+  engine_->WriteFixed(file.GetPlatformFile(), 0, 0, write_buffer.size(),
+                      SequencedTaskRunnerHandle::Get(),
+                      write_future.GetCallback());
+  EXPECT_EQ(4096, std::get<1>(write_future.Get()));
+
+  test::TestFuture<File::Error, int> read_future;
+  engine_->ReadFixed(file.GetPlatformFile(), 1024, 1, 1024,
+                     SequencedTaskRunnerHandle::Get(),
+                     read_future.GetCallback());
+  EXPECT_EQ(File::FILE_OK, std::get<0>(read_future.Get()));
+  EXPECT_EQ(1024, std::get<1>(read_future.Get()));
+  EXPECT_EQ(std::vector<uint8_t>(1024, 'w'),
+            std::vector<uint8_t>(read_buffer.begin(),
+                                 read_buffer.begin() + 1024));
+}
+
+// More operations than the queues can hold are issued in a single batch.
+TEST_F(IoUringFileEngineTest, Batch) {
+  engine_ = IoUringFileEngine::Create(4);
+  ASSERT_TRUE(engine_);
+
+  constexpr int kNumReads = 100;
+  std::string data(kNumReads, 0);
+  for (int i = 0; i < kNumReads; ++i)
+    data[i] = static_cast<char>(i);
+  ASSERT_TRUE(WriteFile(path_, data));
+  File file = OpenFile(File::FLAG_OPEN | File::FLAG_READ);
+  ASSERT_TRUE(file.IsValid());
+
+  std::vector<uint8_t> buffer(kNumReads);
+  int completed = 0;
+  RunLoop run_loop;
+  {
+    IoUringFileEngine::ScopedBatch batch(engine_.get());
+    for (int i = 0; i < kNumReads; ++i) {
+      engine_->Read(file.GetPlatformFile(), i, make_span(&buffer[i], 1),
+                    SequencedTaskRunnerHandle::Get(),
+                    BindLambdaForTesting([&](File::Error error, int bytes) {
+                      EXPECT_EQ(File::FILE_OK, error);
+                      EXPECT_EQ(1, bytes);
+                      if (++completed == kNumReads)
+                        run_loop.Quit();
+                    }));
+    }
+  }
+  run_loop.Run();
+  EXPECT_EQ(data, std::string(buffer.begin(), buffer.end()));
+}
+
+}  // namespace base
@@ -4,7 +4,10 @@
 
 #include "base/json/json_file_value_serializer.h"
 
+#include <limits>
+
 #include "base/check.h"
+#include "base/files/file_contents.h"
 #include "base/files/file_util.h"
 #include "base/json/json_string_value_serializer.h"
 #include "base/notreached.h"
@@ -59,10 +62,16 @@ JSONFileValueDeserializer::JSONFileValueDeserializer(
 
 JSONFileValueDeserializer::~JSONFileValueDeserializer() = default;
 
-int JSONFileValueDeserializer::ReadFileToString(std::string* json_string) {
-  DCHECK(json_string);
+int JSONFileValueDeserializer::ReadFile(
+    absl::optional<base::FileContents>* contents) {
+  DCHECK(contents);
   last_read_size_ = 0u;
-  if (!base::ReadFileToString(json_file_path_, json_string)) {
+  // Never mapped, since truncating a mapped file while it's parsed would
+  // crash the parser.
+  *contents = base::FileContents::Read(
+      json_file_path_, std::numeric_limits<size_t>::max(),
+      base::FileContents::MapMode::kNeverMap);
+  if (!*contents) {
 #if defined(OS_WIN)
     int error = ::GetLastError();
     if (error == ERROR_SHARING_VIOLATION || error == ERROR_LOCK_VIOLATION) {
@@ -75,7 +84,7 @@ int JSONFileValueDeserializer::ReadFileToString(std::string* json_string) {
                                              : JSON_NO_SUCH_FILE;
   }
 
-  last_read_size_ = json_string->size();
+  last_read_size_ = (*contents)->size();
   return JSON_NO_ERROR;
 }
 
@@ -100,8 +109,8 @@ const char* JSONFileValueDeserializer::GetErrorMessageForCode(int error_code) {
 std::unique_ptr<base::Value> JSONFileValueDeserializer::Deserialize(
     int* error_code,
     std::string* error_str) {
-  std::string json_string;
-  int error = ReadFileToString(&json_string);
+  absl::optional<base::FileContents> contents;
+  int error = ReadFile(&contents);
   if (error != JSON_NO_ERROR) {
     if (error_code)
       *error_code = error;
@@ -110,6 +119,6 @@ std::unique_ptr<base::Value> JSONFileValueDeserializer::Deserialize(
     return nullptr;
   }
 
-  JSONStringValueDeserializer deserializer(json_string, options_);
+  JSONStringValueDeserializer deserializer(contents->AsStringPiece(), options_);
   return deserializer.Deserialize(error_code, error_str);
 }
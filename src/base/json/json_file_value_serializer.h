@@ -14,6 +14,11 @@
 #include "base/files/file_path.h"
 #include "base/macros.h"
 #include "base/values.h"
+#include "third_party/abseil-cpp/absl/types/optional.h"
+
+namespace base {
+class FileContents;
+}
 
 class BASE_EXPORT JSONFileValueSerializer : public base::ValueSerializer {
  public:
@@ -98,9 +103,9 @@ class BASE_EXPORT JSONFileValueDeserializer : public base::ValueDeserializer {
   size_t get_last_read_size() const { return last_read_size_; }
 
  private:
-  // A wrapper for ReadFileToString which returns a non-zero JsonFileError if
-  // there were file errors.
-  int ReadFileToString(std::string* json_string);
+  // A wrapper for FileContents::Read() which returns a non-zero JsonFileError
+  // if there were file errors.
+  int ReadFile(absl::optional<base::FileContents>* contents);
 
   const base::FilePath json_file_path_;
   const int options_;
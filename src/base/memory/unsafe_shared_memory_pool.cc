@@ -4,70 +4,204 @@
 
 #include "base/memory/unsafe_shared_memory_pool.h"
 
+#include <algorithm>
+
+#include "base/bind.h"
+#include "base/bits.h"
+#include "base/callback_helpers.h"
 #include "base/logging.h"
+#include "base/memory/page_size.h"
+#include "base/memory/ptr_util.h"
+#include "base/threading/platform_thread.h"
+
+namespace base {
 
 namespace {
-constexpr size_t kMaxStoredBuffers = 32;
+
+size_t CurrentShard(size_t num_shards) {
+  // Thread ids are not necessarily dense, mix the bits a little.
+  uint64_t id = static_cast<uint64_t>(PlatformThread::CurrentId());
+  id *= 0x9E3779B97F4A7C15ull;
+  return static_cast<size_t>(id >> 32) % num_shards;
+}
+
 }  // namespace
 
-namespace base {
+struct UnsafeSharedMemoryPool::PooledRegion {
+  PooledRegion(UnsafeSharedMemoryRegion region,
+               WritableSharedMemoryMapping mapping)
+      : region(std::move(region)), mapping(std::move(mapping)) {}
+
+  UnsafeSharedMemoryRegion region;
+  WritableSharedMemoryMapping mapping;
+};
 
-UnsafeSharedMemoryPool::UnsafeSharedMemoryPool() = default;
+UnsafeSharedMemoryPool::UnsafeSharedMemoryPool()
+    : UnsafeSharedMemoryPool(Options()) {}
 
-UnsafeSharedMemoryPool::~UnsafeSharedMemoryPool() = default;
+UnsafeSharedMemoryPool::UnsafeSharedMemoryPool(const Options& options)
+    : options_(options),
+      memory_pressure_listener_(
+          FROM_HERE,
+          DoNothing(),
+          BindRepeating(&UnsafeSharedMemoryPool::OnMemoryPressure,
+                        Unretained(this))) {}
+
+UnsafeSharedMemoryPool::~UnsafeSharedMemoryPool() {
+  Trim();
+}
 
 UnsafeSharedMemoryPool::Handle::Handle(
     PassKey<UnsafeSharedMemoryPool>,
-    UnsafeSharedMemoryRegion region,
-    WritableSharedMemoryMapping mapping,
+    std::unique_ptr<PooledRegion> region,
     scoped_refptr<UnsafeSharedMemoryPool> pool)
-    : region_(std::move(region)),
-      mapping_(std::move(mapping)),
-      pool_(std::move(pool)) {
+    : region_(std::move(region)), pool_(std::move(pool)) {
   CHECK(pool_);
-  DCHECK(region_.IsValid());
-  DCHECK(mapping_.IsValid());
+  DCHECK(region_->region.IsValid());
+  DCHECK(region_->mapping.IsValid());
 }
 
 UnsafeSharedMemoryPool::Handle::~Handle() {
-  pool_->ReleaseBuffer(std::move(region_), std::move(mapping_));
+  pool_->ReleaseBuffer(std::move(region_));
 }
 
 const UnsafeSharedMemoryRegion& UnsafeSharedMemoryPool::Handle::GetRegion()
     const {
-  return region_;
+  return region_->region;
 }
 
 const WritableSharedMemoryMapping& UnsafeSharedMemoryPool::Handle::GetMapping()
     const {
-  return mapping_;
+  return region_->mapping;
 }
 
 std::unique_ptr<UnsafeSharedMemoryPool::Handle>
 UnsafeSharedMemoryPool::MaybeAllocateBuffer(size_t region_size) {
-  AutoLock lock(lock_);
+  if (is_shutdown_.load(std::memory_order_relaxed))
+    return nullptr;
 
-  DCHECK_GE(region_size, 0u);
-  if (is_shutdown_)
+  const size_t order = std::max<size_t>(
+      bits::Log2Ceiling(static_cast<uint32_t>(
+          std::min<size_t>(region_size, size_t{1} << 31))),
+      kMinSizeClassOrder);
+  const size_t size_class_index = order - kMinSizeClassOrder;
+  if (size_class_index >= kNumSizeClasses) {
+    // Too big to be pooled.
+    misses_.fetch_add(1, std::memory_order_relaxed);
+    std::unique_ptr<PooledRegion> region = CreateRegion(region_size);
+    if (!region)
+      return nullptr;
+    return std::make_unique<Handle>(PassKey<UnsafeSharedMemoryPool>(),
+                                    std::move(region), this);
+  }
+
+  SizeClass& size_class = size_classes_[size_class_index];
+  const size_t first_shard = CurrentShard(kNumShards);
+  for (size_t i = 0; i < kNumShards; ++i) {
+    auto& shard = size_class.slots[(first_shard + i) % kNumShards];
+    for (std::atomic<PooledRegion*>& slot : shard) {
+      // Check first, to avoid dirtying cache lines of empty slots.
+      if (!slot.load(std::memory_order_relaxed))
+        continue;
+      PooledRegion* region = slot.exchange(nullptr, std::memory_order_acquire);
+      if (!region)
+        continue;
+      cached_bytes_.fetch_sub(region->region.GetSize(),
+                              std::memory_order_relaxed);
+      hits_.fetch_add(1, std::memory_order_relaxed);
+      return std::make_unique<Handle>(PassKey<UnsafeSharedMemoryPool>(),
+                                      WrapUnique(region), this);
+    }
+  }
+
+  misses_.fetch_add(1, std::memory_order_relaxed);
+  std::unique_ptr<PooledRegion> region = CreateRegion(size_t{1} << order);
+  if (!region)
     return nullptr;
+  return std::make_unique<Handle>(PassKey<UnsafeSharedMemoryPool>(),
+                                  std::move(region), this);
+}
 
-  // Only change the configured size if bigger region is requested to avoid
-  // unncecessary reallocations.
-  if (region_size > region_size_) {
-    regions_.clear();
-    region_size_ = region_size;
+void UnsafeSharedMemoryPool::Shutdown() {
+  DCHECK(!is_shutdown_.load(std::memory_order_relaxed));
+  // Sequentially consistent, to pair with the check in ReleaseBuffer().
+  is_shutdown_.store(true);
+  Trim();
+}
+
+void UnsafeSharedMemoryPool::Trim() {
+  size_t trimmed = 0;
+  for (SizeClass& size_class : size_classes_) {
+    for (auto& shard : size_class.slots) {
+      for (std::atomic<PooledRegion*>& slot : shard) {
+        std::unique_ptr<PooledRegion> region(slot.exchange(nullptr));
+        if (!region)
+          continue;
+        cached_bytes_.fetch_sub(region->region.GetSize(),
+                                std::memory_order_relaxed);
+        ++trimmed;
+      }
+    }
   }
-  if (!regions_.empty()) {
-    auto region = std::move(regions_.back());
-    regions_.pop_back();
-    DCHECK_GE(region.first.GetSize(), region_size_);
-    auto handle = std::make_unique<Handle>(PassKey<UnsafeSharedMemoryPool>(),
-                                           std::move(region.first),
-                                           std::move(region.second), this);
-    return handle;
+  trimmed_.fetch_add(trimmed, std::memory_order_relaxed);
+}
+
+UnsafeSharedMemoryPool::Stats UnsafeSharedMemoryPool::GetStats() const {
+  Stats stats;
+  stats.hits = hits_.load(std::memory_order_relaxed);
+  stats.misses = misses_.load(std::memory_order_relaxed);
+  stats.evictions = evictions_.load(std::memory_order_relaxed);
+  stats.trimmed = trimmed_.load(std::memory_order_relaxed);
+  return stats;
+}
+
+void UnsafeSharedMemoryPool::ReleaseBuffer(
+    std::unique_ptr<PooledRegion> region) {
+  if (is_shutdown_.load(std::memory_order_relaxed))
+    return;
+
+  // Only regions created for a size class are pooled.
+  const size_t size = region->region.GetSize();
+  if (!bits::IsPowerOfTwo(size) || size < (size_t{1} << kMinSizeClassOrder) ||
+      size >= (size_t{1} << (kMinSizeClassOrder + kNumSizeClasses))) {
+    return;
+  }
+  if (cached_bytes_.fetch_add(size, std::memory_order_relaxed) + size >
+      options_.max_cached_bytes) {
+    cached_bytes_.fetch_sub(size, std::memory_order_relaxed);
+    evictions_.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  SizeClass& size_class =
+      size_classes_[bits::Log2Floor(static_cast<uint32_t>(size)) -
+                    kMinSizeClassOrder];
+  const size_t first_shard = CurrentShard(kNumShards);
+  for (size_t i = 0; i < kNumShards; ++i) {
+    auto& shard = size_class.slots[(first_shard + i) % kNumShards];
+    for (std::atomic<PooledRegion*>& slot : shard) {
+      PooledRegion* expected = nullptr;
+      if (!slot.compare_exchange_strong(expected, region.get()))
+        continue;
+      region.release();
+      // Shutdown() may have drained the slots after the check above. Either
+      // it sees the region in the slot, or this sees the flag.
+      if (is_shutdown_.load())
+        Trim();
+      return;
+    }
   }
 
-  auto region = UnsafeSharedMemoryRegion::Create(region_size_);
+  cached_bytes_.fetch_sub(size, std::memory_order_relaxed);
+  evictions_.fetch_add(1, std::memory_order_relaxed);
+  DLOG(WARNING) << "Not returning SharedMemoryRegion to the pool: all "
+                << kNumShards * kSlotsPerShard << " slots of size " << size
+                << " are in use";
+}
+
+std::unique_ptr<UnsafeSharedMemoryPool::PooledRegion>
+UnsafeSharedMemoryPool::CreateRegion(size_t size) {
+  auto region = UnsafeSharedMemoryRegion::Create(size);
   if (!region.IsValid())
     return nullptr;
 
@@ -75,33 +209,19 @@ UnsafeSharedMemoryPool::MaybeAllocateBuffer(size_t region_size) {
   if (!mapping.IsValid())
     return nullptr;
 
-  return std::make_unique<Handle>(PassKey<UnsafeSharedMemoryPool>(),
-                                  std::move(region), std::move(mapping), this);
-}
+  if (options_.prefault) {
+    volatile uint8_t* memory = mapping.GetMemoryAs<uint8_t>();
+    const size_t page_size = GetPageSize();
+    for (size_t offset = 0; offset < mapping.size(); offset += page_size)
+      memory[offset] = 0;
+  }
 
-void UnsafeSharedMemoryPool::Shutdown() {
-  AutoLock lock(lock_);
-  DCHECK(!is_shutdown_);
-  is_shutdown_ = true;
-  regions_.clear();
+  return std::make_unique<PooledRegion>(std::move(region), std::move(mapping));
 }
 
-void UnsafeSharedMemoryPool::ReleaseBuffer(
-    UnsafeSharedMemoryRegion region,
-    WritableSharedMemoryMapping mapping) {
-  AutoLock lock(lock_);
-  // Only return regions which are at least as big as the current configuration.
-  if (is_shutdown_ || regions_.size() >= kMaxStoredBuffers ||
-      !region.IsValid() || region.GetSize() < region_size_) {
-    DLOG(WARNING) << "Not returning SharedMemoryRegion to the pool:"
-                  << " is_shutdown: " << (is_shutdown_ ? "true" : "false")
-                  << " stored regions: " << regions_.size()
-                  << " configured size: " << region_size_
-                  << " this region size: " << region.GetSize()
-                  << " valid: " << (region.IsValid() ? "true" : "false");
-    return;
-  }
-  regions_.emplace_back(std::move(region), std::move(mapping));
+void UnsafeSharedMemoryPool::OnMemoryPressure(
+    MemoryPressureListener::MemoryPressureLevel level) {
+  Trim();
 }
 
 }  // namespace base
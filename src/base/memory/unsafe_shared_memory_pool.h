@@ -5,33 +5,65 @@
 #ifndef BASE_MEMORY_UNSAFE_SHARED_MEMORY_POOL_H_
 #define BASE_MEMORY_UNSAFE_SHARED_MEMORY_POOL_H_
 
+#include <atomic>
 #include <memory>
-#include <utility>
-#include <vector>
 
+#include "base/memory/memory_pressure_listener.h"
 #include "base/memory/ref_counted.h"
 #include "base/memory/unsafe_shared_memory_region.h"
-#include "base/synchronization/lock.h"
 #include "base/types/pass_key.h"
 
 namespace base {
 
 // UnsafeSharedMemoryPool manages allocation and pooling of
 // UnsafeSharedMemoryRegions. Using pool saves cost of repeated shared memory
-// allocations. Up-to 32 regions would be pooled. It is thread-safe. May return
-// bigger regions than requested. If a requested size is increased, all stored
-// regions are purged. Regions are returned to the buffer on destruction of
-// |SharedMemoryHandle| if they are of a correct size.
+// allocations. It is thread-safe. May return bigger regions than requested.
+// Regions are returned to the pool on destruction of |Handle|.
+//
+// Regions are pooled by size class: requests are rounded up to the next power
+// of two (at least one page), so buffers of different sizes can be recycled
+// side by side. Requests above the largest size class are not pooled.
+//
+// Acquiring and returning a region never takes a lock. Each size class keeps
+// its cached regions in a few shards of atomic slots, and every thread starts
+// looking for a region, or for a free slot to return one into, in the shard
+// its thread id maps to. Threads thus mostly operate on their own cache lines
+// and only fall back to the other shards when theirs is empty or full.
+//
+// Cached regions are dropped on memory pressure, and the total size of the
+// cached regions is bounded by |Options::max_cached_bytes|.
 class BASE_EXPORT UnsafeSharedMemoryPool
     : public RefCountedThreadSafe<UnsafeSharedMemoryPool> {
+ private:
+  struct PooledRegion;
+
  public:
+  struct BASE_EXPORT Options {
+    // Upper bound for the total size of the cached, currently unused regions.
+    size_t max_cached_bytes = 64 * 1024 * 1024;
+    // Touches every page of newly created regions, so that the page faults
+    // are taken on allocation rather than on first use of the buffer.
+    bool prefault = false;
+  };
+
+  // Pool efficiency counters, see |GetStats|.
+  struct Stats {
+    // Allocations served from a cached region.
+    size_t hits = 0;
+    // Allocations that had to create a new region.
+    size_t misses = 0;
+    // Returned regions that were dropped because the pool was full.
+    size_t evictions = 0;
+    // Cached regions dropped by |Trim|, including on memory pressure.
+    size_t trimmed = 0;
+  };
+
   // Used to store the allocation result.
   // This class returns memory to the pool upon destruction.
   class BASE_EXPORT Handle {
    public:
     Handle(PassKey<UnsafeSharedMemoryPool>,
-           UnsafeSharedMemoryRegion region,
-           WritableSharedMemoryMapping mapping,
+           std::unique_ptr<PooledRegion> region,
            scoped_refptr<UnsafeSharedMemoryPool> pool);
 
     ~Handle();
@@ -44,12 +76,12 @@ class BASE_EXPORT UnsafeSharedMemoryPool
     const WritableSharedMemoryMapping& GetMapping() const;
 
    private:
-    UnsafeSharedMemoryRegion region_;
-    WritableSharedMemoryMapping mapping_;
+    std::unique_ptr<PooledRegion> region_;
     scoped_refptr<UnsafeSharedMemoryPool> pool_;
   };
 
   UnsafeSharedMemoryPool();
+  explicit UnsafeSharedMemoryPool(const Options& options);
   // Disallow copy and assign.
   UnsafeSharedMemoryPool(const UnsafeSharedMemoryPool&) = delete;
   UnsafeSharedMemoryPool& operator=(const UnsafeSharedMemoryPool&) = delete;
@@ -62,21 +94,44 @@ class BASE_EXPORT UnsafeSharedMemoryPool
   // outstanding ones as they are returned.
   void Shutdown();
 
+  // Frees all currently unused allocations.
+  void Trim();
+
+  Stats GetStats() const;
+
  private:
   friend class RefCountedThreadSafe<UnsafeSharedMemoryPool>;
+
+  // Size classes are powers of two from 4 KiB to 1 GiB.
+  static constexpr size_t kMinSizeClassOrder = 12;
+  static constexpr size_t kNumSizeClasses = 19;
+  static constexpr size_t kNumShards = 4;
+  static constexpr size_t kSlotsPerShard = 8;
+
+  struct SizeClass {
+    std::atomic<PooledRegion*> slots[kNumShards][kSlotsPerShard] = {};
+  };
+
   ~UnsafeSharedMemoryPool();
 
-  void ReleaseBuffer(UnsafeSharedMemoryRegion region,
-                     WritableSharedMemoryMapping mapping);
-
-  Lock lock_;
-  // All shared memory regions cached internally are guaranteed to be
-  // at least `region_size_` bytes in size.
-  size_t region_size_ GUARDED_BY(lock_) = 0u;
-  // Cached unused regions and their mappings.
-  std::vector<std::pair<UnsafeSharedMemoryRegion, WritableSharedMemoryMapping>>
-      regions_ GUARDED_BY(lock_);
-  bool is_shutdown_ GUARDED_BY(lock_) = false;
+  void ReleaseBuffer(std::unique_ptr<PooledRegion> region);
+  std::unique_ptr<PooledRegion> CreateRegion(size_t size);
+  void OnMemoryPressure(MemoryPressureListener::MemoryPressureLevel level);
+
+  const Options options_;
+
+  SizeClass size_classes_[kNumSizeClasses];
+  std::atomic<size_t> cached_bytes_{0};
+  std::atomic<bool> is_shutdown_{false};
+
+  std::atomic<size_t> hits_{0};
+  std::atomic<size_t> misses_{0};
+  std::atomic<size_t> evictions_{0};
+  std::atomic<size_t> trimmed_{0};
+
+  // Declared last, so that no notification can arrive during destruction of
+  // the other members.
+  MemoryPressureListener memory_pressure_listener_;
 };
 
 }  // namespace base
@@ -4,6 +4,11 @@
 
 #include "base/memory/unsafe_shared_memory_pool.h"
 
+#include <memory>
+#include <vector>
+
+#include "base/memory/memory_pressure_listener.h"
+#include "base/threading/simple_thread.h"
 #include "testing/gtest/include/gtest/gtest.h"
 
 namespace base {
@@ -47,4 +52,132 @@ TEST(UnsafeSharedMemoryPoolTest, RespectsSize) {
   ASSERT_TRUE(handle);
   EXPECT_GE(handle->GetRegion().GetSize(), 1100u);
 }
+
+TEST(UnsafeSharedMemoryPoolTest, PoolsBySizeClass) {
+  scoped_refptr<UnsafeSharedMemoryPool> pool(
+      base::MakeRefCounted<UnsafeSharedMemoryPool>());
+  auto small_handle = pool->MaybeAllocateBuffer(1000u);
+  auto big_handle = pool->MaybeAllocateBuffer(100000u);
+  ASSERT_TRUE(small_handle);
+  ASSERT_TRUE(big_handle);
+  auto small_id = small_handle->GetRegion().GetGUID();
+  auto big_id = big_handle->GetRegion().GetGUID();
+  small_handle.reset();
+  big_handle.reset();
+
+  // Both sizes are pooled side by side.
+  big_handle = pool->MaybeAllocateBuffer(90000u);
+  ASSERT_TRUE(big_handle);
+  EXPECT_EQ(big_id, big_handle->GetRegion().GetGUID());
+  small_handle = pool->MaybeAllocateBuffer(2000u);
+  ASSERT_TRUE(small_handle);
+  EXPECT_EQ(small_id, small_handle->GetRegion().GetGUID());
+
+  UnsafeSharedMemoryPool::Stats stats = pool->GetStats();
+  EXPECT_EQ(2u, stats.hits);
+  EXPECT_EQ(2u, stats.misses);
+}
+
+TEST(UnsafeSharedMemoryPoolTest, TrimsOnMemoryPressure) {
+  scoped_refptr<UnsafeSharedMemoryPool> pool(
+      base::MakeRefCounted<UnsafeSharedMemoryPool>());
+  auto handle = pool->MaybeAllocateBuffer(1000u);
+  ASSERT_TRUE(handle);
+  auto id = handle->GetRegion().GetGUID();
+  handle.reset();
+
+  MemoryPressureListener::SimulatePressureNotification(
+      MemoryPressureListener::MEMORY_PRESSURE_LEVEL_CRITICAL);
+  EXPECT_EQ(1u, pool->GetStats().trimmed);
+
+  handle = pool->MaybeAllocateBuffer(1000u);
+  ASSERT_TRUE(handle);
+  EXPECT_NE(id, handle->GetRegion().GetGUID());
+  EXPECT_EQ(0u, pool->GetStats().hits);
+}
+
+TEST(UnsafeSharedMemoryPoolTest, RespectsMaxCachedBytes) {
+  UnsafeSharedMemoryPool::Options options;
+  options.max_cached_bytes = 64 * 1024;
+  scoped_refptr<UnsafeSharedMemoryPool> pool(
+      base::MakeRefCounted<UnsafeSharedMemoryPool>(options));
+  auto handle1 = pool->MaybeAllocateBuffer(64 * 1024);
+  auto handle2 = pool->MaybeAllocateBuffer(64 * 1024);
+  ASSERT_TRUE(handle1);
+  ASSERT_TRUE(handle2);
+  handle1.reset();
+  handle2.reset();
+  EXPECT_EQ(1u, pool->GetStats().evictions);
+}
+
+TEST(UnsafeSharedMemoryPoolTest, Prefault) {
+  UnsafeSharedMemoryPool::Options options;
+  options.prefault = true;
+  scoped_refptr<UnsafeSharedMemoryPool> pool(
+      base::MakeRefCounted<UnsafeSharedMemoryPool>(options));
+  auto handle = pool->MaybeAllocateBuffer(100000u);
+  ASSERT_TRUE(handle);
+  EXPECT_EQ(0u, handle->GetMapping().GetMemoryAs<uint8_t>()[99999]);
+}
+
+TEST(UnsafeSharedMemoryPoolTest, Shutdown) {
+  scoped_refptr<UnsafeSharedMemoryPool> pool(
+      base::MakeRefCounted<UnsafeSharedMemoryPool>());
+  auto handle1 = pool->MaybeAllocateBuffer(1000u);
+  auto handle2 = pool->MaybeAllocateBuffer(1000u);
+  ASSERT_TRUE(handle1);
+  ASSERT_TRUE(handle2);
+  handle1.reset();
+
+  pool->Shutdown();
+  EXPECT_EQ(1u, pool->GetStats().trimmed);
+  EXPECT_FALSE(pool->MaybeAllocateBuffer(1000u));
+  // Outstanding regions are freed as they are returned.
+  handle2.reset();
+  EXPECT_EQ(1u, pool->GetStats().trimmed);
+}
+
+namespace {
+
+class AllocatorThread : public SimpleThread {
+ public:
+  explicit AllocatorThread(scoped_refptr<UnsafeSharedMemoryPool> pool)
+      : SimpleThread("AllocatorThread"), pool_(std::move(pool)) {}
+
+  void Run() override {
+    for (size_t i = 0; i < 200; ++i) {
+      std::vector<std::unique_ptr<UnsafeSharedMemoryPool::Handle>> handles;
+      for (size_t size = 1000; size < 100000; size *= 3) {
+        handles.push_back(pool_->MaybeAllocateBuffer(size));
+        ASSERT_TRUE(handles.back());
+        // Regions are never handed out twice at the same time.
+        uint8_t* memory = handles.back()->GetMapping().GetMemoryAs<uint8_t>();
+        memory[0] = static_cast<uint8_t>(i);
+        EXPECT_EQ(static_cast<uint8_t>(i), memory[0]);
+      }
+    }
+  }
+
+ private:
+  scoped_refptr<UnsafeSharedMemoryPool> pool_;
+};
+
+}  // namespace
+
+TEST(UnsafeSharedMemoryPoolTest, ConcurrentAllocations) {
+  scoped_refptr<UnsafeSharedMemoryPool> pool(
+      base::MakeRefCounted<UnsafeSharedMemoryPool>());
+  std::vector<std::unique_ptr<AllocatorThread>> threads;
+  for (size_t i = 0; i < 4; ++i)
+    threads.push_back(std::make_unique<AllocatorThread>(pool));
+  for (auto& thread : threads)
+    thread->Start();
+  for (auto& thread : threads)
+    thread->Join();
+
+  UnsafeSharedMemoryPool::Stats stats = pool->GetStats();
+  EXPECT_EQ(4u * 200 * 5, stats.hits + stats.misses);
+  EXPECT_GT(stats.hits, stats.misses);
+}
+
 }  // namespace base
@@ -5,6 +5,9 @@
 
 #include <sys/socket.h>
 
+#include <tuple>
+#include <vector>
+
 #include "base/bind.h"
 #include "base/compiler_specific.h"
 #include "base/files/file_util.h"
@@ -17,6 +20,7 @@
 #include "base/run_loop.h"
 #include "base/task/current_thread.h"
 #include "base/test/gtest_util.h"
+#include "base/test/scoped_feature_list.h"
 #include "base/test/task_environment.h"
 #include "build/build_config.h"
 #include "testing/gtest/include/gtest/gtest.h"
@@ -27,9 +31,49 @@ namespace base {
 
 namespace {
 
-class FdWatchControllerPosixTest : public testing::Test {
+#if defined(OS_LINUX) || defined(OS_CHROMEOS)
+// The tests run against each backend of MessagePumpLibevent.
+using PumpBackend = MessagePumpLibevent::Backend;
+constexpr PumpBackend kPumpBackends[] = {
+    PumpBackend::kLibevent, PumpBackend::kEpoll, PumpBackend::kIoUring};
+#else
+enum class PumpBackend { kDefault };
+constexpr PumpBackend kPumpBackends[] = {PumpBackend::kDefault};
+#endif
+
+// Makes the IO pumps created in its scope use |backend|.
+class ScopedPumpBackend {
+ public:
+  explicit ScopedPumpBackend(PumpBackend backend) {
+#if defined(OS_LINUX) || defined(OS_CHROMEOS)
+    std::vector<Feature> enabled_features;
+    if (backend == PumpBackend::kEpoll)
+      enabled_features.push_back(features::kMessagePumpEpoll);
+    else if (backend == PumpBackend::kIoUring)
+      enabled_features.push_back(features::kMessagePumpIoUring);
+    feature_list_.InitWithFeatures(enabled_features, {});
+    MessagePumpLibevent::InitializeFeatures();
+#endif
+  }
+
+  ScopedPumpBackend(const ScopedPumpBackend&) = delete;
+  ScopedPumpBackend& operator=(const ScopedPumpBackend&) = delete;
+
+  ~ScopedPumpBackend() {
+#if defined(OS_LINUX) || defined(OS_CHROMEOS)
+    feature_list_.Reset();
+    feature_list_.Init();
+    MessagePumpLibevent::InitializeFeatures();
+#endif
+  }
+
+ private:
+  test::ScopedFeatureList feature_list_;
+};
+
+class FdWatchControllerPosixTest : public testing::TestWithParam<PumpBackend> {
  public:
-  FdWatchControllerPosixTest() = default;
+  FdWatchControllerPosixTest() : pump_backend_(GetParam()) {}
 
   FdWatchControllerPosixTest(const FdWatchControllerPosixTest&) = delete;
   FdWatchControllerPosixTest& operator=(const FdWatchControllerPosixTest&) =
@@ -54,10 +98,15 @@ class FdWatchControllerPosixTest : public testing::Test {
   }
 
  protected:
+  ScopedPumpBackend pump_backend_;
   ScopedFD read_fd_;
   ScopedFD write_fd_;
 };
 
+INSTANTIATE_TEST_SUITE_P(AllBackends,
+                         FdWatchControllerPosixTest,
+                         testing::ValuesIn(kPumpBackends));
+
 class TestHandler : public MessagePumpForIO::FdWatcher {
  public:
   void OnFileCanReadWithoutBlocking(int fd) override {
@@ -129,7 +178,7 @@ class CallClosureHandler : public MessagePumpForIO::FdWatcher {
   OnceClosure write_closure_;
 };
 
-TEST_F(FdWatchControllerPosixTest, FileDescriptorWatcherOutlivesMessageLoop) {
+TEST_P(FdWatchControllerPosixTest, FileDescriptorWatcherOutlivesMessageLoop) {
   // Simulate a MessageLoop that dies before an FileDescriptorWatcher.
   // This could happen when people use the Singleton pattern or atexit.
 
@@ -149,7 +198,7 @@ TEST_F(FdWatchControllerPosixTest, FileDescriptorWatcherOutlivesMessageLoop) {
   ASSERT_FALSE(handler.is_writable_);
 }
 
-TEST_F(FdWatchControllerPosixTest, FileDescriptorWatcherDoubleStop) {
+TEST_P(FdWatchControllerPosixTest, FileDescriptorWatcherDoubleStop) {
   // Verify that it's ok to call StopWatchingFileDescriptor().
 
   // Arrange for message loop to live longer than watcher.
@@ -166,7 +215,7 @@ TEST_F(FdWatchControllerPosixTest, FileDescriptorWatcherDoubleStop) {
   }
 }
 
-TEST_F(FdWatchControllerPosixTest, FileDescriptorWatcherDeleteInCallback) {
+TEST_P(FdWatchControllerPosixTest, FileDescriptorWatcherDeleteInCallback) {
   // Verify that it is OK to delete the FileDescriptorWatcher from within a
   // callback.
   test::TaskEnvironment env(test::TaskEnvironment::MainThreadType::IO);
@@ -248,8 +297,14 @@ class ReaderWriterHandler : public MessagePumpForIO::FdWatcher {
 };
 
 class MessageLoopForIoPosixReadAndWriteTest
-    : public testing::TestWithParam<ReaderWriterHandler::Action> {
+    : public testing::TestWithParam<
+          std::tuple<ReaderWriterHandler::Action, PumpBackend>> {
  protected:
+  MessageLoopForIoPosixReadAndWriteTest()
+      : pump_backend_(std::get<1>(GetParam())) {}
+
+  ReaderWriterHandler::Action action() const { return std::get<0>(GetParam()); }
+
   bool CreateSocketPair(ScopedFD* one, ScopedFD* two) {
     int fds[2];
     if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1)
@@ -258,12 +313,17 @@ class MessageLoopForIoPosixReadAndWriteTest
     two->reset(fds[1]);
     return true;
   }
+
+ private:
+  ScopedPumpBackend pump_backend_;
 };
 
-INSTANTIATE_TEST_SUITE_P(StopWatchingOrDelete,
-                         MessageLoopForIoPosixReadAndWriteTest,
-                         testing::Values(ReaderWriterHandler::kStopWatching,
-                                         ReaderWriterHandler::kDelete));
+INSTANTIATE_TEST_SUITE_P(
+    StopWatchingOrDelete,
+    MessageLoopForIoPosixReadAndWriteTest,
+    testing::Combine(testing::Values(ReaderWriterHandler::kStopWatching,
+                                     ReaderWriterHandler::kDelete),
+                     testing::ValuesIn(kPumpBackends)));
 
 // Test deleting or stopping watch after a read event for a watcher that is
 // registered for both read and write.
@@ -274,7 +334,7 @@ TEST_P(MessageLoopForIoPosixReadAndWriteTest, AfterRead) {
 
   RunLoop run_loop;
   ReaderWriterHandler* handler =
-      new ReaderWriterHandler(GetParam(), ReaderWriterHandler::kOnReadEvent,
+      new ReaderWriterHandler(action(), ReaderWriterHandler::kOnReadEvent,
                               run_loop.QuitWhenIdleClosure());
 
   // Trigger a read event on |one| by writing to |two|.
@@ -289,7 +349,7 @@ TEST_P(MessageLoopForIoPosixReadAndWriteTest, AfterRead) {
       handler->controller(), handler);
   run_loop.Run();
 
-  if (GetParam() == ReaderWriterHandler::kStopWatching) {
+  if (action() == ReaderWriterHandler::kStopWatching) {
     delete handler;
   }
 }
@@ -303,7 +363,7 @@ TEST_P(MessageLoopForIoPosixReadAndWriteTest, AfterWrite) {
 
   RunLoop run_loop;
   ReaderWriterHandler* handler =
-      new ReaderWriterHandler(GetParam(), ReaderWriterHandler::kOnWriteEvent,
+      new ReaderWriterHandler(action(), ReaderWriterHandler::kOnWriteEvent,
                               run_loop.QuitWhenIdleClosure());
 
   // Trigger two read events on |one| by writing to |two|. Because each read
@@ -322,13 +382,13 @@ TEST_P(MessageLoopForIoPosixReadAndWriteTest, AfterWrite) {
       handler->controller(), handler);
   run_loop.Run();
 
-  if (GetParam() == ReaderWriterHandler::kStopWatching) {
+  if (action() == ReaderWriterHandler::kStopWatching) {
     delete handler;
   }
 }
 
 // Verify that basic readable notification works.
-TEST_F(FdWatchControllerPosixTest, WatchReadable) {
+TEST_P(FdWatchControllerPosixTest, WatchReadable) {
   test::TaskEnvironment env(test::TaskEnvironment::MainThreadType::IO);
   MessagePumpForIO::FdWatchController watcher(FROM_HERE);
   TestHandler handler;
@@ -354,7 +414,7 @@ TEST_F(FdWatchControllerPosixTest, WatchReadable) {
 }
 
 // Verify that watching a file descriptor for writability succeeds.
-TEST_F(FdWatchControllerPosixTest, WatchWritable) {
+TEST_P(FdWatchControllerPosixTest, WatchWritable) {
   test::TaskEnvironment env(test::TaskEnvironment::MainThreadType::IO);
   MessagePumpForIO::FdWatchController watcher(FROM_HERE);
   TestHandler handler;
@@ -377,7 +437,7 @@ TEST_F(FdWatchControllerPosixTest, WatchWritable) {
 }
 
 // Verify that RunUntilIdle() receives IO notifications.
-TEST_F(FdWatchControllerPosixTest, RunUntilIdle) {
+TEST_P(FdWatchControllerPosixTest, RunUntilIdle) {
   test::TaskEnvironment env(test::TaskEnvironment::MainThreadType::IO);
   MessagePumpForIO::FdWatchController watcher(FROM_HERE);
   TestHandler handler;
@@ -404,7 +464,7 @@ void StopWatching(MessagePumpForIO::FdWatchController* controller,
 }
 
 // Verify that StopWatchingFileDescriptor() works from an event handler.
-TEST_F(FdWatchControllerPosixTest, StopFromHandler) {
+TEST_P(FdWatchControllerPosixTest, StopFromHandler) {
   test::TaskEnvironment env(test::TaskEnvironment::MainThreadType::IO);
   RunLoop run_loop;
   MessagePumpForIO::FdWatchController watcher(FROM_HERE);
@@ -425,7 +485,7 @@ TEST_F(FdWatchControllerPosixTest, StopFromHandler) {
 }
 
 // Verify that non-persistent watcher is called only once.
-TEST_F(FdWatchControllerPosixTest, NonPersistentWatcher) {
+TEST_P(FdWatchControllerPosixTest, NonPersistentWatcher) {
   test::TaskEnvironment env(test::TaskEnvironment::MainThreadType::IO);
   MessagePumpForIO::FdWatchController watcher(FROM_HERE);
 
@@ -446,7 +506,7 @@ TEST_F(FdWatchControllerPosixTest, NonPersistentWatcher) {
 }
 
 // Verify that persistent watcher is called every time the event is triggered.
-TEST_F(FdWatchControllerPosixTest, PersistentWatcher) {
+TEST_P(FdWatchControllerPosixTest, PersistentWatcher) {
   test::TaskEnvironment env(test::TaskEnvironment::MainThreadType::IO);
   MessagePumpForIO::FdWatchController watcher(FROM_HERE);
 
@@ -484,7 +544,7 @@ void StopWatchingAndWatchAgain(MessagePumpForIO::FdWatchController* controller,
 }
 
 // Verify that a watcher can be stopped and reused from an event handler.
-TEST_F(FdWatchControllerPosixTest, StopAndRestartFromHandler) {
+TEST_P(FdWatchControllerPosixTest, StopAndRestartFromHandler) {
   test::TaskEnvironment env(test::TaskEnvironment::MainThreadType::IO);
   MessagePumpForIO::FdWatchController watcher(FROM_HERE);
 
@@ -510,7 +570,7 @@ TEST_F(FdWatchControllerPosixTest, StopAndRestartFromHandler) {
 }
 
 // Verify that the pump properly handles a delayed task after an IO event.
-TEST_F(FdWatchControllerPosixTest, IoEventThenTimer) {
+TEST_P(FdWatchControllerPosixTest, IoEventThenTimer) {
   test::TaskEnvironment env(test::TaskEnvironment::MainThreadType::IO);
   MessagePumpForIO::FdWatchController watcher(FROM_HERE);
 
@@ -539,7 +599,7 @@ TEST_F(FdWatchControllerPosixTest, IoEventThenTimer) {
 }
 
 // Verify that the pipe can handle an IO event after a delayed task.
-TEST_F(FdWatchControllerPosixTest, TimerThenIoEvent) {
+TEST_P(FdWatchControllerPosixTest, TimerThenIoEvent) {
   test::TaskEnvironment env(test::TaskEnvironment::MainThreadType::IO);
   MessagePumpForIO::FdWatchController watcher(FROM_HERE);
 
@@ -560,6 +620,65 @@ TEST_F(FdWatchControllerPosixTest, TimerThenIoEvent) {
   run_loop.Run();
 }
 
+// Runs a nested loop from its first notification, until the next one, then
+// stops the watches of |controllers|.
+class NestedLoopHandler : public MessagePumpForIO::FdWatcher {
+ public:
+  NestedLoopHandler(
+      std::vector<MessagePumpForIO::FdWatchController*> controllers,
+      OnceClosure done_closure)
+      : controllers_(std::move(controllers)),
+        done_closure_(std::move(done_closure)) {}
+
+  void OnFileCanReadWithoutBlocking(int fd) override { ADD_FAILURE(); }
+
+  void OnFileCanWriteWithoutBlocking(int fd) override {
+    if (nested_run_loop_) {
+      nested_run_loop_->Quit();
+      return;
+    }
+    ASSERT_FALSE(done_closure_.is_null());
+    RunLoop nested_run_loop(RunLoop::Type::kNestableTasksAllowed);
+    nested_run_loop_ = &nested_run_loop;
+    nested_run_loop.Run();
+    nested_run_loop_ = nullptr;
+    for (MessagePumpForIO::FdWatchController* controller : controllers_)
+      controller->StopWatchingFileDescriptor();
+    std::move(done_closure_).Run();
+  }
+
+ private:
+  const std::vector<MessagePumpForIO::FdWatchController*> controllers_;
+  OnceClosure done_closure_;
+  RunLoop* nested_run_loop_ = nullptr;
+};
+
+// Verify that a nested loop, run from a handler, doesn't leave the outer loop
+// with the descriptors it is yet to notify after they are unregistered.
+TEST_P(FdWatchControllerPosixTest, StopWatchingAfterNestedLoop) {
+  test::TaskEnvironment env(test::TaskEnvironment::MainThreadType::IO);
+  int pipefds[2];
+  ASSERT_EQ(0, pipe(pipefds));
+  ScopedFD other_read_fd(pipefds[0]);
+  ScopedFD other_write_fd(pipefds[1]);
+  MessagePumpForIO::FdWatchController watcher(FROM_HERE);
+  MessagePumpForIO::FdWatchController other_watcher(FROM_HERE);
+
+  // Both descriptors are writable, so they are notified together, and again
+  // by the nested loop.
+  RunLoop run_loop;
+  NestedLoopHandler handler({&watcher, &other_watcher},
+                            run_loop.QuitClosure());
+  ASSERT_TRUE(CurrentIOThread::Get()->WatchFileDescriptor(
+      write_fd_.get(), /*persistent=*/true, MessagePumpForIO::WATCH_WRITE,
+      &watcher, &handler));
+  ASSERT_TRUE(CurrentIOThread::Get()->WatchFileDescriptor(
+      other_write_fd.get(), /*persistent=*/true, MessagePumpForIO::WATCH_WRITE,
+      &other_watcher, &handler));
+  run_loop.Run();
+  RunLoop().RunUntilIdle();
+}
+
 }  // namespace
 
 #endif  // !defined(OS_NACL)
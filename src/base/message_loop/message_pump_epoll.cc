@@ -0,0 +1,407 @@
+// Copyright 2021 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "base/message_loop/message_pump_epoll.h"
+
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <utility>
+
+#include "base/auto_reset.h"
+#include "base/check_op.h"
+#include "base/logging.h"
+#include "base/memory/ptr_util.h"
+#include "base/notreached.h"
+#include "base/numerics/safe_conversions.h"
+#include "base/posix/eintr_wrapper.h"
+#include "base/trace_event/base_tracing.h"
+
+namespace base {
+
+namespace {
+
+// The maximum number of events dispatched per epoll_wait().
+constexpr int kMaxEventsPerWait = 64;
+
+}  // namespace
+
+EpollInterest::EpollInterest(MessagePumpLibevent::FdWatchController* controller,
+                             int fd,
+                             int mode,
+                             bool persistent)
+    : controller_(controller), fd_(fd), mode_(mode), persistent_(persistent) {}
+
+EpollInterest::~EpollInterest() = default;
+
+MessagePumpEpoll::EpollEventEntry::EpollEventEntry(int fd, uint64_t id)
+    : fd(fd), id(id) {}
+
+MessagePumpEpoll::EpollEventEntry::~EpollEventEntry() = default;
+
+uint32_t MessagePumpEpoll::EpollEventEntry::ComputeActiveEvents() const {
+  uint32_t events = 0;
+  for (const scoped_refptr<EpollInterest>& interest : interests) {
+    if (!interest->active())
+      continue;
+    if (interest->mode() & WATCH_READ)
+      events |= EPOLLIN;
+    if (interest->mode() & WATCH_WRITE)
+      events |= EPOLLOUT;
+  }
+  // Errors and hang-ups are always reported. Without active interests, they
+  // are reported once, rather than until the descriptor is closed.
+  if (!events)
+    events = EPOLLONESHOT;
+  return events;
+}
+
+// static
+std::unique_ptr<MessagePumpEpoll> MessagePumpEpoll::Create() {
+  ScopedFD epoll(epoll_create1(EPOLL_CLOEXEC));
+  if (!epoll.is_valid()) {
+    DPLOG(ERROR) << "epoll_create1";
+    return nullptr;
+  }
+  ScopedFD wakeup_event(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK));
+  if (!wakeup_event.is_valid()) {
+    DPLOG(ERROR) << "eventfd";
+    return nullptr;
+  }
+  return WrapUnique(
+      new MessagePumpEpoll(std::move(epoll), std::move(wakeup_event)));
+}
+
+MessagePumpEpoll::MessagePumpEpoll(ScopedFD epoll, ScopedFD wakeup_event)
+    : epoll_(std::move(epoll)), wakeup_event_(std::move(wakeup_event)) {
+  epoll_event event = {};
+  event.events = EPOLLIN;
+  event.data.ptr = const_cast<ScopedFD*>(&wakeup_event_);
+  const int result =
+      epoll_ctl(epoll_.get(), EPOLL_CTL_ADD, wakeup_event_.get(), &event);
+  DPCHECK(result == 0) << "epoll_ctl";
+}
+
+MessagePumpEpoll::~MessagePumpEpoll() {
+  // The controllers still watching may outlive the pump, and stop watching
+  // without it.
+  for (auto& fd_and_entry : entries_) {
+    for (const scoped_refptr<EpollInterest>& interest :
+         fd_and_entry.second.interests) {
+      if (MessagePumpLibevent::FdWatchController* controller =
+              interest->controller()) {
+        interest->Detach();
+        controller->epoll_interest_ = nullptr;
+      }
+    }
+  }
+}
+
+bool MessagePumpEpoll::WatchFileDescriptor(
+    int fd,
+    bool persistent,
+    int mode,
+    MessagePumpLibevent::FdWatchController* controller,
+    FdWatcher* delegate) {
+  DCHECK_GE(fd, 0);
+  DCHECK(controller);
+  DCHECK(delegate);
+  DCHECK(mode == WATCH_READ || mode == WATCH_WRITE || mode == WATCH_READ_WRITE);
+  // WatchFileDescriptor should be called on the pump thread. It is not
+  // threadsafe, and your watcher may never be registered.
+  DCHECK(watch_file_descriptor_caller_checker_.CalledOnValidThread());
+
+  scoped_refptr<EpollInterest> existing_interest =
+      controller->epoll_interest_;
+  if (existing_interest) {
+    // It's illegal to use this function to listen on 2 separate fds with the
+    // same |controller|.
+    if (existing_interest->fd() != fd) {
+      NOTREACHED() << "FDs don't match: " << existing_interest->fd()
+                   << " != " << fd;
+      return false;
+    }
+    // Combines the old and new registrations, like libevent.
+    mode |= existing_interest->mode();
+    persistent |= existing_interest->persistent();
+    if (mode == existing_interest->mode() &&
+        persistent == existing_interest->persistent()) {
+      // Typically a non-persistent watch renewed after its notification,
+      // which only needs the interest to be reactivated.
+      controller->set_watcher(delegate);
+      if (existing_interest->active())
+        return true;
+      existing_interest->set_active(true);
+      return UpdateEpollEvent(&entries_.at(fd));
+    }
+    StopWatching(controller);
+  }
+
+  auto interest =
+      MakeRefCounted<EpollInterest>(controller, fd, mode, persistent);
+  if (!RegisterInterest(interest))
+    return false;
+  controller->epoll_interest_ = std::move(interest);
+  controller->set_watcher(delegate);
+  return true;
+}
+
+void MessagePumpEpoll::StopWatching(
+    MessagePumpLibevent::FdWatchController* controller) {
+  scoped_refptr<EpollInterest> interest =
+      std::move(controller->epoll_interest_);
+  if (!interest)
+    return;
+  interest->Detach();
+  UnregisterInterest(interest);
+}
+
+void MessagePumpEpoll::Run(Delegate* delegate) {
+  RunState run_state(delegate);
+  AutoReset<RunState*> auto_reset_run_state(&run_state_, &run_state);
+
+  for (;;) {
+    // Do some work and see if the next task is ready right away.
+    Delegate::NextWorkInfo next_work_info = delegate->DoWork();
+    bool immediate_work_available = next_work_info.is_immediate();
+
+    if (run_state.should_quit)
+      break;
+
+    // Process native events if any are ready. Do not block waiting for more.
+    {
+      auto scoped_do_work_item = delegate->BeginWorkItem();
+      WaitForEpollEvents(TimeDelta());
+    }
+
+    bool attempt_more_work = immediate_work_available || processed_io_events_;
+    processed_io_events_ = false;
+
+    if (run_state.should_quit)
+      break;
+
+    if (attempt_more_work)
+      continue;
+
+    attempt_more_work = delegate->DoIdleWork();
+
+    if (run_state.should_quit)
+      break;
+
+    if (attempt_more_work)
+      continue;
+
+    // Block waiting for events and process all available upon waking up, or
+    // until the delayed work is due.
+    DCHECK(!next_work_info.delayed_run_time.is_null());
+    delegate->BeforeWait();
+    WaitForEpollEvents(next_work_info.delayed_run_time.is_max()
+                           ? TimeDelta::Max()
+                           : next_work_info.remaining_delay());
+
+    if (run_state.should_quit)
+      break;
+  }
+}
+
+void MessagePumpEpoll::Quit() {
+  DCHECK(run_state_) << "Quit was called outside of Run!";
+  run_state_->should_quit = true;
+  ScheduleWork();
+}
+
+void MessagePumpEpoll::ScheduleWork() {
+  const uint64_t value = 1;
+  const ssize_t nwrite =
+      HANDLE_EINTR(write(wakeup_event_.get(), &value, sizeof(value)));
+  // EAGAIN if the counter is about to overflow, in which case a wakeup is
+  // pending anyway.
+  DPCHECK(nwrite == sizeof(value) || errno == EAGAIN) << "nwrite:" << nwrite;
+}
+
+void MessagePumpEpoll::ScheduleDelayedWork(const TimeTicks& delayed_work_time) {
+  // Like MessagePumpLibevent, this can only be called on the thread of Run(),
+  // which sets the timeout of its wait when it is out of immediate tasks.
+}
+
+bool MessagePumpEpoll::RegisterInterest(
+    const scoped_refptr<EpollInterest>& interest) {
+  const int fd = interest->fd();
+  auto result = entries_.try_emplace(fd, fd, last_entry_id_ + 1);
+  if (result.second)
+    ++last_entry_id_;
+  auto it = result.first;
+  EpollEventEntry& entry = it->second;
+  entry.interests.push_back(interest);
+  if (UpdateEpollEvent(&entry))
+    return true;
+  entry.interests.pop_back();
+  if (entry.interests.empty())
+    entries_.erase(it);
+  return false;
+}
+
+void MessagePumpEpoll::UnregisterInterest(
+    const scoped_refptr<EpollInterest>& interest) {
+  const int fd = interest->fd();
+  auto entry_it = entries_.find(fd);
+  DCHECK(entry_it != entries_.end());
+  EpollEventEntry& entry = entry_it->second;
+  auto& interests = entry.interests;
+  auto it = std::find(interests.begin(), interests.end(), interest);
+  DCHECK(it != interests.end());
+  interests.erase(it);
+  if (!interests.empty()) {
+    UpdateEpollEvent(&entry);
+    return;
+  }
+
+  // Fails if the descriptor was closed already, which removed it from epoll.
+  epoll_ctl(epoll_.get(), EPOLL_CTL_DEL, fd, nullptr);
+  entries_.erase(entry_it);
+}
+
+bool MessagePumpEpoll::UpdateEpollEvent(EpollEventEntry* entry) {
+  const uint32_t events = entry->ComputeActiveEvents();
+  if (events == entry->registered_events)
+    return true;
+
+  epoll_event event = {};
+  event.events = events;
+  event.data.ptr = entry;
+  int op = entry->registered_events ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+  int result = epoll_ctl(epoll_.get(), op, entry->fd, &event);
+  if (result != 0 && op == EPOLL_CTL_MOD && errno == ENOENT) {
+    // The descriptor was closed and its number reused while watched.
+    op = EPOLL_CTL_ADD;
+    result = epoll_ctl(epoll_.get(), op, entry->fd, &event);
+  }
+  if (result != 0) {
+    DPLOG(ERROR) << "epoll_ctl(fd=" << entry->fd << ")";
+    return false;
+  }
+  entry->registered_events = events;
+  return true;
+}
+
+void MessagePumpEpoll::WaitForEpollEvents(TimeDelta timeout) {
+  // Rounded up, so that the delayed work is due when the wait times out.
+  const int timeout_ms =
+      timeout.is_max()
+          ? -1
+          : saturated_cast<int>(timeout.InMillisecondsRoundedUp());
+  epoll_event events[kMaxEventsPerWait];
+  const int epoll_result =
+      epoll_wait(epoll_.get(), events, kMaxEventsPerWait, timeout_ms);
+  if (epoll_result < 0) {
+    DPCHECK(errno == EINTR) << "epoll_wait";
+    return;
+  }
+
+  // The watchers may stop watching the other descriptors of the batch,
+  // directly or from a nested loop, which destroys their entries. The entries
+  // are therefore looked up again before their events are dispatched.
+  struct PendingEvent {
+    int fd;
+    uint64_t entry_id;
+  };
+  PendingEvent pending_events[kMaxEventsPerWait];
+  for (int i = 0; i < epoll_result; ++i) {
+    if (events[i].data.ptr == &wakeup_event_)
+      continue;
+    const auto* entry = static_cast<EpollEventEntry*>(events[i].data.ptr);
+    pending_events[i] = {entry->fd, entry->id};
+  }
+
+  for (int i = 0; i < epoll_result; ++i) {
+    if (events[i].data.ptr == &wakeup_event_) {
+      // Resets the counter of the eventfd.
+      uint64_t value;
+      const ssize_t nread =
+          HANDLE_EINTR(read(wakeup_event_.get(), &value, sizeof(value)));
+      DPCHECK(nread == sizeof(value) || errno == EAGAIN) << "nread:" << nread;
+      processed_io_events_ = true;
+      continue;
+    }
+    auto it = entries_.find(pending_events[i].fd);
+    if (it == entries_.end() || it->second.id != pending_events[i].entry_id)
+      continue;
+    OnEpollEvent(&it->second, events[i].events);
+  }
+}
+
+void MessagePumpEpoll::OnEpollEvent(EpollEventEntry* entry, uint32_t events) {
+  // Like libevent, errors and hang-ups make the descriptor both readable and
+  // writable.
+  const bool disconnected = events & (EPOLLERR | EPOLLHUP);
+  const bool readable = disconnected || (events & EPOLLIN);
+  const bool writable = disconnected || (events & EPOLLOUT);
+  const int fd = entry->fd;
+
+  // The watchers may stop watching, which removes the interests from |entry|
+  // and |entry| from the pump once it has none. The interests which stopped
+  // are detached.
+  const std::vector<scoped_refptr<EpollInterest>> interests = entry->interests;
+  bool deactivated_interest = false;
+  for (const scoped_refptr<EpollInterest>& interest : interests) {
+    if (!interest->controller() || !interest->active())
+      continue;
+    const bool can_read = readable && (interest->mode() & WATCH_READ);
+    const bool can_write = writable && (interest->mode() & WATCH_WRITE);
+    if (!can_read && !can_write)
+      continue;
+    if (!interest->persistent()) {
+      interest->set_active(false);
+      deactivated_interest = true;
+    }
+    HandleEvent(fd, can_read, can_write, interest->controller());
+  }
+
+  // Only now that the watchers had the chance to watch again, which is
+  // typical of non-persistent watches, is epoll updated, if at all.
+  if (deactivated_interest) {
+    auto it = entries_.find(fd);
+    if (it != entries_.end())
+      UpdateEpollEvent(&it->second);
+  }
+}
+
+void MessagePumpEpoll::HandleEvent(
+    int fd,
+    bool can_read,
+    bool can_write,
+    MessagePumpLibevent::FdWatchController* controller) {
+  TRACE_EVENT("toplevel", "OnEpollEvent", "fd", fd);
+  TRACE_HEAP_PROFILER_API_SCOPED_TASK_EXECUTION heap_profiler_scope(
+      controller->created_from_location().file_name());
+  processed_io_events_ = true;
+
+  // Make the MessagePumpDelegate aware of this other form of "DoWork". Skip if
+  // called outside of Run().
+  Delegate::ScopedDoWorkItem scoped_do_work_item;
+  if (run_state_)
+    scoped_do_work_item = run_state_->delegate->BeginWorkItem();
+
+  MessagePumpLibevent* pump = controller->pump();
+  if (can_read && can_write) {
+    // Both callbacks will be called. It is necessary to check that
+    // |controller| is not destroyed.
+    bool controller_was_destroyed = false;
+    controller->was_destroyed_ = &controller_was_destroyed;
+    controller->OnFileCanWriteWithoutBlocking(fd, pump);
+    if (!controller_was_destroyed)
+      controller->OnFileCanReadWithoutBlocking(fd, pump);
+    if (!controller_was_destroyed)
+      controller->was_destroyed_ = nullptr;
+  } else if (can_write) {
+    controller->OnFileCanWriteWithoutBlocking(fd, pump);
+  } else if (can_read) {
+    controller->OnFileCanReadWithoutBlocking(fd, pump);
+  }
+}
+
+}  // namespace base
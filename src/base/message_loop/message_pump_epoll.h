@@ -0,0 +1,165 @@
+// Copyright 2021 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BASE_MESSAGE_LOOP_MESSAGE_PUMP_EPOLL_H_
+#define BASE_MESSAGE_LOOP_MESSAGE_PUMP_EPOLL_H_
+
+#include <stdint.h>
+
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "base/base_export.h"
+#include "base/files/scoped_file.h"
+#include "base/memory/ref_counted.h"
+#include "base/message_loop/message_pump.h"
+#include "base/message_loop/message_pump_libevent.h"
+#include "base/message_loop/watchable_io_message_pump_posix.h"
+#include "base/threading/thread_checker.h"
+#include "base/time/time.h"
+
+struct epoll_event;
+
+namespace base {
+
+// The registration of a MessagePumpLibevent::FdWatchController with
+// MessagePumpEpoll.
+class EpollInterest : public RefCounted<EpollInterest> {
+ public:
+  EpollInterest(MessagePumpLibevent::FdWatchController* controller,
+                int fd,
+                int mode,
+                bool persistent);
+  EpollInterest(const EpollInterest&) = delete;
+  EpollInterest& operator=(const EpollInterest&) = delete;
+
+  // Null once the controller stopped watching.
+  MessagePumpLibevent::FdWatchController* controller() const {
+    return controller_;
+  }
+  void Detach() { controller_ = nullptr; }
+
+  int fd() const { return fd_; }
+  int mode() const { return mode_; }
+  bool persistent() const { return persistent_; }
+
+  // Whether the events of the interest are watched. A non-persistent interest
+  // is deactivated when its watcher is notified.
+  bool active() const { return active_; }
+  void set_active(bool active) { active_ = active; }
+
+ private:
+  friend class RefCounted<EpollInterest>;
+  ~EpollInterest();
+
+  MessagePumpLibevent::FdWatchController* controller_;
+  const int fd_;
+  const int mode_;
+  const bool persistent_;
+  bool active_ = true;
+};
+
+// MessagePumpEpoll is the epoll backend of MessagePumpLibevent, used instead of
+// libevent if features::kMessagePumpEpoll is enabled, with the same
+// FdWatchController.
+//
+// Each descriptor is added to epoll once, with the union of the events of the
+// controllers watching it, and only modified when that union changes. Up to
+// a batch of events are dispatched per epoll_wait(). ScheduleWork() writes to
+// an eventfd.
+//
+// Linux and ChromeOS only.
+class BASE_EXPORT MessagePumpEpoll
+    : public MessagePumpLibevent::BackendPump,
+      public WatchableIOMessagePumpPosix {
+ public:
+  // Returns null if the epoll instance or the eventfd can't be created.
+  static std::unique_ptr<MessagePumpEpoll> Create();
+
+  MessagePumpEpoll(const MessagePumpEpoll&) = delete;
+  MessagePumpEpoll& operator=(const MessagePumpEpoll&) = delete;
+  ~MessagePumpEpoll() override;
+
+  // Like MessagePumpLibevent::WatchFileDescriptor().
+  bool WatchFileDescriptor(int fd,
+                           bool persistent,
+                           int mode,
+                           MessagePumpLibevent::FdWatchController* controller,
+                           FdWatcher* delegate) override;
+
+  // Removes the watch of |controller|, if any.
+  void StopWatching(
+      MessagePumpLibevent::FdWatchController* controller) override;
+
+  // MessagePump methods:
+  void Run(Delegate* delegate) override;
+  void Quit() override;
+  void ScheduleWork() override;
+  void ScheduleDelayedWork(const TimeTicks& delayed_work_time) override;
+
+ private:
+  struct RunState {
+    explicit RunState(Delegate* delegate_in) : delegate(delegate_in) {}
+
+    Delegate* const delegate;
+
+    // Used to flag that the current Run() invocation should return ASAP.
+    bool should_quit = false;
+  };
+
+  // The registration of a descriptor with epoll, shared by the interests in
+  // it.
+  struct EpollEventEntry {
+    EpollEventEntry(int fd, uint64_t id);
+    EpollEventEntry(const EpollEventEntry&) = delete;
+    EpollEventEntry& operator=(const EpollEventEntry&) = delete;
+    ~EpollEventEntry();
+
+    // Returns the epoll events of the active interests.
+    uint32_t ComputeActiveEvents() const;
+
+    const int fd;
+    // Distinguishes the entry from the previous ones of |fd|.
+    const uint64_t id;
+    // The events registered with epoll, 0 if not registered yet.
+    uint32_t registered_events = 0;
+    std::vector<scoped_refptr<EpollInterest>> interests;
+  };
+
+  MessagePumpEpoll(ScopedFD epoll, ScopedFD wakeup_event);
+
+  bool RegisterInterest(const scoped_refptr<EpollInterest>& interest);
+  void UnregisterInterest(const scoped_refptr<EpollInterest>& interest);
+  bool UpdateEpollEvent(EpollEventEntry* entry);
+
+  // Waits up to |timeout| for events, and dispatches them.
+  void WaitForEpollEvents(TimeDelta timeout);
+  void OnEpollEvent(EpollEventEntry* entry, uint32_t events);
+  void HandleEvent(int fd,
+                   bool can_read,
+                   bool can_write,
+                   MessagePumpLibevent::FdWatchController* controller);
+
+  // State for the current invocation of Run(). null if not running.
+  RunState* run_state_ = nullptr;
+
+  // This flag is set if the pump has notified watchers or has been woken up.
+  bool processed_io_events_ = false;
+
+  const ScopedFD epoll_;
+  // ScheduleWork() writes to the eventfd, which is watched by |epoll_|.
+  const ScopedFD wakeup_event_;
+
+  // The registered descriptors. Their entries don't move, so that epoll can
+  // refer to them.
+  std::map<int, EpollEventEntry> entries_;
+  uint64_t last_entry_id_ = 0;
+
+  ThreadChecker watch_file_descriptor_caller_checker_;
+};
+
+}  // namespace base
+
+#endif  // BASE_MESSAGE_LOOP_MESSAGE_PUMP_EPOLL_H_
@@ -0,0 +1,401 @@
+// Copyright 2021 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "base/message_loop/message_pump_io_uring.h"
+
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <linux/time_types.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <utility>
+
+#include "base/auto_reset.h"
+#include "base/check_op.h"
+#include "base/files/io_uring.h"
+#include "base/logging.h"
+#include "base/memory/ptr_util.h"
+#include "base/notreached.h"
+#include "base/posix/eintr_wrapper.h"
+#include "base/trace_event/base_tracing.h"
+#include "build/build_config.h"
+
+namespace base {
+
+namespace {
+
+// Enough for the watches added or removed by the tasks between two waits.
+// More are submitted as the queue fills up.
+constexpr uint32_t kQueueDepth = 256;
+
+// The operations of the pump, all supported from Linux 5.6.
+constexpr uint8_t kRequiredOps[] = {
+    IORING_OP_POLL_ADD,     IORING_OP_POLL_REMOVE,  IORING_OP_READ,
+    IORING_OP_LINK_TIMEOUT, IORING_OP_ASYNC_CANCEL,
+};
+
+// The user data of the poll requests is the address of their IoUringInterest,
+// which is aligned. That of the other requests has its low bit set.
+constexpr uint64_t kInternalRequest = 1;
+constexpr uint64_t kWakeupRequest = 1 << 1;
+
+// The user data of the reads of the wakeup eventfd holds their generation,
+// so that those cancelled aren't mistaken for the current one.
+uint64_t GetWakeupUserData(uint64_t generation) {
+  return (generation << 2) | kWakeupRequest | kInternalRequest;
+}
+
+uint32_t GetPollEvents(int mode) {
+  uint32_t events = 0;
+  if (mode & WatchableIOMessagePumpPosix::WATCH_READ)
+    events |= POLLIN;
+  if (mode & WatchableIOMessagePumpPosix::WATCH_WRITE)
+    events |= POLLOUT;
+#if defined(ARCH_CPU_BIG_ENDIAN)
+  // The 32-bit poll events are in the two halves of the 16-bit field of
+  // older kernels, swapped.
+  events = (events << 16) | (events >> 16);
+#endif
+  return events;
+}
+
+}  // namespace
+
+IoUringInterest::IoUringInterest(
+    MessagePumpLibevent::FdWatchController* controller,
+    int fd,
+    int mode,
+    bool persistent)
+    : controller_(controller), fd_(fd), mode_(mode), persistent_(persistent) {}
+
+IoUringInterest::~IoUringInterest() = default;
+
+// static
+std::unique_ptr<MessagePumpIoUring> MessagePumpIoUring::Create() {
+  std::unique_ptr<IoUring> ring = IoUring::Create(kQueueDepth);
+  if (!ring)
+    return nullptr;
+  for (uint8_t opcode : kRequiredOps) {
+    if (!ring->IsOpSupported(opcode))
+      return nullptr;
+  }
+  // Not EFD_NONBLOCK, since the ring fails the reads of non-blocking files
+  // instead of waiting for them to be readable.
+  ScopedFD wakeup_event(eventfd(0, EFD_CLOEXEC));
+  if (!wakeup_event.is_valid()) {
+    DPLOG(ERROR) << "eventfd";
+    return nullptr;
+  }
+  return WrapUnique(
+      new MessagePumpIoUring(std::move(ring), std::move(wakeup_event)));
+}
+
+MessagePumpIoUring::MessagePumpIoUring(std::unique_ptr<IoUring> ring,
+                                       ScopedFD wakeup_event)
+    : ring_(std::move(ring)),
+      wakeup_event_(std::move(wakeup_event)),
+      wakeup_timeout_(std::make_unique<__kernel_timespec>()) {}
+
+MessagePumpIoUring::~MessagePumpIoUring() {
+  // The requests are cancelled when the ring is closed, without completions.
+  // The controllers that are still watching may outlive the pump, and stop
+  // watching without it.
+  while (!polling_interests_.empty()) {
+    IoUringInterest* interest = polling_interests_.head()->value();
+    interest->RemoveFromList();
+    interest->set_poll_pending(false);
+    if (MessagePumpLibevent::FdWatchController* controller =
+            interest->controller()) {
+      interest->Detach();
+      controller->io_uring_interest_ = nullptr;
+    }
+    interest->Release();
+  }
+}
+
+bool MessagePumpIoUring::WatchFileDescriptor(
+    int fd,
+    bool persistent,
+    int mode,
+    MessagePumpLibevent::FdWatchController* controller,
+    FdWatcher* delegate) {
+  DCHECK_GE(fd, 0);
+  DCHECK(controller);
+  DCHECK(delegate);
+  DCHECK(mode == WATCH_READ || mode == WATCH_WRITE || mode == WATCH_READ_WRITE);
+  // WatchFileDescriptor should be called on the pump thread. It is not
+  // threadsafe, and your watcher may never be registered.
+  DCHECK(watch_file_descriptor_caller_checker_.CalledOnValidThread());
+
+  if (controller->io_uring_interest_) {
+    // It's illegal to use this function to listen on 2 separate fds with the
+    // same |controller|.
+    if (controller->io_uring_interest_->fd() != fd) {
+      NOTREACHED() << "FDs don't match: "
+                   << controller->io_uring_interest_->fd() << " != " << fd;
+      return false;
+    }
+    // Combines the old and new registrations, like libevent.
+    mode |= controller->io_uring_interest_->mode();
+    persistent |= controller->io_uring_interest_->persistent();
+    StopWatching(controller);
+  }
+
+  controller->io_uring_interest_ =
+      MakeRefCounted<IoUringInterest>(controller, fd, mode, persistent);
+  controller->set_watcher(delegate);
+  ArmPoll(controller->io_uring_interest_.get());
+  return true;
+}
+
+void MessagePumpIoUring::StopWatching(
+    MessagePumpLibevent::FdWatchController* controller) {
+  scoped_refptr<IoUringInterest> interest =
+      std::move(controller->io_uring_interest_);
+  if (!interest)
+    return;
+  interest->Detach();
+  if (!interest->poll_pending())
+    return;
+  // The request completes with -ECANCELED, unless it completed already, in
+  // which case its completion is ignored.
+  io_uring_sqe* sqe = GetSqes(1);
+  sqe->opcode = IORING_OP_POLL_REMOVE;
+  sqe->addr = reinterpret_cast<uintptr_t>(interest.get());
+  sqe->user_data = kInternalRequest;
+}
+
+void MessagePumpIoUring::Run(Delegate* delegate) {
+  RunState run_state(delegate);
+  AutoReset<RunState*> auto_reset_run_state(&run_state_, &run_state);
+
+  for (;;) {
+    // Do some work and see if the next task is ready right away.
+    Delegate::NextWorkInfo next_work_info = delegate->DoWork();
+    bool immediate_work_available = next_work_info.is_immediate();
+
+    if (run_state.should_quit)
+      break;
+
+    // Submit the pending requests, and process the completions if any are
+    // ready. Do not block waiting for more.
+    {
+      auto scoped_do_work_item = delegate->BeginWorkItem();
+      ring_->Submit();
+      if (ring_->HasOverflowedCompletions())
+        ring_->SubmitAndWait(0);
+      ProcessCompletions();
+    }
+
+    bool attempt_more_work = immediate_work_available || processed_io_events_;
+    processed_io_events_ = false;
+
+    if (run_state.should_quit)
+      break;
+
+    if (attempt_more_work)
+      continue;
+
+    attempt_more_work = delegate->DoIdleWork();
+
+    if (run_state.should_quit)
+      break;
+
+    if (attempt_more_work)
+      continue;
+
+    // Submit the pending requests, then block waiting for completions and
+    // process all available upon waking up.
+    DCHECK(!next_work_info.delayed_run_time.is_null());
+    ArmWakeup(next_work_info.delayed_run_time);
+    delegate->BeforeWait();
+    const int result = ring_->SubmitAndWait(1);
+    DPCHECK(result >= 0) << "io_uring_enter: " << -result;
+    ProcessCompletions();
+
+    if (run_state.should_quit)
+      break;
+  }
+}
+
+void MessagePumpIoUring::Quit() {
+  DCHECK(run_state_) << "Quit was called outside of Run!";
+  run_state_->should_quit = true;
+  ScheduleWork();
+}
+
+void MessagePumpIoUring::ScheduleWork() {
+  const uint64_t value = 1;
+  const ssize_t nwrite =
+      HANDLE_EINTR(write(wakeup_event_.get(), &value, sizeof(value)));
+  DPCHECK(nwrite == sizeof(value)) << "nwrite:" << nwrite;
+}
+
+void MessagePumpIoUring::ScheduleDelayedWork(
+    const TimeTicks& delayed_work_time) {
+  // Like MessagePumpLibevent, this can only be called on the thread of Run(),
+  // which sets the timeout of its wait when it is out of immediate tasks.
+}
+
+io_uring_sqe* MessagePumpIoUring::GetSqes(uint32_t count) {
+  DCHECK_LE(count, ring_->sq_entries());
+  if (ring_->GetSqSpaceLeft() < count) {
+    ring_->Submit();
+    // If the kernel can't take more requests until completions are reaped,
+    // e.g. before Linux 5.5.
+    if (ring_->GetSqSpaceLeft() < count)
+      ring_->SubmitAndWait(0);
+  }
+  CHECK_GE(ring_->GetSqSpaceLeft(), count);
+  return ring_->GetSqe();
+}
+
+void MessagePumpIoUring::ArmPoll(IoUringInterest* interest) {
+  DCHECK(!interest->poll_pending());
+  io_uring_sqe* sqe = GetSqes(1);
+  sqe->opcode = IORING_OP_POLL_ADD;
+  sqe->fd = interest->fd();
+  sqe->poll32_events = GetPollEvents(interest->mode());
+  sqe->user_data = reinterpret_cast<uintptr_t>(interest);
+  // The reference of the request.
+  interest->AddRef();
+  interest->set_poll_pending(true);
+  polling_interests_.Append(interest);
+}
+
+void MessagePumpIoUring::ArmWakeup(TimeTicks delayed_run_time) {
+  if (wakeup_armed_) {
+    // A wakeup earlier than needed only costs an iteration of Run().
+    if (delayed_run_time >= wakeup_deadline_)
+      return;
+    io_uring_sqe* sqe = GetSqes(1);
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->addr = GetWakeupUserData(wakeup_generation_);
+    sqe->user_data = kInternalRequest;
+  }
+
+  ++wakeup_generation_;
+  wakeup_armed_ = true;
+  wakeup_deadline_ = delayed_run_time;
+  const bool has_timeout = !delayed_run_time.is_max();
+
+  // The linked requests must be submitted together.
+  io_uring_sqe* sqe = GetSqes(has_timeout ? 2 : 1);
+  sqe->opcode = IORING_OP_READ;
+  sqe->fd = wakeup_event_.get();
+  sqe->addr = reinterpret_cast<uintptr_t>(&wakeup_value_);
+  sqe->len = sizeof(wakeup_value_);
+  sqe->user_data = GetWakeupUserData(wakeup_generation_);
+  if (!has_timeout)
+    return;
+
+  // The timeout cancels the read when it expires.
+  sqe->flags |= IOSQE_IO_LINK;
+  const TimeDelta delay =
+      std::max(delayed_run_time - TimeTicks::Now(), TimeDelta());
+  wakeup_timeout_->tv_sec = delay.InSeconds();
+  wakeup_timeout_->tv_nsec =
+      (delay - Seconds(delay.InSeconds())).InNanoseconds();
+  io_uring_sqe* timeout_sqe = ring_->GetSqe();
+  timeout_sqe->opcode = IORING_OP_LINK_TIMEOUT;
+  timeout_sqe->addr = reinterpret_cast<uintptr_t>(wakeup_timeout_.get());
+  timeout_sqe->len = 1;
+  timeout_sqe->user_data = kInternalRequest;
+}
+
+void MessagePumpIoUring::ProcessCompletions() {
+  // The completions are removed from the queue before they are dispatched,
+  // since the watchers may run a nested loop.
+  while (io_uring_cqe* cqe = ring_->PeekCqe()) {
+    const uint64_t user_data = cqe->user_data;
+    const int result = cqe->res;
+    ring_->PopCqe();
+
+    if (!(user_data & kInternalRequest)) {
+      scoped_refptr<IoUringInterest> interest(
+          reinterpret_cast<IoUringInterest*>(user_data));
+      // Drops the reference of the request.
+      interest->Release();
+      interest->RemoveFromList();
+      interest->set_poll_pending(false);
+      OnPollCompleted(std::move(interest), result);
+      continue;
+    }
+
+    if (user_data & kWakeupRequest) {
+      if (user_data == GetWakeupUserData(wakeup_generation_))
+        wakeup_armed_ = false;
+      // Either ScheduleWork() was called, or the read was cancelled, e.g. by
+      // its timeout.
+      if (result > 0)
+        processed_io_events_ = true;
+    }
+  }
+}
+
+void MessagePumpIoUring::OnPollCompleted(
+    scoped_refptr<IoUringInterest> interest,
+    int result) {
+  MessagePumpLibevent::FdWatchController* controller = interest->controller();
+  // The controller stopped watching after the request completed.
+  if (!controller)
+    return;
+  const int fd = interest->fd();
+  if (result < 0) {
+    // E.g. EBADF if the descriptor was closed before the request was
+    // submitted. libevent would have failed to watch it.
+    DLOG(ERROR) << "Polling fd " << fd << " failed: " << -result;
+    return;
+  }
+
+  TRACE_EVENT("toplevel", "OnIoUringPoll", "fd", fd);
+  TRACE_HEAP_PROFILER_API_SCOPED_TASK_EXECUTION heap_profiler_scope(
+      controller->created_from_location().file_name());
+  processed_io_events_ = true;
+
+  // Make the MessagePumpDelegate aware of this other form of "DoWork". Skip if
+  // called outside of Run().
+  Delegate::ScopedDoWorkItem scoped_do_work_item;
+  if (run_state_)
+    scoped_do_work_item = run_state_->delegate->BeginWorkItem();
+
+  // Like libevent, errors and hang-ups make the descriptor both readable and
+  // writable.
+  int mode = 0;
+  if (result & (POLLERR | POLLHUP))
+    mode = WATCH_READ_WRITE;
+  if (result & POLLIN)
+    mode |= WATCH_READ;
+  if (result & POLLOUT)
+    mode |= WATCH_WRITE;
+  mode &= interest->mode();
+
+  MessagePumpLibevent* pump = controller->pump();
+  if (mode == WATCH_READ_WRITE) {
+    // Both callbacks will be called. It is necessary to check that
+    // |controller| is not destroyed.
+    bool controller_was_destroyed = false;
+    controller->was_destroyed_ = &controller_was_destroyed;
+    controller->OnFileCanWriteWithoutBlocking(fd, pump);
+    if (!controller_was_destroyed)
+      controller->OnFileCanReadWithoutBlocking(fd, pump);
+    if (!controller_was_destroyed)
+      controller->was_destroyed_ = nullptr;
+  } else if (mode & WATCH_WRITE) {
+    controller->OnFileCanWriteWithoutBlocking(fd, pump);
+  } else if (mode & WATCH_READ) {
+    controller->OnFileCanReadWithoutBlocking(fd, pump);
+  }
+
+  // Unless the watcher stopped watching, or watched again.
+  if (interest->persistent() && interest->controller() &&
+      !interest->poll_pending()) {
+    ArmPoll(interest.get());
+  }
+}
+
+}  // namespace base
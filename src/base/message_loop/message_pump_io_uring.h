@@ -0,0 +1,163 @@
+// Copyright 2021 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BASE_MESSAGE_LOOP_MESSAGE_PUMP_IO_URING_H_
+#define BASE_MESSAGE_LOOP_MESSAGE_PUMP_IO_URING_H_
+
+#include <stdint.h>
+
+#include <memory>
+
+#include "base/base_export.h"
+#include "base/containers/linked_list.h"
+#include "base/files/scoped_file.h"
+#include "base/memory/ref_counted.h"
+#include "base/message_loop/message_pump.h"
+#include "base/message_loop/message_pump_libevent.h"
+#include "base/message_loop/watchable_io_message_pump_posix.h"
+#include "base/threading/thread_checker.h"
+#include "base/time/time.h"
+
+struct __kernel_timespec;
+struct io_uring_sqe;
+
+namespace base {
+
+class IoUring;
+
+// The registration of a MessagePumpLibevent::FdWatchController with
+// MessagePumpIoUring. While a poll request for it is in the ring, the request
+// holds a reference to it, and it is in the list of the pump.
+class IoUringInterest : public RefCounted<IoUringInterest>,
+                        public LinkNode<IoUringInterest> {
+ public:
+  IoUringInterest(MessagePumpLibevent::FdWatchController* controller,
+                  int fd,
+                  int mode,
+                  bool persistent);
+  IoUringInterest(const IoUringInterest&) = delete;
+  IoUringInterest& operator=(const IoUringInterest&) = delete;
+
+  // Null once the controller stopped watching.
+  MessagePumpLibevent::FdWatchController* controller() const {
+    return controller_;
+  }
+  void Detach() { controller_ = nullptr; }
+
+  int fd() const { return fd_; }
+  int mode() const { return mode_; }
+  bool persistent() const { return persistent_; }
+
+  bool poll_pending() const { return poll_pending_; }
+  void set_poll_pending(bool poll_pending) { poll_pending_ = poll_pending; }
+
+ private:
+  friend class RefCounted<IoUringInterest>;
+  ~IoUringInterest();
+
+  MessagePumpLibevent::FdWatchController* controller_;
+  const int fd_;
+  const int mode_;
+  const bool persistent_;
+  bool poll_pending_ = false;
+};
+
+// MessagePumpIoUring is the io_uring backend of MessagePumpLibevent, used
+// instead of libevent if features::kMessagePumpIoUring is enabled and the
+// kernel supports it, with the same FdWatchController.
+//
+// Each watch is a one-shot poll request in the ring, re-armed after it
+// completes if persistent, so that the descriptors are level-triggered like
+// with libevent. The requests to add and remove watches are not submitted
+// when they are made, but batched until the next iteration of the pump, whose
+// wait submits them and waits for completions in a single system call.
+// ScheduleWork() writes to an eventfd read by a request of the ring, linked to
+// a timeout request for the delayed work.
+//
+// Linux and ChromeOS only.
+class BASE_EXPORT MessagePumpIoUring
+    : public MessagePumpLibevent::BackendPump,
+      public WatchableIOMessagePumpPosix {
+ public:
+  // Returns null if io_uring, or the operations used (Linux 5.6), aren't
+  // supported.
+  static std::unique_ptr<MessagePumpIoUring> Create();
+
+  MessagePumpIoUring(const MessagePumpIoUring&) = delete;
+  MessagePumpIoUring& operator=(const MessagePumpIoUring&) = delete;
+  ~MessagePumpIoUring() override;
+
+  // Like MessagePumpLibevent::WatchFileDescriptor(). Since the poll request is
+  // submitted later, an invalid |fd| isn't reported.
+  bool WatchFileDescriptor(int fd,
+                           bool persistent,
+                           int mode,
+                           MessagePumpLibevent::FdWatchController* controller,
+                           FdWatcher* delegate) override;
+
+  // Removes the watch of |controller|, if any.
+  void StopWatching(
+      MessagePumpLibevent::FdWatchController* controller) override;
+
+  // MessagePump methods:
+  void Run(Delegate* delegate) override;
+  void Quit() override;
+  void ScheduleWork() override;
+  void ScheduleDelayedWork(const TimeTicks& delayed_work_time) override;
+
+ private:
+  struct RunState {
+    explicit RunState(Delegate* delegate_in) : delegate(delegate_in) {}
+
+    Delegate* const delegate;
+
+    // Used to flag that the current Run() invocation should return ASAP.
+    bool should_quit = false;
+  };
+
+  MessagePumpIoUring(std::unique_ptr<IoUring> ring, ScopedFD wakeup_event);
+
+  // Returns the first of |count| consecutive submission queue entries.
+  io_uring_sqe* GetSqes(uint32_t count);
+
+  // Adds a poll request for |interest|.
+  void ArmPoll(IoUringInterest* interest);
+
+  // Makes sure that a request waking up the pump is in the ring: a read of
+  // |wakeup_event_|, linked to a timeout at |delayed_run_time| unless it is
+  // TimeTicks::Max().
+  void ArmWakeup(TimeTicks delayed_run_time);
+
+  // Dispatches the completions in the queue.
+  void ProcessCompletions();
+  void OnPollCompleted(scoped_refptr<IoUringInterest> interest, int result);
+
+  // State for the current invocation of Run(). null if not running.
+  RunState* run_state_ = nullptr;
+
+  // This flag is set if the pump has notified watchers or has been woken up.
+  bool processed_io_events_ = false;
+
+  const std::unique_ptr<IoUring> ring_;
+
+  // ScheduleWork() writes to the eventfd, and the ring reads it into
+  // |wakeup_value_|.
+  const ScopedFD wakeup_event_;
+  uint64_t wakeup_value_ = 0;
+  // Whether the read of the current generation is in the ring, and when its
+  // linked timeout expires.
+  bool wakeup_armed_ = false;
+  uint64_t wakeup_generation_ = 0;
+  TimeTicks wakeup_deadline_;
+  const std::unique_ptr<__kernel_timespec> wakeup_timeout_;
+
+  // The interests with a poll request in the ring.
+  LinkedList<IoUringInterest> polling_interests_;
+
+  ThreadChecker watch_file_descriptor_caller_checker_;
+};
+
+}  // namespace base
+
+#endif  // BASE_MESSAGE_LOOP_MESSAGE_PUMP_IO_URING_H_
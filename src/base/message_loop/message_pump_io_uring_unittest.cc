@@ -0,0 +1,291 @@
+// Copyright 2021 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "base/message_loop/message_pump_io_uring.h"
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <memory>
+#include <utility>
+
+#include "base/bind.h"
+#include "base/callback.h"
+#include "base/files/scoped_file.h"
+#include "base/message_loop/message_pump_libevent.h"
+#include "base/posix/eintr_wrapper.h"
+#include "base/run_loop.h"
+#include "base/task/single_thread_task_executor.h"
+#include "base/test/bind.h"
+#include "base/threading/thread.h"
+#include "base/threading/thread_task_runner_handle.h"
+#include "base/time/time.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace base {
+
+namespace {
+
+class MessagePumpIoUringTest : public testing::Test {
+ public:
+  void SetUp() override {
+    auto pump = std::make_unique<MessagePumpLibevent>(
+        MessagePumpLibevent::Backend::kIoUring);
+    if (pump->backend() != MessagePumpLibevent::Backend::kIoUring)
+      GTEST_SKIP() << "io_uring is not supported";
+    pump_ = pump.get();
+    executor_ = std::make_unique<SingleThreadTaskExecutor>(std::move(pump));
+
+    int fds[2];
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+    fd_.reset(fds[0]);
+    peer_fd_.reset(fds[1]);
+  }
+
+ protected:
+  void WriteToPeer() {
+    char c = 0;
+    ASSERT_EQ(1, HANDLE_EINTR(write(peer_fd_.get(), &c, 1)));
+  }
+
+  void ReadFromPeer() {
+    char c;
+    ASSERT_EQ(1, HANDLE_EINTR(read(fd_.get(), &c, 1)));
+  }
+
+  MessagePumpLibevent* pump_ = nullptr;
+  std::unique_ptr<SingleThreadTaskExecutor> executor_;
+  ScopedFD fd_;
+  ScopedFD peer_fd_;
+};
+
+// Runs callbacks when the descriptor is readable or writable.
+class CallbackWatcher : public MessagePumpLibevent::FdWatcher {
+ public:
+  CallbackWatcher() = default;
+  ~CallbackWatcher() override = default;
+
+  void set_on_read(RepeatingClosure on_read) { on_read_ = std::move(on_read); }
+  void set_on_write(RepeatingClosure on_write) {
+    on_write_ = std::move(on_write);
+  }
+
+  // MessagePumpLibevent::FdWatcher:
+  void OnFileCanReadWithoutBlocking(int fd) override {
+    ASSERT_TRUE(on_read_);
+    on_read_.Run();
+  }
+  void OnFileCanWriteWithoutBlocking(int fd) override {
+    ASSERT_TRUE(on_write_);
+    on_write_.Run();
+  }
+
+ private:
+  RepeatingClosure on_read_;
+  RepeatingClosure on_write_;
+};
+
+}  // namespace
+
+TEST_F(MessagePumpIoUringTest, WatchReadable) {
+  MessagePumpLibevent::FdWatchController controller(FROM_HERE);
+  CallbackWatcher watcher;
+  RunLoop run_loop;
+  watcher.set_on_read(run_loop.QuitClosure());
+  ASSERT_TRUE(pump_->WatchFileDescriptor(fd_.get(), false,
+                                         MessagePumpLibevent::WATCH_READ,
+                                         &controller, &watcher));
+  ThreadTaskRunnerHandle::Get()->PostTask(
+      FROM_HERE, BindLambdaForTesting([&]() { WriteToPeer(); }));
+  run_loop.Run();
+}
+
+TEST_F(MessagePumpIoUringTest, WatchWritable) {
+  MessagePumpLibevent::FdWatchController controller(FROM_HERE);
+  CallbackWatcher watcher;
+  RunLoop run_loop;
+  watcher.set_on_write(run_loop.QuitClosure());
+  ASSERT_TRUE(pump_->WatchFileDescriptor(fd_.get(), false,
+                                         MessagePumpLibevent::WATCH_WRITE,
+                                         &controller, &watcher));
+  run_loop.Run();
+}
+
+// A persistent watch notifies the watcher as long as the descriptor is
+// readable, like libevent.
+TEST_F(MessagePumpIoUringTest, PersistentWatchIsLevelTriggered) {
+  MessagePumpLibevent::FdWatchController controller(FROM_HERE);
+  CallbackWatcher watcher;
+  RunLoop run_loop;
+  int reads = 0;
+  watcher.set_on_read(BindLambdaForTesting([&]() {
+    // The byte is only consumed on the third notification.
+    if (++reads < 3)
+      return;
+    ReadFromPeer();
+    if (reads == 3) {
+      // Another byte must be notified even though the first was consumed.
+      WriteToPeer();
+      return;
+    }
+    controller.StopWatchingFileDescriptor();
+    run_loop.Quit();
+  }));
+  ASSERT_TRUE(pump_->WatchFileDescriptor(fd_.get(), true,
+                                         MessagePumpLibevent::WATCH_READ,
+                                         &controller, &watcher));
+  WriteToPeer();
+  run_loop.Run();
+  EXPECT_EQ(4, reads);
+}
+
+TEST_F(MessagePumpIoUringTest, NonPersistentWatch) {
+  MessagePumpLibevent::FdWatchController controller(FROM_HERE);
+  CallbackWatcher watcher;
+  int reads = 0;
+  watcher.set_on_read(BindLambdaForTesting([&]() { ++reads; }));
+  ASSERT_TRUE(pump_->WatchFileDescriptor(fd_.get(), false,
+                                         MessagePumpLibevent::WATCH_READ,
+                                         &controller, &watcher));
+  WriteToPeer();
+  RunLoop().RunUntilIdle();
+  RunLoop().RunUntilIdle();
+  EXPECT_EQ(1, reads);
+}
+
+TEST_F(MessagePumpIoUringTest, StopWatching) {
+  MessagePumpLibevent::FdWatchController controller(FROM_HERE);
+  CallbackWatcher watcher;
+  ASSERT_TRUE(pump_->WatchFileDescriptor(fd_.get(), true,
+                                         MessagePumpLibevent::WATCH_READ_WRITE,
+                                         &controller, &watcher));
+  // The watch is removed before its request was even submitted.
+  EXPECT_TRUE(controller.StopWatchingFileDescriptor());
+  WriteToPeer();
+  RunLoop().RunUntilIdle();
+
+  // Now after it was submitted.
+  watcher.set_on_read(BindLambdaForTesting([&]() { ADD_FAILURE(); }));
+  ASSERT_TRUE(pump_->WatchFileDescriptor(fd_.get(), true,
+                                         MessagePumpLibevent::WATCH_READ,
+                                         &controller, &watcher));
+  ReadFromPeer();
+  RunLoop().RunUntilIdle();
+  EXPECT_TRUE(controller.StopWatchingFileDescriptor());
+  WriteToPeer();
+  RunLoop().RunUntilIdle();
+}
+
+// The write callback can delete the controller before the read callback runs.
+TEST_F(MessagePumpIoUringTest, DeleteControllerInCallback) {
+  auto controller =
+      std::make_unique<MessagePumpLibevent::FdWatchController>(FROM_HERE);
+  CallbackWatcher watcher;
+  RunLoop run_loop;
+  watcher.set_on_write(BindLambdaForTesting([&]() {
+    controller.reset();
+    run_loop.Quit();
+  }));
+  WriteToPeer();
+  ASSERT_TRUE(pump_->WatchFileDescriptor(fd_.get(), true,
+                                         MessagePumpLibevent::WATCH_READ_WRITE,
+                                         controller.get(), &watcher));
+  run_loop.Run();
+  RunLoop().RunUntilIdle();
+}
+
+// Watching again with the same controller combines the modes.
+TEST_F(MessagePumpIoUringTest, WatchAgain) {
+  MessagePumpLibevent::FdWatchController controller(FROM_HERE);
+  CallbackWatcher watcher;
+  RunLoop run_loop;
+  bool wrote = false;
+  watcher.set_on_write(BindLambdaForTesting([&]() {
+    if (!wrote) {
+      wrote = true;
+      WriteToPeer();
+    }
+  }));
+  watcher.set_on_read(BindLambdaForTesting([&]() {
+    EXPECT_TRUE(wrote);
+    run_loop.Quit();
+  }));
+  ASSERT_TRUE(pump_->WatchFileDescriptor(fd_.get(), false,
+                                         MessagePumpLibevent::WATCH_READ,
+                                         &controller, &watcher));
+  ASSERT_TRUE(pump_->WatchFileDescriptor(fd_.get(), true,
+                                         MessagePumpLibevent::WATCH_WRITE,
+                                         &controller, &watcher));
+  run_loop.Run();
+}
+
+// The controllers can outlive the pump, whether their request is in the ring
+// or completed.
+TEST_F(MessagePumpIoUringTest, DestroyPumpBeforeController) {
+  MessagePumpLibevent::FdWatchController polling_controller(FROM_HERE);
+  MessagePumpLibevent::FdWatchController completed_controller(FROM_HERE);
+  CallbackWatcher watcher;
+  RunLoop run_loop;
+  watcher.set_on_write(run_loop.QuitClosure());
+  ASSERT_TRUE(pump_->WatchFileDescriptor(fd_.get(), true,
+                                         MessagePumpLibevent::WATCH_READ,
+                                         &polling_controller, &watcher));
+  ASSERT_TRUE(pump_->WatchFileDescriptor(peer_fd_.get(), false,
+                                         MessagePumpLibevent::WATCH_WRITE,
+                                         &completed_controller, &watcher));
+  run_loop.Run();
+
+  pump_ = nullptr;
+  executor_.reset();
+  EXPECT_TRUE(polling_controller.StopWatchingFileDescriptor());
+  EXPECT_TRUE(completed_controller.StopWatchingFileDescriptor());
+}
+
+TEST_F(MessagePumpIoUringTest, DelayedTask) {
+  RunLoop run_loop;
+  const TimeTicks start = TimeTicks::Now();
+  ThreadTaskRunnerHandle::Get()->PostDelayedTask(
+      FROM_HERE, run_loop.QuitClosure(), Milliseconds(50));
+  run_loop.Run();
+  EXPECT_GE(TimeTicks::Now() - start, Milliseconds(50));
+}
+
+// A task delayed less than the one the pump waits for wakes it up earlier.
+TEST_F(MessagePumpIoUringTest, EarlierDelayedTask) {
+  RunLoop run_loop;
+  ThreadTaskRunnerHandle::Get()->PostDelayedTask(
+      FROM_HERE, MakeExpectedNotRunClosure(FROM_HERE), Hours(1));
+  ThreadTaskRunnerHandle::Get()->PostDelayedTask(
+      FROM_HERE, BindLambdaForTesting([&]() {
+        ThreadTaskRunnerHandle::Get()->PostDelayedTask(
+            FROM_HERE, run_loop.QuitClosure(),
+            Milliseconds(10));
+      }),
+      Milliseconds(10));
+  run_loop.Run();
+}
+
+TEST_F(MessagePumpIoUringTest, PostTaskFromOtherThread) {
+  Thread thread("MessagePumpIoUringTestThread");
+  ASSERT_TRUE(thread.Start());
+  constexpr int kNumTasks = 1000;
+  int tasks = 0;
+  RunLoop run_loop;
+  scoped_refptr<SingleThreadTaskRunner> task_runner =
+      ThreadTaskRunnerHandle::Get();
+  thread.task_runner()->PostTask(FROM_HERE, BindLambdaForTesting([&]() {
+                                   for (int i = 0; i < kNumTasks; ++i) {
+                                     task_runner->PostTask(
+                                         FROM_HERE,
+                                         BindLambdaForTesting([&]() {
+                                           if (++tasks == kNumTasks)
+                                             run_loop.Quit();
+                                         }));
+                                   }
+                                 }));
+  run_loop.Run();
+  EXPECT_EQ(kNumTasks, tasks);
+}
+
+}  // namespace base
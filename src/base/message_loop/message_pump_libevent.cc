@@ -7,11 +7,13 @@
 #include <errno.h>
 #include <unistd.h>
 
+#include <atomic>
 #include <memory>
 #include <utility>
 
 #include "base/auto_reset.h"
 #include "base/compiler_specific.h"
+#include "base/feature_list.h"
 #include "base/files/file_util.h"
 #include "base/logging.h"
 #include "base/notreached.h"
@@ -21,6 +23,11 @@
 #include "base/trace_event/base_tracing.h"
 #include "build/build_config.h"
 
+#if defined(OS_LINUX) || defined(OS_CHROMEOS)
+#include "base/message_loop/message_pump_epoll.h"
+#include "base/message_loop/message_pump_io_uring.h"
+#endif
+
 // Lifecycle of struct event
 // Libevent uses two main data structures:
 // struct event_base (of which there is one per message pump), and
@@ -34,6 +41,25 @@
 
 namespace base {
 
+namespace features {
+
+const Feature kMessagePumpEpoll{"MessagePumpEpoll",
+                                FEATURE_DISABLED_BY_DEFAULT};
+const Feature kMessagePumpIoUring{"MessagePumpIoUring",
+                                  FEATURE_DISABLED_BY_DEFAULT};
+
+}  // namespace features
+
+namespace {
+
+// The backend of the pumps created by the default constructor. Set by
+// InitializeFeatures(), since the FeatureList may not exist when the first
+// pumps are created.
+std::atomic<MessagePumpLibevent::Backend> g_default_backend{
+    MessagePumpLibevent::Backend::kLibevent};
+
+}  // namespace
+
 MessagePumpLibevent::FdWatchController::FdWatchController(
     const Location& from_here)
     : FdWatchControllerInterface(from_here) {}
@@ -42,6 +68,10 @@ MessagePumpLibevent::FdWatchController::~FdWatchController() {
   if (event_) {
     CHECK(StopWatchingFileDescriptor());
   }
+#if defined(OS_LINUX) || defined(OS_CHROMEOS)
+  if (epoll_interest_ || io_uring_interest_)
+    StopWatchingFileDescriptor();
+#endif
   if (was_destroyed_) {
     DCHECK(!*was_destroyed_);
     *was_destroyed_ = true;
@@ -49,6 +79,20 @@ MessagePumpLibevent::FdWatchController::~FdWatchController() {
 }
 
 bool MessagePumpLibevent::FdWatchController::StopWatchingFileDescriptor() {
+#if defined(OS_LINUX) || defined(OS_CHROMEOS)
+  if (epoll_interest_ || io_uring_interest_) {
+    if (weak_pump_)
+      weak_pump_->backend_pump_->StopWatching(this);
+    // The interests are only left if the pump was destroyed.
+    epoll_interest_ = nullptr;
+    io_uring_interest_ = nullptr;
+    weak_pump_ = nullptr;
+    pump_ = nullptr;
+    watcher_ = nullptr;
+    return true;
+  }
+#endif
+
   std::unique_ptr<event> e = ReleaseEvent();
   if (!e)
     return true;
@@ -88,7 +132,21 @@ void MessagePumpLibevent::FdWatchController::OnFileCanWriteWithoutBlocking(
   watcher_->OnFileCanWriteWithoutBlocking(fd);
 }
 
-MessagePumpLibevent::MessagePumpLibevent() : event_base_(event_base_new()) {
+MessagePumpLibevent::MessagePumpLibevent()
+    : MessagePumpLibevent(g_default_backend.load(std::memory_order_relaxed)) {}
+
+MessagePumpLibevent::MessagePumpLibevent(Backend backend) {
+#if defined(OS_LINUX) || defined(OS_CHROMEOS)
+  if (backend == Backend::kEpoll)
+    backend_pump_ = MessagePumpEpoll::Create();
+  else if (backend == Backend::kIoUring)
+    backend_pump_ = MessagePumpIoUring::Create();
+  if (backend_pump_) {
+    backend_ = backend;
+    return;
+  }
+#endif
+  event_base_ = event_base_new();
   if (!Init())
     NOTREACHED();
   DCHECK_NE(wakeup_pipe_in_, -1);
@@ -97,6 +155,9 @@ MessagePumpLibevent::MessagePumpLibevent() : event_base_(event_base_new()) {
 }
 
 MessagePumpLibevent::~MessagePumpLibevent() {
+  // The libevent state is only created for Backend::kLibevent.
+  if (backend_ != Backend::kLibevent)
+    return;
   DCHECK(wakeup_event_);
   DCHECK(event_base_);
   event_del(wakeup_event_);
@@ -112,6 +173,20 @@ MessagePumpLibevent::~MessagePumpLibevent() {
   event_base_free(event_base_);
 }
 
+// static
+void MessagePumpLibevent::InitializeFeatures() {
+  Backend backend = Backend::kLibevent;
+  if (FeatureList::IsEnabled(features::kMessagePumpIoUring))
+    backend = Backend::kIoUring;
+  else if (FeatureList::IsEnabled(features::kMessagePumpEpoll))
+    backend = Backend::kEpoll;
+  g_default_backend.store(backend, std::memory_order_relaxed);
+}
+
+MessagePumpLibevent::Backend MessagePumpLibevent::backend() const {
+  return backend_;
+}
+
 bool MessagePumpLibevent::WatchFileDescriptor(int fd,
                                               bool persistent,
                                               int mode,
@@ -125,6 +200,18 @@ bool MessagePumpLibevent::WatchFileDescriptor(int fd,
   // threadsafe, and your watcher may never be registered.
   DCHECK(watch_file_descriptor_caller_checker_.CalledOnValidThread());
 
+#if defined(OS_LINUX) || defined(OS_CHROMEOS)
+  if (backend_pump_) {
+    if (!backend_pump_->WatchFileDescriptor(fd, persistent, mode, controller,
+                                            delegate)) {
+      return false;
+    }
+    controller->set_pump(this);
+    controller->weak_pump_ = weak_factory_.GetWeakPtr();
+    return true;
+  }
+#endif
+
   int event_mask = persistent ? EV_PERSIST : 0;
   if (mode & WATCH_READ) {
     event_mask |= EV_READ;
@@ -183,6 +270,13 @@ static void timer_callback(int fd, short events, void* context) {
 
 // Reentrant!
 void MessagePumpLibevent::Run(Delegate* delegate) {
+#if defined(OS_LINUX) || defined(OS_CHROMEOS)
+  if (backend_pump_) {
+    backend_pump_->Run(delegate);
+    return;
+  }
+#endif
+
   RunState run_state(delegate);
   AutoReset<RunState*> auto_reset_run_state(&run_state_, &run_state);
 
@@ -257,6 +351,12 @@ void MessagePumpLibevent::Run(Delegate* delegate) {
 }
 
 void MessagePumpLibevent::Quit() {
+#if defined(OS_LINUX) || defined(OS_CHROMEOS)
+  if (backend_pump_) {
+    backend_pump_->Quit();
+    return;
+  }
+#endif
   DCHECK(run_state_) << "Quit was called outside of Run!";
   // Tell both libevent and Run that they should break out of their loops.
   run_state_->should_quit = true;
@@ -264,6 +364,12 @@ void MessagePumpLibevent::Quit() {
 }
 
 void MessagePumpLibevent::ScheduleWork() {
+#if defined(OS_LINUX) || defined(OS_CHROMEOS)
+  if (backend_pump_) {
+    backend_pump_->ScheduleWork();
+    return;
+  }
+#endif
   // Tell libevent (in a threadsafe way) that it should break out of its loop.
   char buf = 0;
   int nwrite = HANDLE_EINTR(write(wakeup_pipe_in_, &buf, 1));
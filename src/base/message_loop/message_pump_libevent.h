@@ -7,11 +7,15 @@
 
 #include <memory>
 
+#include "base/base_export.h"
 #include "base/compiler_specific.h"
 #include "base/macros.h"
+#include "base/memory/scoped_refptr.h"
+#include "base/memory/weak_ptr.h"
 #include "base/message_loop/message_pump.h"
 #include "base/message_loop/watchable_io_message_pump_posix.h"
 #include "base/threading/thread_checker.h"
+#include "build/build_config.h"
 
 // Declare structs we need from libevent.h rather than including it
 struct event_base;
@@ -19,6 +23,25 @@ struct event;
 
 namespace base {
 
+struct Feature;
+
+#if defined(OS_LINUX) || defined(OS_CHROMEOS)
+class EpollInterest;
+class IoUringInterest;
+class MessagePumpEpoll;
+class MessagePumpIoUring;
+#endif
+
+namespace features {
+
+// Run the pumps on epoll, or io_uring where supported, instead of libevent.
+// Read by MessagePumpLibevent::InitializeFeatures(). io_uring takes precedence
+// if both are enabled.
+BASE_EXPORT extern const Feature kMessagePumpEpoll;
+BASE_EXPORT extern const Feature kMessagePumpIoUring;
+
+}  // namespace features
+
 // Class to monitor sockets and issue callbacks when sockets are ready for I/O
 // TODO(dkegel): add support for background file IO somehow
 class BASE_EXPORT MessagePumpLibevent : public MessagePump,
@@ -40,6 +63,10 @@ class BASE_EXPORT MessagePumpLibevent : public MessagePump,
    private:
     friend class MessagePumpLibevent;
     friend class MessagePumpLibeventTest;
+#if defined(OS_LINUX) || defined(OS_CHROMEOS)
+    friend class MessagePumpEpoll;
+    friend class MessagePumpIoUring;
+#endif
 
     // Called by MessagePumpLibevent.
     void Init(std::unique_ptr<event> e);
@@ -56,6 +83,14 @@ class BASE_EXPORT MessagePumpLibevent : public MessagePump,
     void OnFileCanWriteWithoutBlocking(int fd, MessagePumpLibevent* pump);
 
     std::unique_ptr<event> event_;
+#if defined(OS_LINUX) || defined(OS_CHROMEOS)
+    // The registration with the epoll or io_uring backend, instead of
+    // |event_|.
+    scoped_refptr<EpollInterest> epoll_interest_;
+    scoped_refptr<IoUringInterest> io_uring_interest_;
+    // Unlike libevent, the backends may be destroyed before the controller.
+    WeakPtr<MessagePumpLibevent> weak_pump_;
+#endif
     MessagePumpLibevent* pump_ = nullptr;
     FdWatcher* watcher_ = nullptr;
     // If this pointer is non-NULL, the pointee is set to true in the
@@ -63,13 +98,50 @@ class BASE_EXPORT MessagePumpLibevent : public MessagePump,
     bool* was_destroyed_ = nullptr;
   };
 
+  // The implementation of the pump.
+  enum class Backend {
+    kLibevent,
+    // See MessagePumpEpoll.
+    kEpoll,
+    // Linux 5.6 and later. See MessagePumpIoUring.
+    kIoUring,
+  };
+
+#if defined(OS_LINUX) || defined(OS_CHROMEOS)
+  // A pump which MessagePumpLibevent delegates to instead of libevent.
+  class BackendPump : public MessagePump {
+   public:
+    // Like MessagePumpLibevent::WatchFileDescriptor().
+    virtual bool WatchFileDescriptor(int fd,
+                                     bool persistent,
+                                     int mode,
+                                     FdWatchController* controller,
+                                     FdWatcher* delegate) = 0;
+
+    // Removes the watch of |controller|, if any.
+    virtual void StopWatching(FdWatchController* controller) = 0;
+  };
+#endif
+
+  // Uses the backend selected by the features, or libevent if
+  // InitializeFeatures() wasn't called.
   MessagePumpLibevent();
+  // Uses |backend|, or libevent if it isn't supported.
+  explicit MessagePumpLibevent(Backend backend);
 
   MessagePumpLibevent(const MessagePumpLibevent&) = delete;
   MessagePumpLibevent& operator=(const MessagePumpLibevent&) = delete;
 
   ~MessagePumpLibevent() override;
 
+  // Selects the backend of the pumps created afterwards, once the FeatureList
+  // is initialized. Called by ThreadPoolImpl::Start() on Linux and ChromeOS,
+  // the only platforms with other backends; embedders which don't start the
+  // ThreadPool must call it themselves.
+  static void InitializeFeatures();
+
+  Backend backend() const;
+
   bool WatchFileDescriptor(int fd,
                            bool persistent,
                            int mode,
@@ -110,9 +182,12 @@ class BASE_EXPORT MessagePumpLibevent : public MessagePump,
   // This flag is set if libevent has processed I/O events.
   bool processed_io_events_ = false;
 
+  Backend backend_ = Backend::kLibevent;
+
   // Libevent dispatcher.  Watches all sockets registered with it, and sends
-  // readiness callbacks when a socket is ready for I/O.
-  event_base* const event_base_;
+  // readiness callbacks when a socket is ready for I/O. Null, like the wakeup
+  // pipe and event, if the pump delegates to another backend.
+  event_base* event_base_ = nullptr;
 
   // ... write end; ScheduleWork() writes a single byte to it
   int wakeup_pipe_in_ = -1;
@@ -122,6 +197,13 @@ class BASE_EXPORT MessagePumpLibevent : public MessagePump,
   event* wakeup_event_ = nullptr;
 
   ThreadChecker watch_file_descriptor_caller_checker_;
+
+#if defined(OS_LINUX) || defined(OS_CHROMEOS)
+  // The pump of |backend_|, if not libevent.
+  std::unique_ptr<BackendPump> backend_pump_;
+
+  WeakPtrFactory<MessagePumpLibevent> weak_factory_{this};
+#endif
 };
 
 }  // namespace base
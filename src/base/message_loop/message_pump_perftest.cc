@@ -29,6 +29,18 @@
 #include "base/android/java_handler_thread.h"
 #endif
 
+#if defined(OS_LINUX) || defined(OS_CHROMEOS)
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "base/files/scoped_file.h"
+#include "base/message_loop/message_pump_libevent.h"
+#include "base/posix/eintr_wrapper.h"
+#include "base/run_loop.h"
+#include "base/task/single_thread_task_executor.h"
+#endif
+
 namespace base {
 namespace {
 
@@ -265,4 +277,149 @@ TEST_F(ScheduleWorkTest, ThreadTimeToJavaFromFourThreads) {
 }
 #endif
 
+#if defined(OS_LINUX) || defined(OS_CHROMEOS)
+namespace {
+
+constexpr char kMetricPrefixWatchFileDescriptor[] = "WatchFileDescriptor.";
+constexpr char kMetricEventRate[] = "event_rate";
+
+}  // namespace
+
+// Passes tokens between many sockets watched by a MessagePumpLibevent with a
+// given backend: each socket made readable by a token is read, and the token
+// is written to the peer of another socket. The watches are either persistent,
+// or renewed after each notification.
+class WatchFileDescriptorPerfTest : public testing::TestWithParam<bool> {
+ public:
+  void RunPingPong(MessagePumpLibevent::Backend backend,
+                   const std::string& story_name) {
+    auto pump = std::make_unique<MessagePumpLibevent>(backend);
+    if (pump->backend() != backend)
+      GTEST_SKIP() << "The backend is not supported";
+    pump_ = pump.get();
+    SingleThreadTaskExecutor executor(std::move(pump));
+
+    // Two descriptors per socket pair, and some for the pump and the test.
+    rlimit limit;
+    ASSERT_EQ(0, getrlimit(RLIMIT_NOFILE, &limit));
+    const rlim_t needed = 2 * kNumSockets + 256;
+    if (limit.rlim_cur < needed && limit.rlim_max >= needed) {
+      limit.rlim_cur = needed;
+      setrlimit(RLIMIT_NOFILE, &limit);
+      ASSERT_EQ(0, getrlimit(RLIMIT_NOFILE, &limit));
+    }
+    if (limit.rlim_cur < needed)
+      GTEST_SKIP() << "Not enough file descriptors";
+
+    sockets_.resize(kNumSockets);
+    peers_.resize(kNumSockets);
+    controllers_.clear();
+    watchers_.clear();
+    for (int i = 0; i < kNumSockets; ++i) {
+      int fds[2];
+      ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+      sockets_[i].reset(fds[0]);
+      peers_[i].reset(fds[1]);
+      controllers_.push_back(
+          std::make_unique<MessagePumpLibevent::FdWatchController>(FROM_HERE));
+      watchers_.push_back(std::make_unique<SocketWatcher>(this, i));
+      ASSERT_TRUE(Watch(i));
+    }
+
+    RunLoop run_loop;
+    quit_closure_ = run_loop.QuitClosure();
+    num_events_ = 0;
+    const TimeTicks start = TimeTicks::Now();
+    for (int i = 0; i < kNumTokens; ++i)
+      SendToken(i * (kNumSockets / kNumTokens));
+    run_loop.Run();
+    const TimeDelta elapsed = TimeTicks::Now() - start;
+
+    controllers_.clear();
+    watchers_.clear();
+    sockets_.clear();
+    peers_.clear();
+
+    perf_test::PerfResultReporter reporter(
+        kMetricPrefixWatchFileDescriptor,
+        StringPrintf("%s_%s_%d_sockets", story_name.c_str(),
+                     persistent() ? "persistent" : "oneshot", kNumSockets));
+    reporter.RegisterImportantMetric(kMetricEventRate, "events/s");
+    reporter.AddResult(kMetricEventRate, kNumEvents / elapsed.InSecondsF());
+  }
+
+ private:
+  class SocketWatcher : public MessagePumpLibevent::FdWatcher {
+   public:
+    SocketWatcher(WatchFileDescriptorPerfTest* test, int index)
+        : test_(test), index_(index) {}
+
+    // MessagePumpLibevent::FdWatcher:
+    void OnFileCanReadWithoutBlocking(int fd) override {
+      test_->OnReadable(index_);
+    }
+    void OnFileCanWriteWithoutBlocking(int fd) override {}
+
+   private:
+    WatchFileDescriptorPerfTest* const test_;
+    const int index_;
+  };
+
+  bool persistent() const { return GetParam(); }
+
+  bool Watch(int index) {
+    return pump_->WatchFileDescriptor(
+        sockets_[index].get(), persistent(), MessagePumpLibevent::WATCH_READ,
+        controllers_[index].get(), watchers_[index].get());
+  }
+
+  void SendToken(int index) {
+    const char token = 0;
+    CHECK_EQ(1, HANDLE_EINTR(write(peers_[index].get(), &token, 1)));
+  }
+
+  void OnReadable(int index) {
+    char token;
+    CHECK_EQ(1, HANDLE_EINTR(read(sockets_[index].get(), &token, 1)));
+    if (!persistent())
+      CHECK(Watch(index));
+    if (++num_events_ == kNumEvents) {
+      std::move(quit_closure_).Run();
+      return;
+    }
+    if (num_events_ < kNumEvents)
+      SendToken((index * 7919 + 1) % kNumSockets);
+  }
+
+  static constexpr int kNumSockets = 10000;
+  static constexpr int kNumTokens = 100;
+  static constexpr int kNumEvents = 1000000;
+
+  MessagePumpLibevent* pump_ = nullptr;
+  std::vector<ScopedFD> sockets_;
+  std::vector<ScopedFD> peers_;
+  std::vector<std::unique_ptr<MessagePumpLibevent::FdWatchController>>
+      controllers_;
+  std::vector<std::unique_ptr<SocketWatcher>> watchers_;
+  OnceClosure quit_closure_;
+  int num_events_ = 0;
+};
+
+TEST_P(WatchFileDescriptorPerfTest, Libevent) {
+  RunPingPong(MessagePumpLibevent::Backend::kLibevent, "libevent");
+}
+
+TEST_P(WatchFileDescriptorPerfTest, Epoll) {
+  RunPingPong(MessagePumpLibevent::Backend::kEpoll, "epoll");
+}
+
+TEST_P(WatchFileDescriptorPerfTest, IoUring) {
+  RunPingPong(MessagePumpLibevent::Backend::kIoUring, "io_uring");
+}
+
+INSTANTIATE_TEST_SUITE_P(PersistentOrNot,
+                         WatchFileDescriptorPerfTest,
+                         testing::Bool());
+#endif  // defined(OS_LINUX) || defined(OS_CHROMEOS)
+
 }  // namespace base
@@ -16,9 +16,20 @@ BASE_EXPORT extern const uint32_t kCrcTable[256];
 
 // This provides a simple, fast CRC-32 calculation that can be used for checking
 // the integrity of data.  It is not a "secure" calculation!  |sum| can start
-// with any seed or be used to continue an operation began with previous data.
+// with any seed or be used to continue an operation began with previous data:
+// Crc32(Crc32(sum, a, a_size), b, b_size) is the checksum of |a| followed by
+// |b|. On x86-64 CPUs with PCLMULQDQ, large inputs are folded with carry-less
+// multiplications, which give the same results as the table.
 BASE_EXPORT uint32_t Crc32(uint32_t sum, const void* data, size_t size);
 
+namespace internal {
+
+// The table-driven implementation of Crc32(), which processes a byte at a
+// time. Exposed for tests and benchmarks.
+BASE_EXPORT uint32_t Crc32Portable(uint32_t sum, const void* data, size_t size);
+
+}  // namespace internal
+
 }  // namespace base
 
 #endif  // BASE_METRICS_CRC32_H_
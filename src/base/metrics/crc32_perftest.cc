@@ -0,0 +1,79 @@
+// Copyright 2021 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "base/metrics/crc32.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "base/rand_util.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/timer/elapsed_timer.h"
+#include "testing/gtest/include/gtest/gtest.h"
+#include "testing/perf/perf_result_reporter.h"
+
+// This file measures the throughput of Crc32(), which uses carry-less
+// multiplications when the CPU supports them, and of the table-driven
+// implementation, on buffers from 64 B to 64 MiB.
+
+namespace base {
+
+namespace {
+
+constexpr char kMetricPrefixCrc32[] = "Crc32.";
+constexpr char kMetricThroughput[] = "throughput";
+constexpr size_t kMinSize = 64;
+constexpr size_t kMaxSize = 64 << 20;  // 64 MiB
+// Each size is checksummed repeatedly, up to this many bytes in total.
+constexpr size_t kBytesPerSize = 64 << 20;  // 64 MiB
+
+perf_test::PerfResultReporter SetUpReporter(const std::string& story_name) {
+  perf_test::PerfResultReporter reporter(kMetricPrefixCrc32, story_name);
+  reporter.RegisterImportantMetric(kMetricThroughput, "GB/s");
+  return reporter;
+}
+
+std::string SizeToString(size_t size) {
+  if (size >= (1 << 20))
+    return NumberToString(size >> 20) + "MiB";
+  if (size >= (1 << 10))
+    return NumberToString(size >> 10) + "KiB";
+  return NumberToString(size) + "B";
+}
+
+void RunThroughputTest(const std::string& name,
+                       uint32_t (*crc32)(uint32_t, const void*, size_t)) {
+  std::vector<uint8_t> data(kMaxSize);
+  RandBytes(data.data(), data.size());
+
+  for (size_t size = kMinSize; size <= kMaxSize; size *= 4) {
+    const size_t iterations = kBytesPerSize / size;
+    uint32_t sum = 0;
+    ElapsedTimer timer;
+    for (size_t i = 0; i < iterations; ++i)
+      sum = crc32(sum, data.data(), size);
+    const TimeDelta elapsed = timer.Elapsed();
+    // Keeps the checksums from being optimized away.
+    EXPECT_NE(0u, sum);
+
+    auto reporter = SetUpReporter(name + "_" + SizeToString(size));
+    reporter.AddResult(kMetricThroughput,
+                       double{kBytesPerSize} / elapsed.InNanoseconds());
+  }
+}
+
+}  // namespace
+
+TEST(Crc32PerfTest, Throughput) {
+  RunThroughputTest("Crc32", &Crc32);
+}
+
+TEST(Crc32PerfTest, ThroughputPortable) {
+  RunThroughputTest("Portable", &internal::Crc32Portable);
+}
+
+}  // namespace base
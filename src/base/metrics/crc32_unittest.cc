@@ -6,6 +6,10 @@
 
 #include <stdint.h>
 
+#include <algorithm>
+#include <vector>
+
+#include "base/rand_util.h"
 #include "testing/gtest/include/gtest/gtest.h"
 
 namespace base {
@@ -31,4 +35,47 @@ TEST(Crc32Test, ZeroTest) {
   EXPECT_EQ(0U, Crc32(0, nullptr, 0));
 }
 
+// The standard CRC-32 check value, which inverts the checksum before and after.
+TEST(Crc32Test, CheckValue) {
+  const char kData[] = "123456789";
+  EXPECT_EQ(0xCBF43926U, ~Crc32(~0U, kData, sizeof(kData) - 1));
+  EXPECT_EQ(0xCBF43926U,
+            ~internal::Crc32Portable(~0U, kData, sizeof(kData) - 1));
+}
+
+// Crc32() may use a different implementation depending on the CPU and the
+// size of the data, which must match the table for all sizes and alignments.
+TEST(Crc32Test, MatchesPortable) {
+  std::vector<uint8_t> data(64 * 1024 + 64);
+  RandBytes(data.data(), data.size());
+  for (size_t offset = 0; offset < 16; ++offset) {
+    for (size_t size = 0; size <= 1024; ++size) {
+      const uint32_t seed = static_cast<uint32_t>(size * 0x9E3779B9);
+      EXPECT_EQ(internal::Crc32Portable(seed, &data[offset], size),
+                Crc32(seed, &data[offset], size))
+          << "offset=" << offset << " size=" << size;
+    }
+    const size_t size = data.size() - offset;
+    EXPECT_EQ(internal::Crc32Portable(0, &data[offset], size),
+              Crc32(0, &data[offset], size));
+  }
+}
+
+// Checksumming data in pieces gives the checksum of the whole.
+TEST(Crc32Test, Incremental) {
+  std::vector<uint8_t> data(4096);
+  RandBytes(data.data(), data.size());
+  const uint32_t expected = Crc32(~0U, data.data(), data.size());
+  for (size_t split = 0; split <= data.size(); split += 7) {
+    uint32_t sum = Crc32(~0U, data.data(), split);
+    sum = Crc32(sum, &data[split], data.size() - split);
+    EXPECT_EQ(expected, sum) << "split=" << split;
+  }
+
+  uint32_t sum = ~0U;
+  for (size_t i = 0; i < data.size(); i += 100)
+    sum = Crc32(sum, &data[i], std::min<size_t>(100, data.size() - i));
+  EXPECT_EQ(expected, sum);
+}
+
 }  // namespace base
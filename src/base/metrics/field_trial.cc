@@ -13,6 +13,7 @@
 #include "base/debug/activity_tracker.h"
 #include "base/logging.h"
 #include "base/metrics/field_trial_param_associator.h"
+#include "base/metrics/field_trial_snapshot.h"
 #include "base/metrics/histogram_macros.h"
 #include "base/process/memory.h"
 #include "base/process/process_handle.h"
@@ -893,6 +894,58 @@ void FieldTrialList::CopyFieldTrialStateToFlags(
     cmd_line->AppendSwitchASCII(disable_features_switch, disabled_features);
 }
 
+// static
+ReadOnlySharedMemoryRegion FieldTrialList::CreateFieldTrialSnapshot() {
+  FieldTrialSnapshot::Builder builder;
+  if (global_) {
+    AutoLock auto_lock(global_->lock_);
+    for (const auto& registered : global_->registered_) {
+      FieldTrial::State trial_state;
+      if (!registered.second->GetStateWhileLocked(&trial_state, false))
+        continue;
+      FieldTrialParams params;
+      FieldTrialParamAssociator::GetInstance()
+          ->GetFieldTrialParamsWithoutFallback(
+              *trial_state.trial_name, *trial_state.group_name, &params);
+      builder.AddTrial(*trial_state.trial_name, *trial_state.group_name,
+                       trial_state.activated, params);
+    }
+  }
+  return builder.BuildRegion();
+}
+
+// static
+bool FieldTrialList::CreateTrialsFromSnapshot(
+    const ReadOnlySharedMemoryRegion& region) {
+  if (!global_)
+    return false;
+  std::unique_ptr<const FieldTrialSnapshot> snapshot =
+      FieldTrialSnapshot::Map(region);
+  if (!snapshot)
+    return false;
+
+  // Install the snapshot first, so that observers notified of activations
+  // below can already look up params.
+  const FieldTrialSnapshot* trials = snapshot.get();
+  {
+    AutoLock auto_lock(global_->lock_);
+    DCHECK(!global_->field_trial_snapshot_);
+    global_->field_trial_snapshot_ = std::move(snapshot);
+  }
+
+  for (size_t i = 0; i < trials->trial_count(); ++i) {
+    const FieldTrialSnapshot::Trial snapshot_trial = trials->GetTrialAt(i);
+    FieldTrial* trial = CreateFieldTrial(snapshot_trial.trial_name(),
+                                         snapshot_trial.group_name());
+    if (!trial)
+      return false;
+    // Like for the allocator, report activations to the observers.
+    if (snapshot_trial.activated())
+      trial->group();
+  }
+  return true;
+}
+
 // static
 FieldTrial* FieldTrialList::CreateFieldTrial(StringPiece name,
                                              StringPiece group_name) {
@@ -1012,6 +1065,16 @@ bool FieldTrialList::GetParamsFromSharedMemory(
   //   allocator should get set up very early in the lifecycle. Try to see if
   //   you can call it after it's been set up.
   AutoLock auto_lock(global_->lock_);
+  if (global_->field_trial_snapshot_) {
+    absl::optional<FieldTrialSnapshot::Trial> snapshot_trial =
+        global_->field_trial_snapshot_->FindTrial(field_trial->trial_name());
+    if (snapshot_trial &&
+        snapshot_trial->group_name() == field_trial->group_name_internal()) {
+      snapshot_trial->GetParams(params);
+      return true;
+    }
+  }
+
   if (!global_->field_trial_allocator_)
     return false;
 
@@ -1032,6 +1095,38 @@ bool FieldTrialList::GetParamsFromSharedMemory(
   return entry->GetParams(params);
 }
 
+// static
+bool FieldTrialList::GetParamValueFromSharedMemory(FieldTrial* field_trial,
+                                                   StringPiece param_name,
+                                                   std::string* value) {
+  DCHECK(global_);
+  {
+    AutoLock auto_lock(global_->lock_);
+    if (global_->field_trial_snapshot_) {
+      absl::optional<FieldTrialSnapshot::Trial> snapshot_trial =
+          global_->field_trial_snapshot_->FindTrial(field_trial->trial_name());
+      if (snapshot_trial &&
+          snapshot_trial->group_name() == field_trial->group_name_internal()) {
+        StringPiece snapshot_value;
+        if (!snapshot_trial->GetParam(param_name, &snapshot_value))
+          return false;
+        *value = std::string(snapshot_value);
+        return true;
+      }
+    }
+  }
+
+  // Entries in the allocator have to be decoded in full.
+  std::map<std::string, std::string> params;
+  if (!GetParamsFromSharedMemory(field_trial, &params))
+    return false;
+  auto it = params.find(std::string(param_name));
+  if (it == params.end())
+    return false;
+  *value = it->second;
+  return true;
+}
+
 // static
 void FieldTrialList::ClearParamsFromSharedMemoryForTesting() {
   if (!global_)
@@ -87,6 +87,7 @@
 namespace base {
 
 class FieldTrialList;
+class FieldTrialSnapshot;
 
 class BASE_EXPORT FieldTrial : public RefCounted<FieldTrial> {
  public:
@@ -600,6 +601,22 @@ class BASE_EXPORT FieldTrialList {
                                          const char* disable_features_switch,
                                          CommandLine* cmd_line);
 
+  // Encodes all the field trials that aren't disabled, along with their params,
+  // in a FieldTrialSnapshot in a new read-only shared memory region. A child
+  // process can pass it to CreateTrialsFromSnapshot() to query the params in
+  // place rather than decoding them from the field trial allocator. The
+  // snapshot doesn't follow later changes to the trials, such as activations.
+  // Returns an invalid region on failure.
+  static ReadOnlySharedMemoryRegion CreateFieldTrialSnapshot();
+
+  // Maps |region|, as created by CreateFieldTrialSnapshot() in the parent
+  // process, and creates the field trials it contains, activating those that
+  // were active. Their params are then looked up in the mapped snapshot.
+  // Returns false if |region| isn't a valid snapshot or one of its trials
+  // conflicts with an existing one.
+  static bool CreateTrialsFromSnapshot(
+      const ReadOnlySharedMemoryRegion& region);
+
   // Create a FieldTrial with the given |name| and using 100% probability for
   // the FieldTrial, force FieldTrial to have the same group string as
   // |group_name|. This is commonly used in a non-browser process, to carry
@@ -637,6 +654,14 @@ class BASE_EXPORT FieldTrialList {
       FieldTrial* field_trial,
       std::map<std::string, std::string>* params);
 
+  // Gets the value of the param |param_name| of |field_trial| from shared
+  // memory and stores it in |value|. Unlike GetParamsFromSharedMemory(), it
+  // doesn't copy the other params when the trial comes from a snapshot. This
+  // is only exposed for use by FieldTrialParamAssociator.
+  static bool GetParamValueFromSharedMemory(FieldTrial* field_trial,
+                                            StringPiece param_name,
+                                            std::string* value);
+
   // Clears all the params in the allocator.
   static void ClearParamsFromSharedMemoryForTesting();
 
@@ -783,6 +808,11 @@ class BASE_EXPORT FieldTrialList {
   // to start passing more data other than field trials.
   std::unique_ptr<FieldTrialAllocator> field_trial_allocator_;
 
+  // Snapshot set by CreateTrialsFromSnapshot(), used to look up the params of
+  // the trials it created.
+  std::unique_ptr<const FieldTrialSnapshot> field_trial_snapshot_
+      GUARDED_BY(lock_);
+
   // Readonly copy of the region to the allocator. Needs to be a member variable
   // because it's needed from both CopyFieldTrialStateToFlags() and
   // AppendFieldTrialHandleIfNeeded().
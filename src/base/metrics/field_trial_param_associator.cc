@@ -54,6 +54,32 @@ bool FieldTrialParamAssociator::GetFieldTrialParams(FieldTrial* field_trial,
   return FieldTrialList::GetParamsFromSharedMemory(field_trial, params);
 }
 
+bool FieldTrialParamAssociator::GetFieldTrialParamValue(
+    FieldTrial* field_trial,
+    const std::string& param_name,
+    std::string* value) {
+  if (!field_trial)
+    return false;
+  // Get the group name before taking the lock, since it may activate the trial
+  // and notify observers.
+  const std::string& group_name = field_trial->group_name();
+  {
+    AutoLock scoped_lock(lock_);
+    const FieldTrialRefKey key(field_trial->trial_name(), group_name);
+    auto it = field_trial_params_.find(key);
+    if (it != field_trial_params_.end()) {
+      auto param = it->second.find(param_name);
+      if (param == it->second.end())
+        return false;
+      *value = param->second;
+      return true;
+    }
+  }
+
+  return FieldTrialList::GetParamValueFromSharedMemory(field_trial, param_name,
+                                                       value);
+}
+
 bool FieldTrialParamAssociator::GetFieldTrialParamsWithoutFallback(
     const std::string& trial_name,
     const std::string& group_name,
@@ -42,6 +42,14 @@ class BASE_EXPORT FieldTrialParamAssociator {
   // false if no params are available or the passed |field_trial| is null.
   bool GetFieldTrialParams(FieldTrial* field_trial, FieldTrialParams* params);
 
+  // Gets the value of the parameter |param_name| for a field trial and its
+  // chosen group, without copying the other parameters. Falls back to shared
+  // memory like GetFieldTrialParams(). Returns false if the parameter isn't
+  // found or the passed |field_trial| is null.
+  bool GetFieldTrialParamValue(FieldTrial* field_trial,
+                               const std::string& param_name,
+                               std::string* value);
+
   // Gets the parameters for a field trial and its chosen group. Does not
   // fallback to looking it up in shared memory. This should only be used if you
   // know for sure the params are in the mapping, like if you're in the browser
@@ -0,0 +1,376 @@
+// Copyright 2021 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "base/metrics/field_trial_snapshot.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <map>
+#include <utility>
+
+#include "base/check_op.h"
+#include "base/hash/hash.h"
+#include "base/memory/ptr_util.h"
+#include "base/numerics/checked_math.h"
+#include "base/numerics/safe_conversions.h"
+
+namespace base {
+
+struct FieldTrialSnapshot::Header {
+  // Increment kVersion if the layout changes!
+  static constexpr uint32_t kMagic = 0x46545331;  // "FTS1"
+  static constexpr uint32_t kVersion = 1;
+
+  uint32_t magic;
+  uint32_t version;
+  // Size of the whole snapshot, including this header.
+  uint32_t size;
+  uint32_t bucket_count;
+  uint32_t trial_count;
+  uint32_t param_count;
+  uint32_t strings_size;
+};
+
+struct FieldTrialSnapshot::TrialRecord {
+  // PersistentHash() of the name, to skip most string comparisons.
+  uint32_t name_hash;
+  uint32_t name_offset;
+  uint32_t name_length;
+  uint32_t group_offset;
+  uint32_t group_length;
+  // Index of the first param of the trial in the params array.
+  uint32_t first_param;
+  uint32_t param_count;
+  uint32_t activated;
+};
+
+struct FieldTrialSnapshot::ParamRecord {
+  uint32_t key_offset;
+  uint32_t key_length;
+  uint32_t value_offset;
+  uint32_t value_length;
+};
+
+namespace {
+
+uint32_t HashTrialName(StringPiece trial_name) {
+  return PersistentHash(as_bytes(make_span(trial_name)));
+}
+
+// Returns whether [offset, offset + length) is within [0, size).
+bool IsRangeValid(uint32_t offset, uint32_t length, uint32_t size) {
+  return length <= size && offset <= size - length;
+}
+
+// Appends the bytes of |value| to |data|.
+template <typename T>
+void Append(const T& value, std::vector<uint8_t>* data) {
+  const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+  data->insert(data->end(), bytes, bytes + sizeof(T));
+}
+
+}  // namespace
+
+FieldTrialSnapshot::Builder::Trial::Trial() = default;
+FieldTrialSnapshot::Builder::Trial::Trial(Trial&& other) = default;
+FieldTrialSnapshot::Builder::Trial& FieldTrialSnapshot::Builder::Trial::
+operator=(Trial&& other) = default;
+FieldTrialSnapshot::Builder::Trial::~Trial() = default;
+
+FieldTrialSnapshot::Builder::Builder() = default;
+
+FieldTrialSnapshot::Builder::~Builder() = default;
+
+void FieldTrialSnapshot::Builder::AddTrial(StringPiece trial_name,
+                                           StringPiece group_name,
+                                           bool activated,
+                                           const FieldTrialParams& params) {
+  Trial trial;
+  trial.trial_name = std::string(trial_name);
+  trial.group_name = std::string(group_name);
+  trial.activated = activated;
+  trial.params = params;
+  trials_.push_back(std::move(trial));
+}
+
+std::vector<uint8_t> FieldTrialSnapshot::Builder::Build() const {
+  std::vector<const Trial*> sorted_trials;
+  sorted_trials.reserve(trials_.size());
+  for (const Trial& trial : trials_)
+    sorted_trials.push_back(&trial);
+  std::sort(sorted_trials.begin(), sorted_trials.end(),
+            [](const Trial* a, const Trial* b) {
+              return a->trial_name < b->trial_name;
+            });
+
+  // Strings such as group names and param keys are often repeated, so each
+  // distinct one is only stored once.
+  std::string strings;
+  std::map<StringPiece, uint32_t> string_offsets;
+  auto add_string = [&strings, &string_offsets](StringPiece string) {
+    auto it = string_offsets.find(string);
+    if (it != string_offsets.end())
+      return it->second;
+    const uint32_t offset = checked_cast<uint32_t>(strings.size());
+    strings.append(string.data(), string.size());
+    string_offsets.emplace(string, offset);
+    return offset;
+  };
+
+  std::vector<TrialRecord> trial_records;
+  std::vector<ParamRecord> param_records;
+  trial_records.reserve(sorted_trials.size());
+  for (const Trial* trial : sorted_trials) {
+    DCHECK(trial_records.empty() ||
+           sorted_trials[trial_records.size() - 1]->trial_name !=
+               trial->trial_name)
+        << trial->trial_name;
+    TrialRecord record;
+    record.name_hash = HashTrialName(trial->trial_name);
+    record.name_offset = add_string(trial->trial_name);
+    record.name_length = checked_cast<uint32_t>(trial->trial_name.size());
+    record.group_offset = add_string(trial->group_name);
+    record.group_length = checked_cast<uint32_t>(trial->group_name.size());
+    record.first_param = checked_cast<uint32_t>(param_records.size());
+    record.param_count = checked_cast<uint32_t>(trial->params.size());
+    record.activated = trial->activated;
+    trial_records.push_back(record);
+
+    // FieldTrialParams is a std::map, so the keys are already sorted.
+    for (const auto& param : trial->params) {
+      ParamRecord param_record;
+      param_record.key_offset = add_string(param.first);
+      param_record.key_length = checked_cast<uint32_t>(param.first.size());
+      param_record.value_offset = add_string(param.second);
+      param_record.value_length = checked_cast<uint32_t>(param.second.size());
+      param_records.push_back(param_record);
+    }
+  }
+
+  // Keep the load factor of the hash table at or below one half, so that
+  // probes are short and there is always an empty bucket to end them.
+  uint32_t bucket_count = 4;
+  while (bucket_count < 2 * trial_records.size())
+    bucket_count *= 2;
+  std::vector<uint32_t> buckets(bucket_count, 0);
+  for (size_t i = 0; i < trial_records.size(); ++i) {
+    uint32_t slot = trial_records[i].name_hash & (bucket_count - 1);
+    while (buckets[slot])
+      slot = (slot + 1) & (bucket_count - 1);
+    buckets[slot] = checked_cast<uint32_t>(i + 1);
+  }
+
+  Header header;
+  header.magic = Header::kMagic;
+  header.version = Header::kVersion;
+  header.bucket_count = bucket_count;
+  header.trial_count = checked_cast<uint32_t>(trial_records.size());
+  header.param_count = checked_cast<uint32_t>(param_records.size());
+  header.strings_size = checked_cast<uint32_t>(strings.size());
+  header.size =
+      (CheckedNumeric<uint32_t>(sizeof(Header)) +
+       CheckedNumeric<uint32_t>(sizeof(uint32_t)) * header.bucket_count +
+       CheckedNumeric<uint32_t>(sizeof(TrialRecord)) * header.trial_count +
+       CheckedNumeric<uint32_t>(sizeof(ParamRecord)) * header.param_count +
+       header.strings_size)
+          .ValueOrDie();
+
+  std::vector<uint8_t> data;
+  data.reserve(header.size);
+  Append(header, &data);
+  for (uint32_t bucket : buckets)
+    Append(bucket, &data);
+  for (const TrialRecord& record : trial_records)
+    Append(record, &data);
+  for (const ParamRecord& record : param_records)
+    Append(record, &data);
+  data.insert(data.end(), strings.begin(), strings.end());
+  DCHECK_EQ(header.size, data.size());
+  return data;
+}
+
+ReadOnlySharedMemoryRegion FieldTrialSnapshot::Builder::BuildRegion() const {
+  std::vector<uint8_t> data = Build();
+  MappedReadOnlyRegion shm = ReadOnlySharedMemoryRegion::Create(data.size());
+  if (!shm.IsValid())
+    return ReadOnlySharedMemoryRegion();
+  memcpy(shm.mapping.memory(), data.data(), data.size());
+  return std::move(shm.region);
+}
+
+FieldTrialSnapshot::Trial::Trial(const FieldTrialSnapshot* snapshot,
+                                 const TrialRecord* record)
+    : snapshot_(snapshot), record_(record) {}
+
+StringPiece FieldTrialSnapshot::Trial::trial_name() const {
+  return snapshot_->GetString(record_->name_offset, record_->name_length);
+}
+
+StringPiece FieldTrialSnapshot::Trial::group_name() const {
+  return snapshot_->GetString(record_->group_offset, record_->group_length);
+}
+
+bool FieldTrialSnapshot::Trial::activated() const {
+  return record_->activated;
+}
+
+size_t FieldTrialSnapshot::Trial::param_count() const {
+  return record_->param_count;
+}
+
+bool FieldTrialSnapshot::Trial::GetParam(StringPiece param_name,
+                                         StringPiece* value) const {
+  const ParamRecord* begin = snapshot_->params_ + record_->first_param;
+  const ParamRecord* end = begin + record_->param_count;
+  const ParamRecord* it = std::lower_bound(
+      begin, end, param_name,
+      [this](const ParamRecord& record, StringPiece key) {
+        return snapshot_->GetString(record.key_offset, record.key_length) <
+               key;
+      });
+  if (it == end ||
+      snapshot_->GetString(it->key_offset, it->key_length) != param_name) {
+    return false;
+  }
+  *value = snapshot_->GetString(it->value_offset, it->value_length);
+  return true;
+}
+
+void FieldTrialSnapshot::Trial::GetParams(FieldTrialParams* params) const {
+  const ParamRecord* begin = snapshot_->params_ + record_->first_param;
+  for (const ParamRecord* it = begin; it != begin + record_->param_count;
+       ++it) {
+    (*params)[std::string(
+        snapshot_->GetString(it->key_offset, it->key_length))] =
+        std::string(snapshot_->GetString(it->value_offset, it->value_length));
+  }
+}
+
+FieldTrialSnapshot::FieldTrialSnapshot(ReadOnlySharedMemoryMapping mapping,
+                                       span<const uint8_t> data)
+    : mapping_(std::move(mapping)), data_(data) {}
+
+FieldTrialSnapshot::~FieldTrialSnapshot() = default;
+
+// static
+std::unique_ptr<FieldTrialSnapshot> FieldTrialSnapshot::Map(
+    const ReadOnlySharedMemoryRegion& region) {
+  ReadOnlySharedMemoryMapping mapping = region.Map();
+  if (!mapping.IsValid())
+    return nullptr;
+  // The span stays valid when the mapping is moved into the snapshot.
+  span<const uint8_t> data = mapping.GetMemoryAsSpan<uint8_t>();
+  std::unique_ptr<FieldTrialSnapshot> snapshot =
+      WrapUnique(new FieldTrialSnapshot(std::move(mapping), data));
+  if (!snapshot->Initialize())
+    return nullptr;
+  return snapshot;
+}
+
+// static
+std::unique_ptr<FieldTrialSnapshot> FieldTrialSnapshot::FromBytes(
+    span<const uint8_t> data) {
+  std::unique_ptr<FieldTrialSnapshot> snapshot =
+      WrapUnique(new FieldTrialSnapshot(ReadOnlySharedMemoryMapping(), data));
+  if (!snapshot->Initialize())
+    return nullptr;
+  return snapshot;
+}
+
+FieldTrialSnapshot::Trial FieldTrialSnapshot::GetTrialAt(size_t index) const {
+  CHECK_LT(index, trial_count_);
+  return Trial(this, &trials_[index]);
+}
+
+absl::optional<FieldTrialSnapshot::Trial> FieldTrialSnapshot::FindTrial(
+    StringPiece trial_name) const {
+  const uint32_t hash = HashTrialName(trial_name);
+  const size_t mask = bucket_count_ - 1;
+  size_t slot = hash & mask;
+  // The number of probes is bounded in case the table is full, which the
+  // builder never does but a corrupted snapshot could.
+  for (size_t probe = 0; probe < bucket_count_; ++probe) {
+    const uint32_t bucket = buckets_[slot];
+    if (!bucket)
+      break;
+    const TrialRecord& record = trials_[bucket - 1];
+    if (record.name_hash == hash &&
+        GetString(record.name_offset, record.name_length) == trial_name) {
+      return Trial(this, &record);
+    }
+    slot = (slot + 1) & mask;
+  }
+  return absl::nullopt;
+}
+
+bool FieldTrialSnapshot::Initialize() {
+  if (data_.size() < sizeof(Header) ||
+      reinterpret_cast<uintptr_t>(data_.data()) % alignof(Header) != 0) {
+    return false;
+  }
+  const Header* header = reinterpret_cast<const Header*>(data_.data());
+  if (header->magic != Header::kMagic || header->version != Header::kVersion ||
+      header->size > data_.size()) {
+    return false;
+  }
+  // The bucket count must be a power of two, with room for all the trials.
+  if (!header->bucket_count ||
+      (header->bucket_count & (header->bucket_count - 1)) != 0 ||
+      header->trial_count >= header->bucket_count) {
+    return false;
+  }
+  const CheckedNumeric<uint32_t> size =
+      CheckedNumeric<uint32_t>(sizeof(Header)) +
+      CheckedNumeric<uint32_t>(sizeof(uint32_t)) * header->bucket_count +
+      CheckedNumeric<uint32_t>(sizeof(TrialRecord)) * header->trial_count +
+      CheckedNumeric<uint32_t>(sizeof(ParamRecord)) * header->param_count +
+      header->strings_size;
+  if (!size.IsValid() || size.ValueOrDie() != header->size)
+    return false;
+
+  const uint8_t* position = data_.data() + sizeof(Header);
+  buckets_ = reinterpret_cast<const uint32_t*>(position);
+  position += sizeof(uint32_t) * header->bucket_count;
+  trials_ = reinterpret_cast<const TrialRecord*>(position);
+  position += sizeof(TrialRecord) * header->trial_count;
+  params_ = reinterpret_cast<const ParamRecord*>(position);
+  position += sizeof(ParamRecord) * header->param_count;
+  strings_ = reinterpret_cast<const char*>(position);
+
+  for (uint32_t i = 0; i < header->bucket_count; ++i) {
+    if (buckets_[i] > header->trial_count)
+      return false;
+  }
+  const uint32_t strings_size = header->strings_size;
+  for (uint32_t i = 0; i < header->trial_count; ++i) {
+    const TrialRecord& record = trials_[i];
+    if (!IsRangeValid(record.name_offset, record.name_length, strings_size) ||
+        !IsRangeValid(record.group_offset, record.group_length,
+                      strings_size) ||
+        !IsRangeValid(record.first_param, record.param_count,
+                      header->param_count)) {
+      return false;
+    }
+  }
+  for (uint32_t i = 0; i < header->param_count; ++i) {
+    const ParamRecord& record = params_[i];
+    if (!IsRangeValid(record.key_offset, record.key_length, strings_size) ||
+        !IsRangeValid(record.value_offset, record.value_length,
+                      strings_size)) {
+      return false;
+    }
+  }
+
+  trial_count_ = header->trial_count;
+  bucket_count_ = header->bucket_count;
+  return true;
+}
+
+StringPiece FieldTrialSnapshot::GetString(uint32_t offset,
+                                          uint32_t length) const {
+  return StringPiece(strings_ + offset, length);
+}
+
+}  // namespace base
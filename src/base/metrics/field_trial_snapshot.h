@@ -0,0 +1,168 @@
+// Copyright 2021 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BASE_METRICS_FIELD_TRIAL_SNAPSHOT_H_
+#define BASE_METRICS_FIELD_TRIAL_SNAPSHOT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "base/base_export.h"
+#include "base/containers/span.h"
+#include "base/memory/read_only_shared_memory_region.h"
+#include "base/memory/shared_memory_mapping.h"
+#include "base/metrics/field_trial_params.h"
+#include "base/strings/string_piece.h"
+#include "third_party/abseil-cpp/absl/types/optional.h"
+
+namespace base {
+
+// FieldTrialSnapshot is a compact, read-only encoding of field trials and
+// their params, meant to be mapped by child processes and queried in place:
+// looking up a trial or a param neither parses nor allocates. This contrasts
+// with the FieldTrialList allocator, whose pickled entries are decoded into
+// FieldTrial objects at startup and into std::maps on every params lookup.
+//
+// A snapshot is immutable: it describes the trials at the time it was built,
+// including whether they were active, and doesn't follow later changes.
+//
+// The layout is position independent, with offsets relative to the start of
+// the snapshot and integers in the native byte order (producers and consumers
+// run the same build on the same machine):
+//
+//   Header
+//   uint32_t buckets[bucket_count];   // Open-addressed hash table over trial
+//                                     // names: trial index + 1, or 0.
+//   TrialRecord trials[trial_count];  // Sorted by trial name.
+//   ParamRecord params[param_count];  // Grouped by trial, sorted by key.
+//   char strings[];                   // Deduplicated, not NUL-terminated.
+//
+// Snapshots are validated when mapped, so a malformed one is rejected rather
+// than read out of bounds.
+class BASE_EXPORT FieldTrialSnapshot {
+ private:
+  struct TrialRecord;
+
+ public:
+  // Collects trials and encodes them.
+  class BASE_EXPORT Builder {
+   public:
+    Builder();
+
+    Builder(const Builder&) = delete;
+    Builder& operator=(const Builder&) = delete;
+
+    ~Builder();
+
+    // Adds a trial. Each trial can only be added once.
+    void AddTrial(StringPiece trial_name,
+                  StringPiece group_name,
+                  bool activated,
+                  const FieldTrialParams& params);
+
+    // Returns the encoded snapshot of the trials added so far.
+    std::vector<uint8_t> Build() const;
+
+    // Same as Build(), but in a new read-only shared memory region that can be
+    // passed to other processes. Returns an invalid region on failure.
+    ReadOnlySharedMemoryRegion BuildRegion() const;
+
+   private:
+    struct Trial {
+      Trial();
+      Trial(Trial&& other);
+      Trial& operator=(Trial&& other);
+      ~Trial();
+
+      std::string trial_name;
+      std::string group_name;
+      bool activated = false;
+      FieldTrialParams params;
+    };
+
+    std::vector<Trial> trials_;
+  };
+
+  // A trial of a snapshot. Only valid as long as the snapshot.
+  class BASE_EXPORT Trial {
+   public:
+    StringPiece trial_name() const;
+    StringPiece group_name() const;
+    bool activated() const;
+
+    size_t param_count() const;
+
+    // Looks up the param |param_name| with a binary search. Returns false if
+    // the trial doesn't have it.
+    bool GetParam(StringPiece param_name, StringPiece* value) const;
+
+    // Copies all the params of the trial to |params|.
+    void GetParams(FieldTrialParams* params) const;
+
+   private:
+    friend class FieldTrialSnapshot;
+
+    Trial(const FieldTrialSnapshot* snapshot, const TrialRecord* record);
+
+    const FieldTrialSnapshot* snapshot_;
+    const TrialRecord* record_;
+  };
+
+  FieldTrialSnapshot(const FieldTrialSnapshot&) = delete;
+  FieldTrialSnapshot& operator=(const FieldTrialSnapshot&) = delete;
+
+  ~FieldTrialSnapshot();
+
+  // Maps |region|, as created by Builder::BuildRegion(). Returns null if it
+  // can't be mapped or isn't a valid snapshot.
+  static std::unique_ptr<FieldTrialSnapshot> Map(
+      const ReadOnlySharedMemoryRegion& region);
+
+  // Reads a snapshot from |data|, as returned by Builder::Build(), which must
+  // be 4-byte aligned and outlive the snapshot. Returns null if it isn't a
+  // valid snapshot.
+  static std::unique_ptr<FieldTrialSnapshot> FromBytes(
+      span<const uint8_t> data);
+
+  size_t trial_count() const { return trial_count_; }
+
+  // Returns the trial at |index|, in the order of the trial names.
+  Trial GetTrialAt(size_t index) const;
+
+  // Looks up the trial named |trial_name| in the hash table.
+  absl::optional<Trial> FindTrial(StringPiece trial_name) const;
+
+ private:
+  struct Header;
+  struct ParamRecord;
+
+  FieldTrialSnapshot(ReadOnlySharedMemoryMapping mapping,
+                     span<const uint8_t> data);
+
+  // Checks that |data_| is a well-formed snapshot and sets up the pointers
+  // into it.
+  bool Initialize();
+
+  // Returns the string at |offset|, which was validated by Initialize().
+  StringPiece GetString(uint32_t offset, uint32_t length) const;
+
+  // Empty when the snapshot doesn't own its memory.
+  ReadOnlySharedMemoryMapping mapping_;
+  span<const uint8_t> data_;
+
+  size_t trial_count_ = 0;
+  size_t bucket_count_ = 0;
+  const uint32_t* buckets_ = nullptr;
+  const TrialRecord* trials_ = nullptr;
+  const ParamRecord* params_ = nullptr;
+  const char* strings_ = nullptr;
+};
+
+}  // namespace base
+
+#endif  // BASE_METRICS_FIELD_TRIAL_SNAPSHOT_H_
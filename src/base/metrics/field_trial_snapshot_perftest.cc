@@ -0,0 +1,200 @@
+// Copyright 2021 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "base/metrics/field_trial.h"
+#include "base/metrics/field_trial_param_associator.h"
+#include "base/metrics/field_trial_snapshot.h"
+#include "base/metrics/persistent_memory_allocator.h"
+#include "base/process/process_metrics.h"
+#include "base/strings/stringprintf.h"
+#include "base/test/scoped_field_trial_list_resetter.h"
+#include "base/timer/elapsed_timer.h"
+#include "build/build_config.h"
+#include "testing/gtest/include/gtest/gtest.h"
+#include "testing/perf/perf_result_reporter.h"
+
+// This file measures what a child process pays to get the field trials of its
+// parent, with 2000 active trials, when reading the pickled entries of the
+// field trial allocator versus mapping a FieldTrialSnapshot. In both cases,
+// the child reads the names of all the trials and one param of each. The
+// FieldTrial objects, which both create, aren't included.
+
+namespace base {
+
+namespace {
+
+constexpr char kMetricPrefixFieldTrial[] = "FieldTrialSnapshot.";
+constexpr char kMetricStartupTime[] = "startup_time";
+constexpr char kMetricHeapUsage[] = "heap_usage";
+constexpr char kMetricResidentSet[] = "resident_set";
+constexpr char kMetricSharedSize[] = "shared_size";
+constexpr int kNumTrials = 2000;
+constexpr int kParamsPerTrial = 5;
+constexpr int kNumRounds = 20;
+constexpr size_t kAllocatorSize = 8 << 20;  // 8 MiB
+
+perf_test::PerfResultReporter SetUpReporter(const std::string& story_name) {
+  perf_test::PerfResultReporter reporter(kMetricPrefixFieldTrial, story_name);
+  reporter.RegisterImportantMetric(kMetricStartupTime, "us");
+  reporter.RegisterImportantMetric(kMetricHeapUsage, "bytes");
+  reporter.RegisterImportantMetric(kMetricResidentSet, "bytes");
+  reporter.RegisterImportantMetric(kMetricSharedSize, "bytes");
+  return reporter;
+}
+
+// Tracks the memory used by the current process.
+class MemoryUsage {
+ public:
+  MemoryUsage()
+      : metrics_(ProcessMetrics::CreateCurrentProcessMetrics()),
+        initial_heap_usage_(metrics_->GetMallocUsage()),
+        initial_resident_set_(GetResidentSetSize()) {}
+
+  size_t GetHeapUsageIncrease() const {
+    return metrics_->GetMallocUsage() - initial_heap_usage_;
+  }
+
+  size_t GetResidentSetIncrease() const {
+    return GetResidentSetSize() - initial_resident_set_;
+  }
+
+ private:
+  size_t GetResidentSetSize() const {
+#if defined(OS_LINUX) || defined(OS_CHROMEOS) || defined(OS_ANDROID)
+    return metrics_->GetResidentSetSize();
+#else
+    return 0;
+#endif
+  }
+
+  const std::unique_ptr<ProcessMetrics> metrics_;
+  const size_t initial_heap_usage_;
+  const size_t initial_resident_set_;
+};
+
+// State read by a child process from the field trial allocator: the trial and
+// group names, and the params of a trial once it is queried.
+struct PickledState {
+  std::map<std::string, std::string> groups;
+  std::vector<std::map<std::string, std::string>> params;
+};
+
+std::unique_ptr<PickledState> ReadPickledState(
+    const PersistentMemoryAllocator& allocator) {
+  auto state = std::make_unique<PickledState>();
+  for (const FieldTrial::FieldTrialEntry* entry :
+       FieldTrialList::GetAllFieldTrialsFromPersistentAllocator(allocator)) {
+    StringPiece trial_name;
+    StringPiece group_name;
+    CHECK(entry->GetTrialAndGroupName(&trial_name, &group_name));
+    state->groups.emplace(trial_name, group_name);
+    state->params.emplace_back();
+    CHECK(entry->GetParams(&state->params.back()));
+    CHECK_EQ(1u, state->params.back().count("param0"));
+  }
+  return state;
+}
+
+std::unique_ptr<FieldTrialSnapshot> ReadSnapshot(
+    const ReadOnlySharedMemoryRegion& region,
+    const std::vector<std::string>& trial_names) {
+  std::unique_ptr<FieldTrialSnapshot> snapshot =
+      FieldTrialSnapshot::Map(region);
+  CHECK(snapshot);
+  for (const std::string& trial_name : trial_names) {
+    absl::optional<FieldTrialSnapshot::Trial> trial =
+        snapshot->FindTrial(trial_name);
+    CHECK(trial);
+    StringPiece value;
+    CHECK(trial->GetParam("param0", &value));
+  }
+  return snapshot;
+}
+
+class FieldTrialSnapshotPerfTest : public testing::Test {
+ public:
+  FieldTrialSnapshotPerfTest() : field_trial_list_(nullptr) {
+    for (int i = 0; i < kNumTrials; ++i) {
+      trial_names_.push_back(StringPrintf("PerfTrial%d", i));
+      const std::string group_name = StringPrintf("Group%d", i % 3);
+      FieldTrialList::CreateFieldTrial(trial_names_.back(), group_name);
+      std::map<std::string, std::string> params;
+      for (int j = 0; j < kParamsPerTrial; ++j)
+        params[StringPrintf("param%d", j)] = StringPrintf("%d", i * j);
+      FieldTrialParamAssociator::GetInstance()->AssociateFieldTrialParams(
+          trial_names_.back(), group_name, params);
+      FieldTrialList::Find(trial_names_.back())->group();
+    }
+  }
+
+  ~FieldTrialSnapshotPerfTest() override {
+    FieldTrialParamAssociator::GetInstance()->ClearAllParamsForTesting();
+  }
+
+ protected:
+  test::ScopedFieldTrialListResetter trial_list_resetter_;
+  FieldTrialList field_trial_list_;
+  std::vector<std::string> trial_names_;
+};
+
+}  // namespace
+
+TEST_F(FieldTrialSnapshotPerfTest, PickledEntries) {
+  LocalPersistentMemoryAllocator allocator(kAllocatorSize, 0, "");
+  FieldTrialList::DumpAllFieldTrialsToPersistentAllocator(&allocator);
+  ASSERT_EQ(static_cast<size_t>(kNumTrials),
+            FieldTrialList::GetAllFieldTrialsFromPersistentAllocator(allocator)
+                .size());
+
+  MemoryUsage memory_usage;
+  std::unique_ptr<PickledState> state = ReadPickledState(allocator);
+  const size_t heap_usage = memory_usage.GetHeapUsageIncrease();
+  const size_t resident_set = memory_usage.GetResidentSetIncrease();
+  state.reset();
+
+  ElapsedTimer timer;
+  for (int round = 0; round < kNumRounds; ++round)
+    ReadPickledState(allocator);
+  const TimeDelta elapsed = timer.Elapsed();
+
+  auto reporter = SetUpReporter("PickledEntries_2000Trials");
+  reporter.AddResult(kMetricStartupTime,
+                     elapsed.InMicroseconds() / double{kNumRounds});
+  reporter.AddResult(kMetricHeapUsage, heap_usage);
+  reporter.AddResult(kMetricResidentSet, resident_set);
+  reporter.AddResult(kMetricSharedSize, allocator.used());
+}
+
+TEST_F(FieldTrialSnapshotPerfTest, Snapshot) {
+  ReadOnlySharedMemoryRegion region =
+      FieldTrialList::CreateFieldTrialSnapshot();
+  ASSERT_TRUE(region.IsValid());
+
+  MemoryUsage memory_usage;
+  std::unique_ptr<FieldTrialSnapshot> snapshot =
+      ReadSnapshot(region, trial_names_);
+  const size_t heap_usage = memory_usage.GetHeapUsageIncrease();
+  const size_t resident_set = memory_usage.GetResidentSetIncrease();
+  ASSERT_EQ(static_cast<size_t>(kNumTrials), snapshot->trial_count());
+  snapshot.reset();
+
+  ElapsedTimer timer;
+  for (int round = 0; round < kNumRounds; ++round)
+    ReadSnapshot(region, trial_names_);
+  const TimeDelta elapsed = timer.Elapsed();
+
+  auto reporter = SetUpReporter("Snapshot_2000Trials");
+  reporter.AddResult(kMetricStartupTime,
+                     elapsed.InMicroseconds() / double{kNumRounds});
+  reporter.AddResult(kMetricHeapUsage, heap_usage);
+  reporter.AddResult(kMetricResidentSet, resident_set);
+  reporter.AddResult(kMetricSharedSize, region.GetSize());
+}
+
+}  // namespace base
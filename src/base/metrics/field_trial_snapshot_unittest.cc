@@ -0,0 +1,125 @@
+// Copyright 2021 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "base/metrics/field_trial_snapshot.h"
+
+#include <string.h>
+
+#include <vector>
+
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace base {
+
+namespace {
+
+std::vector<uint8_t> BuildTestSnapshot() {
+  FieldTrialSnapshot::Builder builder;
+  builder.AddTrial("Trial2", "Group", /*activated=*/false, {});
+  builder.AddTrial("Trial1", "Group", /*activated=*/true,
+                   {{"key1", "value1"}, {"key2", ""}, {"key3", "value1"}});
+  builder.AddTrial("Trial3", "Other", /*activated=*/true, {{"key", "value"}});
+  return builder.Build();
+}
+
+}  // namespace
+
+TEST(FieldTrialSnapshotTest, FindTrials) {
+  std::vector<uint8_t> data = BuildTestSnapshot();
+  std::unique_ptr<FieldTrialSnapshot> snapshot =
+      FieldTrialSnapshot::FromBytes(data);
+  ASSERT_TRUE(snapshot);
+  ASSERT_EQ(3u, snapshot->trial_count());
+
+  // Trials are sorted by name.
+  EXPECT_EQ("Trial1", snapshot->GetTrialAt(0).trial_name());
+  EXPECT_EQ("Trial2", snapshot->GetTrialAt(1).trial_name());
+  EXPECT_EQ("Trial3", snapshot->GetTrialAt(2).trial_name());
+
+  EXPECT_FALSE(snapshot->FindTrial("Trial4"));
+  EXPECT_FALSE(snapshot->FindTrial(""));
+
+  absl::optional<FieldTrialSnapshot::Trial> trial =
+      snapshot->FindTrial("Trial1");
+  ASSERT_TRUE(trial);
+  EXPECT_EQ("Trial1", trial->trial_name());
+  EXPECT_EQ("Group", trial->group_name());
+  EXPECT_TRUE(trial->activated());
+  EXPECT_EQ(3u, trial->param_count());
+
+  StringPiece value;
+  EXPECT_TRUE(trial->GetParam("key1", &value));
+  EXPECT_EQ("value1", value);
+  EXPECT_TRUE(trial->GetParam("key2", &value));
+  EXPECT_EQ("", value);
+  EXPECT_TRUE(trial->GetParam("key3", &value));
+  EXPECT_EQ("value1", value);
+  EXPECT_FALSE(trial->GetParam("key", &value));
+  EXPECT_FALSE(trial->GetParam("key4", &value));
+
+  FieldTrialParams params;
+  trial->GetParams(&params);
+  EXPECT_EQ(FieldTrialParams(
+                {{"key1", "value1"}, {"key2", ""}, {"key3", "value1"}}),
+            params);
+
+  trial = snapshot->FindTrial("Trial2");
+  ASSERT_TRUE(trial);
+  EXPECT_EQ("Group", trial->group_name());
+  EXPECT_FALSE(trial->activated());
+  EXPECT_EQ(0u, trial->param_count());
+  EXPECT_FALSE(trial->GetParam("key1", &value));
+}
+
+TEST(FieldTrialSnapshotTest, Empty) {
+  std::vector<uint8_t> data = FieldTrialSnapshot::Builder().Build();
+  std::unique_ptr<FieldTrialSnapshot> snapshot =
+      FieldTrialSnapshot::FromBytes(data);
+  ASSERT_TRUE(snapshot);
+  EXPECT_EQ(0u, snapshot->trial_count());
+  EXPECT_FALSE(snapshot->FindTrial("Trial"));
+}
+
+TEST(FieldTrialSnapshotTest, SharedMemoryRegion) {
+  FieldTrialSnapshot::Builder builder;
+  builder.AddTrial("Trial", "Group", /*activated=*/true, {{"key", "value"}});
+  ReadOnlySharedMemoryRegion region = builder.BuildRegion();
+  ASSERT_TRUE(region.IsValid());
+
+  std::unique_ptr<FieldTrialSnapshot> snapshot =
+      FieldTrialSnapshot::Map(region);
+  ASSERT_TRUE(snapshot);
+  absl::optional<FieldTrialSnapshot::Trial> trial =
+      snapshot->FindTrial("Trial");
+  ASSERT_TRUE(trial);
+  StringPiece value;
+  EXPECT_TRUE(trial->GetParam("key", &value));
+  EXPECT_EQ("value", value);
+}
+
+TEST(FieldTrialSnapshotTest, RejectMalformed) {
+  const std::vector<uint8_t> data = BuildTestSnapshot();
+  ASSERT_TRUE(FieldTrialSnapshot::FromBytes(data));
+
+  // Truncated.
+  EXPECT_FALSE(FieldTrialSnapshot::FromBytes(make_span(data.data(), 16u)));
+  EXPECT_FALSE(
+      FieldTrialSnapshot::FromBytes(make_span(data.data(), data.size() - 1)));
+
+  // Wrong magic.
+  std::vector<uint8_t> corrupted = data;
+  corrupted[0] ^= 1;
+  EXPECT_FALSE(FieldTrialSnapshot::FromBytes(corrupted));
+
+  // A trial name out of bounds. The header has 7 fields and is followed by 8
+  // buckets for 3 trials, then by the trial records, which start with the
+  // hash and the offset of the name.
+  constexpr size_t kFirstTrialNameOffset = (7 + 8 + 1) * sizeof(uint32_t);
+  corrupted = data;
+  const uint32_t bad_offset = 0x10000;
+  memcpy(&corrupted[kFirstTrialNameOffset], &bad_offset, sizeof(bad_offset));
+  EXPECT_FALSE(FieldTrialSnapshot::FromBytes(corrupted));
+}
+
+}  // namespace base
@@ -1349,6 +1349,42 @@ TEST_F(FieldTrialListTest, ClearParamsFromSharedMemory) {
   EXPECT_EQ("*Trial1/Group1/", check_string);
 }
 
+TEST_F(FieldTrialListTest, CreateTrialsFromSnapshot) {
+  ReadOnlySharedMemoryRegion shm_region;
+  {
+    FieldTrialList field_trial_list1(nullptr);
+    FieldTrialList::CreateFieldTrial("SnapshotTrial1", "Group1");
+    FieldTrialList::CreateFieldTrial("SnapshotTrial2", "Group2");
+    std::map<std::string, std::string> params;
+    params["key1"] = "value1";
+    params["key2"] = "value2";
+    FieldTrialParamAssociator::GetInstance()->AssociateFieldTrialParams(
+        "SnapshotTrial1", "Group1", params);
+    FieldTrialList::Find("SnapshotTrial1")->group();
+
+    shm_region = FieldTrialList::CreateFieldTrialSnapshot();
+    ASSERT_TRUE(shm_region.IsValid());
+  }
+
+  // Look up the params from the snapshot, as in a child process.
+  FieldTrialParamAssociator::GetInstance()->ClearAllCachedParamsForTesting();
+  FieldTrialList field_trial_list2(nullptr);
+  ASSERT_TRUE(FieldTrialList::CreateTrialsFromSnapshot(shm_region));
+
+  EXPECT_TRUE(FieldTrialList::IsTrialActive("SnapshotTrial1"));
+  EXPECT_FALSE(FieldTrialList::IsTrialActive("SnapshotTrial2"));
+  EXPECT_EQ("Group1", FieldTrialList::FindFullName("SnapshotTrial1"));
+  EXPECT_EQ("Group2", FieldTrialList::FindFullName("SnapshotTrial2"));
+
+  EXPECT_EQ("value1", GetFieldTrialParamValue("SnapshotTrial1", "key1"));
+  EXPECT_EQ("", GetFieldTrialParamValue("SnapshotTrial1", "key3"));
+  std::map<std::string, std::string> new_params;
+  EXPECT_TRUE(GetFieldTrialParams("SnapshotTrial1", &new_params));
+  EXPECT_EQ("value1", new_params["key1"]);
+  EXPECT_EQ("value2", new_params["key2"]);
+  EXPECT_EQ(2U, new_params.size());
+}
+
 TEST_F(FieldTrialListTest, DumpAndFetchFromSharedMemory) {
   std::string trial_name("Trial1");
   std::string group_name("Group1");
@@ -13,6 +13,7 @@
 #include <limits.h>
 #include <math.h>
 
+#include <algorithm>
 #include <memory>
 #include <string>
 #include <utility>
@@ -520,7 +521,10 @@ void Histogram::AddCount(int value, int count) {
     NOTREACHED();
     return;
   }
-  unlogged_samples_->Accumulate(value, count);
+  if (UNLIKELY(flags() & kShardedCounters))
+    GetOrCreateShardedSamples()->Accumulate(value, count);
+  else
+    unlogged_samples_->Accumulate(value, count);
 
   if (UNLIKELY(StatisticsRecorder::have_active_callbacks()))
     FindAndRunCallbacks(value);
@@ -623,7 +627,9 @@ Histogram::Histogram(const char* name,
       unlogged_samples_->id(), ranges, logged_meta, logged_counts);
 }
 
-Histogram::~Histogram() = default;
+Histogram::~Histogram() {
+  delete sharded_samples_.load(std::memory_order_relaxed);
+}
 
 const std::string Histogram::GetAsciiBucketRange(uint32_t i) const {
   return GetSimpleAsciiBucketRange(ranges(i));
@@ -666,12 +672,37 @@ std::unique_ptr<SampleVector> Histogram::SnapshotAllSamples() const {
 }
 
 std::unique_ptr<SampleVector> Histogram::SnapshotUnloggedSamples() const {
+  MergeShardedSamples();
   std::unique_ptr<SampleVector> samples(
       new SampleVector(unlogged_samples_->id(), bucket_ranges()));
   samples->Add(*unlogged_samples_);
   return samples;
 }
 
+ShardedSampleVector* Histogram::GetOrCreateShardedSamples() {
+  ShardedSampleVector* sharded_samples =
+      sharded_samples_.load(std::memory_order_acquire);
+  if (LIKELY(sharded_samples))
+    return sharded_samples;
+
+  // Racing threads may each create shards but only one set is kept.
+  auto new_sharded_samples = std::make_unique<ShardedSampleVector>(
+      unlogged_samples_->id(), bucket_ranges());
+  if (sharded_samples_.compare_exchange_strong(
+          sharded_samples, new_sharded_samples.get(),
+          std::memory_order_acq_rel, std::memory_order_acquire)) {
+    return new_sharded_samples.release();
+  }
+  return sharded_samples;
+}
+
+void Histogram::MergeShardedSamples() const {
+  ShardedSampleVector* sharded_samples =
+      sharded_samples_.load(std::memory_order_acquire);
+  if (sharded_samples)
+    sharded_samples->MoveTo(unlogged_samples_.get());
+}
+
 Value Histogram::GetParameters() const {
   Value params(Value::Type::DICTIONARY);
   params.SetStringKey("type", HistogramTypeToString(GetHistogramType()));
@@ -1244,4 +1275,292 @@ bool CustomHistogram::ValidateCustomRanges(
   return has_valid_range;
 }
 
+//------------------------------------------------------------------------------
+// HdrHistogram: This histogram uses log-linear buckets that preserve a fixed
+// number of significant digits.
+//------------------------------------------------------------------------------
+
+// static
+const int HdrHistogram::kMinSignificantDigits = 1;
+const int HdrHistogram::kMaxSignificantDigits = 3;
+const uint32_t HdrHistogram::kMaxBucketCount = 16384u;
+
+class HdrHistogram::Factory : public Histogram::Factory {
+ public:
+  Factory(const std::string& name,
+          HistogramBase::Sample minimum,
+          HistogramBase::Sample maximum,
+          int significant_digits,
+          int32_t flags)
+      : Histogram::Factory(
+            name,
+            HDR_HISTOGRAM,
+            minimum,
+            maximum,
+            HdrHistogram::GetBucketCount(minimum, maximum, significant_digits),
+            flags),
+        significant_digits_(significant_digits) {}
+
+  Factory(const Factory&) = delete;
+  Factory& operator=(const Factory&) = delete;
+
+ protected:
+  BucketRanges* CreateRanges() override {
+    BucketRanges* ranges = new BucketRanges(bucket_count_ + 1);
+    HdrHistogram::InitializeBucketRanges(minimum_, maximum_,
+                                         significant_digits_, ranges);
+    return ranges;
+  }
+
+  std::unique_ptr<HistogramBase> HeapAlloc(
+      const BucketRanges* ranges) override {
+    return WrapUnique(
+        new HdrHistogram(GetPermanentName(name_), minimum_, maximum_, ranges));
+  }
+
+ private:
+  const int significant_digits_;
+};
+
+HdrHistogram::~HdrHistogram() = default;
+
+HistogramBase* HdrHistogram::FactoryGet(const std::string& name,
+                                        Sample minimum,
+                                        Sample maximum,
+                                        int significant_digits,
+                                        int32_t flags) {
+  // The bucket count is derived from the other arguments, any valid one will
+  // do for the checks of the range.
+  uint32_t bucket_count = 3;
+  bool valid_arguments = Histogram::InspectConstructionArguments(
+      name, &minimum, &maximum, &bucket_count);
+  if (significant_digits < kMinSignificantDigits ||
+      significant_digits > kMaxSignificantDigits) {
+    valid_arguments = false;
+    significant_digits = std::max(kMinSignificantDigits,
+                                  std::min(significant_digits,
+                                           kMaxSignificantDigits));
+  }
+  while (significant_digits > kMinSignificantDigits &&
+         GetBucketCount(minimum, maximum, significant_digits) >
+             kMaxBucketCount) {
+    valid_arguments = false;
+    --significant_digits;
+  }
+  DCHECK(valid_arguments) << name;
+
+  return Factory(name, minimum, maximum, significant_digits, flags).Build();
+}
+
+HistogramBase* HdrHistogram::FactoryMicrosecondsTimeGet(
+    const std::string& name,
+    TimeDelta minimum,
+    TimeDelta maximum,
+    int significant_digits,
+    int32_t flags) {
+  DCHECK_LT(minimum.InMicroseconds(), std::numeric_limits<Sample>::max());
+  DCHECK_LT(maximum.InMicroseconds(), std::numeric_limits<Sample>::max());
+  return FactoryGet(name, static_cast<Sample>(minimum.InMicroseconds()),
+                    static_cast<Sample>(maximum.InMicroseconds()),
+                    significant_digits, flags);
+}
+
+HistogramBase* HdrHistogram::FactoryGet(const char* name,
+                                        Sample minimum,
+                                        Sample maximum,
+                                        int significant_digits,
+                                        int32_t flags) {
+  return FactoryGet(std::string(name), minimum, maximum, significant_digits,
+                    flags);
+}
+
+HistogramBase* HdrHistogram::FactoryMicrosecondsTimeGet(
+    const char* name,
+    TimeDelta minimum,
+    TimeDelta maximum,
+    int significant_digits,
+    int32_t flags) {
+  return FactoryMicrosecondsTimeGet(std::string(name), minimum, maximum,
+                                    significant_digits, flags);
+}
+
+std::unique_ptr<HistogramBase> HdrHistogram::PersistentCreate(
+    const char* name,
+    Sample minimum,
+    Sample maximum,
+    const BucketRanges* ranges,
+    const DelayedPersistentAllocation& counts,
+    const DelayedPersistentAllocation& logged_counts,
+    HistogramSamples::Metadata* meta,
+    HistogramSamples::Metadata* logged_meta) {
+  return WrapUnique(new HdrHistogram(name, minimum, maximum, ranges, counts,
+                                     logged_counts, meta, logged_meta));
+}
+
+// static
+uint32_t HdrHistogram::GetBucketCount(Sample minimum,
+                                      Sample maximum,
+                                      int significant_digits) {
+  return static_cast<uint32_t>(
+      GetRanges(minimum, maximum, significant_digits).size() - 1);
+}
+
+// static
+void HdrHistogram::InitializeBucketRanges(Sample minimum,
+                                          Sample maximum,
+                                          int significant_digits,
+                                          BucketRanges* ranges) {
+  std::vector<Sample> boundaries =
+      GetRanges(minimum, maximum, significant_digits);
+  DCHECK_EQ(boundaries.size(), ranges->size());
+  for (size_t i = 0; i < boundaries.size(); ++i)
+    ranges->set_range(i, boundaries[i]);
+  ranges->ResetChecksum();
+}
+
+Sample HdrHistogram::ValueAtQuantile(double quantile) const {
+  return ValueAtQuantile(*SnapshotSamples(), quantile);
+}
+
+// static
+Sample HdrHistogram::ValueAtQuantile(const HistogramSamples& samples,
+                                     double quantile) {
+  DCHECK_GE(quantile, 0.0);
+  DCHECK_LE(quantile, 1.0);
+
+  // Not all sample stores iterate in order of the buckets. The counts are
+  // summed up here rather than taken from TotalCount(), which may be racy.
+  struct Bucket {
+    Sample min;
+    int64_t max;
+    Count count;
+  };
+  std::vector<Bucket> buckets;
+  int64_t total_count = 0;
+  for (std::unique_ptr<SampleCountIterator> it = samples.Iterator();
+       !it->Done(); it->Next()) {
+    Bucket bucket;
+    it->Get(&bucket.min, &bucket.max, &bucket.count);
+    if (bucket.count <= 0)
+      continue;
+    buckets.push_back(bucket);
+    total_count += bucket.count;
+  }
+  if (total_count == 0)
+    return 0;
+  ranges::sort(buckets, {}, &Bucket::min);
+
+  // The rank of the sample at |quantile|, starting at 1.
+  const int64_t rank = std::max<int64_t>(
+      1, static_cast<int64_t>(ceil(quantile * total_count)));
+  int64_t seen_count = 0;
+  for (const Bucket& bucket : buckets) {
+    seen_count += bucket.count;
+    if (seen_count < rank)
+      continue;
+    // The overflow bucket has no meaningful middle.
+    if (bucket.max > kSampleType_MAX)
+      return bucket.min;
+    return static_cast<Sample>(bucket.min + (bucket.max - 1 - bucket.min) / 2);
+  }
+  return buckets.back().min;
+}
+
+HistogramType HdrHistogram::GetHistogramType() const {
+  return HDR_HISTOGRAM;
+}
+
+HdrHistogram::HdrHistogram(const char* name,
+                           Sample minimum,
+                           Sample maximum,
+                           const BucketRanges* ranges)
+    : Histogram(name, minimum, maximum, ranges) {}
+
+HdrHistogram::HdrHistogram(const char* name,
+                           Sample minimum,
+                           Sample maximum,
+                           const BucketRanges* ranges,
+                           const DelayedPersistentAllocation& counts,
+                           const DelayedPersistentAllocation& logged_counts,
+                           HistogramSamples::Metadata* meta,
+                           HistogramSamples::Metadata* logged_meta)
+    : Histogram(name,
+                minimum,
+                maximum,
+                ranges,
+                counts,
+                logged_counts,
+                meta,
+                logged_meta) {}
+
+// static
+HistogramBase* HdrHistogram::DeserializeInfoImpl(PickleIterator* iter) {
+  std::string histogram_name;
+  int flags;
+  int declared_min;
+  int declared_max;
+  uint32_t bucket_count;
+  uint32_t range_checksum;
+
+  if (!ReadHistogramArguments(iter, &histogram_name, &flags, &declared_min,
+                              &declared_max, &bucket_count, &range_checksum)) {
+    return nullptr;
+  }
+
+  // The precision isn't serialized: the bucket count grows with it, so it is
+  // the one precision that results in |bucket_count|. When several do, they
+  // all result in the same ranges.
+  int significant_digits = kMinSignificantDigits;
+  while (significant_digits < kMaxSignificantDigits &&
+         GetBucketCount(declared_min, declared_max, significant_digits) !=
+             bucket_count) {
+    ++significant_digits;
+  }
+
+  HistogramBase* histogram = HdrHistogram::FactoryGet(
+      histogram_name, declared_min, declared_max, significant_digits, flags);
+  if (!histogram)
+    return nullptr;
+
+  if (!ValidateRangeChecksum(*histogram, range_checksum)) {
+    // The serialized histogram might be corrupted.
+    return nullptr;
+  }
+  return histogram;
+}
+
+// static
+std::vector<Sample> HdrHistogram::GetRanges(Sample minimum,
+                                            Sample maximum,
+                                            int significant_digits) {
+  DCHECK_GE(significant_digits, kMinSignificantDigits);
+  DCHECK_LE(significant_digits, kMaxSignificantDigits);
+
+  // Values below |unit_bucket_count| get a bucket each. Above it, the bucket
+  // width doubles with every power of two, which is split into half as many
+  // buckets.
+  int64_t min_unit_bucket_count = 2;
+  for (int i = 0; i < significant_digits; ++i)
+    min_unit_bucket_count *= 10;
+  int64_t unit_bucket_count = 1;
+  while (unit_bucket_count < min_unit_bucket_count)
+    unit_bucket_count *= 2;
+
+  std::vector<Sample> ranges = {0, minimum};
+  int64_t width = 1;
+  int64_t next_doubling = unit_bucket_count;
+  for (int64_t value = 0; value < maximum;) {
+    if (value > minimum)
+      ranges.push_back(static_cast<Sample>(value));
+    if (value >= next_doubling) {
+      width *= 2;
+      next_doubling *= 2;
+    }
+    value += width;
+  }
+  ranges.push_back(maximum);
+  ranges.push_back(kSampleType_MAX);
+  return ranges;
+}
+
 }  // namespace base
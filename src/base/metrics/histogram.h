@@ -67,6 +67,7 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include <atomic>
 #include <map>
 #include <memory>
 #include <string>
@@ -97,6 +98,7 @@ class Pickle;
 class PickleIterator;
 class SampleVector;
 class SampleVectorBase;
+class ShardedSampleVector;
 
 class BASE_EXPORT Histogram : public HistogramBase {
  public:
@@ -287,6 +289,14 @@ class BASE_EXPORT Histogram : public HistogramBase {
   // Create a copy of unlogged samples.
   std::unique_ptr<SampleVector> SnapshotUnloggedSamples() const;
 
+  // Returns the per-CPU shards of a histogram with |kShardedCounters|,
+  // creating them on first use.
+  ShardedSampleVector* GetOrCreateShardedSamples();
+
+  // Moves samples recorded into the per-CPU shards, if any, to the unlogged
+  // samples.
+  void MergeShardedSamples() const;
+
   // Writes the type, min, max, and bucket count information of the histogram in
   // |params|.
   Value GetParameters() const override;
@@ -297,6 +307,10 @@ class BASE_EXPORT Histogram : public HistogramBase {
   // Accumulation of all samples that have been logged with SnapshotDelta().
   std::unique_ptr<SampleVectorBase> logged_samples_;
 
+  // Per-CPU shards for samples that have not yet been merged into
+  // |unlogged_samples_|. Only created for histograms with |kShardedCounters|.
+  std::atomic<ShardedSampleVector*> sharded_samples_{nullptr};
+
 #if DCHECK_IS_ON()  // Don't waste memory if it won't be used.
   // Flag to indicate if PrepareFinalDelta has been previously called. It is
   // used to DCHECK that a final delta is not created multiple times.
@@ -577,6 +591,135 @@ class BASE_EXPORT CustomHistogram : public Histogram {
   static bool ValidateCustomRanges(const std::vector<Sample>& custom_ranges);
 };
 
+//------------------------------------------------------------------------------
+
+// HdrHistogram is a histogram with HDR-style ("high dynamic range") log-linear
+// buckets. Values below 2 * 10^|significant_digits|, rounded up to a power of
+// two, each get their own bucket. Above that, every power of two is split into
+// the same number of equally wide buckets, half as many as there are unit
+// buckets. Any value within the declared range thus lands in a bucket whose
+// width is below 10^-|significant_digits| of the value, which keeps high
+// quantiles (e.g. the 99.9th percentile of a latency) reliable where the
+// exponential buckets of Histogram are far too coarse.
+//
+// For example, with 2 significant digits there are 256 unit buckets, then 128
+// buckets of width 2 for [256, 512), 128 buckets of width 4 for [512, 1024),
+// and so on. Recording microsecond latencies up to 10 seconds takes about 2300
+// buckets.
+//
+// HdrHistogram is otherwise a regular Histogram: it can live in persistent
+// memory, and its deltas are snapshotted by the HistogramSnapshotManager.
+class BASE_EXPORT HdrHistogram : public Histogram {
+ public:
+  // The range of supported |significant_digits|.
+  static const int kMinSignificantDigits;
+  static const int kMaxSignificantDigits;
+
+  // Upper bound for the number of buckets. If the declared range and precision
+  // would need more buckets, the precision is reduced until they fit.
+  static const uint32_t kMaxBucketCount;
+
+  HdrHistogram(const HdrHistogram&) = delete;
+  HdrHistogram& operator=(const HdrHistogram&) = delete;
+
+  ~HdrHistogram() override;
+
+  // |minimum| and |maximum| follow the same rules as for Histogram.
+  // |significant_digits| is the number of decimal digits to which recorded
+  // values are preserved, between |kMinSignificantDigits| and
+  // |kMaxSignificantDigits|.
+  static HistogramBase* FactoryGet(const std::string& name,
+                                   Sample minimum,
+                                   Sample maximum,
+                                   int significant_digits,
+                                   int32_t flags);
+  static HistogramBase* FactoryMicrosecondsTimeGet(const std::string& name,
+                                                   TimeDelta minimum,
+                                                   TimeDelta maximum,
+                                                   int significant_digits,
+                                                   int32_t flags);
+
+  // Overloads of the above two functions that take a const char* |name| param,
+  // to avoid code bloat from the std::string constructor being inlined into
+  // call sites.
+  static HistogramBase* FactoryGet(const char* name,
+                                   Sample minimum,
+                                   Sample maximum,
+                                   int significant_digits,
+                                   int32_t flags);
+  static HistogramBase* FactoryMicrosecondsTimeGet(const char* name,
+                                                   TimeDelta minimum,
+                                                   TimeDelta maximum,
+                                                   int significant_digits,
+                                                   int32_t flags);
+
+  // Create a histogram using data in persistent storage.
+  static std::unique_ptr<HistogramBase> PersistentCreate(
+      const char* name,
+      Sample minimum,
+      Sample maximum,
+      const BucketRanges* ranges,
+      const DelayedPersistentAllocation& counts,
+      const DelayedPersistentAllocation& logged_counts,
+      HistogramSamples::Metadata* meta,
+      HistogramSamples::Metadata* logged_meta);
+
+  // Returns the number of buckets, including the underflow and overflow
+  // buckets, of a histogram with the given construction arguments.
+  static uint32_t GetBucketCount(Sample minimum,
+                                 Sample maximum,
+                                 int significant_digits);
+
+  static void InitializeBucketRanges(Sample minimum,
+                                     Sample maximum,
+                                     int significant_digits,
+                                     BucketRanges* ranges);
+
+  // Returns an estimate of the value below or at which |quantile| (in [0, 1])
+  // of all samples recorded so far fall, e.g. 0.999 for the 99.9th
+  // percentile. The estimate is the middle of the bucket holding the sample of
+  // that rank, so it is off from the exact quantile by at most half a bucket
+  // width. Samples in the overflow bucket are reported as |declared_max()|.
+  // Returns 0 if there are no samples.
+  Sample ValueAtQuantile(double quantile) const;
+
+  // Same as above, for samples from a snapshot of any histogram, e.g. a delta
+  // passed to a HistogramFlattener.
+  static Sample ValueAtQuantile(const HistogramSamples& samples,
+                                double quantile);
+
+  // Overridden from Histogram:
+  HistogramType GetHistogramType() const override;
+
+ protected:
+  class Factory;
+
+  HdrHistogram(const char* name,
+               Sample minimum,
+               Sample maximum,
+               const BucketRanges* ranges);
+
+  HdrHistogram(const char* name,
+               Sample minimum,
+               Sample maximum,
+               const BucketRanges* ranges,
+               const DelayedPersistentAllocation& counts,
+               const DelayedPersistentAllocation& logged_counts,
+               HistogramSamples::Metadata* meta,
+               HistogramSamples::Metadata* logged_meta);
+
+ private:
+  friend BASE_EXPORT HistogramBase* DeserializeHistogramInfo(
+      base::PickleIterator* iter);
+  static HistogramBase* DeserializeInfoImpl(base::PickleIterator* iter);
+
+  // Returns the bucket boundaries of a histogram with the given construction
+  // arguments, including 0 and |kSampleType_MAX|.
+  static std::vector<Sample> GetRanges(Sample minimum,
+                                       Sample maximum,
+                                       int significant_digits);
+};
+
 }  // namespace base
 
 #endif  // BASE_METRICS_HISTOGRAM_H_
@@ -43,6 +43,8 @@ std::string HistogramTypeToString(HistogramType type) {
       return "SPARSE_HISTOGRAM";
     case DUMMY_HISTOGRAM:
       return "DUMMY_HISTOGRAM";
+    case HDR_HISTOGRAM:
+      return "HDR_HISTOGRAM";
   }
   NOTREACHED();
   return "UNKNOWN";
@@ -64,6 +66,8 @@ HistogramBase* DeserializeHistogramInfo(PickleIterator* iter) {
       return CustomHistogram::DeserializeInfoImpl(iter);
     case SPARSE_HISTOGRAM:
       return SparseHistogram::DeserializeInfoImpl(iter);
+    case HDR_HISTOGRAM:
+      return HdrHistogram::DeserializeInfoImpl(iter);
     default:
       return nullptr;
   }
@@ -40,6 +40,7 @@ enum HistogramType {
   CUSTOM_HISTOGRAM,
   SPARSE_HISTOGRAM,
   DUMMY_HISTOGRAM,
+  HDR_HISTOGRAM,
 };
 
 // Controls the verbosity of the information when the histogram is serialized to
@@ -131,6 +132,13 @@ class BASE_EXPORT HistogramBase {
     // MemoryAllocator, and that loaded into the Histogram module before this
     // histogram is created.
     kIsPersistent = 0x40,
+
+    // Indicates that samples are recorded into per-CPU shards which are merged
+    // when the histogram is snapshotted. This avoids contention on the counts
+    // when many threads record into the same histogram, at the cost of memory
+    // and of samples becoming visible only with the next snapshot. It is
+    // honored by Histogram and its subclasses and ignored by other types.
+    kShardedCounters = 0x80,
   };
 
   // Histogram data inconsistency types.
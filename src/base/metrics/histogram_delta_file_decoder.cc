@@ -0,0 +1,121 @@
+// Copyright 2021 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// This program decodes files written by HistogramDeltaFileExporter, adds up
+// the deltas they contain and prints the resulting histograms.
+//
+// Usage:
+// $ ninja -C out/foobar histogram_delta_file_decoder
+// $ out/foobar/histogram_delta_file_decoder [--histogram=Name] \
+//     deltas.2 deltas.1 deltas
+//
+// Rotated files should be listed oldest first. With --histogram, only the
+// histogram with that name is printed, otherwise all of them are, sorted by
+// name. Histograms whose name wasn't found in the files are listed by hash.
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "base/command_line.h"
+#include "base/files/file_path.h"
+#include "base/files/file_util.h"
+#include "base/metrics/histogram_delta_file_exporter.h"
+#include "base/strings/stringprintf.h"
+#include "base/time/time.h"
+
+namespace {
+
+struct AggregatedHistogram {
+  int64_t total_count = 0;
+  int64_t sum = 0;
+  // Counts by bucket [min, max).
+  std::map<std::pair<int64_t, int64_t>, int64_t> buckets;
+};
+
+void PrintHistogram(const std::string& name,
+                    const AggregatedHistogram& histogram) {
+  std::cout << name << ": " << histogram.total_count << " samples, sum "
+            << histogram.sum;
+  if (histogram.total_count) {
+    std::cout << ", mean " << std::fixed << std::setprecision(2)
+              << static_cast<double>(histogram.sum) / histogram.total_count;
+  }
+  std::cout << std::endl;
+
+  int64_t cumulative_count = 0;
+  for (const auto& bucket : histogram.buckets) {
+    cumulative_count += bucket.second;
+    std::cout << std::setw(12) << bucket.first.first << std::setw(12)
+              << bucket.first.second << std::setw(12) << bucket.second
+              << std::setw(9) << std::fixed << std::setprecision(2)
+              << 100.0 * cumulative_count / histogram.total_count << "%"
+              << std::endl;
+  }
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  base::CommandLine::Init(argc, argv);
+  const base::CommandLine& command_line =
+      *base::CommandLine::ForCurrentProcess();
+  const std::string histogram_filter =
+      command_line.GetSwitchValueASCII("histogram");
+  if (command_line.GetArgs().empty()) {
+    std::cout << "# no input files" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  base::HistogramDeltaFileReader reader;
+  std::vector<base::HistogramDeltaFileReader::Record> records;
+  for (const auto& arg : command_line.GetArgs()) {
+    const base::FilePath path(arg);
+    std::string data;
+    if (!base::ReadFileToString(path, &data)) {
+      std::cout << "# cannot read " << path.AsUTF8Unsafe() << std::endl;
+      return EXIT_FAILURE;
+    }
+    // Keep going on malformed files, the last record is usually cut short
+    // by a crash.
+    if (!reader.Decode(data, &records))
+      std::cout << "# " << path.AsUTF8Unsafe() << " is truncated" << std::endl;
+  }
+
+  std::map<std::string, AggregatedHistogram> histograms;
+  for (const auto& record : records) {
+    for (const auto& delta : record.histograms) {
+      std::string name = delta.name.empty()
+                             ? base::StringPrintf("0x%016" PRIx64,
+                                                  delta.name_hash)
+                             : delta.name;
+      if (!histogram_filter.empty() && name != histogram_filter)
+        continue;
+      AggregatedHistogram& histogram = histograms[name];
+      histogram.sum += delta.sum;
+      for (const auto& bucket : delta.buckets) {
+        histogram.total_count += bucket.count;
+        histogram.buckets[{bucket.min, bucket.max}] += bucket.count;
+      }
+    }
+  }
+
+  std::cout << "# " << records.size() << " records";
+  if (!records.empty()) {
+    std::cout << " over "
+              << (records.back().time - records.front().time).InSecondsF()
+              << " s";
+  }
+  std::cout << ", " << histograms.size() << " histograms" << std::endl;
+  for (const auto& histogram : histograms)
+    PrintHistogram(histogram.first, histogram.second);
+  return EXIT_SUCCESS;
+}
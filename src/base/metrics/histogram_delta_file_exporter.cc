@@ -0,0 +1,430 @@
+// Copyright 2021 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "base/metrics/histogram_delta_file_exporter.h"
+
+#include <limits>
+#include <utility>
+
+#include "base/bind.h"
+#include "base/files/file_util.h"
+#include "base/logging.h"
+#include "base/metrics/histogram_base.h"
+#include "base/metrics/histogram_samples.h"
+#include "base/metrics/statistics_recorder.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/timer/elapsed_timer.h"
+
+namespace base {
+
+namespace {
+
+// Protobuf wire types.
+enum WireType : uint32_t {
+  kVarint = 0,
+  kFixed64 = 1,
+  kLengthDelimited = 2,
+};
+
+// Field numbers of HistogramDeltaRecord.
+constexpr uint32_t kRecordTimeField = 1;
+constexpr uint32_t kRecordHistogramField = 2;
+
+// Field numbers of HistogramDelta.
+constexpr uint32_t kHistogramNameHashField = 1;
+constexpr uint32_t kHistogramNameField = 2;
+constexpr uint32_t kHistogramSumField = 3;
+constexpr uint32_t kHistogramBucketField = 4;
+
+// Field numbers of Bucket.
+constexpr uint32_t kBucketMinField = 1;
+constexpr uint32_t kBucketMaxField = 2;
+constexpr uint32_t kBucketCountField = 3;
+
+// The longest encoding of a varint.
+constexpr size_t kMaxVarintSize = 10;
+
+size_t WriteVarintToBuffer(uint64_t value, char* buffer) {
+  size_t size = 0;
+  while (value >= 0x80) {
+    buffer[size++] = static_cast<char>((value & 0x7f) | 0x80);
+    value >>= 7;
+  }
+  buffer[size++] = static_cast<char>(value);
+  return size;
+}
+
+// Writes a field of type kVarint with a field number below 16, so that its tag
+// fits in one byte.
+size_t WriteVarintFieldToBuffer(uint32_t field, uint64_t value, char* buffer) {
+  DCHECK_LT(field, 16u);
+  buffer[0] = static_cast<char>((field << 3) | kVarint);
+  return 1 + WriteVarintToBuffer(value, buffer + 1);
+}
+
+void WriteVarint(uint64_t value, std::string* output) {
+  char buffer[kMaxVarintSize];
+  output->append(buffer, WriteVarintToBuffer(value, buffer));
+}
+
+void WriteTag(uint32_t field, WireType wire_type, std::string* output) {
+  WriteVarint((field << 3) | wire_type, output);
+}
+
+uint64_t ZigZagEncode(int64_t value) {
+  return (static_cast<uint64_t>(value) << 1) ^
+         static_cast<uint64_t>(value >> 63);
+}
+
+int64_t ZigZagDecode(uint64_t value) {
+  return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+void WriteFixed64(uint64_t value, std::string* output) {
+  for (int i = 0; i < 8; ++i)
+    output->push_back(static_cast<char>(value >> (8 * i)));
+}
+
+void WriteLengthDelimited(uint32_t field,
+                          StringPiece value,
+                          std::string* output) {
+  WriteTag(field, kLengthDelimited, output);
+  WriteVarint(value.size(), output);
+  output->append(value.data(), value.size());
+}
+
+bool ReadVarint(StringPiece* data, uint64_t* value) {
+  *value = 0;
+  for (size_t i = 0; i < kMaxVarintSize && i < data->size(); ++i) {
+    const uint8_t byte = static_cast<uint8_t>((*data)[i]);
+    *value |= static_cast<uint64_t>(byte & 0x7f) << (7 * i);
+    if (!(byte & 0x80)) {
+      data->remove_prefix(i + 1);
+      return true;
+    }
+  }
+  return false;
+}
+
+bool ReadFixed64(StringPiece* data, uint64_t* value) {
+  if (data->size() < 8)
+    return false;
+  *value = 0;
+  for (int i = 0; i < 8; ++i)
+    *value |= uint64_t{static_cast<uint8_t>((*data)[i])} << (8 * i);
+  data->remove_prefix(8);
+  return true;
+}
+
+bool ReadLengthDelimited(StringPiece* data, StringPiece* value) {
+  uint64_t size;
+  if (!ReadVarint(data, &size) || size > data->size())
+    return false;
+  *value = data->substr(0, static_cast<size_t>(size));
+  data->remove_prefix(static_cast<size_t>(size));
+  return true;
+}
+
+// Reads the next field of a message. |varint| is set for fields of type
+// kVarint and kFixed64, |bytes| for kLengthDelimited ones.
+bool ReadField(StringPiece* data,
+               uint32_t* field,
+               uint64_t* varint,
+               StringPiece* bytes) {
+  uint64_t tag;
+  if (!ReadVarint(data, &tag) || tag > std::numeric_limits<uint32_t>::max())
+    return false;
+  *field = static_cast<uint32_t>(tag >> 3);
+  switch (tag & 7) {
+    case kVarint:
+      return ReadVarint(data, varint);
+    case kFixed64:
+      return ReadFixed64(data, varint);
+    case kLengthDelimited:
+      return ReadLengthDelimited(data, bytes);
+    default:
+      return false;
+  }
+}
+
+}  // namespace
+
+HistogramDeltaFileExporter::HistogramDeltaFileExporter(const Options& options)
+    : options_(options), histogram_snapshot_manager_(this) {
+  DETACH_FROM_SEQUENCE(sequence_checker_);
+}
+
+HistogramDeltaFileExporter::~HistogramDeltaFileExporter() {
+  DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
+}
+
+void HistogramDeltaFileExporter::Start(TimeDelta interval) {
+  DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
+  timer_.Start(
+      FROM_HERE, interval,
+      BindRepeating(IgnoreResult(&HistogramDeltaFileExporter::ExportNow),
+                    Unretained(this)));
+}
+
+void HistogramDeltaFileExporter::Stop() {
+  DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
+  timer_.Stop();
+}
+
+bool HistogramDeltaFileExporter::ExportNow() {
+  DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
+
+  ElapsedTimer timer;
+  const bool measure_cpu_time = ThreadTicks::IsSupported();
+  const ThreadTicks start_cpu_time =
+      measure_cpu_time ? ThreadTicks::Now() : ThreadTicks();
+
+  last_export_stats_ = ExportStats();
+  const size_t buffer_capacity =
+      record_buffer_.capacity() + histogram_buffer_.capacity();
+  // Rotate before encoding, as names are only written to the first record of
+  // a file that contains the histogram.
+  if (file_size_ >= options_.max_file_size)
+    RotateFiles();
+  record_buffer_.clear();
+  WriteTag(kRecordTimeField, kVarint, &record_buffer_);
+  WriteVarint(static_cast<uint64_t>(
+                  (Time::Now() - Time::UnixEpoch()).InMicroseconds()),
+              &record_buffer_);
+  StatisticsRecorder::PrepareDeltas(
+      options_.include_persistent, HistogramBase::kNoFlags,
+      HistogramBase::kNoFlags, &histogram_snapshot_manager_);
+
+  bool success = true;
+  if (last_export_stats_.histograms) {
+    char size_buffer[kMaxVarintSize];
+    const size_t size_size =
+        WriteVarintToBuffer(record_buffer_.size(), size_buffer);
+    const size_t total_size = size_size + record_buffer_.size();
+    success = OpenFile() &&
+              file_.WriteAtCurrentPos(size_buffer, size_size) ==
+                  static_cast<int>(size_size) &&
+              file_.WriteAtCurrentPos(record_buffer_.data(),
+                                      record_buffer_.size()) ==
+                  static_cast<int>(record_buffer_.size());
+    if (success) {
+      file_size_ += total_size;
+      last_export_stats_.bytes = total_size;
+    } else {
+      DLOG(ERROR) << "Failed to write histogram deltas to "
+                  << options_.path.value();
+      // Start over in a fresh file, as this one may hold a partial record.
+      RotateFiles();
+    }
+  }
+
+  // The buffers never shrink, as clear() keeps their capacity.
+  last_export_stats_.buffer_bytes_allocated =
+      record_buffer_.capacity() + histogram_buffer_.capacity() -
+      buffer_capacity;
+  last_export_stats_.wall_time = timer.Elapsed();
+  if (measure_cpu_time)
+    last_export_stats_.cpu_time = ThreadTicks::Now() - start_cpu_time;
+  return success;
+}
+
+void HistogramDeltaFileExporter::RecordDelta(const HistogramBase& histogram,
+                                             const HistogramSamples& snapshot) {
+  DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
+  DCHECK_NE(0, snapshot.TotalCount());
+
+  histogram_buffer_.clear();
+  WriteTag(kHistogramNameHashField, kFixed64, &histogram_buffer_);
+  WriteFixed64(histogram.name_hash(), &histogram_buffer_);
+  if (names_written_.insert(histogram.name_hash()).second) {
+    WriteLengthDelimited(kHistogramNameField, histogram.histogram_name(),
+                         &histogram_buffer_);
+  }
+  WriteTag(kHistogramSumField, kVarint, &histogram_buffer_);
+  WriteVarint(ZigZagEncode(snapshot.sum()), &histogram_buffer_);
+
+  for (std::unique_ptr<SampleCountIterator> it = snapshot.Iterator();
+       !it->Done(); it->Next()) {
+    HistogramBase::Sample min;
+    int64_t max;
+    HistogramBase::Count count;
+    it->Get(&min, &max, &count);
+    if (!count)
+      continue;
+
+    // A bucket is small enough to be encoded on the stack.
+    char bucket[3 * (1 + kMaxVarintSize)];
+    size_t bucket_size = WriteVarintFieldToBuffer(
+        kBucketMinField, static_cast<uint64_t>(min), bucket);
+    if (max != int64_t{min} + 1) {
+      bucket_size += WriteVarintFieldToBuffer(
+          kBucketMaxField, static_cast<uint64_t>(max), bucket + bucket_size);
+    }
+    bucket_size += WriteVarintFieldToBuffer(
+        kBucketCountField, ZigZagEncode(count), bucket + bucket_size);
+    WriteLengthDelimited(kHistogramBucketField,
+                         StringPiece(bucket, bucket_size), &histogram_buffer_);
+  }
+
+  WriteLengthDelimited(kRecordHistogramField, histogram_buffer_,
+                       &record_buffer_);
+  ++last_export_stats_.histograms;
+}
+
+bool HistogramDeltaFileExporter::OpenFile() {
+  if (file_.IsValid())
+    return true;
+  file_.Initialize(options_.path, File::FLAG_OPEN_ALWAYS | File::FLAG_APPEND);
+  if (!file_.IsValid())
+    return false;
+  const int64_t length = file_.GetLength();
+  file_size_ = length > 0 ? static_cast<size_t>(length) : 0;
+  return true;
+}
+
+void HistogramDeltaFileExporter::RotateFiles() {
+  file_.Close();
+  file_size_ = 0;
+  names_written_.clear();
+
+  if (!options_.max_rotated_files) {
+    DeleteFile(options_.path);
+    return;
+  }
+  DeleteFile(GetRotatedPath(options_.max_rotated_files));
+  for (size_t i = options_.max_rotated_files - 1; i > 0; --i) {
+    const FilePath path = GetRotatedPath(i);
+    if (PathExists(path))
+      Move(path, GetRotatedPath(i + 1));
+  }
+  Move(options_.path, GetRotatedPath(1));
+}
+
+FilePath HistogramDeltaFileExporter::GetRotatedPath(size_t index) const {
+  return options_.path.AddExtensionASCII(NumberToString(index));
+}
+
+HistogramDeltaFileReader::HistogramDelta::HistogramDelta() = default;
+HistogramDeltaFileReader::HistogramDelta::HistogramDelta(
+    const HistogramDelta& other) = default;
+HistogramDeltaFileReader::HistogramDelta::HistogramDelta(
+    HistogramDelta&& other) = default;
+HistogramDeltaFileReader::HistogramDelta&
+HistogramDeltaFileReader::HistogramDelta::operator=(
+    const HistogramDelta& other) = default;
+HistogramDeltaFileReader::HistogramDelta&
+HistogramDeltaFileReader::HistogramDelta::operator=(HistogramDelta&& other) =
+    default;
+HistogramDeltaFileReader::HistogramDelta::~HistogramDelta() = default;
+
+HistogramDeltaFileReader::Record::Record() = default;
+HistogramDeltaFileReader::Record::Record(const Record& other) = default;
+HistogramDeltaFileReader::Record::Record(Record&& other) = default;
+HistogramDeltaFileReader::Record& HistogramDeltaFileReader::Record::operator=(
+    const Record& other) = default;
+HistogramDeltaFileReader::Record& HistogramDeltaFileReader::Record::operator=(
+    Record&& other) = default;
+HistogramDeltaFileReader::Record::~Record() = default;
+
+HistogramDeltaFileReader::HistogramDeltaFileReader() = default;
+
+HistogramDeltaFileReader::~HistogramDeltaFileReader() = default;
+
+bool HistogramDeltaFileReader::Decode(StringPiece data,
+                                      std::vector<Record>* records) {
+  while (!data.empty()) {
+    StringPiece record_data;
+    Record record;
+    if (!ReadLengthDelimited(&data, &record_data) ||
+        !DecodeRecord(record_data, &record)) {
+      return false;
+    }
+    records->push_back(std::move(record));
+  }
+  return true;
+}
+
+bool HistogramDeltaFileReader::DecodeRecord(StringPiece data, Record* record) {
+  while (!data.empty()) {
+    uint32_t field;
+    uint64_t varint = 0;
+    StringPiece bytes;
+    if (!ReadField(&data, &field, &varint, &bytes))
+      return false;
+    switch (field) {
+      case kRecordTimeField:
+        record->time =
+            Time::UnixEpoch() + Microseconds(static_cast<int64_t>(varint));
+        break;
+      case kRecordHistogramField:
+        record->histograms.emplace_back();
+        if (!DecodeHistogramDelta(bytes, &record->histograms.back()))
+          return false;
+        break;
+      default:
+        // Unknown fields are skipped, for forward compatibility.
+        break;
+    }
+  }
+  return true;
+}
+
+bool HistogramDeltaFileReader::DecodeHistogramDelta(
+    StringPiece data,
+    HistogramDelta* histogram) {
+  while (!data.empty()) {
+    uint32_t field;
+    uint64_t varint = 0;
+    StringPiece bytes;
+    if (!ReadField(&data, &field, &varint, &bytes))
+      return false;
+    switch (field) {
+      case kHistogramNameHashField:
+        histogram->name_hash = varint;
+        break;
+      case kHistogramNameField:
+        histogram->name = std::string(bytes);
+        break;
+      case kHistogramSumField:
+        histogram->sum = ZigZagDecode(varint);
+        break;
+      case kHistogramBucketField: {
+        Bucket bucket;
+        bool has_max = false;
+        while (!bytes.empty()) {
+          uint32_t bucket_field;
+          uint64_t bucket_varint = 0;
+          StringPiece bucket_bytes;
+          if (!ReadField(&bytes, &bucket_field, &bucket_varint, &bucket_bytes))
+            return false;
+          if (bucket_field == kBucketMinField) {
+            bucket.min = static_cast<int64_t>(bucket_varint);
+          } else if (bucket_field == kBucketMaxField) {
+            bucket.max = static_cast<int64_t>(bucket_varint);
+            has_max = true;
+          } else if (bucket_field == kBucketCountField) {
+            bucket.count = ZigZagDecode(bucket_varint);
+          }
+        }
+        if (!has_max)
+          bucket.max = bucket.min + 1;
+        histogram->buckets.push_back(bucket);
+        break;
+      }
+      default:
+        break;
+    }
+  }
+
+  if (histogram->name.empty()) {
+    auto it = names_.find(histogram->name_hash);
+    if (it != names_.end())
+      histogram->name = it->second;
+  } else {
+    names_[histogram->name_hash] = histogram->name;
+  }
+  return true;
+}
+
+}  // namespace base
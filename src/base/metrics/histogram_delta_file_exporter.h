@@ -0,0 +1,222 @@
+// Copyright 2021 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BASE_METRICS_HISTOGRAM_DELTA_FILE_EXPORTER_H_
+#define BASE_METRICS_HISTOGRAM_DELTA_FILE_EXPORTER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "base/base_export.h"
+#include "base/files/file.h"
+#include "base/files/file_path.h"
+#include "base/metrics/histogram_flattener.h"
+#include "base/metrics/histogram_snapshot_manager.h"
+#include "base/sequence_checker.h"
+#include "base/strings/string_piece.h"
+#include "base/time/time.h"
+#include "base/timer/timer.h"
+
+namespace base {
+
+class HistogramBase;
+class HistogramSamples;
+
+// HistogramDeltaFileExporter periodically snapshots the deltas of all
+// histograms in the StatisticsRecorder and appends them to a local file, for
+// processes that don't run the UMA pipeline. The files are decoded offline,
+// see HistogramDeltaFileReader and the histogram_delta_file_decoder tool.
+//
+// Like any other consumer of deltas, the exporter marks the samples it
+// exports as logged, so it must not be combined with another one (e.g. UMA)
+// in the same process.
+//
+// The file is a sequence of records, each one a varint length followed by a
+// message in protobuf wire format (so that e.g. "protoc --decode_raw" can read
+// it), as if written by:
+//
+//   message HistogramDeltaRecord {
+//     optional int64 time_us = 1;  // Microseconds since the Unix epoch.
+//     repeated HistogramDelta histogram = 2;
+//   }
+//   message HistogramDelta {
+//     optional fixed64 name_hash = 1;  // HashMetricName() of the name.
+//     optional string name = 2;  // Only in the first delta in a file.
+//     optional sint64 sum = 3;
+//     repeated Bucket bucket = 4;
+//   }
+//   message Bucket {
+//     optional int64 min = 1;
+//     optional int64 max = 2;  // Omitted when it is min + 1.
+//     optional sint64 count = 3;
+//   }
+//
+// Only non-empty buckets of histograms that changed are written, and names are
+// written once per file, which keeps the files compact without running a
+// general-purpose compressor. Once the file reaches |Options::max_file_size|,
+// it is rotated: "deltas" is renamed to "deltas.1", "deltas.1" to "deltas.2",
+// and so on, and the oldest one is deleted.
+//
+// An export cycle reuses the encoding buffers of the previous ones, so once
+// they fit the largest record, it only allocates the snapshot of each
+// histogram with a delta (a HistogramSamples and its iterator, made by
+// HistogramSnapshotManager), and the set entry of each name written to a new
+// file. Its cost is available from |last_export_stats()|.
+//
+// The exporter does blocking file I/O and must be used on a single sequence
+// that allows it, e.g. through a SequenceBound on a task runner with
+// MayBlock().
+class BASE_EXPORT HistogramDeltaFileExporter : public HistogramFlattener {
+ public:
+  struct BASE_EXPORT Options {
+    // The file to append to. Rotated files get a numeric extension.
+    FilePath path;
+    // Files are rotated once they reach this size. Records are never split,
+    // so a file may exceed it by up to one record.
+    size_t max_file_size = 16 * 1024 * 1024;
+    // The number of rotated files to keep besides the current one.
+    size_t max_rotated_files = 4;
+    // Whether to include histograms held in persistent memory.
+    bool include_persistent = true;
+  };
+
+  // The cost of an export cycle.
+  struct ExportStats {
+    // Histograms with a non-empty delta.
+    size_t histograms = 0;
+    // Bytes appended to the file.
+    size_t bytes = 0;
+    // Bytes by which the encoding buffers grew. Zero unless the record is
+    // larger than all the previous ones.
+    size_t buffer_bytes_allocated = 0;
+    // Time taken by the whole cycle, including snapshotting and the write.
+    TimeDelta wall_time;
+    // CPU time taken by the cycle. Zero if thread CPU time isn't supported.
+    TimeDelta cpu_time;
+  };
+
+  explicit HistogramDeltaFileExporter(const Options& options);
+
+  HistogramDeltaFileExporter(const HistogramDeltaFileExporter&) = delete;
+  HistogramDeltaFileExporter& operator=(const HistogramDeltaFileExporter&) =
+      delete;
+
+  ~HistogramDeltaFileExporter() override;
+
+  // Exports deltas every |interval| until Stop() is called or the exporter
+  // is destroyed.
+  void Start(TimeDelta interval);
+  void Stop();
+
+  // Exports the deltas since the previous cycle right away. Returns false if
+  // the file couldn't be written; those deltas are lost.
+  bool ExportNow();
+
+  const ExportStats& last_export_stats() const {
+    DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
+    return last_export_stats_;
+  }
+
+ private:
+  // HistogramFlattener implementation.
+  void RecordDelta(const HistogramBase& histogram,
+                   const HistogramSamples& snapshot) override;
+
+  // Opens |options_.path| for appending, if not open yet.
+  bool OpenFile();
+
+  // Closes the current file and shifts the rotated ones.
+  void RotateFiles();
+
+  FilePath GetRotatedPath(size_t index) const;
+
+  const Options options_;
+
+  // Calculates deltas in histogram counters.
+  HistogramSnapshotManager histogram_snapshot_manager_;
+
+  RepeatingTimer timer_;
+
+  File file_;
+  size_t file_size_ = 0;
+
+  // Hashes of the histograms whose name was written to the current file.
+  std::unordered_set<uint64_t> names_written_;
+
+  // Buffers for encoding, kept across cycles to avoid reallocations.
+  std::string record_buffer_;
+  std::string histogram_buffer_;
+
+  ExportStats last_export_stats_;
+
+  SEQUENCE_CHECKER(sequence_checker_);
+};
+
+// Decodes files written by HistogramDeltaFileExporter.
+class BASE_EXPORT HistogramDeltaFileReader {
+ public:
+  struct Bucket {
+    int64_t min = 0;
+    int64_t max = 0;
+    int64_t count = 0;
+  };
+
+  struct HistogramDelta {
+    HistogramDelta();
+    HistogramDelta(const HistogramDelta& other);
+    HistogramDelta(HistogramDelta&& other);
+    HistogramDelta& operator=(const HistogramDelta& other);
+    HistogramDelta& operator=(HistogramDelta&& other);
+    ~HistogramDelta();
+
+    uint64_t name_hash = 0;
+    // Empty if the file doesn't contain the name of the histogram, which can
+    // happen when it was truncated by a crash.
+    std::string name;
+    int64_t sum = 0;
+    std::vector<Bucket> buckets;
+  };
+
+  struct Record {
+    Record();
+    Record(const Record& other);
+    Record(Record&& other);
+    Record& operator=(const Record& other);
+    Record& operator=(Record&& other);
+    ~Record();
+
+    Time time;
+    std::vector<HistogramDelta> histograms;
+  };
+
+  HistogramDeltaFileReader();
+
+  HistogramDeltaFileReader(const HistogramDeltaFileReader&) = delete;
+  HistogramDeltaFileReader& operator=(const HistogramDeltaFileReader&) = delete;
+
+  ~HistogramDeltaFileReader();
+
+  // Decodes the records in |data|, the contents of a file, and appends them to
+  // |records|. Names are remembered across calls, so rotated files should be
+  // decoded oldest first. Returns false if |data| is malformed, e.g. because
+  // the last record was cut short by a crash; the records before the error
+  // are still appended.
+  bool Decode(StringPiece data, std::vector<Record>* records);
+
+ private:
+  bool DecodeRecord(StringPiece data, Record* record);
+  bool DecodeHistogramDelta(StringPiece data, HistogramDelta* histogram);
+
+  // Names of the histograms seen so far, by hash.
+  std::unordered_map<uint64_t, std::string> names_;
+};
+
+}  // namespace base
+
+#endif  // BASE_METRICS_HISTOGRAM_DELTA_FILE_EXPORTER_H_
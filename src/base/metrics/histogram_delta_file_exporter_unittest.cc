@@ -0,0 +1,172 @@
+// Copyright 2021 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "base/metrics/histogram_delta_file_exporter.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "base/cxx17_backports.h"
+#include "base/files/file_util.h"
+#include "base/files/scoped_temp_dir.h"
+#include "base/metrics/histogram.h"
+#include "base/metrics/histogram_base.h"
+#include "base/metrics/sparse_histogram.h"
+#include "base/metrics/statistics_recorder.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace base {
+
+namespace {
+
+using Record = HistogramDeltaFileReader::Record;
+using HistogramDelta = HistogramDeltaFileReader::HistogramDelta;
+
+int64_t GetCount(const HistogramDelta& histogram, int64_t value) {
+  for (const auto& bucket : histogram.buckets) {
+    if (bucket.min <= value && value < bucket.max)
+      return bucket.count;
+  }
+  return 0;
+}
+
+}  // namespace
+
+class HistogramDeltaFileExporterTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    ASSERT_TRUE(temp_dir_.CreateUniqueTempDir());
+    options_.path = temp_dir_.GetPath().AppendASCII("deltas");
+  }
+
+  std::vector<Record> ReadRecords(const FilePath& path) {
+    std::string data;
+    EXPECT_TRUE(ReadFileToString(path, &data));
+    std::vector<Record> records;
+    HistogramDeltaFileReader reader;
+    EXPECT_TRUE(reader.Decode(data, &records));
+    return records;
+  }
+
+  std::unique_ptr<StatisticsRecorder> statistics_recorder_ =
+      StatisticsRecorder::CreateTemporaryForTesting();
+  ScopedTempDir temp_dir_;
+  HistogramDeltaFileExporter::Options options_;
+};
+
+TEST_F(HistogramDeltaFileExporterTest, ExportAndDecode) {
+  HistogramDeltaFileExporter exporter(options_);
+
+  // Nothing was recorded yet.
+  EXPECT_TRUE(exporter.ExportNow());
+  EXPECT_EQ(0u, exporter.last_export_stats().histograms);
+  EXPECT_EQ(0u, exporter.last_export_stats().bytes);
+  EXPECT_FALSE(PathExists(options_.path));
+
+  HistogramBase* histogram = Histogram::FactoryGet(
+      "Test.Exponential", 1, 1000, 10, HistogramBase::kNoFlags);
+  HistogramBase* sparse_histogram =
+      SparseHistogram::FactoryGet("Test.Sparse", HistogramBase::kNoFlags);
+  histogram->Add(1);
+  histogram->Add(100);
+  histogram->Add(100);
+  sparse_histogram->Add(-5);
+  EXPECT_TRUE(exporter.ExportNow());
+  EXPECT_EQ(2u, exporter.last_export_stats().histograms);
+  EXPECT_LT(0u, exporter.last_export_stats().bytes);
+  EXPECT_LT(0u, exporter.last_export_stats().buffer_bytes_allocated);
+
+  // Only the delta is exported. The record is smaller than the previous one,
+  // so the buffers are reused as they are.
+  histogram->Add(1000);
+  EXPECT_TRUE(exporter.ExportNow());
+  EXPECT_EQ(1u, exporter.last_export_stats().histograms);
+  EXPECT_EQ(0u, exporter.last_export_stats().buffer_bytes_allocated);
+
+  std::vector<Record> records = ReadRecords(options_.path);
+  ASSERT_EQ(2u, records.size());
+  EXPECT_FALSE(records[0].time.is_null());
+
+  ASSERT_EQ(2u, records[0].histograms.size());
+  for (const HistogramDelta& delta : records[0].histograms) {
+    if (delta.name == "Test.Exponential") {
+      EXPECT_EQ(histogram->name_hash(), delta.name_hash);
+      EXPECT_EQ(201, delta.sum);
+      EXPECT_EQ(1, GetCount(delta, 1));
+      EXPECT_EQ(2, GetCount(delta, 100));
+      EXPECT_EQ(0, GetCount(delta, 1000));
+    } else {
+      EXPECT_EQ("Test.Sparse", delta.name);
+      EXPECT_EQ(sparse_histogram->name_hash(), delta.name_hash);
+      EXPECT_EQ(-5, delta.sum);
+      ASSERT_EQ(1u, delta.buckets.size());
+      EXPECT_EQ(-5, delta.buckets[0].min);
+      EXPECT_EQ(-4, delta.buckets[0].max);
+      EXPECT_EQ(1, delta.buckets[0].count);
+    }
+  }
+
+  // The name is only written once, but the reader remembers it.
+  ASSERT_EQ(1u, records[1].histograms.size());
+  const HistogramDelta& delta = records[1].histograms[0];
+  EXPECT_EQ("Test.Exponential", delta.name);
+  EXPECT_EQ(1000, delta.sum);
+  EXPECT_EQ(0, GetCount(delta, 100));
+  EXPECT_EQ(1, GetCount(delta, 1000));
+}
+
+TEST_F(HistogramDeltaFileExporterTest, RotateFiles) {
+  // Every record gets a file of its own.
+  options_.max_file_size = 1;
+  options_.max_rotated_files = 2;
+  HistogramDeltaFileExporter exporter(options_);
+
+  HistogramBase* histogram = Histogram::FactoryGet(
+      "Test.Rotated", 1, 1000, 10, HistogramBase::kNoFlags);
+  for (int i = 1; i <= 4; ++i) {
+    histogram->AddCount(10, i);
+    EXPECT_TRUE(exporter.ExportNow());
+  }
+
+  // The oldest file was deleted.
+  EXPECT_FALSE(PathExists(options_.path.AddExtensionASCII("3")));
+
+  // Each file can be decoded on its own, including the names.
+  const FilePath paths[] = {options_.path.AddExtensionASCII("2"),
+                            options_.path.AddExtensionASCII("1"),
+                            options_.path};
+  for (size_t i = 0; i < base::size(paths); ++i) {
+    std::vector<Record> records = ReadRecords(paths[i]);
+    ASSERT_EQ(1u, records.size());
+    ASSERT_EQ(1u, records[0].histograms.size());
+    EXPECT_EQ("Test.Rotated", records[0].histograms[0].name);
+    EXPECT_EQ(static_cast<int64_t>(i + 2),
+              GetCount(records[0].histograms[0], 10));
+  }
+}
+
+TEST_F(HistogramDeltaFileExporterTest, TruncatedFile) {
+  HistogramDeltaFileExporter exporter(options_);
+  HistogramBase* histogram = Histogram::FactoryGet(
+      "Test.Truncated", 1, 1000, 10, HistogramBase::kNoFlags);
+  histogram->Add(10);
+  EXPECT_TRUE(exporter.ExportNow());
+  histogram->Add(20);
+  EXPECT_TRUE(exporter.ExportNow());
+
+  std::string data;
+  ASSERT_TRUE(ReadFileToString(options_.path, &data));
+  data.resize(data.size() - 1);
+
+  // The complete records are still decoded.
+  std::vector<Record> records;
+  HistogramDeltaFileReader reader;
+  EXPECT_FALSE(reader.Decode(data, &records));
+  ASSERT_EQ(1u, records.size());
+  ASSERT_EQ(1u, records[0].histograms.size());
+  EXPECT_EQ(10, records[0].histograms[0].sum);
+}
+
+}  // namespace base
@@ -0,0 +1,158 @@
+// Copyright 2021 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <math.h>
+
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "base/barrier_closure.h"
+#include "base/callback.h"
+#include "base/metrics/histogram.h"
+#include "base/metrics/histogram_base.h"
+#include "base/metrics/histogram_samples.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/synchronization/waitable_event.h"
+#include "base/threading/simple_thread.h"
+#include "base/timer/elapsed_timer.h"
+#include "testing/gtest/include/gtest/gtest.h"
+#include "testing/perf/perf_result_reporter.h"
+
+// This file measures the cost of recording into histograms with different
+// bucket layouts, and of recording into a single histogram from many threads
+// at once, with and without per-CPU sharded counters.
+
+namespace base {
+
+namespace {
+
+constexpr char kMetricPrefixHistogram[] = "Histogram.";
+constexpr char kMetricTimePerSample[] = "time_per_sample";
+constexpr int kNumThreads = 48;
+constexpr int kSamplesPerThread = 200000;
+constexpr int kNumSamples = 1000000;
+constexpr HistogramBase::Sample kMaxLatencyUs = 10 * 1000 * 1000;
+
+perf_test::PerfResultReporter SetUpReporter(const std::string& story_name) {
+  perf_test::PerfResultReporter reporter(kMetricPrefixHistogram, story_name);
+  reporter.RegisterImportantMetric(kMetricTimePerSample, "ns");
+  return reporter;
+}
+
+class RecordThread : public SimpleThread {
+ public:
+  // Upon entering its main function, the thread waits for |start_event| to be
+  // signaled. Then, it records |kSamplesPerThread| samples into |histogram|.
+  // Finally, it invokes |done_closure|.
+  RecordThread(WaitableEvent* start_event,
+               HistogramBase* histogram,
+               OnceClosure done_closure)
+      : SimpleThread("RecordThread"),
+        start_event_(start_event),
+        histogram_(histogram),
+        done_closure_(std::move(done_closure)) {}
+
+  // SimpleThread:
+  void Run() override {
+    start_event_->Wait();
+    for (int i = 0; i < kSamplesPerThread; ++i)
+      histogram_->Add(i % 1000);
+    std::move(done_closure_).Run();
+  }
+
+ private:
+  WaitableEvent* const start_event_;
+  HistogramBase* const histogram_;
+  OnceClosure done_closure_;
+};
+
+void RunContendedRecordPerfTest(const std::string& story_name, int32_t flags) {
+  HistogramBase* histogram =
+      Histogram::FactoryGet("Perf." + story_name, 1, 1000, 50, flags);
+
+  WaitableEvent start_event;
+  WaitableEvent end_event;
+  RepeatingClosure done_closure = BarrierClosure(
+      kNumThreads, BindOnce(&WaitableEvent::Signal, Unretained(&end_event)));
+
+  std::vector<std::unique_ptr<SimpleThread>> threads;
+  for (int i = 0; i < kNumThreads; ++i) {
+    threads.push_back(
+        std::make_unique<RecordThread>(&start_event, histogram, done_closure));
+    threads.back()->Start();
+  }
+
+  ElapsedTimer timer;
+  start_event.Signal();
+  end_event.Wait();
+  const TimeDelta elapsed = timer.Elapsed();
+
+  for (auto& thread : threads)
+    thread->Join();
+
+  EXPECT_EQ(kNumThreads * kSamplesPerThread,
+            histogram->SnapshotSamples()->TotalCount());
+
+  // Time per sample as seen by each thread, i.e. the wall time divided by the
+  // number of samples recorded by one thread.
+  auto reporter = SetUpReporter(story_name);
+  reporter.AddResult(kMetricTimePerSample,
+                     elapsed.InNanoseconds() / double{kSamplesPerThread});
+}
+
+void RunRecordPerfTest(const std::string& story_name,
+                       HistogramBase* histogram) {
+  // Log-uniformly distributed values, like latencies spanning several orders
+  // of magnitude. Generated upfront, to measure only the recording.
+  std::mt19937 generator(1);
+  std::uniform_real_distribution<double> distribution(0.0, log(kMaxLatencyUs));
+  std::vector<HistogramBase::Sample> values(kNumSamples);
+  for (HistogramBase::Sample& value : values)
+    value = static_cast<HistogramBase::Sample>(exp(distribution(generator)));
+
+  ElapsedTimer timer;
+  for (HistogramBase::Sample value : values)
+    histogram->Add(value);
+  const TimeDelta elapsed = timer.Elapsed();
+
+  EXPECT_EQ(kNumSamples, histogram->SnapshotSamples()->TotalCount());
+
+  auto reporter = SetUpReporter(story_name);
+  reporter.AddResult(kMetricTimePerSample,
+                     elapsed.InNanoseconds() / double{kNumSamples});
+}
+
+}  // namespace
+
+TEST(HistogramPerfTest, Record) {
+  RunRecordPerfTest("Record_50Buckets",
+                    Histogram::FactoryGet("Perf.Record", 1, kMaxLatencyUs, 50,
+                                          HistogramBase::kNoFlags));
+}
+
+TEST(HistogramPerfTest, RecordHdr) {
+  for (int significant_digits = HdrHistogram::kMinSignificantDigits;
+       significant_digits <= HdrHistogram::kMaxSignificantDigits;
+       ++significant_digits) {
+    const std::string suffix = NumberToString(significant_digits) + "Digits";
+    RunRecordPerfTest(
+        "RecordHdr_" + suffix,
+        HdrHistogram::FactoryGet("Perf.RecordHdr." + suffix, 1, kMaxLatencyUs,
+                                 significant_digits, HistogramBase::kNoFlags));
+  }
+}
+
+TEST(HistogramPerfTest, ContendedRecord) {
+  RunContendedRecordPerfTest("ContendedRecord_48Threads",
+                             HistogramBase::kNoFlags);
+}
+
+TEST(HistogramPerfTest, ContendedRecordSharded) {
+  RunContendedRecordPerfTest("ContendedRecordSharded_48Threads",
+                             HistogramBase::kShardedCounters);
+}
+
+}  // namespace base
@@ -8,8 +8,11 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include <algorithm>
 #include <climits>
+#include <cmath>
 #include <memory>
+#include <random>
 #include <string>
 #include <vector>
 
@@ -232,6 +235,41 @@ TEST_P(HistogramTest, FinalDeltaTest) {
   EXPECT_EQ(samples->TotalCount(), samples->redundant_count());
 }
 
+// Check that samples recorded into per-CPU shards show up in snapshots and
+// deltas.
+TEST_P(HistogramTest, ShardedCountersTest) {
+  HistogramBase* histogram =
+      Histogram::FactoryGet("ShardedHistogram", 1, 64, 8,
+                            HistogramBase::kShardedCounters);
+  EXPECT_TRUE(histogram->flags() & HistogramBase::kShardedCounters);
+  histogram->Add(1);
+  histogram->Add(10);
+  histogram->AddCount(50, 3);
+
+  std::unique_ptr<HistogramSamples> samples = histogram->SnapshotSamples();
+  EXPECT_EQ(5, samples->TotalCount());
+  EXPECT_EQ(1 + 10 + 150, samples->sum());
+
+  samples = histogram->SnapshotDelta();
+  EXPECT_EQ(5, samples->TotalCount());
+  EXPECT_EQ(1, samples->GetCount(1));
+  EXPECT_EQ(1, samples->GetCount(10));
+  EXPECT_EQ(3, samples->GetCount(50));
+  EXPECT_EQ(samples->TotalCount(), samples->redundant_count());
+
+  samples = histogram->SnapshotDelta();
+  EXPECT_EQ(0, samples->TotalCount());
+
+  histogram->Add(10);
+  samples = histogram->SnapshotFinalDelta();
+  EXPECT_EQ(1, samples->TotalCount());
+  EXPECT_EQ(1, samples->GetCount(10));
+
+  samples = histogram->SnapshotSamples();
+  EXPECT_EQ(6, samples->TotalCount());
+  EXPECT_EQ(samples->TotalCount(), samples->redundant_count());
+}
+
 TEST_P(HistogramTest, ExponentialRangesTest) {
   // Check that we got a nice exponential when there was enough room.
   BucketRanges ranges(9);
@@ -402,6 +440,105 @@ TEST_P(HistogramTest, CustomHistogramWithOnly2Buckets) {
   EXPECT_EQ(HistogramBase::kSampleType_MAX, ranges->range(2));
 }
 
+TEST_P(HistogramTest, HdrRangesTest) {
+  // With 1 significant digit, there are 32 unit buckets, then 16 buckets per
+  // power of two.
+  const uint32_t bucket_count = HdrHistogram::GetBucketCount(1, 100, 1);
+  EXPECT_EQ(58u, bucket_count);
+  BucketRanges ranges(bucket_count + 1);
+  HdrHistogram::InitializeBucketRanges(1, 100, 1, &ranges);
+  for (int i = 0; i <= 32; i++)
+    EXPECT_EQ(i, ranges.range(i));
+  EXPECT_EQ(34, ranges.range(33));
+  EXPECT_EQ(64, ranges.range(48));
+  EXPECT_EQ(68, ranges.range(49));
+  EXPECT_EQ(96, ranges.range(56));
+  EXPECT_EQ(100, ranges.range(57));
+  EXPECT_EQ(HistogramBase::kSampleType_MAX, ranges.range(58));
+
+  // The corresponding HdrHistogram should use the correct ranges.
+  Histogram* histogram = static_cast<Histogram*>(HdrHistogram::FactoryGet(
+      "Hdr", 1, 100, 1, HistogramBase::kNoFlags));
+  EXPECT_EQ(HDR_HISTOGRAM, histogram->GetHistogramType());
+  EXPECT_TRUE(ranges.Equals(histogram->bucket_ranges()));
+
+  // Every bucket in the declared range is narrower than the precision.
+  for (int significant_digits = HdrHistogram::kMinSignificantDigits;
+       significant_digits <= HdrHistogram::kMaxSignificantDigits;
+       ++significant_digits) {
+    const int kMaximum = 10 * 1000 * 1000;
+    BucketRanges wide_ranges(
+        HdrHistogram::GetBucketCount(1, kMaximum, significant_digits) + 1);
+    HdrHistogram::InitializeBucketRanges(1, kMaximum, significant_digits,
+                                         &wide_ranges);
+    const double precision = pow(10.0, -significant_digits);
+    for (size_t i = 1; i < wide_ranges.bucket_count() - 1; ++i) {
+      const double width = wide_ranges.range(i + 1) - wide_ranges.range(i);
+      ASSERT_GT(width, 0);
+      EXPECT_LE(width, std::max(1.0, wide_ranges.range(i) * precision));
+    }
+  }
+}
+
+TEST_P(HistogramTest, HdrHistogramQuantiles) {
+  const int kMaximum = 10 * 1000 * 1000;
+  const double kQuantiles[] = {0.0, 0.25, 0.5, 0.9, 0.99, 0.999, 1.0};
+
+  for (int significant_digits = HdrHistogram::kMinSignificantDigits;
+       significant_digits <= HdrHistogram::kMaxSignificantDigits;
+       ++significant_digits) {
+    HdrHistogram* histogram = static_cast<HdrHistogram*>(
+        HdrHistogram::FactoryGet(StringPrintf("Hdr%d", significant_digits), 1,
+                                 kMaximum, significant_digits,
+                                 HistogramBase::kNoFlags));
+    EXPECT_EQ(0, histogram->ValueAtQuantile(0.5));
+
+    // Log-uniformly distributed values, like latencies spanning several
+    // orders of magnitude.
+    std::mt19937 generator(significant_digits);
+    std::uniform_real_distribution<double> distribution(0.0, log(kMaximum));
+    std::vector<HistogramBase::Sample> values;
+    for (int i = 0; i < 10000; ++i) {
+      values.push_back(
+          static_cast<HistogramBase::Sample>(exp(distribution(generator))));
+      histogram->Add(values.back());
+    }
+    std::sort(values.begin(), values.end());
+
+    std::unique_ptr<HistogramSamples> delta = histogram->SnapshotDelta();
+    const double precision = pow(10.0, -significant_digits);
+    for (double quantile : kQuantiles) {
+      SCOPED_TRACE(testing::Message() << significant_digits << " digits, "
+                                      << quantile << " quantile");
+      const int64_t rank = std::max<int64_t>(
+          1, static_cast<int64_t>(ceil(quantile * values.size())));
+      const HistogramBase::Sample exact = values[rank - 1];
+      const HistogramBase::Sample estimate =
+          histogram->ValueAtQuantile(quantile);
+      EXPECT_LE(std::abs(estimate - exact), exact * precision);
+      // Deltas give the same answer.
+      EXPECT_EQ(estimate, HdrHistogram::ValueAtQuantile(*delta, quantile));
+    }
+  }
+}
+
+TEST_P(HistogramTest, HdrHistogramSerializeInfo) {
+  for (int significant_digits = HdrHistogram::kMinSignificantDigits;
+       significant_digits <= HdrHistogram::kMaxSignificantDigits;
+       ++significant_digits) {
+    HistogramBase* histogram = HdrHistogram::FactoryGet(
+        StringPrintf("Hdr%d", significant_digits), 1, 10 * 1000 * 1000,
+        significant_digits, HistogramBase::kIPCSerializationSourceFlag);
+    Pickle pickle;
+    histogram->SerializeInfo(&pickle);
+
+    // The precision is recovered from the bucket count, and the histogram of
+    // this process is found.
+    PickleIterator iter(pickle);
+    EXPECT_EQ(histogram, DeserializeHistogramInfo(&iter));
+  }
+}
+
 TEST_P(HistogramTest, AddCountTest) {
   const size_t kBucketCount = 50;
   Histogram* histogram = static_cast<Histogram*>(
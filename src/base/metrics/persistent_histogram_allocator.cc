@@ -612,6 +612,13 @@ std::unique_ptr<HistogramBase> PersistentHistogramAllocator::CreateHistogram(
           &histogram_data_ptr->logged_metadata);
       DCHECK(histogram);
       break;
+    case HDR_HISTOGRAM:
+      histogram = HdrHistogram::PersistentCreate(
+          name, histogram_minimum, histogram_maximum, ranges, counts_data,
+          logged_data, &histogram_data_ptr->samples_metadata,
+          &histogram_data_ptr->logged_metadata);
+      DCHECK(histogram);
+      break;
     default:
       return nullptr;
   }
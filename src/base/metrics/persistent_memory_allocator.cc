@@ -17,6 +17,7 @@
 #include "base/numerics/safe_conversions.h"
 #include "base/strings/string_piece.h"
 #include "base/system/sys_info.h"
+#include "base/threading/platform_thread.h"
 #include "base/threading/scoped_blocking_call.h"
 #include "build/build_config.h"
 #include "third_party/abseil-cpp/absl/types/optional.h"
@@ -65,6 +66,23 @@ enum AllocatorError : int {
   kMemoryIsCorrupt = 1,
 };
 
+// Sharded allocation reserves chunks of this size (or of the page size, if
+// smaller) and serves allocations of up to 1/kShardChunkFraction of it.
+const uint32_t kShardChunkSize = 16 << 10;  // 16 KiB
+const uint32_t kShardChunkFraction = 8;
+const size_t kNumShards = 16;
+
+uint64_t PackChunk(uint32_t cursor, uint32_t end) {
+  return (static_cast<uint64_t>(end) << 32) | cursor;
+}
+
+size_t CurrentShardIndex() {
+  // Thread ids are not necessarily dense, mix the bits a little.
+  uint64_t id = static_cast<uint64_t>(base::PlatformThread::CurrentId());
+  id *= 0x9E3779B97F4A7C15ull;
+  return static_cast<size_t>(id >> 32) % kNumShards;
+}
+
 bool CheckFlag(const volatile std::atomic<uint32_t>* flags, int flag) {
   uint32_t loaded_flags = flags->load(std::memory_order_relaxed);
   return (loaded_flags & flag) != 0;
@@ -144,6 +162,13 @@ struct PersistentMemoryAllocator::SharedMetadata {
   volatile BlockHeader queue;   // Empty block for linked-list head/tail.
 };
 
+// The current chunk of a shard, packed as (end << 32 | cursor) so that both
+// can be updated atomically. Chunks never cross page boundaries. Each shard is
+// on its own cache line.
+struct alignas(64) PersistentMemoryAllocator::Shard {
+  std::atomic<uint64_t> chunk{0};
+};
+
 // The "queue" block header is used to detect "last node" so that zero/null
 // can be used to indicate that it hasn't been added at all. It is part of
 // the SharedMetadata structure which itself is always located at offset zero.
@@ -499,6 +524,12 @@ void PersistentMemoryAllocator::CreateTrackingHistograms(
       HistogramBase::kUmaTargetedHistogramFlag);
 }
 
+void PersistentMemoryAllocator::EnableShardedAllocation() {
+  DCHECK(!readonly_);
+  if (!shards_)
+    shards_ = std::make_unique<Shard[]>(kNumShards);
+}
+
 void PersistentMemoryAllocator::Flush(bool sync) {
   FlushPartial(used(), sync);
 }
@@ -651,6 +682,82 @@ PersistentMemoryAllocator::Reference PersistentMemoryAllocator::AllocateImpl(
     return kReferenceNull;
   }
 
+  if (shards_ &&
+      size <= std::min(kShardChunkSize, mem_page_) / kShardChunkFraction) {
+    Reference ref = AllocateFromShard(size, type_id);
+    if (ref)
+      return ref;
+    // The segment may not have room for another chunk but still for this
+    // allocation.
+  }
+
+  Reference ref = ReserveSpace(&size);
+  if (!ref) {
+    if (!IsCorrupt())
+      SetFlag(&shared_meta()->flags, kFlagFull);
+    return kReferenceNull;
+  }
+  if (!InitializeBlock(ref, size, type_id))
+    return kReferenceNull;
+  return ref;
+}
+
+PersistentMemoryAllocator::Reference
+PersistentMemoryAllocator::AllocateFromShard(uint32_t size, uint32_t type_id) {
+  Shard& shard = shards_[CurrentShardIndex()];
+
+  // Only threads of the same shard compete for this value, and only for the
+  // duration of this compare-exchange.
+  uint64_t chunk = shard.chunk.load(std::memory_order_relaxed);
+  for (;;) {
+    if (IsCorrupt())
+      return kReferenceNull;
+
+    const uint32_t cursor = static_cast<uint32_t>(chunk);
+    const uint32_t end = static_cast<uint32_t>(chunk >> 32);
+    if (end - cursor < size)  // Also true for the initial, empty chunk.
+      break;
+
+    // As in ReserveSpace(), don't leave a slice too small for anything.
+    uint32_t block_size = size;
+    if (end - cursor - size < sizeof(BlockHeader) + kAllocAlignment)
+      block_size = end - cursor;
+
+    // The chunk's memory is owned by whoever advances the cursor past it, so
+    // no ordering with other memory accesses is needed.
+    if (shard.chunk.compare_exchange_weak(chunk,
+                                          PackChunk(cursor + block_size, end),
+                                          std::memory_order_relaxed,
+                                          std::memory_order_relaxed)) {
+      if (!InitializeBlock(cursor, block_size, type_id))
+        return kReferenceNull;
+      return cursor;
+    }
+  }
+
+  // The chunk is exhausted; its remainder, if any, stays unused. Reserve a
+  // new one and allocate from its start.
+  uint32_t chunk_size = std::min(kShardChunkSize, mem_page_);
+  const Reference chunk_start = ReserveSpace(&chunk_size);
+  if (!chunk_start)
+    return kReferenceNull;
+
+  // Another thread of the same shard may have installed a chunk in the
+  // meantime. In that case, the remainder of this one goes unused rather than
+  // that of the other one.
+  shard.chunk.compare_exchange_strong(
+      chunk, PackChunk(chunk_start + size, chunk_start + chunk_size),
+      std::memory_order_relaxed, std::memory_order_relaxed);
+
+  if (!InitializeBlock(chunk_start, size, type_id))
+    return kReferenceNull;
+  return chunk_start;
+}
+
+PersistentMemoryAllocator::Reference PersistentMemoryAllocator::ReserveSpace(
+    uint32_t* size_ptr) {
+  uint32_t size = *size_ptr;
+
   // Get the current start of unallocated memory. Other threads may
   // update this at any time and cause us to retry these operations.
   // This value should be treated as "const" to avoid confusion through
@@ -667,10 +774,8 @@ PersistentMemoryAllocator::Reference PersistentMemoryAllocator::AllocateImpl(
     if (IsCorrupt())
       return kReferenceNull;
 
-    if (freeptr + size > mem_size_) {
-      SetFlag(&shared_meta()->flags, kFlagFull);
+    if (freeptr + size > mem_size_)
       return kReferenceNull;
-    }
 
     // Get pointer to the "free" block. If something has been allocated since
     // the load of freeptr above, it is still safe as nothing will be written
@@ -723,51 +828,64 @@ PersistentMemoryAllocator::Reference PersistentMemoryAllocator::AllocateImpl(
       continue;
     }
 
-    // Given that all memory was zeroed before ever being given to an instance
-    // of this class and given that we only allocate in a monotomic fashion
-    // going forward, it must be that the newly allocated block is completely
-    // full of zeros. If we find anything in the block header that is NOT a
-    // zero then something must have previously run amuck through memory,
-    // writing beyond the allocated space and into unallocated space.
-    if (block->size != 0 ||
-        block->cookie != kBlockCookieFree ||
-        block->type_id.load(std::memory_order_relaxed) != 0 ||
-        block->next.load(std::memory_order_relaxed) != 0) {
-      SetCorrupt();
-      return kReferenceNull;
-    }
+    *size_ptr = size;
+    return freeptr;
+  }
+}
 
-    // Make sure the memory exists by writing to the first byte of every memory
-    // page it touches beyond the one containing the block header itself.
-    // As the underlying storage is often memory mapped from disk or shared
-    // space, sometimes things go wrong and those address don't actually exist
-    // leading to a SIGBUS (or Windows equivalent) at some arbitrary location
-    // in the code. This should concentrate all those failures into this
-    // location for easy tracking and, eventually, proper handling.
-    volatile char* mem_end = reinterpret_cast<volatile char*>(block) + size;
-    volatile char* mem_begin = reinterpret_cast<volatile char*>(
-        (reinterpret_cast<uintptr_t>(block) + sizeof(BlockHeader) +
-         (vm_page_size_ - 1)) &
-        ~static_cast<uintptr_t>(vm_page_size_ - 1));
-    for (volatile char* memory = mem_begin; memory < mem_end;
-         memory += vm_page_size_) {
-      // It's required that a memory segment start as all zeros and thus the
-      // newly allocated block is all zeros at this point. Thus, writing a
-      // zero to it allows testing that the memory exists without actually
-      // changing its contents. The compiler doesn't know about the requirement
-      // and so cannot optimize-away these writes.
-      *memory = 0;
-    }
+bool PersistentMemoryAllocator::InitializeBlock(Reference ref,
+                                                uint32_t size,
+                                                uint32_t type_id) {
+  volatile BlockHeader* const block = GetBlock(ref, 0, 0, false, true);
+  if (!block) {
+    SetCorrupt();
+    return false;
+  }
 
-    // Load information into the block header. There is no "release" of the
-    // data here because this memory can, currently, be seen only by the thread
-    // performing the allocation. When it comes time to share this, the thread
-    // will call MakeIterable() which does the release operation.
-    block->size = size;
-    block->cookie = kBlockCookieAllocated;
-    block->type_id.store(type_id, std::memory_order_relaxed);
-    return freeptr;
+  // Given that all memory was zeroed before ever being given to an instance
+  // of this class and given that we only allocate in a monotomic fashion
+  // going forward, it must be that the newly allocated block is completely
+  // full of zeros. If we find anything in the block header that is NOT a
+  // zero then something must have previously run amuck through memory,
+  // writing beyond the allocated space and into unallocated space.
+  if (block->size != 0 ||
+      block->cookie != kBlockCookieFree ||
+      block->type_id.load(std::memory_order_relaxed) != 0 ||
+      block->next.load(std::memory_order_relaxed) != 0) {
+    SetCorrupt();
+    return false;
   }
+
+  // Make sure the memory exists by writing to the first byte of every memory
+  // page it touches beyond the one containing the block header itself.
+  // As the underlying storage is often memory mapped from disk or shared
+  // space, sometimes things go wrong and those address don't actually exist
+  // leading to a SIGBUS (or Windows equivalent) at some arbitrary location
+  // in the code. This should concentrate all those failures into this
+  // location for easy tracking and, eventually, proper handling.
+  volatile char* mem_end = reinterpret_cast<volatile char*>(block) + size;
+  volatile char* mem_begin = reinterpret_cast<volatile char*>(
+      (reinterpret_cast<uintptr_t>(block) + sizeof(BlockHeader) +
+       (vm_page_size_ - 1)) &
+      ~static_cast<uintptr_t>(vm_page_size_ - 1));
+  for (volatile char* memory = mem_begin; memory < mem_end;
+       memory += vm_page_size_) {
+    // It's required that a memory segment start as all zeros and thus the
+    // newly allocated block is all zeros at this point. Thus, writing a
+    // zero to it allows testing that the memory exists without actually
+    // changing its contents. The compiler doesn't know about the requirement
+    // and so cannot optimize-away these writes.
+    *memory = 0;
+  }
+
+  // Load information into the block header. There is no "release" of the
+  // data here because this memory can, currently, be seen only by the thread
+  // performing the allocation. When it comes time to share this, the thread
+  // will call MakeIterable() which does the release operation.
+  block->size = size;
+  block->cookie = kBlockCookieAllocated;
+  block->type_id.store(type_id, std::memory_order_relaxed);
+  return true;
 }
 
 void PersistentMemoryAllocator::GetMemoryInfo(MemoryInfo* meminfo) const {
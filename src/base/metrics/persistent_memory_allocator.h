@@ -495,6 +495,16 @@ class BASE_EXPORT PersistentMemoryAllocator {
   // called before such information is to be displayed or uploaded.
   void UpdateTrackingHistograms();
 
+  // Makes this allocator carve small allocations out of chunks that are
+  // reserved from the segment's free space in bulk, one chunk per shard of
+  // threads, instead of having every allocation compete for the single
+  // "freeptr" shared by all threads and processes. The chunks are process-
+  // local; the blocks within them are regular blocks, so iteration and readers
+  // are unaffected and the memory format stays compatible. The cost is that
+  // the unused tail of each chunk counts as used space. This must be called
+  // before the allocator is used by multiple threads.
+  void EnableShardedAllocation();
+
   // While the above works much like malloc & free, these next methods provide
   // an "object" interface similar to new and delete.
 
@@ -638,6 +648,7 @@ class BASE_EXPORT PersistentMemoryAllocator {
  private:
   struct SharedMetadata;
   struct BlockHeader;
+  struct Shard;
   static const uint32_t kAllocAlignment;
   static const Reference kReferenceQueue;
 
@@ -655,6 +666,19 @@ class BASE_EXPORT PersistentMemoryAllocator {
   // Actual method for doing the allocation.
   Reference AllocateImpl(size_t size, uint32_t type_id);
 
+  // Allocates a block of |size| bytes, including the header, from the chunk of
+  // the current thread's shard, reserving a new chunk if necessary.
+  Reference AllocateFromShard(uint32_t size, uint32_t type_id);
+
+  // Reserves |size| bytes of the segment's free space, moving on to the next
+  // page if they don't fit in the current one. |size| may be increased so as
+  // to not leave an unusable slice at the end of a page. Returns a null
+  // reference if the space can't be reserved.
+  Reference ReserveSpace(uint32_t* size);
+
+  // Validates and fills in the header of a block of newly reserved space.
+  bool InitializeBlock(Reference ref, uint32_t size, uint32_t type_id);
+
   // Get the block header associated with a specific reference.
   const volatile BlockHeader* GetBlock(Reference ref, uint32_t type_id,
                                        uint32_t size, bool queue_ok,
@@ -686,6 +710,9 @@ class BASE_EXPORT PersistentMemoryAllocator {
   HistogramBase* used_histogram_;    // Histogram recording used space.
   HistogramBase* errors_histogram_;  // Histogram recording errors.
 
+  // Chunks to allocate from, if sharded allocation is enabled.
+  std::unique_ptr<Shard[]> shards_;
+
   friend class PersistentMemoryAllocatorTest;
   FRIEND_TEST_ALL_PREFIXES(PersistentMemoryAllocatorTest, AllocateAndIterate);
 };
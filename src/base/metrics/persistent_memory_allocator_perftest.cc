@@ -0,0 +1,139 @@
+// Copyright 2021 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "base/barrier_closure.h"
+#include "base/callback.h"
+#include "base/files/file.h"
+#include "base/files/memory_mapped_file.h"
+#include "base/files/scoped_temp_dir.h"
+#include "base/metrics/histogram_base.h"
+#include "base/metrics/persistent_histogram_allocator.h"
+#include "base/metrics/persistent_memory_allocator.h"
+#include "base/strings/stringprintf.h"
+#include "base/synchronization/waitable_event.h"
+#include "base/threading/simple_thread.h"
+#include "base/timer/elapsed_timer.h"
+#include "testing/gtest/include/gtest/gtest.h"
+#include "testing/perf/perf_result_reporter.h"
+
+// This file measures the throughput of creating persistent histograms from
+// many threads at once in a file-backed allocator, with and without sharded
+// allocation.
+
+namespace base {
+
+namespace {
+
+constexpr char kMetricPrefixAllocator[] = "PersistentMemoryAllocator.";
+constexpr char kMetricCreationThroughput[] = "creation_throughput";
+constexpr size_t kAllocatorSize = 64 << 20;  // 64 MiB
+constexpr int kNumThreads = 32;
+constexpr int kHistogramsPerThread = 2000;
+
+perf_test::PerfResultReporter SetUpReporter(const std::string& story_name) {
+  perf_test::PerfResultReporter reporter(kMetricPrefixAllocator, story_name);
+  reporter.RegisterImportantMetric(kMetricCreationThroughput,
+                                   "histograms/ms");
+  return reporter;
+}
+
+class CreateHistogramsThread : public SimpleThread {
+ public:
+  // Upon entering its main function, the thread waits for |start_event| to be
+  // signaled. Then, it creates |kHistogramsPerThread| sparse histograms in
+  // |allocator|. Finally, it invokes |done_closure|.
+  CreateHistogramsThread(int index,
+                         WaitableEvent* start_event,
+                         PersistentHistogramAllocator* allocator,
+                         OnceClosure done_closure)
+      : SimpleThread("CreateHistogramsThread"),
+        index_(index),
+        start_event_(start_event),
+        allocator_(allocator),
+        done_closure_(std::move(done_closure)) {}
+
+  // SimpleThread:
+  void Run() override {
+    // Format the names upfront, to measure only the allocator.
+    std::vector<std::string> names;
+    names.reserve(kHistogramsPerThread);
+    for (int i = 0; i < kHistogramsPerThread; ++i)
+      names.push_back(StringPrintf("Perf.Histogram.%d.%d", index_, i));
+
+    start_event_->Wait();
+    for (const std::string& name : names) {
+      PersistentHistogramAllocator::Reference ref;
+      std::unique_ptr<HistogramBase> histogram = allocator_->AllocateHistogram(
+          SPARSE_HISTOGRAM, name, 0, 0, nullptr, 0, &ref);
+      if (histogram)
+        allocator_->FinalizeHistogram(ref, /*registered=*/true);
+    }
+    std::move(done_closure_).Run();
+  }
+
+ private:
+  const int index_;
+  WaitableEvent* const start_event_;
+  PersistentHistogramAllocator* const allocator_;
+  OnceClosure done_closure_;
+};
+
+void RunCreateHistogramsPerfTest(const std::string& story_name, bool sharded) {
+  ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+  auto mmfile = std::make_unique<MemoryMappedFile>();
+  ASSERT_TRUE(mmfile->Initialize(
+      File(temp_dir.GetPath().AppendASCII("histograms"),
+           File::FLAG_CREATE | File::FLAG_READ | File::FLAG_WRITE),
+      {0, kAllocatorSize}, MemoryMappedFile::READ_WRITE_EXTEND));
+  auto memory_allocator = std::make_unique<FilePersistentMemoryAllocator>(
+      std::move(mmfile), kAllocatorSize, 0, "", false);
+  if (sharded)
+    memory_allocator->EnableShardedAllocation();
+  PersistentHistogramAllocator allocator(std::move(memory_allocator));
+
+  WaitableEvent start_event;
+  WaitableEvent end_event;
+  RepeatingClosure done_closure = BarrierClosure(
+      kNumThreads, BindOnce(&WaitableEvent::Signal, Unretained(&end_event)));
+
+  std::vector<std::unique_ptr<SimpleThread>> threads;
+  for (int i = 0; i < kNumThreads; ++i) {
+    threads.push_back(std::make_unique<CreateHistogramsThread>(
+        i, &start_event, &allocator, done_closure));
+    threads.back()->Start();
+  }
+
+  ElapsedTimer timer;
+  start_event.Signal();
+  end_event.Wait();
+  const TimeDelta elapsed = timer.Elapsed();
+
+  for (auto& thread : threads)
+    thread->Join();
+
+  EXPECT_FALSE(allocator.memory_allocator()->IsCorrupt());
+  EXPECT_FALSE(allocator.memory_allocator()->IsFull());
+
+  auto reporter = SetUpReporter(story_name);
+  reporter.AddResult(
+      kMetricCreationThroughput,
+      kNumThreads * kHistogramsPerThread / elapsed.InMillisecondsF());
+}
+
+}  // namespace
+
+TEST(PersistentMemoryAllocatorPerfTest, CreateHistograms) {
+  RunCreateHistogramsPerfTest("CreateHistograms_32Threads", false);
+}
+
+TEST(PersistentMemoryAllocatorPerfTest, CreateHistogramsSharded) {
+  RunCreateHistogramsPerfTest("CreateHistogramsSharded_32Threads", true);
+}
+
+}  // namespace base
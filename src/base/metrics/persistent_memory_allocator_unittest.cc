@@ -301,11 +301,15 @@ class AllocatorThread : public SimpleThread {
   AllocatorThread(const std::string& name,
                   void* base,
                   uint32_t size,
-                  uint32_t page_size)
+                  uint32_t page_size,
+                  bool sharded = false)
       : SimpleThread(name, Options()),
         count_(0),
         iterable_(0),
-        allocator_(base, size, page_size, 0, std::string(), false) {}
+        allocator_(base, size, page_size, 0, std::string(), false) {
+    if (sharded)
+      allocator_.EnableShardedAllocation();
+  }
 
   void Run() override {
     for (;;) {
@@ -367,6 +371,85 @@ TEST_F(PersistentMemoryAllocatorTest, ParallelismTest) {
             t5.iterable());
 }
 
+// Same as above but with sharded allocation, which must not lose or duplicate
+// any block.
+TEST_F(PersistentMemoryAllocatorTest, ShardedParallelismTest) {
+  void* memory = mem_segment_.get();
+  AllocatorThread t1("t1", memory, TEST_MEMORY_SIZE, TEST_MEMORY_PAGE, true);
+  AllocatorThread t2("t2", memory, TEST_MEMORY_SIZE, TEST_MEMORY_PAGE, true);
+  AllocatorThread t3("t3", memory, TEST_MEMORY_SIZE, TEST_MEMORY_PAGE, true);
+  AllocatorThread t4("t4", memory, TEST_MEMORY_SIZE, TEST_MEMORY_PAGE, true);
+  AllocatorThread t5("t5", memory, TEST_MEMORY_SIZE, TEST_MEMORY_PAGE, true);
+
+  t1.Start();
+  t2.Start();
+  t3.Start();
+  t4.Start();
+  t5.Start();
+
+  t1.Join();
+  t2.Join();
+  t3.Join();
+  t4.Join();
+  t5.Join();
+
+  EXPECT_FALSE(allocator_->IsCorrupt());
+  EXPECT_TRUE(allocator_->IsFull());
+  EXPECT_EQ(CountIterables(),
+            t1.iterable() + t2.iterable() + t3.iterable() + t4.iterable() +
+            t5.iterable());
+}
+
+// Blocks allocated from shards are regular blocks that any allocator attached
+// to the same memory can read.
+TEST_F(PersistentMemoryAllocatorTest, ShardedAllocationTest) {
+  allocator_->EnableShardedAllocation();
+
+  // Small allocations are carved out of a shared chunk, larger ones are not.
+  Reference block1 = allocator_->Allocate(sizeof(TestObject1), 1);
+  Reference block2 = allocator_->Allocate(sizeof(TestObject2), 2);
+  Reference block3 = allocator_->Allocate(TEST_MEMORY_PAGE / 4, 3);
+  ASSERT_NE(0U, block1);
+  ASSERT_NE(0U, block2);
+  ASSERT_NE(0U, block3);
+  EXPECT_LT(block1, block2);
+  EXPECT_LE(sizeof(TestObject1), allocator_->GetAllocSize(block1));
+  EXPECT_LE(sizeof(TestObject2), allocator_->GetAllocSize(block2));
+  allocator_->MakeIterable(block1);
+  allocator_->MakeIterable(block2);
+  allocator_->MakeIterable(block3);
+
+  // Fill the segment; there must be no corruption nor any lost blocks.
+  unsigned iterable_count = 3;
+  for (;;) {
+    Reference block = allocator_->Allocate(RandInt(1, 99), RandInt(100, 999));
+    if (!block)
+      break;
+    allocator_->MakeIterable(block);
+    ++iterable_count;
+  }
+  EXPECT_FALSE(allocator_->IsCorrupt());
+  EXPECT_TRUE(allocator_->IsFull());
+  EXPECT_EQ(iterable_count, CountIterables());
+
+  // A read-only, unsharded allocator sees the same blocks.
+  PersistentMemoryAllocator reader(mem_segment_.get(), TEST_MEMORY_SIZE,
+                                   TEST_MEMORY_PAGE, 0, "", true);
+  PersistentMemoryAllocator::Iterator iter(&reader);
+  uint32_t type;
+  EXPECT_EQ(block1, iter.GetNext(&type));
+  EXPECT_EQ(1U, type);
+  EXPECT_EQ(block2, iter.GetNext(&type));
+  EXPECT_EQ(2U, type);
+  EXPECT_EQ(block3, iter.GetNext(&type));
+  EXPECT_EQ(3U, type);
+  unsigned reader_count = 3;
+  while (iter.GetNext(&type) != 0)
+    ++reader_count;
+  EXPECT_EQ(iterable_count, reader_count);
+  EXPECT_FALSE(reader.IsCorrupt());
+}
+
 // A simple thread that counts objects by iterating through an allocator.
 class CounterThread : public SimpleThread {
  public:
@@ -4,15 +4,25 @@
 
 #include "base/metrics/sample_vector.h"
 
+#include <algorithm>
+
+#include "base/bits.h"
 #include "base/check_op.h"
 #include "base/lazy_instance.h"
+#include "base/memory/aligned_memory.h"
 #include "base/memory/ptr_util.h"
 #include "base/metrics/persistent_memory_allocator.h"
 #include "base/notreached.h"
 #include "base/numerics/safe_conversions.h"
 #include "base/strings/stringprintf.h"
 #include "base/synchronization/lock.h"
+#include "base/system/sys_info.h"
 #include "base/threading/platform_thread.h"
+#include "build/build_config.h"
+
+#if defined(OS_LINUX) || defined(OS_CHROMEOS) || defined(OS_ANDROID)
+#include <sched.h>
+#endif
 
 // This SampleVector makes use of the single-sample embedded in the base
 // HistogramSamples class. If the count is non-zero then there is guaranteed
@@ -480,6 +490,90 @@ PersistentSampleVector::CreateCountsStorageWhileLocked() {
   return static_cast<HistogramBase::AtomicCount*>(mem);
 }
 
+namespace {
+
+constexpr size_t kCacheLineSize = 64;
+constexpr size_t kMaxShards = 64;
+
+size_t CurrentShardIndex(size_t num_shards) {
+#if defined(OS_LINUX) || defined(OS_CHROMEOS) || defined(OS_ANDROID)
+  const int cpu = sched_getcpu();
+  if (cpu >= 0)
+    return static_cast<size_t>(cpu) % num_shards;
+#endif
+  // Thread ids are not necessarily dense, mix the bits a little.
+  uint64_t id = static_cast<uint64_t>(PlatformThread::CurrentId());
+  id *= 0x9E3779B97F4A7C15ull;
+  return static_cast<size_t>(id >> 32) % num_shards;
+}
+
+// A sample vector in local memory whose metadata and counts don't share cache
+// lines with anything else.
+class ShardSampleVector : public SampleVectorBase {
+ public:
+  struct alignas(kCacheLineSize) ShardMetadata : LocalMetadata {};
+
+  ShardSampleVector(uint64_t id, const BucketRanges* bucket_ranges)
+      : SampleVectorBase(id, new ShardMetadata(), bucket_ranges) {}
+  ShardSampleVector(const ShardSampleVector&) = delete;
+  ShardSampleVector& operator=(const ShardSampleVector&) = delete;
+
+  ~ShardSampleVector() override {
+    delete static_cast<ShardMetadata*>(meta());
+    if (counts_storage_)
+      AlignedFree(counts_storage_);
+  }
+
+ private:
+  // SampleVectorBase:
+  bool MountExistingCountsStorage() const override {
+    return counts() != nullptr;
+  }
+
+  HistogramBase::Count* CreateCountsStorageWhileLocked() override {
+    const size_t bytes = bits::AlignUp(
+        counts_size() * sizeof(HistogramBase::AtomicCount), kCacheLineSize);
+    counts_storage_ = static_cast<HistogramBase::AtomicCount*>(
+        AlignedAlloc(bytes, kCacheLineSize));
+    memset(counts_storage_, 0, bytes);
+    return counts_storage_;
+  }
+
+  HistogramBase::AtomicCount* counts_storage_ = nullptr;
+};
+
+}  // namespace
+
+ShardedSampleVector::ShardedSampleVector(uint64_t id,
+                                         const BucketRanges* bucket_ranges)
+    : id_(id), bucket_ranges_(bucket_ranges) {
+  const size_t num_shards = std::min<size_t>(
+      std::max(SysInfo::NumberOfProcessors(), 1), kMaxShards);
+  shards_.reserve(num_shards);
+  for (size_t i = 0; i < num_shards; ++i)
+    shards_.push_back(std::make_unique<ShardSampleVector>(id, bucket_ranges));
+}
+
+ShardedSampleVector::~ShardedSampleVector() = default;
+
+void ShardedSampleVector::Accumulate(Sample value, Count count) {
+  shards_[CurrentShardIndex(shards_.size())]->Accumulate(value, count);
+}
+
+void ShardedSampleVector::MoveTo(HistogramSamples* samples) {
+  AutoLock lock(move_lock_);
+  for (const std::unique_ptr<SampleVectorBase>& shard : shards_) {
+    if (shard->redundant_count() == 0)
+      continue;
+    // As with Histogram::SnapshotDelta(), subtract exactly what was copied so
+    // that concurrently recorded samples are kept in the shard.
+    SampleVector snapshot(id_, bucket_ranges_);
+    snapshot.Add(*shard);
+    shard->Subtract(snapshot);
+    samples->Add(snapshot);
+  }
+}
+
 SampleVectorIterator::SampleVectorIterator(
     const std::vector<HistogramBase::AtomicCount>* counts,
     const BucketRanges* bucket_ranges)
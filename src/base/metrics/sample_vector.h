@@ -22,6 +22,7 @@
 #include "base/metrics/histogram_base.h"
 #include "base/metrics/histogram_samples.h"
 #include "base/metrics/persistent_memory_allocator.h"
+#include "base/synchronization/lock.h"
 
 namespace base {
 
@@ -167,6 +168,41 @@ class BASE_EXPORT PersistentSampleVector : public SampleVectorBase {
   DelayedPersistentAllocation persistent_counts_;
 };
 
+// Per-CPU shards of a sample vector, for histograms that are recorded into
+// concurrently by many threads. Each shard keeps its own counts, sum and
+// redundant count on separate cache lines, so that recording only touches
+// lines that are mostly private to the current CPU. Where the current CPU
+// can't be determined, shards are picked by thread instead.
+//
+// The shards live in local memory. Their samples only become visible in
+// another sample vector, possibly a persistent one, when moved there with
+// MoveTo().
+class BASE_EXPORT ShardedSampleVector {
+ public:
+  ShardedSampleVector(uint64_t id, const BucketRanges* bucket_ranges);
+  ShardedSampleVector(const ShardedSampleVector&) = delete;
+  ShardedSampleVector& operator=(const ShardedSampleVector&) = delete;
+  ~ShardedSampleVector();
+
+  // Records |count| samples of |value| into the shard of the current CPU.
+  void Accumulate(HistogramBase::Sample value, HistogramBase::Count count);
+
+  // Moves all samples recorded so far into |samples|. Samples recorded
+  // concurrently are either moved or kept for the next call, never lost.
+  void MoveTo(HistogramSamples* samples);
+
+  size_t num_shards() const { return shards_.size(); }
+
+ private:
+  const uint64_t id_;
+  const BucketRanges* const bucket_ranges_;
+
+  // Serializes MoveTo(), which would otherwise move the same samples twice.
+  Lock move_lock_;
+
+  std::vector<std::unique_ptr<SampleVectorBase>> shards_;
+};
+
 // An iterator for sample vectors. This could be defined privately in the .cc
 // file but is here for easy testing.
 class BASE_EXPORT SampleVectorIterator : public SampleCountIterator {
@@ -14,6 +14,7 @@
 #include "base/metrics/bucket_ranges.h"
 #include "base/metrics/histogram.h"
 #include "base/metrics/persistent_memory_allocator.h"
+#include "base/threading/simple_thread.h"
 #include "base/test/gtest_util.h"
 #include "testing/gtest/include/gtest/gtest.h"
 
@@ -556,4 +557,56 @@ TEST_F(SampleVectorTest, GetPeakBucketSize) {
   EXPECT_EQ(3, samples.GetPeakBucketSize());
 }
 
+// Tests that samples recorded into shards from several threads are all moved,
+// with the right sum, and only once.
+TEST_F(SampleVectorTest, ShardedSampleVector) {
+  // Custom buckets: [1, 5) [5, 10) [10, 20)
+  BucketRanges ranges(4);
+  ranges.set_range(0, 1);
+  ranges.set_range(1, 5);
+  ranges.set_range(2, 10);
+  ranges.set_range(3, 20);
+  ShardedSampleVector sharded(1, &ranges);
+  EXPECT_LE(1u, sharded.num_shards());
+
+  class RecordThread : public SimpleThread {
+   public:
+    explicit RecordThread(ShardedSampleVector* sharded)
+        : SimpleThread("RecordThread"), sharded_(sharded) {}
+    void Run() override {
+      for (int i = 0; i < 1000; ++i) {
+        sharded_->Accumulate(3, 1);
+        sharded_->Accumulate(12, 2);
+      }
+    }
+
+   private:
+    ShardedSampleVector* const sharded_;
+  };
+  std::vector<std::unique_ptr<RecordThread>> threads;
+  for (int i = 0; i < 8; ++i) {
+    threads.push_back(std::make_unique<RecordThread>(&sharded));
+    threads.back()->Start();
+  }
+  for (auto& thread : threads)
+    thread->Join();
+
+  SampleVector samples(1, &ranges);
+  sharded.MoveTo(&samples);
+  EXPECT_EQ(8000, samples.GetCount(3));
+  EXPECT_EQ(16000, samples.GetCount(12));
+  EXPECT_EQ(24000, samples.TotalCount());
+  EXPECT_EQ(samples.TotalCount(), samples.redundant_count());
+  EXPECT_EQ(8000 * 3 + 16000 * 12, samples.sum());
+
+  // Nothing is left to move.
+  sharded.MoveTo(&samples);
+  EXPECT_EQ(24000, samples.TotalCount());
+
+  sharded.Accumulate(6, 1);
+  sharded.MoveTo(&samples);
+  EXPECT_EQ(1, samples.GetCount(6));
+  EXPECT_EQ(24001, samples.redundant_count());
+}
+
 }  // namespace base
@@ -8,7 +8,9 @@
 
 #include "base/at_exit.h"
 #include "base/containers/contains.h"
+#include "base/bits.h"
 #include "base/debug/leak_annotations.h"
+#include "base/hash/hash.h"
 #include "base/json/string_escape.h"
 #include "base/logging.h"
 #include "base/memory/ptr_util.h"
@@ -29,14 +31,84 @@ bool HistogramNameLesser(const base::HistogramBase* a,
   return strcmp(a->histogram_name(), b->histogram_name()) < 0;
 }
 
+// The index is replaced by one twice as large when it becomes half full.
+constexpr size_t kMinIndexCapacity = 1024;
+
 }  // namespace
 
+// Lookups may run concurrently with one writer, which holds the global lock.
+// Slots are only ever filled, never cleared, so a lookup can stop at the first
+// empty slot of the probe sequence.
+class StatisticsRecorder::HistogramIndex {
+ public:
+  explicit HistogramIndex(size_t capacity)
+      : mask_(capacity - 1), slots_(new Slot[capacity]) {
+    DCHECK(bits::IsPowerOfTwo(capacity));
+  }
+  HistogramIndex(const HistogramIndex&) = delete;
+  HistogramIndex& operator=(const HistogramIndex&) = delete;
+  ~HistogramIndex() = default;
+
+  HistogramBase* Find(StringPiece name) const {
+    const size_t hash = FastHash(name);
+    for (size_t i = hash;; ++i) {
+      const Slot& slot = slots_[i & mask_];
+      HistogramBase* const histogram =
+          slot.histogram.load(std::memory_order_acquire);
+      if (!histogram)
+        return nullptr;
+      if (slot.hash.load(std::memory_order_relaxed) == hash &&
+          name == histogram->histogram_name()) {
+        return histogram;
+      }
+    }
+  }
+
+  // Returns false, without adding |histogram|, if the index is half full.
+  bool Add(HistogramBase* histogram) {
+    if ((size_ + 1) * 2 > mask_ + 1)
+      return false;
+    const size_t hash = FastHash(histogram->histogram_name());
+    for (size_t i = hash;; ++i) {
+      Slot& slot = slots_[i & mask_];
+      if (slot.histogram.load(std::memory_order_relaxed))
+        continue;
+      // The release store of the histogram publishes the hash.
+      slot.hash.store(hash, std::memory_order_relaxed);
+      slot.histogram.store(histogram, std::memory_order_release);
+      ++size_;
+      return true;
+    }
+  }
+
+  size_t capacity() const { return mask_ + 1; }
+
+ private:
+  struct Slot {
+    std::atomic<size_t> hash{0};
+    std::atomic<HistogramBase*> histogram{nullptr};
+  };
+
+  const size_t mask_;
+  const std::unique_ptr<Slot[]> slots_;
+  // Only accessed by the writer.
+  size_t size_ = 0;
+};
+
 // static
 LazyInstance<absl::Mutex>::Leaky StatisticsRecorder::lock_;
 
 // static
 StatisticsRecorder* StatisticsRecorder::top_ = nullptr;
 
+// static
+std::atomic<StatisticsRecorder::HistogramIndex*>
+    StatisticsRecorder::top_index_{nullptr};
+
+// static
+LazyInstance<std::vector<std::unique_ptr<StatisticsRecorder::HistogramIndex>>>::
+    Leaky StatisticsRecorder::published_indices_;
+
 // static
 bool StatisticsRecorder::is_vlog_initialized_ = false;
 
@@ -81,6 +153,7 @@ StatisticsRecorder::~StatisticsRecorder() {
   const absl::MutexLock auto_lock(lock_.Pointer());
   DCHECK_EQ(this, top_);
   top_ = previous_;
+  top_index_.store(top_ ? top_->index_ : nullptr, std::memory_order_release);
 }
 
 // static
@@ -106,18 +179,28 @@ void StatisticsRecorder::RegisterHistogramProvider(
 // static
 HistogramBase* StatisticsRecorder::RegisterOrDeleteDuplicate(
     HistogramBase* histogram) {
+  const char* const name = histogram->histogram_name();
+
+  // Most calls are for histograms that are already registered, typically
+  // because they lost a creation race; these don't need the lock.
+  if (HistogramBase* const registered = FindHistogramInIndex(name)) {
+    if (registered != histogram)
+      delete histogram;
+    return registered;
+  }
+
   // Declared before |auto_lock| to ensure correct destruction order.
   std::unique_ptr<HistogramBase> histogram_deleter;
   const absl::MutexLock auto_lock(lock_.Pointer());
   EnsureGlobalRecorderWhileLocked();
 
-  const char* const name = histogram->histogram_name();
   HistogramBase*& registered = top_->histograms_[name];
 
   if (!registered) {
     // |name| is guaranteed to never change or be deallocated so long
     // as the histogram is alive (which is forever).
     registered = histogram;
+    top_->AddToIndexWhileLocked(histogram);
     ANNOTATE_LEAKING_OBJECT_PTR(histogram);  // see crbug.com/79322
     // If there are callbacks for this histogram, we set the kCallbackExists
     // flag.
@@ -204,17 +287,16 @@ HistogramBase* StatisticsRecorder::FindHistogram(base::StringPiece name) {
   // methods will acquire the lock at that time.
   ImportGlobalPersistentHistograms();
 
-  // Acquire the lock in "read" mode since we're only reading the data, not
-  // modifying anything. This allows multiple readers to look up histograms
-  // concurrently.
-  const absl::ReaderMutexLock auto_lock(lock_.Pointer());
-  if (top_) {
-    const HistogramMap::const_iterator it = top_->histograms_.find(name);
-    return it != top_->histograms_.end() ? it->second : nullptr;
-  }
-  // If we're here, |top_| was null (no StatisticsRecorder instance), so the
+  return FindHistogramInIndex(name);
+}
+
+// static
+HistogramBase* StatisticsRecorder::FindHistogramInIndex(StringPiece name) {
+  const HistogramIndex* const index =
+      top_index_.load(std::memory_order_acquire);
+  // If there is no index, there is no StatisticsRecorder instance, so the
   // histogram also doesn't exist.
-  return nullptr;
+  return index ? index->Find(name) : nullptr;
 }
 
 // static
@@ -367,6 +449,7 @@ void StatisticsRecorder::ForgetHistogramForTesting(base::StringPiece name) {
   }
 
   top_->histograms_.erase(found);
+  top_->PublishIndexWhileLocked(top_->BuildIndexWhileLocked());
 }
 
 // static
@@ -459,9 +542,42 @@ StatisticsRecorder::StatisticsRecorder() {
   lock_.Get().AssertHeld();
   previous_ = top_;
   top_ = this;
+  PublishIndexWhileLocked(std::make_unique<HistogramIndex>(kMinIndexCapacity));
   InitLogOnShutdownWhileLocked();
 }
 
+void StatisticsRecorder::AddToIndexWhileLocked(HistogramBase* histogram) {
+  lock_.Get().AssertHeld();
+  if (!index_->Add(histogram)) {
+    // |histograms_| already has |histogram|.
+    PublishIndexWhileLocked(BuildIndexWhileLocked());
+  }
+}
+
+std::unique_ptr<StatisticsRecorder::HistogramIndex>
+StatisticsRecorder::BuildIndexWhileLocked() const {
+  lock_.Get().AssertHeld();
+  // Leave room for as many histograms again before the index is half full.
+  size_t capacity = kMinIndexCapacity;
+  while (capacity < histograms_.size() * 4)
+    capacity *= 2;
+  auto index = std::make_unique<HistogramIndex>(capacity);
+  for (const auto& entry : histograms_) {
+    const bool added = index->Add(entry.second);
+    DCHECK(added);
+  }
+  return index;
+}
+
+void StatisticsRecorder::PublishIndexWhileLocked(
+    std::unique_ptr<HistogramIndex> index) {
+  lock_.Get().AssertHeld();
+  index_ = index.get();
+  published_indices_.Get().push_back(std::move(index));
+  if (top_ == this)
+    top_index_.store(index_, std::memory_order_release);
+}
+
 // static
 void StatisticsRecorder::InitLogOnShutdownWhileLocked() {
   lock_.Get().AssertHeld();
@@ -169,7 +169,9 @@ class BASE_EXPORT StatisticsRecorder {
   // Finds a histogram by name. Matches the exact name. Returns a null pointer
   // if a matching histogram is not found.
   //
-  // This method is thread safe.
+  // This method is thread safe. It takes no lock: lookups go through an index
+  // of the registered histograms that is only ever appended to, or replaced as
+  // a whole, while the global lock is held.
   static HistogramBase* FindHistogram(base::StringPiece name);
 
   // Imports histograms from providers.
@@ -319,6 +321,10 @@ class BASE_EXPORT StatisticsRecorder {
       unordered_set<const BucketRanges*, BucketRangesHash, BucketRangesEqual>
           RangesMap;
 
+  // Open-addressing hash table of the registered histograms, for lock-free
+  // lookups by name. Defined in the .cc file.
+  class HistogramIndex;
+
   friend class StatisticsRecorderTest;
   FRIEND_TEST_ALL_PREFIXES(StatisticsRecorderTest, IterationTest);
 
@@ -351,12 +357,32 @@ class BASE_EXPORT StatisticsRecorder {
   static void InitLogOnShutdownWhileLocked()
       EXCLUSIVE_LOCKS_REQUIRED(lock_.Pointer());
 
+  // Looks up |name| in the index of the global recorder without locking.
+  static HistogramBase* FindHistogramInIndex(StringPiece name);
+
+  // Adds |histogram| to the index, replacing the index with a larger one if
+  // it's getting full.
+  void AddToIndexWhileLocked(HistogramBase* histogram)
+      EXCLUSIVE_LOCKS_REQUIRED(lock_.Pointer());
+
+  // Builds an index of |histograms_|.
+  std::unique_ptr<HistogramIndex> BuildIndexWhileLocked() const
+      EXCLUSIVE_LOCKS_REQUIRED(lock_.Pointer());
+
+  // Makes |index| the index of this recorder and, if this is the global
+  // recorder, the one used for lookups.
+  void PublishIndexWhileLocked(std::unique_ptr<HistogramIndex> index)
+      EXCLUSIVE_LOCKS_REQUIRED(lock_.Pointer());
+
   HistogramMap histograms_;
   ObserverMap observers_;
   RangesMap ranges_;
   HistogramProviders providers_;
   std::unique_ptr<RecordHistogramChecker> record_checker_;
 
+  // Index of |histograms_|, owned by |published_indices_|.
+  HistogramIndex* index_ = nullptr;
+
   // Previous global recorder that existed when this one was created.
   StatisticsRecorder* previous_ = nullptr;
 
@@ -369,6 +395,16 @@ class BASE_EXPORT StatisticsRecorder {
   // previous global recorder is referenced by top_->previous_.
   static StatisticsRecorder* top_ GUARDED_BY(lock_.Pointer());
 
+  // Index of |top_|, or null if there is no global recorder. Written while
+  // holding |lock_|, read without it.
+  static std::atomic<HistogramIndex*> top_index_;
+
+  // Every index that was ever published. Lookups may still be reading an index
+  // after it was replaced, or after its recorder was destroyed, so they are
+  // intentionally leaked.
+  static LazyInstance<std::vector<std::unique_ptr<HistogramIndex>>>::Leaky
+      published_indices_ GUARDED_BY(lock_.Pointer());
+
   // Tracks whether InitLogOnShutdownWhileLocked() has registered a logging
   // function that will be called when the program finishes.
   static bool is_vlog_initialized_;
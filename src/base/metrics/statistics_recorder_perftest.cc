@@ -0,0 +1,113 @@
+// Copyright 2021 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "base/barrier_closure.h"
+#include "base/callback.h"
+#include "base/metrics/histogram_functions.h"
+#include "base/metrics/statistics_recorder.h"
+#include "base/strings/stringprintf.h"
+#include "base/synchronization/waitable_event.h"
+#include "base/threading/simple_thread.h"
+#include "base/timer/elapsed_timer.h"
+#include "testing/gtest/include/gtest/gtest.h"
+#include "testing/perf/perf_result_reporter.h"
+
+// This file measures the cost of recording through the histogram functions,
+// which look up the histogram by name in the StatisticsRecorder on every call,
+// from many threads at once.
+
+namespace base {
+
+namespace {
+
+constexpr char kMetricPrefixStatisticsRecorder[] = "StatisticsRecorder.";
+constexpr char kMetricTimePerSample[] = "time_per_sample";
+constexpr int kNumThreads = 32;
+constexpr int kNumHistograms = 1000;
+constexpr int kSamplesPerThread = 100000;
+
+perf_test::PerfResultReporter SetUpReporter(const std::string& story_name) {
+  perf_test::PerfResultReporter reporter(kMetricPrefixStatisticsRecorder,
+                                         story_name);
+  reporter.RegisterImportantMetric(kMetricTimePerSample, "ns");
+  return reporter;
+}
+
+class RecordThread : public SimpleThread {
+ public:
+  // Upon entering its main function, the thread waits for |start_event| to be
+  // signaled. Then, it records |kSamplesPerThread| samples, spread over the
+  // histograms named in |names|. Finally, it invokes |done_closure|.
+  RecordThread(WaitableEvent* start_event,
+               const std::vector<std::string>* names,
+               OnceClosure done_closure)
+      : SimpleThread("RecordThread"),
+        start_event_(start_event),
+        names_(names),
+        done_closure_(std::move(done_closure)) {}
+
+  // SimpleThread:
+  void Run() override {
+    start_event_->Wait();
+    for (int i = 0; i < kSamplesPerThread; ++i)
+      UmaHistogramCounts1M((*names_)[i % kNumHistograms], i);
+    std::move(done_closure_).Run();
+  }
+
+ private:
+  WaitableEvent* const start_event_;
+  const std::vector<std::string>* const names_;
+  OnceClosure done_closure_;
+};
+
+}  // namespace
+
+TEST(StatisticsRecorderPerfTest, ContendedLookup) {
+  std::unique_ptr<StatisticsRecorder> statistics_recorder =
+      StatisticsRecorder::CreateTemporaryForTesting();
+
+  // Format the names and register the histograms upfront, to measure only the
+  // lookups.
+  std::vector<std::string> names;
+  names.reserve(kNumHistograms);
+  for (int i = 0; i < kNumHistograms; ++i) {
+    names.push_back(StringPrintf("Perf.Lookup.%d", i));
+    UmaHistogramCounts1M(names.back(), 0);
+  }
+
+  WaitableEvent start_event;
+  WaitableEvent end_event;
+  RepeatingClosure done_closure = BarrierClosure(
+      kNumThreads, BindOnce(&WaitableEvent::Signal, Unretained(&end_event)));
+
+  std::vector<std::unique_ptr<SimpleThread>> threads;
+  for (int i = 0; i < kNumThreads; ++i) {
+    threads.push_back(
+        std::make_unique<RecordThread>(&start_event, &names, done_closure));
+    threads.back()->Start();
+  }
+
+  ElapsedTimer timer;
+  start_event.Signal();
+  end_event.Wait();
+  const TimeDelta elapsed = timer.Elapsed();
+
+  for (auto& thread : threads)
+    thread->Join();
+
+  EXPECT_EQ(static_cast<size_t>(kNumHistograms),
+            StatisticsRecorder::GetHistogramCount());
+
+  // Time per sample as seen by each thread, i.e. the wall time divided by the
+  // number of samples recorded by one thread.
+  auto reporter = SetUpReporter("ContendedLookup_32Threads");
+  reporter.AddResult(kMetricTimePerSample,
+                     elapsed.InNanoseconds() / double{kSamplesPerThread});
+}
+
+}  // namespace base
@@ -20,6 +20,7 @@
 #include "base/metrics/persistent_histogram_allocator.h"
 #include "base/metrics/record_histogram_checker.h"
 #include "base/metrics/sparse_histogram.h"
+#include "base/strings/stringprintf.h"
 #include "base/test/task_environment.h"
 #include "base/values.h"
 #include "testing/gmock/include/gmock/gmock.h"
@@ -277,6 +278,36 @@ TEST_P(StatisticsRecorderTest, FindHistogram) {
   EXPECT_FALSE(StatisticsRecorder::FindHistogram("TestHistogram"));
 }
 
+// Lookups keep working while the index of registered histograms grows, and
+// after histograms are forgotten.
+TEST_P(StatisticsRecorderTest, FindHistogramManyHistograms) {
+  constexpr int kNumHistograms = 3000;
+  std::vector<HistogramBase*> histograms;
+  for (int i = 0; i < kNumHistograms; ++i) {
+    const std::string name = StringPrintf("TestHistogram.Many.%d", i);
+    HistogramBase* histogram =
+        Histogram::FactoryGet(name, 1, 1000, 10, HistogramBase::kNoFlags);
+    histograms.push_back(histogram);
+    ASSERT_EQ(histogram, StatisticsRecorder::FindHistogram(name));
+  }
+  for (int i = 0; i < kNumHistograms; ++i) {
+    EXPECT_EQ(histograms[i], StatisticsRecorder::FindHistogram(
+                                 StringPrintf("TestHistogram.Many.%d", i)));
+  }
+
+  // A duplicate is deleted in favor of the registered histogram.
+  EXPECT_EQ(histograms[7], StatisticsRecorder::RegisterOrDeleteDuplicate(
+                               CreateHistogram("TestHistogram.Many.7", 1, 1000,
+                                               10)));
+
+  StatisticsRecorder::ForgetHistogramForTesting("TestHistogram.Many.7");
+  EXPECT_FALSE(StatisticsRecorder::FindHistogram("TestHistogram.Many.7"));
+  EXPECT_EQ(histograms[8],
+            StatisticsRecorder::FindHistogram("TestHistogram.Many.8"));
+  EXPECT_EQ(static_cast<size_t>(kNumHistograms - 1),
+            StatisticsRecorder::GetHistogramCount());
+}
+
 TEST_P(StatisticsRecorderTest, WithName) {
   Histogram::FactoryGet("TestHistogram1", 1, 1000, 10, Histogram::kNoFlags);
   Histogram::FactoryGet("TestHistogram2", 1, 1000, 10, Histogram::kNoFlags);
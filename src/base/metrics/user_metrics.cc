@@ -6,13 +6,25 @@
 
 #include <stddef.h>
 
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <utility>
 #include <vector>
 
 #include "base/bind.h"
 #include "base/lazy_instance.h"
 #include "base/location.h"
+#include "base/metrics/metrics_hashes.h"
+#include "base/no_destructor.h"
+#include "base/rand_util.h"
+#include "base/strings/string_piece.h"
+#include "base/synchronization/lock.h"
+#include "base/thread_annotations.h"
 #include "base/threading/thread_checker.h"
+#include "base/threading/thread_local.h"
 #include "base/time/time.h"
+#include "base/timer/timer.h"
 #include "base/trace_event/base_tracing.h"
 
 namespace base {
@@ -23,6 +35,187 @@ LazyInstance<std::vector<ActionCallback>>::DestructorAtExit g_callbacks =
 LazyInstance<scoped_refptr<SingleThreadTaskRunner>>::DestructorAtExit
     g_task_runner = LAZY_INSTANCE_INITIALIZER;
 
+// Sampling thresholds are compared to 32-bit random numbers, so that a
+// sampling rate of 1 maps to a threshold above all of them.
+constexpr uint64_t kSamplingRange = uint64_t{1} << 32;
+
+// Buffers the actions recorded in batching mode and delivers them to the
+// batch callbacks. Actions are appended to a buffer owned by the recording
+// thread, which only contends with the flushes, and buffers are drained on
+// the task runner.
+class ActionBatcher {
+ public:
+  static ActionBatcher* GetInstance() {
+    static NoDestructor<ActionBatcher> instance;
+    return instance.get();
+  }
+
+  ActionBatcher(const ActionBatcher&) = delete;
+  ActionBatcher& operator=(const ActionBatcher&) = delete;
+
+  bool enabled() const { return enabled_.load(std::memory_order_relaxed); }
+
+  void Enable(const ActionBatchingOptions& options) {
+    DCHECK_GT(options.buffer_size, 0u);
+    DCHECK_GE(options.sampling_rate, 0.0);
+    DCHECK_LE(options.sampling_rate, 1.0);
+    DCHECK(options.flush_interval.is_positive());
+
+    buffer_size_.store(options.buffer_size, std::memory_order_relaxed);
+    sampling_threshold_.store(
+        static_cast<uint64_t>(options.sampling_rate * kSamplingRange),
+        std::memory_order_relaxed);
+    enabled_.store(true, std::memory_order_relaxed);
+    timer_.Start(FROM_HERE, options.flush_interval,
+                 BindRepeating(&ActionBatcher::Flush, Unretained(this)));
+  }
+
+  void Disable() {
+    enabled_.store(false, std::memory_order_relaxed);
+    timer_.Stop();
+    Flush();
+  }
+
+  void Record(StringPiece action, TimeTicks action_time) {
+    ThreadBuffer* buffer = thread_buffer_.Get();
+    if (!buffer) {
+      auto new_buffer = std::make_unique<ThreadBuffer>(this);
+      buffer = new_buffer.get();
+      thread_buffer_.Set(std::move(new_buffer));
+    }
+
+    if (!buffer->ShouldSample(
+            sampling_threshold_.load(std::memory_order_relaxed))) {
+      return;
+    }
+
+    // Hashing is the most expensive part of recording, so it is only done for
+    // the sampled actions.
+    const size_t size =
+        buffer->Append({HashMetricName(action), action_time});
+    // Only one flush is requested at a time, however many threads fill their
+    // buffers meanwhile. The buffer size is thus a threshold rather than a
+    // limit: a buffer keeps growing until the flush drains it.
+    if (size >= buffer_size_.load(std::memory_order_relaxed) &&
+        !flush_pending_.exchange(true, std::memory_order_relaxed)) {
+      g_task_runner.Get()->PostTask(
+          FROM_HERE, BindOnce(&ActionBatcher::Flush, Unretained(this)));
+    }
+  }
+
+  void Flush() {
+    flush_pending_.store(false, std::memory_order_relaxed);
+
+    std::vector<RecordedAction> actions;
+    {
+      AutoLock auto_lock(lock_);
+      // The actions of exited threads were recorded before those that are
+      // still buffered by these threads, if any.
+      actions.swap(orphaned_actions_);
+      for (ThreadBuffer* buffer : buffers_)
+        buffer->TakeActions(&actions);
+    }
+
+    if (actions.empty())
+      return;
+    for (const ActionBatchCallback& callback : callbacks_)
+      callback.Run(actions);
+  }
+
+  void AddCallback(const ActionBatchCallback& callback) {
+    callbacks_.push_back(callback);
+  }
+
+  void RemoveCallback(const ActionBatchCallback& callback) {
+    auto it = std::find(callbacks_.begin(), callbacks_.end(), callback);
+    if (it != callbacks_.end())
+      callbacks_.erase(it);
+  }
+
+ private:
+  friend class NoDestructor<ActionBatcher>;
+
+  // The actions recorded by a thread and not delivered yet. Deleted when the
+  // thread exits.
+  class ThreadBuffer {
+   public:
+    explicit ThreadBuffer(ActionBatcher* batcher)
+        : batcher_(batcher), random_state_(RandUint64() | 1) {
+      batcher_->RegisterBuffer(this);
+    }
+
+    ThreadBuffer(const ThreadBuffer&) = delete;
+    ThreadBuffer& operator=(const ThreadBuffer&) = delete;
+
+    ~ThreadBuffer() { batcher_->UnregisterBuffer(this); }
+
+    // Draws whether to record an action. Only called on the owning thread.
+    bool ShouldSample(uint64_t threshold) {
+      if (threshold >= kSamplingRange)
+        return true;
+      // xorshift64, since a system call per action would defeat the purpose
+      // of sampling.
+      random_state_ ^= random_state_ << 13;
+      random_state_ ^= random_state_ >> 7;
+      random_state_ ^= random_state_ << 17;
+      return (random_state_ >> 32) < threshold;
+    }
+
+    // Returns the number of buffered actions.
+    size_t Append(const RecordedAction& action) {
+      AutoLock auto_lock(lock_);
+      actions_.push_back(action);
+      return actions_.size();
+    }
+
+    // Moves the buffered actions to the end of |actions|.
+    void TakeActions(std::vector<RecordedAction>* actions) {
+      AutoLock auto_lock(lock_);
+      actions->insert(actions->end(), actions_.begin(), actions_.end());
+      actions_.clear();
+    }
+
+   private:
+    ActionBatcher* const batcher_;
+    uint64_t random_state_;
+    Lock lock_;
+    std::vector<RecordedAction> actions_ GUARDED_BY(lock_);
+  };
+
+  ActionBatcher() = default;
+  ~ActionBatcher() = default;
+
+  void RegisterBuffer(ThreadBuffer* buffer) {
+    AutoLock auto_lock(lock_);
+    buffers_.push_back(buffer);
+  }
+
+  // Keeps the actions of |buffer| for the next flush.
+  void UnregisterBuffer(ThreadBuffer* buffer) {
+    AutoLock auto_lock(lock_);
+    buffer->TakeActions(&orphaned_actions_);
+    auto it = std::find(buffers_.begin(), buffers_.end(), buffer);
+    DCHECK(it != buffers_.end());
+    buffers_.erase(it);
+  }
+
+  std::atomic<bool> enabled_{false};
+  std::atomic<size_t> buffer_size_{0};
+  std::atomic<uint64_t> sampling_threshold_{kSamplingRange};
+  std::atomic<bool> flush_pending_{false};
+
+  ThreadLocalOwnedPointer<ThreadBuffer> thread_buffer_;
+
+  // Acquired before the lock of a ThreadBuffer.
+  Lock lock_;
+  std::vector<ThreadBuffer*> buffers_ GUARDED_BY(lock_);
+  std::vector<RecordedAction> orphaned_actions_ GUARDED_BY(lock_);
+
+  // Only used on the task runner.
+  RepeatingTimer timer_;
+  std::vector<ActionBatchCallback> callbacks_;
+};
+
 }  // namespace
 
 void RecordAction(const UserMetricsAction& action) {
@@ -41,6 +234,12 @@ void RecordComputedActionSince(const std::string& action,
 void RecordComputedActionAt(const std::string& action, TimeTicks action_time) {
   TRACE_EVENT_INSTANT1("ui", "UserEvent", TRACE_EVENT_SCOPE_GLOBAL, "action",
                        action);
+  ActionBatcher* batcher = ActionBatcher::GetInstance();
+  if (batcher->enabled()) {
+    batcher->Record(action, action_time);
+    return;
+  }
+
   if (!g_task_runner.Get()) {
     DCHECK(g_callbacks.Get().empty());
     return;
@@ -61,6 +260,8 @@ void AddActionCallback(const ActionCallback& callback) {
   // Only allow adding a callback if the task runner is set.
   DCHECK(g_task_runner.Get());
   DCHECK(g_task_runner.Get()->BelongsToCurrentThread());
+  // ActionCallbacks aren't run in batching mode.
+  DCHECK(!ActionBatcher::GetInstance()->enabled());
   g_callbacks.Get().push_back(callback);
 }
 
@@ -76,6 +277,37 @@ void RemoveActionCallback(const ActionCallback& callback) {
   }
 }
 
+void EnableActionBatching(const ActionBatchingOptions& options) {
+  DCHECK(g_task_runner.Get());
+  DCHECK(g_task_runner.Get()->BelongsToCurrentThread());
+  DCHECK(g_callbacks.Get().empty());
+  ActionBatcher::GetInstance()->Enable(options);
+}
+
+void DisableActionBatching() {
+  DCHECK(g_task_runner.Get());
+  DCHECK(g_task_runner.Get()->BelongsToCurrentThread());
+  ActionBatcher::GetInstance()->Disable();
+}
+
+void FlushActionBatches() {
+  DCHECK(g_task_runner.Get());
+  DCHECK(g_task_runner.Get()->BelongsToCurrentThread());
+  ActionBatcher::GetInstance()->Flush();
+}
+
+void AddActionBatchCallback(const ActionBatchCallback& callback) {
+  DCHECK(g_task_runner.Get());
+  DCHECK(g_task_runner.Get()->BelongsToCurrentThread());
+  ActionBatcher::GetInstance()->AddCallback(callback);
+}
+
+void RemoveActionBatchCallback(const ActionBatchCallback& callback) {
+  DCHECK(g_task_runner.Get());
+  DCHECK(g_task_runner.Get()->BelongsToCurrentThread());
+  ActionBatcher::GetInstance()->RemoveCallback(callback);
+}
+
 void SetRecordActionTaskRunner(
     scoped_refptr<SingleThreadTaskRunner> task_runner) {
   DCHECK(task_runner->BelongsToCurrentThread());
@@ -5,17 +5,20 @@
 #ifndef BASE_METRICS_USER_METRICS_H_
 #define BASE_METRICS_USER_METRICS_H_
 
+#include <stddef.h>
+#include <stdint.h>
+
 #include <string>
+#include <vector>
 
 #include "base/base_export.h"
 #include "base/callback.h"
 #include "base/metrics/user_metrics_action.h"
 #include "base/task/single_thread_task_runner.h"
+#include "base/time/time.h"
 
 namespace base {
 
-class TimeTicks;
-
 // This module provides some helper functions for logging actions tracked by
 // the user metrics system.
 
@@ -76,6 +79,53 @@ using ActionCallback = RepeatingCallback<void(const std::string&, TimeTicks)>;
 BASE_EXPORT void AddActionCallback(const ActionCallback& callback);
 BASE_EXPORT void RemoveActionCallback(const ActionCallback& callback);
 
+// An action recorded while batching is enabled, see EnableActionBatching().
+struct RecordedAction {
+  // The hash of the action name, as computed by HashMetricName().
+  uint64_t action_hash;
+  TimeTicks action_time;
+};
+
+// Called with a batch of recorded actions. The actions that were recorded on
+// the same thread are in the order in which they were recorded; there is no
+// ordering between the actions of different threads.
+using ActionBatchCallback =
+    RepeatingCallback<void(const std::vector<RecordedAction>&)>;
+
+struct BASE_EXPORT ActionBatchingOptions {
+  // How often the recorded actions are delivered to the batch callbacks.
+  TimeDelta flush_interval = Seconds(1);
+
+  // Number of actions a thread buffers before it requests a flush, without
+  // waiting for |flush_interval|.
+  size_t buffer_size = 1024;
+
+  // Fraction of the actions which are recorded, between 0 and 1. The others
+  // are dropped without being buffered.
+  double sampling_rate = 1.0;
+};
+
+// Switches to batching mode: instead of posting a task to the task runner for
+// each action, actions are hashed and buffered on the thread which records
+// them, then delivered in bulk to the batch callbacks on the task runner. The
+// ActionCallbacks aren't run in this mode, and none may be registered.
+// Calling this again updates the options.
+// These functions must be called on the task runner set with
+// SetRecordActionTaskRunner().
+BASE_EXPORT void EnableActionBatching(const ActionBatchingOptions& options);
+
+// Leaves batching mode, after delivering the buffered actions.
+BASE_EXPORT void DisableActionBatching();
+
+// Delivers the actions buffered so far to the batch callbacks. Actions which
+// are being recorded concurrently on other threads may be delivered with the
+// next batch.
+BASE_EXPORT void FlushActionBatches();
+
+// Add/remove batch callbacks (see above).
+BASE_EXPORT void AddActionBatchCallback(const ActionBatchCallback& callback);
+BASE_EXPORT void RemoveActionBatchCallback(const ActionBatchCallback& callback);
+
 // Set the task runner on which to record actions.
 BASE_EXPORT void SetRecordActionTaskRunner(
     scoped_refptr<SingleThreadTaskRunner> task_runner);
@@ -0,0 +1,154 @@
+// Copyright 2021 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "base/metrics/user_metrics.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "base/barrier_closure.h"
+#include "base/bind.h"
+#include "base/callback.h"
+#include "base/run_loop.h"
+#include "base/synchronization/waitable_event.h"
+#include "base/task/bind_post_task.h"
+#include "base/test/bind.h"
+#include "base/test/task_environment.h"
+#include "base/threading/simple_thread.h"
+#include "base/timer/elapsed_timer.h"
+#include "testing/gtest/include/gtest/gtest.h"
+#include "testing/perf/perf_result_reporter.h"
+
+// This file measures the throughput of RecordAction() when several threads
+// record actions at once, from the first action until all of them are
+// delivered on the task runner, with one task per action and in batching mode.
+
+namespace base {
+
+namespace {
+
+constexpr char kMetricPrefixUserMetrics[] = "UserMetrics.";
+constexpr char kMetricTimePerAction[] = "time_per_action";
+constexpr char kAction[] = "Perf.Action";
+constexpr int kNumThreads = 4;
+constexpr int kActionsPerThread = 100000;
+
+perf_test::PerfResultReporter SetUpReporter(const std::string& story_name) {
+  perf_test::PerfResultReporter reporter(kMetricPrefixUserMetrics, story_name);
+  reporter.RegisterImportantMetric(kMetricTimePerAction, "ns");
+  return reporter;
+}
+
+class RecordThread : public SimpleThread {
+ public:
+  // Upon entering its main function, the thread waits for |start_event| to be
+  // signaled. Then, it records |kActionsPerThread| actions. Finally, it
+  // invokes |done_closure|.
+  RecordThread(WaitableEvent* start_event, OnceClosure done_closure)
+      : SimpleThread("RecordThread"),
+        start_event_(start_event),
+        done_closure_(std::move(done_closure)) {}
+
+  // SimpleThread:
+  void Run() override {
+    start_event_->Wait();
+    for (int i = 0; i < kActionsPerThread; ++i)
+      RecordAction(UserMetricsAction(kAction));
+    std::move(done_closure_).Run();
+  }
+
+ private:
+  WaitableEvent* const start_event_;
+  OnceClosure done_closure_;
+};
+
+class UserMetricsPerfTest : public testing::Test {
+ public:
+  UserMetricsPerfTest() {
+    SetRecordActionTaskRunner(task_environment_.GetMainThreadTaskRunner());
+  }
+
+ protected:
+  // Records actions on |kNumThreads| threads and returns the time it took for
+  // all of them to be recorded and delivered.
+  TimeDelta RecordActions(bool batching) {
+    WaitableEvent start_event;
+    RunLoop run_loop;
+    // The threads quit the loop after they posted their actions, if any, so
+    // the loop only quits once these have been delivered.
+    RepeatingClosure done_closure = BarrierClosure(
+        kNumThreads, BindPostTask(task_environment_.GetMainThreadTaskRunner(),
+                                  run_loop.QuitClosure()));
+
+    std::vector<std::unique_ptr<SimpleThread>> threads;
+    for (int i = 0; i < kNumThreads; ++i) {
+      threads.push_back(
+          std::make_unique<RecordThread>(&start_event, done_closure));
+      threads.back()->Start();
+    }
+
+    ElapsedTimer timer;
+    start_event.Signal();
+    run_loop.Run();
+    if (batching)
+      FlushActionBatches();
+    const TimeDelta elapsed = timer.Elapsed();
+
+    for (auto& thread : threads)
+      thread->Join();
+    return elapsed;
+  }
+
+  test::TaskEnvironment task_environment_;
+};
+
+}  // namespace
+
+TEST_F(UserMetricsPerfTest, Unbatched) {
+  int delivered = 0;
+  ActionCallback callback = BindLambdaForTesting(
+      [&](const std::string& action, TimeTicks action_time) { ++delivered; });
+  AddActionCallback(callback);
+  const TimeDelta elapsed = RecordActions(/*batching=*/false);
+  RemoveActionCallback(callback);
+  EXPECT_EQ(kNumThreads * kActionsPerThread, delivered);
+
+  auto reporter = SetUpReporter("Unbatched_4Threads");
+  reporter.AddResult(kMetricTimePerAction,
+                     elapsed.InNanoseconds() / double{kActionsPerThread});
+}
+
+TEST_F(UserMetricsPerfTest, Batched) {
+  const struct {
+    const char* story_name;
+    double sampling_rate;
+  } kConfigs[] = {{"Batched_4Threads", 1.0},
+                  {"Batched_Sampled10Percent_4Threads", 0.1}};
+
+  for (const auto& config : kConfigs) {
+    size_t delivered = 0;
+    ActionBatchCallback callback = BindLambdaForTesting(
+        [&](const std::vector<RecordedAction>& actions) {
+          delivered += actions.size();
+        });
+    AddActionBatchCallback(callback);
+    ActionBatchingOptions options;
+    options.sampling_rate = config.sampling_rate;
+    EnableActionBatching(options);
+    const TimeDelta elapsed = RecordActions(/*batching=*/true);
+    DisableActionBatching();
+    RemoveActionBatchCallback(callback);
+    if (config.sampling_rate == 1.0) {
+      EXPECT_EQ(static_cast<size_t>(kNumThreads * kActionsPerThread),
+                delivered);
+    }
+
+    auto reporter = SetUpReporter(config.story_name);
+    reporter.AddResult(kMetricTimePerAction,
+                       elapsed.InNanoseconds() / double{kActionsPerThread});
+  }
+}
+
+}  // namespace base
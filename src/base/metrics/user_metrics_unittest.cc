@@ -0,0 +1,198 @@
+// Copyright 2021 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "base/metrics/user_metrics.h"
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "base/bind.h"
+#include "base/metrics/metrics_hashes.h"
+#include "base/run_loop.h"
+#include "base/strings/stringprintf.h"
+#include "base/test/bind.h"
+#include "base/test/task_environment.h"
+#include "base/threading/thread.h"
+#include "base/time/time.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace base {
+
+namespace {
+
+constexpr char kAction1[] = "Action1";
+constexpr char kAction2[] = "Action2";
+
+class UserMetricsBatchingTest : public testing::Test {
+ protected:
+  UserMetricsBatchingTest()
+      : batch_callback_(BindRepeating(&UserMetricsBatchingTest::OnBatch,
+                                      Unretained(this))) {
+    SetRecordActionTaskRunner(task_environment_.GetMainThreadTaskRunner());
+    AddActionBatchCallback(batch_callback_);
+  }
+
+  ~UserMetricsBatchingTest() override {
+    DisableActionBatching();
+    RemoveActionBatchCallback(batch_callback_);
+  }
+
+  void EnableBatching(TimeDelta flush_interval,
+                      size_t buffer_size,
+                      double sampling_rate = 1.0) {
+    ActionBatchingOptions options;
+    options.flush_interval = flush_interval;
+    options.buffer_size = buffer_size;
+    options.sampling_rate = sampling_rate;
+    EnableActionBatching(options);
+  }
+
+  size_t GetRecordedActionCount() const {
+    size_t count = 0;
+    for (const auto& batch : batches_)
+      count += batch.size();
+    return count;
+  }
+
+  test::TaskEnvironment task_environment_{
+      test::TaskEnvironment::TimeSource::MOCK_TIME};
+  std::vector<std::vector<RecordedAction>> batches_;
+
+ private:
+  void OnBatch(const std::vector<RecordedAction>& actions) {
+    batches_.push_back(actions);
+  }
+
+  ActionBatchCallback batch_callback_;
+};
+
+}  // namespace
+
+TEST_F(UserMetricsBatchingTest, FlushOnTimer) {
+  EnableBatching(Seconds(1), 100);
+  const TimeTicks start = TimeTicks::Now();
+  RecordComputedActionAt(kAction1, start + Microseconds(1));
+  RecordComputedActionAt(kAction2, start + Microseconds(2));
+  RecordComputedActionAt(kAction1, start + Microseconds(3));
+
+  // Nothing is delivered before the flush interval.
+  task_environment_.FastForwardBy(Milliseconds(999));
+  EXPECT_TRUE(batches_.empty());
+
+  task_environment_.FastForwardBy(Milliseconds(1));
+  ASSERT_EQ(1u, batches_.size());
+  ASSERT_EQ(3u, batches_[0].size());
+  EXPECT_EQ(HashMetricName(kAction1), batches_[0][0].action_hash);
+  EXPECT_EQ(start + Microseconds(1), batches_[0][0].action_time);
+  EXPECT_EQ(HashMetricName(kAction2), batches_[0][1].action_hash);
+  EXPECT_EQ(start + Microseconds(2), batches_[0][1].action_time);
+  EXPECT_EQ(HashMetricName(kAction1), batches_[0][2].action_hash);
+  EXPECT_EQ(start + Microseconds(3), batches_[0][2].action_time);
+
+  // Empty batches aren't delivered.
+  task_environment_.FastForwardBy(Seconds(1));
+  EXPECT_EQ(1u, batches_.size());
+
+  RecordAction(UserMetricsAction(kAction2));
+  task_environment_.FastForwardBy(Seconds(1));
+  ASSERT_EQ(2u, batches_.size());
+  ASSERT_EQ(1u, batches_[1].size());
+  EXPECT_EQ(HashMetricName(kAction2), batches_[1][0].action_hash);
+
+  // Disabling batching delivers the pending actions.
+  RecordAction(UserMetricsAction(kAction1));
+  DisableActionBatching();
+  ASSERT_EQ(3u, batches_.size());
+  EXPECT_EQ(1u, batches_[2].size());
+}
+
+TEST_F(UserMetricsBatchingTest, FlushWhenBufferIsFull) {
+  EnableBatching(Hours(1), 4);
+  for (int i = 0; i < 3; ++i)
+    RecordAction(UserMetricsAction(kAction1));
+  RunLoop().RunUntilIdle();
+  EXPECT_TRUE(batches_.empty());
+
+  RecordAction(UserMetricsAction(kAction2));
+  RunLoop().RunUntilIdle();
+  ASSERT_EQ(1u, batches_.size());
+  ASSERT_EQ(4u, batches_[0].size());
+  EXPECT_EQ(HashMetricName(kAction2), batches_[0][3].action_hash);
+}
+
+// Actions recorded on the same thread are delivered in order, including those
+// left in the buffer of a thread when it exits, even when flushes run
+// concurrently with the recording.
+TEST_F(UserMetricsBatchingTest, PerThreadOrder) {
+  constexpr int kNumThreads = 4;
+  constexpr int kActionsPerThread = 1000;
+  EnableBatching(Hours(1), 16);
+
+  std::vector<std::string> action_names;
+  std::vector<std::unique_ptr<Thread>> threads;
+  RunLoop run_loop;
+  int remaining_threads = kNumThreads;
+  for (int i = 0; i < kNumThreads; ++i) {
+    action_names.push_back(StringPrintf("ThreadAction%d", i));
+    threads.push_back(std::make_unique<Thread>(action_names.back()));
+    ASSERT_TRUE(threads.back()->Start());
+  }
+  for (int i = 0; i < kNumThreads; ++i) {
+    threads[i]->task_runner()->PostTask(
+        FROM_HERE,
+        BindLambdaForTesting([&, action_name = action_names[i]]() {
+          // The action times number the actions of each thread. Since the
+          // buffer size doesn't divide their count, the last ones are
+          // usually still buffered when the thread exits.
+          for (int j = 0; j < kActionsPerThread; ++j) {
+            RecordComputedActionAt(action_name,
+                                   TimeTicks() + Microseconds(j + 1));
+          }
+          task_environment_.GetMainThreadTaskRunner()->PostTask(
+              FROM_HERE, BindLambdaForTesting([&]() {
+                if (--remaining_threads == 0)
+                  run_loop.Quit();
+              }));
+        }));
+  }
+  // Flushes run on the main thread while the other threads record.
+  run_loop.Run();
+  threads.clear();
+  FlushActionBatches();
+
+  std::map<uint64_t, std::vector<TimeTicks>> times_by_action;
+  for (const auto& batch : batches_) {
+    for (const RecordedAction& action : batch)
+      times_by_action[action.action_hash].push_back(action.action_time);
+  }
+  ASSERT_EQ(static_cast<size_t>(kNumThreads), times_by_action.size());
+  for (const std::string& action_name : action_names) {
+    const std::vector<TimeTicks>& times =
+        times_by_action[HashMetricName(action_name)];
+    ASSERT_EQ(static_cast<size_t>(kActionsPerThread), times.size());
+    for (int j = 0; j < kActionsPerThread; ++j)
+      EXPECT_EQ(TimeTicks() + Microseconds(j + 1), times[j]);
+  }
+}
+
+TEST_F(UserMetricsBatchingTest, Sampling) {
+  constexpr int kNumActions = 10000;
+  EnableBatching(Hours(1), 2 * kNumActions, /*sampling_rate=*/0.0);
+  for (int i = 0; i < kNumActions; ++i)
+    RecordAction(UserMetricsAction(kAction1));
+  FlushActionBatches();
+  EXPECT_TRUE(batches_.empty());
+
+  EnableBatching(Hours(1), 2 * kNumActions, /*sampling_rate=*/0.25);
+  for (int i = 0; i < kNumActions; ++i)
+    RecordAction(UserMetricsAction(kAction1));
+  FlushActionBatches();
+  // The standard deviation of the count is about 43.
+  EXPECT_GT(GetRecordedActionCount(), 2000u);
+  EXPECT_LT(GetRecordedActionCount(), 3000u);
+}
+
+}  // namespace base
@@ -0,0 +1,306 @@
+// Copyright 2021 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "base/profiler/continuous_sampling_profiler.h"
+
+#include <algorithm>
+
+#include "base/bind.h"
+#include "base/check_op.h"
+#include "base/debug/debugging_buildflags.h"
+#include "base/debug/stack_trace.h"
+#include "base/files/important_file_writer.h"
+#include "base/location.h"
+#include "base/profiler/pprof_profile_builder.h"
+#include "base/profiler/register_context.h"
+#include "base/profiler/stack_buffer.h"
+#include "base/profiler/stack_copier_signal.h"
+#include "base/profiler/stack_sampler.h"
+#include "base/profiler/thread_delegate_posix.h"
+#include "base/threading/thread.h"
+#include "base/threading/thread_id_name_manager.h"
+#include "base/threading/thread_task_runner_handle.h"
+
+namespace base {
+
+namespace {
+
+// Maximum number of frames of a sample.
+constexpr size_t kMaxFrames = 128;
+
+class NoOpStackCopierDelegate : public StackCopier::Delegate {
+ public:
+  // StackCopier::Delegate:
+  void OnStackCopy() override {}
+};
+
+// Returns the instruction pointers of a copied stack, from the leaf.
+std::vector<uintptr_t> UnwindCopiedStack(RegisterContext* thread_context,
+                                         uintptr_t stack_top) {
+  std::vector<uintptr_t> frames;
+  frames.push_back(RegisterContextInstructionPointer(thread_context));
+#if BUILDFLAG(CAN_UNWIND_WITH_FRAME_POINTERS)
+  // The frame pointer may hold anything in the functions built without frame
+  // pointers, and TraceStackFramePointersFromBuffer() only checks the frames
+  // after the first one.
+  const uintptr_t stack_bottom = RegisterContextStackPointer(thread_context);
+  const uintptr_t fp = RegisterContextFramePointer(thread_context);
+  if (fp < stack_bottom || fp % sizeof(uintptr_t) != 0 ||
+      stack_top - fp < 2 * sizeof(uintptr_t)) {
+    return frames;
+  }
+  const void* trace[kMaxFrames - 1];
+  const size_t depth = debug::TraceStackFramePointersFromBuffer(
+      fp, stack_top, trace, kMaxFrames - 1, /* skip_initial */ 0,
+      /* enable_scanning */ false);
+  for (size_t i = 0; i < depth; ++i)
+    frames.push_back(reinterpret_cast<uintptr_t>(trace[i]));
+#endif  // BUILDFLAG(CAN_UNWIND_WITH_FRAME_POINTERS)
+  return frames;
+}
+
+}  // namespace
+
+ContinuousSamplingProfiler::Options::Options() = default;
+ContinuousSamplingProfiler::Options::Options(const Options&) = default;
+ContinuousSamplingProfiler::Options&
+ContinuousSamplingProfiler::Options::operator=(const Options&) = default;
+ContinuousSamplingProfiler::Options::~Options() = default;
+
+// static
+ContinuousSamplingProfiler* ContinuousSamplingProfiler::Get() {
+  static NoDestructor<ContinuousSamplingProfiler> instance;
+  return instance.get();
+}
+
+ContinuousSamplingProfiler::ContinuousSamplingProfiler() = default;
+ContinuousSamplingProfiler::~ContinuousSamplingProfiler() = default;
+
+void ContinuousSamplingProfiler::RegisterThread(
+    SamplingProfilerThreadToken thread_token) {
+  auto thread_delegate = ThreadDelegatePosix::Create(thread_token);
+  if (!thread_delegate)
+    return;
+  auto stack_copier =
+      std::make_unique<StackCopierSignal>(std::move(thread_delegate));
+  AutoLock lock(lock_);
+  threads_[thread_token.id] = std::move(stack_copier);
+}
+
+void ContinuousSamplingProfiler::UnregisterThread(PlatformThreadId thread_id) {
+  std::unique_ptr<StackCopierSignal> stack_copier;
+  {
+    AutoLock lock(lock_);
+    auto it = threads_.find(thread_id);
+    if (it == threads_.end())
+      return;
+    stack_copier = std::move(it->second);
+    threads_.erase(it);
+  }
+  // A pass which started before the thread was removed may still be sampling
+  // it, with |stack_copier|.
+  AutoLock sampling_lock(sampling_lock_);
+}
+
+bool ContinuousSamplingProfiler::Start(const Options& options) {
+  DCHECK(!options.sampling_interval.is_negative());
+  DCHECK_GT(options.cpu_budget, 0);
+  AutoLock lock(lock_);
+  if (sampling_thread_)
+    return false;
+  auto sampling_thread =
+      std::make_unique<Thread>("ContinuousSamplingProfiler");
+  if (!sampling_thread->Start())
+    return false;
+  if (!stack_buffer_)
+    stack_buffer_ = StackSampler::CreateStackBuffer();
+  options_ = options;
+  start_time_ = TimeTicks::Now();
+  last_pass_time_ = TimeTicks();
+  last_write_time_ = start_time_;
+  sampling_thread->task_runner()->PostTask(
+      FROM_HERE,
+      BindOnce(&ContinuousSamplingProfiler::DoPass, Unretained(this)));
+  sampling_thread_ = std::move(sampling_thread);
+  return true;
+}
+
+void ContinuousSamplingProfiler::Stop() {
+  std::unique_ptr<Thread> sampling_thread;
+  FilePath output_path;
+  {
+    AutoLock lock(lock_);
+    if (!sampling_thread_)
+      return;
+    sampling_thread = std::move(sampling_thread_);
+    output_path = options_.output_path;
+    stats_.duration += TimeTicks::Now() - start_time_;
+  }
+  // The pending passes are dropped, but not the final write, which isn't
+  // delayed.
+  if (!output_path.empty()) {
+    sampling_thread->task_runner()->PostTask(
+        FROM_HERE,
+        BindOnce(IgnoreResult(&ContinuousSamplingProfiler::WriteToFile),
+                 Unretained(this), output_path));
+  }
+  sampling_thread->Stop();
+}
+
+bool ContinuousSamplingProfiler::IsRunning() const {
+  AutoLock lock(lock_);
+  return !!sampling_thread_;
+}
+
+std::string ContinuousSamplingProfiler::SerializeToPprof() {
+  AutoLock lock(lock_);
+  return SerializeToPprofLocked();
+}
+
+bool ContinuousSamplingProfiler::WriteToFile(const FilePath& path) {
+  const std::string profile = SerializeToPprof();
+  return ImportantFileWriter::WriteFileAtomically(path, profile);
+}
+
+ContinuousSamplingProfiler::Stats ContinuousSamplingProfiler::GetStats()
+    const {
+  AutoLock lock(lock_);
+  Stats stats = stats_;
+  stats.stacks = samples_.size();
+  if (sampling_thread_)
+    stats.duration += TimeTicks::Now() - start_time_;
+  if (!stats.duration.is_zero())
+    stats.overhead = stats.sampling_cpu_time / stats.duration;
+  return stats;
+}
+
+void ContinuousSamplingProfiler::Clear() {
+  AutoLock lock(lock_);
+  samples_.clear();
+  stats_ = Stats();
+  last_pass_time_ = TimeTicks();
+  if (sampling_thread_)
+    start_time_ = TimeTicks::Now();
+}
+
+void ContinuousSamplingProfiler::DoPass() {
+  const ThreadTicks start_cpu_time = ThreadTicks::Now();
+  std::vector<std::pair<PlatformThreadId, std::vector<uintptr_t>>> stacks;
+  size_t failed_samples = 0;
+  TimeTicks now;
+  TimeDelta wall_time;
+  {
+    // The threads are sampled without |lock_|, which the sampled threads may
+    // be waiting for, e.g. to unregister.
+    AutoLock sampling_lock(sampling_lock_);
+    std::vector<std::pair<PlatformThreadId, StackCopierSignal*>> threads;
+    StackBuffer* stack_buffer;
+    {
+      AutoLock lock(lock_);
+      // Stopping.
+      if (!sampling_thread_)
+        return;
+
+      now = TimeTicks::Now();
+      wall_time = last_pass_time_.is_null() ? options_.sampling_interval
+                                            : now - last_pass_time_;
+      if (!last_pass_time_.is_null()) {
+        const size_t intervals = stats_.passes;
+        stats_.mean_interval =
+            (stats_.mean_interval * (intervals - 1) + wall_time) / intervals;
+      }
+      last_pass_time_ = now;
+
+      threads.reserve(threads_.size());
+      for (const auto& thread : threads_)
+        threads.emplace_back(thread.first, thread.second.get());
+      stack_buffer = stack_buffer_.get();
+    }
+
+    NoOpStackCopierDelegate delegate;
+    stacks.reserve(threads.size());
+    for (const auto& thread : threads) {
+      RegisterContext thread_context;
+      uintptr_t stack_top;
+      TimeTicks timestamp;
+      if (!thread.second->CopyStack(stack_buffer, &stack_top, &timestamp,
+                                    &thread_context, &delegate)) {
+        ++failed_samples;
+        continue;
+      }
+      stacks.emplace_back(thread.first,
+                          UnwindCopiedStack(&thread_context, stack_top));
+    }
+  }
+
+  std::string profile;
+  FilePath output_path;
+  TimeDelta delay;
+  {
+    AutoLock lock(lock_);
+    stats_.failed_samples += failed_samples;
+    for (auto& stack : stacks) {
+      SampleKey key(stack.first, std::move(stack.second));
+      auto it = samples_.find(key);
+      if (it == samples_.end()) {
+        if (samples_.size() >= options_.max_stacks) {
+          ++stats_.dropped_samples;
+          continue;
+        }
+        it = samples_.emplace(std::move(key), SampleValue()).first;
+      }
+      ++it->second.count;
+      it->second.wall_time += wall_time;
+      ++stats_.samples;
+    }
+    ++stats_.passes;
+
+    if (!options_.output_path.empty() &&
+        now - last_write_time_ >= options_.write_interval) {
+      profile = SerializeToPprofLocked();
+      output_path = options_.output_path;
+      last_write_time_ = now;
+    }
+
+    // Writing the profile counts against the budget of the next pass.
+    const TimeDelta cpu_time = ThreadTicks::Now() - start_cpu_time;
+    stats_.sampling_cpu_time += cpu_time;
+    const TimeDelta elapsed = TimeTicks::Now() - now;
+    delay = std::max(options_.sampling_interval,
+                     cpu_time / options_.cpu_budget) -
+            elapsed;
+  }
+
+  if (!output_path.empty())
+    ImportantFileWriter::WriteFileAtomically(output_path, profile);
+
+  ThreadTaskRunnerHandle::Get()->PostDelayedTask(
+      FROM_HERE,
+      BindOnce(&ContinuousSamplingProfiler::DoPass, Unretained(this)),
+      std::max(delay, TimeDelta()));
+}
+
+std::string ContinuousSamplingProfiler::SerializeToPprofLocked() {
+  PprofProfileBuilder builder({{"samples", "count"}, {"wall", "nanoseconds"}},
+                              &module_cache_);
+  builder.SetPeriod({"wall", "nanoseconds"},
+                    options_.sampling_interval.InNanoseconds());
+  TimeDelta duration = stats_.duration;
+  if (sampling_thread_)
+    duration += TimeTicks::Now() - start_time_;
+  builder.SetTime(Time::Now() - duration, duration);
+
+  ThreadIdNameManager* thread_names = ThreadIdNameManager::GetInstance();
+  for (const auto& sample : samples_) {
+    const PlatformThreadId thread_id = sample.first.first;
+    builder.AddSample(
+        sample.first.second,
+        {sample.second.count, sample.second.wall_time.InNanoseconds()},
+        {{"thread", thread_names->GetName(thread_id)},
+         {"thread_id", std::string(), static_cast<int64_t>(thread_id)}});
+  }
+  return builder.Serialize();
+}
+
+}  // namespace base
@@ -0,0 +1,174 @@
+// Copyright 2021 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BASE_PROFILER_CONTINUOUS_SAMPLING_PROFILER_H_
+#define BASE_PROFILER_CONTINUOUS_SAMPLING_PROFILER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "base/base_export.h"
+#include "base/files/file_path.h"
+#include "base/no_destructor.h"
+#include "base/profiler/module_cache.h"
+#include "base/profiler/sampling_profiler_thread_token.h"
+#include "base/synchronization/lock.h"
+#include "base/thread_annotations.h"
+#include "base/threading/platform_thread.h"
+#include "base/time/time.h"
+
+namespace base {
+
+class StackBuffer;
+class StackCopierSignal;
+class Thread;
+
+// ContinuousSamplingProfiler samples the stacks of all the registered threads
+// of the process, one after the other in a single pass at each interval, for
+// as long as it runs. Unlike StackSamplingProfiler, which profiles one thread
+// for a bounded duration on behalf of a ProfileBuilder, it is meant to stay on
+// in the background, e.g. for fleet-wide profiling.
+//
+// The stacks are copied with StackCopierSignal and unwound with frame pointers
+// where the build has them, otherwise only the sampled instruction pointers are
+// kept. Identical stacks are aggregated per thread, for up to
+// |Options::max_stacks| distinct stacks. The samples are only
+// mapped to modules, through a ModuleCache, when the profile is serialized in
+// the pprof format, which pprof symbolizes offline against the binaries. The
+// profile can also be written to a file periodically while the profiler runs.
+//
+// A pass costs a signal round-trip and a stack copy per thread. The CPU time
+// of the sampling thread is measured and the passes are spaced out further
+// than the sampling interval if needed to stay within a CPU budget. It is
+// reported by GetStats(), but the cost on the sampled threads isn't, see
+// |Stats::overhead|.
+//
+// Available on Linux and ChromeOS only.
+class BASE_EXPORT ContinuousSamplingProfiler {
+ public:
+  struct BASE_EXPORT Options {
+    Options();
+    Options(const Options&);
+    Options& operator=(const Options&);
+    ~Options();
+
+    // Interval between the starts of two passes, unless the CPU budget
+    // requires more.
+    TimeDelta sampling_interval = Milliseconds(10);
+    // Fraction of a CPU that the sampling thread may use.
+    double cpu_budget = 0.01;
+    // If not empty, the profile is written to this file every
+    // |write_interval|, and when the profiler stops.
+    FilePath output_path;
+    TimeDelta write_interval = Minutes(1);
+    // Maximum number of distinct stacks kept, over all the threads, including
+    // those which exited. The samples with other stacks are then dropped.
+    size_t max_stacks = 16 * 1024;
+  };
+
+  struct BASE_EXPORT Stats {
+    size_t passes = 0;
+    size_t samples = 0;
+    // Samples which couldn't be copied, e.g. because the stack was larger than
+    // the buffer.
+    size_t failed_samples = 0;
+    // Samples which were dropped because |Options::max_stacks| was reached.
+    size_t dropped_samples = 0;
+    // Distinct stacks kept.
+    size_t stacks = 0;
+    // CPU time of the sampling thread in passes, over the time the profiler
+    // ran.
+    TimeDelta sampling_cpu_time;
+    TimeDelta duration;
+    // |sampling_cpu_time| over |duration|. This excludes the time that each
+    // sampled thread spends in the signal handler, copying its own stack,
+    // and switching to it and back, which is charged to the sampled threads
+    // and isn't measured.
+    double overhead = 0;
+    // Mean time between the starts of two passes.
+    TimeDelta mean_interval;
+  };
+
+  static ContinuousSamplingProfiler* Get();
+
+  ContinuousSamplingProfiler(const ContinuousSamplingProfiler&) = delete;
+  ContinuousSamplingProfiler& operator=(const ContinuousSamplingProfiler&) =
+      delete;
+
+  // Adds a thread to those sampled by every pass, whether or not the profiler
+  // is running. The thread must be unregistered before it exits.
+  // UnregisterThread() waits for the pass in progress, if any.
+  void RegisterThread(SamplingProfilerThreadToken thread_token);
+  void UnregisterThread(PlatformThreadId thread_id);
+
+  // Starts the sampling thread. Returns false if the profiler already runs or
+  // the thread can't be started. The samples of a previous run are kept.
+  bool Start(const Options& options);
+  // Stops the sampling thread, once the profile is written if needed.
+  void Stop();
+  bool IsRunning() const;
+
+  // Returns the profile as a serialized, uncompressed pprof profile.proto
+  // message with samples/count and wall/nanoseconds sample types, where wall is
+  // the time between the pass of a sample and the previous one. Every sample
+  // is labeled with its thread.
+  std::string SerializeToPprof();
+
+  // Writes the result of |SerializeToPprof| to |path|, atomically.
+  bool WriteToFile(const FilePath& path);
+
+  Stats GetStats() const;
+
+  // Drops the samples and the stats.
+  void Clear();
+
+ private:
+  friend class NoDestructor<ContinuousSamplingProfiler>;
+
+  // The samples of a thread with the same stack, from the leaf.
+  using SampleKey = std::pair<PlatformThreadId, std::vector<uintptr_t>>;
+  struct SampleValue {
+    int64_t count = 0;
+    TimeDelta wall_time;
+  };
+
+  ContinuousSamplingProfiler();
+  ~ContinuousSamplingProfiler();
+
+  // Samples all the registered threads, then schedules the next pass. Runs on
+  // the sampling thread.
+  void DoPass();
+
+  std::string SerializeToPprofLocked() EXCLUSIVE_LOCKS_REQUIRED(lock_);
+
+  // Held by DoPass() while it samples the threads, without |lock_|, so that
+  // UnregisterThread() can wait for it. Acquired before |lock_|.
+  Lock sampling_lock_ ACQUIRED_BEFORE(lock_);
+
+  mutable Lock lock_;
+
+  std::map<PlatformThreadId, std::unique_ptr<StackCopierSignal>> threads_
+      GUARDED_BY(lock_);
+  std::map<SampleKey, SampleValue> samples_ GUARDED_BY(lock_);
+  // Caches the modules across serializations.
+  ModuleCache module_cache_ GUARDED_BY(lock_);
+
+  Options options_ GUARDED_BY(lock_);
+  std::unique_ptr<Thread> sampling_thread_ GUARDED_BY(lock_);
+  std::unique_ptr<StackBuffer> stack_buffer_ GUARDED_BY(lock_);
+  TimeTicks start_time_ GUARDED_BY(lock_);
+  TimeTicks last_pass_time_ GUARDED_BY(lock_);
+  TimeTicks last_write_time_ GUARDED_BY(lock_);
+  Stats stats_ GUARDED_BY(lock_);
+};
+
+}  // namespace base
+
+#endif  // BASE_PROFILER_CONTINUOUS_SAMPLING_PROFILER_H_
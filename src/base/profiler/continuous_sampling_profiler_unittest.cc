@@ -0,0 +1,179 @@
+// Copyright 2021 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "base/profiler/continuous_sampling_profiler.h"
+
+#include <atomic>
+#include <string>
+
+#include "base/files/file_util.h"
+#include "base/files/scoped_temp_dir.h"
+#include "base/profiler/sampling_profiler_thread_token.h"
+#include "base/synchronization/waitable_event.h"
+#include "base/threading/platform_thread.h"
+#include "base/threading/simple_thread.h"
+#include "base/time/time.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace base {
+
+namespace {
+
+// Spins until stopped, registered with the profiler.
+class BusyThread : public SimpleThread {
+ public:
+  BusyThread() : SimpleThread("BusyThread") {}
+
+  void Run() override {
+    ContinuousSamplingProfiler::Get()->RegisterThread(
+        GetSamplingProfilerCurrentThreadToken());
+    registered_.Signal();
+    uint64_t counter = 0;
+    while (!stop_.load(std::memory_order_relaxed))
+      counter_.store(++counter, std::memory_order_relaxed);
+    ContinuousSamplingProfiler::Get()->UnregisterThread(
+        PlatformThread::CurrentId());
+  }
+
+  void WaitUntilRegistered() { registered_.Wait(); }
+  void StopSoon() { stop_.store(true, std::memory_order_relaxed); }
+
+ private:
+  WaitableEvent registered_;
+  std::atomic<bool> stop_{false};
+  std::atomic<uint64_t> counter_{0};
+};
+
+class ContinuousSamplingProfilerTest : public testing::Test {
+ public:
+  void SetUp() override {
+    busy_thread_.StartAsync();
+    busy_thread_.WaitUntilRegistered();
+  }
+
+  void TearDown() override {
+    ContinuousSamplingProfiler::Get()->Stop();
+    ContinuousSamplingProfiler::Get()->Clear();
+    busy_thread_.StopSoon();
+    busy_thread_.Join();
+  }
+
+  // Waits until the profiler has done |passes| passes.
+  void WaitForPasses(size_t passes) {
+    while (ContinuousSamplingProfiler::Get()->GetStats().passes < passes)
+      PlatformThread::Sleep(Milliseconds(1));
+  }
+
+ private:
+  BusyThread busy_thread_;
+};
+
+}  // namespace
+
+TEST_F(ContinuousSamplingProfilerTest, SamplesRegisteredThreads) {
+  ContinuousSamplingProfiler* profiler = ContinuousSamplingProfiler::Get();
+  ContinuousSamplingProfiler::Options options;
+  options.sampling_interval = Milliseconds(1);
+  options.cpu_budget = 1;
+  ASSERT_TRUE(profiler->Start(options));
+  EXPECT_TRUE(profiler->IsRunning());
+  EXPECT_FALSE(profiler->Start(options));
+  WaitForPasses(10);
+  profiler->Stop();
+  EXPECT_FALSE(profiler->IsRunning());
+
+  const ContinuousSamplingProfiler::Stats stats = profiler->GetStats();
+  EXPECT_GE(stats.passes, 10u);
+  EXPECT_EQ(stats.passes, stats.samples + stats.failed_samples);
+  EXPECT_GT(stats.samples, 0u);
+  EXPECT_EQ(0u, stats.dropped_samples);
+  EXPECT_GT(stats.stacks, 0u);
+  EXPECT_GT(stats.duration, TimeDelta());
+  EXPECT_GE(stats.overhead, 0);
+  EXPECT_GT(stats.mean_interval, TimeDelta());
+
+  // The samples are kept once stopped.
+  const std::string profile = profiler->SerializeToPprof();
+  EXPECT_FALSE(profile.empty());
+  EXPECT_NE(std::string::npos, profile.find("BusyThread"));
+  EXPECT_NE(std::string::npos, profile.find("wall"));
+
+  profiler->Clear();
+  EXPECT_EQ(0u, profiler->GetStats().samples);
+  EXPECT_EQ(std::string::npos,
+            profiler->SerializeToPprof().find("BusyThread"));
+}
+
+TEST_F(ContinuousSamplingProfilerTest, UnregisterUnknownThread) {
+  ContinuousSamplingProfiler* profiler = ContinuousSamplingProfiler::Get();
+  ContinuousSamplingProfiler::Options options;
+  options.sampling_interval = Milliseconds(1);
+  options.cpu_budget = 1;
+  ASSERT_TRUE(profiler->Start(options));
+  WaitForPasses(1);
+  // The profiler ignores the threads it doesn't know.
+  profiler->UnregisterThread(kInvalidThreadId);
+  profiler->Stop();
+  EXPECT_GT(profiler->GetStats().samples, 0u);
+}
+
+// Once |max_stacks| distinct stacks are kept, the samples with new stacks are
+// dropped.
+TEST_F(ContinuousSamplingProfilerTest, MaxStacks) {
+  ContinuousSamplingProfiler* profiler = ContinuousSamplingProfiler::Get();
+  ContinuousSamplingProfiler::Options options;
+  options.sampling_interval = Milliseconds(1);
+  options.cpu_budget = 1;
+  options.max_stacks = 1;
+  ASSERT_TRUE(profiler->Start(options));
+  WaitForPasses(20);
+  profiler->Stop();
+
+  const ContinuousSamplingProfiler::Stats stats = profiler->GetStats();
+  EXPECT_EQ(stats.passes,
+            stats.samples + stats.failed_samples + stats.dropped_samples);
+  EXPECT_GT(stats.samples, 0u);
+  EXPECT_EQ(1u, stats.stacks);
+}
+
+// The passes are spaced out to stay within the CPU budget.
+TEST_F(ContinuousSamplingProfilerTest, CpuBudget) {
+  ContinuousSamplingProfiler* profiler = ContinuousSamplingProfiler::Get();
+  ContinuousSamplingProfiler::Options options;
+  options.sampling_interval = TimeDelta();
+  options.cpu_budget = 0.01;
+  ASSERT_TRUE(profiler->Start(options));
+  WaitForPasses(5);
+  profiler->Stop();
+
+  const ContinuousSamplingProfiler::Stats stats = profiler->GetStats();
+  ASSERT_GE(stats.passes, 5u);
+  EXPECT_GT(stats.sampling_cpu_time, TimeDelta());
+  // Only the last pass isn't followed by a wait proportional to its CPU time.
+  EXPECT_LT(stats.overhead, 0.1);
+}
+
+TEST_F(ContinuousSamplingProfilerTest, WritesProfile) {
+  ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+  const FilePath path = temp_dir.GetPath().AppendASCII("profile.pb");
+
+  ContinuousSamplingProfiler* profiler = ContinuousSamplingProfiler::Get();
+  ContinuousSamplingProfiler::Options options;
+  options.sampling_interval = Milliseconds(1);
+  options.cpu_budget = 1;
+  options.output_path = path;
+  options.write_interval = TimeDelta();
+  ASSERT_TRUE(profiler->Start(options));
+  WaitForPasses(2);
+  EXPECT_TRUE(PathExists(path));
+  profiler->Stop();
+
+  // Written once more when stopped.
+  std::string profile;
+  ASSERT_TRUE(ReadFileToString(path, &profile));
+  EXPECT_NE(std::string::npos, profile.find("BusyThread"));
+}
+
+}  // namespace base
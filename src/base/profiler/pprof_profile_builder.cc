@@ -0,0 +1,246 @@
+// Copyright 2021 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "base/profiler/pprof_profile_builder.h"
+
+#include <utility>
+
+#include "base/files/file_path.h"
+
+namespace base {
+
+namespace {
+
+// Field numbers of the messages in pprof's profile.proto.
+enum ProfileField : uint32_t {
+  kProfileSampleType = 1,
+  kProfileSample = 2,
+  kProfileMapping = 3,
+  kProfileLocation = 4,
+  kProfileStringTable = 6,
+  kProfileTimeNanos = 9,
+  kProfileDurationNanos = 10,
+  kProfilePeriodType = 11,
+  kProfilePeriod = 12,
+};
+
+enum ValueTypeField : uint32_t {
+  kValueTypeType = 1,
+  kValueTypeUnit = 2,
+};
+
+enum SampleField : uint32_t {
+  kSampleLocationId = 1,
+  kSampleValue = 2,
+  kSampleLabel = 3,
+};
+
+enum LabelField : uint32_t {
+  kLabelKey = 1,
+  kLabelStr = 2,
+  kLabelNum = 3,
+  kLabelNumUnit = 4,
+};
+
+enum MappingField : uint32_t {
+  kMappingId = 1,
+  kMappingMemoryStart = 2,
+  kMappingMemoryLimit = 3,
+  kMappingFilename = 5,
+  kMappingBuildId = 6,
+};
+
+enum LocationField : uint32_t {
+  kLocationId = 1,
+  kLocationMappingId = 2,
+  kLocationAddress = 3,
+};
+
+enum WireType : uint32_t {
+  kVarint = 0,
+  kLengthDelimited = 2,
+};
+
+void AppendVarint(uint64_t value, std::string* out) {
+  while (value >= 0x80) {
+    out->push_back(static_cast<char>((value & 0x7f) | 0x80));
+    value >>= 7;
+  }
+  out->push_back(static_cast<char>(value));
+}
+
+void AppendTag(uint32_t field, WireType wire_type, std::string* out) {
+  AppendVarint((static_cast<uint64_t>(field) << 3) | wire_type, out);
+}
+
+// Zero is the default value of scalar fields and is omitted.
+void AppendVarintField(uint32_t field, uint64_t value, std::string* out) {
+  if (!value)
+    return;
+  AppendTag(field, kVarint, out);
+  AppendVarint(value, out);
+}
+
+void AppendBytesField(uint32_t field,
+                      const std::string& bytes,
+                      std::string* out) {
+  AppendTag(field, kLengthDelimited, out);
+  AppendVarint(bytes.size(), out);
+  out->append(bytes);
+}
+
+template <typename T>
+void AppendPackedField(uint32_t field,
+                       const std::vector<T>& values,
+                       std::string* out) {
+  if (values.empty())
+    return;
+  std::string packed;
+  for (T value : values)
+    AppendVarint(static_cast<uint64_t>(value), &packed);
+  AppendBytesField(field, packed, out);
+}
+
+}  // namespace
+
+PprofProfileBuilder::PprofProfileBuilder(std::vector<ValueType> sample_types,
+                                         ModuleCache* module_cache)
+    : module_cache_(module_cache) {
+  // The first entry of the string table must be the empty string.
+  InternString(std::string());
+  for (const ValueType& sample_type : sample_types) {
+    std::string value_type;
+    AppendVarintField(kValueTypeType, InternString(sample_type.type),
+                      &value_type);
+    AppendVarintField(kValueTypeUnit, InternString(sample_type.unit),
+                      &value_type);
+    AppendBytesField(kProfileSampleType, value_type, &sample_types_);
+  }
+}
+
+PprofProfileBuilder::~PprofProfileBuilder() = default;
+
+void PprofProfileBuilder::SetPeriod(const ValueType& period_type,
+                                    int64_t period) {
+  period_type_.clear();
+  AppendVarintField(kValueTypeType, InternString(period_type.type),
+                    &period_type_);
+  AppendVarintField(kValueTypeUnit, InternString(period_type.unit),
+                    &period_type_);
+  period_ = period;
+}
+
+void PprofProfileBuilder::SetTime(Time start, TimeDelta duration) {
+  start_time_ = start;
+  duration_ = duration;
+}
+
+void PprofProfileBuilder::AddSample(const std::vector<uintptr_t>& frames,
+                                    const std::vector<int64_t>& values,
+                                    const std::vector<Label>& labels) {
+  std::vector<uint64_t> location_ids;
+  location_ids.reserve(frames.size());
+  for (uintptr_t frame : frames)
+    location_ids.push_back(InternLocation(frame));
+
+  std::string sample;
+  AppendPackedField(kSampleLocationId, location_ids, &sample);
+  AppendPackedField(kSampleValue, values, &sample);
+  for (const Label& label : labels) {
+    std::string encoded_label;
+    AppendVarintField(kLabelKey, InternString(label.key), &encoded_label);
+    if (!label.str.empty()) {
+      AppendVarintField(kLabelStr, InternString(label.str), &encoded_label);
+    } else {
+      AppendVarintField(kLabelNum, static_cast<uint64_t>(label.num),
+                        &encoded_label);
+      if (!label.num_unit.empty()) {
+        AppendVarintField(kLabelNumUnit, InternString(label.num_unit),
+                          &encoded_label);
+      }
+    }
+    AppendBytesField(kSampleLabel, encoded_label, &sample);
+  }
+  AppendBytesField(kProfileSample, sample, &samples_);
+  ++sample_count_;
+}
+
+std::string PprofProfileBuilder::Serialize() const {
+  std::string profile = sample_types_;
+  profile.append(samples_);
+
+  for (size_t i = 0; i < mappings_.size(); ++i) {
+    const ModuleCache::Module* module = mappings_[i];
+    std::string mapping;
+    AppendVarintField(kMappingId, i + 1, &mapping);
+    AppendVarintField(kMappingMemoryStart, module->GetBaseAddress(), &mapping);
+    AppendVarintField(kMappingMemoryLimit,
+                      module->GetBaseAddress() + module->GetSize(), &mapping);
+    // The strings are interned when the mapping is created.
+    AppendVarintField(
+        kMappingFilename,
+        string_ids_.at(module->GetDebugBasename().AsUTF8Unsafe()), &mapping);
+    AppendVarintField(kMappingBuildId, string_ids_.at(module->GetId()),
+                      &mapping);
+    AppendBytesField(kProfileMapping, mapping, &profile);
+  }
+
+  for (size_t i = 0; i < locations_.size(); ++i) {
+    std::string location;
+    AppendVarintField(kLocationId, i + 1, &location);
+    AppendVarintField(kLocationMappingId, locations_[i].mapping_id, &location);
+    AppendVarintField(kLocationAddress, locations_[i].address, &location);
+    AppendBytesField(kProfileLocation, location, &profile);
+  }
+
+  for (const std::string& string : strings_)
+    AppendBytesField(kProfileStringTable, string, &profile);
+
+  if (!start_time_.is_null()) {
+    AppendVarintField(kProfileTimeNanos,
+                      (start_time_ - Time::UnixEpoch()).InNanoseconds(),
+                      &profile);
+  }
+  AppendVarintField(kProfileDurationNanos, duration_.InNanoseconds(), &profile);
+  if (!period_type_.empty())
+    AppendBytesField(kProfilePeriodType, period_type_, &profile);
+  AppendVarintField(kProfilePeriod, period_, &profile);
+  return profile;
+}
+
+int64_t PprofProfileBuilder::InternString(const std::string& string) {
+  auto result = string_ids_.emplace(string, strings_.size());
+  if (result.second)
+    strings_.push_back(string);
+  return result.first->second;
+}
+
+uint64_t PprofProfileBuilder::InternLocation(uintptr_t address) {
+  auto it = location_ids_.find(address);
+  if (it != location_ids_.end())
+    return it->second;
+
+  const ModuleCache::Module* module =
+      module_cache_ ? module_cache_->GetModuleForAddress(address) : nullptr;
+  const uint64_t mapping_id = module ? InternMapping(module) : 0;
+  locations_.push_back({address, mapping_id});
+  const uint64_t location_id = locations_.size();
+  location_ids_.emplace(address, location_id);
+  return location_id;
+}
+
+uint64_t PprofProfileBuilder::InternMapping(const ModuleCache::Module* module) {
+  auto it = mapping_ids_.find(module);
+  if (it != mapping_ids_.end())
+    return it->second;
+
+  InternString(module->GetDebugBasename().AsUTF8Unsafe());
+  InternString(module->GetId());
+  mappings_.push_back(module);
+  const uint64_t mapping_id = mappings_.size();
+  mapping_ids_.emplace(module, mapping_id);
+  return mapping_id;
+}
+
+}  // namespace base
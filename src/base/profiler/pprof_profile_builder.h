@@ -0,0 +1,111 @@
+// Copyright 2021 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BASE_PROFILER_PPROF_PROFILE_BUILDER_H_
+#define BASE_PROFILER_PPROF_PROFILE_BUILDER_H_
+
+#include <stdint.h>
+
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "base/base_export.h"
+#include "base/memory/raw_ptr.h"
+#include "base/profiler/module_cache.h"
+#include "base/time/time.h"
+
+namespace base {
+
+// PprofProfileBuilder encodes stack samples as a pprof profile, i.e. a
+// serialized perftools.profiles.Profile message (see profile.proto in
+// https://github.com/google/pprof). Instruction pointers are written
+// unsymbolized along with the mappings of the modules that contain them, so
+// that pprof can symbolize the profile offline against the binaries.
+//
+// The result is not compressed; pprof accepts both gzipped and plain profiles.
+class BASE_EXPORT PprofProfileBuilder {
+ public:
+  struct ValueType {
+    std::string type;
+    std::string unit;
+  };
+
+  // Either |str| or |num| is set. |num_unit| optionally qualifies |num|.
+  struct Label {
+    std::string key;
+    std::string str;
+    int64_t num = 0;
+    std::string num_unit;
+  };
+
+  // |module_cache| is used to look up the mappings of sampled addresses and
+  // must outlive the builder.
+  PprofProfileBuilder(std::vector<ValueType> sample_types,
+                      ModuleCache* module_cache);
+  ~PprofProfileBuilder();
+
+  PprofProfileBuilder(const PprofProfileBuilder&) = delete;
+  PprofProfileBuilder& operator=(const PprofProfileBuilder&) = delete;
+
+  // Describes the sampling period, e.g. {"space", "bytes"} and the mean
+  // sampling interval for heap profiles.
+  void SetPeriod(const ValueType& period_type, int64_t period);
+
+  // Sets the wall-clock time at which the profile was started and the duration
+  // it covers.
+  void SetTime(Time start, TimeDelta duration);
+
+  // Adds a sample. |frames| are instruction pointers ordered from the leaf to
+  // the root. |values| correspond to the sample types passed to the
+  // constructor.
+  void AddSample(const std::vector<uintptr_t>& frames,
+                 const std::vector<int64_t>& values,
+                 const std::vector<Label>& labels = {});
+
+  size_t sample_count() const { return sample_count_; }
+
+  // Returns the serialized profile.
+  std::string Serialize() const;
+
+ private:
+  int64_t InternString(const std::string& string);
+  uint64_t InternLocation(uintptr_t address);
+  uint64_t InternMapping(const ModuleCache::Module* module);
+
+  struct Location {
+    uintptr_t address;
+    uint64_t mapping_id;
+  };
+
+  const raw_ptr<ModuleCache> module_cache_;
+
+  std::vector<std::string> strings_;
+  std::unordered_map<std::string, int64_t> string_ids_;
+
+  // Location ids are 1-based indices into |locations_|.
+  std::vector<Location> locations_;
+  std::unordered_map<uintptr_t, uint64_t> location_ids_;
+
+  // Mapping ids are 1-based indices into |mappings_|.
+  std::vector<const ModuleCache::Module*> mappings_;
+  std::map<const ModuleCache::Module*, uint64_t> mapping_ids_;
+
+  // Encoded ValueType messages of the sample types.
+  std::string sample_types_;
+  // Encoded Sample messages. Samples are encoded as they are added to avoid
+  // keeping them around in a structured form.
+  std::string samples_;
+  size_t sample_count_ = 0;
+
+  std::string period_type_;
+  int64_t period_ = 0;
+  Time start_time_;
+  TimeDelta duration_;
+};
+
+}  // namespace base
+
+#endif  // BASE_PROFILER_PPROF_PROFILE_BUILDER_H_
@@ -0,0 +1,194 @@
+// Copyright 2021 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "base/profiler/pprof_profile_builder.h"
+
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "base/files/file_path.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace base {
+namespace {
+
+class TestModule : public ModuleCache::Module {
+ public:
+  TestModule(uintptr_t base_address, size_t size, std::string id)
+      : base_address_(base_address), size_(size), id_(std::move(id)) {}
+
+  TestModule(const TestModule&) = delete;
+  TestModule& operator=(const TestModule&) = delete;
+
+  uintptr_t GetBaseAddress() const override { return base_address_; }
+  std::string GetId() const override { return id_; }
+  FilePath GetDebugBasename() const override {
+    return FilePath(FILE_PATH_LITERAL("libtest.so"));
+  }
+  size_t GetSize() const override { return size_; }
+  bool IsNative() const override { return true; }
+
+ private:
+  uintptr_t base_address_;
+  size_t size_;
+  std::string id_;
+};
+
+// Minimal protobuf wire format decoder, sufficient for the messages written by
+// PprofProfileBuilder. Maps each field number to the values it was encoded
+// with; length-delimited values are stored as raw bytes in |bytes|.
+struct Message {
+  std::multimap<uint32_t, uint64_t> varints;
+  std::multimap<uint32_t, std::string> bytes;
+};
+
+bool ReadVarint(const std::string& data, size_t* pos, uint64_t* value) {
+  *value = 0;
+  for (int shift = 0; shift < 64 && *pos < data.size(); shift += 7) {
+    const uint8_t byte = static_cast<uint8_t>(data[(*pos)++]);
+    *value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if (!(byte & 0x80))
+      return true;
+  }
+  return false;
+}
+
+Message Decode(const std::string& data) {
+  Message message;
+  size_t pos = 0;
+  while (pos < data.size()) {
+    uint64_t tag;
+    EXPECT_TRUE(ReadVarint(data, &pos, &tag));
+    const uint32_t field = static_cast<uint32_t>(tag >> 3);
+    uint64_t value;
+    EXPECT_TRUE(ReadVarint(data, &pos, &value));
+    if ((tag & 7) == 0) {
+      message.varints.emplace(field, value);
+    } else {
+      EXPECT_EQ(2u, tag & 7);
+      EXPECT_LE(pos + value, data.size());
+      message.bytes.emplace(field, data.substr(pos, value));
+      pos += value;
+    }
+  }
+  return message;
+}
+
+std::vector<uint64_t> DecodePacked(const std::string& data) {
+  std::vector<uint64_t> values;
+  size_t pos = 0;
+  while (pos < data.size()) {
+    uint64_t value;
+    EXPECT_TRUE(ReadVarint(data, &pos, &value));
+    values.push_back(value);
+  }
+  return values;
+}
+
+template <typename T>
+std::vector<T> Values(const std::multimap<uint32_t, T>& fields,
+                      uint32_t field) {
+  std::vector<T> values;
+  auto range = fields.equal_range(field);
+  for (auto it = range.first; it != range.second; ++it)
+    values.push_back(it->second);
+  return values;
+}
+
+uint64_t Varint(const Message& message, uint32_t field) {
+  auto it = message.varints.find(field);
+  return it == message.varints.end() ? 0 : it->second;
+}
+
+}  // namespace
+
+TEST(PprofProfileBuilderTest, EmptyProfile) {
+  PprofProfileBuilder builder({{"objects", "count"}}, nullptr);
+  const Message profile = Decode(builder.Serialize());
+
+  const std::vector<std::string> strings = Values(profile.bytes, 6);
+  ASSERT_EQ(3u, strings.size());
+  EXPECT_EQ("", strings[0]);
+  EXPECT_EQ("objects", strings[1]);
+  EXPECT_EQ("count", strings[2]);
+
+  const std::vector<std::string> sample_types = Values(profile.bytes, 1);
+  ASSERT_EQ(1u, sample_types.size());
+  const Message sample_type = Decode(sample_types[0]);
+  EXPECT_EQ(1u, Varint(sample_type, 1));
+  EXPECT_EQ(2u, Varint(sample_type, 2));
+  EXPECT_TRUE(Values(profile.bytes, 2).empty());
+}
+
+TEST(PprofProfileBuilderTest, Samples) {
+  ModuleCache module_cache;
+  module_cache.AddCustomNativeModule(
+      std::make_unique<TestModule>(0x1000, 0x1000, "ABCDEF"));
+
+  PprofProfileBuilder builder(
+      {{"alloc_objects", "count"}, {"alloc_space", "bytes"}}, &module_cache);
+  builder.SetPeriod({"space", "bytes"}, 128 * 1024);
+  builder.SetTime(Time::UnixEpoch() + Seconds(1), Seconds(2));
+  builder.AddSample({0x1010, 0x1020}, {1, 100}, {{"bucket", "", 128, "bytes"}});
+  builder.AddSample({0x1020, 0x5000}, {2, 300}, {{"allocator", "malloc"}});
+  EXPECT_EQ(2u, builder.sample_count());
+
+  const Message profile = Decode(builder.Serialize());
+  const std::vector<std::string> strings = Values(profile.bytes, 6);
+  EXPECT_EQ(1000000000u, Varint(profile, 9));
+  EXPECT_EQ(2000000000u, Varint(profile, 10));
+  EXPECT_EQ(128u * 1024, Varint(profile, 12));
+
+  // Locations are deduplicated by address. Only the addresses inside the
+  // module have a mapping.
+  const std::vector<std::string> locations = Values(profile.bytes, 4);
+  ASSERT_EQ(3u, locations.size());
+  std::map<uint64_t, Message> locations_by_id;
+  for (const std::string& location : locations) {
+    Message decoded = Decode(location);
+    locations_by_id.emplace(Varint(decoded, 1), std::move(decoded));
+  }
+
+  const std::vector<std::string> mappings = Values(profile.bytes, 3);
+  ASSERT_EQ(1u, mappings.size());
+  const Message mapping = Decode(mappings[0]);
+  EXPECT_EQ(0x1000u, Varint(mapping, 2));
+  EXPECT_EQ(0x2000u, Varint(mapping, 3));
+  EXPECT_EQ("libtest.so", strings[Varint(mapping, 5)]);
+  EXPECT_EQ("ABCDEF", strings[Varint(mapping, 6)]);
+
+  const std::vector<std::string> samples = Values(profile.bytes, 2);
+  ASSERT_EQ(2u, samples.size());
+
+  const Message first = Decode(samples[0]);
+  const std::vector<uint64_t> first_locations =
+      DecodePacked(first.bytes.find(1)->second);
+  ASSERT_EQ(2u, first_locations.size());
+  EXPECT_EQ(0x1010u, Varint(locations_by_id[first_locations[0]], 3));
+  EXPECT_EQ(0x1020u, Varint(locations_by_id[first_locations[1]], 3));
+  EXPECT_EQ(Varint(mapping, 1),
+            Varint(locations_by_id[first_locations[0]], 2));
+  EXPECT_EQ(std::vector<uint64_t>({1, 100}),
+            DecodePacked(first.bytes.find(2)->second));
+  const Message first_label = Decode(first.bytes.find(3)->second);
+  EXPECT_EQ("bucket", strings[Varint(first_label, 1)]);
+  EXPECT_EQ(128u, Varint(first_label, 3));
+  EXPECT_EQ("bytes", strings[Varint(first_label, 4)]);
+
+  const Message second = Decode(samples[1]);
+  const std::vector<uint64_t> second_locations =
+      DecodePacked(second.bytes.find(1)->second);
+  ASSERT_EQ(2u, second_locations.size());
+  EXPECT_EQ(first_locations[1], second_locations[0]);
+  EXPECT_EQ(0x5000u, Varint(locations_by_id[second_locations[1]], 3));
+  EXPECT_EQ(0u, Varint(locations_by_id[second_locations[1]], 2));
+  const Message second_label = Decode(second.bytes.find(3)->second);
+  EXPECT_EQ("allocator", strings[Varint(second_label, 1)]);
+  EXPECT_EQ("malloc", strings[Varint(second_label, 2)]);
+}
+
+}  // namespace base
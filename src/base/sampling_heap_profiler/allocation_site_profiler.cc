@@ -0,0 +1,279 @@
+// Copyright 2021 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "base/sampling_heap_profiler/allocation_site_profiler.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "base/bits.h"
+#include "base/files/file_util.h"
+#include "base/hash/hash.h"
+#include "base/no_destructor.h"
+#include "base/profiler/module_cache.h"
+#include "base/profiler/pprof_profile_builder.h"
+#include "base/sampling_heap_profiler/sampling_heap_profiler.h"
+
+namespace base {
+
+namespace {
+
+constexpr size_t kMaxStackEntries = 128;
+// Frame storage is sized for this many frames per site on average.
+constexpr size_t kAverageFramesPerSite = 32;
+// Bound on the probe sequences of the live samples table.
+constexpr size_t kMaxProbes = 32;
+
+constexpr uintptr_t kEmptySlot = 0;
+// Marks slots of freed samples. Lookups continue probing past removed slots.
+constexpr uintptr_t kRemovedSlot = 1;
+
+// Size classes are powers of two. The discriminator of a site combines the
+// size class and the allocator type.
+uint32_t SizeClassOrder(size_t size) {
+  return bits::Log2Ceiling(
+      static_cast<uint32_t>(std::min<size_t>(size, uint32_t{1} << 31)));
+}
+
+uint32_t MakeDiscriminator(size_t size,
+                           PoissonAllocationSampler::AllocatorType type) {
+  return (SizeClassOrder(size) << 8) | type;
+}
+
+size_t SizeClassFromDiscriminator(uint32_t discriminator) {
+  return size_t{1} << (discriminator >> 8);
+}
+
+PoissonAllocationSampler::AllocatorType AllocatorFromDiscriminator(
+    uint32_t discriminator) {
+  return static_cast<PoissonAllocationSampler::AllocatorType>(discriminator &
+                                                              0xff);
+}
+
+const char* AllocatorName(PoissonAllocationSampler::AllocatorType type) {
+  switch (type) {
+    case PoissonAllocationSampler::kMalloc:
+      return "malloc";
+    case PoissonAllocationSampler::kPartitionAlloc:
+      return "partition_alloc";
+  }
+  return "unknown";
+}
+
+size_t LiveSamplesTableSize(size_t max_live_samples) {
+  // At most half full, which keeps the bounded probe sequences sufficient.
+  return size_t{1} << bits::Log2Ceiling(static_cast<uint32_t>(
+             std::max<size_t>(max_live_samples * 2, kMaxProbes)));
+}
+
+}  // namespace
+
+AllocationSiteProfiler::Options::Options() = default;
+AllocationSiteProfiler::Options::Options(const Options&) = default;
+AllocationSiteProfiler::Options::~Options() = default;
+
+AllocationSiteProfiler::Site::Site() = default;
+AllocationSiteProfiler::Site::Site(const Site&) = default;
+AllocationSiteProfiler::Site::~Site() = default;
+
+AllocationSiteProfiler::AllocationSiteProfiler(const Options& options)
+    : options_(options),
+      stacks_(options.max_sites, options.max_sites * kAverageFramesPerSite),
+      site_stats_(new SiteStats[stacks_.end_index()]),
+      live_samples_mask_(LiveSamplesTableSize(options.max_live_samples) - 1),
+      live_samples_(new LiveSample[live_samples_mask_ + 1]) {}
+
+AllocationSiteProfiler::~AllocationSiteProfiler() = default;
+
+// static
+AllocationSiteProfiler* AllocationSiteProfiler::Get(const Options& options) {
+  static NoDestructor<AllocationSiteProfiler> instance([&options] {
+    PoissonAllocationSampler::Init();
+    return options;
+  }());
+  return instance.get();
+}
+
+void AllocationSiteProfiler::Start() {
+  AutoLock lock(start_stop_lock_);
+  if (running_)
+    return;
+  running_ = true;
+  start_time_ = TimeTicks::Now();
+  PoissonAllocationSampler::Get()->SetSamplingInterval(
+      options_.sampling_interval);
+  PoissonAllocationSampler::Get()->AddSamplesObserver(this);
+}
+
+void AllocationSiteProfiler::Stop() {
+  AutoLock lock(start_stop_lock_);
+  if (!running_)
+    return;
+  running_ = false;
+  previous_duration_ += TimeTicks::Now() - start_time_;
+  PoissonAllocationSampler::Get()->RemoveSamplesObserver(this);
+}
+
+std::vector<AllocationSiteProfiler::Site> AllocationSiteProfiler::GetSites()
+    const {
+  TimeDelta duration;
+  {
+    AutoLock lock(start_stop_lock_);
+    duration = previous_duration_;
+    if (running_)
+      duration += TimeTicks::Now() - start_time_;
+  }
+
+  std::vector<Site> sites;
+  for (uint32_t index = 0; index < stacks_.end_index(); ++index) {
+    if (!stacks_.IsValid(index))
+      continue;
+    const SiteStats& stats = site_stats_[index];
+    Site site;
+    site.allocated_count =
+        stats.allocated_count.load(std::memory_order_relaxed);
+    if (!site.allocated_count)
+      continue;
+    const span<const void* const> frames = stacks_.GetStack(index);
+    site.frames.assign(frames.begin(), frames.end());
+    const uint32_t discriminator = stacks_.GetDiscriminator(index);
+    site.allocator = AllocatorFromDiscriminator(discriminator);
+    site.size_class = SizeClassFromDiscriminator(discriminator);
+    site.live_bytes = stats.live_bytes.load(std::memory_order_relaxed);
+    site.live_count = stats.live_count.load(std::memory_order_relaxed);
+    site.allocated_bytes =
+        stats.allocated_bytes.load(std::memory_order_relaxed);
+    if (!duration.is_zero()) {
+      site.allocated_bytes_per_second =
+          site.allocated_bytes / duration.InSecondsF();
+    }
+    sites.push_back(std::move(site));
+  }
+  return sites;
+}
+
+std::string AllocationSiteProfiler::SerializeToPprof() const {
+  ModuleCache module_cache;
+  PprofProfileBuilder builder({{"alloc_objects", "count"},
+                               {"alloc_space", "bytes"},
+                               {"inuse_objects", "count"},
+                               {"inuse_space", "bytes"}},
+                              &module_cache);
+  builder.SetPeriod({"space", "bytes"},
+                    static_cast<int64_t>(options_.sampling_interval));
+  {
+    AutoLock lock(start_stop_lock_);
+    TimeDelta duration = previous_duration_;
+    if (running_)
+      duration += TimeTicks::Now() - start_time_;
+    builder.SetTime(Time::Now() - duration, duration);
+  }
+
+  for (const Site& site : GetSites()) {
+    std::vector<uintptr_t> frames;
+    frames.reserve(site.frames.size());
+    for (const void* frame : site.frames)
+      frames.push_back(reinterpret_cast<uintptr_t>(frame));
+    builder.AddSample(frames,
+                      {static_cast<int64_t>(site.allocated_count),
+                       static_cast<int64_t>(site.allocated_bytes),
+                       static_cast<int64_t>(site.live_count),
+                       static_cast<int64_t>(site.live_bytes)},
+                      {{"bucket", std::string(),
+                        static_cast<int64_t>(site.size_class), "bytes"},
+                       {"allocator", AllocatorName(site.allocator)}});
+  }
+  return builder.Serialize();
+}
+
+bool AllocationSiteProfiler::WriteToFile(const FilePath& path) const {
+  const std::string profile = SerializeToPprof();
+  return WriteFile(path, profile);
+}
+
+void AllocationSiteProfiler::SampleAdded(
+    void* address,
+    size_t size,
+    size_t total,
+    PoissonAllocationSampler::AllocatorType type,
+    const char* context) {
+  void* stack[kMaxStackEntries];
+  size_t frame_count;
+  void** first_frame = SamplingHeapProfiler::CaptureStackTrace(
+      stack, kMaxStackEntries, &frame_count);
+  RecordSample(address, size, total, type,
+               span<const void* const>(first_frame, frame_count));
+}
+
+void AllocationSiteProfiler::RecordSample(
+    void* address,
+    size_t size,
+    size_t total,
+    PoissonAllocationSampler::AllocatorType type,
+    span<const void* const> frames) {
+  const uint32_t site = stacks_.Insert(frames, MakeDiscriminator(size, type));
+  if (site == LockFreeStackTable::kInvalidIndex) {
+    dropped_samples_.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  // A sample stands for |total| bytes worth of allocations of the same size.
+  const size_t count = size ? std::max<size_t>(total / size, 1) : 1;
+  SiteStats& stats = site_stats_[site];
+  stats.allocated_bytes.fetch_add(total, std::memory_order_relaxed);
+  stats.allocated_count.fetch_add(count, std::memory_order_relaxed);
+
+  const uintptr_t key = reinterpret_cast<uintptr_t>(address);
+  size_t index = HashInts(key, 0u);
+  for (size_t probe = 0; probe < kMaxProbes; ++probe, ++index) {
+    LiveSample& sample = live_samples_[index & live_samples_mask_];
+    uintptr_t slot_address = sample.address.load(std::memory_order_relaxed);
+    if (slot_address != kEmptySlot && slot_address != kRemovedSlot)
+      continue;
+    if (!sample.address.compare_exchange_strong(slot_address, key,
+                                                std::memory_order_relaxed)) {
+      continue;
+    }
+    // The sample can only be removed after the allocation returns, which
+    // orders these stores before the loads in SampleRemoved().
+    sample.site.store(site, std::memory_order_relaxed);
+    sample.bytes.store(total, std::memory_order_relaxed);
+    sample.count.store(count, std::memory_order_relaxed);
+    stats.live_bytes.fetch_add(total, std::memory_order_relaxed);
+    stats.live_count.fetch_add(count, std::memory_order_relaxed);
+    return;
+  }
+  // The allocation is still accounted for in the allocated totals.
+  dropped_samples_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void AllocationSiteProfiler::SampleRemoved(void* address) {
+  LiveSample* sample = FindLiveSample(reinterpret_cast<uintptr_t>(address));
+  if (!sample)
+    return;
+  SiteStats& stats = site_stats_[sample->site.load(std::memory_order_relaxed)];
+  stats.live_bytes.fetch_sub(sample->bytes.load(std::memory_order_relaxed),
+                             std::memory_order_relaxed);
+  stats.live_count.fetch_sub(sample->count.load(std::memory_order_relaxed),
+                             std::memory_order_relaxed);
+  sample->address.store(kRemovedSlot, std::memory_order_relaxed);
+}
+
+AllocationSiteProfiler::LiveSample* AllocationSiteProfiler::FindLiveSample(
+    uintptr_t address) {
+  size_t index = HashInts(address, 0u);
+  for (size_t probe = 0; probe < kMaxProbes; ++probe, ++index) {
+    LiveSample& sample = live_samples_[index & live_samples_mask_];
+    const uintptr_t slot_address =
+        sample.address.load(std::memory_order_relaxed);
+    if (slot_address == address)
+      return &sample;
+    // Samples are inserted into the first free slot of the probe sequence, and
+    // slots never become empty again, so the address can't be further along.
+    if (slot_address == kEmptySlot)
+      return nullptr;
+  }
+  return nullptr;
+}
+
+}  // namespace base
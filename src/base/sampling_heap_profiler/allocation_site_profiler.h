@@ -0,0 +1,170 @@
+// Copyright 2021 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BASE_SAMPLING_HEAP_PROFILER_ALLOCATION_SITE_PROFILER_H_
+#define BASE_SAMPLING_HEAP_PROFILER_ALLOCATION_SITE_PROFILER_H_
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "base/base_export.h"
+#include "base/sampling_heap_profiler/lock_free_stack_table.h"
+#include "base/sampling_heap_profiler/poisson_allocation_sampler.h"
+#include "base/synchronization/lock.h"
+#include "base/thread_annotations.h"
+#include "base/time/time.h"
+
+namespace base {
+
+class FilePath;
+
+// AllocationSiteProfiler aggregates sampled allocations by allocation site,
+// i.e. by the call stack of the allocation, the allocator and the size class of
+// the allocation. For every site it tracks the estimated live (in use) memory
+// and the estimated number of bytes allocated since the profiler was started.
+//
+// Allocations are sampled by PoissonAllocationSampler, which observes both the
+// allocator shim and PartitionAlloc through their hooks. The overhead is
+// controlled by the mean sampling interval: allocations that are not sampled
+// only pay for the sampler's thread-local byte counter, while sampled ones
+// additionally pay for a stack unwind (using frame pointers where available)
+// and a few lock-free table updates, a few microseconds in total. With the
+// default interval of 128KiB the overhead stays below 2% for threads that
+// allocate less than about 800MB/s (see allocation_site_profiler_perftest.cc).
+//
+// Sampled allocations never take locks or allocate: stacks are deduplicated in
+// a LockFreeStackTable and live samples are tracked in a fixed-size open
+// addressing table. Once either is full, new samples are dropped and counted
+// in |dropped_samples|.
+//
+// The collected profile can be exported in the pprof format, e.g.
+//   AllocationSiteProfiler::Get()->WriteToFile(path);
+// and then inspected with `pprof -http=: <binary> <path>`.
+class BASE_EXPORT AllocationSiteProfiler
+    : private PoissonAllocationSampler::SamplesObserver {
+ public:
+  struct BASE_EXPORT Options {
+    Options();
+    Options(const Options&);
+    ~Options();
+
+    // Mean sampling interval in bytes.
+    size_t sampling_interval = 128 * 1024;
+    // Maximum number of distinct allocation sites.
+    size_t max_sites = 16 * 1024;
+    // Maximum number of sampled allocations that can be alive at once.
+    size_t max_live_samples = 64 * 1024;
+  };
+
+  struct BASE_EXPORT Site {
+    Site();
+    Site(const Site&);
+    ~Site();
+
+    // Instruction pointers from the allocating function to the root.
+    std::vector<const void*> frames;
+    PoissonAllocationSampler::AllocatorType allocator;
+    // All allocations of the site are at most |size_class| bytes and larger
+    // than half of it.
+    size_t size_class = 0;
+    // Estimates, derived from the samples.
+    size_t live_bytes = 0;
+    size_t live_count = 0;
+    size_t allocated_bytes = 0;
+    size_t allocated_count = 0;
+    double allocated_bytes_per_second = 0;
+  };
+
+  // Returns the profiler singleton, creating it with |options| if needed.
+  // |options| are ignored on subsequent calls.
+  static AllocationSiteProfiler* Get(const Options& options = Options());
+
+  AllocationSiteProfiler(const AllocationSiteProfiler&) = delete;
+  AllocationSiteProfiler& operator=(const AllocationSiteProfiler&) = delete;
+
+  // Starts and stops recording samples. The sampling interval of
+  // PoissonAllocationSampler is process-wide and is set on |Start|.
+  void Start();
+  void Stop();
+
+  // Returns the sites that have seen at least one sample.
+  std::vector<Site> GetSites() const;
+
+  // Returns the profile as a serialized, uncompressed pprof profile.proto
+  // message with alloc_objects, alloc_space, inuse_objects and inuse_space
+  // sample types. Every site is labeled with its size class ("bucket") and
+  // allocator.
+  std::string SerializeToPprof() const;
+
+  // Writes the result of |SerializeToPprof| to |path|.
+  bool WriteToFile(const FilePath& path) const;
+
+  size_t dropped_samples() const {
+    return dropped_samples_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  friend class AllocationSiteProfilerTest;
+
+  struct SiteStats {
+    std::atomic<size_t> live_bytes{0};
+    std::atomic<size_t> live_count{0};
+    std::atomic<size_t> allocated_bytes{0};
+    std::atomic<size_t> allocated_count{0};
+  };
+
+  struct LiveSample {
+    std::atomic<uintptr_t> address{0};
+    std::atomic<uint32_t> site{0};
+    std::atomic<size_t> bytes{0};
+    std::atomic<size_t> count{0};
+  };
+
+  explicit AllocationSiteProfiler(const Options& options);
+  ~AllocationSiteProfiler() override;
+
+  // PoissonAllocationSampler::SamplesObserver:
+  void SampleAdded(void* address,
+                   size_t size,
+                   size_t total,
+                   PoissonAllocationSampler::AllocatorType type,
+                   const char* context) override;
+  void SampleRemoved(void* address) override;
+
+  // Records a sample allocated at the site with the given stack.
+  void RecordSample(void* address,
+                    size_t size,
+                    size_t total,
+                    PoissonAllocationSampler::AllocatorType type,
+                    span<const void* const> frames);
+
+  LiveSample* FindLiveSample(uintptr_t address);
+
+  const Options options_;
+
+  LockFreeStackTable stacks_;
+  // Indexed by the stack table index of the site.
+  std::unique_ptr<SiteStats[]> site_stats_;
+
+  // Open addressing table of the live samples. Probing is bounded by
+  // kMaxProbes, which keeps removals of unknown addresses cheap.
+  const size_t live_samples_mask_;
+  std::unique_ptr<LiveSample[]> live_samples_;
+
+  std::atomic<size_t> dropped_samples_{0};
+
+  mutable Lock start_stop_lock_;
+  bool running_ GUARDED_BY(start_stop_lock_) = false;
+  TimeTicks start_time_ GUARDED_BY(start_stop_lock_);
+  // Time spent running before the last |Start|.
+  TimeDelta previous_duration_ GUARDED_BY(start_stop_lock_);
+
+  friend class NoDestructor<AllocationSiteProfiler>;
+};
+
+}  // namespace base
+
+#endif  // BASE_SAMPLING_HEAP_PROFILER_ALLOCATION_SITE_PROFILER_H_
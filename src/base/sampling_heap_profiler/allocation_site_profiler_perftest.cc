@@ -0,0 +1,118 @@
+// Copyright 2021 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "base/sampling_heap_profiler/allocation_site_profiler.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "base/allocator/allocator_shim.h"
+#include "base/sampling_heap_profiler/poisson_allocation_sampler.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/time/time.h"
+#include "build/build_config.h"
+#include "testing/gtest/include/gtest/gtest.h"
+#include "testing/perf/perf_result_reporter.h"
+
+namespace base {
+
+namespace {
+
+constexpr char kMetricPrefixAllocationSiteProfiler[] =
+    "AllocationSiteProfiler.";
+constexpr char kMetricTimePerAllocation[] = "time_per_allocation";
+constexpr char kMetricTimePerSample[] = "time_per_sample";
+constexpr char kMetricOverhead[] = "overhead";
+
+constexpr size_t kAllocationsCount = 10 * 1000 * 1000;
+constexpr size_t kLiveAllocationsCount = 1024;
+
+perf_test::PerfResultReporter SetUpReporter(const std::string& story_name) {
+  perf_test::PerfResultReporter reporter(kMetricPrefixAllocationSiteProfiler,
+                                         story_name);
+  reporter.RegisterImportantMetric(kMetricTimePerAllocation, "ns");
+  reporter.RegisterImportantMetric(kMetricTimePerSample, "ns");
+  reporter.RegisterImportantMetric(kMetricOverhead, "%");
+  return reporter;
+}
+
+// Allocates kAllocationsCount blocks of 16 bytes to 8 KiB with malloc(),
+// writes all their bytes, and frees each one kLiveAllocationsCount
+// allocations later. This is about the least work a program does per
+// allocated byte, so the overhead of the profiler is an upper bound.
+// Returns the time per allocation in nanoseconds, and the mean size of the
+// allocations in |mean_size|.
+double RunAllocations(double* mean_size) {
+  std::vector<void*> live(kLiveAllocationsCount, nullptr);
+  uint32_t random = 1;
+  size_t total_size = 0;
+  const TimeTicks start = TimeTicks::Now();
+  for (size_t i = 0; i < kAllocationsCount; ++i) {
+    random = random * 1664525 + 1013904223;
+    // Log-uniform sizes.
+    const size_t size_class = size_t{16} << ((random >> 8) % 9);
+    const size_t size = size_class + ((random >> 16) & (size_class - 1));
+    void*& block = live[i % kLiveAllocationsCount];
+    free(block);
+    block = malloc(size);
+    memset(block, static_cast<int>(i), size);
+    total_size += size;
+  }
+  const TimeDelta elapsed = TimeTicks::Now() - start;
+  for (void* block : live)
+    free(block);
+  *mean_size = static_cast<double>(total_size) / kAllocationsCount;
+  return elapsed.InMicrosecondsF() * 1000 / kAllocationsCount;
+}
+
+}  // namespace
+
+TEST(AllocationSiteProfilerPerfTest, Overhead) {
+#if defined(OS_APPLE)
+  allocator::InitializeAllocatorShim();
+#endif
+  PoissonAllocationSampler::Init();
+
+  // The allocator hooks are installed when the profiler is first started, and
+  // stay installed, so the baseline is measured first.
+  double mean_size;
+  const double baseline = RunAllocations(&mean_size);
+  SetUpReporter("baseline").AddResult(kMetricTimePerAllocation, baseline);
+
+  // The cost of the hooks of PoissonAllocationSampler, paid by every
+  // allocation while they are installed, even if no profiler is running.
+  AllocationSiteProfiler* profiler = AllocationSiteProfiler::Get();
+  profiler->Start();
+  profiler->Stop();
+  const double hooks_only = RunAllocations(&mean_size);
+  perf_test::PerfResultReporter hooks_reporter = SetUpReporter("hooks_only");
+  hooks_reporter.AddResult(kMetricTimePerAllocation, hooks_only);
+  hooks_reporter.AddResult(kMetricOverhead,
+                           100 * (hooks_only - baseline) / baseline);
+
+  for (size_t sampling_interval : {32 * 1024, 128 * 1024, 512 * 1024}) {
+    // The state of the heap, and of the sampler, changes from run to run, so
+    // every interval is compared with a run without the profiler right before
+    // it.
+    const double reference = RunAllocations(&mean_size);
+    profiler->Start();
+    PoissonAllocationSampler::Get()->SetSamplingInterval(sampling_interval);
+    const double time = RunAllocations(&mean_size);
+    profiler->Stop();
+
+    perf_test::PerfResultReporter reporter = SetUpReporter(
+        "interval_" + NumberToString(sampling_interval / 1024) + "KiB");
+    reporter.AddResult(kMetricTimePerAllocation, time);
+    // The samples of an allocation, on average.
+    const double samples = mean_size / sampling_interval;
+    reporter.AddResult(kMetricTimePerSample, (time - reference) / samples);
+    reporter.AddResult(kMetricOverhead, 100 * (time - reference) / reference);
+  }
+}
+
+}  // namespace base
@@ -0,0 +1,173 @@
+// Copyright 2021 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "base/sampling_heap_profiler/allocation_site_profiler.h"
+
+#include <stdlib.h>
+
+#include <memory>
+#include <vector>
+
+#include "base/allocator/allocator_shim.h"
+#include "base/debug/alias.h"
+#include "base/files/file_util.h"
+#include "base/files/scoped_temp_dir.h"
+#include "build/build_config.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace base {
+
+class AllocationSiteProfilerTest : public ::testing::Test {
+ public:
+  void SetUp() override {
+#if defined(OS_APPLE)
+    allocator::InitializeAllocatorShim();
+#endif
+    PoissonAllocationSampler::Init();
+  }
+
+  void TearDown() override { delete profiler_; }
+
+  AllocationSiteProfiler* CreateProfiler(
+      const AllocationSiteProfiler::Options& options) {
+    profiler_ = new AllocationSiteProfiler(options);
+    return profiler_;
+  }
+
+  void AddSample(uintptr_t address,
+                 size_t size,
+                 size_t total,
+                 const std::vector<const void*>& frames) {
+    profiler_->RecordSample(reinterpret_cast<void*>(address), size, total,
+                            PoissonAllocationSampler::kMalloc, frames);
+  }
+
+  void RemoveSample(uintptr_t address) {
+    profiler_->SampleRemoved(reinterpret_cast<void*>(address));
+  }
+
+ private:
+  AllocationSiteProfiler* profiler_ = nullptr;
+};
+
+namespace {
+
+const std::vector<const void*> kStack1 = {reinterpret_cast<const void*>(0x10),
+                                          reinterpret_cast<const void*>(0x20)};
+const std::vector<const void*> kStack2 = {reinterpret_cast<const void*>(0x30)};
+
+const AllocationSiteProfiler::Site* FindSite(
+    const std::vector<AllocationSiteProfiler::Site>& sites,
+    const std::vector<const void*>& frames,
+    size_t size_class) {
+  for (const AllocationSiteProfiler::Site& site : sites) {
+    if (site.frames == frames && site.size_class == size_class)
+      return &site;
+  }
+  return nullptr;
+}
+
+}  // namespace
+
+TEST_F(AllocationSiteProfilerTest, AggregatesBySite) {
+  AllocationSiteProfiler* profiler =
+      CreateProfiler(AllocationSiteProfiler::Options());
+  // Two samples of 100 bytes, each standing for 1000 bytes.
+  AddSample(0x1000, 100, 1000, kStack1);
+  AddSample(0x2000, 100, 1000, kStack1);
+  // Same stack, but a different size class.
+  AddSample(0x3000, 1000, 1000, kStack1);
+  AddSample(0x4000, 100, 1000, kStack2);
+
+  std::vector<AllocationSiteProfiler::Site> sites = profiler->GetSites();
+  ASSERT_EQ(3u, sites.size());
+  const AllocationSiteProfiler::Site* site = FindSite(sites, kStack1, 128);
+  ASSERT_TRUE(site);
+  EXPECT_EQ(PoissonAllocationSampler::kMalloc, site->allocator);
+  EXPECT_EQ(2000u, site->allocated_bytes);
+  EXPECT_EQ(20u, site->allocated_count);
+  EXPECT_EQ(2000u, site->live_bytes);
+  EXPECT_EQ(20u, site->live_count);
+  site = FindSite(sites, kStack1, 1024);
+  ASSERT_TRUE(site);
+  EXPECT_EQ(1u, site->allocated_count);
+  ASSERT_TRUE(FindSite(sites, kStack2, 128));
+
+  RemoveSample(0x1000);
+  // Samples recorded before the profiler was created are ignored.
+  RemoveSample(0x5000);
+  sites = profiler->GetSites();
+  site = FindSite(sites, kStack1, 128);
+  ASSERT_TRUE(site);
+  EXPECT_EQ(2000u, site->allocated_bytes);
+  EXPECT_EQ(1000u, site->live_bytes);
+  EXPECT_EQ(10u, site->live_count);
+  EXPECT_EQ(0u, profiler->dropped_samples());
+}
+
+TEST_F(AllocationSiteProfilerTest, ReusesRemovedSlots) {
+  AllocationSiteProfiler::Options options;
+  options.max_live_samples = 4;
+  AllocationSiteProfiler* profiler = CreateProfiler(options);
+  for (uintptr_t address = 0x1000; address < 0x100000; address += 0x10) {
+    AddSample(address, 16, 16, kStack1);
+    RemoveSample(address);
+  }
+  const std::vector<AllocationSiteProfiler::Site> sites = profiler->GetSites();
+  ASSERT_EQ(1u, sites.size());
+  EXPECT_EQ(0u, sites[0].live_bytes);
+  EXPECT_EQ(0u, profiler->dropped_samples());
+}
+
+TEST_F(AllocationSiteProfilerTest, DropsSamplesWhenFull) {
+  AllocationSiteProfiler::Options options;
+  options.max_sites = 1;
+  AllocationSiteProfiler* profiler = CreateProfiler(options);
+  AddSample(0x1000, 100, 1000, kStack1);
+  AddSample(0x2000, 100, 1000, kStack2);
+  EXPECT_EQ(1u, profiler->GetSites().size());
+  EXPECT_EQ(1u, profiler->dropped_samples());
+}
+
+TEST_F(AllocationSiteProfilerTest, WriteToFile) {
+  AllocationSiteProfiler* profiler =
+      CreateProfiler(AllocationSiteProfiler::Options());
+  AddSample(0x1000, 100, 1000, kStack1);
+
+  ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+  const FilePath path = temp_dir.GetPath().AppendASCII("heap.pb");
+  ASSERT_TRUE(profiler->WriteToFile(path));
+  std::string contents;
+  ASSERT_TRUE(ReadFileToString(path, &contents));
+  EXPECT_EQ(profiler->SerializeToPprof().size(), contents.size());
+  EXPECT_NE(std::string::npos, contents.find("inuse_space"));
+  EXPECT_NE(std::string::npos, contents.find("bucket"));
+}
+
+TEST_F(AllocationSiteProfilerTest, RecordsAllocations) {
+  AllocationSiteProfiler::Options options;
+  options.sampling_interval = 1024;
+  AllocationSiteProfiler* profiler = CreateProfiler(options);
+  PoissonAllocationSampler::Get()->SuppressRandomnessForTest(true);
+  profiler->Start();
+  std::vector<void*> allocations;
+  for (int i = 0; i < 100; ++i) {
+    allocations.push_back(malloc(10000));
+    debug::Alias(&allocations.back());
+  }
+  profiler->Stop();
+
+  size_t live_bytes = 0;
+  for (const AllocationSiteProfiler::Site& site : profiler->GetSites()) {
+    if (site.size_class == 16384 && !site.frames.empty())
+      live_bytes += site.live_bytes;
+  }
+  EXPECT_GE(live_bytes, 100u * 10000 / 2);
+  for (void* allocation : allocations)
+    free(allocation);
+  PoissonAllocationSampler::Get()->SuppressRandomnessForTest(false);
+}
+
+}  // namespace base
@@ -0,0 +1,116 @@
+// Copyright 2021 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "base/sampling_heap_profiler/lock_free_stack_table.h"
+
+#include <algorithm>
+
+#include "base/bits.h"
+#include "base/check_op.h"
+#include "base/hash/hash.h"
+
+namespace base {
+
+LockFreeStackTable::LockFreeStackTable(size_t capacity, size_t frames_capacity)
+    // Keep the load factor below 3/4 to bound probe sequences.
+    : slots_count_(size_t{1} << bits::Log2Ceiling(static_cast<uint32_t>(
+                       std::max<size_t>(capacity + capacity / 3, 1)))),
+      max_size_(capacity),
+      frames_capacity_(frames_capacity),
+      entries_(new Entry[slots_count_]),
+      frames_(new const void*[frames_capacity]) {
+  DCHECK_LT(slots_count_, kInvalidIndex);
+  DCHECK_LE(frames_capacity, std::numeric_limits<uint32_t>::max());
+}
+
+LockFreeStackTable::~LockFreeStackTable() = default;
+
+uint32_t LockFreeStackTable::Insert(span<const void* const> frames,
+                                    uint32_t discriminator) {
+  const size_t hash = HashStack(frames, discriminator);
+  const size_t mask = slots_count_ - 1;
+  for (size_t probe = 0, index = hash & mask; probe < slots_count_;
+       ++probe, index = (index + 1) & mask) {
+    Entry& entry = entries_[index];
+    size_t entry_hash = entry.hash.load(std::memory_order_acquire);
+    if (entry_hash == 0) {
+      if (size_.load(std::memory_order_relaxed) >= max_size_)
+        return kInvalidIndex;
+      if (entry.hash.compare_exchange_strong(entry_hash, hash,
+                                             std::memory_order_acq_rel)) {
+        size_.fetch_add(1, std::memory_order_relaxed);
+        size_t offset;
+        if (!AllocateFrames(frames.size(), &offset)) {
+          entry.state.store(kOverflow, std::memory_order_release);
+          return kInvalidIndex;
+        }
+        std::copy(frames.begin(), frames.end(), &frames_[offset]);
+        entry.discriminator = discriminator;
+        entry.frames_offset = static_cast<uint32_t>(offset);
+        entry.frame_count = static_cast<uint32_t>(frames.size());
+        entry.state.store(kReady, std::memory_order_release);
+        return static_cast<uint32_t>(index);
+      }
+      // Another thread claimed the slot; |entry_hash| now holds its hash.
+    }
+    if (entry_hash != hash)
+      continue;
+
+    // The slot may have been claimed just now. Waiting for it to be filled in
+    // would block on the claiming thread, which may be preempted or be
+    // interrupted by a signal handler that allocates, so it's a miss.
+    const uint32_t state = entry.state.load(std::memory_order_acquire);
+    if (state != kReady)
+      return kInvalidIndex;
+    if (Matches(entry, frames, discriminator))
+      return static_cast<uint32_t>(index);
+  }
+  return kInvalidIndex;
+}
+
+span<const void* const> LockFreeStackTable::GetStack(uint32_t index) const {
+  DCHECK(IsValid(index));
+  const Entry& entry = entries_[index];
+  return make_span(&frames_[entry.frames_offset], entry.frame_count);
+}
+
+uint32_t LockFreeStackTable::GetDiscriminator(uint32_t index) const {
+  DCHECK(IsValid(index));
+  return entries_[index].discriminator;
+}
+
+bool LockFreeStackTable::IsValid(uint32_t index) const {
+  return index < slots_count_ &&
+         entries_[index].state.load(std::memory_order_acquire) == kReady;
+}
+
+bool LockFreeStackTable::AllocateFrames(size_t count, size_t* offset) {
+  size_t used = frames_used_.load(std::memory_order_relaxed);
+  do {
+    if (used + count > frames_capacity_)
+      return false;
+  } while (!frames_used_.compare_exchange_weak(used, used + count,
+                                               std::memory_order_relaxed));
+  *offset = used;
+  return true;
+}
+
+// static
+size_t LockFreeStackTable::HashStack(span<const void* const> frames,
+                                     uint32_t discriminator) {
+  const size_t hash = HashInts(FastHash(as_bytes(frames)), discriminator);
+  // Zero marks empty slots.
+  return hash ? hash : 1;
+}
+
+bool LockFreeStackTable::Matches(const Entry& entry,
+                                 span<const void* const> frames,
+                                 uint32_t discriminator) const {
+  return entry.discriminator == discriminator &&
+         entry.frame_count == frames.size() &&
+         std::equal(frames.begin(), frames.end(),
+                    &frames_[entry.frames_offset]);
+}
+
+}  // namespace base
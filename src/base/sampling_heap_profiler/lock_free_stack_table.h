@@ -0,0 +1,109 @@
+// Copyright 2021 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BASE_SAMPLING_HEAP_PROFILER_LOCK_FREE_STACK_TABLE_H_
+#define BASE_SAMPLING_HEAP_PROFILER_LOCK_FREE_STACK_TABLE_H_
+
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <memory>
+
+#include "base/base_export.h"
+#include "base/containers/span.h"
+
+namespace base {
+
+// A fixed-capacity table that deduplicates call stacks and assigns each
+// distinct stack a stable index. |Insert| and |GetStack| are lock-free and can
+// be called concurrently from any thread, including from within allocator
+// hooks: the table never allocates after construction.
+//
+// Each stack is keyed by its frames and a caller-provided |discriminator|, so
+// identical stacks can be kept apart, e.g. by allocation size class.
+//
+// Entries are never removed. Once the table or its frame storage runs out of
+// space, new stacks are rejected with kInvalidIndex while already known stacks
+// continue to be found.
+//
+// Internally the table uses open addressing with linear probing. A slot is
+// claimed by publishing the hash of the stack with a compare-and-swap; the
+// claiming thread then copies the frames into a bump-allocated frame pool and
+// marks the slot ready. Threads that find a matching hash in a slot which is
+// still being filled in don't wait for it: the stack is rejected with
+// kInvalidIndex, like when the table is full.
+class BASE_EXPORT LockFreeStackTable {
+ public:
+  static constexpr uint32_t kInvalidIndex =
+      std::numeric_limits<uint32_t>::max();
+
+  // |capacity| is the maximum number of distinct stacks and |frames_capacity|
+  // the total number of frames that can be stored.
+  LockFreeStackTable(size_t capacity, size_t frames_capacity);
+  ~LockFreeStackTable();
+
+  LockFreeStackTable(const LockFreeStackTable&) = delete;
+  LockFreeStackTable& operator=(const LockFreeStackTable&) = delete;
+
+  // Returns the index of the stack, inserting it if it's not in the table yet.
+  // Returns kInvalidIndex if the stack is new and the table is full, or if
+  // another thread is inserting the same stack.
+  uint32_t Insert(span<const void* const> frames, uint32_t discriminator);
+
+  // Returns the frames and discriminator of the stack at |index|, which must
+  // have been returned by |Insert|.
+  span<const void* const> GetStack(uint32_t index) const;
+  uint32_t GetDiscriminator(uint32_t index) const;
+
+  // Returns one past the largest valid index. Indices below it may refer to
+  // empty slots; use |IsValid| to check.
+  uint32_t end_index() const { return static_cast<uint32_t>(slots_count_); }
+  bool IsValid(uint32_t index) const;
+
+  // Number of stacks in the table.
+  size_t size() const { return size_.load(std::memory_order_relaxed); }
+
+ private:
+  enum State : uint32_t {
+    // The slot is empty, or it has been claimed and the frames are being
+    // copied.
+    kPending,
+    kReady,
+    // The slot has been claimed but the frame pool didn't have enough space
+    // left for the stack. The slot stays unusable.
+    kOverflow,
+  };
+
+  struct Entry {
+    std::atomic<size_t> hash{0};
+    std::atomic<uint32_t> state{kPending};
+    uint32_t discriminator = 0;
+    uint32_t frames_offset = 0;
+    uint32_t frame_count = 0;
+  };
+
+  // Reserves |count| frames in the frame pool. Fails without reserving
+  // anything if there isn't enough space left.
+  bool AllocateFrames(size_t count, size_t* offset);
+  static size_t HashStack(span<const void* const> frames,
+                          uint32_t discriminator);
+  bool Matches(const Entry& entry,
+               span<const void* const> frames,
+               uint32_t discriminator) const;
+
+  // Always a power of two.
+  const size_t slots_count_;
+  const size_t max_size_;
+  const size_t frames_capacity_;
+
+  std::unique_ptr<Entry[]> entries_;
+  std::unique_ptr<const void*[]> frames_;
+
+  std::atomic<size_t> size_{0};
+  std::atomic<size_t> frames_used_{0};
+};
+
+}  // namespace base
+
+#endif  // BASE_SAMPLING_HEAP_PROFILER_LOCK_FREE_STACK_TABLE_H_
@@ -0,0 +1,140 @@
+// Copyright 2021 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "base/sampling_heap_profiler/lock_free_stack_table.h"
+
+#include <memory>
+#include <vector>
+
+#include "base/threading/simple_thread.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace base {
+
+namespace {
+
+std::vector<const void*> MakeStack(uintptr_t seed, size_t depth) {
+  std::vector<const void*> stack;
+  for (size_t i = 0; i < depth; ++i)
+    stack.push_back(reinterpret_cast<const void*>(seed * 0x1000 + i * 8));
+  return stack;
+}
+
+class InserterThread : public SimpleThread {
+ public:
+  InserterThread(LockFreeStackTable* table, size_t stacks_count)
+      : SimpleThread("InserterThread"),
+        table_(table),
+        stacks_count_(stacks_count) {}
+
+  void Run() override {
+    for (size_t i = 0; i < stacks_count_; ++i)
+      indices_.push_back(table_->Insert(MakeStack(i, 1 + i % 16), 0));
+  }
+
+  const std::vector<uint32_t>& indices() const { return indices_; }
+
+ private:
+  LockFreeStackTable* table_;
+  size_t stacks_count_;
+  std::vector<uint32_t> indices_;
+};
+
+}  // namespace
+
+TEST(LockFreeStackTableTest, EmptyTable) {
+  LockFreeStackTable table(16, 256);
+  EXPECT_EQ(0u, table.size());
+  for (uint32_t index = 0; index < table.end_index(); ++index)
+    EXPECT_FALSE(table.IsValid(index));
+}
+
+TEST(LockFreeStackTableTest, Deduplicates) {
+  LockFreeStackTable table(16, 256);
+  const std::vector<const void*> stack1 = MakeStack(1, 5);
+  const std::vector<const void*> stack2 = MakeStack(2, 5);
+
+  const uint32_t index1 = table.Insert(stack1, 0);
+  ASSERT_NE(LockFreeStackTable::kInvalidIndex, index1);
+  EXPECT_EQ(index1, table.Insert(stack1, 0));
+  EXPECT_EQ(1u, table.size());
+
+  const uint32_t index2 = table.Insert(stack2, 0);
+  ASSERT_NE(LockFreeStackTable::kInvalidIndex, index2);
+  EXPECT_NE(index1, index2);
+
+  // The discriminator keeps identical stacks apart.
+  const uint32_t index3 = table.Insert(stack1, 7);
+  ASSERT_NE(LockFreeStackTable::kInvalidIndex, index3);
+  EXPECT_NE(index1, index3);
+  EXPECT_EQ(3u, table.size());
+
+  EXPECT_TRUE(table.IsValid(index1));
+  const span<const void* const> frames = table.GetStack(index1);
+  EXPECT_EQ(stack1, std::vector<const void*>(frames.begin(), frames.end()));
+  EXPECT_EQ(0u, table.GetDiscriminator(index1));
+  EXPECT_EQ(7u, table.GetDiscriminator(index3));
+}
+
+TEST(LockFreeStackTableTest, EmptyStack) {
+  LockFreeStackTable table(4, 16);
+  const uint32_t index = table.Insert({}, 0);
+  ASSERT_NE(LockFreeStackTable::kInvalidIndex, index);
+  EXPECT_EQ(index, table.Insert({}, 0));
+  EXPECT_TRUE(table.GetStack(index).empty());
+}
+
+TEST(LockFreeStackTableTest, Full) {
+  LockFreeStackTable table(2, 256);
+  const uint32_t index1 = table.Insert(MakeStack(1, 4), 0);
+  const uint32_t index2 = table.Insert(MakeStack(2, 4), 0);
+  EXPECT_NE(LockFreeStackTable::kInvalidIndex, index1);
+  EXPECT_NE(LockFreeStackTable::kInvalidIndex, index2);
+  EXPECT_EQ(LockFreeStackTable::kInvalidIndex,
+            table.Insert(MakeStack(3, 4), 0));
+  // Known stacks are still found.
+  EXPECT_EQ(index1, table.Insert(MakeStack(1, 4), 0));
+  EXPECT_EQ(2u, table.size());
+}
+
+TEST(LockFreeStackTableTest, FramesExhausted) {
+  LockFreeStackTable table(16, 8);
+  EXPECT_NE(LockFreeStackTable::kInvalidIndex,
+            table.Insert(MakeStack(1, 6), 0));
+  EXPECT_EQ(LockFreeStackTable::kInvalidIndex,
+            table.Insert(MakeStack(2, 6), 0));
+  EXPECT_NE(LockFreeStackTable::kInvalidIndex,
+            table.Insert(MakeStack(3, 2), 0));
+}
+
+TEST(LockFreeStackTableTest, ConcurrentInsert) {
+  constexpr size_t kStacksCount = 1000;
+  constexpr size_t kThreadsCount = 4;
+  LockFreeStackTable table(kStacksCount, kStacksCount * 16);
+
+  std::vector<std::unique_ptr<InserterThread>> threads;
+  for (size_t i = 0; i < kThreadsCount; ++i)
+    threads.push_back(std::make_unique<InserterThread>(&table, kStacksCount));
+  for (auto& thread : threads)
+    thread->Start();
+  for (auto& thread : threads)
+    thread->Join();
+
+  // All threads agree on the index of every stack, unless they found it being
+  // inserted by another thread.
+  EXPECT_EQ(kStacksCount, table.size());
+  for (size_t i = 0; i < kStacksCount; ++i) {
+    const uint32_t index = table.Insert(MakeStack(i, 1 + i % 16), 0);
+    ASSERT_NE(LockFreeStackTable::kInvalidIndex, index);
+    for (auto& thread : threads) {
+      if (thread->indices()[i] != LockFreeStackTable::kInvalidIndex)
+        EXPECT_EQ(index, thread->indices()[i]);
+    }
+    const span<const void* const> frames = table.GetStack(index);
+    EXPECT_EQ(MakeStack(i, 1 + i % 16),
+              std::vector<const void*>(frames.begin(), frames.end()));
+  }
+}
+
+}  // namespace base
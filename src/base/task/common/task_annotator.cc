@@ -13,6 +13,7 @@
 #include "base/no_destructor.h"
 #include "base/ranges/algorithm.h"
 #include "base/sys_byteorder.h"
+#include "base/task/common/task_perf_counters.h"
 #include "base/threading/thread_local.h"
 #include "base/trace_event/base_tracing.h"
 #include "base/tracing_buildflags.h"
@@ -154,7 +155,10 @@ void TaskAnnotator::RunTaskImpl(PendingTask& pending_task) {
 
   if (g_task_annotator_observer)
     g_task_annotator_observer->BeforeRunTask(&pending_task);
-  std::move(pending_task.task).Run();
+  {
+    ScopedTaskPerfCounters task_perf_counters(pending_task.posted_from);
+    std::move(pending_task.task).Run();
+  }
 
   tls->Set(previous_pending_task);
 
@@ -0,0 +1,325 @@
+// Copyright 2021 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "base/task/common/task_perf_counters.h"
+
+#include <algorithm>
+
+#include "base/base_switches.h"
+#include "base/command_line.h"
+#include "base/hash/hash.h"
+#include "base/no_destructor.h"
+#include "base/trace_event/base_tracing.h"
+#include "build/build_config.h"
+
+#if defined(OS_LINUX) || defined(OS_CHROMEOS)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <memory>
+
+#include "base/cxx17_backports.h"
+#include "base/files/scoped_file.h"
+#include "base/posix/eintr_wrapper.h"
+#include "base/threading/thread_local.h"
+#endif  // defined(OS_LINUX) || defined(OS_CHROMEOS)
+
+namespace base {
+
+namespace {
+
+// Must be a power of two.
+constexpr size_t kTableSize = 1024;
+
+// An entry of the table. The entries are zero-initialized, i.e. empty, and
+// never freed: an entry is claimed for a location by setting |key|, after
+// which its counts are incremented by any thread, and the location is read
+// once |ready| is set.
+struct Entry {
+  std::atomic<uintptr_t> key;
+  std::atomic<bool> ready;
+  const char* function_name;
+  const char* file_name;
+  int line_number;
+  const void* program_counter;
+  std::atomic<int64_t> num_tasks;
+  std::atomic<int64_t> instructions;
+  std::atomic<int64_t> cycles;
+  std::atomic<int64_t> cache_misses;
+  std::atomic<int64_t> context_switches;
+};
+
+Entry g_entries[kTableSize];
+
+// Counts the tasks from the locations which don't fit in |g_entries|.
+Entry g_overflow_entry;
+
+uintptr_t GetKey(const Location& location) {
+  uintptr_t key = reinterpret_cast<uintptr_t>(location.program_counter());
+  if (!key) {
+    key = HashInts(reinterpret_cast<uintptr_t>(location.file_name()),
+                   location.line_number());
+  }
+  // Zero is the key of the empty entries.
+  return key ? key : 1;
+}
+
+Entry* FindOrClaimEntry(const Location& location) {
+  const uintptr_t key = GetKey(location);
+  size_t index = HashInts(key, 0) & (kTableSize - 1);
+  for (size_t probes = 0; probes < kTableSize; ++probes) {
+    Entry& entry = g_entries[index];
+    uintptr_t entry_key = entry.key.load(std::memory_order_relaxed);
+    if (entry_key == key)
+      return &entry;
+    if (!entry_key &&
+        entry.key.compare_exchange_strong(entry_key, key,
+                                          std::memory_order_relaxed)) {
+      entry.function_name = location.function_name();
+      entry.file_name = location.file_name();
+      entry.line_number = location.line_number();
+      entry.program_counter = location.program_counter();
+      entry.ready.store(true, std::memory_order_release);
+      return &entry;
+    }
+    // Claimed by another thread meanwhile, possibly for the same location.
+    if (entry_key == key)
+      return &entry;
+    index = (index + 1) & (kTableSize - 1);
+  }
+  return &g_overflow_entry;
+}
+
+void ClearEntry(Entry& entry) {
+  entry.key.store(0, std::memory_order_relaxed);
+  entry.ready.store(false, std::memory_order_relaxed);
+  entry.function_name = nullptr;
+  entry.file_name = nullptr;
+  entry.line_number = 0;
+  entry.program_counter = nullptr;
+  entry.num_tasks.store(0, std::memory_order_relaxed);
+  entry.instructions.store(0, std::memory_order_relaxed);
+  entry.cycles.store(0, std::memory_order_relaxed);
+  entry.cache_misses.store(0, std::memory_order_relaxed);
+  entry.context_switches.store(0, std::memory_order_relaxed);
+}
+
+TaskPerfCounters::LocationCounts ReadEntry(const Entry& entry,
+                                           const Location& location) {
+  TaskPerfCounters::LocationCounts result;
+  result.posted_from = location;
+  result.num_tasks = entry.num_tasks.load(std::memory_order_relaxed);
+  result.counts.instructions =
+      entry.instructions.load(std::memory_order_relaxed);
+  result.counts.cycles = entry.cycles.load(std::memory_order_relaxed);
+  result.counts.cache_misses =
+      entry.cache_misses.load(std::memory_order_relaxed);
+  result.counts.context_switches =
+      entry.context_switches.load(std::memory_order_relaxed);
+  return result;
+}
+
+#if defined(OS_LINUX) || defined(OS_CHROMEOS)
+
+struct CounterConfig {
+  uint32_t type;
+  uint64_t config;
+  int64_t TaskPerfCounters::Counts::*field;
+};
+
+constexpr CounterConfig kCounterConfigs[] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS,
+     &TaskPerfCounters::Counts::instructions},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES,
+     &TaskPerfCounters::Counts::cycles},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES,
+     &TaskPerfCounters::Counts::cache_misses},
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES,
+     &TaskPerfCounters::Counts::context_switches},
+};
+
+constexpr size_t kNumCounters = base::size(kCounterConfigs);
+
+// The counters of a thread, opened as a single group so they are read at once.
+class ThreadCounters {
+ public:
+  ThreadCounters() {
+    for (const CounterConfig& config : kCounterConfigs) {
+      struct perf_event_attr pe = {0};
+      pe.type = config.type;
+      pe.size = sizeof(struct perf_event_attr);
+      pe.config = config.config;
+      pe.read_format = PERF_FORMAT_GROUP;
+      // The context switches happen in the kernel.
+      pe.exclude_kernel = config.type == PERF_TYPE_HARDWARE;
+      pe.exclude_hv = 1;
+
+      const int group_fd = fds_.empty() ? -1 : fds_.front().get();
+      ScopedFD fd(syscall(__NR_perf_event_open, &pe, /* pid */ 0,
+                          /* cpu */ -1, group_fd, PERF_FLAG_FD_CLOEXEC));
+      // Not supported by the hardware or not permitted, which is expected.
+      if (!fd.is_valid())
+        continue;
+      fds_.push_back(std::move(fd));
+      fields_.push_back(config.field);
+    }
+  }
+
+  ThreadCounters(const ThreadCounters&) = delete;
+  ThreadCounters& operator=(const ThreadCounters&) = delete;
+
+  bool Read(TaskPerfCounters::Counts* counts) const {
+    if (fds_.empty())
+      return false;
+    // The number of counters, followed by their values.
+    uint64_t values[1 + kNumCounters];
+    const ssize_t expected_size = (1 + fields_.size()) * sizeof(uint64_t);
+    if (HANDLE_EINTR(read(fds_.front().get(), values, sizeof(values))) !=
+            expected_size ||
+        values[0] != fields_.size()) {
+      return false;
+    }
+    *counts = TaskPerfCounters::Counts();
+    for (size_t i = 0; i < fields_.size(); ++i)
+      (*counts).*fields_[i] = static_cast<int64_t>(values[1 + i]);
+    return true;
+  }
+
+ private:
+  // The group leader first.
+  std::vector<ScopedFD> fds_;
+  std::vector<int64_t TaskPerfCounters::Counts::*> fields_;
+};
+
+ThreadLocalOwnedPointer<ThreadCounters>& GetThreadCounters() {
+  static NoDestructor<ThreadLocalOwnedPointer<ThreadCounters>> instance;
+  return *instance;
+}
+
+#endif  // defined(OS_LINUX) || defined(OS_CHROMEOS)
+
+}  // namespace
+
+// static
+std::atomic<TaskPerfCounters::State> TaskPerfCounters::g_state_{
+    TaskPerfCounters::State::kUninitialized};
+
+TaskPerfCounters::Counts& TaskPerfCounters::Counts::operator+=(
+    const Counts& other) {
+  instructions += other.instructions;
+  cycles += other.cycles;
+  cache_misses += other.cache_misses;
+  context_switches += other.context_switches;
+  return *this;
+}
+
+TaskPerfCounters::Counts TaskPerfCounters::Counts::operator-(
+    const Counts& other) const {
+  Counts result;
+  result.instructions = instructions - other.instructions;
+  result.cycles = cycles - other.cycles;
+  result.cache_misses = cache_misses - other.cache_misses;
+  result.context_switches = context_switches - other.context_switches;
+  return result;
+}
+
+// static
+bool TaskPerfCounters::InitializeState() {
+  // The tasks run before the command line is initialized aren't counted.
+  if (!CommandLine::InitializedForCurrentProcess())
+    return false;
+#if defined(OS_LINUX) || defined(OS_CHROMEOS)
+  const bool enabled = CommandLine::ForCurrentProcess()->HasSwitch(
+      switches::kEnableTaskPerfCounters);
+#else
+  const bool enabled = false;
+#endif
+  State state = State::kUninitialized;
+  g_state_.compare_exchange_strong(
+      state, enabled ? State::kEnabled : State::kDisabled,
+      std::memory_order_relaxed);
+  return enabled;
+}
+
+// static
+void TaskPerfCounters::EnableForTesting() {
+  ResetForTesting();
+  g_state_.store(State::kEnabled, std::memory_order_relaxed);
+}
+
+// static
+void TaskPerfCounters::ResetForTesting() {
+  g_state_.store(State::kUninitialized, std::memory_order_relaxed);
+  for (Entry& entry : g_entries)
+    ClearEntry(entry);
+  ClearEntry(g_overflow_entry);
+}
+
+// static
+bool TaskPerfCounters::ReadCurrentThread(Counts* counts) {
+#if defined(OS_LINUX) || defined(OS_CHROMEOS)
+  ThreadLocalOwnedPointer<ThreadCounters>& thread_counters =
+      GetThreadCounters();
+  if (!thread_counters.Get())
+    thread_counters.Set(std::make_unique<ThreadCounters>());
+  return thread_counters.Get()->Read(counts);
+#else
+  return false;
+#endif
+}
+
+// static
+void TaskPerfCounters::AddTask(const Location& posted_from,
+                               const Counts& counts) {
+  Entry* entry = FindOrClaimEntry(posted_from);
+  entry->num_tasks.fetch_add(1, std::memory_order_relaxed);
+  entry->instructions.fetch_add(counts.instructions,
+                                std::memory_order_relaxed);
+  entry->cycles.fetch_add(counts.cycles, std::memory_order_relaxed);
+  entry->cache_misses.fetch_add(counts.cache_misses,
+                                std::memory_order_relaxed);
+  entry->context_switches.fetch_add(counts.context_switches,
+                                    std::memory_order_relaxed);
+}
+
+// static
+std::vector<TaskPerfCounters::LocationCounts> TaskPerfCounters::GetReport() {
+  std::vector<LocationCounts> report;
+  for (const Entry& entry : g_entries) {
+    if (!entry.ready.load(std::memory_order_acquire))
+      continue;
+    report.push_back(ReadEntry(
+        entry, Location(entry.function_name, entry.file_name,
+                        entry.line_number, entry.program_counter)));
+  }
+  if (g_overflow_entry.num_tasks.load(std::memory_order_relaxed))
+    report.push_back(ReadEntry(g_overflow_entry, Location()));
+  std::sort(report.begin(), report.end(),
+            [](const LocationCounts& a, const LocationCounts& b) {
+              if (a.counts.cycles != b.counts.cycles)
+                return a.counts.cycles > b.counts.cycles;
+              return a.counts.instructions > b.counts.instructions;
+            });
+  return report;
+}
+
+void ScopedTaskPerfCounters::Start() {
+  started_ = TaskPerfCounters::ReadCurrentThread(&start_counts_);
+}
+
+void ScopedTaskPerfCounters::Stop() {
+  TaskPerfCounters::Counts end_counts;
+  if (!TaskPerfCounters::ReadCurrentThread(&end_counts))
+    return;
+  const TaskPerfCounters::Counts counts = end_counts - start_counts_;
+  TaskPerfCounters::AddTask(posted_from_, counts);
+  TRACE_EVENT_INSTANT(TRACE_DISABLED_BY_DEFAULT("toplevel.perf_counters"),
+                      "TaskPerfCounters", "posted_from", posted_from_,
+                      "instructions", counts.instructions, "cycles",
+                      counts.cycles, "cache_misses", counts.cache_misses,
+                      "context_switches", counts.context_switches);
+}
+
+}  // namespace base
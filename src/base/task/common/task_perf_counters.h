@@ -0,0 +1,121 @@
+// Copyright 2021 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BASE_TASK_COMMON_TASK_PERF_COUNTERS_H_
+#define BASE_TASK_COMMON_TASK_PERF_COUNTERS_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <vector>
+
+#include "base/base_export.h"
+#include "base/location.h"
+
+namespace base {
+
+// Attributes the work of the tasks to the locations they were posted from,
+// with per-thread perf_event_open(2) counters: the instructions retired and
+// the CPU cycles spent in user space, the cache misses and the context
+// switches. TaskAnnotator counts every task it runs when the counters are
+// enabled by --enable-task-perf-counters, on Linux and ChromeOS only. Like
+// --enable-thread-instruction-count, that switch must only be passed to the
+// processes which are allowed to open perf events, i.e. not to those in the
+// seccomp-bpf sandbox.
+//
+// The counters which can't be opened, e.g. the hardware ones in most virtual
+// machines, read as zero. Nothing is counted on a thread where none of them
+// can be opened.
+//
+// The counts are added up in a fixed-size lock-free table with one entry per
+// location, which can be read at any time with GetReport(). The counts of a
+// task include those of the tasks nested in it, e.g. by a nested RunLoop.
+class BASE_EXPORT TaskPerfCounters {
+ public:
+  struct BASE_EXPORT Counts {
+    Counts& operator+=(const Counts& other);
+    Counts operator-(const Counts& other) const;
+
+    int64_t instructions = 0;
+    int64_t cycles = 0;
+    int64_t cache_misses = 0;
+    int64_t context_switches = 0;
+  };
+
+  // The counts of all the tasks posted from a location.
+  struct BASE_EXPORT LocationCounts {
+    Location posted_from;
+    int64_t num_tasks = 0;
+    Counts counts;
+  };
+
+  TaskPerfCounters() = delete;
+
+  // Returns whether the tasks are counted.
+  static bool IsEnabled() {
+    const State state = g_state_.load(std::memory_order_relaxed);
+    return state == State::kEnabled ||
+           (state == State::kUninitialized && InitializeState());
+  }
+
+  // Enables the counters regardless of the command line, and clears the table.
+  // Not thread-safe, like ResetForTesting() which disables the counters again
+  // until the next command line check.
+  static void EnableForTesting();
+  static void ResetForTesting();
+
+  // Reads the counters of the current thread into |counts|, opening them on
+  // the first call on the thread. Returns false if none of them can be opened.
+  static bool ReadCurrentThread(Counts* counts);
+
+  // Adds a task posted from |posted_from| which took |counts| to the table.
+  // Thread-safe. The tasks from the locations which don't fit in the table are
+  // counted together, under a default Location.
+  static void AddTask(const Location& posted_from, const Counts& counts);
+
+  // Returns the counts of all the locations which tasks were posted from, most
+  // cycles first, then most instructions. Thread-safe, but the counts of the
+  // tasks which complete meanwhile may be partially included.
+  static std::vector<LocationCounts> GetReport();
+
+ private:
+  enum class State { kUninitialized, kEnabled, kDisabled };
+
+  static bool InitializeState();
+
+  static std::atomic<State> g_state_;
+};
+
+// Counts the task which runs in its scope, if TaskPerfCounters are enabled. The
+// counts are added to the table and, if the
+// "disabled-by-default-toplevel.perf_counters" category is enabled, recorded as
+// the arguments of a "TaskPerfCounters" trace event.
+class BASE_EXPORT ScopedTaskPerfCounters {
+ public:
+  explicit ScopedTaskPerfCounters(const Location& posted_from)
+      : posted_from_(posted_from) {
+    if (TaskPerfCounters::IsEnabled())
+      Start();
+  }
+
+  ScopedTaskPerfCounters(const ScopedTaskPerfCounters&) = delete;
+  ScopedTaskPerfCounters& operator=(const ScopedTaskPerfCounters&) = delete;
+
+  ~ScopedTaskPerfCounters() {
+    if (started_)
+      Stop();
+  }
+
+ private:
+  void Start();
+  void Stop();
+
+  const Location& posted_from_;
+  bool started_ = false;
+  TaskPerfCounters::Counts start_counts_;
+};
+
+}  // namespace base
+
+#endif  // BASE_TASK_COMMON_TASK_PERF_COUNTERS_H_
@@ -0,0 +1,176 @@
+// Copyright 2021 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "base/task/common/task_perf_counters.h"
+
+#include <stdint.h>
+
+#include <memory>
+#include <vector>
+
+#include "base/bind.h"
+#include "base/location.h"
+#include "base/pending_task.h"
+#include "base/task/common/task_annotator.h"
+#include "base/threading/simple_thread.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace base {
+
+namespace {
+
+TaskPerfCounters::Counts MakeCounts(int64_t instructions, int64_t cycles) {
+  TaskPerfCounters::Counts counts;
+  counts.instructions = instructions;
+  counts.cycles = cycles;
+  counts.cache_misses = 1;
+  counts.context_switches = 2;
+  return counts;
+}
+
+Location MakeLocation(uintptr_t program_counter) {
+  return Location("task_perf_counters_unittest.cc",
+                  reinterpret_cast<const void*>(program_counter));
+}
+
+class TaskPerfCountersTest : public testing::Test {
+ public:
+  void SetUp() override { TaskPerfCounters::EnableForTesting(); }
+  void TearDown() override { TaskPerfCounters::ResetForTesting(); }
+};
+
+class AddTasksDelegate : public DelegateSimpleThread::Delegate {
+ public:
+  AddTasksDelegate(int num_locations, int num_tasks)
+      : num_locations_(num_locations), num_tasks_(num_tasks) {}
+
+  void Run() override {
+    for (int i = 0; i < num_tasks_; ++i)
+      TaskPerfCounters::AddTask(MakeLocation(1 + i % num_locations_),
+                                MakeCounts(10, 20));
+  }
+
+ private:
+  const int num_locations_;
+  const int num_tasks_;
+};
+
+}  // namespace
+
+TEST_F(TaskPerfCountersTest, CountsArithmetic) {
+  TaskPerfCounters::Counts counts = MakeCounts(10, 20);
+  counts += MakeCounts(1, 2);
+  EXPECT_EQ(11, counts.instructions);
+  EXPECT_EQ(22, counts.cycles);
+  EXPECT_EQ(2, counts.cache_misses);
+  EXPECT_EQ(4, counts.context_switches);
+
+  const TaskPerfCounters::Counts difference = counts - MakeCounts(1, 2);
+  EXPECT_EQ(10, difference.instructions);
+  EXPECT_EQ(20, difference.cycles);
+  EXPECT_EQ(1, difference.cache_misses);
+  EXPECT_EQ(2, difference.context_switches);
+}
+
+TEST_F(TaskPerfCountersTest, ReportPerLocation) {
+  EXPECT_TRUE(TaskPerfCounters::GetReport().empty());
+
+  const Location location1 = MakeLocation(1);
+  const Location location2 = MakeLocation(2);
+  TaskPerfCounters::AddTask(location1, MakeCounts(100, 10));
+  TaskPerfCounters::AddTask(location2, MakeCounts(5, 50));
+  TaskPerfCounters::AddTask(location1, MakeCounts(100, 10));
+
+  // Most cycles first.
+  const std::vector<TaskPerfCounters::LocationCounts> report =
+      TaskPerfCounters::GetReport();
+  ASSERT_EQ(2u, report.size());
+  EXPECT_EQ(location2.program_counter(),
+            report[0].posted_from.program_counter());
+  EXPECT_EQ(1, report[0].num_tasks);
+  EXPECT_EQ(5, report[0].counts.instructions);
+  EXPECT_EQ(50, report[0].counts.cycles);
+  EXPECT_EQ(location1.program_counter(),
+            report[1].posted_from.program_counter());
+  EXPECT_STREQ(location1.file_name(), report[1].posted_from.file_name());
+  EXPECT_EQ(2, report[1].num_tasks);
+  EXPECT_EQ(200, report[1].counts.instructions);
+  EXPECT_EQ(20, report[1].counts.cycles);
+  EXPECT_EQ(2, report[1].counts.cache_misses);
+  EXPECT_EQ(4, report[1].counts.context_switches);
+
+  TaskPerfCounters::ResetForTesting();
+  EXPECT_TRUE(TaskPerfCounters::GetReport().empty());
+}
+
+// The tasks from the locations which don't fit in the table are still counted.
+TEST_F(TaskPerfCountersTest, TableOverflow) {
+  constexpr int kNumLocations = 4096;
+  for (int i = 0; i < kNumLocations; ++i)
+    TaskPerfCounters::AddTask(MakeLocation(1 + i), MakeCounts(1, 1));
+
+  const std::vector<TaskPerfCounters::LocationCounts> report =
+      TaskPerfCounters::GetReport();
+  EXPECT_LT(report.size(), static_cast<size_t>(kNumLocations));
+  int64_t num_tasks = 0;
+  int64_t cycles = 0;
+  for (const auto& location_counts : report) {
+    num_tasks += location_counts.num_tasks;
+    cycles += location_counts.counts.cycles;
+  }
+  EXPECT_EQ(kNumLocations, num_tasks);
+  EXPECT_EQ(kNumLocations, cycles);
+}
+
+TEST_F(TaskPerfCountersTest, ConcurrentAddTask) {
+  constexpr int kNumThreads = 4;
+  constexpr int kNumLocations = 16;
+  constexpr int kTasksPerThread = 1024;
+  AddTasksDelegate delegate(kNumLocations, kTasksPerThread);
+  DelegateSimpleThreadPool pool("TaskPerfCountersTest", kNumThreads);
+  pool.AddWork(&delegate, kNumThreads);
+  pool.Start();
+  pool.JoinAll();
+
+  const std::vector<TaskPerfCounters::LocationCounts> report =
+      TaskPerfCounters::GetReport();
+  ASSERT_EQ(static_cast<size_t>(kNumLocations), report.size());
+  for (const auto& location_counts : report) {
+    EXPECT_EQ(kNumThreads * kTasksPerThread / kNumLocations,
+              location_counts.num_tasks);
+    EXPECT_EQ(10 * location_counts.num_tasks,
+              location_counts.counts.instructions);
+  }
+}
+
+// Perf events may not be permitted, in which case no task is counted.
+TEST_F(TaskPerfCountersTest, RunTask) {
+  TaskPerfCounters::Counts counts;
+  const bool supported = TaskPerfCounters::ReadCurrentThread(&counts);
+
+  int result = 0;
+  PendingTask pending_task(FROM_HERE, BindOnce([](int* result) { *result = 1; },
+                                               Unretained(&result)));
+  const Location posted_from = pending_task.posted_from;
+  TaskAnnotator annotator;
+  annotator.WillQueueTask("TaskPerfCountersTest::Queue", &pending_task, "?");
+  annotator.RunTask("TaskPerfCountersTest::RunTask", pending_task);
+  EXPECT_EQ(1, result);
+
+  const std::vector<TaskPerfCounters::LocationCounts> report =
+      TaskPerfCounters::GetReport();
+  if (!supported) {
+    EXPECT_TRUE(report.empty());
+    return;
+  }
+  ASSERT_EQ(1u, report.size());
+  EXPECT_EQ(posted_from.program_counter(),
+            report[0].posted_from.program_counter());
+  EXPECT_EQ(1, report[0].num_tasks);
+  EXPECT_GE(report[0].counts.instructions, 0);
+  EXPECT_GE(report[0].counts.cycles, 0);
+  EXPECT_GE(report[0].counts.context_switches, 0);
+}
+
+}  // namespace base
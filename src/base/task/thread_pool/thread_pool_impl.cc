@@ -40,6 +40,10 @@
 #include "base/task/thread_pool/thread_group_native_mac.h"
 #endif
 
+#if defined(OS_LINUX) || defined(OS_CHROMEOS)
+#include "base/message_loop/message_pump_libevent.h"
+#endif
+
 namespace base {
 namespace internal {
 
@@ -125,6 +129,9 @@ void ThreadPoolImpl::Start(const ThreadPoolInstance::InitParams& init_params,
   DCHECK(!started_);
 
   internal::InitializeThreadPrioritiesFeature();
+#if defined(OS_LINUX) || defined(OS_CHROMEOS)
+  MessagePumpLibevent::InitializeFeatures();
+#endif
 
   disable_job_yield_ = FeatureList::IsEnabled(kDisableJobYield);
   disable_fair_scheduling_ = FeatureList::IsEnabled(kDisableFairJobScheduling);
@@ -243,6 +243,7 @@
   X(TRACE_DISABLED_BY_DEFAULT("system_stats"))                           \
   X(TRACE_DISABLED_BY_DEFAULT("thread_pool_diagnostics"))                \
   X(TRACE_DISABLED_BY_DEFAULT("toplevel.ipc"))                           \
+  X(TRACE_DISABLED_BY_DEFAULT("toplevel.perf_counters"))                 \
   X(TRACE_DISABLED_BY_DEFAULT("user_action_samples"))                    \
   X(TRACE_DISABLED_BY_DEFAULT("v8.compile"))                             \
   X(TRACE_DISABLED_BY_DEFAULT("v8.cpu_profiler"))                        \
@@ -350,7 +351,7 @@
 
 #define INTERNAL_TRACE_INIT_CATEGORY_NAME(name) name,
 
-#define INTERNAL_TRACE_INIT_CATEGORY(name) {0, 0, name},
+#define INTERNAL_TRACE_INIT_CATEGORY(name) {0, 0, 0, name},
 
 #if BUILDFLAG(USE_PERFETTO_CLIENT_LIBRARY)
 PERFETTO_DEFINE_TEST_CATEGORY_PREFIXES("cat",
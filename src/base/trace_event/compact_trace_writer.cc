@@ -0,0 +1,611 @@
+// Copyright 2021 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "base/trace_event/compact_trace_writer.h"
+
+#include <inttypes.h>
+#include <string.h>
+
+#include <memory>
+#include <utility>
+
+#include "base/bind.h"
+#include "base/check_op.h"
+#include "base/json/string_escape.h"
+#include "base/logging.h"
+#include "base/process/process_handle.h"
+#include "base/strings/stringprintf.h"
+#include "base/trace_event/trace_event.h"
+#include "base/trace_event/trace_log.h"
+
+namespace base {
+namespace trace_event {
+
+namespace {
+
+constexpr char kMagic[] = {'C', 'T', 'R', 'C'};
+
+// Same as the pieces of TraceLog::ConvertTraceEventsToTraceFormat().
+constexpr size_t kPieceSize = 100 * 1024;
+constexpr size_t kReserveCapacity = kPieceSize * 5 / 4;
+
+// Prefixes of the encoded strings, see the format in the header.
+constexpr uint64_t kNewTableString = 0;
+constexpr uint64_t kInlineString = 1;
+constexpr uint64_t kFirstTableIndex = 2;
+
+constexpr unsigned int kIdFlags = TRACE_EVENT_FLAG_HAS_ID |
+                                  TRACE_EVENT_FLAG_HAS_LOCAL_ID |
+                                  TRACE_EVENT_FLAG_HAS_GLOBAL_ID;
+constexpr unsigned int kFlowFlags =
+    TRACE_EVENT_FLAG_FLOW_OUT | TRACE_EVENT_FLAG_FLOW_IN;
+
+uint64_t ZigzagEncode(int64_t value) {
+  return (static_cast<uint64_t>(value) << 1) ^
+         static_cast<uint64_t>(value >> 63);
+}
+
+int64_t ZigzagDecode(uint64_t value) {
+  return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+void WriteToFile(File* file,
+                 const scoped_refptr<RefCountedString>& piece,
+                 bool has_more_events) {
+  if (file->IsValid() && !piece->data().empty()) {
+    const int size = static_cast<int>(piece->data().size());
+    if (file->WriteAtCurrentPos(piece->data().data(), size) != size) {
+      DPLOG(ERROR) << "Failed to write the trace";
+      file->Close();
+    }
+  }
+  if (!has_more_events)
+    file->Close();
+}
+
+}  // namespace
+
+// Reads the encoded values of a piece. Once a read fails, the following ones
+// fail too and result() tells whether the data was malformed or incomplete.
+class CompactTraceReader::Decoder {
+ public:
+  explicit Decoder(StringPiece data) : data_(data) {}
+
+  Result result() const { return result_; }
+  size_t position() const { return position_; }
+  bool AtEnd() const { return position_ == data_.size(); }
+
+  uint8_t ReadByte() {
+    if (!CheckAvailable(1))
+      return 0;
+    return static_cast<uint8_t>(data_[position_++]);
+  }
+
+  uint64_t ReadVarint() {
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      if (!CheckAvailable(1))
+        return 0;
+      const uint8_t byte = static_cast<uint8_t>(data_[position_++]);
+      value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+      if (!(byte & 0x80))
+        return value;
+    }
+    Fail(Result::kError);
+    return 0;
+  }
+
+  int64_t ReadZigzag() { return ZigzagDecode(ReadVarint()); }
+
+  StringPiece ReadBytes(size_t size) {
+    if (!CheckAvailable(size))
+      return StringPiece();
+    StringPiece bytes = data_.substr(position_, size);
+    position_ += size;
+    return bytes;
+  }
+
+  // Reads a string, which is added to |strings| if it is new in the table.
+  StringPiece ReadString(std::deque<std::string>* strings) {
+    const uint64_t prefix = ReadVarint();
+    if (result_ != Result::kOk)
+      return StringPiece();
+    if (prefix >= kFirstTableIndex) {
+      if (prefix - kFirstTableIndex >= strings->size()) {
+        Fail(Result::kError);
+        return StringPiece();
+      }
+      return (*strings)[prefix - kFirstTableIndex];
+    }
+    const StringPiece str = ReadBytes(ReadVarint());
+    if (result_ != Result::kOk || prefix == kInlineString)
+      return str;
+    strings->emplace_back(str);
+    return strings->back();
+  }
+
+  void Fail(Result result) {
+    if (result_ == Result::kOk)
+      result_ = result;
+  }
+
+ private:
+  bool CheckAvailable(size_t size) {
+    if (result_ != Result::kOk)
+      return false;
+    if (size > data_.size() - position_) {
+      Fail(Result::kNeedMoreData);
+      return false;
+    }
+    return true;
+  }
+
+  const StringPiece data_;
+  size_t position_ = 0;
+  Result result_ = Result::kOk;
+};
+
+CompactTraceWriter::CompactTraceWriter(
+    int process_id,
+    const ArgumentFilterPredicate& argument_filter_predicate,
+    const OutputCallback& output_callback)
+    : argument_filter_predicate_(argument_filter_predicate),
+      output_callback_(output_callback),
+      piece_(MakeRefCounted<RefCountedString>()) {
+  piece_->data().reserve(kReserveCapacity);
+  piece_->data().append(kMagic, sizeof(kMagic));
+  WriteVarint(kVersion);
+  WriteZigzag(process_id);
+}
+
+CompactTraceWriter::~CompactTraceWriter() = default;
+
+// static
+CompactTraceWriter::OutputCallback CompactTraceWriter::CreateFileOutputCallback(
+    File file) {
+  return BindRepeating(&WriteToFile, Owned(new File(std::move(file))));
+}
+
+void CompactTraceWriter::AddEvent(const TraceEvent& event) {
+  DCHECK(piece_) << "AddEvent() called after Finish()";
+  const unsigned int flags = event.flags();
+  const bool copy = flags & TRACE_EVENT_FLAG_COPY;
+  const char* category_group_name =
+      TraceLog::GetCategoryGroupName(event.category_group_enabled());
+
+  uint32_t fields = 0;
+  if (!event.thread_timestamp().is_null())
+    fields |= kHasThreadTimestamp;
+  if (!event.thread_instruction_count().is_null())
+    fields |= kHasThreadInstructionCount;
+  if ((flags & TRACE_EVENT_FLAG_HAS_PROCESS_ID) &&
+      event.process_id() != kNullProcessId) {
+    fields |= kHasProcessId;
+  }
+  if ((flags & kIdFlags) && event.scope() != trace_event_internal::kGlobalScope)
+    fields |= kHasScope;
+
+  ArgumentNameFilterPredicate argument_name_filter_predicate;
+  if (event.arg_size() > 0 && event.arg_name(0) &&
+      !argument_filter_predicate_.is_null() &&
+      !argument_filter_predicate_.Run(category_group_name, event.name(),
+                                      &argument_name_filter_predicate)) {
+    fields |= kArgsStripped;
+  }
+
+  // The thread id and the process id share their storage in TraceEvent.
+  const int thread_id = event.thread_id();
+  ThreadState* state = GetThreadState(thread_id);
+  piece_->data().push_back(event.phase());
+  WriteVarint(flags);
+  WriteVarint(fields);
+  WriteZigzag(thread_id);
+
+  const int64_t timestamp = event.timestamp().ToInternalValue();
+  WriteZigzag(timestamp - state->timestamp);
+  state->timestamp = timestamp;
+  if (fields & kHasThreadTimestamp) {
+    const int64_t thread_timestamp =
+        event.thread_timestamp().ToInternalValue();
+    WriteZigzag(thread_timestamp - state->thread_timestamp);
+    state->thread_timestamp = thread_timestamp;
+  }
+  if (fields & kHasThreadInstructionCount) {
+    const int64_t thread_instruction_count =
+        event.thread_instruction_count().ToInternalValue();
+    WriteZigzag(thread_instruction_count - state->thread_instruction_count);
+    state->thread_instruction_count = thread_instruction_count;
+  }
+
+  WriteStaticString(category_group_name);
+  if (copy)
+    WriteInlineString(event.name());
+  else
+    WriteStaticString(event.name());
+
+  if (event.phase() == TRACE_EVENT_PHASE_COMPLETE) {
+    WriteZigzag(event.duration().ToInternalValue());
+    if (fields & kHasThreadTimestamp)
+      WriteZigzag(event.thread_duration().ToInternalValue());
+    if (fields & kHasThreadInstructionCount)
+      WriteZigzag(event.thread_instruction_delta().ToInternalValue());
+  }
+
+  if (fields & kHasScope) {
+    if (copy)
+      WriteInlineString(event.scope());
+    else
+      WriteStaticString(event.scope());
+  }
+  if (flags & kIdFlags)
+    WriteVarint(event.id());
+  if (flags & kFlowFlags)
+    WriteVarint(event.bind_id());
+
+  if (!(fields & kArgsStripped)) {
+    size_t num_args = 0;
+    while (num_args < event.arg_size() && event.arg_name(num_args))
+      ++num_args;
+    WriteVarint(num_args);
+    for (size_t i = 0; i < num_args; ++i) {
+      if (copy)
+        WriteInlineString(event.arg_name(i));
+      else
+        WriteStaticString(event.arg_name(i));
+
+      std::string& out = piece_->data();
+      if (!argument_name_filter_predicate.is_null() &&
+          !argument_name_filter_predicate.Run(event.arg_name(i))) {
+        out.push_back(kStrippedArgType);
+        continue;
+      }
+      const unsigned char type = event.arg_type(i);
+      const TraceValue& value = event.arg_value(i);
+      switch (type) {
+        case TRACE_VALUE_TYPE_BOOL:
+          out.push_back(type);
+          out.push_back(value.as_bool);
+          break;
+        case TRACE_VALUE_TYPE_UINT:
+          out.push_back(type);
+          WriteVarint(value.as_uint);
+          break;
+        case TRACE_VALUE_TYPE_INT:
+          out.push_back(type);
+          WriteZigzag(value.as_int);
+          break;
+        case TRACE_VALUE_TYPE_DOUBLE:
+          out.push_back(type);
+          out.append(reinterpret_cast<const char*>(&value.as_double),
+                     sizeof(value.as_double));
+          break;
+        case TRACE_VALUE_TYPE_POINTER:
+          out.push_back(type);
+          WriteVarint(reinterpret_cast<uintptr_t>(value.as_pointer));
+          break;
+        case TRACE_VALUE_TYPE_STRING:
+          out.push_back(type);
+          // Null strings are printed as "NULL", which isn't static.
+          if (value.as_string)
+            WriteStaticString(value.as_string);
+          else
+            WriteInlineString("NULL");
+          break;
+        case TRACE_VALUE_TYPE_COPY_STRING:
+          out.push_back(type);
+          WriteInlineString(value.as_string ? value.as_string : "NULL");
+          break;
+        default: {
+          std::string json;
+          value.AppendAsJSON(type, &json);
+          out.push_back(TRACE_VALUE_TYPE_CONVERTABLE);
+          WriteInlineString(json);
+          break;
+        }
+      }
+    }
+  }
+
+  ++event_count_;
+  if (piece_->data().size() > kPieceSize) {
+    output_callback_.Run(piece_, true);
+    piece_ = MakeRefCounted<RefCountedString>();
+    piece_->data().reserve(kReserveCapacity);
+  }
+}
+
+void CompactTraceWriter::Finish() {
+  DCHECK(piece_) << "Finish() called twice";
+  output_callback_.Run(piece_, false);
+  piece_ = nullptr;
+}
+
+CompactTraceWriter::ThreadState* CompactTraceWriter::GetThreadState(
+    int thread_id) {
+  // Consecutive events usually come from the same thread, since each chunk of
+  // the trace buffer belongs to one thread.
+  if (!last_thread_state_ || thread_id != last_thread_id_) {
+    last_thread_id_ = thread_id;
+    last_thread_state_ = &thread_states_[thread_id];
+  }
+  return last_thread_state_;
+}
+
+void CompactTraceWriter::WriteVarint(uint64_t value) {
+  std::string& out = piece_->data();
+  while (value >= 0x80) {
+    out.push_back(static_cast<char>(value | 0x80));
+    value >>= 7;
+  }
+  out.push_back(static_cast<char>(value));
+}
+
+void CompactTraceWriter::WriteZigzag(int64_t value) {
+  WriteVarint(ZigzagEncode(value));
+}
+
+void CompactTraceWriter::WriteStaticString(const char* str) {
+  auto result = string_indices_.emplace(str, string_indices_.size());
+  if (!result.second) {
+    WriteVarint(kFirstTableIndex + result.first->second);
+    return;
+  }
+  const size_t length = strlen(str);
+  WriteVarint(kNewTableString);
+  WriteVarint(length);
+  piece_->data().append(str, length);
+}
+
+void CompactTraceWriter::WriteInlineString(StringPiece str) {
+  WriteVarint(kInlineString);
+  WriteVarint(str.size());
+  piece_->data().append(str.data(), str.size());
+}
+
+CompactTraceReader::CompactTraceReader() = default;
+
+CompactTraceReader::~CompactTraceReader() = default;
+
+bool CompactTraceReader::AppendAsJSON(StringPiece data, std::string* json) {
+  std::string buffer;
+  if (!pending_.empty()) {
+    buffer = std::move(pending_);
+    buffer.append(data.data(), data.size());
+    data = buffer;
+  }
+  pending_.clear();
+
+  Decoder decoder(data);
+  size_t complete_size = 0;
+  if (!header_read_) {
+    const Result result = ReadHeader(&decoder);
+    if (result == Result::kError)
+      return false;
+    if (result == Result::kNeedMoreData) {
+      pending_.assign(data.data(), data.size());
+      return true;
+    }
+    header_read_ = true;
+    complete_size = decoder.position();
+  }
+
+  while (!decoder.AtEnd()) {
+    // Undo what an incomplete or malformed event added.
+    const size_t json_size = json->size();
+    const size_t string_count = strings_.size();
+    const Result result = ReadEvent(&decoder, json);
+    if (result != Result::kOk) {
+      json->resize(json_size);
+      strings_.resize(string_count);
+      if (result == Result::kError)
+        return false;
+      pending_.assign(data.data() + complete_size,
+                      data.size() - complete_size);
+      return true;
+    }
+    complete_size = decoder.position();
+  }
+  return true;
+}
+
+CompactTraceReader::Result CompactTraceReader::ReadHeader(Decoder* decoder) {
+  const StringPiece magic = decoder->ReadBytes(sizeof(kMagic));
+  if (decoder->result() == Result::kOk &&
+      magic != StringPiece(kMagic, sizeof(kMagic))) {
+    return Result::kError;
+  }
+  if (decoder->ReadVarint() != CompactTraceWriter::kVersion &&
+      decoder->result() == Result::kOk) {
+    return Result::kError;
+  }
+  process_id_ = static_cast<int>(decoder->ReadZigzag());
+  return decoder->result();
+}
+
+// Mirrors TraceEvent::AppendAsJSON().
+CompactTraceReader::Result CompactTraceReader::ReadEvent(Decoder* decoder,
+                                                        std::string* json) {
+  const char phase = static_cast<char>(decoder->ReadByte());
+  const unsigned int flags = static_cast<unsigned int>(decoder->ReadVarint());
+  const uint32_t fields = static_cast<uint32_t>(decoder->ReadVarint());
+  const int thread_id = static_cast<int>(decoder->ReadZigzag());
+
+  // The state is only updated once the event is complete.
+  ThreadState state;
+  auto it = thread_states_.find(thread_id);
+  if (it != thread_states_.end())
+    state = it->second;
+  state.timestamp += decoder->ReadZigzag();
+  if (fields & CompactTraceWriter::kHasThreadTimestamp)
+    state.thread_timestamp += decoder->ReadZigzag();
+  if (fields & CompactTraceWriter::kHasThreadInstructionCount)
+    state.thread_instruction_count += decoder->ReadZigzag();
+  const StringPiece category_group_name = decoder->ReadString(&strings_);
+  const StringPiece name = decoder->ReadString(&strings_);
+  if (decoder->result() != Result::kOk)
+    return decoder->result();
+
+  if (event_count_ > 0)
+    *json += ",\n";
+  const bool has_process_id = fields & CompactTraceWriter::kHasProcessId;
+  StringAppendF(json,
+                "{\"pid\":%i,\"tid\":%i,\"ts\":%" PRId64
+                ",\"ph\":\"%c\",\"cat\":\"%.*s\",\"name\":",
+                has_process_id ? thread_id : process_id_,
+                has_process_id ? -1 : thread_id, state.timestamp, phase,
+                static_cast<int>(category_group_name.size()),
+                category_group_name.data());
+  EscapeJSONString(name, true, json);
+
+  // The durations and ids come before the arguments in the stream, but after
+  // them in the JSON.
+  std::string trailer;
+  if (phase == TRACE_EVENT_PHASE_COMPLETE) {
+    const int64_t duration = decoder->ReadZigzag();
+    if (duration != -1)
+      StringAppendF(&trailer, ",\"dur\":%" PRId64, duration);
+    if (fields & CompactTraceWriter::kHasThreadTimestamp) {
+      const int64_t thread_duration = decoder->ReadZigzag();
+      if (thread_duration != -1)
+        StringAppendF(&trailer, ",\"tdur\":%" PRId64, thread_duration);
+    }
+    if (fields & CompactTraceWriter::kHasThreadInstructionCount) {
+      StringAppendF(&trailer, ",\"tidelta\":%" PRId64, decoder->ReadZigzag());
+    }
+  }
+  if (fields & CompactTraceWriter::kHasThreadTimestamp)
+    StringAppendF(&trailer, ",\"tts\":%" PRId64, state.thread_timestamp);
+  if (fields & CompactTraceWriter::kHasThreadInstructionCount) {
+    StringAppendF(&trailer, ",\"ticount\":%" PRId64,
+                  state.thread_instruction_count);
+  }
+  if (flags & TRACE_EVENT_FLAG_ASYNC_TTS)
+    trailer += ", \"use_async_tts\":1";
+
+  const unsigned int id_flags = flags & kIdFlags;
+  if (id_flags) {
+    if (fields & CompactTraceWriter::kHasScope) {
+      const StringPiece scope = decoder->ReadString(&strings_);
+      StringAppendF(&trailer, ",\"scope\":\"%.*s\"",
+                    static_cast<int>(scope.size()), scope.data());
+    }
+    const uint64_t id = decoder->ReadVarint();
+    switch (id_flags) {
+      case TRACE_EVENT_FLAG_HAS_ID:
+        StringAppendF(&trailer, ",\"id\":\"0x%" PRIx64 "\"", id);
+        break;
+      case TRACE_EVENT_FLAG_HAS_LOCAL_ID:
+        StringAppendF(&trailer, ",\"id2\":{\"local\":\"0x%" PRIx64 "\"}", id);
+        break;
+      case TRACE_EVENT_FLAG_HAS_GLOBAL_ID:
+        StringAppendF(&trailer, ",\"id2\":{\"global\":\"0x%" PRIx64 "\"}",
+                      id);
+        break;
+      default:
+        return Result::kError;
+    }
+  }
+
+  if (flags & TRACE_EVENT_FLAG_BIND_TO_ENCLOSING)
+    trailer += ",\"bp\":\"e\"";
+  if (flags & kFlowFlags) {
+    StringAppendF(&trailer, ",\"bind_id\":\"0x%" PRIx64 "\"",
+                  decoder->ReadVarint());
+  }
+  if (flags & TRACE_EVENT_FLAG_FLOW_IN)
+    trailer += ",\"flow_in\":true";
+  if (flags & TRACE_EVENT_FLAG_FLOW_OUT)
+    trailer += ",\"flow_out\":true";
+
+  if (phase == TRACE_EVENT_PHASE_INSTANT) {
+    char scope = '?';
+    switch (flags & TRACE_EVENT_FLAG_SCOPE_MASK) {
+      case TRACE_EVENT_SCOPE_GLOBAL:
+        scope = TRACE_EVENT_SCOPE_NAME_GLOBAL;
+        break;
+      case TRACE_EVENT_SCOPE_PROCESS:
+        scope = TRACE_EVENT_SCOPE_NAME_PROCESS;
+        break;
+      case TRACE_EVENT_SCOPE_THREAD:
+        scope = TRACE_EVENT_SCOPE_NAME_THREAD;
+        break;
+    }
+    StringAppendF(&trailer, ",\"s\":\"%c\"", scope);
+  }
+
+  *json += ",\"args\":";
+  if (fields & CompactTraceWriter::kArgsStripped) {
+    *json += "\"__stripped__\"";
+  } else {
+    *json += "{";
+    const uint64_t num_args = decoder->ReadVarint();
+    for (uint64_t i = 0; i < num_args && decoder->result() == Result::kOk;
+         ++i) {
+      if (i > 0)
+        *json += ",";
+      *json += "\"";
+      const StringPiece arg_name = decoder->ReadString(&strings_);
+      json->append(arg_name.data(), arg_name.size());
+      *json += "\":";
+
+      const unsigned char type = decoder->ReadByte();
+      TraceValue value;
+      switch (type) {
+        case CompactTraceWriter::kStrippedArgType:
+          *json += "\"__stripped__\"";
+          break;
+        case TRACE_VALUE_TYPE_BOOL:
+          value.as_bool = decoder->ReadByte();
+          value.AppendAsJSON(type, json);
+          break;
+        case TRACE_VALUE_TYPE_UINT:
+          value.as_uint = decoder->ReadVarint();
+          value.AppendAsJSON(type, json);
+          break;
+        case TRACE_VALUE_TYPE_INT:
+          value.as_int = decoder->ReadZigzag();
+          value.AppendAsJSON(type, json);
+          break;
+        case TRACE_VALUE_TYPE_DOUBLE: {
+          const StringPiece bytes =
+              decoder->ReadBytes(sizeof(value.as_double));
+          if (decoder->result() == Result::kOk) {
+            memcpy(&value.as_double, bytes.data(), sizeof(value.as_double));
+            value.AppendAsJSON(type, json);
+          }
+          break;
+        }
+        case TRACE_VALUE_TYPE_POINTER:
+          value.as_pointer =
+              reinterpret_cast<const void*>(
+                  static_cast<uintptr_t>(decoder->ReadVarint()));
+          value.AppendAsJSON(type, json);
+          break;
+        case TRACE_VALUE_TYPE_STRING:
+        case TRACE_VALUE_TYPE_COPY_STRING:
+          EscapeJSONString(decoder->ReadString(&strings_), true, json);
+          break;
+        case TRACE_VALUE_TYPE_CONVERTABLE: {
+          const StringPiece arg_json = decoder->ReadString(&strings_);
+          json->append(arg_json.data(), arg_json.size());
+          break;
+        }
+        default:
+          return Result::kError;
+      }
+    }
+    *json += "}";
+  }
+  *json += trailer;
+  *json += "}";
+
+  if (decoder->result() != Result::kOk)
+    return decoder->result();
+  thread_states_[thread_id] = state;
+  ++event_count_;
+  return Result::kOk;
+}
+
+}  // namespace trace_event
+}  // namespace base
@@ -0,0 +1,176 @@
+// Copyright 2021 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BASE_TRACE_EVENT_COMPACT_TRACE_WRITER_H_
+#define BASE_TRACE_EVENT_COMPACT_TRACE_WRITER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <deque>
+#include <string>
+#include <unordered_map>
+
+#include "base/base_export.h"
+#include "base/callback.h"
+#include "base/files/file.h"
+#include "base/memory/ref_counted_memory.h"
+#include "base/strings/string_piece.h"
+#include "base/trace_event/trace_event_impl.h"
+
+namespace base {
+namespace trace_event {
+
+// CompactTraceWriter serializes TraceEvents in a binary format which is a
+// fraction of the size of the JSON of TraceEvent::AppendAsJSON(), and much
+// cheaper to produce:
+// - Strings which outlive the trace, i.e. category groups, and the names,
+//   argument names and TRACE_STR_STATIC() values of events without
+//   TRACE_EVENT_FLAG_COPY, are written once and then referred to by index.
+// - Timestamps are written as deltas to the previous event of the same thread.
+// - Integers are written as varints, signed ones after a zigzag encoding.
+//
+// The output is produced in pieces of about 100 KB, which only contain whole
+// events, so that the trace can be sent or written to a file while it is
+// encoded. CompactTraceReader converts it back to the JSON of
+// TraceLog::Flush(). See TraceLog::FlushCompact().
+//
+// The stream is a header followed by one record per event:
+//   header := "CTRC" varint(kVersion) varint(process_id)
+//   event  := byte(phase) varint(flags) varint(fields) zigzag(thread_id)
+//             zigzag(timestamp delta) [zigzag(thread timestamp delta)]
+//             [zigzag(thread instruction count delta)] string(category)
+//             string(name) [complete event durations] [string(scope)]
+//             [varint(id)] [varint(bind_id)] [varint(num_args) arg*]
+//   arg    := string(name) byte(type) value
+//   string := varint(0) varint(length) bytes  -- added to the string table
+//           | varint(1) varint(length) bytes  -- used once
+//           | varint(index + 2)               -- from the string table
+// where |fields| tells which of the optional parts are present.
+class BASE_EXPORT CompactTraceWriter {
+ public:
+  // Same signature as TraceLog::OutputCallback.
+  using OutputCallback =
+      RepeatingCallback<void(const scoped_refptr<RefCountedString>&,
+                             bool has_more_events)>;
+
+  static constexpr uint32_t kVersion = 1;
+
+  // Bits of the |fields| of an event.
+  enum Fields : uint32_t {
+    kHasThreadTimestamp = 1 << 0,
+    kHasThreadInstructionCount = 1 << 1,
+    // |thread_id| is the explicit process id of the event, see
+    // TRACE_EVENT_FLAG_HAS_PROCESS_ID.
+    kHasProcessId = 1 << 2,
+    kHasScope = 1 << 3,
+    // The arguments were removed by the argument filter predicate.
+    kArgsStripped = 1 << 4,
+  };
+
+  // Type of the arguments removed by the argument name filter, which have no
+  // value. The other arguments keep their TRACE_VALUE_TYPE_XXX, except that
+  // the JSON of TRACE_VALUE_TYPE_PROTO ones is stored as a
+  // TRACE_VALUE_TYPE_CONVERTABLE string.
+  static constexpr unsigned char kStrippedArgType = 0;
+
+  // Events are encoded with |argument_filter_predicate|, if any, as in
+  // TraceEvent::AppendAsJSON(), and |output_callback| receives the pieces.
+  CompactTraceWriter(int process_id,
+                     const ArgumentFilterPredicate& argument_filter_predicate,
+                     const OutputCallback& output_callback);
+  CompactTraceWriter(const CompactTraceWriter&) = delete;
+  CompactTraceWriter& operator=(const CompactTraceWriter&) = delete;
+  ~CompactTraceWriter();
+
+  // Returns an OutputCallback which appends the pieces to |file|, e.g. to pass
+  // to TraceLog::FlushCompact(). The file is closed after the last piece.
+  static OutputCallback CreateFileOutputCallback(File file);
+
+  void AddEvent(const TraceEvent& event);
+
+  // Sends the last piece, which may be empty, to the output callback. No
+  // events can be added afterwards.
+  void Finish();
+
+  size_t event_count() const { return event_count_; }
+
+ private:
+  struct ThreadState {
+    int64_t timestamp = 0;
+    int64_t thread_timestamp = 0;
+    int64_t thread_instruction_count = 0;
+  };
+
+  ThreadState* GetThreadState(int thread_id);
+
+  void WriteVarint(uint64_t value);
+  void WriteZigzag(int64_t value);
+  // Writes |str| as a reference to the string table, adding it to the table
+  // the first time it is seen. |str| must outlive the writer.
+  void WriteStaticString(const char* str);
+  // Writes |str| inline, to be used once.
+  void WriteInlineString(StringPiece str);
+  void WriteArgs(const TraceEvent& event, const char* category_group_name);
+
+  const ArgumentFilterPredicate argument_filter_predicate_;
+  const OutputCallback output_callback_;
+  scoped_refptr<RefCountedString> piece_;
+
+  // Index of the static strings in the string table, by address.
+  std::unordered_map<const void*, uint32_t> string_indices_;
+  std::unordered_map<int, ThreadState> thread_states_;
+  int last_thread_id_ = 0;
+  ThreadState* last_thread_state_ = nullptr;
+  size_t event_count_ = 0;
+};
+
+// Converts a stream of CompactTraceWriter back to JSON. The stream can be
+// passed in any number of pieces, split anywhere.
+class BASE_EXPORT CompactTraceReader {
+ public:
+  CompactTraceReader();
+  CompactTraceReader(const CompactTraceReader&) = delete;
+  CompactTraceReader& operator=(const CompactTraceReader&) = delete;
+  ~CompactTraceReader();
+
+  // Appends the events of |data|, the next piece of the stream, to |json|, in
+  // the format of TraceEvent::AppendAsJSON() and separated by ",\n", so that
+  // the output of all the pieces, surrounded by "[" and "]", is a JSON array.
+  // An event which is incomplete at the end of |data| is kept until the next
+  // piece. Returns false if the stream is malformed.
+  bool AppendAsJSON(StringPiece data, std::string* json);
+
+  // Returns true if the stream received so far ends with a complete event.
+  bool IsComplete() const { return header_read_ && pending_.empty(); }
+
+  size_t event_count() const { return event_count_; }
+
+ private:
+  class Decoder;
+  struct ThreadState {
+    int64_t timestamp = 0;
+    int64_t thread_timestamp = 0;
+    int64_t thread_instruction_count = 0;
+  };
+
+  enum class Result { kOk, kNeedMoreData, kError };
+
+  Result ReadHeader(Decoder* decoder);
+  Result ReadEvent(Decoder* decoder, std::string* json);
+
+  bool header_read_ = false;
+  int process_id_ = 0;
+  // A deque, since the decoded events refer to the strings as they are added.
+  std::deque<std::string> strings_;
+  std::unordered_map<int, ThreadState> thread_states_;
+  // The start of an event which was incomplete at the end of the last piece.
+  std::string pending_;
+  size_t event_count_ = 0;
+};
+
+}  // namespace trace_event
+}  // namespace base
+
+#endif  // BASE_TRACE_EVENT_COMPACT_TRACE_WRITER_H_
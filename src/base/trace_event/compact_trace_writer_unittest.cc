@@ -0,0 +1,352 @@
+// Copyright 2021 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "base/trace_event/compact_trace_writer.h"
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "base/bind.h"
+#include "base/files/file_util.h"
+#include "base/files/scoped_temp_dir.h"
+#include "base/json/json_reader.h"
+#include "base/strings/string_piece.h"
+#include "base/test/bind.h"
+#include "base/trace_event/trace_event.h"
+#include "base/trace_event/trace_log.h"
+#include "base/trace_event/traced_value.h"
+#include "base/values.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace base {
+namespace trace_event {
+
+namespace {
+
+constexpr int kThreadId = 42;
+constexpr int kOtherThreadId = 43;
+
+class CompactTraceWriterTest : public testing::Test {
+ public:
+  void SetUp() override { TraceLog::ResetForTesting(); }
+  void TearDown() override { TraceLog::ResetForTesting(); }
+
+ protected:
+  void AddEvent(int thread_id,
+                int64_t timestamp_us,
+                char phase,
+                const char* name,
+                TraceArguments args,
+                unsigned int flags,
+                const char* scope = trace_event_internal::kGlobalScope,
+                unsigned long long id = trace_event_internal::kNoId,
+                unsigned long long bind_id = trace_event_internal::kNoId) {
+    events_.emplace_back(
+        thread_id, TimeTicks() + Microseconds(timestamp_us), ThreadTicks(),
+        ThreadInstructionCount(), phase, category_group_enabled_, name, scope,
+        id, bind_id, &args, flags);
+  }
+
+  // Returns the output of CompactTraceWriter for |events_|.
+  std::string Encode(const ArgumentFilterPredicate& argument_filter_predicate =
+                         ArgumentFilterPredicate()) {
+    std::string data;
+    bool finished = false;
+    CompactTraceWriter writer(
+        TraceLog::GetInstance()->process_id(), argument_filter_predicate,
+        BindLambdaForTesting([&](const scoped_refptr<RefCountedString>& piece,
+                                 bool has_more_events) {
+          EXPECT_FALSE(finished);
+          data += piece->data();
+          finished = !has_more_events;
+        }));
+    for (const TraceEvent& event : events_)
+      writer.AddEvent(event);
+    writer.Finish();
+    EXPECT_TRUE(finished);
+    EXPECT_EQ(events_.size(), writer.event_count());
+    return data;
+  }
+
+  // Returns the JSON of TraceLog::Flush() for |events_|.
+  std::string GetExpectedJSON(
+      const ArgumentFilterPredicate& argument_filter_predicate =
+          ArgumentFilterPredicate()) {
+    std::string json;
+    for (const TraceEvent& event : events_) {
+      if (!json.empty())
+        json += ",\n";
+      event.AppendAsJSON(&json, argument_filter_predicate);
+    }
+    return json;
+  }
+
+  void ExpectSameJSON(const ArgumentFilterPredicate& argument_filter_predicate =
+                          ArgumentFilterPredicate()) {
+    CompactTraceReader reader;
+    std::string json;
+    EXPECT_TRUE(reader.AppendAsJSON(Encode(argument_filter_predicate), &json));
+    EXPECT_TRUE(reader.IsComplete());
+    EXPECT_EQ(events_.size(), reader.event_count());
+    EXPECT_EQ(GetExpectedJSON(argument_filter_predicate), json);
+  }
+
+  const unsigned char* const category_group_enabled_ =
+      TraceLog::GetCategoryGroupEnabled("test_all");
+  std::vector<TraceEvent> events_;
+};
+
+class TestConvertable : public ConvertableToTraceFormat {
+ public:
+  void AppendAsTraceFormat(std::string* out) const override {
+    *out += "{\"nested\":[1,2]}";
+  }
+};
+
+}  // namespace
+
+TEST_F(CompactTraceWriterTest, Args) {
+  int value = 0;
+  AddEvent(kThreadId, 10, TRACE_EVENT_PHASE_INSTANT, "Ints",
+           TraceArguments("int", -5, "uint", 7u), TRACE_EVENT_SCOPE_THREAD);
+  AddEvent(kThreadId, 20, TRACE_EVENT_PHASE_INSTANT, "Numbers",
+           TraceArguments("double", 0.25, "bool", true),
+           TRACE_EVENT_SCOPE_PROCESS);
+  AddEvent(kThreadId, 30, TRACE_EVENT_PHASE_INSTANT, "Strings",
+           TraceArguments("static", "quote\"d", "copy",
+                          TraceStringWithCopy("copied")),
+           TRACE_EVENT_SCOPE_GLOBAL);
+  AddEvent(kThreadId, 40, TRACE_EVENT_PHASE_INSTANT, "Pointer",
+           TraceArguments("pointer", static_cast<void*>(&value)),
+           TRACE_EVENT_SCOPE_THREAD);
+  AddEvent(kThreadId, 50, TRACE_EVENT_PHASE_INSTANT, "Null",
+           TraceArguments("null", static_cast<const char*>(nullptr)),
+           TRACE_EVENT_SCOPE_THREAD);
+  AddEvent(kThreadId, 60, TRACE_EVENT_PHASE_INSTANT, "Convertable",
+           TraceArguments("convertable",
+                          std::unique_ptr<ConvertableToTraceFormat>(
+                              new TestConvertable())),
+           TRACE_EVENT_SCOPE_THREAD);
+  // The same names again, from the string table.
+  AddEvent(kThreadId, 70, TRACE_EVENT_PHASE_INSTANT, "Strings",
+           TraceArguments("static", "quote\"d"), TRACE_EVENT_SCOPE_GLOBAL);
+  ExpectSameJSON();
+}
+
+TEST_F(CompactTraceWriterTest, CopiedStrings) {
+  std::string name = "Copied";
+  std::string arg_name = "arg";
+  AddEvent(kThreadId, 10, TRACE_EVENT_PHASE_INSTANT, name.c_str(),
+           TraceArguments(arg_name.c_str(), "value"),
+           TRACE_EVENT_SCOPE_THREAD | TRACE_EVENT_FLAG_COPY);
+  // Reusing the memory of the copied strings doesn't change the trace.
+  name = "Other";
+  arg_name = "other";
+  AddEvent(kThreadId, 20, TRACE_EVENT_PHASE_INSTANT, name.c_str(),
+           TraceArguments(arg_name.c_str(), "value"),
+           TRACE_EVENT_SCOPE_THREAD | TRACE_EVENT_FLAG_COPY);
+  ExpectSameJSON();
+}
+
+TEST_F(CompactTraceWriterTest, IdsAndFlows) {
+  AddEvent(kThreadId, 10, TRACE_EVENT_PHASE_NESTABLE_ASYNC_BEGIN, "Async",
+           TraceArguments(), TRACE_EVENT_FLAG_HAS_ID, "scope", 0x1234);
+  AddEvent(kThreadId, 20, TRACE_EVENT_PHASE_NESTABLE_ASYNC_END, "Async",
+           TraceArguments(),
+           TRACE_EVENT_FLAG_HAS_LOCAL_ID | TRACE_EVENT_FLAG_ASYNC_TTS,
+           trace_event_internal::kGlobalScope, 0xffffffffffffffffull);
+  AddEvent(kThreadId, 30, TRACE_EVENT_PHASE_ASYNC_STEP_INTO, "Global",
+           TraceArguments(), TRACE_EVENT_FLAG_HAS_GLOBAL_ID, "other scope", 7);
+  AddEvent(kThreadId, 40, TRACE_EVENT_PHASE_BEGIN, "Flow", TraceArguments(),
+           TRACE_EVENT_FLAG_FLOW_OUT | TRACE_EVENT_FLAG_FLOW_IN,
+           trace_event_internal::kGlobalScope, trace_event_internal::kNoId,
+           0x5678);
+  AddEvent(kThreadId, 50, TRACE_EVENT_PHASE_BEGIN, "Enclosing",
+           TraceArguments(),
+           TRACE_EVENT_FLAG_BIND_TO_ENCLOSING | TRACE_EVENT_FLAG_FLOW_IN,
+           trace_event_internal::kGlobalScope, trace_event_internal::kNoId, 9);
+  ExpectSameJSON();
+}
+
+TEST_F(CompactTraceWriterTest, TimestampsAndThreads) {
+  AddEvent(kThreadId, 1000, TRACE_EVENT_PHASE_BEGIN, "A", TraceArguments(), 0);
+  AddEvent(kOtherThreadId, 500, TRACE_EVENT_PHASE_BEGIN, "B", TraceArguments(),
+           0);
+  AddEvent(kThreadId, 1001, TRACE_EVENT_PHASE_END, "A", TraceArguments(), 0);
+  // Out of order on the same thread.
+  AddEvent(kOtherThreadId, 400, TRACE_EVENT_PHASE_END, "B", TraceArguments(),
+           0);
+  AddEvent(kThreadId, -3, TRACE_EVENT_PHASE_INSTANT, "Negative",
+           TraceArguments(), TRACE_EVENT_SCOPE_THREAD);
+  // The thread id of an event with a process id holds that process id.
+  AddEvent(1234, 2000, TRACE_EVENT_PHASE_INSTANT, "OtherProcess",
+           TraceArguments(),
+           TRACE_EVENT_SCOPE_PROCESS | TRACE_EVENT_FLAG_HAS_PROCESS_ID);
+  ExpectSameJSON();
+}
+
+TEST_F(CompactTraceWriterTest, CompleteEvents) {
+  const TimeTicks start = TimeTicks() + Milliseconds(3);
+  events_.emplace_back(kThreadId, start, ThreadTicks() + Milliseconds(1),
+                       ThreadInstructionCount(1000),
+                       TRACE_EVENT_PHASE_COMPLETE, category_group_enabled_,
+                       "Complete", trace_event_internal::kGlobalScope,
+                       trace_event_internal::kNoId,
+                       trace_event_internal::kNoId, nullptr, 0);
+  events_.back().UpdateDuration(start + Microseconds(250),
+                                ThreadTicks() + Microseconds(1100),
+                                ThreadInstructionCount(1500));
+  // Still open, so without duration.
+  events_.emplace_back(kThreadId, start + Microseconds(10),
+                       ThreadTicks() + Microseconds(1010),
+                       ThreadInstructionCount(1200),
+                       TRACE_EVENT_PHASE_COMPLETE, category_group_enabled_,
+                       "Open", trace_event_internal::kGlobalScope,
+                       trace_event_internal::kNoId,
+                       trace_event_internal::kNoId, nullptr, 0);
+  AddEvent(kThreadId, 3500, TRACE_EVENT_PHASE_COMPLETE, "NoThreadTime",
+           TraceArguments(), 0);
+  events_.back().UpdateDuration(TimeTicks() + Microseconds(3600), ThreadTicks(),
+                                ThreadInstructionCount());
+  ExpectSameJSON();
+}
+
+TEST_F(CompactTraceWriterTest, ArgumentFilter) {
+  AddEvent(kThreadId, 10, TRACE_EVENT_PHASE_INSTANT, "Stripped",
+           TraceArguments("a", 1, "b", 2), TRACE_EVENT_SCOPE_THREAD);
+  AddEvent(kThreadId, 20, TRACE_EVENT_PHASE_INSTANT, "Allowed",
+           TraceArguments("a", 1, "b", 2), TRACE_EVENT_SCOPE_THREAD);
+  AddEvent(kThreadId, 30, TRACE_EVENT_PHASE_INSTANT, "Partial",
+           TraceArguments("a", 1, "b", 2), TRACE_EVENT_SCOPE_THREAD);
+  ExpectSameJSON(BindRepeating([](const char* category_group_name,
+                                  const char* event_name,
+                                  ArgumentNameFilterPredicate* arg_filter) {
+    if (StringPiece(event_name) == "Stripped")
+      return false;
+    if (StringPiece(event_name) == "Partial") {
+      *arg_filter = BindRepeating(
+          [](const char* arg_name) { return StringPiece(arg_name) == "b"; });
+    }
+    return true;
+  }));
+}
+
+TEST_F(CompactTraceWriterTest, Pieces) {
+  // Enough events for several pieces.
+  for (int i = 0; i < 20000; ++i) {
+    AddEvent(kThreadId + i % 3, i, TRACE_EVENT_PHASE_INSTANT, "Event",
+             TraceArguments("i", i, "copy", TraceStringWithCopy("text")),
+             TRACE_EVENT_SCOPE_THREAD);
+  }
+  std::vector<std::string> pieces;
+  CompactTraceWriter writer(
+      TraceLog::GetInstance()->process_id(), ArgumentFilterPredicate(),
+      BindLambdaForTesting([&](const scoped_refptr<RefCountedString>& piece,
+                               bool has_more_events) {
+        pieces.push_back(piece->data());
+      }));
+  for (const TraceEvent& event : events_)
+    writer.AddEvent(event);
+  writer.Finish();
+  ASSERT_GT(pieces.size(), 2u);
+
+  // The pieces only contain whole events.
+  CompactTraceReader reader;
+  std::string json;
+  for (const std::string& piece : pieces) {
+    EXPECT_TRUE(reader.AppendAsJSON(piece, &json));
+    EXPECT_TRUE(reader.IsComplete());
+  }
+  EXPECT_EQ(GetExpectedJSON(), json);
+}
+
+TEST_F(CompactTraceWriterTest, ReadByteByByte) {
+  AddEvent(kThreadId, 10, TRACE_EVENT_PHASE_INSTANT, "Event",
+           TraceArguments("string", "value", "double", 1.5),
+           TRACE_EVENT_SCOPE_THREAD);
+  AddEvent(kThreadId, 20, TRACE_EVENT_PHASE_INSTANT, "Event",
+           TraceArguments("string", "value", "double", 2.5),
+           TRACE_EVENT_SCOPE_THREAD);
+  const std::string data = Encode();
+
+  CompactTraceReader reader;
+  std::string json;
+  for (char c : data)
+    ASSERT_TRUE(reader.AppendAsJSON(StringPiece(&c, 1), &json));
+  EXPECT_TRUE(reader.IsComplete());
+  EXPECT_EQ(2u, reader.event_count());
+  EXPECT_EQ(GetExpectedJSON(), json);
+
+  // A truncated stream is incomplete.
+  CompactTraceReader truncated_reader;
+  json.clear();
+  EXPECT_TRUE(truncated_reader.AppendAsJSON(
+      StringPiece(data).substr(0, data.size() - 1), &json));
+  EXPECT_FALSE(truncated_reader.IsComplete());
+  EXPECT_EQ(1u, truncated_reader.event_count());
+}
+
+TEST_F(CompactTraceWriterTest, MalformedData) {
+  std::string json;
+  EXPECT_FALSE(CompactTraceReader().AppendAsJSON("JSON{}", &json));
+
+  AddEvent(kThreadId, 10, TRACE_EVENT_PHASE_INSTANT, "Event", TraceArguments(),
+           TRACE_EVENT_SCOPE_THREAD);
+  std::string data = Encode();
+  // Refers to a string which isn't in the table.
+  data += std::string("i\x02\x00\x54\x02\x09\x09\x00", 8);
+  CompactTraceReader reader;
+  EXPECT_FALSE(reader.AppendAsJSON(data, &json));
+}
+
+TEST_F(CompactTraceWriterTest, FlushCompact) {
+  TraceLog::GetInstance()->SetEnabled(TraceConfig("*", ""),
+                                      TraceLog::RECORDING_MODE);
+  for (int i = 0; i < 100; ++i) {
+    TRACE_EVENT1("test_all", "Complete", "i", i);
+    TRACE_EVENT_INSTANT1("test_all", "Instant", TRACE_EVENT_SCOPE_THREAD,
+                         "name", TRACE_STR_COPY("copy"));
+  }
+  TraceLog::GetInstance()->SetDisabled();
+
+  ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+  const FilePath path = temp_dir.GetPath().AppendASCII("trace.ctrc");
+  TraceLog::GetInstance()->FlushCompact(
+      CompactTraceWriter::CreateFileOutputCallback(
+          File(path, File::FLAG_CREATE | File::FLAG_WRITE)));
+
+  std::string data;
+  ASSERT_TRUE(ReadFileToString(path, &data));
+  CompactTraceReader reader;
+  std::string json = "[";
+  ASSERT_TRUE(reader.AppendAsJSON(data, &json));
+  json += "]";
+  EXPECT_TRUE(reader.IsComplete());
+
+  absl::optional<Value> trace = JSONReader::Read(json);
+  ASSERT_TRUE(trace);
+  ASSERT_TRUE(trace->is_list());
+  int complete_events = 0;
+  int instant_events = 0;
+  for (const Value& event : trace->GetList()) {
+    const std::string* name = event.FindStringKey("name");
+    ASSERT_TRUE(name);
+    if (*name == "Complete") {
+      EXPECT_EQ(complete_events, *event.FindIntPath("args.i"));
+      EXPECT_TRUE(event.FindIntKey("dur"));
+      ++complete_events;
+    } else if (*name == "Instant") {
+      EXPECT_EQ("copy", *event.FindStringPath("args.name"));
+      ++instant_events;
+    }
+  }
+  EXPECT_EQ(100, complete_events);
+  EXPECT_EQ(100, instant_events);
+}
+
+}  // namespace trace_event
+}  // namespace base
@@ -0,0 +1,358 @@
+// Copyright 2021 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "base/trace_event/flight_recorder.h"
+
+#include <inttypes.h>
+#include <string.h>
+
+#include <algorithm>
+#include <utility>
+
+#include "base/check_op.h"
+#include "base/files/file.h"
+#include "base/files/file_path.h"
+#include "base/files/memory_mapped_file.h"
+#include "base/json/string_escape.h"
+#include "base/memory/ptr_util.h"
+#include "base/metrics/persistent_memory_allocator.h"
+#include "base/process/process_handle.h"
+#include "base/strings/stringprintf.h"
+#include "base/trace_event/common/trace_event_common.h"
+
+namespace base {
+namespace trace_event {
+
+namespace {
+
+// Values of Record::state other than the position of the event plus
+// kFirstPosition. The records are zeroed, i.e. empty, by the allocator.
+constexpr uint64_t kWriting = 1;
+constexpr uint64_t kFirstPosition = 2;
+
+// Room left in the allocator for the block header of the ring and alignment.
+constexpr size_t kAllocationOverhead = 64;
+constexpr size_t kMinRecords = 16;
+
+// Strings are stored in words which can be read while they are written. Stores
+// at most sizeof(dest) - 1 characters of |src|, without reading further, and
+// the terminating null character.
+template <size_t N>
+void StoreTruncated(std::atomic<uint32_t> (&dest)[N], const char* src) {
+  char buffer[N * sizeof(uint32_t)] = {};
+  const size_t length = strnlen(src, sizeof(buffer) - 1);
+  memcpy(buffer, src, length);
+  for (size_t i = 0; i <= length / sizeof(uint32_t); ++i) {
+    uint32_t word;
+    memcpy(&word, buffer + i * sizeof(uint32_t), sizeof(word));
+    dest[i].store(word, std::memory_order_relaxed);
+  }
+}
+
+template <size_t N>
+std::string LoadTruncated(const std::atomic<uint32_t> (&src)[N]) {
+  char buffer[N * sizeof(uint32_t)];
+  for (size_t i = 0; i < N; ++i) {
+    const uint32_t word = src[i].load(std::memory_order_relaxed);
+    memcpy(buffer + i * sizeof(uint32_t), &word, sizeof(word));
+  }
+  return std::string(buffer, strnlen(buffer, sizeof(buffer)));
+}
+
+}  // namespace
+
+// Found once in the allocator, followed by the records of the ring. All fields
+// must be of exact sizes so the ring can be read by 32-bit and 64-bit builds.
+struct FlightRecorder::Header {
+  static constexpr uint32_t kPersistentTypeId =
+      FlightRecorder::kTypeIdFlightRecorder;
+
+  // Expected size for 32/64-bit check.
+  static constexpr size_t kExpectedInstanceSize = 48;
+
+  int64_t process_id;
+  int64_t start_time;
+  int64_t start_ticks;
+
+  // In microseconds, zero if the events are kept as long as they fit.
+  std::atomic<int64_t> max_age;
+
+  // Position of the next event. The record of an event is at its position
+  // modulo |num_records|.
+  std::atomic<uint64_t> next_position;
+
+  uint32_t num_records;
+  uint32_t padding;
+};
+
+// An event, written and read like a sequence lock: |state| is kWriting while
+// the other fields are written, and a reader which sees the same |state|
+// before and after copying them got a consistent event. The other fields are
+// atomics too, accessed with relaxed ordering, since they can be read while
+// they are written. The strings are null-terminated.
+struct FlightRecorder::Record {
+  // Expected size for 32/64-bit check.
+  static constexpr size_t kExpectedInstanceSize = 128;
+
+  std::atomic<uint64_t> state;
+  std::atomic<int64_t> timestamp;
+  std::atomic<uint64_t> id;
+  std::atomic<int64_t> thread_id;
+  std::atomic<uint32_t> flags;
+  std::atomic<char> phase;
+  char padding[3];
+  std::atomic<uint32_t>
+      category_group[(kMaxCategoryGroupLength + 1) / sizeof(uint32_t)];
+  std::atomic<uint32_t> name[(kMaxNameLength + 1) / sizeof(uint32_t)];
+};
+
+static_assert((FlightRecorder::kMaxCategoryGroupLength + 1) %
+                      sizeof(uint32_t) ==
+                  0,
+              "The category group must fill whole words");
+static_assert((FlightRecorder::kMaxNameLength + 1) % sizeof(uint32_t) == 0,
+              "The name must fill whole words");
+
+// static
+std::atomic<FlightRecorder*> FlightRecorder::g_flight_recorder_{nullptr};
+
+FlightRecorder::Event::Event() = default;
+FlightRecorder::Event::Event(const Event& other) = default;
+FlightRecorder::Event::~Event() = default;
+
+FlightRecorder::Snapshot::Snapshot() = default;
+FlightRecorder::Snapshot::~Snapshot() = default;
+
+std::string FlightRecorder::Snapshot::ToJSON() const {
+  std::string out = "[";
+  for (const Event& event : events) {
+    if (out.size() > 1)
+      out += ",\n";
+    StringAppendF(&out,
+                  "{\"pid\":%" PRId64 ",\"tid\":%" PRId64 ",\"ts\":%" PRId64
+                  ",\"ph\":\"%c\",\"cat\":",
+                  process_id, event.thread_id,
+                  event.timestamp.since_origin().InMicroseconds(),
+                  event.phase);
+    EscapeJSONString(event.category_group, true, &out);
+    out += ",\"name\":";
+    EscapeJSONString(event.name, true, &out);
+    if (event.flags & TRACE_EVENT_FLAG_HAS_ID)
+      StringAppendF(&out, ",\"id\":\"0x%" PRIx64 "\"", event.id);
+    if (event.phase == TRACE_EVENT_PHASE_INSTANT) {
+      char scope = '?';
+      switch (event.flags & TRACE_EVENT_FLAG_SCOPE_MASK) {
+        case TRACE_EVENT_SCOPE_GLOBAL:
+          scope = TRACE_EVENT_SCOPE_NAME_GLOBAL;
+          break;
+        case TRACE_EVENT_SCOPE_PROCESS:
+          scope = TRACE_EVENT_SCOPE_NAME_PROCESS;
+          break;
+        case TRACE_EVENT_SCOPE_THREAD:
+          scope = TRACE_EVENT_SCOPE_NAME_THREAD;
+          break;
+      }
+      StringAppendF(&out, ",\"s\":\"%c\"", scope);
+    }
+    out += ",\"args\":{}}";
+  }
+  out += "]";
+  return out;
+}
+
+FlightRecorder::FlightRecorder(
+    std::unique_ptr<PersistentMemoryAllocator> allocator,
+    Header* header,
+    Record* records,
+    size_t num_records)
+    : allocator_(std::move(allocator)),
+      header_(header),
+      records_(records),
+      num_records_(num_records) {
+  // This won't compile at the global scope because Record is a private
+  // struct. The size of Header is checked by the allocator.
+  static_assert(sizeof(Record) == Record::kExpectedInstanceSize,
+                "Unexpected size of FlightRecorder::Record");
+}
+
+FlightRecorder::~FlightRecorder() = default;
+
+// static
+bool FlightRecorder::CreateWithAllocator(
+    std::unique_ptr<PersistentMemoryAllocator> allocator) {
+  DCHECK(!Get());
+  const size_t used = allocator->used();
+  const size_t available =
+      allocator->size() > used ? allocator->size() - used : 0;
+  if (available < sizeof(Header) + kAllocationOverhead +
+                      kMinRecords * sizeof(Record)) {
+    return false;
+  }
+  const size_t num_records =
+      (available - sizeof(Header) - kAllocationOverhead) / sizeof(Record);
+
+  Header* header = allocator->New<Header>(sizeof(Header) +
+                                          num_records * sizeof(Record));
+  if (!header)
+    return false;
+  header->process_id = GetCurrentProcId();
+  header->start_time = Time::Now().ToInternalValue();
+  header->start_ticks = TimeTicks::Now().ToInternalValue();
+  header->num_records = static_cast<uint32_t>(num_records);
+  Record* records = reinterpret_cast<Record*>(header + 1);
+  allocator->MakeIterable(header);
+
+  g_flight_recorder_.store(
+      new FlightRecorder(std::move(allocator), header, records, num_records),
+      std::memory_order_release);
+  return true;
+}
+
+#if !defined(OS_NACL)
+// static
+bool FlightRecorder::CreateWithFile(const FilePath& file_path,
+                                    size_t size,
+                                    uint64_t id,
+                                    StringPiece name) {
+  DCHECK(!file_path.empty());
+  auto mapped_file = std::make_unique<MemoryMappedFile>();
+  if (!mapped_file->Initialize(
+          File(file_path, File::FLAG_CREATE_ALWAYS | File::FLAG_READ |
+                              File::FLAG_WRITE | File::FLAG_SHARE_DELETE),
+          {0, size}, MemoryMappedFile::READ_WRITE_EXTEND)) {
+    return false;
+  }
+  if (!FilePersistentMemoryAllocator::IsFileAcceptable(*mapped_file, false))
+    return false;
+  return CreateWithAllocator(std::make_unique<FilePersistentMemoryAllocator>(
+      std::move(mapped_file), size, id, name, false));
+}
+#endif  // !defined(OS_NACL)
+
+// static
+bool FlightRecorder::CreateWithLocalMemory(size_t size,
+                                           uint64_t id,
+                                           StringPiece name) {
+  return CreateWithAllocator(
+      std::make_unique<LocalPersistentMemoryAllocator>(size, id, name));
+}
+
+// static
+std::unique_ptr<FlightRecorder> FlightRecorder::ReleaseForTesting() {
+  return WrapUnique(
+      g_flight_recorder_.exchange(nullptr, std::memory_order_acq_rel));
+}
+
+// static
+bool FlightRecorder::CreateSnapshot(const PersistentMemoryAllocator& allocator,
+                                    Snapshot* snapshot) {
+  PersistentMemoryAllocator::Iterator iter(&allocator);
+  const PersistentMemoryAllocator::Reference ref =
+      iter.GetNextOfType(kTypeIdFlightRecorder);
+  const Header* header = allocator.GetAsObject<Header>(ref);
+  if (!header)
+    return false;
+  const size_t num_records = header->num_records;
+  if (!num_records ||
+      allocator.GetAllocSize(ref) <
+          sizeof(Header) + num_records * sizeof(Record)) {
+    return false;
+  }
+  const Record* records = reinterpret_cast<const Record*>(header + 1);
+
+  snapshot->process_id = header->process_id;
+  snapshot->start_time = Time::FromInternalValue(header->start_time);
+  snapshot->start_ticks = TimeTicks::FromInternalValue(header->start_ticks);
+  snapshot->events.clear();
+
+  std::vector<std::pair<uint64_t, Event>> events;
+  events.reserve(num_records);
+  for (size_t i = 0; i < num_records; ++i) {
+    const Record& record = records[i];
+    const uint64_t state = record.state.load(std::memory_order_acquire);
+    if (state < kFirstPosition)
+      continue;
+    Event event;
+    event.phase = record.phase.load(std::memory_order_relaxed);
+    event.category_group = LoadTruncated(record.category_group);
+    event.name = LoadTruncated(record.name);
+    event.id = record.id.load(std::memory_order_relaxed);
+    event.flags = record.flags.load(std::memory_order_relaxed);
+    event.thread_id = record.thread_id.load(std::memory_order_relaxed);
+    event.timestamp = TimeTicks::FromInternalValue(
+        record.timestamp.load(std::memory_order_relaxed));
+    // The record was rewritten while it was copied.
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (record.state.load(std::memory_order_relaxed) != state)
+      continue;
+    events.emplace_back(state - kFirstPosition, std::move(event));
+  }
+  std::sort(events.begin(), events.end(),
+            [](const std::pair<uint64_t, Event>& a,
+               const std::pair<uint64_t, Event>& b) {
+              return a.first < b.first;
+            });
+
+  TimeTicks oldest;
+  const int64_t max_age = header->max_age.load(std::memory_order_relaxed);
+  if (max_age > 0 && !events.empty()) {
+    TimeTicks newest;
+    for (const auto& event : events)
+      newest = std::max(newest, event.second.timestamp);
+    oldest = newest - Microseconds(max_age);
+  }
+  for (auto& event : events) {
+    if (event.second.timestamp >= oldest)
+      snapshot->events.push_back(std::move(event.second));
+  }
+  return true;
+}
+
+bool FlightRecorder::CreateSnapshot(Snapshot* snapshot) const {
+  return CreateSnapshot(*allocator_, snapshot);
+}
+
+void FlightRecorder::SetMaxAge(TimeDelta max_age) {
+  header_->max_age.store(max_age.InMicroseconds(), std::memory_order_relaxed);
+}
+
+void FlightRecorder::AddEvent(char phase,
+                              const char* category_group,
+                              const char* name,
+                              uint64_t id,
+                              unsigned int flags,
+                              int thread_id,
+                              TimeTicks timestamp) {
+  const uint64_t position =
+      header_->next_position.fetch_add(1, std::memory_order_relaxed);
+  Record& record = records_[position % num_records_];
+  const uint64_t new_state = position + kFirstPosition;
+
+  // The record is being written by another thread, or already holds a newer
+  // event, if this thread was preempted for a whole lap of the ring.
+  uint64_t state = record.state.load(std::memory_order_relaxed);
+  if (state == kWriting || state > new_state ||
+      !record.state.compare_exchange_strong(state, kWriting,
+                                            std::memory_order_relaxed)) {
+    dropped_event_count_.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  std::atomic_thread_fence(std::memory_order_release);
+
+  record.timestamp.store(timestamp.ToInternalValue(),
+                         std::memory_order_relaxed);
+  record.id.store(id, std::memory_order_relaxed);
+  record.thread_id.store(thread_id, std::memory_order_relaxed);
+  record.flags.store(flags, std::memory_order_relaxed);
+  record.phase.store(
+      phase == TRACE_EVENT_PHASE_COMPLETE ? TRACE_EVENT_PHASE_BEGIN : phase,
+      std::memory_order_relaxed);
+  StoreTruncated(record.category_group, category_group);
+  StoreTruncated(record.name, name);
+
+  record.state.store(new_state, std::memory_order_release);
+}
+
+}  // namespace trace_event
+}  // namespace base
@@ -0,0 +1,170 @@
+// Copyright 2021 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BASE_TRACE_EVENT_FLIGHT_RECORDER_H_
+#define BASE_TRACE_EVENT_FLIGHT_RECORDER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "base/base_export.h"
+#include "base/strings/string_piece.h"
+#include "base/time/time.h"
+#include "build/build_config.h"
+
+namespace base {
+
+class FilePath;
+class PersistentMemoryAllocator;
+
+namespace trace_event {
+
+// FlightRecorder keeps the last trace events of the categories enabled for
+// TraceLog's FLIGHT_RECORDER_MODE in a fixed-size ring of records inside a
+// PersistentMemoryAllocator, so that they can be dumped on demand, or read
+// after a crash from the file or shared memory which backed the allocator,
+// much like the activity data of debug::GlobalActivityTracker.
+//
+// Adding an event costs a few atomic operations and the copy of a bounded
+// part of its category group and name, without a lock or memory allocation.
+// Arguments are not kept. Complete events are kept as a begin record and an
+// end record, so that the events which were running at the time of a crash
+// show as unfinished.
+class BASE_EXPORT FlightRecorder {
+ public:
+  // SHA1(FlightRecorder): Increment this if the ring layout changes!
+  static constexpr uint32_t kTypeIdFlightRecorder = 0x5A3B01D9 + 1;
+
+  // Maximum lengths of the category group and name of the events, which are
+  // truncated beyond that.
+  static constexpr size_t kMaxCategoryGroupLength = 31;
+  static constexpr size_t kMaxNameLength = 55;
+
+  // An event read back from the ring.
+  struct BASE_EXPORT Event {
+    Event();
+    Event(const Event& other);
+    ~Event();
+
+    char phase = 0;
+    std::string category_group;
+    std::string name;
+    uint64_t id = 0;
+    unsigned int flags = 0;
+    int64_t thread_id = 0;
+    TimeTicks timestamp;
+  };
+
+  // The content of a ring.
+  struct BASE_EXPORT Snapshot {
+    Snapshot();
+    ~Snapshot();
+
+    // Returns the events as a JSON array of trace events, like the output of
+    // TraceLog::Flush(), which can be loaded in the trace viewers.
+    std::string ToJSON() const;
+
+    int64_t process_id = 0;
+    // Used to convert the timestamps of the events to wall time.
+    Time start_time;
+    TimeTicks start_ticks;
+    // Oldest first.
+    std::vector<Event> events;
+  };
+
+  FlightRecorder(const FlightRecorder&) = delete;
+  FlightRecorder& operator=(const FlightRecorder&) = delete;
+  ~FlightRecorder();
+
+  // Creates the global flight recorder, whose ring takes the space left in
+  // |allocator|. Returns false if there isn't room for it.
+  static bool CreateWithAllocator(
+      std::unique_ptr<PersistentMemoryAllocator> allocator);
+
+#if !defined(OS_NACL)
+  // Like CreateWithAllocator(), with a ring in the memory-mapped file at
+  // |file_path|, of |size| bytes, which can be read with
+  // FilePersistentMemoryAllocator once the process is gone.
+  static bool CreateWithFile(const FilePath& file_path,
+                             size_t size,
+                             uint64_t id,
+                             StringPiece name);
+#endif  // !defined(OS_NACL)
+
+  // Like CreateWithAllocator(), with a ring in local memory, which only
+  // allows dumps on demand.
+  static bool CreateWithLocalMemory(size_t size, uint64_t id, StringPiece name);
+
+  // Returns the global flight recorder, or null if it wasn't created.
+  static FlightRecorder* Get() {
+    return g_flight_recorder_.load(std::memory_order_acquire);
+  }
+
+  // Removes the global flight recorder, for tests. It must not be in use.
+  static std::unique_ptr<FlightRecorder> ReleaseForTesting();
+
+  // Reads the ring of the flight recorder in |allocator|, which can be the
+  // memory of a process which crashed. The events older than the max age of
+  // the ring, relative to the newest event, are dropped, as well as the
+  // records which were being written. Returns false if |allocator| doesn't
+  // hold a valid ring.
+  static bool CreateSnapshot(const PersistentMemoryAllocator& allocator,
+                             Snapshot* snapshot);
+
+  // Reads the ring of this flight recorder, while events are added.
+  bool CreateSnapshot(Snapshot* snapshot) const;
+
+  // Sets how long the events are kept, at most, which is zero for as long as
+  // they fit in the ring. Can be called at any time, and applies when the ring
+  // is read.
+  void SetMaxAge(TimeDelta max_age);
+
+  // Adds an event to the ring. Thread-safe. A TRACE_EVENT_PHASE_COMPLETE event
+  // is recorded as a TRACE_EVENT_PHASE_BEGIN one, to be followed by a
+  // TRACE_EVENT_PHASE_END one.
+  void AddEvent(char phase,
+                const char* category_group,
+                const char* name,
+                uint64_t id,
+                unsigned int flags,
+                int thread_id,
+                TimeTicks timestamp);
+
+  // Returns the number of events which were dropped because their record was
+  // being written by another thread, i.e. the ring was too small.
+  size_t dropped_event_count() const {
+    return dropped_event_count_.load(std::memory_order_relaxed);
+  }
+
+  size_t capacity() const { return num_records_; }
+
+  PersistentMemoryAllocator* allocator() const { return allocator_.get(); }
+
+ private:
+  struct Header;
+  struct Record;
+
+  FlightRecorder(std::unique_ptr<PersistentMemoryAllocator> allocator,
+                 Header* header,
+                 Record* records,
+                 size_t num_records);
+
+  static std::atomic<FlightRecorder*> g_flight_recorder_;
+
+  const std::unique_ptr<PersistentMemoryAllocator> allocator_;
+  Header* const header_;
+  Record* const records_;
+  const size_t num_records_;
+  std::atomic<size_t> dropped_event_count_{0};
+};
+
+}  // namespace trace_event
+}  // namespace base
+
+#endif  // BASE_TRACE_EVENT_FLIGHT_RECORDER_H_
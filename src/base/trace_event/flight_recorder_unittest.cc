@@ -0,0 +1,328 @@
+// Copyright 2021 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "base/trace_event/flight_recorder.h"
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "base/files/file.h"
+#include "base/files/file_path.h"
+#include "base/files/memory_mapped_file.h"
+#include "base/files/scoped_temp_dir.h"
+#include "base/json/json_reader.h"
+#include "base/metrics/persistent_memory_allocator.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/strings/stringprintf.h"
+#include "base/threading/simple_thread.h"
+#include "base/trace_event/trace_event.h"
+#include "base/trace_event/trace_log.h"
+#include "base/values.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace base {
+namespace trace_event {
+
+namespace {
+
+constexpr size_t kMemorySize = 64 << 10;  // 64 KiB
+constexpr uint64_t kAllocatorId = 0x1234;
+constexpr char kAllocatorName[] = "FlightRecorderTest";
+constexpr int kThreadId = 42;
+
+class FlightRecorderTest : public testing::Test {
+ public:
+  void SetUp() override { TraceLog::ResetForTesting(); }
+  void TearDown() override {
+    TraceLog::ResetForTesting();
+    FlightRecorder::ReleaseForTesting();
+  }
+
+ protected:
+  FlightRecorder* CreateFlightRecorder() {
+    EXPECT_TRUE(FlightRecorder::CreateWithLocalMemory(kMemorySize, kAllocatorId,
+                                                      kAllocatorName));
+    return FlightRecorder::Get();
+  }
+
+  static TimeTicks Timestamp(int64_t us) {
+    return TimeTicks() + Microseconds(us);
+  }
+
+  static std::vector<std::string> GetNames(
+      const FlightRecorder::Snapshot& snapshot) {
+    std::vector<std::string> names;
+    for (const FlightRecorder::Event& event : snapshot.events)
+      names.push_back(event.name);
+    return names;
+  }
+};
+
+}  // namespace
+
+TEST_F(FlightRecorderTest, AddEvents) {
+  FlightRecorder* flight_recorder = CreateFlightRecorder();
+  ASSERT_TRUE(flight_recorder);
+  EXPECT_LT(100u, flight_recorder->capacity());
+
+  flight_recorder->AddEvent(TRACE_EVENT_PHASE_COMPLETE, "cat", "complete", 0,
+                            TRACE_EVENT_FLAG_NONE, kThreadId, Timestamp(10));
+  flight_recorder->AddEvent(TRACE_EVENT_PHASE_ASYNC_BEGIN, "cat", "async", 0x2a,
+                            TRACE_EVENT_FLAG_HAS_ID, kThreadId, Timestamp(20));
+  flight_recorder->AddEvent(TRACE_EVENT_PHASE_END, "cat", "complete", 0,
+                            TRACE_EVENT_FLAG_NONE, kThreadId, Timestamp(30));
+
+  FlightRecorder::Snapshot snapshot;
+  ASSERT_TRUE(flight_recorder->CreateSnapshot(&snapshot));
+  EXPECT_EQ(GetCurrentProcId(), snapshot.process_id);
+  ASSERT_EQ(3u, snapshot.events.size());
+  EXPECT_EQ(TRACE_EVENT_PHASE_BEGIN, snapshot.events[0].phase);
+  EXPECT_EQ("cat", snapshot.events[0].category_group);
+  EXPECT_EQ("complete", snapshot.events[0].name);
+  EXPECT_EQ(kThreadId, snapshot.events[0].thread_id);
+  EXPECT_EQ(Timestamp(10), snapshot.events[0].timestamp);
+  EXPECT_EQ(TRACE_EVENT_PHASE_ASYNC_BEGIN, snapshot.events[1].phase);
+  EXPECT_EQ(0x2au, snapshot.events[1].id);
+  EXPECT_EQ(TRACE_EVENT_PHASE_END, snapshot.events[2].phase);
+  EXPECT_EQ(0u, flight_recorder->dropped_event_count());
+
+  absl::optional<Value> json = JSONReader::Read(snapshot.ToJSON());
+  ASSERT_TRUE(json);
+  ASSERT_TRUE(json->is_list());
+  ASSERT_EQ(3u, json->GetList().size());
+  const Value& async_event = json->GetList()[1];
+  EXPECT_EQ("S", *async_event.FindStringKey("ph"));
+  EXPECT_EQ("async", *async_event.FindStringKey("name"));
+  EXPECT_EQ("0x2a", *async_event.FindStringKey("id"));
+  EXPECT_EQ(20, async_event.FindIntKey("ts").value_or(-1));
+}
+
+TEST_F(FlightRecorderTest, InstantEventScopes) {
+  FlightRecorder* flight_recorder = CreateFlightRecorder();
+  ASSERT_TRUE(flight_recorder);
+  flight_recorder->AddEvent(TRACE_EVENT_PHASE_INSTANT, "cat", "global", 0,
+                            TRACE_EVENT_SCOPE_GLOBAL, kThreadId, Timestamp(10));
+  flight_recorder->AddEvent(TRACE_EVENT_PHASE_INSTANT, "cat", "process", 0,
+                            TRACE_EVENT_SCOPE_PROCESS, kThreadId,
+                            Timestamp(20));
+  flight_recorder->AddEvent(TRACE_EVENT_PHASE_INSTANT, "cat", "thread", 0,
+                            TRACE_EVENT_SCOPE_THREAD, kThreadId, Timestamp(30));
+
+  FlightRecorder::Snapshot snapshot;
+  ASSERT_TRUE(flight_recorder->CreateSnapshot(&snapshot));
+  absl::optional<Value> json = JSONReader::Read(snapshot.ToJSON());
+  ASSERT_TRUE(json);
+  ASSERT_TRUE(json->is_list());
+  ASSERT_EQ(3u, json->GetList().size());
+  EXPECT_EQ("g", *json->GetList()[0].FindStringKey("s"));
+  EXPECT_EQ("p", *json->GetList()[1].FindStringKey("s"));
+  EXPECT_EQ("t", *json->GetList()[2].FindStringKey("s"));
+}
+
+TEST_F(FlightRecorderTest, LongStringsAreTruncated) {
+  FlightRecorder* flight_recorder = CreateFlightRecorder();
+  ASSERT_TRUE(flight_recorder);
+  const std::string category_group(100, 'c');
+  const std::string name(100, 'n');
+  flight_recorder->AddEvent(TRACE_EVENT_PHASE_INSTANT, category_group.c_str(),
+                            name.c_str(), 0, TRACE_EVENT_FLAG_NONE, kThreadId,
+                            Timestamp(10));
+
+  FlightRecorder::Snapshot snapshot;
+  ASSERT_TRUE(flight_recorder->CreateSnapshot(&snapshot));
+  ASSERT_EQ(1u, snapshot.events.size());
+  EXPECT_EQ(category_group.substr(0, FlightRecorder::kMaxCategoryGroupLength),
+            snapshot.events[0].category_group);
+  EXPECT_EQ(name.substr(0, FlightRecorder::kMaxNameLength),
+            snapshot.events[0].name);
+}
+
+// The ring keeps the last events.
+TEST_F(FlightRecorderTest, RingWrapsAround) {
+  FlightRecorder* flight_recorder = CreateFlightRecorder();
+  ASSERT_TRUE(flight_recorder);
+  const size_t capacity = flight_recorder->capacity();
+  const size_t num_events = capacity * 5 / 2;
+  std::vector<std::string> names;
+  for (size_t i = 0; i < num_events; ++i) {
+    names.push_back(NumberToString(i));
+    flight_recorder->AddEvent(TRACE_EVENT_PHASE_INSTANT, "cat",
+                              names.back().c_str(), 0, TRACE_EVENT_FLAG_NONE,
+                              kThreadId, Timestamp(i));
+  }
+
+  FlightRecorder::Snapshot snapshot;
+  ASSERT_TRUE(flight_recorder->CreateSnapshot(&snapshot));
+  EXPECT_EQ(std::vector<std::string>(names.end() - capacity, names.end()),
+            GetNames(snapshot));
+}
+
+// Only the events of the last |max_age| before the newest one are read.
+TEST_F(FlightRecorderTest, MaxAge) {
+  FlightRecorder* flight_recorder = CreateFlightRecorder();
+  ASSERT_TRUE(flight_recorder);
+  const char* const kNames[] = {"old", "recent", "newest"};
+  const int64_t kTimestamps[] = {1000, 9000, 10000};
+  for (size_t i = 0; i < 3; ++i) {
+    flight_recorder->AddEvent(TRACE_EVENT_PHASE_INSTANT, "cat", kNames[i], 0,
+                              TRACE_EVENT_FLAG_NONE, kThreadId,
+                              Timestamp(kTimestamps[i]));
+  }
+
+  FlightRecorder::Snapshot snapshot;
+  ASSERT_TRUE(flight_recorder->CreateSnapshot(&snapshot));
+  EXPECT_EQ(3u, snapshot.events.size());
+
+  flight_recorder->SetMaxAge(Milliseconds(5));
+  ASSERT_TRUE(flight_recorder->CreateSnapshot(&snapshot));
+  EXPECT_EQ(std::vector<std::string>({"recent", "newest"}), GetNames(snapshot));
+}
+
+// The events can be read from the file of the ring once the process is gone.
+TEST_F(FlightRecorderTest, ReadFromFile) {
+  ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+  const FilePath file_path = temp_dir.GetPath().AppendASCII("flight_recorder");
+  ASSERT_TRUE(FlightRecorder::CreateWithFile(file_path, kMemorySize,
+                                             kAllocatorId, kAllocatorName));
+  FlightRecorder* flight_recorder = FlightRecorder::Get();
+  ASSERT_TRUE(flight_recorder);
+  flight_recorder->SetMaxAge(Seconds(10));
+  flight_recorder->AddEvent(TRACE_EVENT_PHASE_COMPLETE, "cat", "running", 0,
+                            TRACE_EVENT_FLAG_NONE, kThreadId, Timestamp(10));
+  flight_recorder->AddEvent(TRACE_EVENT_PHASE_INSTANT, "cat", "instant", 0,
+                            TRACE_EVENT_FLAG_NONE, kThreadId, Timestamp(20));
+  // Simulates a crash, where the ring isn't closed.
+  std::unique_ptr<FlightRecorder> released =
+      FlightRecorder::ReleaseForTesting();
+
+  auto mapped_file = std::make_unique<MemoryMappedFile>();
+  ASSERT_TRUE(mapped_file->Initialize(
+      File(file_path, File::FLAG_OPEN | File::FLAG_READ)));
+  ASSERT_TRUE(FilePersistentMemoryAllocator::IsFileAcceptable(*mapped_file,
+                                                              true));
+  FilePersistentMemoryAllocator allocator(std::move(mapped_file), 0, 0, "",
+                                          true);
+  EXPECT_EQ(kAllocatorId, allocator.Id());
+  FlightRecorder::Snapshot snapshot;
+  ASSERT_TRUE(FlightRecorder::CreateSnapshot(allocator, &snapshot));
+  EXPECT_EQ(GetCurrentProcId(), snapshot.process_id);
+  ASSERT_EQ(2u, snapshot.events.size());
+  EXPECT_EQ(TRACE_EVENT_PHASE_BEGIN, snapshot.events[0].phase);
+  EXPECT_EQ("running", snapshot.events[0].name);
+  EXPECT_EQ("instant", snapshot.events[1].name);
+}
+
+TEST_F(FlightRecorderTest, NoRing) {
+  LocalPersistentMemoryAllocator allocator(kMemorySize, kAllocatorId,
+                                           kAllocatorName);
+  FlightRecorder::Snapshot snapshot;
+  EXPECT_FALSE(FlightRecorder::CreateSnapshot(allocator, &snapshot));
+
+  // Too small for a ring.
+  EXPECT_FALSE(FlightRecorder::CreateWithLocalMemory(1024, kAllocatorId,
+                                                     kAllocatorName));
+  EXPECT_FALSE(FlightRecorder::Get());
+}
+
+// Threads add events while the ring is read. Each event read is consistent.
+TEST_F(FlightRecorderTest, ConcurrentWritersAndReader) {
+  constexpr int kNumThreads = 4;
+  constexpr int kNumEvents = 10000;
+
+  class WriterThread : public SimpleThread {
+   public:
+    WriterThread(FlightRecorder* flight_recorder, int thread_index)
+        : SimpleThread("WriterThread"),
+          flight_recorder_(flight_recorder),
+          thread_index_(thread_index) {}
+
+    // SimpleThread:
+    void Run() override {
+      for (int i = 0; i < kNumEvents; ++i) {
+        const std::string name = StringPrintf("%d %d", thread_index_, i);
+        flight_recorder_->AddEvent(TRACE_EVENT_PHASE_INSTANT, "cat",
+                                   name.c_str(), 0, TRACE_EVENT_FLAG_NONE,
+                                   thread_index_, Timestamp(i));
+      }
+    }
+
+   private:
+    FlightRecorder* const flight_recorder_;
+    const int thread_index_;
+  };
+
+  FlightRecorder* flight_recorder = CreateFlightRecorder();
+  ASSERT_TRUE(flight_recorder);
+  std::vector<std::unique_ptr<WriterThread>> threads;
+  for (int i = 0; i < kNumThreads; ++i) {
+    threads.push_back(std::make_unique<WriterThread>(flight_recorder, i));
+    threads.back()->Start();
+  }
+
+  auto check_snapshot = [](const FlightRecorder::Snapshot& snapshot) {
+    for (const FlightRecorder::Event& event : snapshot.events) {
+      EXPECT_EQ(StringPrintf("%d %d", static_cast<int>(event.thread_id),
+                             static_cast<int>(event.timestamp.since_origin()
+                                                  .InMicroseconds())),
+                event.name);
+    }
+  };
+  FlightRecorder::Snapshot snapshot;
+  for (int i = 0; i < 20; ++i) {
+    ASSERT_TRUE(flight_recorder->CreateSnapshot(&snapshot));
+    check_snapshot(snapshot);
+  }
+  for (auto& thread : threads)
+    thread->Join();
+
+  ASSERT_TRUE(flight_recorder->CreateSnapshot(&snapshot));
+  check_snapshot(snapshot);
+  // Once written, a record only gets newer events.
+  EXPECT_EQ(flight_recorder->capacity(), snapshot.events.size());
+}
+
+// TraceLog adds the events of the flight recorder categories to the ring,
+// without recording.
+TEST_F(FlightRecorderTest, TraceLogFlightRecorderMode) {
+  FlightRecorder* flight_recorder = CreateFlightRecorder();
+  ASSERT_TRUE(flight_recorder);
+  TraceConfig config;
+  TraceConfig::FlightRecorderConfig flight_recorder_config;
+  TraceConfigCategoryFilter category_filter;
+  category_filter.InitializeFromString("test_all");
+  flight_recorder_config.SetCategoryFilter(category_filter);
+  flight_recorder_config.set_max_age(Seconds(30));
+  config.SetFlightRecorderConfig(flight_recorder_config);
+  TraceLog::GetInstance()->SetEnabled(config, TraceLog::FLIGHT_RECORDER_MODE);
+  EXPECT_FALSE(TraceLog::GetInstance()->IsEnabled());
+  EXPECT_EQ(
+      Seconds(30),
+      TraceLog::GetInstance()->GetCurrentTraceConfig().flight_recorder_config()
+          .max_age());
+
+  {
+    TRACE_EVENT0("test_all", "scope");
+    TRACE_EVENT_INSTANT0("test_all", "instant", TRACE_EVENT_SCOPE_THREAD);
+    TRACE_EVENT_INSTANT0("test_a", "not kept", TRACE_EVENT_SCOPE_THREAD);
+  }
+  TraceLog::GetInstance()->SetDisabled(TraceLog::FLIGHT_RECORDER_MODE);
+  TRACE_EVENT_INSTANT0("test_all", "after", TRACE_EVENT_SCOPE_THREAD);
+
+  FlightRecorder::Snapshot snapshot;
+  ASSERT_TRUE(flight_recorder->CreateSnapshot(&snapshot));
+  EXPECT_EQ(std::vector<std::string>({"scope", "instant", "scope"}),
+            GetNames(snapshot));
+  EXPECT_EQ(TRACE_EVENT_PHASE_BEGIN, snapshot.events[0].phase);
+  EXPECT_EQ(TRACE_EVENT_PHASE_INSTANT, snapshot.events[1].phase);
+  EXPECT_EQ(TRACE_EVENT_PHASE_END, snapshot.events[2].phase);
+  EXPECT_EQ("test_all", snapshot.events[0].category_group);
+  EXPECT_EQ(PlatformThread::CurrentId(), snapshot.events[0].thread_id);
+  EXPECT_LE(snapshot.events[0].timestamp, snapshot.events[2].timestamp);
+}
+
+}  // namespace trace_event
+}  // namespace base
@@ -116,27 +116,33 @@ void ReportPartitionAllocStats(ProcessMemoryDump* pmd,
                                                         level_of_detail);
   bool is_light_dump = level_of_detail == MemoryDumpLevelOfDetail::BACKGROUND;
 
+  // Walking all slot spans is too expensive for periodic dumps, so the
+  // fragmentation stats are only reported in detailed dumps.
+  bool dump_fragmentation =
+      level_of_detail == MemoryDumpLevelOfDetail::DETAILED;
+  auto dump_root = [&](auto* root, const char* partition_name) {
+    root->DumpStats(partition_name, is_light_dump, &partition_stats_dumper);
+    if (dump_fragmentation)
+      root->DumpFragmentationStats(partition_name, &partition_stats_dumper);
+  };
+
   auto* allocator = internal::PartitionAllocMalloc::Allocator();
-  allocator->DumpStats("allocator", is_light_dump, &partition_stats_dumper);
+  dump_root(allocator, "allocator");
 
   auto* original_allocator =
       internal::PartitionAllocMalloc::OriginalAllocator();
-  if (original_allocator) {
-    original_allocator->DumpStats("original", is_light_dump,
-                                  &partition_stats_dumper);
-  }
+  if (original_allocator)
+    dump_root(original_allocator, "original");
   auto* aligned_allocator = internal::PartitionAllocMalloc::AlignedAllocator();
-  if (aligned_allocator != allocator) {
-    aligned_allocator->DumpStats("aligned", is_light_dump,
-                                 &partition_stats_dumper);
-  }
+  if (aligned_allocator != allocator)
+    dump_root(aligned_allocator, "aligned");
   auto& nonscannable_allocator = internal::NonScannableAllocator::Instance();
   if (auto* root = nonscannable_allocator.root())
-    root->DumpStats("nonscannable", is_light_dump, &partition_stats_dumper);
+    dump_root(root, "nonscannable");
   auto& nonquarantinable_allocator =
       internal::NonQuarantinableAllocator::Instance();
   if (auto* root = nonquarantinable_allocator.root())
-    root->DumpStats("nonquarantinable", is_light_dump, &partition_stats_dumper);
+    dump_root(root, "nonquarantinable");
 
   *total_virtual_size += partition_stats_dumper.total_resident_bytes();
   *resident_size += partition_stats_dumper.total_resident_bytes();
@@ -382,6 +388,30 @@ void MemoryDumpPartitionStatsDumper::PartitionsDumpBucketStats(
                             memory_stats->num_decommitted_slot_spans);
 }
 
+void MemoryDumpPartitionStatsDumper::PartitionDumpBucketFragmentationStats(
+    const char* partition_name,
+    const base::PartitionBucketFragmentationStats* fragmentation_stats) {
+  std::string dump_name = GetPartitionDumpName(root_name_, partition_name);
+  dump_name.append(base::StringPrintf("/buckets/bucket_%07" PRIu32,
+                                      fragmentation_stats->bucket_slot_size));
+
+  MemoryAllocatorDump* allocator_dump =
+      memory_dump_->GetOrCreateAllocatorDump(dump_name);
+  allocator_dump->AddScalar("mostly_empty_size", "bytes",
+                            fragmentation_stats->mostly_empty_resident_bytes);
+  allocator_dump->AddScalar("ideal_packed_size", "bytes",
+                            fragmentation_stats->ideal_packed_bytes);
+  for (size_t i = 0;
+       i < base::PartitionBucketFragmentationStats::kOccupancyHistogramSize;
+       ++i) {
+    allocator_dump->AddScalar(
+        base::StringPrintf("occupancy_%02" PRIuS "_percent_slot_spans",
+                           i * 100 / base::PartitionBucketFragmentationStats::
+                                         kOccupancyHistogramSize),
+        "objects", fragmentation_stats->occupancy_histogram[i]);
+  }
+}
+
 void ReportPartitionAllocThreadCacheStats(ProcessMemoryDump* pmd,
                                           MemoryAllocatorDump* dump,
                                           const ThreadCacheStats& stats,
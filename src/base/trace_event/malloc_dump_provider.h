@@ -60,7 +60,8 @@ class BASE_EXPORT MallocDumpProvider : public MemoryDumpProvider {
 // PartitionAllocMemoryDumpProvider. This implements an interface that will
 // be called with memory statistics for each bucket in the allocator.
 class BASE_EXPORT MemoryDumpPartitionStatsDumper final
-    : public base::PartitionStatsDumper {
+    : public base::PartitionStatsDumper,
+      public base::PartitionFragmentationStatsDumper {
  public:
   MemoryDumpPartitionStatsDumper(const char* root_name,
                                  ProcessMemoryDump* memory_dump,
@@ -78,6 +79,12 @@ class BASE_EXPORT MemoryDumpPartitionStatsDumper final
       const char* partition_name,
       const base::PartitionBucketMemoryStats*) override;
 
+  // PartitionFragmentationStatsDumper implementation. Adds the fragmentation
+  // scalars to the bucket dumps created by |PartitionsDumpBucketStats|.
+  void PartitionDumpBucketFragmentationStats(
+      const char* partition_name,
+      const base::PartitionBucketFragmentationStats*) override;
+
   size_t total_mmapped_bytes() const { return total_mmapped_bytes_; }
   size_t total_resident_bytes() const { return total_resident_bytes_; }
   size_t total_active_bytes() const { return total_active_bytes_; }
@@ -12,6 +12,7 @@
 #include <utility>
 
 #include "base/allocator/buildflags.h"
+#include "base/barrier_closure.h"
 #include "base/base_switches.h"
 #include "base/command_line.h"
 #include "base/debug/alias.h"
@@ -20,6 +21,8 @@
 #include "base/memory/ptr_util.h"
 #include "base/strings/string_util.h"
 #include "base/task/sequenced_task_runner.h"
+#include "base/task/thread_pool.h"
+#include "base/task/thread_pool/thread_pool_instance.h"
 #include "base/third_party/dynamic_annotations/dynamic_annotations.h"
 #include "base/threading/thread.h"
 #include "base/threading/thread_task_runner_handle.h"
@@ -176,6 +179,9 @@ void MemoryDumpManager::RegisterDumpProviderInternal(
   if (dumper_registrations_ignored_for_testing_)
     return;
 
+  // Providers bound to a task runner are always dumped on it.
+  DCHECK(!options.supports_parallel_dumps || !task_runner);
+
   // Only a handful of MDPs are required to compute the memory metrics. These
   // have small enough performance overhead that it is reasonable to run them
   // in the background while the user is doing other things. Those MDPs are
@@ -307,9 +313,15 @@ void MemoryDumpManager::CreateProcessDump(const MemoryDumpRequestArgs& args,
 
     pmd_async_state = std::make_unique<ProcessMemoryDumpAsyncState>(
         args, dump_providers_, std::move(callback),
-        GetOrCreateBgTaskRunnerLocked());
+        GetOrCreateBgTaskRunnerLocked(),
+        ThreadPoolInstance::Get() != nullptr);
   }
 
+  // The parallel dumps must be posted before ContinueAsyncProcessDump() can
+  // finish the dump.
+  if (!pmd_async_state->parallel_dump_providers.empty())
+    StartParallelDumps(pmd_async_state.get());
+
   // Start the process dump. This involves task runner hops as specified by the
   // MemoryDumpProvider(s) in RegisterDumpProvider()).
   ContinueAsyncProcessDump(pmd_async_state.release());
@@ -323,11 +335,6 @@ void MemoryDumpManager::CreateProcessDump(const MemoryDumpRequestArgs& args,
 void MemoryDumpManager::ContinueAsyncProcessDump(
     ProcessMemoryDumpAsyncState* owned_pmd_async_state) {
   HEAP_PROFILER_SCOPED_IGNORE;
-  // Initalizes the ThreadLocalEventBuffer to guarantee that the TRACE_EVENTs
-  // in the PostTask below don't end up registering their own dump providers
-  // (for discounting trace memory overhead) while holding the |lock_|.
-  TraceLog::GetInstance()->InitializeThreadLocalEventBufferIfSupported();
-
   // In theory |owned_pmd_async_state| should be a unique_ptr. The only reason
   // why it isn't is because of the corner case logic of |did_post_task|
   // above, which needs to take back the ownership of the |pmd_async_state| when
@@ -395,7 +402,7 @@ void MemoryDumpManager::ContinueAsyncProcessDump(
     pmd_async_state->pending_dump_providers.pop_back();
   }
 
-  FinishAsyncProcessDump(std::move(pmd_async_state));
+  CompleteProcessDumpPart(std::move(pmd_async_state));
 }
 
 // This function is called on the right task runner for current MDP. It is
@@ -452,10 +459,55 @@ void MemoryDumpManager::InvokeOnMemoryDump(MemoryDumpProviderInfo* mdpinfo,
         !*(static_cast<volatile bool*>(&mdpinfo->disabled)));
   bool dump_successful =
       mdpinfo->dump_provider->OnMemoryDump(pmd->dump_args(), pmd);
+
+  // Overlapping dumps can invoke the providers which support parallel dumps
+  // concurrently, hence the lock.
+  AutoLockMaybe lock(mdpinfo->options.supports_parallel_dumps ? &lock_
+                                                              : nullptr);
   mdpinfo->consecutive_failures =
       dump_successful ? 0 : mdpinfo->consecutive_failures + 1;
 }
 
+void MemoryDumpManager::StartParallelDumps(
+    ProcessMemoryDumpAsyncState* pmd_async_state) {
+  const size_t num_providers = pmd_async_state->parallel_dump_providers.size();
+  RepeatingClosure barrier = BarrierClosure(
+      num_providers, BindOnce(&MemoryDumpManager::OnParallelDumpsDone,
+                              Unretained(this), Unretained(pmd_async_state)));
+  for (size_t i = 0; i < num_providers; ++i) {
+    MemoryDumpProviderInfo* mdpinfo =
+        pmd_async_state->parallel_dump_providers[i].get();
+    ProcessMemoryDump* pmd =
+        pmd_async_state->parallel_process_memory_dumps[i].get();
+    bool did_post_task = ThreadPool::PostTask(
+        FROM_HERE, {MayBlock()},
+        BindOnce(&MemoryDumpManager::InvokeOnMemoryDump, Unretained(this),
+                 Unretained(mdpinfo), Unretained(pmd))
+            .Then(barrier));
+
+    // PostTask fails only if the thread pool is shut down. Ignore the dump
+    // provider and continue.
+    if (!did_post_task)
+      barrier.Run();
+  }
+}
+
+void MemoryDumpManager::OnParallelDumpsDone(
+    ProcessMemoryDumpAsyncState* owned_pmd_async_state) {
+  CompleteProcessDumpPart(WrapUnique(owned_pmd_async_state));
+}
+
+void MemoryDumpManager::CompleteProcessDumpPart(
+    std::unique_ptr<ProcessMemoryDumpAsyncState> pmd_async_state) {
+  if (pmd_async_state->num_pending_parts.fetch_sub(
+          1, std::memory_order_acq_rel) > 1) {
+    // The other part of the dump will finish it.
+    ignore_result(pmd_async_state.release());
+    return;
+  }
+  FinishAsyncProcessDump(std::move(pmd_async_state));
+}
+
 void MemoryDumpManager::FinishAsyncProcessDump(
     std::unique_ptr<ProcessMemoryDumpAsyncState> pmd_async_state) {
   HEAP_PROFILER_SCOPED_IGNORE;
@@ -472,6 +524,17 @@ void MemoryDumpManager::FinishAsyncProcessDump(
 
   TRACE_EVENT0(kTraceCategory, "MemoryDumpManager::FinishAsyncProcessDump");
 
+  ProcessMemoryDump* process_memory_dump =
+      pmd_async_state->process_memory_dump.get();
+  for (auto& pmd : pmd_async_state->parallel_process_memory_dumps)
+    process_memory_dump->TakeAllDumpsFrom(pmd.get());
+
+  if (pmd_async_state->req_args.incremental) {
+    AutoLock lock(lock_);
+    process_memory_dump->RemoveAllocatorDumpsUnchangedSince(
+        &incremental_dump_digests_[pmd_async_state->req_args.level_of_detail]);
+  }
+
   if (!pmd_async_state->callback.is_null()) {
     std::move(pmd_async_state->callback)
         .Run(true /* success */, dump_guid,
@@ -516,21 +579,42 @@ void MemoryDumpManager::TeardownForTracing() {
   AutoLock lock(lock_);
 
   MemoryDumpScheduler::GetInstance()->Stop();
+  incremental_dump_digests_.clear();
 }
 
 MemoryDumpManager::ProcessMemoryDumpAsyncState::ProcessMemoryDumpAsyncState(
     MemoryDumpRequestArgs req_args,
     const MemoryDumpProviderInfo::OrderedSet& dump_providers,
     ProcessMemoryDumpCallback callback,
-    scoped_refptr<SequencedTaskRunner> dump_thread_task_runner)
+    scoped_refptr<SequencedTaskRunner> dump_thread_task_runner,
+    bool parallel_dumps_allowed)
     : req_args(req_args),
+      num_pending_parts(1),
       callback(std::move(callback)),
       callback_task_runner(ThreadTaskRunnerHandle::Get()),
       dump_thread_task_runner(std::move(dump_thread_task_runner)) {
-  pending_dump_providers.reserve(dump_providers.size());
-  pending_dump_providers.assign(dump_providers.rbegin(), dump_providers.rend());
   MemoryDumpArgs args = {req_args.level_of_detail, req_args.determinism,
                          req_args.dump_guid};
+  pending_dump_providers.reserve(dump_providers.size());
+  for (auto it = dump_providers.rbegin(); it != dump_providers.rend(); ++it) {
+    const scoped_refptr<MemoryDumpProviderInfo>& mdpinfo = *it;
+    if (!parallel_dumps_allowed || mdpinfo->task_runner ||
+        !mdpinfo->options.supports_parallel_dumps) {
+      pending_dump_providers.push_back(mdpinfo);
+      continue;
+    }
+    // As in ContinueAsyncProcessDump(), invoke only the whitelisted providers
+    // in background mode.
+    if (req_args.level_of_detail == MemoryDumpLevelOfDetail::BACKGROUND &&
+        !mdpinfo->allowed_in_background_mode) {
+      continue;
+    }
+    parallel_dump_providers.push_back(mdpinfo);
+    parallel_process_memory_dumps.push_back(
+        std::make_unique<ProcessMemoryDump>(args));
+  }
+  if (!parallel_dump_providers.empty())
+    num_pending_parts = 2;
   process_memory_dump = std::make_unique<ProcessMemoryDump>(args);
 }
 
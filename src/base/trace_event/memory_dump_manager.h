@@ -7,6 +7,7 @@
 
 #include <stdint.h>
 
+#include <atomic>
 #include <map>
 #include <memory>
 #include <unordered_set>
@@ -109,7 +110,8 @@ class BASE_EXPORT MemoryDumpManager {
   // Also initializes the scheduler with the given config.
   void SetupForTracing(const TraceConfig::MemoryDumpConfig&);
 
-  // Tear-down tracing related state.
+  // Tear-down tracing related state, including the allocator dumps that the
+  // next incremental dumps are relative to.
   // Non-tracing modes (e.g. SUMMARY_ONLY) will continue to work.
   void TeardownForTracing();
 
@@ -157,13 +159,16 @@ class BASE_EXPORT MemoryDumpManager {
   // Holds the state of a process memory dump that needs to be carried over
   // across task runners in order to fulfill an asynchronous CreateProcessDump()
   // request. At any time exactly one task runner owns a
-  // ProcessMemoryDumpAsyncState.
+  // ProcessMemoryDumpAsyncState, except while the dump providers which support
+  // parallel dumps run: the last of the two parts of the dump to be done takes
+  // it over.
   struct ProcessMemoryDumpAsyncState {
     ProcessMemoryDumpAsyncState(
         MemoryDumpRequestArgs req_args,
         const MemoryDumpProviderInfo::OrderedSet& dump_providers,
         ProcessMemoryDumpCallback callback,
-        scoped_refptr<SequencedTaskRunner> dump_thread_task_runner);
+        scoped_refptr<SequencedTaskRunner> dump_thread_task_runner,
+        bool parallel_dumps_allowed);
     ProcessMemoryDumpAsyncState(const ProcessMemoryDumpAsyncState&) = delete;
     ProcessMemoryDumpAsyncState& operator=(const ProcessMemoryDumpAsyncState&) =
         delete;
@@ -180,6 +185,18 @@ class BASE_EXPORT MemoryDumpManager {
     // and becomes empty at the end, when all dump providers have been invoked.
     std::vector<scoped_refptr<MemoryDumpProviderInfo>> pending_dump_providers;
 
+    // The dump providers which support parallel dumps, each of which dumps
+    // into the ProcessMemoryDump at the same index on the thread pool. These
+    // are merged into |process_memory_dump| at the end.
+    std::vector<scoped_refptr<MemoryDumpProviderInfo>> parallel_dump_providers;
+    std::vector<std::unique_ptr<ProcessMemoryDump>>
+        parallel_process_memory_dumps;
+
+    // The number of parts of the dump which are not done: the invocation of
+    // the |pending_dump_providers| and, if any, of the
+    // |parallel_dump_providers|.
+    std::atomic<int> num_pending_parts;
+
     // Callback passed to the initial call to CreateProcessDump().
     ProcessMemoryDumpCallback callback;
 
@@ -220,6 +237,16 @@ class BASE_EXPORT MemoryDumpManager {
   void InvokeOnMemoryDump(MemoryDumpProviderInfo* mdpinfo,
                           ProcessMemoryDump* pmd);
 
+  // Posts the invocations of the |parallel_dump_providers| to the thread pool.
+  // OnParallelDumpsDone() is called once all of them are done.
+  void StartParallelDumps(ProcessMemoryDumpAsyncState* pmd_async_state);
+  void OnParallelDumpsDone(ProcessMemoryDumpAsyncState* owned_pmd_async_state);
+
+  // Called when a part of the dump is done. Calls FinishAsyncProcessDump() if
+  // it was the last one.
+  void CompleteProcessDumpPart(
+      std::unique_ptr<ProcessMemoryDumpAsyncState> pmd_async_state);
+
   void FinishAsyncProcessDump(
       std::unique_ptr<ProcessMemoryDumpAsyncState> pmd_async_state);
 
@@ -256,6 +283,11 @@ class BASE_EXPORT MemoryDumpManager {
   // affinity.
   std::unique_ptr<Thread> dump_thread_ GUARDED_BY(lock_);
 
+  // The digests of the allocator dumps of the last incremental dump of each
+  // level of detail, which the next one is relative to.
+  std::map<MemoryDumpLevelOfDetail, ProcessMemoryDump::AllocatorDumpDigests>
+      incremental_dump_digests_ GUARDED_BY(lock_);
+
   // The unique id of the child process. This is created only for tracing and is
   // expected to be valid only when tracing is enabled.
   uint64_t tracing_process_id_ = kInvalidTracingProcessId;
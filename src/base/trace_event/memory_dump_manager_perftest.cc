@@ -0,0 +1,209 @@
+// Copyright 2021 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "base/at_exit.h"
+#include "base/bind.h"
+#include "base/callback.h"
+#include "base/run_loop.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/test/task_environment.h"
+#include "base/timer/elapsed_timer.h"
+#include "base/trace_event/memory_allocator_dump.h"
+#include "base/trace_event/memory_dump_manager.h"
+#include "base/trace_event/memory_dump_manager_test_utils.h"
+#include "base/trace_event/memory_dump_provider.h"
+#include "base/trace_event/memory_dump_request_args.h"
+#include "base/trace_event/process_memory_dump.h"
+#include "base/trace_event/trace_log.h"
+#include "base/trace_event/traced_value.h"
+#include "testing/gtest/include/gtest/gtest.h"
+#include "testing/perf/perf_result_reporter.h"
+
+// This file measures the time it takes to dump many memory dump providers, one
+// after the other or in parallel on the thread pool, and the size of the full
+// and incremental dumps they produce.
+
+namespace base {
+namespace trace_event {
+
+namespace {
+
+constexpr char kMetricPrefixMemoryDump[] = "MemoryDump.";
+constexpr char kMetricDumpTime[] = "dump_time";
+constexpr char kMetricDumpSize[] = "dump_size";
+constexpr int kNumProviders = 64;
+constexpr int kDumpsPerProvider = 32;
+constexpr int kNumDumps = 20;
+
+// One allocator dump in |kChangedOneIn| changes between two dumps.
+constexpr int kChangedOneIn = 10;
+
+// The number of heap entries which a provider walks to compute its dumps.
+constexpr size_t kHeapEntries = 50000;
+
+perf_test::PerfResultReporter SetUpReporter(const std::string& story_name) {
+  perf_test::PerfResultReporter reporter(kMetricPrefixMemoryDump, story_name);
+  reporter.RegisterImportantMetric(kMetricDumpTime, "us");
+  reporter.RegisterImportantMetric(kMetricDumpSize, "bytes");
+  return reporter;
+}
+
+// Walks a fake heap, like the providers of the allocators do, and reports its
+// sizes in |kDumpsPerProvider| allocator dumps, some of which change at each
+// dump.
+class HeapDumpProvider : public MemoryDumpProvider {
+ public:
+  explicit HeapDumpProvider(int id)
+      : name_prefix_("provider_" + NumberToString(id) + "/heap_"),
+        heap_(kHeapEntries, id) {}
+
+  bool OnMemoryDump(const MemoryDumpArgs& args,
+                    ProcessMemoryDump* pmd) override {
+    uint64_t total = 0;
+    for (uint32_t entry : heap_)
+      total += entry;
+    ++num_dumps_;
+    for (int i = 0; i < kDumpsPerProvider; ++i) {
+      MemoryAllocatorDump* dump =
+          pmd->CreateAllocatorDump(name_prefix_ + NumberToString(i));
+      uint64_t size = total + i;
+      if (i % kChangedOneIn == 0)
+        size += num_dumps_;
+      dump->AddScalar(MemoryAllocatorDump::kNameSize,
+                      MemoryAllocatorDump::kUnitsBytes, size);
+      dump->AddScalar(MemoryAllocatorDump::kNameObjectCount,
+                      MemoryAllocatorDump::kUnitsObjects, kHeapEntries);
+    }
+    return true;
+  }
+
+ private:
+  const std::string name_prefix_;
+  const std::vector<uint32_t> heap_;
+  uint64_t num_dumps_ = 0;
+};
+
+class MemoryDumpManagerPerfTest : public testing::Test {
+ public:
+  void SetUp() override {
+    mdm_ = MemoryDumpManager::CreateInstanceForTesting();
+    InitializeMemoryDumpManagerForInProcessTesting(false);
+    task_environment_ = std::make_unique<test::TaskEnvironment>();
+  }
+
+  void TearDown() override {
+    task_environment_.reset();
+    mdm_.reset();
+    TraceLog::ResetForTesting();
+  }
+
+  void RegisterProviders(bool parallel) {
+    MemoryDumpProvider::Options options;
+    options.supports_parallel_dumps = parallel;
+    mdm_->set_dumper_registrations_ignored_for_testing(false);
+    for (int i = 0; i < kNumProviders; ++i) {
+      mdps_.push_back(std::make_unique<HeapDumpProvider>(i));
+      mdm_->RegisterDumpProvider(mdps_.back().get(), "HeapDumpProvider",
+                                 nullptr, options);
+    }
+    mdm_->set_dumper_registrations_ignored_for_testing(true);
+  }
+
+  void UnregisterProviders() {
+    while (!mdps_.empty()) {
+      mdm_->UnregisterAndDeleteDumpProviderSoon(std::move(mdps_.back()));
+      mdps_.pop_back();
+    }
+  }
+
+  // Returns the dump, and adds the time it took to |dump_time|.
+  std::unique_ptr<ProcessMemoryDump> RequestProcessDump(bool incremental,
+                                                        TimeDelta* dump_time) {
+    RunLoop run_loop;
+    std::unique_ptr<ProcessMemoryDump> result;
+    MemoryDumpRequestArgs request_args{1, MemoryDumpType::EXPLICITLY_TRIGGERED,
+                                       MemoryDumpLevelOfDetail::DETAILED,
+                                       MemoryDumpDeterminism::NONE};
+    request_args.incremental = incremental;
+    ElapsedTimer timer;
+    mdm_->CreateProcessDump(
+        request_args,
+        BindOnce(
+            [](std::unique_ptr<ProcessMemoryDump>* curried_result,
+               OnceClosure curried_quit_closure, bool success,
+               uint64_t dump_guid, std::unique_ptr<ProcessMemoryDump> pmd) {
+              *curried_result = std::move(pmd);
+              std::move(curried_quit_closure).Run();
+            },
+            Unretained(&result), run_loop.QuitClosure()));
+    run_loop.Run();
+    *dump_time += timer.Elapsed();
+    return result;
+  }
+
+  void RunDumpTest(const std::string& story_name,
+                   bool parallel,
+                   bool incremental) {
+    RegisterProviders(parallel);
+    mdm_->SetupForTracing(TraceConfig::MemoryDumpConfig());
+
+    TimeDelta dump_time;
+    size_t dump_size = 0;
+    for (int i = 0; i < kNumDumps; ++i) {
+      std::unique_ptr<ProcessMemoryDump> pmd =
+          RequestProcessDump(incremental, &dump_time);
+      ASSERT_TRUE(pmd);
+      TracedValue traced_value;
+      pmd->SerializeAllocatorDumpsInto(&traced_value);
+      std::string json;
+      traced_value.AppendAsTraceFormat(&json);
+      dump_size += json.size();
+    }
+
+    mdm_->TeardownForTracing();
+    UnregisterProviders();
+
+    auto reporter = SetUpReporter(story_name);
+    reporter.AddResult(kMetricDumpTime,
+                       dump_time.InMicrosecondsF() / kNumDumps);
+    reporter.AddResult(kMetricDumpSize, dump_size / kNumDumps);
+  }
+
+ private:
+  // To tear down the singleton instance after each test.
+  ShadowingAtExitManager at_exit_manager_;
+
+  std::unique_ptr<MemoryDumpManager> mdm_;
+  std::unique_ptr<test::TaskEnvironment> task_environment_;
+  std::vector<std::unique_ptr<HeapDumpProvider>> mdps_;
+};
+
+}  // namespace
+
+TEST_F(MemoryDumpManagerPerfTest, Sequential) {
+  RunDumpTest("Sequential", false /* parallel */, false /* incremental */);
+}
+
+TEST_F(MemoryDumpManagerPerfTest, Parallel) {
+  RunDumpTest("Parallel", true /* parallel */, false /* incremental */);
+}
+
+TEST_F(MemoryDumpManagerPerfTest, Incremental) {
+  RunDumpTest("Incremental", false /* parallel */, true /* incremental */);
+}
+
+TEST_F(MemoryDumpManagerPerfTest, ParallelIncremental) {
+  RunDumpTest("ParallelIncremental", true /* parallel */,
+              true /* incremental */);
+}
+
+}  // namespace trace_event
+}  // namespace base
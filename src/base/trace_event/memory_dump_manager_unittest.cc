@@ -7,6 +7,7 @@
 #include <stdint.h>
 
 #include <memory>
+#include <string>
 #include <utility>
 #include <vector>
 
@@ -17,6 +18,7 @@
 #include "base/command_line.h"
 #include "base/macros.h"
 #include "base/run_loop.h"
+#include "base/strings/string_number_conversions.h"
 #include "base/synchronization/waitable_event.h"
 #include "base/task/post_task.h"
 #include "base/task/single_thread_task_runner.h"
@@ -239,6 +241,32 @@ class MemoryDumpManagerTest : public testing::Test {
     return success;
   }
 
+  // Like RequestProcessDumpAndWait(), returning the dump, or null if it
+  // failed.
+  std::unique_ptr<ProcessMemoryDump> RequestProcessDumpAndGetResult(
+      MemoryDumpLevelOfDetail level_of_detail,
+      bool incremental) {
+    RunLoop run_loop;
+    std::unique_ptr<ProcessMemoryDump> result;
+    MemoryDumpRequestArgs request_args{
+        1, MemoryDumpType::EXPLICITLY_TRIGGERED, level_of_detail,
+        MemoryDumpDeterminism::NONE};
+    request_args.incremental = incremental;
+    mdm_->CreateProcessDump(
+        request_args,
+        BindOnce(
+            [](std::unique_ptr<ProcessMemoryDump>* curried_result,
+               OnceClosure curried_quit_closure, bool success,
+               uint64_t dump_guid, std::unique_ptr<ProcessMemoryDump> pmd) {
+              if (success)
+                *curried_result = std::move(pmd);
+              std::move(curried_quit_closure).Run();
+            },
+            Unretained(&result), run_loop.QuitClosure()));
+    run_loop.Run();
+    return result;
+  }
+
   void EnableForTracing() {
     mdm_->SetupForTracing(TraceConfig::MemoryDumpConfig());
   }
@@ -836,6 +864,131 @@ TEST_F(MemoryDumpManagerTest, UnregisterAndDeleteDumpProviderSoonDuringDump) {
   DisableTracing();
 }
 
+// Dump provider which creates an allocator dump of the given name and size.
+class AllocatorDumpProvider : public MemoryDumpProvider {
+ public:
+  explicit AllocatorDumpProvider(std::string name) : name_(std::move(name)) {}
+
+  void set_size(uint64_t size) { size_ = size; }
+  int num_dump_calls() const { return num_dump_calls_; }
+  bool dumped_on_thread(PlatformThreadRef thread_ref) const {
+    return thread_ref_ == thread_ref;
+  }
+
+  bool OnMemoryDump(const MemoryDumpArgs& args,
+                    ProcessMemoryDump* pmd) override {
+    ++num_dump_calls_;
+    thread_ref_ = PlatformThread::CurrentRef();
+    pmd->CreateAllocatorDump(name_)->AddScalar(
+        MemoryAllocatorDump::kNameSize, MemoryAllocatorDump::kUnitsBytes,
+        size_);
+    return true;
+  }
+
+ private:
+  const std::string name_;
+  uint64_t size_ = 0;
+  int num_dump_calls_ = 0;
+  PlatformThreadRef thread_ref_;
+};
+
+// Checks that the providers which support parallel dumps are dumped on the
+// thread pool, along with the other ones.
+TEST_F(MemoryDumpManagerTest, ParallelDumps) {
+  SetDumpProviderAllowlistForTesting(kTestMDPWhitelist);
+  MemoryDumpProvider::Options options;
+  options.supports_parallel_dumps = true;
+
+  std::vector<std::unique_ptr<AllocatorDumpProvider>> mdps;
+  for (int i = 0; i < 8; ++i) {
+    mdps.push_back(std::make_unique<AllocatorDumpProvider>(
+        "parallel/" + NumberToString(i)));
+    RegisterDumpProvider(mdps.back().get(), nullptr, options,
+                         i % 2 ? kWhitelistedMDPName : kMDPName);
+  }
+  AllocatorDumpProvider thread_bound_mdp("thread_bound");
+  RegisterDumpProvider(&thread_bound_mdp, ThreadTaskRunnerHandle::Get());
+  AllocatorDumpProvider unbound_mdp("unbound");
+  RegisterDumpProvider(&unbound_mdp, nullptr);
+
+  EnableForTracing();
+  std::unique_ptr<ProcessMemoryDump> pmd = RequestProcessDumpAndGetResult(
+      MemoryDumpLevelOfDetail::DETAILED, false /* incremental */);
+  ASSERT_TRUE(pmd);
+  EXPECT_EQ(10u, pmd->allocator_dumps().size());
+  EXPECT_EQ(1u, pmd->allocator_dumps().count("thread_bound"));
+  EXPECT_EQ(1u, pmd->allocator_dumps().count("unbound"));
+  for (const auto& mdp : mdps) {
+    EXPECT_EQ(1, mdp->num_dump_calls());
+    EXPECT_FALSE(mdp->dumped_on_thread(PlatformThread::CurrentRef()));
+  }
+
+  // Only the whitelisted providers are dumped in background mode.
+  EXPECT_TRUE(RequestProcessDumpAndWait(MemoryDumpType::SUMMARY_ONLY,
+                                        MemoryDumpLevelOfDetail::BACKGROUND,
+                                        MemoryDumpDeterminism::NONE));
+  for (size_t i = 0; i < mdps.size(); ++i)
+    EXPECT_EQ(i % 2 ? 2 : 1, mdps[i]->num_dump_calls());
+  DisableTracing();
+
+  while (!mdps.empty()) {
+    mdm_->UnregisterAndDeleteDumpProviderSoon(std::move(mdps.back()));
+    mdps.pop_back();
+  }
+  mdm_->UnregisterDumpProvider(&thread_bound_mdp);
+}
+
+// Checks that incremental dumps only hold the allocator dumps which changed
+// since the previous one, in the same tracing session.
+TEST_F(MemoryDumpManagerTest, IncrementalDumps) {
+  AllocatorDumpProvider mdp1("mdp1");
+  AllocatorDumpProvider mdp2("mdp2");
+  RegisterDumpProvider(&mdp1, ThreadTaskRunnerHandle::Get());
+  RegisterDumpProvider(&mdp2, ThreadTaskRunnerHandle::Get());
+
+  EnableForTracing();
+  std::unique_ptr<ProcessMemoryDump> pmd = RequestProcessDumpAndGetResult(
+      MemoryDumpLevelOfDetail::DETAILED, true /* incremental */);
+  ASSERT_TRUE(pmd);
+  EXPECT_EQ(2u, pmd->allocator_dumps().size());
+
+  pmd = RequestProcessDumpAndGetResult(MemoryDumpLevelOfDetail::DETAILED,
+                                       true /* incremental */);
+  ASSERT_TRUE(pmd);
+  EXPECT_TRUE(pmd->allocator_dumps().empty());
+
+  // The other levels of detail and the full dumps are independent.
+  pmd = RequestProcessDumpAndGetResult(MemoryDumpLevelOfDetail::LIGHT,
+                                       true /* incremental */);
+  ASSERT_TRUE(pmd);
+  EXPECT_EQ(2u, pmd->allocator_dumps().size());
+  pmd = RequestProcessDumpAndGetResult(MemoryDumpLevelOfDetail::DETAILED,
+                                       false /* incremental */);
+  ASSERT_TRUE(pmd);
+  EXPECT_EQ(2u, pmd->allocator_dumps().size());
+
+  mdp1.set_size(42);
+  mdm_->UnregisterDumpProvider(&mdp2);
+  pmd = RequestProcessDumpAndGetResult(MemoryDumpLevelOfDetail::DETAILED,
+                                       true /* incremental */);
+  ASSERT_TRUE(pmd);
+  EXPECT_EQ(1u, pmd->allocator_dumps().size());
+  EXPECT_EQ(42u, pmd->GetAllocatorDump("mdp1")->GetSizeInternal());
+  EXPECT_EQ(std::vector<std::string>{"mdp2"},
+            pmd->removed_allocator_dump_names());
+  DisableTracing();
+
+  // A new tracing session starts with a full dump.
+  EnableForTracing();
+  pmd = RequestProcessDumpAndGetResult(MemoryDumpLevelOfDetail::DETAILED,
+                                       true /* incremental */);
+  ASSERT_TRUE(pmd);
+  EXPECT_EQ(1u, pmd->allocator_dumps().size());
+  DisableTracing();
+
+  mdm_->UnregisterDumpProvider(&mdp1);
+}
+
 // Mock MDP class that tests if the number of OnMemoryDump() calls are expected.
 // It is implemented without gmocks since EXPECT_CALL implementation is slow
 // when there are 1000s of instances, as required in
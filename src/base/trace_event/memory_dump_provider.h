@@ -19,12 +19,21 @@ class BASE_EXPORT MemoryDumpProvider {
  public:
   // Optional arguments for MemoryDumpManager::RegisterDumpProvider().
   struct Options {
-    Options() : dumps_on_single_thread_task_runner(false) {}
+    Options()
+        : dumps_on_single_thread_task_runner(false),
+          supports_parallel_dumps(false) {}
 
     // |dumps_on_single_thread_task_runner| is true if the dump provider runs on
     // a SingleThreadTaskRunner, which is usually the case. It is faster to run
     // all providers that run on the same thread together without thread hops.
     bool dumps_on_single_thread_task_runner;
+
+    // |supports_parallel_dumps| is true if OnMemoryDump() can be called on any
+    // thread, concurrently with the other dump providers and with itself. Such
+    // providers are dumped in parallel on the thread pool instead of one after
+    // the other on the MemoryDumpManager thread. Only for providers registered
+    // without a task runner.
+    bool supports_parallel_dumps;
   };
 
   MemoryDumpProvider(const MemoryDumpProvider&) = delete;
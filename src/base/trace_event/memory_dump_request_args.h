@@ -74,6 +74,11 @@ struct BASE_EXPORT MemoryDumpRequestArgs {
   MemoryDumpType dump_type;
   MemoryDumpLevelOfDetail level_of_detail;
   MemoryDumpDeterminism determinism;
+
+  // If true, the dump only holds the allocator dumps which changed since the
+  // previous incremental dump with the same level of detail in this tracing
+  // session. See ProcessMemoryDump::RemoveAllocatorDumpsUnchangedSince().
+  bool incremental = false;
 };
 
 // Args for ProcessMemoryDump and passed to OnMemoryDump calls for memory dump
@@ -9,6 +9,7 @@
 #include <memory>
 #include <vector>
 
+#include "base/hash/hash.h"
 #include "base/logging.h"
 #include "base/memory/page_size.h"
 #include "base/memory/ptr_util.h"
@@ -65,6 +66,19 @@ UnguessableToken GetTokenForCurrentProcess() {
   return instance;
 }
 
+size_t GetAllocatorDumpDigest(const MemoryAllocatorDump& dump) {
+  size_t digest = HashInts(dump.guid().ToUint64(), dump.flags());
+  for (const MemoryAllocatorDump::Entry& entry : dump.entries()) {
+    digest = HashInts(digest, FastHash(entry.name));
+    digest = HashInts(digest, FastHash(entry.units));
+    if (entry.entry_type == MemoryAllocatorDump::Entry::kUint64)
+      digest = HashInts(digest, entry.value_uint64);
+    else
+      digest = HashInts(digest, ~FastHash(entry.value_string));
+  }
+  return digest;
+}
+
 }  // namespace
 
 // static
@@ -361,6 +375,7 @@ void ProcessMemoryDump::SetAllEdgesForSerialization(
 void ProcessMemoryDump::Clear() {
   allocator_dumps_.clear();
   allocator_dumps_edges_.clear();
+  removed_allocator_dump_names_.clear();
 }
 
 void ProcessMemoryDump::TakeAllDumpsFrom(ProcessMemoryDump* other) {
@@ -374,6 +389,36 @@ void ProcessMemoryDump::TakeAllDumpsFrom(ProcessMemoryDump* other) {
   allocator_dumps_edges_.insert(other->allocator_dumps_edges_.begin(),
                                 other->allocator_dumps_edges_.end());
   other->allocator_dumps_edges_.clear();
+
+  removed_allocator_dump_names_.insert(
+      removed_allocator_dump_names_.end(),
+      other->removed_allocator_dump_names_.begin(),
+      other->removed_allocator_dump_names_.end());
+  other->removed_allocator_dump_names_.clear();
+}
+
+void ProcessMemoryDump::RemoveAllocatorDumpsUnchangedSince(
+    AllocatorDumpDigests* previous_digests) {
+  AllocatorDumpDigests digests;
+  for (auto it = allocator_dumps_.begin(); it != allocator_dumps_.end();) {
+    const size_t digest = GetAllocatorDumpDigest(*it->second);
+    digests.emplace_hint(digests.end(), it->first, digest);
+    auto previous_it = previous_digests->find(it->first);
+    bool unchanged = false;
+    if (previous_it != previous_digests->end()) {
+      unchanged = previous_it->second == digest;
+      previous_digests->erase(previous_it);
+    }
+    if (unchanged)
+      it = allocator_dumps_.erase(it);
+    else
+      ++it;
+  }
+
+  // The dumps left are not in this dump.
+  for (const auto& it : *previous_digests)
+    removed_allocator_dump_names_.push_back(it.first);
+  *previous_digests = std::move(digests);
 }
 
 void ProcessMemoryDump::SerializeAllocatorDumpsInto(TracedValue* value) const {
@@ -384,6 +429,13 @@ void ProcessMemoryDump::SerializeAllocatorDumpsInto(TracedValue* value) const {
     value->EndDictionary();
   }
 
+  if (!removed_allocator_dump_names_.empty()) {
+    value->BeginArray("removed_allocators");
+    for (const std::string& name : removed_allocator_dump_names_)
+      value->AppendString(name);
+    value->EndArray();
+  }
+
   value->BeginArray("allocators_graph");
   for (const auto& it : allocator_dumps_edges_) {
     const MemoryAllocatorDumpEdge& edge = it.second;
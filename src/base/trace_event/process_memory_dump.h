@@ -68,6 +68,11 @@ class BASE_EXPORT ProcessMemoryDump {
   using AllocatorDumpEdgesMap =
       std::map<MemoryAllocatorDumpGuid, MemoryAllocatorDumpEdge>;
 
+  // Maps allocator dumps absolute names to a digest of their guid, flags and
+  // entries, which tells RemoveAllocatorDumpsUnchangedSince() whether they
+  // changed since a previous dump.
+  using AllocatorDumpDigests = std::map<std::string, size_t>;
+
 #if defined(COUNT_RESIDENT_BYTES_SUPPORTED)
   // Returns the number of bytes in a kernel memory page. Some platforms may
   // have a different value for kernel page sizes from user page sizes. It is
@@ -236,6 +241,21 @@ class BASE_EXPORT ProcessMemoryDump {
   // of the MemoryDumpProvider::OnMemoryDump(ProcessMemoryDump*) callback.
   void TakeAllDumpsFrom(ProcessMemoryDump* other);
 
+  // Turns this dump into an incremental one, relative to the dump summarized
+  // by |previous_digests|: removes the MemoryAllocatorDump(s) which are the
+  // same as in that dump, and lists the ones which are not there any more in
+  // removed_allocator_dump_names(). The edges are all kept, as they can refer
+  // to unchanged dumps. Then replaces |previous_digests| with the digests of
+  // all the MemoryAllocatorDump(s) of this dump, for the next one.
+  void RemoveAllocatorDumpsUnchangedSince(
+      AllocatorDumpDigests* previous_digests);
+
+  // Returns the absolute names of the MemoryAllocatorDump(s) of the previous
+  // dump which are gone in this incremental dump.
+  const std::vector<std::string>& removed_allocator_dump_names() const {
+    return removed_allocator_dump_names_;
+  }
+
   // Populate the traced value with information about the memory allocator
   // dumps.
   void SerializeAllocatorDumpsInto(TracedValue* value) const;
@@ -281,6 +301,9 @@ class BASE_EXPORT ProcessMemoryDump {
   // Keeps track of relationships between MemoryAllocatorDump(s).
   AllocatorDumpEdgesMap allocator_dumps_edges_;
 
+  // See RemoveAllocatorDumpsUnchangedSince().
+  std::vector<std::string> removed_allocator_dump_names_;
+
   // Level of detail of the current dump.
   MemoryDumpArgs dump_args_;
 
@@ -215,6 +215,65 @@ TEST(ProcessMemoryDumpTest, TakeAllDumpsFrom) {
   pmd1.reset();
 }
 
+TEST(ProcessMemoryDumpTest, RemoveAllocatorDumpsUnchangedSince) {
+  ProcessMemoryDump::AllocatorDumpDigests digests;
+
+  // The first incremental dump has all the dumps.
+  ProcessMemoryDump pmd1(kDetailedDumpArgs);
+  pmd1.CreateAllocatorDump("mad1")->AddScalar("size", "bytes", 1);
+  pmd1.CreateAllocatorDump("mad2")->AddScalar("size", "bytes", 2);
+  pmd1.CreateAllocatorDump("mad3")->AddString("name", "", "foo");
+  pmd1.CreateAllocatorDump("mad4");
+  pmd1.RemoveAllocatorDumpsUnchangedSince(&digests);
+  EXPECT_EQ(4u, pmd1.allocator_dumps().size());
+  EXPECT_TRUE(pmd1.removed_allocator_dump_names().empty());
+  EXPECT_EQ(4u, digests.size());
+
+  // Nothing changed.
+  ProcessMemoryDump pmd2(kDetailedDumpArgs);
+  auto* mad1 = pmd2.CreateAllocatorDump("mad1");
+  mad1->AddScalar("size", "bytes", 1);
+  auto* mad2 = pmd2.CreateAllocatorDump("mad2");
+  mad2->AddScalar("size", "bytes", 2);
+  pmd2.CreateAllocatorDump("mad3")->AddString("name", "", "foo");
+  pmd2.CreateAllocatorDump("mad4");
+  pmd2.AddOwnershipEdge(mad1->guid(), mad2->guid());
+  pmd2.RemoveAllocatorDumpsUnchangedSince(&digests);
+  EXPECT_TRUE(pmd2.allocator_dumps().empty());
+  EXPECT_TRUE(pmd2.removed_allocator_dump_names().empty());
+  // The edges are kept.
+  EXPECT_EQ(1u, pmd2.allocator_dumps_edges().size());
+
+  // A scalar, a string and the flags of three of the dumps changed, one is
+  // gone and one is new.
+  ProcessMemoryDump pmd3(kDetailedDumpArgs);
+  pmd3.CreateAllocatorDump("mad1")->AddScalar("size", "bytes", 10);
+  pmd3.CreateAllocatorDump("mad3")->AddString("name", "", "bar");
+  pmd3.CreateAllocatorDump("mad4")->set_flags(MemoryAllocatorDump::WEAK);
+  pmd3.CreateAllocatorDump("mad5");
+  pmd3.RemoveAllocatorDumpsUnchangedSince(&digests);
+  EXPECT_EQ(4u, pmd3.allocator_dumps().size());
+  EXPECT_EQ(1u, pmd3.allocator_dumps().count("mad1"));
+  EXPECT_EQ(1u, pmd3.allocator_dumps().count("mad3"));
+  EXPECT_EQ(1u, pmd3.allocator_dumps().count("mad4"));
+  EXPECT_EQ(1u, pmd3.allocator_dumps().count("mad5"));
+  ASSERT_EQ(1u, pmd3.removed_allocator_dump_names().size());
+  EXPECT_EQ("mad2", pmd3.removed_allocator_dump_names()[0]);
+  EXPECT_EQ(4u, digests.size());
+
+  // Check that calling serialization routines doesn't cause a crash.
+  auto traced_value = std::make_unique<TracedValue>();
+  pmd3.SerializeAllocatorDumpsInto(traced_value.get());
+
+  // The removed dumps are merged and cleared like the others.
+  ProcessMemoryDump pmd4(kDetailedDumpArgs);
+  pmd4.TakeAllDumpsFrom(&pmd3);
+  EXPECT_TRUE(pmd3.removed_allocator_dump_names().empty());
+  EXPECT_EQ(1u, pmd4.removed_allocator_dump_names().size());
+  pmd4.Clear();
+  EXPECT_TRUE(pmd4.removed_allocator_dump_names().empty());
+}
+
 TEST(ProcessMemoryDumpTest, OverrideOwnershipEdge) {
   std::unique_ptr<ProcessMemoryDump> pmd(
       new ProcessMemoryDump(kDetailedDumpArgs));
@@ -4,12 +4,15 @@
 
 #include "base/trace_event/trace_buffer.h"
 
+#include <atomic>
 #include <memory>
 #include <utility>
 #include <vector>
 
 #include "base/bind.h"
+#include "base/bits.h"
 #include "base/macros.h"
+#include "base/threading/platform_thread.h"
 #include "base/trace_event/heap_profiler.h"
 #include "base/trace_event/trace_event_impl.h"
 
@@ -18,139 +21,276 @@ namespace trace_event {
 
 namespace {
 
+// A ring of chunks whose GetChunk() and ReturnChunk() can be called from any
+// thread at once, without TraceLog's lock, so that threads recycling chunks in
+// RECORD_CONTINUOUSLY mode don't serialize on it.
+//
+// The indices of the returned chunks, oldest first, are kept in a bounded
+// multi-producer multi-consumer queue (Dmitry Vyukov's), where the atomic
+// sequence number of each cell tells whether it can be written or read at a
+// given position. Each chunk lives in a slot of |chunks_|, which is empty
+// while the chunk is in flight. GetEventByHandle() pins the slot of the event,
+// under TraceLog's lock, so that its chunk isn't recycled before
+// ReleaseEventByHandle(); GetChunk() puts pinned chunks back in the queue.
 class TraceBufferRingBuffer : public TraceBuffer {
  public:
   TraceBufferRingBuffer(size_t max_chunks)
       : max_chunks_(max_chunks),
-        recyclable_chunks_queue_(new size_t[queue_capacity()]),
-        queue_head_(0),
-        queue_tail_(max_chunks),
-        current_iteration_index_(0),
-        current_chunk_seq_(1) {
-    chunks_.reserve(max_chunks);
+        chunks_(new std::atomic<uintptr_t>[max_chunks]),
+        queue_mask_((size_t{1} << bits::Log2Ceiling(
+                         static_cast<uint32_t>(max_chunks))) -
+                    1),
+        queue_(new Cell[queue_mask_ + 1]) {
+    DCHECK_GT(max_chunks, 0u);
+    DCHECK_LE(max_chunks, TraceBufferChunk::kMaxChunkIndex + 1);
+    for (size_t i = 0; i < max_chunks; ++i)
+      chunks_[i].store(0, std::memory_order_relaxed);
+    for (size_t i = 0; i <= queue_mask_; ++i)
+      queue_[i].sequence.store(i, std::memory_order_relaxed);
     for (size_t i = 0; i < max_chunks; ++i)
-      recyclable_chunks_queue_[i] = i;
+      Enqueue(i);
   }
 
   TraceBufferRingBuffer(const TraceBufferRingBuffer&) = delete;
   TraceBufferRingBuffer& operator=(const TraceBufferRingBuffer&) = delete;
 
+  ~TraceBufferRingBuffer() override {
+    for (size_t i = 0; i < max_chunks_; ++i)
+      delete GetChunkFromSlot(chunks_[i].load(std::memory_order_acquire));
+  }
+
   std::unique_ptr<TraceBufferChunk> GetChunk(size_t* index) override {
     HEAP_PROFILER_SCOPED_IGNORE;
 
-    // Because the number of threads is much less than the number of chunks,
-    // the queue should never be empty.
-    DCHECK(!QueueIsEmpty());
-
-    *index = recyclable_chunks_queue_[queue_head_];
-    queue_head_ = NextQueueIndex(queue_head_);
-    current_iteration_index_ = queue_head_;
-
-    if (*index >= chunks_.size())
-      chunks_.resize(*index + 1);
-
-    TraceBufferChunk* chunk = chunks_[*index].release();
-    chunks_[*index] = nullptr;  // Put nullptr in the slot of a in-flight chunk.
-    if (chunk)
-      chunk->Reset(current_chunk_seq_++);
-    else
-      chunk = new TraceBufferChunk(current_chunk_seq_++);
-
-    return std::unique_ptr<TraceBufferChunk>(chunk);
+    for (size_t attempt = 0; attempt < max_chunks_; ++attempt) {
+      // Because the number of threads is much less than the number of chunks,
+      // the queue should never be empty.
+      size_t chunk_index;
+      if (!Dequeue(&chunk_index))
+        break;
+
+      std::atomic<uintptr_t>& slot = chunks_[chunk_index];
+      uintptr_t value = slot.load(std::memory_order_acquire);
+      while (!(value & kPinned) &&
+             !slot.compare_exchange_weak(value, 0, std::memory_order_acquire,
+                                         std::memory_order_acquire)) {
+      }
+      if (value & kPinned) {
+        // The chunk is being read, so it becomes the newest one instead.
+        Enqueue(chunk_index);
+        continue;
+      }
+
+      *index = chunk_index;
+      TraceBufferChunk* chunk = GetChunkFromSlot(value);
+      if (chunk) {
+        chunk->Reset(NextChunkSeq());
+      } else {
+        chunk = new TraceBufferChunk(NextChunkSeq());
+        allocated_chunk_count_.fetch_add(1, std::memory_order_relaxed);
+      }
+      return std::unique_ptr<TraceBufferChunk>(chunk);
+    }
+    NOTREACHED() << "No chunk to recycle";
+    return nullptr;
   }
 
   void ReturnChunk(size_t index,
                    std::unique_ptr<TraceBufferChunk> chunk) override {
-    // When this method is called, the queue should not be full because it
-    // can contain all chunks including the one to be returned.
-    DCHECK(!QueueIsFull());
     DCHECK(chunk);
-    DCHECK_LT(index, chunks_.size());
-    DCHECK(!chunks_[index]);
-    chunks_[index] = std::move(chunk);
-    recyclable_chunks_queue_[queue_tail_] = index;
-    queue_tail_ = NextQueueIndex(queue_tail_);
+    DCHECK_LT(index, max_chunks_);
+    DCHECK(!chunks_[index].load(std::memory_order_relaxed));
+    chunks_[index].store(reinterpret_cast<uintptr_t>(chunk.release()),
+                         std::memory_order_release);
+    Enqueue(index);
   }
 
   bool IsFull() const override { return false; }
 
   size_t Size() const override {
     // This is approximate because not all of the chunks are full.
-    return chunks_.size() * TraceBufferChunk::kTraceBufferChunkSize;
+    return allocated_chunk_count_.load(std::memory_order_relaxed) *
+           TraceBufferChunk::kTraceBufferChunkSize;
   }
 
   size_t Capacity() const override {
     return max_chunks_ * TraceBufferChunk::kTraceBufferChunkSize;
   }
 
+  bool IsLockFree() const override { return true; }
+
   TraceEvent* GetEventByHandle(TraceEventHandle handle) override {
-    if (handle.chunk_index >= chunks_.size())
+    if (handle.chunk_index >= max_chunks_)
       return nullptr;
-    TraceBufferChunk* chunk = chunks_[handle.chunk_index].get();
-    if (!chunk || chunk->seq() != handle.chunk_seq)
+    std::atomic<uintptr_t>& slot = chunks_[handle.chunk_index];
+    uintptr_t value = slot.load(std::memory_order_acquire);
+    do {
+      // The chunk is in flight, or pinned by an event which wasn't released.
+      if (!value || (value & kPinned))
+        return nullptr;
+    } while (!slot.compare_exchange_weak(value, value | kPinned,
+                                         std::memory_order_acquire,
+                                         std::memory_order_acquire));
+    TraceBufferChunk* chunk = GetChunkFromSlot(value);
+    if (chunk->seq() != handle.chunk_seq) {
+      slot.store(value, std::memory_order_release);
       return nullptr;
+    }
     return chunk->GetEventAt(handle.event_index);
   }
 
+  void ReleaseEventByHandle(TraceEventHandle handle) override {
+    if (handle.chunk_index >= max_chunks_)
+      return;
+    std::atomic<uintptr_t>& slot = chunks_[handle.chunk_index];
+    const uintptr_t value = slot.load(std::memory_order_relaxed);
+    if ((value & kPinned) &&
+        GetChunkFromSlot(value)->seq() == handle.chunk_seq) {
+      slot.store(value & ~kPinned, std::memory_order_release);
+    }
+  }
+
+  // Must not be called while chunks are recycled: TraceLog iterates the
+  // buffer once the threads have returned their chunks. Waits for the chunks
+  // being returned, if any, so that the iteration sees a consistent snapshot
+  // of the queue.
   const TraceBufferChunk* NextChunk() override {
-    if (chunks_.empty())
+    if (!allocated_chunk_count_.load(std::memory_order_relaxed))
       return nullptr;
 
-    while (current_iteration_index_ != queue_tail_) {
-      size_t chunk_index = recyclable_chunks_queue_[current_iteration_index_];
-      current_iteration_index_ = NextQueueIndex(current_iteration_index_);
-      if (chunk_index >= chunks_.size())  // Skip uninitialized chunks.
+    if (!iteration_started_) {
+      iteration_started_ = true;
+      iteration_position_ = queue_head_.load(std::memory_order_acquire);
+      iteration_end_ = queue_tail_.load(std::memory_order_acquire);
+    }
+    while (iteration_position_ != iteration_end_) {
+      const Cell& cell = queue_[iteration_position_ & queue_mask_];
+      size_t sequence;
+      while ((sequence = cell.sequence.load(std::memory_order_acquire)) ==
+             iteration_position_) {
+        PlatformThread::YieldCurrentThread();
+      }
+      const size_t chunk_index = cell.chunk_index;
+      ++iteration_position_;
+      if (sequence != iteration_position_)  // Already dequeued.
         continue;
-      DCHECK(chunks_[chunk_index]);
-      return chunks_[chunk_index].get();
+      // Skip uninitialized chunks.
+      const uintptr_t value =
+          chunks_[chunk_index].load(std::memory_order_acquire);
+      if (value)
+        return GetChunkFromSlot(value);
     }
     return nullptr;
   }
 
   void EstimateTraceMemoryOverhead(
       TraceEventMemoryOverhead* overhead) override {
-    overhead->Add(TraceEventMemoryOverhead::kTraceBuffer, sizeof(*this));
-    for (size_t queue_index = queue_head_; queue_index != queue_tail_;
-         queue_index = NextQueueIndex(queue_index)) {
-      size_t chunk_index = recyclable_chunks_queue_[queue_index];
-      if (chunk_index >= chunks_.size())  // Skip uninitialized chunks.
+    overhead->Add(TraceEventMemoryOverhead::kTraceBuffer,
+                  sizeof(*this) + max_chunks_ * sizeof(chunks_[0]) +
+                      (queue_mask_ + 1) * sizeof(Cell));
+    for (size_t i = 0; i < max_chunks_; ++i) {
+      // Pins the chunk like GetEventByHandle(). The in-flight chunks are
+      // accounted by TraceLog::OnMemoryDump().
+      std::atomic<uintptr_t>& slot = chunks_[i];
+      uintptr_t value = slot.load(std::memory_order_acquire);
+      do {
+        if (!value || (value & kPinned))
+          break;
+      } while (!slot.compare_exchange_weak(value, value | kPinned,
+                                           std::memory_order_acquire,
+                                           std::memory_order_acquire));
+      if (!value || (value & kPinned))
         continue;
-      chunks_[chunk_index]->EstimateTraceMemoryOverhead(overhead);
+      GetChunkFromSlot(value)->EstimateTraceMemoryOverhead(overhead);
+      slot.store(value, std::memory_order_release);
     }
   }
 
  private:
-  bool QueueIsEmpty() const { return queue_head_ == queue_tail_; }
-
-  size_t QueueSize() const {
-    return queue_tail_ > queue_head_
-               ? queue_tail_ - queue_head_
-               : queue_tail_ + queue_capacity() - queue_head_;
-  }
+  struct Cell {
+    std::atomic<size_t> sequence;
+    size_t chunk_index;
+  };
 
-  bool QueueIsFull() const { return QueueSize() == queue_capacity() - 1; }
+  // Tag of the slots whose chunk is pinned. Chunks are at least 8 bytes
+  // aligned.
+  static constexpr uintptr_t kPinned = 1;
 
-  size_t queue_capacity() const {
-    // One extra space to help distinguish full state and empty state.
-    return max_chunks_ + 1;
+  static TraceBufferChunk* GetChunkFromSlot(uintptr_t value) {
+    return reinterpret_cast<TraceBufferChunk*>(value & ~kPinned);
   }
 
-  size_t NextQueueIndex(size_t index) const {
-    index++;
-    if (index >= queue_capacity())
-      index = 0;
-    return index;
+  uint32_t NextChunkSeq() {
+    uint32_t seq = next_chunk_seq_.fetch_add(1, std::memory_order_relaxed);
+    // Zero chunk_seq is not allowed.
+    if (!seq)
+      seq = next_chunk_seq_.fetch_add(1, std::memory_order_relaxed);
+    return seq;
   }
 
-  size_t max_chunks_;
-  std::vector<std::unique_ptr<TraceBufferChunk>> chunks_;
+  // Never fails, since the queue can hold all the chunks.
+  void Enqueue(size_t chunk_index) {
+    size_t position = queue_tail_.load(std::memory_order_relaxed);
+    for (;;) {
+      Cell& cell = queue_[position & queue_mask_];
+      const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+      if (sequence == position) {
+        if (queue_tail_.compare_exchange_weak(position, position + 1,
+                                              std::memory_order_relaxed)) {
+          cell.chunk_index = chunk_index;
+          cell.sequence.store(position + 1, std::memory_order_release);
+          return;
+        }
+      } else {
+        // Another thread took the position, or the cell is still being read
+        // by GetChunk() one lap behind.
+        position = queue_tail_.load(std::memory_order_relaxed);
+      }
+    }
+  }
 
-  std::unique_ptr<size_t[]> recyclable_chunks_queue_;
-  size_t queue_head_;
-  size_t queue_tail_;
+  // Returns false if the queue is empty.
+  bool Dequeue(size_t* chunk_index) {
+    size_t position = queue_head_.load(std::memory_order_relaxed);
+    for (;;) {
+      Cell& cell = queue_[position & queue_mask_];
+      const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+      if (sequence == position + 1) {
+        if (queue_head_.compare_exchange_weak(position, position + 1,
+                                              std::memory_order_relaxed)) {
+          *chunk_index = cell.chunk_index;
+          cell.sequence.store(position + queue_mask_ + 1,
+                              std::memory_order_release);
+          return true;
+        }
+      } else if (sequence == position &&
+                 queue_tail_.load(std::memory_order_acquire) == position) {
+        return false;
+      } else {
+        // Another thread took the position, or the cell is still being
+        // written by ReturnChunk().
+        position = queue_head_.load(std::memory_order_relaxed);
+      }
+    }
+  }
 
-  size_t current_iteration_index_;
-  uint32_t current_chunk_seq_;
+  const size_t max_chunks_;
+  // The chunk of each index, tagged with kPinned, or 0 if in flight or not
+  // allocated yet.
+  const std::unique_ptr<std::atomic<uintptr_t>[]> chunks_;
+  std::atomic<size_t> allocated_chunk_count_{0};
+  std::atomic<uint32_t> next_chunk_seq_{1};
+
+  const size_t queue_mask_;
+  const std::unique_ptr<Cell[]> queue_;
+  // On separate cache lines, since they are updated by different threads.
+  alignas(64) std::atomic<size_t> queue_head_{0};
+  alignas(64) std::atomic<size_t> queue_tail_{0};
+
+  // Only used by NextChunk().
+  bool iteration_started_ = false;
+  size_t iteration_position_ = 0;
+  size_t iteration_end_ = 0;
 };
 
 class TraceBufferVector : public TraceBuffer {
@@ -265,6 +405,12 @@ TraceEvent* TraceBufferChunk::AddTraceEvent(size_t* event_index) {
   return &chunk_[*event_index];
 }
 
+void TraceBufferChunk::RemoveLastEvent() {
+  DCHECK(next_free_);
+  chunk_[--next_free_].Reset();
+  cached_overhead_estimate_.reset();
+}
+
 void TraceBufferChunk::EstimateTraceMemoryOverhead(
     TraceEventMemoryOverhead* overhead) {
   if (!cached_overhead_estimate_) {
@@ -24,6 +24,8 @@ class BASE_EXPORT TraceBufferChunk {
 
   void Reset(uint32_t new_seq);
   TraceEvent* AddTraceEvent(size_t* event_index);
+  // Removes and resets the event added last, so that its index is reused.
+  void RemoveLastEvent();
   bool IsFull() const { return next_free_ == kTraceBufferChunkSize; }
 
   uint32_t seq() const { return seq_; }
@@ -67,6 +69,13 @@ class BASE_EXPORT TraceBuffer {
   virtual size_t Size() const = 0;
   virtual size_t Capacity() const = 0;
   virtual TraceEvent* GetEventByHandle(TraceEventHandle handle) = 0;
+  // Must be called once done with an event returned by GetEventByHandle(),
+  // before releasing TraceLog's lock.
+  virtual void ReleaseEventByHandle(TraceEventHandle handle) {}
+
+  // Returns true if GetChunk() and ReturnChunk() can be called from any thread
+  // without TraceLog's lock.
+  virtual bool IsLockFree() const { return false; }
 
   // For iteration. Each TraceBuffer can only be iterated once.
   virtual const TraceBufferChunk* NextChunk() = 0;
@@ -26,7 +26,12 @@ struct TraceCategory {
     DEPRECATED_ENABLED_FOR_EVENT_CALLBACK = 1 << 2,
 
     ENABLED_FOR_ETW_EXPORT = 1 << 3,
-    ENABLED_FOR_FILTERING = 1 << 4
+    ENABLED_FOR_FILTERING = 1 << 4,
+    ENABLED_FOR_FLIGHT_RECORDER = 1 << 5,
+
+    // Set along with ENABLED_FOR_RECORDING when the recorded events of the
+    // category are sampled, by the TraceEventSampler at sampler_index().
+    SAMPLED_FOR_RECORDING = 1 << 6
   };
 
   static const TraceCategory* FromStatePtr(const uint8_t* state_ptr) {
@@ -77,9 +82,18 @@ struct TraceCategory {
     *const_cast<volatile uint32_t*>(&enabled_filters_) = enabled_filters;
   }
 
+  uint8_t sampler_index() const {
+    return *const_cast<volatile const uint8_t*>(&sampler_index_);
+  }
+
+  void set_sampler_index(uint8_t sampler_index) {
+    *const_cast<volatile uint8_t*>(&sampler_index_) = sampler_index;
+  }
+
   void reset_for_testing() {
     set_state(0);
     set_enabled_filters(0);
+    set_sampler_index(0);
   }
 
   // These fields should not be accessed directly, not even by tracing code.
@@ -95,6 +109,10 @@ struct TraceCategory {
   // about missing some events.
   uint8_t state_;
 
+  // When SAMPLED_FOR_RECORDING is set, this is the index of the sampler of the
+  // category (see trace_event_sampler.h).
+  uint8_t sampler_index_;
+
   // When ENABLED_FOR_FILTERING is set, this contains a bitmap to the
   // corresponding filter (see event_filters.h).
   uint32_t enabled_filters_;
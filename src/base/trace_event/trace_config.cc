@@ -64,6 +64,16 @@ const char kIncludedProcessesParam[] = "included_process_ids";
 
 const char kHistogramNamesParam[] = "histogram_names";
 
+// String parameters used to parse the event sampling rules.
+const char kEventSamplingParam[] = "event_sampling";
+const char kSampleOneInParam[] = "sample_one_in";
+const char kMaxEventsPerSecondParam[] = "max_events_per_second";
+const char kMinDurationUsParam[] = "min_duration_us";
+
+// String parameters used to parse the flight recorder config.
+const char kFlightRecorderParam[] = "flight_recorder";
+const char kMaxAgeMsParam[] = "max_age_ms";
+
 class ConvertableTraceConfigToTraceFormat
     : public base::trace_event::ConvertableToTraceFormat {
  public:
@@ -242,6 +252,96 @@ bool TraceConfig::EventFilterConfig::IsCategoryGroupEnabled(
   return category_filter_.IsCategoryGroupEnabled(category_group_name);
 }
 
+TraceConfig::EventSamplingConfig::EventSamplingConfig() = default;
+
+TraceConfig::EventSamplingConfig::EventSamplingConfig(
+    const EventSamplingConfig& other) = default;
+
+TraceConfig::EventSamplingConfig::~EventSamplingConfig() = default;
+
+TraceConfig::EventSamplingConfig& TraceConfig::EventSamplingConfig::operator=(
+    const EventSamplingConfig& rhs) = default;
+
+void TraceConfig::EventSamplingConfig::InitializeFromConfigDict(
+    const Value& event_sampling) {
+  category_filter_.InitializeFromConfigDict(event_sampling);
+  sample_one_in_ = static_cast<uint32_t>(
+      std::max(0, event_sampling.FindIntKey(kSampleOneInParam).value_or(0)));
+  max_events_per_second_ = static_cast<uint32_t>(std::max(
+      0, event_sampling.FindIntKey(kMaxEventsPerSecondParam).value_or(0)));
+  min_duration_ = Microseconds(
+      std::max(0, event_sampling.FindIntKey(kMinDurationUsParam).value_or(0)));
+}
+
+void TraceConfig::EventSamplingConfig::ToDict(
+    Value* event_sampling_dict) const {
+  category_filter_.ToDict(event_sampling_dict);
+  if (sample_one_in_) {
+    event_sampling_dict->SetIntKey(kSampleOneInParam,
+                                   static_cast<int>(sample_one_in_));
+  }
+  if (max_events_per_second_) {
+    event_sampling_dict->SetIntKey(kMaxEventsPerSecondParam,
+                                   static_cast<int>(max_events_per_second_));
+  }
+  if (!min_duration_.is_zero()) {
+    event_sampling_dict->SetIntKey(
+        kMinDurationUsParam, static_cast<int>(min_duration_.InMicroseconds()));
+  }
+}
+
+bool TraceConfig::EventSamplingConfig::IsCategoryGroupEnabled(
+    const StringPiece& category_group_name) const {
+  return category_filter_.IsCategoryGroupEnabled(category_group_name);
+}
+
+void TraceConfig::EventSamplingConfig::SetCategoryFilter(
+    const TraceConfigCategoryFilter& category_filter) {
+  category_filter_ = category_filter;
+}
+
+TraceConfig::FlightRecorderConfig::FlightRecorderConfig() = default;
+
+TraceConfig::FlightRecorderConfig::FlightRecorderConfig(
+    const FlightRecorderConfig& other) = default;
+
+TraceConfig::FlightRecorderConfig::~FlightRecorderConfig() = default;
+
+TraceConfig::FlightRecorderConfig& TraceConfig::FlightRecorderConfig::operator=(
+    const FlightRecorderConfig& rhs) = default;
+
+void TraceConfig::FlightRecorderConfig::Clear() {
+  category_filter_.Clear();
+  max_age_ = TimeDelta();
+}
+
+void TraceConfig::FlightRecorderConfig::InitializeFromConfigDict(
+    const Value& flight_recorder) {
+  category_filter_.InitializeFromConfigDict(flight_recorder);
+  max_age_ =
+      Milliseconds(flight_recorder.FindIntKey(kMaxAgeMsParam).value_or(0));
+}
+
+void TraceConfig::FlightRecorderConfig::ToDict(
+    Value* flight_recorder_dict) const {
+  category_filter_.ToDict(flight_recorder_dict);
+  if (!max_age_.is_zero()) {
+    flight_recorder_dict->SetIntKey(
+        kMaxAgeMsParam, static_cast<int>(max_age_.InMilliseconds()));
+  }
+}
+
+bool TraceConfig::FlightRecorderConfig::IsCategoryGroupEnabled(
+    const StringPiece& category_group_name) const {
+  return !empty() &&
+         category_filter_.IsCategoryGroupEnabled(category_group_name);
+}
+
+void TraceConfig::FlightRecorderConfig::SetCategoryFilter(
+    const TraceConfigCategoryFilter& category_filter) {
+  category_filter_ = category_filter;
+}
+
 // static
 std::string TraceConfig::TraceRecordModeToStr(TraceRecordMode record_mode) {
   switch (record_mode) {
@@ -302,6 +402,8 @@ TraceConfig& TraceConfig::operator=(const TraceConfig& rhs) {
   process_filter_config_ = rhs.process_filter_config_;
   memory_dump_config_ = rhs.memory_dump_config_;
   event_filters_ = rhs.event_filters_;
+  event_sampling_rules_ = rhs.event_sampling_rules_;
+  flight_recorder_config_ = rhs.flight_recorder_config_;
   histogram_names_ = rhs.histogram_names_;
   systrace_events_ = rhs.systrace_events_;
   return *this;
@@ -346,6 +448,11 @@ void TraceConfig::Merge(const TraceConfig& config) {
 
   event_filters_.insert(event_filters_.end(), config.event_filters().begin(),
                         config.event_filters().end());
+  event_sampling_rules_.insert(event_sampling_rules_.end(),
+                               config.event_sampling_rules().begin(),
+                               config.event_sampling_rules().end());
+  if (flight_recorder_config_.empty())
+    flight_recorder_config_ = config.flight_recorder_config_;
   histogram_names_.insert(config.histogram_names().begin(),
                           config.histogram_names().end());
 }
@@ -360,6 +467,8 @@ void TraceConfig::Clear() {
   memory_dump_config_.Clear();
   process_filter_config_.Clear();
   event_filters_.clear();
+  event_sampling_rules_.clear();
+  flight_recorder_config_.Clear();
   histogram_names_.clear();
   systrace_events_.clear();
 }
@@ -400,6 +509,12 @@ void TraceConfig::InitializeFromConfigDict(const Value& dict) {
   const Value* category_event_filters = dict.FindListKey(kEventFiltersParam);
   if (category_event_filters)
     SetEventFiltersFromConfigList(*category_event_filters);
+  const Value* event_sampling = dict.FindListKey(kEventSamplingParam);
+  if (event_sampling)
+    SetEventSamplingRulesFromConfigList(*event_sampling);
+  const Value* flight_recorder = dict.FindDictKey(kFlightRecorderParam);
+  if (flight_recorder)
+    flight_recorder_config_.InitializeFromConfigDict(*flight_recorder);
   const Value* histogram_names = dict.FindListKey(kHistogramNamesParam);
   if (histogram_names)
     SetHistogramNamesFromConfigList(*histogram_names);
@@ -589,6 +704,20 @@ void TraceConfig::SetEventFiltersFromConfigList(
   }
 }
 
+void TraceConfig::SetEventSamplingRulesFromConfigList(
+    const Value& event_sampling) {
+  event_sampling_rules_.clear();
+
+  for (const Value& rule : event_sampling.GetList()) {
+    if (!rule.is_dict())
+      continue;
+
+    EventSamplingConfig new_config;
+    new_config.InitializeFromConfigDict(rule);
+    event_sampling_rules_.push_back(new_config);
+  }
+}
+
 Value TraceConfig::ToValue() const {
   Value dict(Value::Type::DICTIONARY);
   dict.SetStringKey(kRecordModeParam,
@@ -612,6 +741,21 @@ Value TraceConfig::ToValue() const {
     dict.SetKey(kEventFiltersParam, Value(std::move(filter_list)));
   }
 
+  if (!event_sampling_rules_.empty()) {
+    std::vector<Value> rule_list;
+    for (const EventSamplingConfig& rule : event_sampling_rules_) {
+      rule_list.emplace_back(Value::Type::DICTIONARY);
+      rule.ToDict(&rule_list.back());
+    }
+    dict.SetKey(kEventSamplingParam, Value(std::move(rule_list)));
+  }
+
+  if (!flight_recorder_config_.empty()) {
+    Value flight_recorder(Value::Type::DICTIONARY);
+    flight_recorder_config_.ToDict(&flight_recorder);
+    dict.SetKey(kFlightRecorderParam, std::move(flight_recorder));
+  }
+
   if (category_filter_.IsCategoryEnabled(MemoryDumpManager::kTraceCategory)) {
     std::vector<Value> allowed_modes;
     for (auto dump_mode : memory_dump_config_.allowed_dump_modes)
@@ -16,6 +16,7 @@
 #include "base/base_export.h"
 #include "base/gtest_prod_util.h"
 #include "base/strings/string_piece.h"
+#include "base/time/time.h"
 #include "base/trace_event/memory_dump_request_args.h"
 #include "base/trace_event/trace_config_category_filter.h"
 #include "base/values.h"
@@ -149,6 +150,93 @@ class BASE_EXPORT TraceConfig {
   };
   typedef std::vector<EventFilterConfig> EventFilters;
 
+  // Selects the categories whose events are kept by the FlightRecorder while
+  // TraceLog's FLIGHT_RECORDER_MODE is enabled, and how long they are kept.
+  // Unlike the category filter of the config, no category is enabled if the
+  // included categories are empty.
+  class BASE_EXPORT FlightRecorderConfig {
+   public:
+    FlightRecorderConfig();
+    FlightRecorderConfig(const FlightRecorderConfig&);
+    ~FlightRecorderConfig();
+
+    FlightRecorderConfig& operator=(const FlightRecorderConfig&);
+
+    bool empty() const {
+      return category_filter_.included_categories().empty();
+    }
+
+    void Clear();
+
+    void InitializeFromConfigDict(const Value& flight_recorder);
+    void ToDict(Value* flight_recorder_dict) const;
+
+    bool IsCategoryGroupEnabled(const StringPiece& category_group_name) const;
+
+    void SetCategoryFilter(const TraceConfigCategoryFilter& category_filter);
+    const TraceConfigCategoryFilter& category_filter() const {
+      return category_filter_;
+    }
+
+    // Zero if the events are kept as long as they fit in the ring.
+    TimeDelta max_age() const { return max_age_; }
+    void set_max_age(TimeDelta max_age) { max_age_ = max_age; }
+
+   private:
+    TraceConfigCategoryFilter category_filter_;
+    TimeDelta max_age_;
+  };
+
+  // Samples the recorded events of the categories it applies to, so that busy
+  // categories can be enabled without filling the trace buffer. Only the
+  // complete, instant and counter events are sampled, since dropping one half
+  // of a begin/end or async pair would leave the other unmatched. An event is
+  // kept if it passes every limit. See TraceEventSampler.
+  class BASE_EXPORT EventSamplingConfig {
+   public:
+    EventSamplingConfig();
+    EventSamplingConfig(const EventSamplingConfig&);
+    ~EventSamplingConfig();
+
+    EventSamplingConfig& operator=(const EventSamplingConfig&);
+
+    void InitializeFromConfigDict(const Value& event_sampling);
+    void ToDict(Value* event_sampling_dict) const;
+
+    bool IsCategoryGroupEnabled(const StringPiece& category_group_name) const;
+
+    void SetCategoryFilter(const TraceConfigCategoryFilter& category_filter);
+    const TraceConfigCategoryFilter& category_filter() const {
+      return category_filter_;
+    }
+
+    // Keeps one event out of |sample_one_in|. Zero or one keeps all of them.
+    uint32_t sample_one_in() const { return sample_one_in_; }
+    void set_sample_one_in(uint32_t sample_one_in) {
+      sample_one_in_ = sample_one_in;
+    }
+
+    // Keeps at most this many events per second, in bursts of up to one
+    // second worth of events. Zero if the rate isn't limited.
+    uint32_t max_events_per_second() const { return max_events_per_second_; }
+    void set_max_events_per_second(uint32_t max_events_per_second) {
+      max_events_per_second_ = max_events_per_second;
+    }
+
+    // Drops the complete events which took less than this, when possible.
+    TimeDelta min_duration() const { return min_duration_; }
+    void set_min_duration(TimeDelta min_duration) {
+      min_duration_ = min_duration;
+    }
+
+   private:
+    TraceConfigCategoryFilter category_filter_;
+    uint32_t sample_one_in_ = 0;
+    uint32_t max_events_per_second_ = 0;
+    TimeDelta min_duration_;
+  };
+  typedef std::vector<EventSamplingConfig> EventSamplingRules;
+
   static std::string TraceRecordModeToStr(TraceRecordMode record_mode);
 
   TraceConfig();
@@ -204,6 +292,14 @@ class BASE_EXPORT TraceConfig {
   //                             "inc_pattern*",
   //                             "disabled-by-default-memory-infra"],
   //     "excluded_categories": ["excluded", "exc_pattern*"],
+  //     "event_sampling": [
+  //       {
+  //         "included_categories": ["toplevel"],
+  //         "sample_one_in": 100,
+  //         "max_events_per_second": 1000,
+  //         "min_duration_us": 50
+  //       }
+  //     ],
   //     "memory_dump_config": {
   //       "triggers": [
   //         {
@@ -292,6 +388,21 @@ class BASE_EXPORT TraceConfig {
     event_filters_ = filter_configs;
   }
 
+  // The first rule which applies to a category samples its events.
+  const EventSamplingRules& event_sampling_rules() const {
+    return event_sampling_rules_;
+  }
+  void SetEventSamplingRules(const EventSamplingRules& rules) {
+    event_sampling_rules_ = rules;
+  }
+
+  const FlightRecorderConfig& flight_recorder_config() const {
+    return flight_recorder_config_;
+  }
+  void SetFlightRecorderConfig(const FlightRecorderConfig& config) {
+    flight_recorder_config_ = config;
+  }
+
   const std::unordered_set<std::string>& systrace_events() const {
     return systrace_events_;
   }
@@ -326,6 +437,7 @@ class BASE_EXPORT TraceConfig {
 
   void SetHistogramNamesFromConfigList(const Value& histogram_names);
   void SetEventFiltersFromConfigList(const Value& event_filters);
+  void SetEventSamplingRulesFromConfigList(const Value& event_sampling);
   Value ToValue() const;
 
   TraceRecordMode record_mode_;
@@ -340,6 +452,8 @@ class BASE_EXPORT TraceConfig {
   ProcessFilterConfig process_filter_config_;
 
   EventFilters event_filters_;
+  EventSamplingRules event_sampling_rules_;
+  FlightRecorderConfig flight_recorder_config_;
   std::unordered_set<std::string> histogram_names_;
   std::unordered_set<std::string> systrace_events_;
 };
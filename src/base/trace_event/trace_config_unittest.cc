@@ -696,5 +696,67 @@ TEST(TraceConfigTest, SystraceEventsSerialization) {
   EXPECT_TRUE(tc2.systrace_events().count("timer:tick_stop"));
 }
 
+TEST(TraceConfigTest, FlightRecorderConfig) {
+  TraceConfig tc(
+      "{\"flight_recorder\":{\"included_categories\":[\"input\",\"gpu\"],"
+      "\"excluded_categories\":[\"gpu.debug\"],\"max_age_ms\":30000}}");
+  const TraceConfig::FlightRecorderConfig& config = tc.flight_recorder_config();
+  EXPECT_FALSE(config.empty());
+  EXPECT_EQ(Seconds(30), config.max_age());
+  EXPECT_TRUE(config.IsCategoryGroupEnabled("input"));
+  EXPECT_TRUE(config.IsCategoryGroupEnabled("gpu,other"));
+  EXPECT_FALSE(config.IsCategoryGroupEnabled("gpu.debug"));
+  EXPECT_FALSE(config.IsCategoryGroupEnabled("other"));
+  // The flight recorder categories don't affect recording.
+  EXPECT_TRUE(tc.IsCategoryGroupEnabled("other"));
+
+  const TraceConfig tc2(tc.ToString());
+  EXPECT_EQ(tc.ToString(), tc2.ToString());
+  EXPECT_EQ(Seconds(30), tc2.flight_recorder_config().max_age());
+
+  // No category is enabled without included categories.
+  EXPECT_TRUE(TraceConfig().flight_recorder_config().empty());
+  EXPECT_FALSE(
+      TraceConfig().flight_recorder_config().IsCategoryGroupEnabled("input"));
+  EXPECT_EQ(std::string::npos, TraceConfig().ToString().find("flight"));
+}
+
+TEST(TraceConfigTest, EventSamplingRules) {
+  TraceConfig tc(
+      "{\"included_categories\":[\"*\"],\"event_sampling\":["
+      "{\"included_categories\":[\"toplevel\"],\"sample_one_in\":100,"
+      "\"max_events_per_second\":1000},"
+      "{\"included_categories\":[\"ipc\",\"task\"],"
+      "\"min_duration_us\":50}]}");
+  const TraceConfig::EventSamplingRules& rules = tc.event_sampling_rules();
+  ASSERT_EQ(2u, rules.size());
+  EXPECT_TRUE(rules[0].IsCategoryGroupEnabled("toplevel"));
+  EXPECT_FALSE(rules[0].IsCategoryGroupEnabled("task"));
+  EXPECT_EQ(100u, rules[0].sample_one_in());
+  EXPECT_EQ(1000u, rules[0].max_events_per_second());
+  EXPECT_TRUE(rules[0].min_duration().is_zero());
+  EXPECT_TRUE(rules[1].IsCategoryGroupEnabled("task"));
+  EXPECT_EQ(0u, rules[1].sample_one_in());
+  EXPECT_EQ(0u, rules[1].max_events_per_second());
+  EXPECT_EQ(Microseconds(50), rules[1].min_duration());
+  // The rules don't affect which categories are enabled.
+  EXPECT_TRUE(tc.IsCategoryGroupEnabled("toplevel"));
+
+  const TraceConfig tc2(tc.ToString());
+  EXPECT_EQ(tc.ToString(), tc2.ToString());
+  ASSERT_EQ(2u, tc2.event_sampling_rules().size());
+  EXPECT_EQ(Microseconds(50), tc2.event_sampling_rules()[1].min_duration());
+
+  // Merging appends the rules.
+  TraceConfig tc3("{\"event_sampling\":[{\"included_categories\":[\"gpu\"],"
+                  "\"sample_one_in\":2}]}");
+  tc3.Merge(tc);
+  ASSERT_EQ(3u, tc3.event_sampling_rules().size());
+  EXPECT_TRUE(tc3.event_sampling_rules()[0].IsCategoryGroupEnabled("gpu"));
+
+  EXPECT_TRUE(TraceConfig().event_sampling_rules().empty());
+  EXPECT_EQ(std::string::npos, TraceConfig().ToString().find("sampling"));
+}
+
 }  // namespace trace_event
 }  // namespace base
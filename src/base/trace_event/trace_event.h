@@ -74,7 +74,8 @@
   UNLIKELY(*INTERNAL_TRACE_EVENT_UID(category_group_enabled) &         \
            (base::trace_event::TraceCategory::ENABLED_FOR_RECORDING |  \
             base::trace_event::TraceCategory::ENABLED_FOR_ETW_EXPORT | \
-            base::trace_event::TraceCategory::ENABLED_FOR_FILTERING))
+            base::trace_event::TraceCategory::ENABLED_FOR_FILTERING |  \
+            base::trace_event::TraceCategory::ENABLED_FOR_FLIGHT_RECORDER))
 
 ////////////////////////////////////////////////////////////////////////////////
 // Implementation specific tracing API definitions.
@@ -662,6 +663,10 @@ inline base::trace_event::TraceEventHandle AddTraceEvent(
     unsigned long long id,
     unsigned int flags,
     unsigned long long bind_id) {
+  if (!base::trace_event::TraceLog::ShouldSampleEvent(
+          phase, category_group_enabled)) {
+    return base::trace_event::TraceEventHandle::Dropped();
+  }
   const int thread_id = static_cast<int>(base::PlatformThread::CurrentId());
   const base::TimeTicks now = TRACE_TIME_TICKS_NOW();
   return AddTraceEventWithThreadIdAndTimestamp(
@@ -680,6 +685,10 @@ inline base::trace_event::TraceEventHandle AddTraceEvent(
     unsigned long long bind_id,
     const char* arg1_name,
     ARG1_TYPE&& arg1_val) {
+  if (!base::trace_event::TraceLog::ShouldSampleEvent(
+          phase, category_group_enabled)) {
+    return base::trace_event::TraceEventHandle::Dropped();
+  }
   int thread_id = static_cast<int>(base::PlatformThread::CurrentId());
   base::TimeTicks now = TRACE_TIME_TICKS_NOW();
   return AddTraceEventWithThreadIdAndTimestamp(
@@ -700,6 +709,10 @@ inline base::trace_event::TraceEventHandle AddTraceEvent(
     ARG1_TYPE&& arg1_val,
     const char* arg2_name,
     ARG2_TYPE&& arg2_val) {
+  if (!base::trace_event::TraceLog::ShouldSampleEvent(
+          phase, category_group_enabled)) {
+    return base::trace_event::TraceEventHandle::Dropped();
+  }
   int thread_id = static_cast<int>(base::PlatformThread::CurrentId());
   base::TimeTicks now = TRACE_TIME_TICKS_NOW();
   return AddTraceEventWithThreadIdAndTimestamp(
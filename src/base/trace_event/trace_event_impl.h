@@ -45,6 +45,13 @@ struct TraceEventHandle {
   // TraceBufferChunk::kTraceBufferChunkSize (in trace_buffer.h).
   unsigned chunk_index : 26;
   unsigned event_index : 6;
+
+  // The handle of an event dropped by the sampler of its category, whose end
+  // is dropped too. Unlike the zero handle of an event which wasn't added to
+  // the trace buffer, e.g. because it is full, which may still have been seen
+  // by the filters and the flight recorder. No event has a zero |chunk_seq|.
+  static constexpr TraceEventHandle Dropped() { return {0, 1, 0}; }
+  constexpr bool IsDropped() const { return !chunk_seq && chunk_index == 1; }
 };
 
 class BASE_EXPORT TraceEvent {
@@ -0,0 +1,331 @@
+// Copyright 2021 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "base/barrier_closure.h"
+#include "base/bind.h"
+#include "base/callback.h"
+#include "base/memory/ref_counted_memory.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/synchronization/lock.h"
+#include "base/synchronization/waitable_event.h"
+#include "base/threading/simple_thread.h"
+#include "base/timer/elapsed_timer.h"
+#include "base/trace_event/trace_buffer.h"
+#include "base/trace_event/trace_event.h"
+#include "base/trace_event/trace_log.h"
+#include "testing/gtest/include/gtest/gtest.h"
+#include "testing/perf/perf_result_reporter.h"
+
+// This file measures the throughput of AddTraceEvent() when one or several
+// threads without a message loop add events at once, through their thread
+// local buffers, and the time it takes to flush these buffers afterwards. It
+// also compares the time and size of the JSON and compact flush formats, and
+// the throughput of the lock-free ring buffer of RECORD_CONTINUOUSLY mode with
+// that of the same buffer behind a lock, as it used to be, and the cost of the
+// events of a category which is disabled, sampled or fully enabled.
+
+namespace base {
+namespace trace_event {
+
+#if !BUILDFLAG(USE_PERFETTO_CLIENT_LIBRARY)
+
+namespace {
+
+constexpr char kMetricPrefixTraceEvent[] = "TraceEvent.";
+constexpr char kMetricTimePerEvent[] = "time_per_event";
+constexpr char kMetricFlushTime[] = "flush_time";
+constexpr char kMetricBytesPerEvent[] = "bytes_per_event";
+constexpr char kMetricTimePerChunk[] = "time_per_chunk";
+constexpr int kEventsPerThread = 100000;
+constexpr int kChunksPerThread = 100000;
+
+perf_test::PerfResultReporter SetUpReporter(const std::string& story_name) {
+  perf_test::PerfResultReporter reporter(kMetricPrefixTraceEvent, story_name);
+  reporter.RegisterImportantMetric(kMetricTimePerEvent, "ns");
+  reporter.RegisterImportantMetric(kMetricFlushTime, "us");
+  reporter.RegisterImportantMetric(kMetricBytesPerEvent, "bytes");
+  reporter.RegisterImportantMetric(kMetricTimePerChunk, "ns");
+  return reporter;
+}
+
+enum class EventType { kInstant, kComplete };
+
+// Returns a config which records the "benchmark" category with the sampling
+// rule |rule|, which is a JSON dictionary without its braces.
+TraceConfig SamplingConfig(const std::string& rule) {
+  return TraceConfig(
+      "{\"record_mode\":\"record-continuously\","
+      "\"included_categories\":[\"benchmark\"],\"event_sampling\":[{"
+      "\"included_categories\":[\"benchmark\"]," +
+      rule + "}]}");
+}
+
+class TraceThread : public SimpleThread {
+ public:
+  // Upon entering its main function, the thread waits for |start_event| to be
+  // signaled. Then, it adds |kEventsPerThread| events of |event_type|, invokes
+  // |done_closure| and waits for |stop_event| to be signaled.
+  TraceThread(WaitableEvent* start_event,
+              WaitableEvent* stop_event,
+              EventType event_type,
+              OnceClosure done_closure)
+      : SimpleThread("TraceThread"),
+        start_event_(start_event),
+        stop_event_(stop_event),
+        event_type_(event_type),
+        done_closure_(std::move(done_closure)) {}
+
+  // SimpleThread:
+  void Run() override {
+    start_event_->Wait();
+    for (int i = 0; i < kEventsPerThread; ++i) {
+      if (event_type_ == EventType::kInstant) {
+        TRACE_EVENT_INSTANT1("benchmark", "Instant", TRACE_EVENT_SCOPE_THREAD,
+                             "value", i);
+      } else {
+        TRACE_EVENT1("benchmark", "Complete", "value", i);
+      }
+    }
+    std::move(done_closure_).Run();
+    stop_event_->Wait();
+  }
+
+ private:
+  WaitableEvent* const start_event_;
+  WaitableEvent* const stop_event_;
+  const EventType event_type_;
+  OnceClosure done_closure_;
+};
+
+// Gets and returns |kChunksPerThread| chunks of |buffer|, while holding |lock|
+// if not null.
+class RecycleChunksThread : public SimpleThread {
+ public:
+  RecycleChunksThread(WaitableEvent* start_event,
+                      TraceBuffer* buffer,
+                      Lock* lock,
+                      OnceClosure done_closure)
+      : SimpleThread("RecycleChunksThread"),
+        start_event_(start_event),
+        buffer_(buffer),
+        lock_(lock),
+        done_closure_(std::move(done_closure)) {}
+
+  // SimpleThread:
+  void Run() override {
+    start_event_->Wait();
+    for (int i = 0; i < kChunksPerThread; ++i) {
+      size_t chunk_index;
+      std::unique_ptr<TraceBufferChunk> chunk;
+      // Two critical sections, like TraceLog took its lock to get a chunk and
+      // again to return it once full.
+      if (lock_) {
+        AutoLock lock(*lock_);
+        chunk = buffer_->GetChunk(&chunk_index);
+      } else {
+        chunk = buffer_->GetChunk(&chunk_index);
+      }
+      if (lock_) {
+        AutoLock lock(*lock_);
+        buffer_->ReturnChunk(chunk_index, std::move(chunk));
+      } else {
+        buffer_->ReturnChunk(chunk_index, std::move(chunk));
+      }
+    }
+    std::move(done_closure_).Run();
+  }
+
+ private:
+  WaitableEvent* const start_event_;
+  TraceBuffer* const buffer_;
+  Lock* const lock_;
+  OnceClosure done_closure_;
+};
+
+class TraceEventPerfTest : public testing::Test {
+ public:
+  void SetUp() override { TraceLog::ResetForTesting(); }
+  void TearDown() override { TraceLog::ResetForTesting(); }
+
+ protected:
+  void RunTest(const std::string& story_name,
+               int num_threads,
+               EventType event_type) {
+    // The ring buffer keeps the trace from filling up, which would disable
+    // tracing.
+    TraceLog::GetInstance()->SetEnabled(
+        TraceConfig("benchmark", RECORD_CONTINUOUSLY),
+        TraceLog::RECORDING_MODE);
+
+    WaitableEvent start_event;
+    WaitableEvent stop_event;
+    WaitableEvent done_event;
+    RepeatingClosure done_closure = BarrierClosure(
+        num_threads, BindOnce(&WaitableEvent::Signal, Unretained(&done_event)));
+    std::vector<std::unique_ptr<TraceThread>> threads;
+    for (int i = 0; i < num_threads; ++i) {
+      threads.push_back(std::make_unique<TraceThread>(
+          &start_event, &stop_event, event_type, done_closure));
+      threads.back()->Start();
+    }
+
+    ElapsedTimer timer;
+    start_event.Signal();
+    done_event.Wait();
+    const TimeDelta elapsed = timer.Elapsed();
+
+    // The threads are still alive during the flush, which takes the chunks of
+    // their thread local buffers.
+    TraceLog::GetInstance()->SetDisabled();
+    ElapsedTimer flush_timer;
+    TraceLog::GetInstance()->Flush(TraceLog::OutputCallback());
+    const TimeDelta flush_time = flush_timer.Elapsed();
+
+    stop_event.Signal();
+    for (auto& thread : threads)
+      thread->Join();
+
+    auto reporter = SetUpReporter(story_name);
+    reporter.AddResult(kMetricTimePerEvent,
+                       elapsed.InNanoseconds() / double{kEventsPerThread});
+    reporter.AddResult(kMetricFlushTime, flush_time.InMicrosecondsF());
+  }
+
+  // Adds |kEventsPerThread| events on the current thread, then flushes them
+  // with |flush|, which is TraceLog::Flush() or TraceLog::FlushCompact().
+  void RunFlushTest(
+      const std::string& story_name,
+      void (TraceLog::*flush)(const TraceLog::OutputCallback&, bool)) {
+    TraceLog::GetInstance()->SetEnabled(TraceConfig("benchmark", ""),
+                                        TraceLog::RECORDING_MODE);
+    for (int i = 0; i < kEventsPerThread / 2; ++i) {
+      TRACE_EVENT1("benchmark", "Complete", "value", i);
+      TRACE_EVENT_INSTANT2("benchmark", "Instant", TRACE_EVENT_SCOPE_THREAD,
+                           "name", "static string", "ratio", i / 3.0);
+    }
+    TraceLog::GetInstance()->SetDisabled();
+    ASSERT_FALSE(TraceLog::GetInstance()->BufferIsFull());
+
+    size_t size = 0;
+    ElapsedTimer timer;
+    (TraceLog::GetInstance()->*flush)(
+        BindRepeating(
+            [](size_t* size, const scoped_refptr<RefCountedString>& piece,
+               bool has_more_events) { *size += piece->size(); },
+            Unretained(&size)),
+        false);
+    const TimeDelta flush_time = timer.Elapsed();
+
+    auto reporter = SetUpReporter(story_name);
+    reporter.AddResult(kMetricFlushTime, flush_time.InMicrosecondsF());
+    reporter.AddResult(kMetricBytesPerEvent,
+                       size / static_cast<double>(kEventsPerThread));
+  }
+
+  // Adds |kEventsPerThread| complete events on the current thread, with
+  // |config| if not null, or with tracing disabled.
+  void RunSamplingTest(const std::string& story_name,
+                       const TraceConfig* config) {
+    if (config)
+      TraceLog::GetInstance()->SetEnabled(*config, TraceLog::RECORDING_MODE);
+    ElapsedTimer timer;
+    for (int i = 0; i < kEventsPerThread; ++i) {
+      TRACE_EVENT1("benchmark", "Complete", "value", i);
+    }
+    const TimeDelta elapsed = timer.Elapsed();
+    TraceLog::GetInstance()->SetDisabled();
+
+    auto reporter = SetUpReporter(story_name);
+    reporter.AddResult(kMetricTimePerEvent,
+                       elapsed.InNanoseconds() / double{kEventsPerThread});
+  }
+
+  void RunRecycleChunksTest(const std::string& story_name,
+                            int num_threads,
+                            bool use_lock) {
+    std::unique_ptr<TraceBuffer> buffer(
+        TraceBuffer::CreateTraceBufferRingBuffer(1024));
+    Lock lock;
+    WaitableEvent start_event;
+    WaitableEvent done_event;
+    RepeatingClosure done_closure = BarrierClosure(
+        num_threads, BindOnce(&WaitableEvent::Signal, Unretained(&done_event)));
+    std::vector<std::unique_ptr<RecycleChunksThread>> threads;
+    for (int i = 0; i < num_threads; ++i) {
+      threads.push_back(std::make_unique<RecycleChunksThread>(
+          &start_event, buffer.get(), use_lock ? &lock : nullptr,
+          done_closure));
+      threads.back()->Start();
+    }
+
+    ElapsedTimer timer;
+    start_event.Signal();
+    done_event.Wait();
+    const TimeDelta elapsed = timer.Elapsed();
+    for (auto& thread : threads)
+      thread->Join();
+
+    auto reporter = SetUpReporter(story_name);
+    reporter.AddResult(kMetricTimePerChunk,
+                       elapsed.InNanoseconds() / double{kChunksPerThread});
+  }
+};
+
+}  // namespace
+
+TEST_F(TraceEventPerfTest, AddInstantEvents) {
+  for (int num_threads : {1, 4}) {
+    RunTest("Instant_" + NumberToString(num_threads) + "Threads", num_threads,
+            EventType::kInstant);
+  }
+}
+
+TEST_F(TraceEventPerfTest, AddCompleteEvents) {
+  for (int num_threads : {1, 4}) {
+    RunTest("Complete_" + NumberToString(num_threads) + "Threads", num_threads,
+            EventType::kComplete);
+  }
+}
+
+TEST_F(TraceEventPerfTest, FlushJSON) {
+  RunFlushTest("FlushJSON", &TraceLog::Flush);
+}
+
+TEST_F(TraceEventPerfTest, FlushCompact) {
+  RunFlushTest("FlushCompact", &TraceLog::FlushCompact);
+}
+
+TEST_F(TraceEventPerfTest, SampledEvents) {
+  RunSamplingTest("Disabled", nullptr);
+  const TraceConfig enabled("benchmark", RECORD_CONTINUOUSLY);
+  RunSamplingTest("Enabled", &enabled);
+  const TraceConfig one_in_100 = SamplingConfig("\"sample_one_in\":100");
+  RunSamplingTest("SampleOneIn100", &one_in_100);
+  const TraceConfig max_1000_per_second =
+      SamplingConfig("\"max_events_per_second\":1000");
+  RunSamplingTest("MaxEventsPerSecond1000", &max_1000_per_second);
+  // All the events are shorter than that, and removed once they end.
+  const TraceConfig min_duration = SamplingConfig("\"min_duration_us\":1000");
+  RunSamplingTest("MinDuration", &min_duration);
+}
+
+TEST_F(TraceEventPerfTest, RecycleRingBufferChunks) {
+  for (int num_threads : {1, 4}) {
+    RunRecycleChunksTest(
+        "RingBuffer_" + NumberToString(num_threads) + "Threads", num_threads,
+        false);
+    RunRecycleChunksTest(
+        "LockedRingBuffer_" + NumberToString(num_threads) + "Threads",
+        num_threads, true);
+  }
+}
+
+#endif  // !BUILDFLAG(USE_PERFETTO_CLIENT_LIBRARY)
+
+}  // namespace trace_event
+}  // namespace base
@@ -0,0 +1,60 @@
+// Copyright 2021 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "base/trace_event/trace_event_sampler.h"
+
+#include <algorithm>
+
+#include "base/trace_event/common/trace_event_common.h"
+
+namespace base {
+namespace trace_event {
+
+namespace {
+
+bool IsSampledPhase(char phase) {
+  return phase == TRACE_EVENT_PHASE_COMPLETE ||
+         phase == TRACE_EVENT_PHASE_INSTANT ||
+         phase == TRACE_EVENT_PHASE_COUNTER;
+}
+
+}  // namespace
+
+TraceEventSampler::TraceEventSampler(
+    const TraceConfig::EventSamplingConfig& config)
+    : sample_one_in_(config.sample_one_in()),
+      event_interval_ns_(config.max_events_per_second()
+                             ? Seconds(1).InNanoseconds() /
+                                   config.max_events_per_second()
+                             : 0),
+      min_duration_(config.min_duration()) {}
+
+TraceEventSampler::~TraceEventSampler() = default;
+
+bool TraceEventSampler::ShouldSampleEvent(char phase) {
+  return sample_one_in_ <= 1 || !IsSampledPhase(phase) ||
+         !(event_count_.fetch_add(1, std::memory_order_relaxed) %
+           sample_one_in_);
+}
+
+bool TraceEventSampler::IsWithinRateLimit(char phase, TimeTicks timestamp) {
+  return !event_interval_ns_ || !IsSampledPhase(phase) || TakeToken(timestamp);
+}
+
+bool TraceEventSampler::TakeToken(TimeTicks timestamp) {
+  const int64_t now_ns = timestamp.since_origin().InNanoseconds();
+  const int64_t capacity_ns = Seconds(1).InNanoseconds();
+  int64_t full_time_ns = bucket_full_time_ns_.load(std::memory_order_relaxed);
+  int64_t new_full_time_ns;
+  do {
+    new_full_time_ns = std::max(full_time_ns, now_ns) + event_interval_ns_;
+    if (new_full_time_ns - now_ns > capacity_ns)
+      return false;
+  } while (!bucket_full_time_ns_.compare_exchange_weak(
+      full_time_ns, new_full_time_ns, std::memory_order_relaxed));
+  return true;
+}
+
+}  // namespace trace_event
+}  // namespace base
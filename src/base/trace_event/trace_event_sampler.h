@@ -0,0 +1,85 @@
+// Copyright 2021 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BASE_TRACE_EVENT_TRACE_EVENT_SAMPLER_H_
+#define BASE_TRACE_EVENT_TRACE_EVENT_SAMPLER_H_
+
+#include <stdint.h>
+
+#include <atomic>
+
+#include "base/base_export.h"
+#include "base/time/time.h"
+#include "base/trace_event/trace_config.h"
+
+namespace base {
+namespace trace_event {
+
+// TraceEventSampler decides which events of the categories of a
+// TraceConfig::EventSamplingConfig are recorded. TraceLog sets the
+// SAMPLED_FOR_RECORDING flag and the sampler index on these categories, so
+// that the events of the other categories don't pay for sampling. The one-in-N
+// sampling doesn't need the time of the event, so it is decided before the
+// clock is read and the arguments are converted, and dropping an event costs
+// one atomic operation. The rate limit is applied once the time is known.
+//
+// The complete, instant and counter events are kept one out of
+// sample_one_in(), then while the rate of kept events stays below
+// max_events_per_second(). The other phases are always kept, so that the
+// begin/end and async pairs stay matched. Complete events which took less than
+// min_duration() are removed once they end, if no event was added after them
+// in the trace buffer of their thread. This covers the nested events of the
+// category, which end before the enclosing ones.
+//
+// Thread-safe.
+class BASE_EXPORT TraceEventSampler {
+ public:
+  explicit TraceEventSampler(const TraceConfig::EventSamplingConfig& config);
+  TraceEventSampler(const TraceEventSampler&) = delete;
+  TraceEventSampler& operator=(const TraceEventSampler&) = delete;
+  ~TraceEventSampler();
+
+  // Returns whether the event of |phase| which happened at |timestamp| should
+  // be added. Same as ShouldSampleEvent() followed by IsWithinRateLimit().
+  bool ShouldAddEvent(char phase, TimeTicks timestamp) {
+    return ShouldSampleEvent(phase) && IsWithinRateLimit(phase, timestamp);
+  }
+
+  // Returns whether the event of |phase| is kept by the one-in-N sampling.
+  bool ShouldSampleEvent(char phase);
+
+  // Returns whether the event of |phase|, kept by ShouldSampleEvent(), is
+  // within the rate limit at |timestamp|.
+  bool IsWithinRateLimit(char phase, TimeTicks timestamp);
+
+  // Returns whether a complete event which took |duration| should be kept.
+  bool ShouldKeepCompleteEvent(TimeDelta duration) const {
+    return duration >= min_duration_;
+  }
+
+  TimeDelta min_duration() const { return min_duration_; }
+
+ private:
+  // Takes a token from the bucket of the rate limit, at |timestamp|.
+  bool TakeToken(TimeTicks timestamp);
+
+  const uint32_t sample_one_in_;
+  // The time between two events at the maximum rate, in nanoseconds, or zero
+  // if the rate isn't limited.
+  const int64_t event_interval_ns_;
+  const TimeDelta min_duration_;
+
+  std::atomic<uint32_t> event_count_{0};
+
+  // The bucket of the rate limit, as the time at which it will be full again,
+  // in nanoseconds. A token is available while this is less than a second in
+  // the future, and taking it moves this by |event_interval_ns_|. This is the
+  // virtual scheduling form of the token bucket, which fits in one atomic.
+  std::atomic<int64_t> bucket_full_time_ns_{0};
+};
+
+}  // namespace trace_event
+}  // namespace base
+
+#endif  // BASE_TRACE_EVENT_TRACE_EVENT_SAMPLER_H_
@@ -0,0 +1,123 @@
+// Copyright 2021 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "base/trace_event/trace_event_sampler.h"
+
+#include "base/trace_event/common/trace_event_common.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace base {
+namespace trace_event {
+
+namespace {
+
+int CountAddedEvents(TraceEventSampler* sampler,
+                     char phase,
+                     int num_events,
+                     TimeTicks timestamp,
+                     TimeDelta interval) {
+  int added = 0;
+  for (int i = 0; i < num_events; ++i) {
+    if (sampler->ShouldAddEvent(phase, timestamp + interval * i))
+      ++added;
+  }
+  return added;
+}
+
+}  // namespace
+
+TEST(TraceEventSamplerTest, KeepsAllEventsByDefault) {
+  TraceEventSampler sampler{TraceConfig::EventSamplingConfig()};
+  EXPECT_EQ(100, CountAddedEvents(&sampler, TRACE_EVENT_PHASE_COMPLETE, 100,
+                                  TimeTicks::Now(), TimeDelta()));
+  EXPECT_TRUE(sampler.ShouldKeepCompleteEvent(TimeDelta()));
+}
+
+TEST(TraceEventSamplerTest, SampleOneIn) {
+  TraceConfig::EventSamplingConfig config;
+  config.set_sample_one_in(10);
+  TraceEventSampler sampler(config);
+  const TimeTicks now = TimeTicks::Now();
+  EXPECT_EQ(10, CountAddedEvents(&sampler, TRACE_EVENT_PHASE_COMPLETE, 100,
+                                 now, TimeDelta()));
+  EXPECT_EQ(10, CountAddedEvents(&sampler, TRACE_EVENT_PHASE_INSTANT, 100, now,
+                                 TimeDelta()));
+  EXPECT_EQ(10, CountAddedEvents(&sampler, TRACE_EVENT_PHASE_COUNTER, 100, now,
+                                 TimeDelta()));
+
+  // The paired phases are always kept.
+  EXPECT_EQ(100, CountAddedEvents(&sampler, TRACE_EVENT_PHASE_BEGIN, 100, now,
+                                  TimeDelta()));
+  EXPECT_EQ(100, CountAddedEvents(&sampler, TRACE_EVENT_PHASE_END, 100, now,
+                                  TimeDelta()));
+  EXPECT_EQ(100, CountAddedEvents(&sampler, TRACE_EVENT_PHASE_ASYNC_BEGIN, 100,
+                                  now, TimeDelta()));
+}
+
+TEST(TraceEventSamplerTest, MaxEventsPerSecond) {
+  TraceConfig::EventSamplingConfig config;
+  config.set_max_events_per_second(100);
+  TraceEventSampler sampler(config);
+  TimeTicks now = TimeTicks::Now();
+
+  // A burst takes the whole bucket.
+  EXPECT_EQ(100, CountAddedEvents(&sampler, TRACE_EVENT_PHASE_INSTANT, 1000,
+                                  now, TimeDelta()));
+  // Which refills at the maximum rate.
+  now += Milliseconds(100);
+  EXPECT_EQ(10, CountAddedEvents(&sampler, TRACE_EVENT_PHASE_INSTANT, 1000,
+                                 now, TimeDelta()));
+  // Events at the maximum rate are all kept.
+  now += Seconds(1);
+  EXPECT_EQ(1000, CountAddedEvents(&sampler, TRACE_EVENT_PHASE_INSTANT, 1000,
+                                   now, Milliseconds(10)));
+  // Events at twice the rate empty the bucket, then one out of two is kept
+  // until the last one, 4995 ms later.
+  now += Seconds(20);
+  EXPECT_EQ(100 + 499, CountAddedEvents(&sampler, TRACE_EVENT_PHASE_INSTANT,
+                                        1000, now, Milliseconds(5)));
+}
+
+TEST(TraceEventSamplerTest, SampleOneInThenMaxEventsPerSecond) {
+  TraceConfig::EventSamplingConfig config;
+  config.set_sample_one_in(2);
+  config.set_max_events_per_second(10);
+  TraceEventSampler sampler(config);
+  EXPECT_EQ(10, CountAddedEvents(&sampler, TRACE_EVENT_PHASE_COMPLETE, 100,
+                                 TimeTicks::Now(), TimeDelta()));
+}
+
+// The one-in-N sampling is decided without a timestamp, and the events it
+// drops don't take tokens.
+TEST(TraceEventSamplerTest, SampleOneInWithoutTimestamp) {
+  TraceConfig::EventSamplingConfig config;
+  config.set_sample_one_in(10);
+  config.set_max_events_per_second(1);
+  TraceEventSampler sampler(config);
+  int sampled = 0;
+  for (int i = 0; i < 100; ++i) {
+    if (sampler.ShouldSampleEvent(TRACE_EVENT_PHASE_COMPLETE))
+      ++sampled;
+  }
+  EXPECT_EQ(10, sampled);
+  EXPECT_TRUE(sampler.ShouldSampleEvent(TRACE_EVENT_PHASE_BEGIN));
+
+  const TimeTicks now = TimeTicks::Now();
+  EXPECT_TRUE(sampler.IsWithinRateLimit(TRACE_EVENT_PHASE_COMPLETE, now));
+  EXPECT_FALSE(sampler.IsWithinRateLimit(TRACE_EVENT_PHASE_COMPLETE, now));
+  EXPECT_TRUE(sampler.IsWithinRateLimit(TRACE_EVENT_PHASE_END, now));
+}
+
+TEST(TraceEventSamplerTest, MinDuration) {
+  TraceConfig::EventSamplingConfig config;
+  config.set_min_duration(Microseconds(50));
+  TraceEventSampler sampler(config);
+  EXPECT_FALSE(sampler.ShouldKeepCompleteEvent(Microseconds(49)));
+  EXPECT_TRUE(sampler.ShouldKeepCompleteEvent(Microseconds(50)));
+  EXPECT_TRUE(sampler.ShouldAddEvent(TRACE_EVENT_PHASE_COMPLETE,
+                                     TimeTicks::Now()));
+}
+
+}  // namespace trace_event
+}  // namespace base
@@ -9,10 +9,13 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include <algorithm>
+#include <atomic>
 #include <cstdlib>
 #include <limits>
 #include <map>
 #include <memory>
+#include <set>
 #include <utility>
 #include <vector>
 
@@ -33,6 +36,7 @@
 #include "base/synchronization/waitable_event.h"
 #include "base/task/single_thread_task_runner.h"
 #include "base/threading/platform_thread.h"
+#include "base/threading/simple_thread.h"
 #include "base/threading/thread.h"
 #include "base/time/time.h"
 #include "base/trace_event/event_name_filter.h"
@@ -129,8 +133,8 @@ class TraceEventTestFixture : public testing::Test {
     flush_complete_event.Wait();
   }
 
-  // Used when testing thread-local buffers which requires the thread initiating
-  // flush to have a message loop.
+  // Used when testing thread-local buffers, to flush from another thread than
+  // the ones adding events.
   void EndTraceAndFlushInThreadWithMessageLoop() {
     WaitableEvent flush_complete_event(
         WaitableEvent::ResetPolicy::AUTOMATIC,
@@ -2312,6 +2316,233 @@ TEST_F(TraceEventTestFixture, TraceBufferRingBufferFullIteration) {
   TraceLog::GetInstance()->SetDisabled();
 }
 
+// Threads recycle the chunks of a small ring buffer at once, while another
+// thread reads their events. Meant to run under ThreadSanitizer too.
+TEST_F(TraceEventTestFixture, TraceBufferRingBufferConcurrentGetReturnChunk) {
+  static constexpr size_t kNumChunks = 16;
+  constexpr int kNumThreads = 4;
+  constexpr int kIterations = 20000;
+  std::unique_ptr<TraceBuffer> buffer(
+      TraceBuffer::CreateTraceBufferRingBuffer(kNumChunks));
+  ASSERT_TRUE(buffer->IsLockFree());
+  std::atomic_bool in_flight[kNumChunks] = {};
+  std::atomic<uint32_t> last_handle_seq{0};
+  std::atomic<size_t> last_handle_index{0};
+
+  class RecycleThread : public SimpleThread {
+   public:
+    RecycleThread(TraceBuffer* buffer,
+                  std::atomic_bool* in_flight,
+                  std::atomic<uint32_t>* last_handle_seq,
+                  std::atomic<size_t>* last_handle_index)
+        : SimpleThread("RecycleThread"),
+          buffer_(buffer),
+          in_flight_(in_flight),
+          last_handle_seq_(last_handle_seq),
+          last_handle_index_(last_handle_index) {}
+
+    // SimpleThread:
+    void Run() override {
+      uint32_t last_seq = 0;
+      for (int i = 0; i < kIterations; ++i) {
+        size_t chunk_index;
+        std::unique_ptr<TraceBufferChunk> chunk =
+            buffer_->GetChunk(&chunk_index);
+        ASSERT_TRUE(chunk);
+        ASSERT_LT(chunk_index, kNumChunks);
+        // No other thread has the chunk.
+        ASSERT_FALSE(in_flight_[chunk_index].exchange(true));
+        ASSERT_EQ(0u, chunk->size());
+        ASSERT_NE(last_seq, chunk->seq());
+        last_seq = chunk->seq();
+
+        size_t event_index;
+        chunk->AddTraceEvent(&event_index);
+        last_handle_index_->store(chunk_index, std::memory_order_relaxed);
+        last_handle_seq_->store(chunk->seq(), std::memory_order_relaxed);
+
+        in_flight_[chunk_index].store(false);
+        buffer_->ReturnChunk(chunk_index, std::move(chunk));
+      }
+    }
+
+   private:
+    TraceBuffer* const buffer_;
+    std::atomic_bool* const in_flight_;
+    std::atomic<uint32_t>* const last_handle_seq_;
+    std::atomic<size_t>* const last_handle_index_;
+  };
+
+  std::vector<std::unique_ptr<RecycleThread>> threads;
+  for (int i = 0; i < kNumThreads; ++i) {
+    threads.push_back(std::make_unique<RecycleThread>(
+        buffer.get(), in_flight, &last_handle_seq, &last_handle_index));
+    threads.back()->Start();
+  }
+
+  // Events are read like TraceLog::UpdateTraceEventDuration() does: a chunk
+  // can't be recycled while one of its events is in use.
+  for (int i = 0; i < kIterations; ++i) {
+    TraceEventHandle handle;
+    handle.chunk_seq = last_handle_seq.load(std::memory_order_relaxed);
+    handle.chunk_index = static_cast<unsigned>(
+        last_handle_index.load(std::memory_order_relaxed));
+    handle.event_index = 0;
+    if (!handle.chunk_seq)
+      continue;
+    TraceEvent* event = buffer->GetEventByHandle(handle);
+    if (!event)
+      continue;
+    EXPECT_FALSE(in_flight[handle.chunk_index].load());
+    PlatformThread::YieldCurrentThread();
+    EXPECT_FALSE(in_flight[handle.chunk_index].load());
+    buffer->ReleaseEventByHandle(handle);
+  }
+
+  for (auto& thread : threads)
+    thread->Join();
+
+  // Every chunk was returned, with a different sequence number.
+  EXPECT_EQ(kNumChunks * TraceBufferChunk::kTraceBufferChunkSize,
+            buffer->Size());
+  std::set<uint32_t> seqs;
+  while (const TraceBufferChunk* chunk = buffer->NextChunk()) {
+    EXPECT_EQ(1u, chunk->size());
+    EXPECT_TRUE(seqs.insert(chunk->seq()).second);
+  }
+  EXPECT_EQ(kNumChunks, seqs.size());
+}
+
+// Threads without a message loop recycle the chunks of the ring buffer without
+// TraceLog's lock.
+TEST_F(TraceEventTestFixture, TraceRecordContinuouslyManyThreads) {
+  constexpr int kNumThreads = 4;
+  constexpr int kNumEvents = 20000;
+
+  class TraceThread : public SimpleThread {
+   public:
+    explicit TraceThread(int thread_index)
+        : SimpleThread("TraceThread"), thread_index_(thread_index) {}
+
+    // SimpleThread:
+    void Run() override {
+      for (int i = 0; i < kNumEvents; ++i) {
+        TRACE_EVENT2("test_all", "ring event", "thread", thread_index_,
+                     "event", i);
+      }
+    }
+
+   private:
+    const int thread_index_;
+  };
+
+  TraceConfig config(kRecordAllCategoryFilter, RECORD_CONTINUOUSLY);
+  config.SetTraceBufferSizeInEvents(64 *
+                                    TraceBufferChunk::kTraceBufferChunkSize);
+  TraceLog::GetInstance()->SetEnabled(config, TraceLog::RECORDING_MODE);
+  std::vector<std::unique_ptr<TraceThread>> threads;
+  for (int i = 0; i < kNumThreads; ++i) {
+    threads.push_back(std::make_unique<TraceThread>(i));
+    threads.back()->Start();
+  }
+  for (auto& thread : threads)
+    thread->Join();
+  EndTraceAndFlush();
+
+  // The buffer kept some of the events, each of them once.
+  std::set<std::pair<int, int>> events;
+  for (const Value& value : trace_parsed_.GetList()) {
+    const std::string* name = value.FindStringKey("name");
+    ASSERT_TRUE(name);
+    if (*name != "ring event")
+      continue;
+    absl::optional<int> thread_index = value.FindIntPath("args.thread");
+    absl::optional<int> event = value.FindIntPath("args.event");
+    ASSERT_TRUE(thread_index);
+    ASSERT_TRUE(event);
+    EXPECT_TRUE(value.FindKey("dur"));
+    EXPECT_TRUE(events.emplace(*thread_index, *event).second);
+  }
+  EXPECT_FALSE(events.empty());
+  EXPECT_LE(events.size(), 64 * TraceBufferChunk::kTraceBufferChunkSize);
+}
+
+TEST_F(TraceEventTestFixture, EventSampling) {
+  TraceLog::GetInstance()->SetEnabled(
+      TraceConfig("{\"included_categories\":[\"test_a\",\"test_b\"],"
+                  "\"event_sampling\":[{\"included_categories\":[\"test_a\"],"
+                  "\"sample_one_in\":10}]}"),
+      TraceLog::RECORDING_MODE);
+  // The events of the category are counted together.
+  for (int i = 0; i < 100; ++i) {
+    TRACE_EVENT0("test_a", "sampled complete");
+  }
+  for (int i = 0; i < 100; ++i) {
+    TRACE_EVENT_INSTANT0("test_a", "sampled instant", TRACE_EVENT_SCOPE_THREAD);
+  }
+  for (int i = 0; i < 100; ++i) {
+    TRACE_EVENT_BEGIN0("test_a", "begin end");
+    TRACE_EVENT_END0("test_a", "begin end");
+    TRACE_EVENT_INSTANT0("test_b", "unsampled", TRACE_EVENT_SCOPE_THREAD);
+  }
+  EndTraceAndFlush();
+
+  EXPECT_EQ(10u, FindTraceEntries(trace_parsed_, "sampled complete").size());
+  EXPECT_EQ(10u, FindTraceEntries(trace_parsed_, "sampled instant").size());
+  EXPECT_EQ(200u, FindTraceEntries(trace_parsed_, "begin end").size());
+  EXPECT_EQ(100u, FindTraceEntries(trace_parsed_, "unsampled").size());
+}
+
+TEST_F(TraceEventTestFixture, EventSamplingMinDuration) {
+  TraceLog::GetInstance()->SetEnabled(
+      TraceConfig("{\"included_categories\":[\"test_a\",\"test_b\"],"
+                  "\"event_sampling\":[{\"included_categories\":[\"test_a\"],"
+                  "\"min_duration_us\":1000}]}"),
+      TraceLog::RECORDING_MODE);
+  {
+    TRACE_EVENT0("test_a", "long");
+    for (int i = 0; i < 10; ++i) {
+      TRACE_EVENT0("test_a", "short");
+    }
+    PlatformThread::Sleep(Milliseconds(2));
+  }
+  {
+    // Only the last event of the buffer can be removed.
+    TRACE_EVENT0("test_a", "short, followed");
+    TRACE_EVENT_INSTANT0("test_b", "instant", TRACE_EVENT_SCOPE_THREAD);
+  }
+  EndTraceAndFlush();
+
+  EXPECT_TRUE(FindNamePhase("long", "X"));
+  EXPECT_FALSE(FindNamePhase("short", "X"));
+  EXPECT_TRUE(FindNamePhase("short, followed", "X"));
+  EXPECT_TRUE(FindNamePhase("instant", "I"));
+}
+
+// The events kept by the sampler end in the filters, even when they aren't
+// added to the trace buffer.
+TEST_F(TraceEventTestFixture, EventSamplingWithFiltering) {
+  TestEventFilter::HitsCounter filter_hits_counter;
+  TestEventFilter::set_filter_return_value(false);
+  TraceLog::GetInstance()->SetFilterFactoryForTesting(TestEventFilter::Factory);
+  TraceLog::GetInstance()->SetEnabled(
+      TraceConfig("{\"included_categories\":[\"test_a\"],"
+                  "\"event_sampling\":[{\"included_categories\":[\"test_a\"],"
+                  "\"sample_one_in\":10}],"
+                  "\"event_filters\":[{\"filter_predicate\":"
+                  "\"testing_predicate\",\"included_categories\":[\"test_a\"]"
+                  "}]}"),
+      TraceLog::RECORDING_MODE | TraceLog::FILTERING_MODE);
+  for (int i = 0; i < 100; ++i) {
+    TRACE_EVENT0("test_a", "sampled complete");
+  }
+  EndTraceAndFlush();
+
+  EXPECT_EQ(10u, filter_hits_counter.filter_trace_event_hit_count);
+  EXPECT_EQ(10u, filter_hits_counter.end_event_hit_count);
+  EXPECT_FALSE(FindMatchingValue("name", "sampled complete"));
+}
+
 TEST_F(TraceEventTestFixture, TraceRecordAsMuchAsPossibleMode) {
   TraceLog::GetInstance()->SetEnabled(
     TraceConfig(kRecordAllCategoryFilter, RECORD_AS_MUCH_AS_POSSIBLE),
@@ -2338,17 +2569,15 @@ void BlockUntilStopped(WaitableEvent* task_start_event,
   task_stop_event->Wait();
 }
 
-TEST_F(TraceEventTestFixture, SetCurrentThreadBlocksMessageLoopBeforeTracing) {
+// The events of a thread whose message loop is blocked during the flush are
+// flushed, since the flush doesn't run tasks on the thread.
+TEST_F(TraceEventTestFixture, ThreadBlockedDuringFlush) {
   BeginTrace();
 
   Thread thread("1");
   WaitableEvent task_complete_event(WaitableEvent::ResetPolicy::AUTOMATIC,
                                     WaitableEvent::InitialState::NOT_SIGNALED);
   thread.Start();
-  thread.task_runner()->PostTask(
-      FROM_HERE, BindOnce(&TraceLog::SetCurrentThreadBlocksMessageLoop,
-                          Unretained(TraceLog::GetInstance())));
-
   thread.task_runner()->PostTask(
       FROM_HERE, BindOnce(&TraceWithAllMacroVariants, &task_complete_event));
   task_complete_event.Wait();
@@ -2388,38 +2617,115 @@ TEST_F(TraceEventTestFixture, ConvertTraceConfigToInternalOptions) {
                 TraceConfig("*", "trace-to-console,enable-systrace")));
 }
 
-void SetBlockingFlagAndBlockUntilStopped(WaitableEvent* task_start_event,
-                                         WaitableEvent* task_stop_event) {
-  TraceLog::GetInstance()->SetCurrentThreadBlocksMessageLoop();
-  BlockUntilStopped(task_start_event, task_stop_event);
-}
+// The events of a thread without a message loop are flushed while the thread
+// runs, and once it has exited.
+TEST_F(TraceEventTestFixture, ThreadWithoutMessageLoop) {
+  class TraceThread : public SimpleThread {
+   public:
+    TraceThread(WaitableEvent* task_complete_event,
+                WaitableEvent* task_stop_event)
+        : SimpleThread("TraceThread"),
+          task_complete_event_(task_complete_event),
+          task_stop_event_(task_stop_event) {}
+
+    // SimpleThread:
+    void Run() override {
+      TraceWithAllMacroVariants(task_complete_event_);
+      task_stop_event_->Wait();
+    }
 
-TEST_F(TraceEventTestFixture, SetCurrentThreadBlocksMessageLoopAfterTracing) {
-  BeginTrace();
+   private:
+    WaitableEvent* const task_complete_event_;
+    WaitableEvent* const task_stop_event_;
+  };
 
-  Thread thread("1");
   WaitableEvent task_complete_event(WaitableEvent::ResetPolicy::AUTOMATIC,
                                     WaitableEvent::InitialState::NOT_SIGNALED);
-  thread.Start();
-
-  thread.task_runner()->PostTask(
-      FROM_HERE, BindOnce(&TraceWithAllMacroVariants, &task_complete_event));
-  task_complete_event.Wait();
-
-  WaitableEvent task_start_event(WaitableEvent::ResetPolicy::AUTOMATIC,
-                                 WaitableEvent::InitialState::NOT_SIGNALED);
   WaitableEvent task_stop_event(WaitableEvent::ResetPolicy::AUTOMATIC,
                                 WaitableEvent::InitialState::NOT_SIGNALED);
-  thread.task_runner()->PostTask(FROM_HERE,
-                                 BindOnce(&SetBlockingFlagAndBlockUntilStopped,
-                                          &task_start_event, &task_stop_event));
-  task_start_event.Wait();
-
+  TraceThread running_thread(&task_complete_event, &task_stop_event);
+  BeginTrace();
+  running_thread.Start();
+  task_complete_event.Wait();
   EndTraceAndFlush();
   ValidateAllTraceMacrosCreatedData(trace_parsed_);
+  task_stop_event.Signal();
+  running_thread.Join();
 
+  Clear();
+  TraceThread exited_thread(&task_complete_event, &task_stop_event);
+  BeginTrace();
+  exited_thread.Start();
+  task_complete_event.Wait();
   task_stop_event.Signal();
-  thread.Stop();
+  exited_thread.Join();
+  EndTraceAndFlush();
+  ValidateAllTraceMacrosCreatedData(trace_parsed_);
+}
+
+// Flushing while other threads are still adding events, after tracing was
+// disabled, yields complete events.
+TEST_F(TraceEventTestFixture, FlushWhileThreadsAddEvents) {
+  constexpr int kNumThreads = 4;
+
+  class TraceThread : public SimpleThread {
+   public:
+    TraceThread(int thread_index, const std::atomic_bool* stop)
+        : SimpleThread("TraceThread"),
+          thread_index_(thread_index),
+          stop_(stop) {}
+
+    // SimpleThread:
+    void Run() override {
+      for (int i = 0; !stop_->load(std::memory_order_relaxed); ++i) {
+        TRACE_EVENT_INSTANT2("test_all", "multi thread event",
+                             TRACE_EVENT_SCOPE_THREAD, "thread", thread_index_,
+                             "event", i);
+        TRACE_EVENT0("test_all", "complete event");
+      }
+    }
+
+   private:
+    const int thread_index_;
+    const std::atomic_bool* const stop_;
+  };
+
+  for (int round = 0; round < 4; ++round) {
+    Clear();
+    std::atomic_bool stop{false};
+    std::vector<std::unique_ptr<TraceThread>> threads;
+    BeginTrace();
+    for (int i = 0; i < kNumThreads; ++i) {
+      threads.push_back(std::make_unique<TraceThread>(i, &stop));
+      threads.back()->Start();
+    }
+    PlatformThread::Sleep(Milliseconds(1));
+    EndTraceAndFlush();
+    stop.store(true, std::memory_order_relaxed);
+    for (auto& thread : threads)
+      thread->Join();
+
+    // The events of each thread are numbered from 0 with no gap, except for
+    // the events added after the flush, which are dropped.
+    std::map<int, std::vector<int>> events_by_thread;
+    for (const Value& value : trace_parsed_.GetList()) {
+      const std::string* name = value.FindStringKey("name");
+      ASSERT_TRUE(name);
+      if (*name != "multi thread event")
+        continue;
+      absl::optional<int> thread_index = value.FindIntPath("args.thread");
+      absl::optional<int> event = value.FindIntPath("args.event");
+      ASSERT_TRUE(thread_index);
+      ASSERT_TRUE(event);
+      events_by_thread[*thread_index].push_back(*event);
+    }
+    for (auto& thread_events : events_by_thread) {
+      std::vector<int>& events = thread_events.second;
+      std::sort(events.begin(), events.end());
+      for (size_t i = 0; i < events.size(); ++i)
+        ASSERT_EQ(static_cast<int>(i), events[i]);
+    }
+  }
 }
 
 TEST_F(TraceEventTestFixture, ThreadOnceBlocking) {
@@ -2443,15 +2749,15 @@ TEST_F(TraceEventTestFixture, ThreadOnceBlocking) {
       BindOnce(&BlockUntilStopped, &task_start_event, &task_stop_event));
   task_start_event.Wait();
 
-  // The thread will timeout in this flush.
+  // The thread doesn't need to run a task for this flush.
   EndTraceAndFlushInThreadWithMessageLoop();
+  ValidateAllTraceMacrosCreatedData(trace_parsed_);
   Clear();
 
   // Let the thread's message loop continue to spin.
   task_stop_event.Signal();
 
-  // The following sequence ensures that the FlushCurrentThread task has been
-  // executed in the thread before continuing.
+  // The following sequence ensures that the thread is idle before continuing.
   thread.task_runner()->PostTask(
       FROM_HERE,
       BindOnce(&BlockUntilStopped, &task_start_event, &task_stop_event));
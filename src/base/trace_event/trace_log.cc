@@ -14,6 +14,7 @@
 #include "base/bind.h"
 #include "base/command_line.h"
 #include "base/containers/contains.h"
+#include "base/containers/cxx20_erase_vector.h"
 #include "base/debug/leak_annotations.h"
 #include "base/location.h"
 #include "base/logging.h"
@@ -28,15 +29,15 @@
 #include "base/strings/string_tokenizer.h"
 #include "base/strings/stringprintf.h"
 #include "base/system/sys_info.h"
-#include "base/task/current_thread.h"
 #include "base/task/post_task.h"
 #include "base/task/thread_pool.h"
 #include "base/threading/platform_thread.h"
-#include "base/threading/sequenced_task_runner_handle.h"
 #include "base/threading/thread_id_name_manager.h"
 #include "base/threading/thread_task_runner_handle.h"
 #include "base/time/time.h"
+#include "base/trace_event/compact_trace_writer.h"
 #include "base/trace_event/event_name_filter.h"
+#include "base/trace_event/flight_recorder.h"
 #include "base/trace_event/heap_profiler.h"
 #include "base/trace_event/heap_profiler_allocation_context_tracker.h"
 #include "base/trace_event/memory_dump_manager.h"
@@ -45,6 +46,7 @@
 #include "base/trace_event/thread_instruction_count.h"
 #include "base/trace_event/trace_buffer.h"
 #include "base/trace_event/trace_event.h"
+#include "base/trace_event/trace_event_sampler.h"
 #include "build/build_config.h"
 
 #if BUILDFLAG(USE_PERFETTO_CLIENT_LIBRARY)
@@ -94,9 +96,6 @@ const size_t kTraceEventRingBufferChunks = kTraceEventVectorBufferChunks / 4;
 const size_t kEchoToConsoleTraceEventBufferChunks = 256;
 
 const size_t kTraceEventBufferSizeInBytes = 100 * 1024;
-#if !BUILDFLAG(USE_PERFETTO_CLIENT_LIBRARY)
-const int kThreadFlushTimeoutMs = 3000;
-#endif
 
 #if BUILDFLAG(USE_PERFETTO_CLIENT_LIBRARY)
 static bool g_perfetto_initialized_by_tracelog;
@@ -112,6 +111,16 @@ std::vector<std::unique_ptr<TraceEventFilter>>& GetCategoryGroupFilters() {
   return *filters;
 }
 
+// Indexed by TraceCategory::sampler_index().
+constexpr size_t kMaxTraceEventSamplers = 32;
+
+// List of TraceEventSampler objects from the most recent tracing session.
+std::vector<std::unique_ptr<TraceEventSampler>>& GetCategoryGroupSamplers() {
+  static auto* samplers =
+      new std::vector<std::unique_ptr<TraceEventSampler>>();
+  return *samplers;
+}
+
 ThreadTicks ThreadNow() {
   return ThreadTicks::IsSupported()
              ? base::subtle::ThreadTicksNowIgnoringOverride()
@@ -490,134 +499,202 @@ class TraceLog::OptionalAutoLock {
   bool locked_ = false;
 };
 
-class TraceLog::ThreadLocalEventBuffer
-    : public CurrentThread::DestructionObserver,
-      public MemoryDumpProvider {
+// The event buffer of a thread, which is created for every thread that adds
+// trace events. The thread adds events to its chunk without taking |lock_|,
+// except to get a new chunk from a trace buffer which isn't lock-free. Flush()
+// takes the chunk back from any thread: it waits until the owner thread is not
+// writing to the chunk, and from then on, the buffer doesn't accept events
+// anymore. |state_| implements this handshake, which also lets the owner
+// thread use |logged_events_| without |lock_| while writing, since it is only
+// replaced after the handshake.
+class TraceLog::ThreadLocalEventBuffer {
  public:
   explicit ThreadLocalEventBuffer(TraceLog* trace_log);
   ThreadLocalEventBuffer(const ThreadLocalEventBuffer&) = delete;
   ThreadLocalEventBuffer& operator=(const ThreadLocalEventBuffer&) = delete;
-  ~ThreadLocalEventBuffer() override;
+  ~ThreadLocalEventBuffer();
+
+  // Called when the owner thread exits.
+  static void OnThreadExit(void* buffer) {
+    delete static_cast<ThreadLocalEventBuffer*>(buffer);
+  }
 
+  // Returns a new event, or nullptr if the buffer was flushed or the trace
+  // buffer is full. When an event is returned, the buffer is left in the
+  // writing state, and the caller must call EndWrite() once it has filled the
+  // event.
   TraceEvent* AddTraceEvent(TraceEventHandle* handle);
 
-  TraceEvent* GetEventByHandle(TraceEventHandle handle) {
-    if (!chunk_ || handle.chunk_seq != chunk_->seq() ||
-        handle.chunk_index != chunk_index_) {
+  // Returns the event of |handle| if it is in the chunk of this buffer, in
+  // which case the buffer is left in the writing state, and the caller must
+  // call EndWrite() once it has updated the event.
+  TraceEvent* BeginUpdate(TraceEventHandle handle) {
+    if (!BeginWrite())
       return nullptr;
-    }
+    TraceEvent* trace_event = GetEventByHandle(handle);
+    if (!trace_event)
+      EndWrite();
+    return trace_event;
+  }
 
-    return chunk_->GetEventAt(handle.event_index);
+  void EndWrite() { state_.store(State::kIdle, std::memory_order_release); }
+
+  // Removes the event of |handle| if it is the last event of the chunk of this
+  // buffer. Only called in the writing state, after BeginUpdate(|handle|).
+  void RemoveLastEvent(TraceEventHandle handle) {
+    DCHECK(GetEventByHandle(handle));
+    if (handle.event_index + 1u == chunk_->size())
+      chunk_->RemoveLastEvent();
   }
 
+  // Waits until the owner thread isn't writing, then returns the chunk to the
+  // trace buffer. Can be called from any thread.
+  void FlushWhileLocked();
+
+  bool has_chunk_while_locked() const { return !!chunk_; }
+
   int generation() const { return generation_; }
 
  private:
-  // CurrentThread::DestructionObserver
-  void WillDestroyCurrentMessageLoop() override;
+  enum class State {
+    // The owner thread isn't using the chunk.
+    kIdle,
+    // The owner thread is adding or updating an event in the chunk. It must
+    // not acquire |lock_| in this state, since Flush() waits for the state to
+    // change while holding it.
+    kWriting,
+    // The chunk was taken by Flush(). The buffer is deleted by its owner
+    // thread once it notices the generation change.
+    kFlushed,
+  };
 
-  // MemoryDumpProvider implementation.
-  bool OnMemoryDump(const MemoryDumpArgs& args,
-                    ProcessMemoryDump* pmd) override;
+  // Only called on the owner thread. Fails if the buffer was flushed.
+  bool BeginWrite() {
+    State expected = State::kIdle;
+    return state_.compare_exchange_strong(expected, State::kWriting,
+                                          std::memory_order_acquire,
+                                          std::memory_order_relaxed);
+  }
 
-  void FlushWhileLocked();
+  TraceEvent* GetEventByHandle(TraceEventHandle handle) {
+    if (!chunk_ || handle.chunk_seq != chunk_->seq() ||
+        handle.chunk_index != chunk_index_) {
+      return nullptr;
+    }
 
-  void CheckThisIsCurrentBuffer() const {
-    DCHECK(trace_log_->thread_local_event_buffer_.Get() == this);
+    return chunk_->GetEventAt(handle.event_index);
   }
 
+  void ReturnChunkWhileLocked();
+  // Only called on the owner thread in the writing state, or while holding
+  // |lock_|.
+  void ReturnChunk();
+
   // Since TraceLog is a leaky singleton, trace_log_ will always be valid
   // as long as the thread exists.
   TraceLog* trace_log_;
+  std::atomic<State> state_{State::kIdle};
+  // Only replaced on the owner thread in the writing state, or while holding
+  // |lock_| after the handshake of Flush().
   std::unique_ptr<TraceBufferChunk> chunk_;
   size_t chunk_index_ = 0;
-  int generation_;
+  int generation_ = 0;
 };
 
 TraceLog::ThreadLocalEventBuffer::ThreadLocalEventBuffer(TraceLog* trace_log)
-    : trace_log_(trace_log),
-      generation_(trace_log->generation()) {
-  // ThreadLocalEventBuffer is created only if the thread has a message loop, so
-  // the following message_loop won't be NULL.
-  CurrentThread::Get()->AddDestructionObserver(this);
-
-  // This is to report the local memory usage when memory-infra is enabled.
-  MemoryDumpManager::GetInstance()->RegisterDumpProvider(
-      this, "ThreadLocalEventBuffer", ThreadTaskRunnerHandle::Get());
-
-  int thread_id = static_cast<int>(PlatformThread::CurrentId());
-
+    : trace_log_(trace_log) {
+  // The generation is read while holding |lock_|, so that it matches the trace
+  // buffer until the next handshake.
   AutoLock lock(trace_log->lock_);
-  trace_log->thread_task_runners_[thread_id] = ThreadTaskRunnerHandle::Get();
+  generation_ = trace_log->generation();
+  trace_log->thread_local_event_buffers_.push_back(this);
 }
 
 TraceLog::ThreadLocalEventBuffer::~ThreadLocalEventBuffer() {
-  CheckThisIsCurrentBuffer();
-  CurrentThread::Get()->RemoveDestructionObserver(this);
-  MemoryDumpManager::GetInstance()->UnregisterDumpProvider(this);
-
-  {
-    AutoLock lock(trace_log_->lock_);
-    FlushWhileLocked();
+  DCHECK_NE(State::kWriting, state_.load(std::memory_order_relaxed));
 
-    int thread_id = static_cast<int>(PlatformThread::CurrentId());
-    trace_log_->thread_task_runners_.erase(thread_id);
-  }
-  trace_log_->thread_local_event_buffer_.Set(nullptr);
+  AutoLock lock(trace_log_->lock_);
+  ReturnChunkWhileLocked();
+  base::Erase(trace_log_->thread_local_event_buffers_, this);
 }
 
 TraceEvent* TraceLog::ThreadLocalEventBuffer::AddTraceEvent(
     TraceEventHandle* handle) {
-  CheckThisIsCurrentBuffer();
+  if (!BeginWrite())
+    return nullptr;
 
-  if (chunk_ && chunk_->IsFull()) {
-    AutoLock lock(trace_log_->lock_);
-    FlushWhileLocked();
-    chunk_.reset();
-  }
-  if (!chunk_) {
-    AutoLock lock(trace_log_->lock_);
+  if ((!chunk_ || chunk_->IsFull()) &&
+      trace_log_->logged_events_->IsLockFree()) {
+    // Flush() waits for the writing state to end before it takes the chunk or
+    // replaces the trace buffer, so the chunk is swapped without |lock_|.
+    ReturnChunk();
     chunk_ = trace_log_->logged_events_->GetChunk(&chunk_index_);
-    trace_log_->CheckIfBufferIsFullWhileLocked();
+    if (!chunk_) {
+      EndWrite();
+      return nullptr;
+    }
+  } else if (!chunk_ || chunk_->IsFull()) {
+    // A new chunk is needed, which requires |lock_|. Flush() can't take the
+    // chunk while the lock is held, so the writing state is entered again
+    // before releasing it.
+    EndWrite();
+    AutoLock lock(trace_log_->lock_);
+    if (!BeginWrite())
+      return nullptr;
+    if (chunk_ && chunk_->IsFull())
+      ReturnChunkWhileLocked();
+    if (!chunk_) {
+      chunk_ = trace_log_->logged_events_->GetChunk(&chunk_index_);
+      trace_log_->CheckIfBufferIsFullWhileLocked();
+    }
+    if (!chunk_) {
+      EndWrite();
+      return nullptr;
+    }
   }
-  if (!chunk_)
-    return nullptr;
 
   size_t event_index;
   TraceEvent* trace_event = chunk_->AddTraceEvent(&event_index);
   if (trace_event && handle)
     MakeHandle(chunk_->seq(), chunk_index_, event_index, handle);
+  if (!trace_event)
+    EndWrite();
 
   return trace_event;
 }
 
-void TraceLog::ThreadLocalEventBuffer::WillDestroyCurrentMessageLoop() {
-  delete this;
+void TraceLog::ThreadLocalEventBuffer::FlushWhileLocked() {
+  trace_log_->lock_.AssertAcquired();
+
+  State expected = State::kIdle;
+  while (!state_.compare_exchange_weak(expected, State::kFlushed,
+                                       std::memory_order_acquire,
+                                       std::memory_order_relaxed)) {
+    if (expected == State::kFlushed)
+      return;
+    // The owner thread is in the middle of adding or updating an event, which
+    // only takes a few hundred nanoseconds.
+    expected = State::kIdle;
+    PlatformThread::YieldCurrentThread();
+  }
+  ReturnChunkWhileLocked();
 }
 
-bool TraceLog::ThreadLocalEventBuffer::OnMemoryDump(const MemoryDumpArgs& args,
-                                                    ProcessMemoryDump* pmd) {
-  if (!chunk_)
-    return true;
-  std::string dump_base_name = StringPrintf(
-      "tracing/thread_%d", static_cast<int>(PlatformThread::CurrentId()));
-  TraceEventMemoryOverhead overhead;
-  chunk_->EstimateTraceMemoryOverhead(&overhead);
-  overhead.DumpInto(dump_base_name.c_str(), pmd);
-  return true;
+void TraceLog::ThreadLocalEventBuffer::ReturnChunkWhileLocked() {
+  trace_log_->lock_.AssertAcquired();
+  ReturnChunk();
 }
 
-void TraceLog::ThreadLocalEventBuffer::FlushWhileLocked() {
+void TraceLog::ThreadLocalEventBuffer::ReturnChunk() {
   if (!chunk_)
     return;
 
-  trace_log_->lock_.AssertAcquired();
   if (trace_log_->CheckGeneration(generation_)) {
     // Return the chunk to the buffer only if the generation matches.
     trace_log_->logged_events_->ReturnChunk(chunk_index_, std::move(chunk_));
   }
-  // Otherwise this method may be called from the destructor, or TraceLog will
-  // find the generation mismatch and delete this buffer soon.
+  // Otherwise, the chunk belongs to a trace buffer which was already flushed.
+  chunk_.reset();
 }
 
 void TraceLog::SetAddTraceEventOverrides(
@@ -681,6 +758,7 @@ TraceLog::TraceLog(int generation)
       process_id_(base::kNullProcessId),
       trace_options_(kInternalRecordUntilFull),
       trace_config_(TraceConfig()),
+      thread_local_event_buffer_(&ThreadLocalEventBuffer::OnThreadExit),
       thread_shared_chunk_index_(0),
       generation_(generation),
       use_worker_thread_(false) {
@@ -715,18 +793,9 @@ TraceLog::~TraceLog() {
 #endif  // BUILDFLAG(USE_PERFETTO_CLIENT_LIBRARY)
 }
 
-void TraceLog::InitializeThreadLocalEventBufferIfSupported() {
-  // A ThreadLocalEventBuffer needs the message loop with a task runner
-  // - to know when the thread exits;
-  // - to handle the final flush.
-  // For a thread without a message loop or if the message loop may be blocked,
-  // the trace events will be added into the main buffer directly.
-  if (thread_blocks_message_loop_.Get() || !CurrentThread::IsSet() ||
-      !ThreadTaskRunnerHandle::IsSet()) {
-    return;
-  }
+TraceLog::ThreadLocalEventBuffer* TraceLog::InitializeThreadLocalEventBuffer() {
   HEAP_PROFILER_SCOPED_IGNORE;
-  auto* thread_local_event_buffer = thread_local_event_buffer_.Get();
+  auto* thread_local_event_buffer = GetThreadLocalEventBuffer();
   if (thread_local_event_buffer &&
       !CheckGeneration(thread_local_event_buffer->generation())) {
     delete thread_local_event_buffer;
@@ -736,6 +805,11 @@ void TraceLog::InitializeThreadLocalEventBufferIfSupported() {
     thread_local_event_buffer = new ThreadLocalEventBuffer(this);
     thread_local_event_buffer_.Set(thread_local_event_buffer);
   }
+  return thread_local_event_buffer;
+}
+
+TraceLog::ThreadLocalEventBuffer* TraceLog::GetThreadLocalEventBuffer() const {
+  return static_cast<ThreadLocalEventBuffer*>(thread_local_event_buffer_.Get());
 }
 
 bool TraceLog::OnMemoryDump(const MemoryDumpArgs& args,
@@ -751,6 +825,15 @@ bool TraceLog::OnMemoryDump(const MemoryDumpArgs& args,
 
     for (auto& metadata_event : metadata_events_)
       metadata_event->EstimateTraceMemoryOverhead(&overhead);
+
+    // The events in the chunks of the thread-local buffers can't be read
+    // while their threads write them, so only the chunks are accounted for.
+    for (const ThreadLocalEventBuffer* buffer : thread_local_event_buffers_) {
+      if (buffer->has_chunk_while_locked()) {
+        overhead.Add(TraceEventMemoryOverhead::kTraceBufferChunk,
+                     sizeof(TraceBufferChunk));
+      }
+    }
   }
   overhead.AddSelf();
   overhead.DumpInto("tracing/main_trace_log", pmd);
@@ -818,6 +901,28 @@ void TraceLog::UpdateCategoryState(TraceCategory* category) {
   }
 #endif
 
+  if (enabled_modes_ & FLIGHT_RECORDER_MODE &&
+      enabled_flight_recorder_config_.IsCategoryGroupEnabled(
+          category->name())) {
+    state_flags |= TraceCategory::ENABLED_FOR_FLIGHT_RECORDER;
+  }
+
+  // The metadata events are never sampled.
+  uint8_t sampler_index = 0;
+  if (state_flags & TraceCategory::ENABLED_FOR_RECORDING &&
+      category != CategoryRegistry::kCategoryMetadata) {
+    const TraceConfig::EventSamplingRules& rules =
+        trace_config_.event_sampling_rules();
+    for (size_t i = 0; i < GetCategoryGroupSamplers().size(); ++i) {
+      if (rules[i].IsCategoryGroupEnabled(category->name())) {
+        state_flags |= TraceCategory::SAMPLED_FOR_RECORDING;
+        sampler_index = static_cast<uint8_t>(i);
+        break;
+      }
+    }
+  }
+  category->set_sampler_index(sampler_index);
+
   uint32_t enabled_filters_bitmap = 0;
   int index = 0;
   for (const auto& event_filter : enabled_event_filters_) {
@@ -838,6 +943,7 @@ void TraceLog::UpdateCategoryState(TraceCategory* category) {
 void TraceLog::UpdateCategoryRegistry() {
   lock_.AssertAcquired();
   CreateFiltersForTraceConfig();
+  CreateSamplersForTraceConfig();
   for (TraceCategory& category : CategoryRegistry::GetAllCategories()) {
     UpdateCategoryState(&category);
   }
@@ -874,6 +980,69 @@ void TraceLog::CreateFiltersForTraceConfig() {
   }
 }
 
+void TraceLog::CreateSamplersForTraceConfig() {
+  if (!(enabled_modes_ & RECORDING_MODE))
+    return;
+
+  // Like the filters, the samplers can't be changed while trace events could
+  // be using them. The rules merged into a config which is already recording
+  // are ignored.
+  if (GetCategoryGroupSamplers().size())
+    return;
+
+  for (const auto& rule : trace_config_.event_sampling_rules()) {
+    if (GetCategoryGroupSamplers().size() >= kMaxTraceEventSamplers) {
+      NOTREACHED() << "Too many trace event sampling rules";
+      break;
+    }
+    GetCategoryGroupSamplers().push_back(
+        std::make_unique<TraceEventSampler>(rule));
+  }
+}
+
+// static
+bool TraceLog::ShouldSampleEventSlow(
+    char phase,
+    const unsigned char* category_group_enabled) {
+  const TraceCategory* category =
+      CategoryRegistry::GetCategoryByStatePtr(category_group_enabled);
+  const size_t index = category->sampler_index();
+  return index >= GetCategoryGroupSamplers().size() ||
+         GetCategoryGroupSamplers()[index]->ShouldSampleEvent(phase);
+}
+
+bool TraceLog::ShouldAddSampledEvent(
+    char phase,
+    const unsigned char* category_group_enabled,
+    const TimeTicks& timestamp,
+    unsigned int flags) {
+  if (LIKELY(!(*category_group_enabled &
+               TraceCategory::SAMPLED_FOR_RECORDING))) {
+    return true;
+  }
+  const TraceCategory* category =
+      CategoryRegistry::GetCategoryByStatePtr(category_group_enabled);
+  const size_t index = category->sampler_index();
+  if (index >= GetCategoryGroupSamplers().size())
+    return true;
+  TraceEventSampler* sampler = GetCategoryGroupSamplers()[index].get();
+  if (flags & TRACE_EVENT_FLAG_EXPLICIT_TIMESTAMP &&
+      !sampler->ShouldSampleEvent(phase)) {
+    return false;
+  }
+  return sampler->IsWithinRateLimit(phase, timestamp);
+}
+
+bool TraceLog::IsSampledEventTooShort(
+    const unsigned char* category_group_enabled,
+    TimeDelta duration) {
+  const TraceCategory* category =
+      CategoryRegistry::GetCategoryByStatePtr(category_group_enabled);
+  const size_t index = category->sampler_index();
+  return index < GetCategoryGroupSamplers().size() &&
+         !GetCategoryGroupSamplers()[index]->ShouldKeepCompleteEvent(duration);
+}
+
 void TraceLog::SetEnabled(const TraceConfig& trace_config,
                           uint8_t modes_to_enable) {
   DCHECK(trace_config.process_filter_config().IsEnabled(process_id_));
@@ -967,9 +1136,6 @@ void TraceLog::SetEnabled(const TraceConfig& trace_config,
 
   SetEnabledImpl(trace_config, perfetto_config);
 #else   // !BUILDFLAG(USE_PERFETTO_CLIENT_LIBRARY)
-  // Can't enable tracing when Flush() is in progress.
-  DCHECK(!flush_task_runner_);
-
   InternalTraceOptions new_options =
       GetInternalOptionsFromTraceConfig(trace_config);
 
@@ -987,6 +1153,9 @@ void TraceLog::SetEnabled(const TraceConfig& trace_config,
   // when disabling, could try to use the filters.
   if (!enabled_modes_)
     GetCategoryGroupFilters().clear();
+  // Same for the samplers, which only apply to recording.
+  if (!(enabled_modes_ & RECORDING_MODE))
+    GetCategoryGroupSamplers().clear();
 
   // Update trace config for recording.
   const bool already_recording = enabled_modes_ & RECORDING_MODE;
@@ -1008,6 +1177,18 @@ void TraceLog::SetEnabled(const TraceConfig& trace_config,
   // empty).
   trace_config_.SetEventFilters(enabled_event_filters_);
 
+  // Same for the flight recorder categories.
+  if (modes_to_enable & FLIGHT_RECORDER_MODE &&
+      enabled_flight_recorder_config_.empty()) {
+    FlightRecorder* flight_recorder = FlightRecorder::Get();
+    DCHECK(flight_recorder) << "The flight recorder must be created first";
+    if (flight_recorder) {
+      enabled_flight_recorder_config_ = trace_config.flight_recorder_config();
+      flight_recorder->SetMaxAge(enabled_flight_recorder_config_.max_age());
+    }
+  }
+  trace_config_.SetFlightRecorderConfig(enabled_flight_recorder_config_);
+
   enabled_modes_ |= modes_to_enable;
   UpdateCategoryRegistry();
 
@@ -1204,6 +1385,9 @@ void TraceLog::SetDisabledWhileLocked(uint8_t modes_to_disable) {
   if (modes_to_disable & FILTERING_MODE)
     enabled_event_filters_.clear();
 
+  if (modes_to_disable & FLIGHT_RECORDER_MODE)
+    enabled_flight_recorder_config_.Clear();
+
   if (modes_to_disable & RECORDING_MODE)
     trace_config_.Clear();
 
@@ -1338,29 +1522,38 @@ void TraceLog::CheckIfBufferIsFullWhileLocked() {
 }
 
 // Flush() works as the following:
-// 1. Flush() is called in thread A whose task runner is saved in
-//    flush_task_runner_;
-// 2. If thread_message_loops_ is not empty, thread A posts task to each message
-//    loop to flush the thread local buffers; otherwise finish the flush;
-// 3. FlushCurrentThread() deletes the thread local event buffer:
-//    - The last batch of events of the thread are flushed into the main buffer;
-//    - The message loop will be removed from thread_message_loops_;
-//    If this is the last message loop, finish the flush;
-// 4. If any thread hasn't finish its flush in time, finish the flush.
+// 1. Flush() is called in thread A after tracing was disabled;
+// 2. Thread A takes the chunk of each thread local buffer, waiting for the
+//    threads which are in the middle of adding an event, and returns it to the
+//    main buffer. The threads don't need to run tasks, or even to have a
+//    message loop;
+// 3. The flushed thread local buffers don't accept events anymore. Each thread
+//    replaces its buffer when it adds its next event, since the generation of
+//    the main buffer changes in the next step;
+// 4. Thread A finishes the flush.
 void TraceLog::Flush(const TraceLog::OutputCallback& cb,
                      bool use_worker_thread) {
-  FlushInternal(cb, use_worker_thread, false);
+  FlushInternal(cb, use_worker_thread, false, FlushFormat::kJSON);
+}
+
+#if !BUILDFLAG(USE_PERFETTO_CLIENT_LIBRARY)
+void TraceLog::FlushCompact(const TraceLog::OutputCallback& cb,
+                            bool use_worker_thread) {
+  FlushInternal(cb, use_worker_thread, false, FlushFormat::kCompact);
 }
+#endif  // !BUILDFLAG(USE_PERFETTO_CLIENT_LIBRARY)
 
 void TraceLog::CancelTracing(const OutputCallback& cb) {
   SetDisabled();
-  FlushInternal(cb, false, true);
+  FlushInternal(cb, false, true, FlushFormat::kJSON);
 }
 
 void TraceLog::FlushInternal(const TraceLog::OutputCallback& cb,
                              bool use_worker_thread,
-                             bool discard_events) {
+                             bool discard_events,
+                             FlushFormat format) {
   use_worker_thread_ = use_worker_thread;
+  flush_format_ = format;
 
 #if BUILDFLAG(USE_PERFETTO_CLIENT_LIBRARY) && !defined(OS_NACL)
   perfetto::TrackEvent::Flush();
@@ -1408,10 +1601,9 @@ void TraceLog::FlushInternal(const TraceLog::OutputCallback& cb,
   CHECK(false) << "JSON tracing isn't supported on NaCL";
 #else   // !BUILDFLAG(USE_PERFETTO_CLIENT_LIBRARY)
   if (IsEnabled()) {
-    // Can't flush when tracing is enabled because otherwise PostTask would
-    // - generate more trace events;
-    // - deschedule the calling thread on some platforms causing inaccurate
-    //   timing of the trace events.
+    // Can't flush when tracing is enabled because otherwise the threads would
+    // keep adding events, which the flush would have to wait for, and their
+    // thread local buffers would have to be replaced after each flush.
     scoped_refptr<RefCountedString> empty_result = new RefCountedString;
     if (!cb.is_null())
       cb.Run(empty_result, false);
@@ -1420,15 +1612,8 @@ void TraceLog::FlushInternal(const TraceLog::OutputCallback& cb,
   }
 
   int gen = generation();
-  // Copy of thread_task_runners_ to be used without locking.
-  std::vector<scoped_refptr<SingleThreadTaskRunner>> task_runners;
   {
     AutoLock lock(lock_);
-    DCHECK(!flush_task_runner_);
-    flush_task_runner_ = SequencedTaskRunnerHandle::IsSet()
-                             ? SequencedTaskRunnerHandle::Get()
-                             : nullptr;
-    DCHECK(thread_task_runners_.empty() || flush_task_runner_);
     flush_output_callback_ = cb;
 
     if (thread_shared_chunk_) {
@@ -1436,23 +1621,12 @@ void TraceLog::FlushInternal(const TraceLog::OutputCallback& cb,
                                   std::move(thread_shared_chunk_));
     }
 
-    for (const auto& it : thread_task_runners_)
-      task_runners.push_back(it.second);
+    FlushThreadLocalEventBuffersWhileLocked();
   }
 
-  if (!task_runners.empty()) {
-    for (auto& task_runner : task_runners) {
-      task_runner->PostTask(
-          FROM_HERE, BindOnce(&TraceLog::FlushCurrentThread, Unretained(this),
-                              gen, discard_events));
-    }
-    flush_task_runner_->PostDelayedTask(
-        FROM_HERE,
-        BindOnce(&TraceLog::OnFlushTimeout, Unretained(this), gen,
-                 discard_events),
-        Milliseconds(kThreadFlushTimeoutMs));
-    return;
-  }
+  auto on_flush_override = on_flush_override_.load(std::memory_order_relaxed);
+  if (on_flush_override)
+    on_flush_override();
 
   FinishFlush(gen, discard_events);
 #endif  // !BUILDFLAG(USE_PERFETTO_CLIENT_LIBRARY)
@@ -1521,6 +1695,26 @@ void TraceLog::ConvertTraceEventsToTraceFormat(
   flush_output_callback.Run(json_events_str_ptr, false);
 }
 
+// Usually it runs on a different thread.
+void TraceLog::ConvertTraceEventsToCompactFormat(
+    std::unique_ptr<TraceBuffer> logged_events,
+    const OutputCallback& flush_output_callback,
+    const ArgumentFilterPredicate& argument_filter_predicate) {
+  if (flush_output_callback.is_null())
+    return;
+
+  HEAP_PROFILER_SCOPED_IGNORE;
+  // Each chunk is sent as soon as it is encoded, instead of after the whole
+  // trace, to keep the memory usage low.
+  CompactTraceWriter writer(TraceLog::GetInstance()->process_id(),
+                            argument_filter_predicate, flush_output_callback);
+  while (const TraceBufferChunk* chunk = logged_events->NextChunk()) {
+    for (size_t j = 0; j < chunk->size(); ++j)
+      writer.AddEvent(*chunk->GetEventAt(j));
+  }
+  writer.Finish();
+}
+
 void TraceLog::FinishFlush(int generation, bool discard_events) {
   std::unique_ptr<TraceBuffer> previous_logged_events;
   OutputCallback flush_output_callback;
@@ -1532,11 +1726,11 @@ void TraceLog::FinishFlush(int generation, bool discard_events) {
   {
     AutoLock lock(lock_);
 
+    // Threads may have created their buffer since FlushInternal().
+    FlushThreadLocalEventBuffersWhileLocked();
     previous_logged_events.swap(logged_events_);
     UseNextTraceBuffer();
-    thread_task_runners_.clear();
 
-    flush_task_runner_ = nullptr;
     flush_output_callback = flush_output_callback_;
     flush_output_callback_.Reset();
 
@@ -1560,79 +1754,31 @@ void TraceLog::FinishFlush(int generation, bool discard_events) {
     return;
   }
 
+  auto* convert_trace_events =
+      flush_format_ == FlushFormat::kCompact
+          ? &TraceLog::ConvertTraceEventsToCompactFormat
+          : &TraceLog::ConvertTraceEventsToTraceFormat;
   if (use_worker_thread_) {
     base::ThreadPool::PostTask(
         FROM_HERE,
         {MayBlock(), TaskPriority::BEST_EFFORT,
          TaskShutdownBehavior::CONTINUE_ON_SHUTDOWN},
-        BindOnce(&TraceLog::ConvertTraceEventsToTraceFormat,
-                 std::move(previous_logged_events), flush_output_callback,
-                 argument_filter_predicate));
+        BindOnce(convert_trace_events, std::move(previous_logged_events),
+                 flush_output_callback, argument_filter_predicate));
     return;
   }
 
-  ConvertTraceEventsToTraceFormat(std::move(previous_logged_events),
-                                  flush_output_callback,
-                                  argument_filter_predicate);
+  convert_trace_events(std::move(previous_logged_events),
+                       flush_output_callback, argument_filter_predicate);
 }
 
-// Run in each thread holding a local event buffer.
-void TraceLog::FlushCurrentThread(int generation, bool discard_events) {
-  {
-    AutoLock lock(lock_);
-    if (!CheckGeneration(generation) || !flush_task_runner_) {
-      // This is late. The corresponding flush has finished.
-      return;
-    }
-  }
-
-  // This will flush the thread local buffer.
-  delete thread_local_event_buffer_.Get();
-
-  auto on_flush_override = on_flush_override_.load(std::memory_order_relaxed);
-  if (on_flush_override) {
-    on_flush_override();
-  }
-
-  // Scheduler uses TRACE_EVENT macros when posting a task, which can lead
-  // to acquiring a tracing lock. Given that posting a task requires grabbing
-  // a scheduler lock, we need to post this task outside tracing lock to avoid
-  // deadlocks.
-  scoped_refptr<SequencedTaskRunner> cached_flush_task_runner;
-  {
-    AutoLock lock(lock_);
-    cached_flush_task_runner = flush_task_runner_;
-    if (!CheckGeneration(generation) || !flush_task_runner_ ||
-        !thread_task_runners_.empty())
-      return;
-  }
-  cached_flush_task_runner->PostTask(
-      FROM_HERE, BindOnce(&TraceLog::FinishFlush, Unretained(this), generation,
-                          discard_events));
-}
-
-void TraceLog::OnFlushTimeout(int generation, bool discard_events) {
-  {
-    AutoLock lock(lock_);
-    if (!CheckGeneration(generation) || !flush_task_runner_) {
-      // Flush has finished before timeout.
-      return;
-    }
-
-    LOG(WARNING)
-        << "The following threads haven't finished flush in time. "
-           "If this happens stably for some thread, please call "
-           "TraceLog::GetInstance()->SetCurrentThreadBlocksMessageLoop() from "
-           "the thread to avoid its trace events from being lost.";
-    for (const auto& it : thread_task_runners_) {
-      LOG(WARNING) << "Thread: "
-                   << ThreadIdNameManager::GetInstance()->GetName(it.first);
-    }
-  }
-  FinishFlush(generation, discard_events);
+void TraceLog::FlushThreadLocalEventBuffersWhileLocked() {
+  for (ThreadLocalEventBuffer* buffer : thread_local_event_buffers_)
+    buffer->FlushWhileLocked();
 }
 
 void TraceLog::UseNextTraceBuffer() {
+  FlushThreadLocalEventBuffersWhileLocked();
   logged_events_.reset(CreateTraceBuffer());
   subtle::NoBarrier_AtomicIncrement(&generation_, 1);
   thread_shared_chunk_.reset();
@@ -1710,6 +1856,8 @@ TraceEventHandle TraceLog::AddTraceEvent(
     unsigned long long id,
     TraceArguments* args,
     unsigned int flags) {
+  if (!ShouldSampleEvent(phase, category_group_enabled))
+    return TraceEventHandle::Dropped();
   int thread_id = static_cast<int>(base::PlatformThread::CurrentId());
   base::TimeTicks now = TRACE_TIME_TICKS_NOW();
   return AddTraceEventWithThreadIdAndTimestamp(
@@ -1727,6 +1875,8 @@ TraceEventHandle TraceLog::AddTraceEventWithBindId(
     unsigned long long bind_id,
     TraceArguments* args,
     unsigned int flags) {
+  if (!ShouldSampleEvent(phase, category_group_enabled))
+    return TraceEventHandle::Dropped();
   int thread_id = static_cast<int>(base::PlatformThread::CurrentId());
   base::TimeTicks now = TRACE_TIME_TICKS_NOW();
   return AddTraceEventWithThreadIdAndTimestamp(
@@ -1743,6 +1893,8 @@ TraceEventHandle TraceLog::AddTraceEventWithProcessId(
     int process_id,
     TraceArguments* args,
     unsigned int flags) {
+  if (!ShouldSampleEvent(phase, category_group_enabled))
+    return TraceEventHandle::Dropped();
   base::TimeTicks now = TRACE_TIME_TICKS_NOW();
   return AddTraceEventWithThreadIdAndTimestamp(
       phase, category_group_enabled, name, scope, id,
@@ -1779,6 +1931,9 @@ TraceEventHandle TraceLog::AddTraceEventWithThreadIdAndTimestamp(
     const TimeTicks& timestamp,
     TraceArguments* args,
     unsigned int flags) {
+  if (!ShouldAddSampledEvent(phase, category_group_enabled, timestamp, flags))
+    return TraceEventHandle::Dropped();
+
   ThreadTicks thread_now;
   // If timestamp is provided explicitly, don't record thread time as it would
   // be for the wrong timestamp. Similarly, if we record an event for another
@@ -1788,12 +1943,31 @@ TraceEventHandle TraceLog::AddTraceEventWithThreadIdAndTimestamp(
         thread_id != static_cast<int>(PlatformThread::CurrentId()))) {
     thread_now = ThreadNow();
   }
-  return AddTraceEventWithThreadIdAndTimestamps(
-      phase, category_group_enabled, name, scope, id, bind_id, thread_id,
-      timestamp, thread_now, args, flags);
+  return AddTraceEventAfterSampling(phase, category_group_enabled, name, scope,
+                                    id, bind_id, thread_id, timestamp,
+                                    thread_now, args, flags);
 }
 
 TraceEventHandle TraceLog::AddTraceEventWithThreadIdAndTimestamps(
+    char phase,
+    const unsigned char* category_group_enabled,
+    const char* name,
+    const char* scope,
+    unsigned long long id,
+    unsigned long long bind_id,
+    int thread_id,
+    const TimeTicks& timestamp,
+    const ThreadTicks& thread_timestamp,
+    TraceArguments* args,
+    unsigned int flags) {
+  if (!ShouldAddSampledEvent(phase, category_group_enabled, timestamp, flags))
+    return TraceEventHandle::Dropped();
+  return AddTraceEventAfterSampling(phase, category_group_enabled, name, scope,
+                                    id, bind_id, thread_id, timestamp,
+                                    thread_timestamp, args, flags);
+}
+
+TraceEventHandle TraceLog::AddTraceEventAfterSampling(
     char phase,
     const unsigned char* category_group_enabled,
     const char* name,
@@ -1833,12 +2007,15 @@ TraceEventHandle TraceLog::AddTraceEventWithThreadIdAndTimestamps(
     thread_instruction_now = ThreadInstructionNow();
   }
 
-  ThreadLocalEventBuffer* thread_local_event_buffer = nullptr;
-  if (*category_group_enabled & RECORDING_MODE) {
-    // |thread_local_event_buffer_| can be null if the current thread doesn't
-    // have a message loop or the message loop is blocked.
-    InitializeThreadLocalEventBufferIfSupported();
-    thread_local_event_buffer = thread_local_event_buffer_.Get();
+  // The flight recorder copies what it keeps of the event, without the lock.
+  if (*category_group_enabled & TraceCategory::ENABLED_FOR_FLIGHT_RECORDER) {
+    FlightRecorder* flight_recorder = FlightRecorder::Get();
+    if (flight_recorder) {
+      flight_recorder->AddEvent(phase,
+                                GetCategoryGroupName(category_group_enabled),
+                                name, id, flags, thread_id,
+                                offset_event_timestamp);
+    }
   }
 
   if (*category_group_enabled & RECORDING_MODE) {
@@ -1850,9 +2027,10 @@ TraceEventHandle TraceLog::AddTraceEventWithThreadIdAndTimestamps(
                                  phase, category_group_enabled, name, scope, id,
                                  bind_id, args, flags);
 
-      trace_event_override(
-          &new_trace_event,
-          /*thread_will_flush=*/thread_local_event_buffer != nullptr, &handle);
+      // Flush() doesn't run tasks on the threads anymore, so the override
+      // can't rely on a flush of the current thread.
+      trace_event_override(&new_trace_event, /*thread_will_flush=*/false,
+                           &handle);
       return handle;
     }
   }
@@ -1881,17 +2059,11 @@ TraceEventHandle TraceLog::AddTraceEventWithThreadIdAndTimestamps(
   // filters indicates or category is not enabled for filtering.
   if ((*category_group_enabled & TraceCategory::ENABLED_FOR_RECORDING) &&
       !disabled_by_filters) {
-    OptionalAutoLock lock(&lock_);
-
-    TraceEvent* trace_event = nullptr;
-    if (thread_local_event_buffer) {
-      trace_event = thread_local_event_buffer->AddTraceEvent(&handle);
-    } else {
-      lock.EnsureAcquired();
-      trace_event = AddEventToThreadSharedChunkWhileLocked(&handle, true);
-    }
-
-    // NO_THREAD_SAFETY_ANALYSIS: Conditional locking above.
+    ThreadLocalEventBuffer* thread_local_event_buffer =
+        InitializeThreadLocalEventBuffer();
+    // If an event is returned, Flush() can't take it until EndWrite().
+    TraceEvent* trace_event =
+        thread_local_event_buffer->AddTraceEvent(&handle);
     if (trace_event) {
       if (filtered_trace_event) {
         *trace_event = std::move(*filtered_trace_event);
@@ -1912,6 +2084,9 @@ TraceEventHandle TraceLog::AddTraceEventWithThreadIdAndTimestamps(
           phase == TRACE_EVENT_PHASE_COMPLETE ? TRACE_EVENT_PHASE_BEGIN : phase,
           timestamp, trace_event);
     }
+
+    if (trace_event)
+      thread_local_event_buffer->EndWrite();
   }
 
   if (!console_message.empty())
@@ -2010,6 +2185,11 @@ void TraceLog::UpdateTraceEventDuration(
   if (!category_group_enabled_local)
     return;
 
+  // The event was dropped by the sampler of its category, so its end is
+  // dropped too, before the clocks are read.
+  if (handle.IsDropped())
+    return;
+
   UpdateTraceEventDurationExplicit(
       category_group_enabled, name, handle,
       static_cast<int>(base::PlatformThread::CurrentId()),
@@ -2027,7 +2207,7 @@ void TraceLog::UpdateTraceEventDurationExplicit(
     const ThreadTicks& thread_now,
     ThreadInstructionCount thread_instruction_now) {
   char category_group_enabled_local = *category_group_enabled;
-  if (!category_group_enabled_local)
+  if (!category_group_enabled_local || handle.IsDropped())
     return;
 
   // Avoid re-entrance of AddTraceEvent. This may happen in GPU process when
@@ -2043,6 +2223,17 @@ void TraceLog::UpdateTraceEventDurationExplicit(
     TraceEventETWExport::AddCompleteEndEvent(category_group_enabled, name);
 #endif  // OS_WIN
 
+  // The flight recorder keeps the end of complete events as separate events.
+  if (category_group_enabled_local &
+      TraceCategory::ENABLED_FOR_FLIGHT_RECORDER) {
+    FlightRecorder* flight_recorder = FlightRecorder::Get();
+    if (flight_recorder) {
+      flight_recorder->AddEvent(TRACE_EVENT_PHASE_END,
+                                GetCategoryGroupName(category_group_enabled),
+                                name, 0, TRACE_EVENT_FLAG_NONE, thread_id, now);
+    }
+  }
+
   if (category_group_enabled_local & TraceCategory::ENABLED_FOR_RECORDING) {
     auto update_duration_override =
         update_duration_override_.load(std::memory_order_relaxed);
@@ -2058,7 +2249,17 @@ void TraceLog::UpdateTraceEventDurationExplicit(
   if (category_group_enabled_local & TraceCategory::ENABLED_FOR_RECORDING) {
     OptionalAutoLock lock(&lock_);
 
-    TraceEvent* trace_event = GetEventByHandleInternal(handle, &lock);
+    // An event still in the chunk of the thread local buffer is updated
+    // without the lock, before Flush() can take the chunk.
+    ThreadLocalEventBuffer* thread_local_event_buffer =
+        GetThreadLocalEventBuffer();
+    TraceEvent* trace_event =
+        thread_local_event_buffer
+            ? thread_local_event_buffer->BeginUpdate(handle)
+            : nullptr;
+    const bool is_thread_local_event = !!trace_event;
+    if (!trace_event)
+      trace_event = GetEventByHandleInternal(handle, &lock);
     if (trace_event) {
       DCHECK(trace_event->phase() == TRACE_EVENT_PHASE_COMPLETE);
 
@@ -2072,6 +2273,20 @@ void TraceLog::UpdateTraceEventDurationExplicit(
       console_message =
           EventToConsoleMessage(TRACE_EVENT_PHASE_END, now, trace_event);
     }
+
+    // A complete event which is too short for the sampler of its category is
+    // removed while it is the last event of the chunk of its thread.
+    if (is_thread_local_event &&
+        category_group_enabled_local & TraceCategory::SAMPLED_FOR_RECORDING &&
+        IsSampledEventTooShort(category_group_enabled,
+                               trace_event->duration())) {
+      thread_local_event_buffer->RemoveLastEvent(handle);
+    }
+
+    if (is_thread_local_event)
+      thread_local_event_buffer->EndWrite();
+    else if (trace_event)
+      logged_events_->ReleaseEventByHandle(handle);
   }
 
   if (!console_message.empty())
@@ -2173,7 +2388,21 @@ void TraceLog::AddMetadataEventsWhileLocked() {
 }
 
 TraceEvent* TraceLog::GetEventByHandle(TraceEventHandle handle) {
-  return GetEventByHandleInternal(handle, nullptr);
+  ThreadLocalEventBuffer* thread_local_event_buffer =
+      GetThreadLocalEventBuffer();
+  if (thread_local_event_buffer) {
+    TraceEvent* trace_event = thread_local_event_buffer->BeginUpdate(handle);
+    if (trace_event) {
+      thread_local_event_buffer->EndWrite();
+      return trace_event;
+    }
+  }
+  TraceEvent* trace_event = GetEventByHandleInternal(handle, nullptr);
+  // The caller doesn't hold the lock and can't keep the chunk from being
+  // recycled anyway.
+  if (trace_event)
+    logged_events_->ReleaseEventByHandle(handle);
+  return trace_event;
 }
 
 TraceEvent* TraceLog::GetEventByHandleInternal(TraceEventHandle handle,
@@ -2186,15 +2415,8 @@ TraceEvent* TraceLog::GetEventByHandleInternal(TraceEventHandle handle,
   DCHECK(handle.chunk_index <= TraceBufferChunk::kMaxChunkIndex);
   DCHECK(handle.event_index <= TraceBufferChunk::kTraceBufferChunkSize - 1);
 
-  if (thread_local_event_buffer_.Get()) {
-    TraceEvent* trace_event =
-        thread_local_event_buffer_.Get()->GetEventByHandle(handle);
-    if (trace_event)
-      return trace_event;
-  }
-
-  // The event has been out-of-control of the thread local buffer.
-  // Try to get the event from the main buffer with a lock.
+  // The event isn't in the thread local buffer. Try to get the event from the
+  // main buffer with a lock.
   // NO_THREAD_SAFETY_ANALYSIS: runtime-dependent locking here.
   if (lock)
     lock->EnsureAcquired();
@@ -2269,12 +2491,6 @@ size_t TraceLog::GetObserverCountForTest() const {
   return enabled_state_observers_.size();
 }
 
-void TraceLog::SetCurrentThreadBlocksMessageLoop() {
-  thread_blocks_message_loop_.Set(true);
-  // This will flush the thread local buffer.
-  delete thread_local_event_buffer_.Get();
-}
-
 TraceBuffer* TraceLog::CreateTraceBuffer() {
   HEAP_PROFILER_SCOPED_IGNORE;
   InternalTraceOptions options = trace_options();
@@ -2318,6 +2534,7 @@ void TraceLog::UpdateETWCategoryGroupEnabledFlags() {
 void TraceLog::SetTraceBufferForTesting(
     std::unique_ptr<TraceBuffer> trace_buffer) {
   AutoLock lock(lock_);
+  FlushThreadLocalEventBuffersWhileLocked();
   logged_events_ = std::move(trace_buffer);
 }
 
@@ -2499,6 +2716,11 @@ ScopedTraceBinaryEfficient::ScopedTraceBinaryEfficient(
       category_group, atomic, category_group_enabled_);
   name_ = name;
   if (*category_group_enabled_) {
+    if (!base::trace_event::TraceLog::ShouldSampleEvent(
+            TRACE_EVENT_PHASE_COMPLETE, category_group_enabled_)) {
+      event_handle_ = base::trace_event::TraceEventHandle::Dropped();
+      return;
+    }
     event_handle_ =
         TRACE_EVENT_API_ADD_TRACE_EVENT_WITH_THREAD_ID_AND_TIMESTAMP(
             TRACE_EVENT_PHASE_COMPLETE, category_group_enabled_, name,
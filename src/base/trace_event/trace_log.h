@@ -14,6 +14,7 @@
 #include <unordered_map>
 #include <vector>
 
+#include "base/compiler_specific.h"
 #include "base/containers/stack.h"
 #include "base/gtest_prod_util.h"
 #include "base/macros.h"
@@ -21,6 +22,7 @@
 #include "base/no_destructor.h"
 #include "base/task/single_thread_task_runner.h"
 #include "base/threading/platform_thread.h"
+#include "base/threading/thread_local_storage.h"
 #include "base/time/time_override.h"
 #include "base/trace_event/category_registry.h"
 #include "base/trace_event/memory_dump_provider.h"
@@ -72,7 +74,12 @@ class BASE_EXPORT TraceLog :
 
     // Trace events are enabled just for filtering but not for recording. Only
     // event filters config of |trace_config| argument is used.
-    FILTERING_MODE = 1 << 1
+    FILTERING_MODE = 1 << 1,
+
+    // Trace events are kept in the ring of the FlightRecorder, which must have
+    // been created, without a trace buffer. Only the flight recorder config of
+    // |trace_config| argument is used.
+    FLIGHT_RECORDER_MODE = 1 << 2
   };
 
   static TraceLog* GetInstance();
@@ -83,18 +90,15 @@ class BASE_EXPORT TraceLog :
   // Retrieves a copy (for thread-safety) of the current TraceConfig.
   TraceConfig GetCurrentTraceConfig() const;
 
-  // Initializes the thread-local event buffer, if not already initialized and
-  // if the current thread supports that (has a message loop).
-  void InitializeThreadLocalEventBufferIfSupported();
-
   // See TraceConfig comments for details on how to control which categories
   // will be traced. SetDisabled must be called distinctly for each mode that is
   // enabled. If tracing has already been enabled for recording, category filter
   // (enabled and disabled categories) will be merged into the current category
   // filter. Enabling RECORDING_MODE does not enable filters. Trace event
   // filters will be used only if FILTERING_MODE is set on |modes_to_enable|.
-  // Conversely to RECORDING_MODE, FILTERING_MODE doesn't support upgrading,
-  // i.e. filters can only be enabled if not previously enabled.
+  // Conversely to RECORDING_MODE, FILTERING_MODE and FLIGHT_RECORDER_MODE
+  // don't support upgrading, i.e. filters and flight recorder categories can
+  // only be enabled if not previously enabled.
   void SetEnabled(const TraceConfig& trace_config, uint8_t modes_to_enable);
 
 #if BUILDFLAG(USE_PERFETTO_CLIENT_LIBRARY)
@@ -227,6 +231,14 @@ class BASE_EXPORT TraceLog :
                                    bool has_more_events)>;
   void Flush(const OutputCallback& cb, bool use_worker_thread = false);
 
+#if !BUILDFLAG(USE_PERFETTO_CLIENT_LIBRARY)
+  // Like Flush(), but serializes the events in the binary format of
+  // CompactTraceWriter, which is several times smaller and cheaper to produce
+  // than JSON. The pieces can be concatenated, e.g. into a file, and converted
+  // to JSON with CompactTraceReader.
+  void FlushCompact(const OutputCallback& cb, bool use_worker_thread = false);
+#endif  // !BUILDFLAG(USE_PERFETTO_CLIENT_LIBRARY)
+
   // Cancels tracing and discards collected data.
   void CancelTracing(const OutputCallback& cb);
 
@@ -275,6 +287,21 @@ class BASE_EXPORT TraceLog :
                                    unsigned long long id,
                                    int thread_id,
                                    TraceArguments* args);
+
+  // Called by TRACE_EVENT* macros before they read the clock and convert the
+  // arguments, don't call this directly. Returns whether the event of |phase|
+  // is kept by the one-in-N sampling of its category, if the category is
+  // sampled. The events which are dropped get TraceEventHandle::Dropped().
+  // The methods below which read the clock call this themselves, and so does
+  // AddTraceEventWithThreadIdAndTimestamp() with
+  // TRACE_EVENT_FLAG_EXPLICIT_TIMESTAMP.
+  static bool ShouldSampleEvent(char phase,
+                                const unsigned char* category_group_enabled) {
+    return LIKELY(!(*category_group_enabled &
+                    TraceCategory::SAMPLED_FOR_RECORDING)) ||
+           ShouldSampleEventSlow(phase, category_group_enabled);
+  }
+
   TraceEventHandle AddTraceEvent(char phase,
                                  const unsigned char* category_group_enabled,
                                  const char* name,
@@ -419,11 +446,6 @@ class BASE_EXPORT TraceLog :
 
   size_t GetObserverCountForTest() const;
 
-  // Call this method if the current thread may block the message loop to
-  // prevent the thread from using the thread-local buffer because the thread
-  // may not handle the flush request in time causing lost of unflushed events.
-  void SetCurrentThreadBlocksMessageLoop();
-
 #if defined(OS_WIN)
   // This function is called by the ETW exporting module whenever the ETW
   // keyword (flags) changes. This keyword indicates which categories should be
@@ -476,6 +498,41 @@ class BASE_EXPORT TraceLog :
   void UpdateCategoryState(TraceCategory* category);
 
   void CreateFiltersForTraceConfig();
+  void CreateSamplersForTraceConfig();
+
+  static bool ShouldSampleEventSlow(
+      char phase,
+      const unsigned char* category_group_enabled);
+
+  // Returns whether the event of |phase| at |timestamp| is kept by the sampler
+  // of its category, if the category is sampled. The one-in-N sampling is
+  // only applied to the events with TRACE_EVENT_FLAG_EXPLICIT_TIMESTAMP in
+  // |flags|, as ShouldSampleEvent() was called for the others before the
+  // clock was read. Called before the thread time is read.
+  bool ShouldAddSampledEvent(char phase,
+                             const unsigned char* category_group_enabled,
+                             const TimeTicks& timestamp,
+                             unsigned int flags);
+
+  // Implements AddTraceEventWithThreadIdAndTimestamps() once the event is
+  // sampled.
+  TraceEventHandle AddTraceEventAfterSampling(
+      char phase,
+      const unsigned char* category_group_enabled,
+      const char* name,
+      const char* scope,
+      unsigned long long id,
+      unsigned long long bind_id,
+      int thread_id,
+      const TimeTicks& timestamp,
+      const ThreadTicks& thread_timestamp,
+      TraceArguments* args,
+      unsigned int flags);
+
+  // Returns whether a complete event of a sampled category which took
+  // |duration| is too short to be kept by the sampler of the category.
+  bool IsSampledEventTooShort(const unsigned char* category_group_enabled,
+                              TimeDelta duration);
 
   InternalTraceOptions GetInternalOptionsFromTraceConfig(
       const TraceConfig& config);
@@ -510,29 +567,44 @@ class BASE_EXPORT TraceLog :
       EXCLUSIVE_LOCKS_REQUIRED(lock_);
   void CheckIfBufferIsFullWhileLocked() EXCLUSIVE_LOCKS_REQUIRED(lock_);
   void SetDisabledWhileLocked(uint8_t modes) EXCLUSIVE_LOCKS_REQUIRED(lock_);
+  // Takes the chunks of the thread local buffers, which stop accepting events.
+  // Must be done before replacing |logged_events_|, which the threads use
+  // without |lock_| if it is lock-free.
+  void FlushThreadLocalEventBuffersWhileLocked()
+      EXCLUSIVE_LOCKS_REQUIRED(lock_);
+
+  // Returns the event buffer of the current thread, creating it if it doesn't
+  // exist or if it was flushed.
+  ThreadLocalEventBuffer* InitializeThreadLocalEventBuffer();
+  ThreadLocalEventBuffer* GetThreadLocalEventBuffer() const;
 
   TraceEvent* GetEventByHandleInternal(TraceEventHandle handle,
                                        OptionalAutoLock* lock);
 
+  enum class FlushFormat { kJSON, kCompact };
+
   void FlushInternal(const OutputCallback& cb,
                      bool use_worker_thread,
-                     bool discard_events);
+                     bool discard_events,
+                     FlushFormat format);
 
 #if BUILDFLAG(USE_PERFETTO_CLIENT_LIBRARY)
   tracing::PerfettoPlatform* GetOrCreatePerfettoPlatform();
   void OnTraceData(const char* data, size_t size, bool has_more);
 #endif  // BUILDFLAG(USE_PERFETTO_CLIENT_LIBRARY)
 
-  // |generation| is used in the following callbacks to check if the callback
-  // is called for the flush of the current |logged_events_|.
-  void FlushCurrentThread(int generation, bool discard_events);
   // Usually it runs on a different thread.
   static void ConvertTraceEventsToTraceFormat(
       std::unique_ptr<TraceBuffer> logged_events,
       const TraceLog::OutputCallback& flush_output_callback,
       const ArgumentFilterPredicate& argument_filter_predicate);
+  static void ConvertTraceEventsToCompactFormat(
+      std::unique_ptr<TraceBuffer> logged_events,
+      const TraceLog::OutputCallback& flush_output_callback,
+      const ArgumentFilterPredicate& argument_filter_predicate);
+  // |generation| is used to check if FinishFlush() is called for the flush of
+  // the current |logged_events_|.
   void FinishFlush(int generation, bool discard_events);
-  void OnFlushTimeout(int generation, bool discard_events);
 
   int generation() const {
     return static_cast<int>(subtle::NoBarrier_Load(&generation_));
@@ -606,29 +678,30 @@ class BASE_EXPORT TraceLog :
 
   TraceConfig trace_config_;
   TraceConfig::EventFilters enabled_event_filters_;
+  TraceConfig::FlightRecorderConfig enabled_flight_recorder_config_;
 
-  ThreadLocalPointer<ThreadLocalEventBuffer> thread_local_event_buffer_;
-  ThreadLocalBoolean thread_blocks_message_loop_;
+  // Owns the ThreadLocalEventBuffer of each thread, which is deleted when the
+  // thread exits.
+  ThreadLocalStorage::Slot thread_local_event_buffer_;
   ThreadLocalBoolean thread_is_in_trace_event_;
 
-  // Contains task runners for the threads that have had at least one event
-  // added into the local event buffer.
-  std::unordered_map<int, scoped_refptr<SingleThreadTaskRunner>>
-      thread_task_runners_;
+  // The event buffers of all the threads that have added at least one event,
+  // whose chunks Flush() collects without running tasks on these threads.
+  std::vector<ThreadLocalEventBuffer*> thread_local_event_buffers_
+      GUARDED_BY(lock_);
 
-  // For events which can't be added into the thread local buffer, e.g. events
-  // from threads without a message loop.
+  // For events which are added while holding |lock_|, e.g. metadata events.
   std::unique_ptr<TraceBufferChunk> thread_shared_chunk_;
   size_t thread_shared_chunk_index_;
 
-  // Set when asynchronous Flush is in progress.
+  // Set while Flush() is in progress.
   OutputCallback flush_output_callback_;
-  scoped_refptr<SequencedTaskRunner> flush_task_runner_;
   ArgumentFilterPredicate argument_filter_predicate_;
   MetadataFilterPredicate metadata_filter_predicate_;
   bool record_host_app_package_name_{false};
   subtle::AtomicWord generation_;
   bool use_worker_thread_;
+  FlushFormat flush_format_ = FlushFormat::kJSON;
   std::atomic<AddTraceEventOverrideFunction> add_trace_event_override_{nullptr};
   std::atomic<OnFlushFunction> on_flush_override_{nullptr};
   std::atomic<UpdateDurationFunction> update_duration_override_{nullptr};